@@ -20,6 +20,7 @@ namespace llvm {
 }
 
 namespace klee {
+  class ArrayCache;
   class ExprBuilder;
 
 namespace expr {
@@ -228,8 +229,12 @@ namespace expr {
     /// \arg MB - The input data.
     /// \arg Builder - The expression builder to use for constructing
     /// expressions.
+    /// \arg TheArrayCache - The cache owning the parsed arrays, or null for
+    /// one owned by the parser. A cache outliving the parser keeps the
+    /// arrays, hence their addresses, across the parsed inputs.
     static Parser *Create(const std::string Name, const llvm::MemoryBuffer *MB,
-                          ExprBuilder *Builder, bool ClearArrayAfterQuery);
+                          ExprBuilder *Builder, bool ClearArrayAfterQuery,
+                          ArrayCache *TheArrayCache = 0);
   };
 }
 }
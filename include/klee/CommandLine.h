@@ -10,11 +10,7 @@
 #include "klee/Config/config.h"
 
 #ifdef ENABLE_Z3
-#ifdef ENABLE_STP
-#define INTERPOLATION_ENABLED (CoreSolverToUse == Z3_SOLVER && !NoInterpolation)
-#else
 #define INTERPOLATION_ENABLED (!NoInterpolation)
-#endif
 #define OUTPUT_INTERPOLATION_TREE (INTERPOLATION_ENABLED &&OutputTree)
 #else
 #define INTERPOLATION_ENABLED false
@@ -29,16 +25,32 @@ extern llvm::cl::opt<bool> UseCexCache;
 
 extern llvm::cl::opt<bool> UseCache;
 
+extern llvm::cl::opt<bool> UseUnsatCoreCache;
+
+extern llvm::cl::opt<std::string> QueryCacheFile;
+
+extern llvm::cl::opt<unsigned> QueryCacheMaxSize;
+
+extern llvm::cl::opt<bool> UseAlphaCache;
+
 extern llvm::cl::opt<bool> UseIndependentSolver;
 
+extern llvm::cl::opt<bool> UseRangeSolver;
+
+extern llvm::cl::opt<unsigned> SmallArraySize;
+
 extern llvm::cl::opt<bool> DebugValidateSolver;
 
+extern llvm::cl::opt<double> ValidateSolverSample;
+
 extern llvm::cl::opt<int> MinQueryTimeToLog;
 
 extern llvm::cl::opt<double> MaxCoreSolverTime;
 
 extern llvm::cl::opt<bool> UseForkedCoreSolver;
 
+extern llvm::cl::opt<bool> UseSolverWorker;
+
 extern llvm::cl::opt<bool> CoreSolverOptimizeDivides;
 
 /// The different query logging solvers that can switched on/off
@@ -79,10 +91,34 @@ enum SpecStrategy {
   CUSTOM
 };
 
+/// The orders in which subsumption table entries are tried
+enum SubsumptionEntryOrder {
+  NEWEST_FIRST,  ///< Newest entry first
+  MOVE_TO_FRONT, ///< Most recently successful entry first
+  HIT_RATE       ///< Entry with the highest success rate first
+};
+
+/// The policies for choosing the subsumption table entries to evict
+enum SubsumptionEvictionPolicy {
+  EVICT_LRU,        ///< Least recently successful entry first
+  EVICT_LEAST_HIT,  ///< Entry with the fewest subsumptions first
+  EVICT_LARGEST     ///< Largest entry first
+};
+
+/// The control points at which subsumption table entries are stored and
+/// checked
+enum SubsumptionPointPolicy {
+  ALL_POINTS,  ///< The program points of all nodes
+  LOOP_POINTS, ///< Loop headers and function entries
+  JOIN_POINTS  ///< Loop headers, join points and function entries
+};
+
 extern llvm::cl::opt<CoreSolverType> CoreSolverToUse;
 
 extern llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith;
 
+extern llvm::cl::list<CoreSolverType> PortfolioSolvers;
+
 // We should compile in this option even when ENABLE_Z3
 // was undefined to avoid regression test failure.
 extern llvm::cl::opt<bool> NoInterpolation;
@@ -91,6 +127,8 @@ extern llvm::cl::opt<bool> NoInterpolation;
 
 extern llvm::cl::opt<bool> OutputTree;
 
+extern llvm::cl::opt<bool> CompressOutputTree;
+
 extern llvm::cl::opt<bool> SubsumedTest;
 
 extern llvm::cl::opt<bool> NoExistential;
@@ -117,12 +155,88 @@ extern llvm::cl::opt<SpecStrategy> SpecStrategyToUse;
 
 extern llvm::cl::opt<std::string> DependencyFolder;
 
+extern llvm::cl::opt<unsigned> SpecBackoff;
+
+extern llvm::cl::opt<unsigned> SpecBackoffMaxGap;
+
+extern llvm::cl::opt<bool> SpecDependencyAnalysis;
+
 extern llvm::cl::opt<bool> WPInterpolant;
 
 extern llvm::cl::opt<bool> MarkGlobal;
 
+extern llvm::cl::opt<bool> SubsumptionPrefilter;
+
+extern llvm::cl::opt<bool> SubsumptionArrayPrefilter;
+
+extern llvm::cl::opt<unsigned> SubsumptionThreads;
+
+extern llvm::cl::opt<unsigned> SubsumptionBackoff;
+
+extern llvm::cl::opt<unsigned> SubsumptionBackoffMaxGap;
+
+extern llvm::cl::opt<unsigned> SubsumptionFailureSharing;
+
+extern llvm::cl::opt<SubsumptionEntryOrder> SubsumptionEntryOrderToUse;
+
+extern llvm::cl::opt<SubsumptionPointPolicy> SubsumptionPoints;
+
+extern llvm::cl::opt<unsigned> MaxSubsumptionTableMemory;
+
+extern llvm::cl::opt<unsigned> MaxSubsumptionPointEntries;
+
+extern llvm::cl::opt<SubsumptionEvictionPolicy> SubsumptionEvictionPolicyToUse;
+
+extern llvm::cl::opt<unsigned> MaxInterpolantNodes;
+
+extern llvm::cl::opt<unsigned> MaxInterpolantDepth;
+
+extern llvm::cl::opt<unsigned> SubsumptionQueryCacheSize;
+
+extern llvm::cl::opt<bool> SubsumptionModelRefutation;
+
+extern llvm::cl::opt<bool> SubsumptionPartitioning;
+
+extern llvm::cl::opt<bool> SubsumptionEntryPruning;
+
+extern llvm::cl::opt<bool> SubsumptionEntryInterning;
+
+extern llvm::cl::opt<bool> LoopEntryGeneralization;
+
+extern llvm::cl::opt<unsigned> SubsumptionSmallArraySize;
+
+extern llvm::cl::opt<bool> CompactHistoricalStore;
+
+extern llvm::cl::opt<unsigned> AsyncInterpolants;
+
+extern llvm::cl::opt<unsigned> SampleNodeMemory;
+
+extern llvm::cl::opt<bool> LogSubsumptionQueries;
+
+extern llvm::cl::opt<std::string> SubsumptionTableFile;
+
+extern llvm::cl::opt<bool> SeparateSubsumptionSolver;
+
+extern llvm::cl::opt<bool> SubsumptionUseCache;
+
+extern llvm::cl::opt<bool> SubsumptionUseCexCache;
+
+extern llvm::cl::opt<bool> SubsumptionUseIndependentSolver;
+
+extern llvm::cl::opt<double> SubsumptionSolverTimeout;
+
+extern llvm::cl::opt<double> SubsumptionAdaptiveTimeout;
+
+extern llvm::cl::opt<double> SubsumptionTimeFraction;
+
+extern llvm::cl::opt<unsigned> Z3RecycleMemory;
+
 extern llvm::cl::opt<bool> DebugTracerX;
 
+extern llvm::cl::opt<unsigned> TxTimerSampling;
+
+extern llvm::cl::opt<bool> TxCycleTimer;
+
 #endif
 
 #ifdef ENABLE_METASMT
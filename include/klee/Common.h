@@ -27,6 +27,12 @@ namespace klee {
                                  std::string baseSolverQuerySMT2LogPath,
                                  std::string queryPCLogPath,
                                  std::string baseSolverQueryPCLogPath);
+
+#ifdef ENABLE_Z3
+    /// Construct the solver chain of the subsumption checks, configured by
+    /// the -subsumption-use-* options.
+    Solver *constructSubsumptionSolverChain(Solver *coreSolver);
+#endif
 }
 
 
@@ -11,6 +11,10 @@
 #define KLEE_CONSTRAINTS_H
 
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+
+#include <map>
+#include <vector>
 
 // FIXME: Currently we use ConstraintManager for two things: to pass
 // sets of constraints around, and to optimize constraints. We should
@@ -19,21 +23,76 @@
 namespace klee {
 
 class ExprVisitor;
-  
+
+/// Union-find partition of a constraint sequence into independent sets. Two
+/// constraints are in the same set if they are connected by a chain of
+/// constraints reading common array elements, where a read at a symbolic
+/// index counts as a read of the whole array. This is the closure computed by
+/// the independent solver, maintained as the constraints are added.
+class ConstraintPartition {
+  /// An array element, or the whole array when the index is ~0u
+  typedef std::pair<const Array *, unsigned> key_ty;
+
+  std::map<key_ty, unsigned> keyIds;
+  std::vector<unsigned> parent;
+  std::vector<unsigned> rank;
+
+  /// The key of some read of each constraint, or ~0u if it reads no array
+  std::vector<unsigned> constraintKeys;
+
+  static void getKeys(ref<Expr> e, std::vector<key_ty> &keys);
+
+  unsigned find(unsigned id) const;
+  unsigned unite(unsigned a, unsigned b);
+  unsigned getKeyId(const key_ty &key);
+
+public:
+  /// Append the constraint following the previously added ones
+  void add(ref<Expr> e);
+
+  void clear();
+
+  /// The number of constraints added
+  size_t size() const { return constraintKeys.size(); }
+
+  /// Set the flag of each constraint that is in the same set as the
+  /// expression. Returns false if the expression reads no array that the
+  /// partition tracks, in which case no flag is set.
+  bool getDependent(ref<Expr> e, std::vector<bool> &dependent) const;
+};
+
 class ConstraintManager {
 public:
   typedef std::vector< ref<Expr> > constraints_ty;
   typedef constraints_ty::iterator iterator;
   typedef constraints_ty::const_iterator const_iterator;
 
-  ConstraintManager() {}
+  /// The replacement of each expression known from the constraints, with
+  /// the constraint it is known from: the constant of an equality with a
+  /// constant, or true for the other constraints
+  typedef ImmutableMap<ref<Expr>, std::pair<ref<Expr>, ref<Expr> > >
+  equalities_ty;
+
+  /// The unsigned range of a term known from the constraints, with the
+  /// constraints each bound is known from
+  struct Range {
+    uint64_t min, max;
+    std::vector<ref<Expr> > minCore, maxCore;
+  };
+
+  typedef ImmutableMap<ref<Expr>, Range> ranges_ty;
+
+  ConstraintManager() : equalitiesSize(0), rangesSize(0) {}
 
   // create from constraints with no optimization
   explicit
   ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+    constraints(_constraints), equalitiesSize(0), rangesSize(0) {}
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+  ConstraintManager(const ConstraintManager &cs)
+      : constraints(cs.constraints), partition(cs.partition),
+        equalities(cs.equalities), equalitiesSize(cs.equalitiesSize),
+        ranges(cs.ranges), rangesSize(cs.rangesSize) {}
 
   typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
 
@@ -45,6 +104,14 @@ public:
 
   ref<Expr> simplifyExpr(ref<Expr> e, std::vector<ref<Expr> > &core) const;
 
+  /// Decide a comparison of a term with a constant from the unsigned range
+  /// of the term known from the comparisons of the constraints with
+  /// constants, without a solver. Returns false if the range does not
+  /// decide it, and otherwise sets the value of the expression and adds to
+  /// the core the constraints the value follows from.
+  bool evaluateRange(ref<Expr> e, bool &value,
+                     std::vector<ref<Expr> > &core) const;
+
   void addConstraint(ref<Expr> e);
   
   bool empty() const {
@@ -71,11 +138,46 @@ public:
 	  return constraints;
   }
 
+  /// Collect, in order, the constraints that the expression transitively
+  /// depends on through common array elements. This uses the partition kept
+  /// by addConstraint, and returns false without collecting anything if the
+  /// constraints were instead given to the constructor.
+  bool getIndependentConstraints(ref<Expr> e,
+                                 std::vector<ref<Expr> > &result) const;
+
 private:
   std::vector< ref<Expr> > constraints;
 
-  // returns true iff the constraints were modified
-  bool rewriteConstraints(ExprVisitor &visitor);
+  /// The independence partition of the constraints, complete when its size
+  /// is the number of constraints
+  ConstraintPartition partition;
+
+  /// The replacements used by simplifyExpr of the first equalitiesSize
+  /// constraints, shared with the copies of the manager. They are kept up
+  /// to date as the constraints are pushed, and caught up by simplifyExpr
+  /// for the constraints given to the constructor.
+  mutable equalities_ty equalities;
+  mutable size_t equalitiesSize;
+
+  void addEquality(ref<Expr> e) const;
+
+  /// The ranges used by evaluateRange of the terms of the first rangesSize
+  /// constraints, kept and caught up as the equalities
+  mutable ranges_ty ranges;
+  mutable size_t rangesSize;
+
+  Range getRange(ref<Expr> term) const;
+
+  void narrowRange(ref<Expr> term, bool isMin, uint64_t bound,
+                   const std::vector<ref<Expr> > &core) const;
+
+  void addRange(ref<Expr> e) const;
+
+  void pushConstraint(ref<Expr> e);
+
+  // returns true iff the constraints were modified. Only the constraints
+  // that may contain the expression replaced by the visitor are visited.
+  bool rewriteConstraints(ExprVisitor &visitor, ref<Expr> replaced);
 
   void addConstraintInternal(ref<Expr> e);
 };
@@ -12,10 +12,14 @@
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/CopyOnWrite.h"
 #include "klee/Internal/ADT/TreeStream.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
 
 // FIXME: We do not want to be exposing these? :(
 #include "../../lib/Core/AddressSpace.h"
+#include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstIterator.h"
 #include "klee/Internal/Module/KInstruction.h"
 
@@ -32,7 +36,7 @@
 namespace klee {
 class Array;
 class CallPathNode;
-struct Cell;
+class CheckpointNode;
 struct KFunction;
 struct KInstruction;
 class MemoryObject;
@@ -48,7 +52,10 @@ struct StackFrame {
   CallPathNode *callPathNode;
 
   std::vector<const MemoryObject *> allocas;
-  Cell *locals;
+
+  /// The register file, shared with the frames copied from this one by
+  /// forking until either writes to it.
+  CopyOnWrite<std::vector<Cell> > locals;
 
   /// Minimum distance to an uncovered instruction once the function
   /// returns. This is not a good place for this but is used to
@@ -65,8 +72,51 @@ struct StackFrame {
   MemoryObject *varargs;
 
   StackFrame(KInstIterator caller, KFunction *kf);
-  StackFrame(const StackFrame &s);
-  ~StackFrame();
+
+  const Cell &getLocal(unsigned index) const { return (*locals)[index]; }
+  Cell &getWriteableLocal(unsigned index) { return locals.mutate()[index]; }
+};
+
+/// @brief Ordered list of symbolics, holding a reference to each of the
+/// memory objects.
+class SymbolicList {
+public:
+  typedef std::pair<const MemoryObject *, const Array *> value_type;
+
+private:
+  std::vector<value_type> list;
+
+  // unsupported, use copy constructor
+  SymbolicList &operator=(const SymbolicList &);
+
+public:
+  SymbolicList() {}
+  SymbolicList(const SymbolicList &b);
+  ~SymbolicList();
+
+  void push_back(const value_type &symbolic);
+
+  unsigned size() const { return list.size(); }
+  const value_type &operator[](unsigned index) const { return list[index]; }
+
+  bool operator==(const SymbolicList &b) const { return list == b.list; }
+};
+
+/// @brief A fork choice on the path of a state, linked to the choices
+/// before it and shared with the states forked after it
+class ForkChoice {
+public:
+  unsigned refCount;
+
+  /// @brief The choice of the previous fork on the path, or null
+  const ref<ForkChoice> previous;
+
+  /// @brief The index of the side taken, 1 for the true side of a
+  /// two-way fork
+  const unsigned choice;
+
+  ForkChoice(const ref<ForkChoice> &_previous, unsigned _choice)
+      : refCount(0), previous(_previous), choice(_choice) {}
 };
 
 /// @brief ExecutionState representing a path under exploration
@@ -78,7 +128,7 @@ private:
   // unsupported, use copy constructor
   ExecutionState &operator=(const ExecutionState &);
 
-  std::map<std::string, std::string> fnAliases;
+  CopyOnWrite<std::map<std::string, std::string> > fnAliases;
 
   void addTxTreeConstraint(ref<Expr> e, llvm::Instruction *instr);
 
@@ -138,7 +188,7 @@ public:
   bool forkDisabled;
 
   /// @brief Set containing which lines in which files are covered by this state
-  std::map<const std::string *, std::set<unsigned> > coveredLines;
+  CopyOnWrite<std::map<const std::string *, std::set<unsigned> > > coveredLines;
 
   /// @brief Pointer to the process tree of the current state
   PTreeNode *ptreeNode;
@@ -147,19 +197,45 @@ public:
   TxTreeNode *txTreeNode;
 
   /// @brief Ordered list of symbolics: used to generate test cases.
-  //
-  // FIXME: Move to a shared list structure (not critical).
-  std::vector<std::pair<const MemoryObject *, const Array *> > symbolics;
+  /// Shared with the forked states until either adds a symbolic.
+  CopyOnWrite<SymbolicList> symbolics;
 
   /// @brief Set of used array names for this state.  Used to avoid collisions.
-  std::set<std::string> arrayNames;
+  CopyOnWrite<std::set<std::string> > arrayNames;
+
+  /// @brief The last satisfying assignment given by the solver for the path
+  /// condition, possibly before constraints were added, under
+  /// -reuse-state-model. Shared with the forked states until either gets
+  /// its own.
+  CopyOnWrite<Assignment> model;
+
+  /// @brief The expressions found to have a single value under the path
+  /// condition when concretized, under -cache-unique-values. They keep it as
+  /// constraints are added, and the cache is only reset by a merge, which
+  /// weakens the path condition. Shared with the forked states until either
+  /// concretizes.
+  mutable CopyOnWrite<ExprHashMap<ref<ConstantExpr> > > uniqueValues;
+
+  /// @brief The bytes of the symbolic arrays whose values implied-value
+  /// concretization has already handled, so that an equality implying them
+  /// again does not look up their objects. Shared with the forked states
+  /// until either concretizes.
+  CopyOnWrite<std::set<std::pair<const Array *, unsigned> > > impliedBytes;
+
+  /// @brief The last fork choice on the path, recorded under
+  /// -checkpoint-dir
+  ref<ForkChoice> forkChoices;
+
+  /// @brief The node of the path in the restored checkpoint, or null when
+  /// the path is not within the checkpoint
+  const CheckpointNode *checkpointNode;
 
   std::string getFnAlias(std::string fn);
   void addFnAlias(std::string old_fn, std::string new_fn);
   void removeFnAlias(std::string fn);
 
 private:
-  ExecutionState() : ptreeNode(0), txTreeNode(0) {}
+  ExecutionState() : ptreeNode(0), txTreeNode(0), checkpointNode(0) {}
 
 public:
   ExecutionState(KFunction *kf);
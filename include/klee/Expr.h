@@ -96,7 +96,24 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 class Expr {
 public:
   static unsigned count;
-  static const unsigned MAGIC_HASH_CONSTANT = 39;
+
+  /// The bytes allocated by the live expressions
+  static size_t allocatedBytes;
+
+  /// The comparisons of distinct expressions of equal hashes, which are not
+  /// decided by the hashes, and those of them which found the expressions to
+  /// differ
+  static uint64_t equalHashCompares;
+  static uint64_t hashCollisions;
+
+  /// Combine a value into a hash. The result depends on the order in which
+  /// the values are combined, and distinct values combined into the same
+  /// seed give distinct results.
+  static uint64_t combineHash(uint64_t seed, uint64_t value) {
+    uint64_t h = seed * UINT64_C(0x9E3779B97F4A7C15) + value;
+    h ^= h >> 32;
+    return h * UINT64_C(0xD6E8FEB86659FD93);
+  }
 
   /// The type of an expression is simply its width, in bits. 
   typedef unsigned Width; 
@@ -181,11 +198,33 @@ public:
   unsigned refCount;
 
 protected:  
-  unsigned hashValue;
-  
+  uint64_t hashValue;
+
+private:
+  /// The arrays read by the expression, computed by getReadArrays
+  mutable const std::vector<const Array *> *readArrays;
+
+  static const std::vector<const Array *> noReadArrays;
+
 public:
-  Expr() : refCount(0) { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  Expr() : refCount(0), readArrays(0) { incrementSharedCount(Expr::count); }
+
+  /// Count the bytes of the expressions, for the memory accounting of the
+  /// executor
+  static void *operator new(size_t size) {
+    addSharedCount(allocatedBytes, size);
+    return ::operator new(size);
+  }
+  static void operator delete(void *p, size_t size) {
+    subSharedCount(allocatedBytes, size);
+    ::operator delete(p);
+  }
+
+  virtual ~Expr() {
+    decrementSharedCount(Expr::count);
+    if (readArrays != &noReadArrays)
+      delete readArrays;
+  }
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -199,11 +238,22 @@ public:
   void dump() const;
 
   /// Returns the pre-computed hash of the current expression
-  virtual unsigned hash() const { return hashValue; }
+  virtual uint64_t hash() const { return hashValue; }
+
+  /// Returns the root arrays of the reads in the expression, including the
+  /// reads in the indices and updates of other reads, sorted by address. The
+  /// arrays are computed on the first call and cached in the expression.
+  const std::vector<const Array *> &getReadArrays() const;
+
+  /// Returns true if the expression reads an array in the given set
+  bool readsArrayIn(const std::set<const Array *> &arrays) const;
+
+  /// Returns true if the expression reads an array not in the given set
+  bool readsArrayNotIn(const std::set<const Array *> &arrays) const;
 
   /// (Re)computes the hash of the current expression.
   /// Returns the hash value. 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
   
   /// Returns 0 iff b is structuraly equivalent to *this
   typedef llvm::DenseSet<std::pair<const Expr *, const Expr *> > ExprEquivSet;
@@ -411,7 +461,7 @@ public:
     return create(variables, kids[0]);
   }
 
-  unsigned computeHash();
+  uint64_t computeHash();
 
   static bool classof(const Expr *E) { return E->getKind() == Expr::Exists; }
 
@@ -456,7 +506,7 @@ public:
 
   void print(llvm::raw_ostream &os) const;
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
 private:
   WPVarExpr(llvm::Value *_address, std::string _name, const ref<Expr> &_index)
@@ -507,7 +557,7 @@ public:
 
   void print(llvm::raw_ostream &os) const;
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
 private:
   UpdExpr(const ref<Expr> &_array, const ref<Expr> &_index,
@@ -551,7 +601,7 @@ public:
 
   void print(llvm::raw_ostream &os) const;
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
 private:
   SelExpr(const ref<Expr> &_array, const ref<Expr> &_index) : array(_array) {
@@ -604,7 +654,7 @@ class UpdateNode {
 
   mutable unsigned refCount;
   // cache instead of recalc
-  unsigned hashValue;
+  uint64_t hashValue;
 
 public:
   const UpdateNode *next;
@@ -622,13 +672,13 @@ public:
   unsigned getSize() const { return size; }
 
   int compare(const UpdateNode &b) const;  
-  unsigned hash() const { return hashValue; }
+  uint64_t hash() const { return hashValue; }
 
 private:
   UpdateNode() : refCount(0) {}
   ~UpdateNode();
 
-  unsigned computeHash();
+  uint64_t computeHash();
 };
 
 class Array {
@@ -649,7 +699,12 @@ public:
   const std::vector<ref<ConstantExpr> > constantValues;
 
 private:
-  unsigned hashValue;
+  uint64_t hashValue;
+
+  /// The shadow of this array, the existentially-quantified counterpart of
+  /// the array in Tracer-X interpolants, as created by
+  /// ArrayCache::CreateShadowArray
+  mutable const Array *shadow;
 
   // FIXME: Make =delete when we switch to C++11
   Array(const Array& array);
@@ -680,9 +735,12 @@ public:
   Expr::Width getDomain() const { return domain; }
   Expr::Width getRange() const { return range; }
 
+  /// getShadow - The shadow of this array, or null if it has none.
+  const Array *getShadow() const { return shadow; }
+
   /// ComputeHash must take into account the name, the size, the domain, and the range
-  unsigned computeHash();
-  unsigned hash() const { return hashValue; }
+  uint64_t computeHash();
+  uint64_t hash() const { return hashValue; }
   friend class ArrayCache;
 };
 
@@ -709,7 +767,7 @@ public:
   void extend(const ref<Expr> &index, const ref<Expr> &value);
 
   int compare(const UpdateList &b) const;
-  unsigned hash() const;
+  uint64_t hash() const;
 private:
   void tryFreeNodes();
 };
@@ -751,7 +809,7 @@ public:
     return create(updates, kids[0]);
   }
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
 private:
   ReadExpr(const UpdateList &_updates, const ref<Expr> &_index) : 
@@ -917,7 +975,7 @@ public:
     return create(kids[0], offset, width);
   }
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
 private:
   ExtractExpr(const ref<Expr> &e, unsigned b, Width w) 
@@ -966,7 +1024,7 @@ public:
     return create(kids[0]);
   }
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
 public:
   static bool classof(const Expr *E) {
@@ -1003,7 +1061,7 @@ public:
     return 0;
   }
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
   static bool classof(const Expr *E) {
     Expr::Kind k = E->getKind();
@@ -1191,22 +1249,31 @@ public:
     return const_cast<ConstantExpr *>(this);
   }
 
-  virtual unsigned computeHash();
+  virtual uint64_t computeHash();
 
   static ref<Expr> fromMemory(void *address, Width w);
   void toMemory(void *address);
 
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
+    if (v.getBitWidth() <= 64)
+      return allocSmall(v.getZExtValue(), v.getBitWidth());
     ref<ConstantExpr> r(new ConstantExpr(v));
     r->computeHash();
     return r;
   }
 
+  /// Return the constant of at most 64 bits, from a table of the recent
+  /// constants of each value and width, so that the folding of concrete
+  /// operations mostly finds its results without allocating them.
+  static ref<ConstantExpr> allocSmall(uint64_t v, Width w);
+
   static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
     return alloc(f.bitcastToAPInt());
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
+    if (w <= 64)
+      return allocSmall(bits64::truncateToNBits(v, w), w);
     return alloc(llvm::APInt(w, v));
   }
 
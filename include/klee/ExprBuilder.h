@@ -86,6 +86,14 @@ namespace klee {
   ///
   /// Base - The base builder to use when constructing expressions.
   ExprBuilder *createSimplifyingExprBuilder(ExprBuilder *Base);
+
+  /// createHashConsingExprBuilder - Create an expression builder which
+  /// returns shared canonical nodes for structurally equal expressions, such
+  /// that they can be compared by pointer and hit the caches keyed by
+  /// expressions more often.
+  ///
+  /// Base - The base builder to use when constructing expressions.
+  ExprBuilder *createHashConsingExprBuilder(ExprBuilder *Base);
 }
 
 #endif
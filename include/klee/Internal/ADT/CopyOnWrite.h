@@ -0,0 +1,93 @@
+//===-- CopyOnWrite.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_COPYONWRITE_H__
+#define __UTIL_COPYONWRITE_H__
+
+#include <algorithm>
+
+namespace klee {
+  /// A reference-counted value that copies share until one of them is
+  /// written to, at which point the writer obtains its own copy. Copying and
+  /// assignment are constant time. Like ref<>, the reference count is not
+  /// thread-safe.
+  template<class T>
+  class CopyOnWrite {
+    struct Shared {
+      unsigned refCount;
+      T value;
+
+      Shared() : refCount(1) {}
+      explicit Shared(const T &_value) : refCount(1), value(_value) {}
+    };
+
+    Shared *shared;
+
+    void release() {
+      if (--shared->refCount == 0)
+        delete shared;
+    }
+
+  public:
+    CopyOnWrite() : shared(new Shared()) {}
+    explicit CopyOnWrite(const T &value) : shared(new Shared(value)) {}
+    CopyOnWrite(const CopyOnWrite &b) : shared(b.shared) {
+      ++shared->refCount;
+    }
+    ~CopyOnWrite() { release(); }
+
+    CopyOnWrite &operator=(const CopyOnWrite &b) {
+      ++b.shared->refCount;
+      release();
+      shared = b.shared;
+      return *this;
+    }
+
+    const T &operator*() const { return shared->value; }
+    const T *operator->() const { return &shared->value; }
+
+    /// Return the value for writing, first copying it if it is shared.
+    T &mutate() {
+      if (shared->refCount > 1) {
+        Shared *copy = new Shared(shared->value);
+        --shared->refCount;
+        shared = copy;
+      }
+      return shared->value;
+    }
+
+    /// Replace the value by a default constructed one.
+    void reset() {
+      if (shared->refCount > 1) {
+        --shared->refCount;
+        shared = new Shared();
+      } else {
+        shared->value = T();
+      }
+    }
+
+    bool isShared() const { return shared->refCount > 1; }
+
+    void swap(CopyOnWrite &b) { std::swap(shared, b.shared); }
+
+    bool operator==(const CopyOnWrite &b) const {
+      return shared == b.shared || shared->value == b.shared->value;
+    }
+    bool operator!=(const CopyOnWrite &b) const { return !(*this == b); }
+  };
+}
+
+namespace std {
+  template<class T>
+  inline void swap(klee::CopyOnWrite<T> &a, klee::CopyOnWrite<T> &b) {
+    a.swap(b);
+  }
+}
+
+#endif
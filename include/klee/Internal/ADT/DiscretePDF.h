@@ -25,6 +25,13 @@ namespace klee {
     void remove(T item);
     bool inTree(T item);
     weight_type getWeight(T item);
+
+    /* update the weights of all the elements to weightOf(item), then
+     * recompute the sums in a single pass over the tree rather than
+     * propagating each change up to the root.
+     */
+    template <class WeightFunction>
+    void updateAll(WeightFunction &weightOf);
 	
     /* pick a tree element according to its
      * weight. p should be in [0,1).
@@ -40,6 +47,8 @@ namespace klee {
     void rotate(Node *node);
     void lengthen(Node *node);
     void propogateSumsUp(Node *n);
+    template <class WeightFunction>
+    void updateAll(Node *n, WeightFunction &weightOf);
   };
 
 }
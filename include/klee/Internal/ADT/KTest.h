@@ -55,6 +55,36 @@ extern "C" {
 
   void  kTest_free(KTest *);
 
+  /* An archive of test cases in a single file. The test cases are stored in
+     blocks, which are compressed when zlib is available, and which each
+     store the object names once. An index at the end of the file locates
+     the blocks; the blocks are scanned when the index is missing, as when
+     the writer was interrupted. */
+  typedef struct KTestArchive KTestArchive;
+
+  /* return true iff file at path matches KTest archive header */
+  int   kTestArchive_isArchive(const char *path);
+
+  /* create an archive for writing, returns NULL on error */
+  KTestArchive *kTestArchive_create(const char *path);
+
+  /* append a test case, returns 1 on success, 0 on error */
+  int   kTestArchive_add(KTestArchive *, const KTest *);
+
+  /* open an archive for reading, returns NULL on error */
+  KTestArchive *kTestArchive_open(const char *path);
+
+  /* returns the number of test cases of an archive opened for reading */
+  unsigned kTestArchive_numTests(KTestArchive *);
+
+  /* returns the test case of the given index, to be freed with kTest_free,
+     or NULL on error */
+  KTest *kTestArchive_get(KTestArchive *, unsigned index);
+
+  /* finish writing an archive and free it, returns 1 on success, 0 on
+     error */
+  int   kTestArchive_close(KTestArchive *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -40,6 +40,10 @@ namespace klee {
 
     V *lookup(const std::set<K> &set);
 
+    /// Remove the set, and the nodes that are left without entries below
+    /// them; returns false if the set is not in the map.
+    bool erase(const std::set<K> &set);
+
     iterator begin();
     iterator end();
 
@@ -213,6 +217,32 @@ namespace klee {
     }
   }
 
+  template<class K, class V>
+  bool MapOfSets<K,V>::erase(const std::set<K> &set) {
+    std::vector<Node*> path;
+    Node *n = &root;
+    for (typename std::set<K>::const_iterator it = set.begin(), ie = set.end();
+         it != ie; ++it) {
+      typename Node::children_ty::iterator kit = n->children.find(*it);
+      if (kit==n->children.end())
+        return false;
+      path.push_back(n);
+      n = &kit->second;
+    }
+    if (!n->isEndOfSet)
+      return false;
+    n->isEndOfSet = false;
+    n->value = V();
+
+    typename std::set<K>::const_reverse_iterator rit = set.rbegin();
+    while (!path.empty() && !n->isEndOfSet && n->children.empty()) {
+      n = path.back();
+      path.pop_back();
+      n->children.erase(*rit++);
+    }
+    return true;
+  }
+
   template<class K, class V>
   typename MapOfSets<K,V>::iterator 
   MapOfSets<K,V>::begin() { return iterator(&root); }
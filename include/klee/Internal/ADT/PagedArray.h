@@ -0,0 +1,285 @@
+//===-- PagedArray.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_PAGEDARRAY_H__
+#define __UTIL_PAGEDARRAY_H__
+
+#include <algorithm>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+  /// A fixed-size array stored in reference-counted pages of 2^PageBits
+  /// elements. Copies share the pages, and a shared page is copied on its
+  /// first write through one of them, so that copying the array and writing
+  /// one element cost a page rather than the whole array. Pages that were
+  /// never written are not allocated, and read as the fill value. An array
+  /// smaller than a page has a single page of its own size. Like ref<>, the
+  /// reference counts are not thread-safe.
+  template<class T, unsigned PageBits = 12>
+  class PagedArray {
+    static const unsigned PageSize = 1u << PageBits;
+
+    struct Page {
+      unsigned refCount;
+      unsigned length;
+      T *data;
+
+      Page(unsigned _length, const T &value)
+        : refCount(1), length(_length), data(new T[_length]) {
+        std::fill(data, data + length, value);
+      }
+      Page(const Page &p)
+        : refCount(1), length(p.length), data(new T[p.length]) {
+        std::copy(p.data, p.data + length, data);
+      }
+      ~Page() { delete[] data; }
+
+      size_t getBytes() const { return sizeof(Page) + length * sizeof(T); }
+
+    private:
+      // DO NOT IMPLEMENT
+      Page &operator=(const Page &p);
+    };
+
+    std::vector<Page*> pages;
+    T fill;
+
+    /// The number of elements of a page
+    unsigned pageLength;
+
+    /// The bytes of the pages allocated by all the arrays of this type
+    static size_t pageBytes;
+
+    void release() {
+      for (typename std::vector<Page*>::iterator it = pages.begin(),
+             ie = pages.end(); it != ie; ++it) {
+        if (*it && --(*it)->refCount == 0) {
+          pageBytes -= (*it)->getBytes();
+          delete *it;
+        }
+        *it = 0;
+      }
+    }
+
+    /// Return a page for writing, allocating it or copying it if it is
+    /// shared.
+    Page *getWriteablePage(unsigned index) {
+      Page *&p = pages[index];
+      if (!p) {
+        p = new Page(pageLength, fill);
+        pageBytes += p->getBytes();
+      } else if (p->refCount > 1) {
+        --p->refCount;
+        p = new Page(*p);
+        pageBytes += p->getBytes();
+      }
+      return p;
+    }
+
+    // DO NOT IMPLEMENT
+    PagedArray &operator=(const PagedArray &b);
+
+  public:
+    PagedArray(unsigned _size, const T &_fill)
+      : pages((_size + PageSize - 1) >> PageBits, (Page*) 0),
+        fill(_fill), pageLength(_size < PageSize ? _size : PageSize) {}
+
+    PagedArray(const PagedArray &b)
+      : pages(b.pages), fill(b.fill), pageLength(b.pageLength) {
+      for (typename std::vector<Page*>::iterator it = pages.begin(),
+             ie = pages.end(); it != ie; ++it)
+        if (*it)
+          ++(*it)->refCount;
+    }
+
+    ~PagedArray() { release(); }
+
+    /// Return the bytes of the pages allocated by all the arrays of this
+    /// type.
+    static size_t getAllocatedBytes() { return pageBytes; }
+
+    const T &get(unsigned i) const {
+      const Page *p = pages[i >> PageBits];
+      return p ? p->data[i & (PageSize - 1)] : fill;
+    }
+
+    T &getWriteable(unsigned i) {
+      return getWriteablePage(i >> PageBits)->data[i & (PageSize - 1)];
+    }
+
+    /// Write an element, without allocating a page to write the fill value.
+    /// This compares the value with the elements, so it is meant for cheaply
+    /// comparable types.
+    void set(unsigned i, const T &value) {
+      if (!pages[i >> PageBits] && value == fill)
+        return;
+      getWriteable(i) = value;
+    }
+
+    /// Reset an element to the fill value.
+    void reset(unsigned i) {
+      if (pages[i >> PageBits])
+        getWriteable(i) = fill;
+    }
+
+    /// Set all the elements to the value, releasing all the pages.
+    void assign(const T &value) {
+      release();
+      fill = value;
+    }
+
+    /// Return the end of the page of element i, or e if it is earlier.
+    static unsigned pageEnd(unsigned i, unsigned e) {
+      return std::min(e, ((i >> PageBits) + 1) << PageBits);
+    }
+
+    /// Read the elements a page at a time, so that the copy of each page is
+    /// a single block copy.
+    void copyOut(T *out, unsigned begin, unsigned n) const {
+      unsigned i = begin, e = begin + n;
+      while (i != e) {
+        unsigned end = pageEnd(i, e);
+        const Page *p = pages[i >> PageBits];
+        if (p) {
+          const T *data = p->data + (i & (PageSize - 1));
+          out = std::copy(data, data + (end - i), out);
+        } else {
+          std::fill(out, out + (end - i), fill);
+          out += end - i;
+        }
+        i = end;
+      }
+    }
+
+    /// Write the value to the elements, without allocating the pages that
+    /// would only hold the fill value.
+    void assign(unsigned begin, unsigned n, const T &value) {
+      unsigned i = begin, e = begin + n;
+      while (i != e) {
+        unsigned end = pageEnd(i, e);
+        if (pages[i >> PageBits] || !(value == fill)) {
+          Page *p = getWriteablePage(i >> PageBits);
+          T *data = p->data + (i & (PageSize - 1));
+          std::fill(data, data + (end - i), value);
+        }
+        i = end;
+      }
+    }
+
+    /// Write the elements, leaving the pages whose contents are unchanged
+    /// shared or unallocated.
+    void copyIn(const T *in, unsigned begin, unsigned n) {
+      unsigned i = begin, e = begin + n;
+      while (i != e) {
+        unsigned end = pageEnd(i, e);
+        if (!equals(in, i, end - i)) {
+          Page *p = getWriteablePage(i >> PageBits);
+          std::copy(in, in + (end - i), p->data + (i & (PageSize - 1)));
+        }
+        in += end - i;
+        i = end;
+      }
+    }
+
+    bool equals(const T *in, unsigned begin, unsigned n) const {
+      unsigned i = begin, e = begin + n;
+      while (i != e) {
+        unsigned end = pageEnd(i, e);
+        const Page *p = pages[i >> PageBits];
+        if (p) {
+          const T *data = p->data + (i & (PageSize - 1));
+          if (!std::equal(data, data + (end - i), in))
+            return false;
+        } else {
+          for (const T *it = in, *ie = in + (end - i); it != ie; ++it)
+            if (!(*it == fill))
+              return false;
+        }
+        in += end - i;
+        i = end;
+      }
+      return true;
+    }
+  };
+
+  template<class T, unsigned PageBits>
+  size_t PagedArray<T, PageBits>::pageBytes = 0;
+
+  /// A fixed-size bit array with the paged copy-on-write storage of
+  /// PagedArray. A page holds the bits of 2^(PageBits+5) elements.
+  template<unsigned PageBits = 7>
+  class PagedBitArray {
+    PagedArray<uint32_t, PageBits> words;
+
+    static unsigned length(unsigned size) { return (size + 31) / 32; }
+
+    /// The mask of the bits from b to e of a word, where 0 <= b < e <= 32.
+    static uint32_t mask(unsigned b, unsigned e) {
+      uint32_t high = e == 32 ? ~(uint32_t) 0 : (1u << e) - 1;
+      return high & ~((1u << b) - 1);
+    }
+
+  public:
+    PagedBitArray(unsigned size, bool value)
+      : words(length(size), value ? ~(uint32_t) 0 : 0) {}
+
+    bool get(unsigned idx) const {
+      return (bool) ((words.get(idx / 32) >> (idx & 0x1F)) & 1);
+    }
+    void set(unsigned idx) {
+      if (!get(idx))
+        words.getWriteable(idx / 32) |= 1u << (idx & 0x1F);
+    }
+    void unset(unsigned idx) {
+      if (get(idx))
+        words.getWriteable(idx / 32) &= ~(1u << (idx & 0x1F));
+    }
+    void set(unsigned idx, bool value) { if (value) set(idx); else unset(idx); }
+
+    /// Return whether the n bits from begin all have the value, checking a
+    /// word at a time.
+    bool allEqual(unsigned begin, unsigned n, bool value) const {
+      uint32_t ones = value ? ~(uint32_t) 0 : 0;
+      for (unsigned i = begin, e = begin + n; i != e;) {
+        unsigned end = std::min(e, (i & ~31u) + 32);
+        uint32_t m = mask(i & 31, end - (i & ~31u));
+        if ((words.get(i / 32) & m) != (ones & m))
+          return false;
+        i = end;
+      }
+      return true;
+    }
+
+    /// Set the n bits from begin to the value, a word at a time.
+    void set(unsigned begin, unsigned n, bool value) {
+      for (unsigned i = begin, e = begin + n; i != e;) {
+        unsigned end = std::min(e, (i & ~31u) + 32);
+        uint32_t m = mask(i & 31, end - (i & ~31u));
+        uint32_t word = words.get(i / 32);
+        uint32_t result = value ? word | m : word & ~m;
+        if (result != word)
+          words.getWriteable(i / 32) = result;
+        i = end;
+      }
+    }
+
+    /// Set all the bits to the value, releasing all the pages.
+    void assign(bool value) { words.assign(value ? ~(uint32_t) 0 : 0); }
+
+    /// Return the bytes of the pages allocated by all the bit arrays of this
+    /// type.
+    static size_t getAllocatedBytes() {
+      return PagedArray<uint32_t, PageBits>::getAllocatedBytes();
+    }
+  };
+}
+
+#endif
@@ -17,9 +17,15 @@ namespace klee {
 
   typedef unsigned TreeStreamID;
   class TreeOStream;
+  class TreeStreamBlockWriter;
 
+  /// The records of the streams are gathered into large blocks, which are
+  /// compressed and written to the file by a background thread. Runs of
+  /// branch decisions, the "0" and "1" strings written by the executor, are
+  /// stored as packed bits.
   class TreeStreamWriter {
     static const unsigned bufferSize = 4*4096;
+    static const unsigned blockSize = 256*1024;
 
     friend class TreeOStream;
 
@@ -31,8 +37,15 @@ namespace klee {
     std::ofstream *output;
     unsigned ids;
 
+    /// The records not yet handed to the block writer
+    std::vector<char> *block;
+    TreeStreamBlockWriter *blockWriter;
+
     void write(TreeOStream &os, const char *s, unsigned size);
     void flushBuffer();
+    void writeRecord(unsigned id, unsigned kind, unsigned value,
+                     const char *data, unsigned size);
+    void submitBlock();
 
   public:
     TreeStreamWriter(const std::string &_path);
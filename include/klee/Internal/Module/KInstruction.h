@@ -37,6 +37,13 @@ namespace klee {
     int *operands;
     /// Destination register index.
     unsigned dest;
+    /// The number of the basic block of the instruction, dense over the
+    /// basic blocks of the module (see KModule::numBasicBlocks).
+    unsigned basicBlockId;
+    /// Whether the result of the instruction is only used by the next
+    /// instruction of its block: an icmp by its conditional branch, or a
+    /// getelementptr by its load. The two are then executed in one step.
+    bool fusedWithNext;
 
   public:
     virtual ~KInstruction(); 
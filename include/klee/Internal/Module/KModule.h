@@ -59,9 +59,17 @@ namespace klee {
     KFunction &operator=(const KFunction&);
 
   public:
-    explicit KFunction(llvm::Function*, KModule *);
+    /// Build the instructions of the function, which only reads the
+    /// function, so that the functions may be built by several threads. The
+    /// basic block ids are relative to the function, and the constant
+    /// operands are left to resolve.
+    explicit KFunction(llvm::Function*);
     ~KFunction();
 
+    /// Number the basic blocks and the constant operands of the function
+    /// after those of the functions resolved before it
+    void resolve(KModule *km);
+
     unsigned getArgRegister(unsigned index) { return index; }
   };
 
@@ -113,10 +121,34 @@ namespace klee {
     // Functions which are part of KLEE runtime
     std::set<const llvm::Function*> internalFunctions;
 
+    /// The number of basic blocks of the functions, numbered densely in the
+    /// order of the functions, for the per-block tables of the executor.
+    unsigned numBasicBlocks;
+
+    /// The kinds of control points of a basic block, as the bits of
+    /// basicBlockKinds.
+    enum BasicBlockKind {
+      FunctionEntry = 1,
+      LoopHeader = 2,
+      JoinPoint = 4
+    };
+
+    /// The control point kinds of the basic blocks, by basic block id, from
+    /// the control flow graphs of the functions.
+    std::vector<unsigned char> basicBlockKinds;
+
   private:
+    /// The module given to the constructor, when prepare replaced it by a
+    /// cached preparation. Its functions have no bodies.
+    llvm::Module *originalModule;
+
     // Mark function with functionName as part of the KLEE runtime
     void addInternalFunction(const char* functionName);
 
+    /// Link the runtime into the module and run the passes that prepare it
+    /// for interpretation.
+    void transform(const Interpreter::ModuleOptions &opts);
+
   public:
     KModule(llvm::Module *_module);
     ~KModule();
@@ -34,6 +34,9 @@
 #include <llvm/Value.h>
 #endif
 
+#include <algorithm>
+#include <map>
+#include <string>
 #include <vector>
 
 namespace klee {
@@ -46,9 +49,160 @@ class TxStoreEntry;
 
 class TxStore;
 
+class KModule;
+
 const uint64_t symbolicBoundId = ULONG_MAX;
 void setDebugSubsumptionLevelTxValue(int debugSubsumptionLevel);
 
+/// \brief A reason for marking a value as in the interpolant, used for
+/// debugging.
+///
+/// A reason is recorded as its kind and the LLVM values involved, and it is
+/// only rendered into text when it is printed.
+class TxMarkReason {
+public:
+  enum Kind {
+    None,
+    /// \brief Subsumption at an instruction
+    Subsumption,
+    /// \brief Memory bound interpolation for subsumption at an instruction
+    SubsumptionBound,
+    /// \brief Infeasibility of a side of a branch instruction
+    BranchInfeasibility,
+    /// \brief A conditional branch instruction
+    BranchInstruction,
+    /// \brief A switch instruction with infeasible cases
+    InfeasibleSwitchCase,
+    /// \brief A pointer argument of a call to an external function: the
+    /// values are the argument and the call
+    ExternalCallParameter,
+    /// \brief Use of a pointer by an instruction
+    PointerUse,
+    /// \brief Memory bound violation at an instruction
+    MemoryBoundViolation
+  };
+
+private:
+  Kind kind;
+
+  llvm::Value *first, *second;
+
+public:
+  TxMarkReason() : kind(None), first(0), second(0) {}
+
+  TxMarkReason(Kind _kind, llvm::Value *_first, llvm::Value *_second = 0)
+      : kind(_kind), first(_first), second(_second) {}
+
+  bool empty() const { return kind == None; }
+
+  bool operator<(const TxMarkReason &other) const {
+    if (kind != other.kind)
+      return kind < other.kind;
+    if (first != other.first)
+      return first < other.first;
+    return second < other.second;
+  }
+
+  /// \brief Render the reason into a stream
+  void print(llvm::raw_ostream &stream) const;
+};
+
+inline llvm::raw_ostream &operator<<(llvm::raw_ostream &stream,
+                                     const TxMarkReason &reason) {
+  reason.print(stream);
+  return stream;
+}
+
+/// \brief A set of reasons for marking a value as in the interpolant, used
+/// for debugging.
+///
+/// The reasons are interned into a global table, and the set only stores
+/// their small integer ids in sorted order, such that copying and merging
+/// sets do not allocate nor compare reasons.
+class TxCoreReasons {
+  static std::map<TxMarkReason, unsigned> idTable;
+
+  static std::vector<TxMarkReason> reasonTable;
+
+  std::vector<unsigned> ids;
+
+public:
+  typedef std::vector<unsigned>::const_iterator const_iterator;
+
+  /// \brief Get the id of a reason, adding it to the table if necessary
+  static unsigned intern(const TxMarkReason &reason);
+
+  /// \brief Get the reason of an id
+  static const TxMarkReason &getReason(unsigned id) { return reasonTable[id]; }
+
+  void insert(unsigned id) {
+    std::vector<unsigned>::iterator it =
+        std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id)
+      ids.insert(it, id);
+  }
+
+  bool empty() const { return ids.empty(); }
+
+  const_iterator begin() const { return ids.begin(); }
+
+  const_iterator end() const { return ids.end(); }
+};
+
+/// \brief A call history, interned as a node of the tree of all the call
+/// histories seen, where the children of a node extend its history by one
+/// call site.
+///
+/// An interned history is never deleted, so that equal histories are the
+/// same object and are compared by their ids. A node only keeps its last call
+/// site, and its whole history is built from its ancestors when it is first
+/// requested.
+class TxCallHistory {
+  /// \brief The empty history, the root of the tree
+  static TxCallHistory root;
+
+  static unsigned nextId;
+
+  unsigned id;
+
+  /// \brief The history without its last call site, or null for the root
+  const TxCallHistory *parent;
+
+  /// \brief The last call site, or null for the root
+  llvm::Instruction *call;
+
+  /// \brief The number of call sites of the history
+  unsigned depth;
+
+  /// \brief The call sites, built by getHistory
+  mutable std::vector<llvm::Instruction *> history;
+
+  mutable std::map<llvm::Instruction *, TxCallHistory *> children;
+
+  TxCallHistory() : id(0), parent(0), call(0), depth(0) {}
+
+public:
+  /// \brief Get the interned node of a call history
+  static const TxCallHistory *
+  intern(const std::vector<llvm::Instruction *> &callHistory);
+
+  /// \brief The empty history
+  static const TxCallHistory *getEmpty() { return &root; }
+
+  /// \brief The history extended by a call site
+  const TxCallHistory *push(llvm::Instruction *call) const;
+
+  /// \brief The history without its last call site, or the empty history
+  /// if it is empty
+  const TxCallHistory *pop() const { return parent ? parent : this; }
+
+  bool empty() const { return !parent; }
+
+  unsigned getId() const { return id; }
+
+  const std::vector<llvm::Instruction *> &getHistory() const;
+};
+
 class TxAllocationContext {
 
 public:
@@ -59,14 +213,15 @@ private:
   llvm::Value *value;
 
   /// \brief The call history by which the allocation is reached
-  std::vector<llvm::Instruction *> callHistory;
+  const TxCallHistory *callHistory;
 
   TxAllocationContext(llvm::Value *_value,
                       const std::vector<llvm::Instruction *> &_callHistory)
-      : refCount(0), value(_value), callHistory(_callHistory) {}
+      : refCount(0), value(_value),
+        callHistory(TxCallHistory::intern(_callHistory)) {}
 
 public:
-  ~TxAllocationContext() { callHistory.clear(); }
+  ~TxAllocationContext() {}
 
   static ref<TxAllocationContext>
   create(llvm::Value *_value,
@@ -75,35 +230,17 @@ public:
   llvm::Value *getValue() const { return value; }
 
   const std::vector<llvm::Instruction *> &getCallHistory() const {
-    return callHistory;
+    return callHistory->getHistory();
   }
 
   int compare(const TxAllocationContext &other) const {
     if (value == other.value) {
-      // Please note the use of reverse iterator here, which improves
-      // performance.
-      for (std::vector<llvm::Instruction *>::const_reverse_iterator
-               it1 = callHistory.rbegin(),
-               ie1 = callHistory.rend(), it2 = other.callHistory.rbegin(),
-               ie2 = other.callHistory.rend();
-           ; ++it1, ++it2) {
-        if (it1 == ie1) {
-          if (it2 == ie2) {
-            break;
-          } else
-            return -1;
-        }
-        if (it2 == ie2)
-          return 1;
-        if (it1 == ie1)
-          return 1;
-        if ((*it1) > (*it2))
-          return 2;
-        if (it2 == ie2)
-          return -1;
-        if ((*it1) < (*it2))
-          return -2;
-      }
+      // The call histories are interned, so that they are equal exactly when
+      // their ids are.
+      if (callHistory->getId() < other.callHistory->getId())
+        return -2;
+      if (callHistory->getId() > other.callHistory->getId())
+        return 2;
       return 0;
     } else if (value < other.value) {
       return -3;
@@ -143,9 +280,16 @@ private:
 
   uint64_t size;
 
+  /// \brief The hash of the base and the size, equal for equal allocation
+  /// infos
+  uint64_t key;
+
   TxAllocationInfo(ref<TxAllocationContext> &_context, ref<Expr> _base,
                    uint64_t _size)
-      : refCount(0), context(_context), base(_base), size(_size) {}
+      : refCount(0), context(_context), base(_base), size(_size) {
+    key = (base.isNull() ? 0 : base->hash()) * UINT64_C(0x9e3779b97f4a7c15) ^
+          size;
+  }
 
 public:
   ~TxAllocationInfo() {}
@@ -161,6 +305,8 @@ public:
 
   uint64_t getSize() { return size; }
 
+  uint64_t getKey() const { return key; }
+
   /// \brief Translate this allocation info into another.
   ///
   /// \param other The other translation info to translate to
@@ -222,10 +368,16 @@ private:
   /// \brief The value of the concrete offset
   uint64_t concreteOffset;
 
+  /// \brief The hash of the allocation info and the offset, equal for equal
+  /// variables. The stores keyed by variables are ordered by it first, so
+  /// that their lookups mostly compare integers instead of expressions.
+  uint64_t key;
+
   /// \brief The copy constructor.
   TxVariable(const TxVariable &src)
       : refCount(0), allocInfo(src.allocInfo), offset(src.offset),
-        isConcrete(src.isConcrete), concreteOffset(src.concreteOffset) {}
+        isConcrete(src.isConcrete), concreteOffset(src.concreteOffset),
+        key(src.key) {}
 
   /// \brief The normal constructor.
   TxVariable(ref<TxAllocationInfo> _allocInfo, ref<Expr> _offset)
@@ -237,6 +389,8 @@ private:
       isConcrete = true;
       concreteOffset = ce->getZExtValue();
     }
+    key = allocInfo->getKey() * UINT64_C(0xff51afd7ed558ccd) ^
+          (isConcrete ? concreteOffset : offset->hash());
   }
 
 public:
@@ -273,6 +427,9 @@ public:
   /// states for subsumption as in subsumption, related allocations in different
   /// paths may have different base addresses.
   int compare(const TxVariable &other) const {
+    if (key != other.key)
+      return key < other.key ? -1 : 1;
+
     int res = allocInfo->compare(*(other.allocInfo.get()));
     if (res)
       return res;
@@ -332,21 +489,21 @@ private:
   bool doNotUseBound;
 
   /// \brief Reason this was stored as needed value
-  std::set<std::string> coreReasons;
+  TxCoreReasons coreReasons;
 
   /// \brief The original state value, which is used in subsumption check
   /// interpolation to propagate this value to interpolation marking
   ref<TxStateValue> originalValue;
 
   void init(llvm::Value *_value, ref<Expr> _expr, bool canInterpolateBound,
-            const std::set<std::string> &_coreReasons,
+            const TxCoreReasons &_coreReasons,
             ref<TxStateAddress> _locations,
             const std::map<ref<Expr>, ref<Expr> > &substitution,
             std::set<const Array *> &replacements, bool shadowing = false);
 
   TxInterpolantValue(llvm::Value *value, ref<Expr> expr,
                      bool canInterpolateBound,
-                     const std::set<std::string> &coreReasons,
+                     const TxCoreReasons &coreReasons,
                      ref<TxStateAddress> location,
                      const std::map<ref<Expr>, ref<Expr> > &substitution,
                      std::set<const Array *> &replacements) {
@@ -356,7 +513,7 @@ private:
 
   TxInterpolantValue(llvm::Value *value, ref<Expr> expr,
                      bool canInterpolateBound,
-                     const std::set<std::string> &coreReasons,
+                     const TxCoreReasons &coreReasons,
                      ref<TxStateAddress> location) {
     const std::map<ref<Expr>, ref<Expr> > dummySubstitution;
     std::set<const Array *> dummyReplacements;
@@ -367,7 +524,7 @@ private:
 public:
   static ref<TxInterpolantValue>
   create(llvm::Value *value, ref<Expr> expr, bool canInterpolateBound,
-         const std::set<std::string> &coreReasons, ref<TxStateAddress> location,
+         const TxCoreReasons &coreReasons, ref<TxStateAddress> location,
          const std::map<ref<Expr>, ref<Expr> > &substitution,
          std::set<const Array *> &replacements) {
     ref<TxInterpolantValue> sv(
@@ -378,7 +535,7 @@ public:
 
   static ref<TxInterpolantValue> create(llvm::Value *value, ref<Expr> expr,
                                         ref<TxStateAddress> location) {
-    std::set<std::string> dummyCoreReasons;
+    TxCoreReasons dummyCoreReasons;
     ref<TxInterpolantValue> sv(
         new TxInterpolantValue(value, expr, false, dummyCoreReasons, location));
     return sv;
@@ -398,6 +555,10 @@ public:
 
   bool isPointer() const { return !allocationOffsets.empty(); }
 
+  /// \brief Whether the other value has the same expression, bounds and
+  /// offsets, and so the same subsumption checks, regardless of the ids
+  bool isEquivalent(const TxInterpolantValue &other) const;
+
   /// \brief Get bounds check expression.
   ///
   /// \param svalue The value that comes from the program state to be checked
@@ -718,6 +879,10 @@ public:
 
   const std::set<ref<TxStoreEntry> > &getDisableBoundEntryList() const;
 
+  /// \brief The number of references of this value to the entry in its lists
+  /// of entries
+  unsigned countStoreEntry(const TxStoreEntry *entry) const;
+
   int compare(const TxStateValue other) const {
     if (id == other.id)
       return 0;
@@ -800,6 +965,10 @@ private:
   /// \brief The creation depth of this entry
   uint64_t depth;
 
+  /// \brief The number of the entry among the entries created on its path,
+  /// which indexes the used entry sets of the stores
+  unsigned pathId;
+
   llvm::Value *value;
 
   const ref<Expr> valueExpr;
@@ -835,11 +1004,11 @@ private:
 
   /// \brief Reasons for the interpolant marking, from the subtree of the
   /// immediate left child. This is used for debugging.
-  std::set<std::string> leftCoreReasons;
+  TxCoreReasons leftCoreReasons;
 
   /// \brief Reasons for the interpolant marking, from the subtree of the
   /// immediate right child. This is used for debugging.
-  std::set<std::string> rightCoreReasons;
+  TxCoreReasons rightCoreReasons;
 
   /// \brief Cached interpolant-style value for left querying in subsumption
   /// check.
@@ -849,10 +1018,14 @@ private:
   /// check.
   ref<TxInterpolantValue> rightInterpolantStyleValue;
 
+  /// \brief The last pointer flow marking that visited this entry, for the
+  /// left and the right marking.
+  uint64_t pointerFlowEpoch[2];
+
 public:
   TxStoreEntry(ref<TxStateAddress> _address, ref<TxStateValue> _addressValue,
                ref<TxStateValue> _content, const TxStore *store,
-               uint64_t _depth);
+               uint64_t _depth, unsigned _pathId);
 
   ~TxStoreEntry() {}
 
@@ -882,6 +1055,16 @@ public:
     return rightPointerInfo;
   }
 
+  /// \brief Record the visit of the entry by a pointer flow marking. Returns
+  /// false if the marking has already visited the entry.
+  bool visitPointerFlow(bool leftMarking, uint64_t epoch) {
+    uint64_t &last = pointerFlowEpoch[leftMarking ? 0 : 1];
+    if (last == epoch)
+      return false;
+    last = epoch;
+    return true;
+  }
+
   bool canInterpolateBound(bool leftMarking) const {
     if (leftMarking)
       return !leftDoNotInterpolateBound;
@@ -896,16 +1079,16 @@ public:
     rightDoNotInterpolateBound = true;
   }
 
-  void setAsCore(bool leftMarking, const std::string &reason) {
+  void setAsCore(bool leftMarking, const TxMarkReason &reason) {
     if (leftMarking) {
       leftCore = true;
       if (!reason.empty())
-        leftCoreReasons.insert(reason);
+        leftCoreReasons.insert(TxCoreReasons::intern(reason));
       return;
     }
     rightCore = true;
     if (!reason.empty())
-      rightCoreReasons.insert(reason);
+      rightCoreReasons.insert(TxCoreReasons::intern(reason));
   }
 
   bool isCore(bool leftMarking) const {
@@ -916,8 +1099,15 @@ public:
 
   bool isPointer() const { return !leftPointerInfo.isNull(); }
 
+  /// \brief Whether the entry is not in the core, and is referenced only by
+  /// a single store and by its own values. No value of a state can then
+  /// reach the entry to mark it.
+  bool isUnmarkable() const;
+
   uint64_t getDepth() { return depth; }
 
+  unsigned getPathId() const { return pathId; }
+
   ref<TxInterpolantValue> getInterpolantStyleValue(bool leftUse) {
     if (leftUse) {
       if (!leftInterpolantStyleValue.get()) {
@@ -973,6 +1163,120 @@ public:
 
   void print(llvm::raw_ostream &stream, const std::string &prefix) const;
 };
+
+/// \brief The versions of LLVM values bound in a node of the dependency tree
+///
+/// Each node keeps the versions of the values bound locally, and a flat array
+/// of slots indexed by a dense numbering of the LLVM values, which points to
+/// the versions of the value in the nearest node of the path that binds it.
+/// This avoids walking the ancestor nodes when the value is not local. The
+/// dense numbering reuses the register indices of the values assigned by
+/// KModule, offset per function. The slots of a node are shared with its
+/// children, and copied on the first write to shared slots. They are released
+/// once both children are created, since the ancestor nodes no longer bind
+/// new values, so that the last child writing them owns them uncopied.
+class TxVersionedValues {
+public:
+  typedef std::vector<ref<TxStateValue> > Versions;
+
+  /// \brief The versions of a value in the nearest node binding it
+  struct Binding {
+    const TxVersionedValues *owner;
+    const Versions *versions;
+
+    Binding() : owner(0), versions(0) {}
+
+    Binding(const TxVersionedValues *_owner, const Versions *_versions)
+        : owner(_owner), versions(_versions) {}
+  };
+
+private:
+  const TxVersionedValues *parent;
+
+  /// \brief The versions of the values bound in this node
+  std::map<llvm::Value *, Versions> localValues;
+
+  /// \brief The resolved bindings, indexed by value id, shared by the nodes
+  /// with the same resolutions; a null versions pointer means not yet
+  /// resolved
+  struct Slots {
+    unsigned refCount;
+    std::vector<Binding> bindings;
+
+    Slots() : refCount(1) {}
+  };
+
+  mutable Slots *slots;
+
+  /// \brief Whether the slots are still maintained
+  bool slotsEnabled;
+
+  /// \brief The marker of a value resolved to have no binding
+  static const Versions noVersions;
+
+  /// \brief Find the binding without caching
+  Binding findUncached(llvm::Value *value) const;
+
+  /// \brief Set the slot of a value id, copying the slots if they are shared
+  void setSlot(unsigned id, const Binding &binding) const;
+
+  void dropSlots() {
+    if (slots && --slots->refCount == 0)
+      delete slots;
+    slots = 0;
+  }
+
+  // DO NOT IMPLEMENT
+  TxVersionedValues(const TxVersionedValues &);
+  TxVersionedValues &operator=(const TxVersionedValues &);
+
+public:
+  TxVersionedValues(const TxVersionedValues *_parent)
+      : parent(_parent), slots(parent ? parent->slots : 0),
+        slotsEnabled(true) {
+    if (slots)
+      ++slots->refCount;
+  }
+
+  ~TxVersionedValues() { dropSlots(); }
+
+  /// \brief Number the values of all functions of the module
+  static void initialize(KModule *kmodule);
+
+  /// \brief Get the dense id of a value, assigning a new one if it was not
+  /// numbered by initialize
+  static unsigned getValueId(llvm::Value *value);
+
+  const TxVersionedValues *getParent() const { return parent; }
+
+  /// \brief Append a new version of a value
+  void bind(llvm::Value *value, ref<TxStateValue> version);
+
+  /// \brief Find the nearest node binding a value, with a null owner when
+  /// there is none
+  Binding find(llvm::Value *value) const;
+
+  /// \brief Release the slots of a node that no longer binds values
+  void releaseSlots() {
+    dropSlots();
+    slotsEnabled = false;
+  }
+
+  /// \brief Drop the versions of a node that no longer binds values, which
+  /// are shadowed by a later version with the same expression. A lookup
+  /// returns either the last version of a value, or the last one with a
+  /// given expression, so the shadowed versions are never returned and are
+  /// only kept alive by the node.
+  void pruneShadowedVersions();
+
+  /// \brief Estimate of the bytes of the versions bound in this node and of
+  /// its share of its slots
+  uint64_t getByteSize() const;
+
+  const std::map<llvm::Value *, Versions> &getLocalValues() const {
+    return localValues;
+  }
+};
 }
 
 #endif
@@ -22,6 +22,40 @@ namespace klee {
     /// check - Return the delta since the timer was created, in microseconds.
     uint64_t check();
   };
+
+  /// CycleTimer - Reads the time stamp counter of the processor, which is
+  /// much cheaper than the wall clock, converted to microseconds by the
+  /// rate measured against the wall clock on first use. On the processors
+  /// without a time stamp counter it reads the wall clock.
+  class CycleTimer {
+    uint64_t startTicks;
+
+  public:
+    CycleTimer() : startTicks(now()) {}
+
+    /// check - Return the delta since the timer was created, in microseconds.
+    uint64_t check() { return toMicroseconds(now() - startTicks); }
+
+    /// now - Return the current ticks of the counter.
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+      uint32_t lo, hi;
+      __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+      return ((uint64_t)hi << 32) | lo;
+#else
+      return wallMicroseconds();
+#endif
+    }
+
+    /// toMicroseconds - Convert a number of ticks into microseconds.
+    static uint64_t toMicroseconds(uint64_t ticks);
+
+  private:
+    static uint64_t wallMicroseconds();
+
+    /// The ticks per microsecond, zero until measured
+    static double ticksPerMicrosecond;
+  };
 }
 
 #endif
@@ -16,6 +16,7 @@
 #include <vector>
 
 namespace klee {
+  class Assignment;
   class ConstraintManager;
   class Expr;
   class SolverImpl;
@@ -257,6 +258,30 @@ namespace klee {
     /// layers of solving
     bool directComputeValidity(const Query &query, Solver::Validity &result,
                                std::vector<ref<Expr> > &unsatCore);
+
+    /// computeFirstValid - Decide the validity of the given expressions under
+    /// the same constraints concurrently, each on its own thread and Z3
+    /// context, without other layers of solving. The remaining checks are
+    /// interrupted as soon as one expression is found valid. The contexts
+    /// are kept by the solver for the next calls.
+    ///
+    /// \return The index of a valid expression, with the unsatisfiability
+    /// core of its query in the last argument, or -1 if no expression is
+    /// known to be valid.
+    int computeFirstValid(const ConstraintManager &constraints,
+                          const std::vector<ref<Expr> > &exprs, double timeout,
+                          std::vector<ref<Expr> > &unsatCore);
+
+    /// getMemoryUsage - Return the number of bytes allocated by Z3 in all
+    /// its contexts, or the heap usage with Z3 versions not estimating it.
+    static uint64_t getMemoryUsage();
+
+    /// shouldRecycleContext - Whether a Z3 context is to be recycled under
+    /// -z3-recycle-memory, given the memory usage after its last recycling.
+    /// A context is only recycled again after the usage grew by half the
+    /// limit, so that the contexts are not recycled at every query when the
+    /// limit is too low.
+    static bool shouldRecycleContext(uint64_t usageAfterRecycle);
   };
   #endif // ENABLE_Z3
 
@@ -285,6 +310,18 @@ namespace klee {
   /// \param oracle - The solver to check query results against.
   Solver *createValidatingSolver(Solver *s, Solver *oracle);
 
+  /// createSampledValidatingSolver - Create a solver which validates a
+  /// fraction of the query results against an oracle running in a background
+  /// process, reporting the mismatches as warnings without waiting for the
+  /// oracle.
+  ///
+  /// \param s - The primary underlying solver to use.
+  /// \param oracle - The solver to check query results against, which is
+  /// only run in the background process.
+  /// \param fraction - The fraction of the queries to check.
+  Solver *createSampledValidatingSolver(Solver *s, Solver *oracle,
+                                        double fraction);
+
   /// createCachingSolver - Create a solver which will cache the queries in
   /// memory (without eviction).
   ///
@@ -299,6 +336,29 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCexCachingSolver(Solver *s);
 
+  /// getLastCexCacheModel - Return the satisfying assignment last found or
+  /// computed by a counterexample caching solver, or null. The assignment is
+  /// owned by the cache, and only valid until the next query.
+  Assignment *getLastCexCacheModel();
+
+  /// createUnsatCoreCachingSolver - Create a solver which answers a valid
+  /// query from the unsatisfiability core of an earlier valid query of the
+  /// same expression, when the constraints of the query include the core.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createUnsatCoreCachingSolver(Solver *s);
+
+  /// createPersistentCachingSolver - Create a solver which answers the queries
+  /// from a file of the answers of earlier runs, and appends the new answers
+  /// to the file at its destruction.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The path of the file, or empty to keep the answers in
+  /// memory for the run only.
+  /// \param maxSize - The size in bytes beyond which the file is not grown.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path,
+                                        uint64_t maxSize);
+
   /// createFastCexSolver - Create a "fast counterexample solver", which tries
   /// to quickly compute a satisfying assignment for a constraint set using
   /// value propogation and range analysis.
@@ -312,6 +372,14 @@ namespace klee {
   ///
   /// \param s - The underlying solver to use.
   Solver *createIndependentSolver(Solver *s);
+
+  /// createRangeSolver - Create a solver which decides the unsigned
+  /// comparisons of an expression with a constant from the constant bounds
+  /// of the same expression in the constraints, before propogating the
+  /// other queries to the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createRangeSolver(Solver *s);
   
   /// createPCLoggingSolver - Create a solver which will forward all queries
   /// after writing them to the given path in .pc format.
@@ -324,6 +392,32 @@ namespace klee {
                                     int minQueryTimeToLog);
 
 
+  /// createPortfolioSolver - Create a solver which runs each query on all
+  /// the given core solvers in child processes, and returns the first answer.
+  /// The unsatisfiability core of the answer is the whole constraint set when
+  /// the winning solver does not compute one.
+  ///
+  /// \param solvers - The core solvers to race, the first being the primary.
+  /// \param names - The names of the solvers, for the win statistics.
+  Solver *createPortfolioSolver(const std::vector<Solver *> &solvers,
+                                const std::vector<std::string> &names);
+
+  /// createWorkerSolver - Create a solver which runs the queries of a core
+  /// solver in a long-lived worker process, isolating KLEE from its crashes
+  /// and timeouts without forking KLEE for each query.
+  ///
+  /// \param s - The core solver, which should not fork itself.
+  Solver *createWorkerSolver(Solver *s);
+
+  /// createClassifyingSolver - Create a solver which sends the subsumption
+  /// checks and the quantified queries to one solver, and the other queries
+  /// to another, so that each kind of query has its own caches and settings.
+  ///
+  /// \param branchSolver - The solver of the other queries.
+  /// \param subsumptionSolver - The solver of the subsumption checks.
+  Solver *createClassifyingSolver(Solver *branchSolver,
+                                  Solver *subsumptionSolver);
+
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
   Solver *createDummySolver();
@@ -25,8 +25,21 @@ namespace klee {
     void operator=(const SolverImpl&);
     std::vector<ref<Expr> > emptyUnsatCore;
 
+    /// Whether the unsatisfiability core of a query is being computed, so
+    /// that the queries solved to compute it report no core themselves.
+    bool computingUnsatCore;
+
+  protected:
+    /// computeUnsatCoreBySolving - Append to unsatCore the constraints of a
+    /// valid query, for the solvers that cannot report a core. The
+    /// constraints are already those the query expression depends on, and
+    /// with -solver-minimize-unsat-core, those not needed are deleted by
+    /// solving the query again without them.
+    void computeUnsatCoreBySolving(const Query &query,
+                                   std::vector<ref<Expr> > &unsatCore);
+
   public:
-    SolverImpl() {}
+    SolverImpl() : computingUnsatCore(false) {}
     virtual ~SolverImpl();
 
     enum SolverRunStatus { SOLVER_RUN_STATUS_SUCCESS_SOLVABLE,
@@ -105,6 +118,10 @@ namespace klee {
     }
 
     virtual void setCoreSolverTimeout(double timeout) {};
+
+    /// clearUpdateNodeCache - Forget the translations of the update nodes,
+    /// which the builders cache by address, before the nodes are freed.
+    virtual void clearUpdateNodeCache() {}
   };
 
 }
@@ -20,9 +20,14 @@ namespace stats {
   extern Statistic queriesInvalid;
   extern Statistic queriesValid;
   extern Statistic queryCacheHits;
+  extern Statistic queryRangeHits;
+  extern Statistic queryFastCexHits;
+  extern Statistic queryIndependentReductions;
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryUnsatCoreCacheHits;
+  extern Statistic queryPersistentCacheHits;
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
@@ -30,6 +35,11 @@ namespace stats {
   extern Statistic subsumptionQueryTime;
   extern Statistic subsumptionQueryCount;
   extern Statistic subsumptionQueryFailureCount;
+  extern Statistic unsatCoreMinimizations;
+  extern Statistic unsatCoreMinimizationTime;
+  extern Statistic unsatCoreSize;
+  extern Statistic minimalUnsatCoreSize;
+  extern Statistic z3ContextRecycles;
 
 #ifdef DEBUG
   extern Statistic arrayHashTime;
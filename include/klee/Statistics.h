@@ -15,6 +15,7 @@
 #include <vector>
 #include <string>
 #include <string.h>
+#include <pthread.h>
 
 namespace klee {
   class Statistic;
@@ -39,6 +40,15 @@ namespace klee {
 
   class StatisticManager {
   private:
+    /// The statistics incremented by a thread other than the main one,
+    /// which the thread alone writes, and which are added to the global
+    /// statistics when read. The statistics outlive their thread, and are
+    /// reused by a later thread.
+    struct ThreadStatistics {
+      uint64_t *data;
+      ThreadStatistics *next;
+    };
+
     bool enabled;
     std::vector<Statistic*> stats;
     uint64_t *globalStats;
@@ -46,6 +56,15 @@ namespace klee {
     StatisticRecord *contextStats;
     unsigned index;
 
+    /// The statistics of all the threads, linked by next, and those of the
+    /// threads that ended, to be reused
+    ThreadStatistics *threadStats;
+    std::vector<ThreadStatistics *> freeThreadStats;
+    pthread_mutex_t threadLock;
+
+    /// The statistics of the current thread, null for the main thread
+    static __thread ThreadStatistics *currentThreadStats;
+
   public:
     StatisticManager();
     ~StatisticManager();
@@ -60,6 +79,13 @@ namespace klee {
     unsigned getNumStatistics() { return stats.size(); }
     Statistic &getStatistic(unsigned i) { return *stats[i]; }
     
+    /// Make the statistics incremented by the calling thread, other than
+    /// the main thread, its own until endThread, so that the threads do not
+    /// share the counters they write. Their counts are not attributed to
+    /// the instructions nor to the context record.
+    void beginThread();
+    void endThread();
+
     void registerStatistic(Statistic &s);
     void incrementStatistic(Statistic &s, uint64_t addend);
     uint64_t getValue(const Statistic &s) const;
@@ -76,6 +102,10 @@ namespace klee {
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
     if (enabled) {
+      if (ThreadStatistics *ts = currentThreadStats) {
+        ts->data[s.id] += addend;
+        return;
+      }
       globalStats[s.id] += addend;
       if (indexedStats) {
         indexedStats[index*stats.size() + s.id] += addend;
@@ -130,7 +160,10 @@ namespace klee {
   }
 
   inline uint64_t StatisticManager::getValue(const Statistic &s) const {
-    return globalStats[s.id];
+    uint64_t value = globalStats[s.id];
+    for (const ThreadStatistics *ts = threadStats; ts; ts = ts->next)
+      value += ts->data[s.id];
+    return value;
   }
 
   inline void StatisticManager::incrementIndexedValue(const Statistic &s, 
@@ -12,6 +12,9 @@
 
 #include "klee/Statistics.h"
 #include "klee/Internal/Support/Timer.h"
+#include "klee/Internal/System/Time.h"
+
+#include <vector>
 
 namespace klee {
   class TimerStatIncrementer {
@@ -27,6 +30,47 @@ namespace klee {
 
     uint64_t check() { return timer.check(); }
   };
+
+  /// SampledTimerStatIncrementer - Times one in every interval calls of the
+  /// scope with the statistic, with the cycle counter or the wall clock, and
+  /// adds the time scaled by the interval, so that the timers of frequent
+  /// calls cost little. An interval of zero times no call.
+  class SampledTimerStatIncrementer {
+  private:
+    Statistic &statistic;
+    /// The interval when the call is timed, and zero otherwise
+    unsigned scale;
+    bool useCycles;
+    uint64_t start;
+
+    /// The calls since the last timed one, by statistic id
+    static std::vector<unsigned> calls;
+
+  public:
+    SampledTimerStatIncrementer(Statistic &_statistic, unsigned interval,
+                                bool _useCycles)
+        : statistic(_statistic), scale(0), useCycles(_useCycles), start(0) {
+      if (!interval)
+        return;
+      unsigned id = statistic.getID();
+      if (id >= calls.size())
+        calls.resize(id + 1, 0);
+      if (++calls[id] < interval)
+        return;
+      calls[id] = 0;
+      scale = interval;
+      start = useCycles ? CycleTimer::now() : util::getWallTimeVal().usec();
+    }
+
+    ~SampledTimerStatIncrementer() {
+      if (!scale)
+        return;
+      uint64_t elapsed =
+          useCycles ? CycleTimer::toMicroseconds(CycleTimer::now() - start)
+                    : util::getWallTimeVal().usec() - start;
+      statistic += scale * elapsed;
+    }
+  };
 }
 
 #endif
@@ -25,6 +25,10 @@
 #include <string>
 #include <vector>
 
+#ifdef KLEE_THREADSAFE_REFS
+#include <pthread.h>
+#endif
+
 namespace klee {
 
 struct EquivArrayCmpFn {
@@ -38,7 +42,7 @@ struct EquivArrayCmpFn {
 /// Provides an interface for creating and destroying Array objects.
 class ArrayCache {
 public:
-  ArrayCache() {}
+  ArrayCache();
   ~ArrayCache();
   /// Create an Array object.
   //
@@ -67,12 +71,29 @@ public:
                            Expr::Width _domain = Expr::Int32,
                            Expr::Width _range = Expr::Int8);
 
+  /// Create the shadow of an array, a symbolic array of the given name and of
+  /// the size, domain and range of the source array, or return the shadow
+  /// it already has. The shadow is cached as the other symbolic arrays, and
+  /// is referenced from the source array.
+  const Array *CreateShadowArray(const Array *source,
+                                 const std::string &shadowName);
+
 private:
   typedef unordered_set<const Array *, klee::ArrayHashFn,
                         klee::EquivArrayCmpFn> ArrayHashMap;
   ArrayHashMap cachedSymbolicArrays;
   typedef std::vector<const Array *> ArrayPtrVec;
   ArrayPtrVec concreteArrays;
+
+#ifdef KLEE_THREADSAFE_REFS
+  /// Guards the arrays, as threads sharing expressions may create arrays
+  pthread_mutex_t lock;
+#endif
+
+  const Array *createArrayUnlocked(const std::string &_name, uint64_t _size,
+                                   const ref<ConstantExpr> *constantValuesBegin,
+                                   const ref<ConstantExpr> *constantValuesEnd,
+                                   Expr::Width _domain, Expr::Width _range);
 };
 }
 
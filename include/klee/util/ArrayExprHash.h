@@ -28,7 +28,7 @@
 namespace klee {
   
 struct ArrayHashFn  {
-  unsigned operator()(const Array* array) const {
+  std::size_t operator()(const Array* array) const {
     return(array ? array->hash() : 0);
   }
 };
@@ -40,7 +40,7 @@ struct ArrayCmpFn {
 };  
   
 struct UpdateNodeHashFn  {
-  unsigned operator()(const UpdateNode* un) const {
+  std::size_t operator()(const UpdateNode* un) const {
     return(un ? un->hash() : 0);
   }
 };
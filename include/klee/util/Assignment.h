@@ -12,6 +12,7 @@
 
 #include <map>
 
+#include "klee/util/CompiledExpr.h"
 #include "klee/util/ExprEvaluator.h"
 
 // FIXME: Rename?
@@ -64,6 +65,9 @@ namespace klee {
     AssignmentEvaluator(const Assignment &_a) : a(_a) {}    
   };
 
+  /// A cached solver result: either an assignment, which the cache owns
+  /// separately since it is shared between results, or the unsatisfiability
+  /// core of an unsatisfiable query.
   class AssignmentCacheWrapper {
     Assignment *a;
     std::vector< ref<Expr> > unsatCore;
@@ -75,7 +79,6 @@ namespace klee {
         : a(0), unsatCore(_unsatCore) {}
 
     ~AssignmentCacheWrapper() {
-      delete a;
       unsatCore.clear();
     }
 
@@ -112,9 +115,20 @@ namespace klee {
   template<typename InputIterator>
   inline bool Assignment::satisfies(InputIterator begin, InputIterator end) {
     AssignmentEvaluator v(*this);
-    for (; begin!=end; ++begin)
+    for (; begin!=end; ++begin) {
+      // The compiled programs of the constraints are cached, as the same
+      // constraints are checked against many assignments
+      const CompiledExpr *compiled = CompiledExpr::get(*begin);
+      uint64_t value;
+      if (compiled && (*begin)->getWidth() == Expr::Bool &&
+          compiled->evaluate(*this, value)) {
+        if (!value)
+          return false;
+        continue;
+      }
       if (!v.visit(*begin)->isTrue())
         return false;
+    }
     return true;
   }
 }
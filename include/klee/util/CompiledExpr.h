@@ -0,0 +1,85 @@
+//===-- CompiledExpr.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_COMPILEDEXPR_H
+#define KLEE_UTIL_COMPILEDEXPR_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+
+namespace klee {
+  class Assignment;
+
+  /// An expression lowered to a linear program over 64-bit registers, one
+  /// register per node of the expression DAG, for evaluating the same
+  /// expression in many assignments without the recursion and the
+  /// allocation of the expressions of ExprEvaluator. Expressions with nodes
+  /// wider than 64 bits are not compiled.
+  class CompiledExpr {
+    struct Instruction {
+      Expr::Kind kind;
+      Expr::Width width;
+      unsigned ops[3];
+      /// The constant of a constant, the offset of an extract, and the width
+      /// of the operand of the other instructions needing it
+      uint64_t value;
+      /// The array of a read, as an index into arrays
+      unsigned array;
+      /// The update list of a read, as a range of updates
+      unsigned updatesBegin, updatesEnd;
+    };
+
+    /// The registers of the index and the value of each update of the update
+    /// lists of the reads, from the latest update
+    std::vector<std::pair<unsigned, unsigned> > updates;
+
+    std::vector<const Array *> arrays;
+
+    std::vector<Instruction> program;
+
+    /// The register of the value of the expression
+    unsigned resultRegister;
+
+    bool valid;
+
+    std::map<const Expr *, unsigned> registers;
+
+    std::map<const Array *, unsigned> arrayIndices;
+
+    std::map<const UpdateNode *, std::pair<unsigned, unsigned> > updateLists;
+
+    unsigned compile(const ref<Expr> &e);
+
+    unsigned compileUpdates(const UpdateNode *head);
+
+    unsigned emit(const Instruction &instruction);
+
+  public:
+    explicit CompiledExpr(const ref<Expr> &e);
+
+    /// Whether the expression could be compiled
+    bool isValid() const { return valid; }
+
+    /// Evaluate the expression in the assignment. Return false when the
+    /// value is not a constant in the assignment: when it depends on a value
+    /// the assignment leaves free, or on a division by zero, which
+    /// ExprEvaluator leaves unevaluated. The caller then falls back to
+    /// ExprEvaluator, which may still simplify the expression to a constant.
+    bool evaluate(const Assignment &a, uint64_t &result) const;
+
+    /// The compiled program of the expression, from a cache of the
+    /// recently compiled expressions, or null if it could not be compiled.
+    /// The program is valid until the next call.
+    static const CompiledExpr *get(const ref<Expr> &e);
+  };
+}
+
+#endif
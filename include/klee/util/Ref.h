@@ -26,6 +26,48 @@ namespace llvm {
 
 namespace klee {
 
+class Expr;
+
+/// The update of the reference counts and of the other counters of the
+/// expressions. When KLEE is built with ENABLE_THREADSAFE_REFS=1, for
+/// sharing expressions among threads, the updates are atomic.
+template<class C> inline C addSharedCount(C &count, C amount) {
+#ifdef KLEE_THREADSAFE_REFS
+  return __sync_add_and_fetch(&count, amount);
+#else
+  return count += amount;
+#endif
+}
+
+template<class C> inline C subSharedCount(C &count, C amount) {
+#ifdef KLEE_THREADSAFE_REFS
+  return __sync_sub_and_fetch(&count, amount);
+#else
+  return count -= amount;
+#endif
+}
+
+template<class C> inline C incrementSharedCount(C &count) {
+  return addSharedCount(count, (C) 1);
+}
+
+template<class C> inline C decrementSharedCount(C &count) {
+  return subSharedCount(count, (C) 1);
+}
+
+/// Free an expression whose last reference was dropped. The expressions
+/// whose last references are dropped while freeing are queued and freed in
+/// turn, so that freeing a deep expression does not recurse.
+void deleteExprRef(Expr *e);
+
+// The deletion of a referenced object, where the second argument selects
+// the deletion of expressions.
+template<class T>
+inline void deleteRef(T *p, const volatile void *) { delete p; }
+
+template<class T>
+inline void deleteRef(T *p, const Expr *) { deleteExprRef(p); }
+
 template<class T>
 class ref {
   T *ptr;
@@ -38,12 +80,12 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->refCount;
+      incrementSharedCount(ptr->refCount);
   }
 
   void dec() const {
-    if (ptr && --ptr->refCount == 0)
-      delete ptr;
+    if (ptr && decrementSharedCount(ptr->refCount) == 0)
+      deleteRef(ptr, ptr);
   }
 
 public:
@@ -17,8 +17,74 @@
 
 #include "klee/util/ExprVisitor.h"
 
+#include <map>
+#include <set>
+#include <vector>
+
 namespace klee {
 
+/// \brief Traversal of the distinct subexpressions of an expression DAG.
+///
+/// The subexpressions are visited from a worklist rather than by recursion,
+/// and a subexpression shared by several parents is visited once, so that a
+/// traversal takes time linear in the size of the DAG. A subclass visits a
+/// subexpression and pushes the kids it descends into.
+class TxExprWalker {
+  std::vector<ref<Expr> > worklist;
+
+  std::set<const Expr *> visited;
+
+protected:
+  /// \brief Schedule a subexpression to be visited, unless it was already
+  void push(const ref<Expr> &e) {
+    if (visited.insert(e.get()).second)
+      worklist.push_back(e);
+  }
+
+  /// \brief Visit a subexpression, returning false to end the traversal
+  virtual bool visit(const ref<Expr> &e) = 0;
+
+public:
+  virtual ~TxExprWalker() {}
+
+  void walk(const ref<Expr> &e) {
+    push(e);
+    while (!worklist.empty()) {
+      ref<Expr> current = worklist.back();
+      worklist.pop_back();
+      if (!visit(current)) {
+        worklist.clear();
+        return;
+      }
+    }
+  }
+};
+
+/// \brief Rewriting of an expression DAG, where the rewrite of a
+/// subexpression shared by several parents is computed once.
+///
+/// A subclass rewrites a subexpression, calling rewrite() for the kids it
+/// rewrites. The rewrites are memoized by the identity of the
+/// subexpressions, which the rewritten expression keeps alive.
+class TxExprRewriter {
+  std::map<const Expr *, ref<Expr> > memo;
+
+protected:
+  virtual ref<Expr> rewriteNode(const ref<Expr> &e) = 0;
+
+public:
+  virtual ~TxExprRewriter() {}
+
+  ref<Expr> rewrite(const ref<Expr> &e) {
+    std::map<const Expr *, ref<Expr> >::iterator it = memo.find(e.get());
+    if (it != memo.end())
+      return it->second;
+    ref<Expr> ret = rewriteNode(e);
+    memo[e.get()] = ret;
+    return ret;
+  }
+};
+
 /// \brief General substitution mechanism
 class TxSubstitutionVisitor : public ExprVisitor {
 private:
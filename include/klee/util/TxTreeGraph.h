@@ -22,6 +22,7 @@
 #include "llvm/Support/raw_ostream.h"
 
 #include <map>
+#include <string>
 
 namespace klee {
 
@@ -34,6 +35,12 @@ class TxSubsumptionTableEntry;
 class TxTreeNode;
 
 /// \brief The interpolation tree graph for outputting to .dot file.
+///
+/// The graph is written as the tree is explored: a node is written, together
+/// with the edge from its parent, once its Tracer-X tree node is deleted and
+/// its children have been written, and its mirror is then freed. Subsumption
+/// edges are written as they are found. The nodes remaining at the end of the
+/// run are written by TxTreeGraph#save.
 class TxTreeGraph {
 
 public:
@@ -59,9 +66,17 @@ private:
     /// due to memory access.
     uint64_t internalNodeId;
 
-    /// \brief False and true children of this node
+    /// \brief False and true children of this node, which are reset when
+    /// they are written
     TxTreeGraph::Node *parent, *falseTarget, *trueTarget;
 
+    /// \brief Indicates that the node has children
+    bool split;
+
+    /// \brief Indicates that the Tracer-X tree node has been deleted, so
+    /// that this node is written as soon as its children are
+    bool removed;
+
     /// \brief Indicates that node is subsumed
     bool subsumed;
 
@@ -93,8 +108,9 @@ private:
 
     Node(uint64_t _markCount)
         : nodeSequenceNumber(0), internalNodeId(0), parent(0), falseTarget(0),
-          trueTarget(0), subsumed(false), errorType(TxTreeGraph::NONE),
-          errorPath(false), markCount(_markCount), markAddition(0) {}
+          trueTarget(0), split(false), removed(false), subsumed(false),
+          errorType(TxTreeGraph::NONE), errorPath(false),
+          markCount(_markCount), markAddition(0) {}
 
     ~Node() {
       if (falseTarget)
@@ -111,65 +127,57 @@ private:
     }
   };
 
-  class NumberedEdge {
-    TxTreeGraph::Node *source;
-    TxTreeGraph::Node *destination;
-    uint64_t number;
-
-  public:
-    NumberedEdge(TxTreeGraph::Node *_source, TxTreeGraph::Node *_destination,
-                 uint64_t _number)
-        : source(_source), destination(_destination), number(_number) {}
-
-    ~NumberedEdge() {
-      delete source;
-      delete destination;
-    }
-
-    std::string render() const;
-  };
-
   TxTreeGraph::Node *root;
   std::map<TxTreeNode *, TxTreeGraph::Node *> txTreeNodeMap;
-  std::map<TxSubsumptionTableEntry *, TxTreeGraph::Node *> tableEntryMap;
-  std::vector<TxTreeGraph::NumberedEdge *> subsumptionEdges;
+
+  /// \brief The names of the nodes of the table entries, which may have been
+  /// written already when they subsume another node
+  std::map<TxSubsumptionTableEntry *, std::string> tableEntryMap;
+
   std::map<TxPCConstraint *, TxTreeGraph::Node *> pathConditionMap;
 
-  /// \brief The set of known leaves
-  std::set<TxTreeGraph::Node *> leaves;
+  /// \brief The stream the graph is written to
+  llvm::raw_ostream *os;
 
-  /// \brief Maps leaves to leaf ids
-  std::map<TxTreeGraph::Node *, uint64_t> leafToLeafSequenceNumber;
+  /// \brief The number of leaves written, numbering the terminal nodes in
+  /// the order they are completed
+  uint64_t leafCount;
 
   uint64_t subsumptionEdgeNumber;
 
   uint64_t internalNodeId;
 
-  std::string recurseRender(TxTreeGraph::Node *node);
+  /// \brief Get the DOT name of a node
+  std::string getName(TxTreeGraph::Node *node);
 
-  std::string render();
+  /// \brief Write a node without children and the edge from its parent, and
+  /// free it. The parent is also written if it was waiting for this node.
+  void write(TxTreeGraph::Node *node);
 
-  TxTreeGraph(TxTreeNode *_root);
+  /// \brief Write a subtree, children first
+  void recurseWrite(TxTreeGraph::Node *node);
+
+  TxTreeGraph(TxTreeNode *_root, const std::string &dotFileName);
 
   ~TxTreeGraph();
 
 public:
   static uint64_t nodeCount;
 
-  static void initialize(TxTreeNode *root) {
+  static void initialize(TxTreeNode *root, const std::string &dotFileName) {
     if (!OUTPUT_INTERPOLATION_TREE)
       return;
 
-    if (!instance)
+    if (instance)
       delete instance;
-    instance = new TxTreeGraph(root);
+    instance = new TxTreeGraph(root, dotFileName);
   }
 
   static void deallocate() {
     if (!OUTPUT_INTERPOLATION_TREE)
       return;
 
-    if (!instance)
+    if (instance)
       delete instance;
     instance = 0;
   }
@@ -177,6 +185,10 @@ public:
   static void addChildren(TxTreeNode *parent, TxTreeNode *falseChild,
                           TxTreeNode *trueChild);
 
+  /// \brief Write the node of a Tracer-X tree node being deleted, once its
+  /// children are written
+  static void removeNode(TxTreeNode *txTreeNode);
+
   static void setCurrentNode(ExecutionState &state,
                              const uint64_t _nodeSequenceNumber);
 
@@ -190,13 +202,16 @@ public:
   static void addTableEntryMapping(TxTreeNode *txTreeNode,
                                    TxSubsumptionTableEntry *entry);
 
+  /// \brief Forget the node of a table entry, before the entry is deleted
+  static void removeTableEntryMapping(TxSubsumptionTableEntry *entry);
+
   static void setAsCore(TxPCConstraint *pathCondition);
 
   static void setError(const ExecutionState &state,
                        TxTreeGraph::Error errorType);
 
-  /// \brief Save the graph
-  static void save(std::string dotFileName);
+  /// \brief Write the remaining nodes and close the graph
+  static void save();
 };
 }
 
@@ -16,9 +16,11 @@
 
 namespace klee {
 
-llvm::cl::opt<bool> UseFastCexSolver("use-fast-cex-solver",
-                                     llvm::cl::init(false),
-                                     llvm::cl::desc("(default=off)"));
+llvm::cl::opt<bool> UseFastCexSolver(
+    "use-fast-cex-solver", llvm::cl::init(false),
+    llvm::cl::desc("Try to decide the queries by propagating the ranges of "
+                   "the bytes of the arrays before calling the core solver "
+                   "(default=off)"));
 
 llvm::cl::opt<bool>
 UseCexCache("use-cex-cache", llvm::cl::init(true),
@@ -28,13 +30,60 @@ llvm::cl::opt<bool>
 UseCache("use-cache", llvm::cl::init(true),
          llvm::cl::desc("Use validity caching (default=on)"));
 
+llvm::cl::opt<bool> UseUnsatCoreCache(
+    "use-unsat-core-cache", llvm::cl::init(false),
+    llvm::cl::desc("Answer a valid query from the unsatisfiability core of an "
+                   "earlier valid query of the same expression whose "
+                   "constraints the query has (default=off)"));
+
+llvm::cl::opt<std::string> QueryCacheFile(
+    "query-cache-file", llvm::cl::init(""),
+    llvm::cl::value_desc("path"),
+    llvm::cl::desc("Answer the queries reaching the core solver from the "
+                   "answers of earlier runs in the file, and append the new "
+                   "answers to it at exit (default=none)"));
+
+llvm::cl::opt<unsigned> QueryCacheMaxSize(
+    "query-cache-max-size", llvm::cl::init(256),
+    llvm::cl::value_desc("megabytes"),
+    llvm::cl::desc("Size beyond which the file of -query-cache-file is not "
+                   "grown (default=256)"));
+
+llvm::cl::opt<bool> UseAlphaCache(
+    "use-alpha-cache", llvm::cl::init(false),
+    llvm::cl::desc("Answer the queries that the other caches miss from "
+                   "earlier queries of the same structure, whatever the "
+                   "names of their arrays, kept in memory up to "
+                   "-query-cache-max-size (default=off)"));
+
 llvm::cl::opt<bool> UseIndependentSolver(
     "use-independent-solver", llvm::cl::init(true),
     llvm::cl::desc("Use constraint independence (default=on)"));
 
+llvm::cl::opt<bool> UseRangeSolver(
+    "use-range-solver", llvm::cl::init(true),
+    llvm::cl::desc("Decide comparisons with constants from the bounds in the "
+                   "constraints, before any other solver (default=on)"));
+
+llvm::cl::opt<unsigned> SmallArraySize(
+    "small-array-size", llvm::cl::init(0),
+    llvm::cl::desc("Encode the symbolic arrays of at most this number of "
+                   "bytes as one bitvector variable per byte instead of with "
+                   "the array theory, in the STP and Z3 builders. A read at a "
+                   "symbolic index becomes a chain of if-then-else over the "
+                   "bytes (default=0 (off))"));
+
 llvm::cl::opt<bool> DebugValidateSolver("debug-validate-solver",
                                         llvm::cl::init(false));
 
+llvm::cl::opt<double> ValidateSolverSample(
+    "validate-solver-sample", llvm::cl::init(0.0),
+    llvm::cl::desc("Validate this fraction of the query results of the solver "
+                   "chain in a background process, against the solver of "
+                   "-debug-crosscheck-core-solver, or else against the core "
+                   "solver without the chain, warning of each mismatch "
+                   "(default=0 (off))"));
+
 llvm::cl::opt<int> MinQueryTimeToLog(
     "min-query-time-to-log", llvm::cl::init(0),
     llvm::cl::value_desc("milliseconds"),
@@ -54,6 +103,13 @@ llvm::cl::opt<bool> UseForkedCoreSolver(
     llvm::cl::desc("Run the core SMT solver in a forked process (default=on)"),
     llvm::cl::init(true));
 
+llvm::cl::opt<bool> UseSolverWorker(
+    "use-solver-worker",
+    llvm::cl::desc("Run the core SMT solver in a long-lived worker process "
+                   "rather than forking for each query, with any backend.  "
+                   "Not used with --portfolio-solvers (default=off)"),
+    llvm::cl::init(false));
+
 llvm::cl::opt<bool> CoreSolverOptimizeDivides(
     "solver-optimize-divides",
     llvm::cl::desc("Optimize constant divides into add/shift/multiplies before "
@@ -97,6 +153,11 @@ llvm::cl::opt<bool> OutputTree(
                    "format. At present, this feature is only available when "
                    "Z3 is compiled in and interpolation is enabled."));
 
+llvm::cl::opt<bool> CompressOutputTree(
+    "compress-output-tree",
+    llvm::cl::desc("Compress the tree.dot file of -output-tree into "
+                   "tree.dot.gz (default=off)"));
+
 llvm::cl::opt<bool>
 SubsumedTest("subsumed-test",
              llvm::cl::desc("Enables generation of test cases for subsumed "
@@ -204,6 +265,28 @@ llvm::cl::opt<std::string> DependencyFolder(
         "also must be put in this folder"),
     llvm::cl::init("."));
 
+llvm::cl::opt<unsigned> SpecBackoff(
+    "spec-backoff",
+    llvm::cl::desc("After this number of consecutive failed speculations at "
+                   "a branch, skip the speculations there with exponentially "
+                   "increasing gaps, until a speculation is not failed by the "
+                   "next one (default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> SpecBackoffMaxGap(
+    "spec-backoff-max-gap",
+    llvm::cl::desc("Maximum number of consecutive speculations skipped at a "
+                   "branch by -spec-backoff (default=64)."),
+    llvm::cl::init(64));
+
+llvm::cl::opt<bool> SpecDependencyAnalysis(
+    "spec-dependency-analysis",
+    llvm::cl::desc("Compute the variables to avoid in speculation with an "
+                   "analysis of the module instead of reading the SpecAvoid_* "
+                   "files of -spec-dependency. InitialVisitedBB.txt is still "
+                   "read from the folder when it exists (default=off)."),
+    llvm::cl::init(false));
+
 llvm::cl::opt<bool>
 WPInterpolant("wp-interpolant",
               llvm::cl::desc("Perform weakest-precondition interpolation"),
@@ -214,11 +297,311 @@ MarkGlobal("mark-global",
            llvm::cl::desc("Decide whether global variables are marked or not"),
            llvm::cl::init(true));
 
+llvm::cl::opt<bool> SubsumptionPrefilter(
+    "subsumption-prefilter",
+    llvm::cl::desc("Reject subsumption table entries whose allocation "
+                   "contexts or historical variables do not exist in the "
+                   "state before building any constraint (default=true)."),
+    llvm::cl::init(true));
+
+llvm::cl::opt<bool> SubsumptionArrayPrefilter(
+    "subsumption-array-prefilter",
+    llvm::cl::desc("Also reject subsumption table entries whose interpolant "
+                   "mentions free arrays not constrained in the state. This "
+                   "may lose subsumptions whose interpolant is implied via "
+                   "store equalities only (default=false)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> SubsumptionThreads(
+    "subsumption-threads",
+    llvm::cl::desc("Decide the solver queries of up to this number of "
+                   "subsumption table entries concurrently, each on its own "
+                   "thread and Z3 context, stopping at the first success. "
+                   "Values below 2 check the entries one at a time "
+                   "(default=0)."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> SubsumptionBackoff(
+    "subsumption-backoff",
+    llvm::cl::desc("After this number of consecutive failed subsumption "
+                   "checks at a program point, skip the checks there with "
+                   "exponentially increasing gaps, until a check succeeds "
+                   "(default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> SubsumptionBackoffMaxGap(
+    "subsumption-backoff-max-gap",
+    llvm::cl::desc("Maximum number of consecutive subsumption checks skipped "
+                   "at a program point by -subsumption-backoff "
+                   "(default=1024)."),
+    llvm::cl::init(1024));
+
+llvm::cl::opt<unsigned> SubsumptionFailureSharing(
+    "subsumption-failure-sharing",
+    llvm::cl::desc("Maximum number of state fingerprints whose failed "
+                   "subsumption checks are remembered, such that a state "
+                   "with the same program point, path condition and stores "
+                   "as an earlier one skips the table entries that failed "
+                   "to subsume it (default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<SubsumptionEntryOrder> SubsumptionEntryOrderToUse(
+    "subsumption-entry-order",
+    llvm::cl::desc("Order in which the subsumption table entries of a program "
+                   "point are tried (default=newest)."),
+    llvm::cl::values(
+        clEnumValN(NEWEST_FIRST, "newest", "Newest entry first"),
+        clEnumValN(MOVE_TO_FRONT, "move-to-front",
+                   "Most recently successful entry first"),
+        clEnumValN(HIT_RATE, "hit-rate",
+                   "Entry with the highest subsumption rate first"),
+        clEnumValEnd),
+    llvm::cl::init(NEWEST_FIRST));
+
+llvm::cl::opt<SubsumptionPointPolicy> SubsumptionPoints(
+    "subsumption-points",
+    llvm::cl::desc("Program points at which subsumption table entries are "
+                   "stored and checked, from a static analysis of the "
+                   "control flow graphs (default=all)."),
+    llvm::cl::values(
+        clEnumValN(ALL_POINTS, "all", "The program points of all nodes"),
+        clEnumValN(LOOP_POINTS, "loops",
+                   "Loop headers and function entries"),
+        clEnumValN(JOIN_POINTS, "joins",
+                   "Loop headers, join points with several predecessors and "
+                   "function entries"),
+        clEnumValEnd),
+    llvm::cl::init(ALL_POINTS));
+
+llvm::cl::opt<unsigned> MaxSubsumptionTableMemory(
+    "max-subsumption-table-memory",
+    llvm::cl::desc("Memory budget of the subsumption table in megabytes. When "
+                   "the estimated size of the table exceeds the budget, "
+                   "entries chosen by -subsumption-eviction-policy are "
+                   "deleted. This also allows the table to be shrunk instead "
+                   "of killing states when -max-memory is reached (default=0 "
+                   "(off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> MaxSubsumptionPointEntries(
+    "max-subsumption-point-entries",
+    llvm::cl::desc("Maximum number of subsumption table entries of a program "
+                   "point. When a program point has more entries, an entry "
+                   "chosen by -subsumption-eviction-policy is deleted "
+                   "(default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<SubsumptionEvictionPolicy> SubsumptionEvictionPolicyToUse(
+    "subsumption-eviction-policy",
+    llvm::cl::desc("Which subsumption table entries to delete first when "
+                   "-max-subsumption-table-memory or "
+                   "-max-subsumption-point-entries is exceeded "
+                   "(default=lru)."),
+    llvm::cl::values(
+        clEnumValN(EVICT_LRU, "lru", "Least recently successful entry first"),
+        clEnumValN(EVICT_LEAST_HIT, "least-hit",
+                   "Entry with the fewest subsumptions first"),
+        clEnumValN(EVICT_LARGEST, "largest", "Largest entry first"),
+        clEnumValEnd),
+    llvm::cl::init(EVICT_LRU));
+
+llvm::cl::opt<unsigned> MaxInterpolantNodes(
+    "max-interpolant-nodes",
+    llvm::cl::desc("Budget of distinct expression nodes of an interpolant. A "
+                   "weakest precondition interpolant over the budget is "
+                   "dropped for the deletion-based interpolant, and an entry "
+                   "whose interpolant is still over the budget is not stored "
+                   "(default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> MaxInterpolantDepth(
+    "max-interpolant-depth",
+    llvm::cl::desc("Budget of expression depth of an interpolant, enforced "
+                   "as -max-interpolant-nodes (default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> SubsumptionQueryCacheSize(
+    "subsumption-query-cache-size",
+    llvm::cl::desc("Maximum number of solver results of subsumption queries "
+                   "cached per subsumption table entry, reused by states "
+                   "with the same query expression and path condition "
+                   "(0=off, default=64)."),
+    llvm::cl::init(64));
+
+llvm::cl::opt<bool> SubsumptionModelRefutation(
+    "subsumption-model-refutation",
+    llvm::cl::desc("Fail a subsumption check without its validity query when "
+                   "the query expression is false under a solution of the "
+                   "path condition, computed once for the entries checked "
+                   "(default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> SubsumptionPartitioning(
+    "subsumption-partitioning",
+    llvm::cl::desc("Decide an unquantified subsumption query by its groups of "
+                   "conjuncts sharing no variables, one solver query each, "
+                   "failing at the first invalid group and reusing the "
+                   "results of the groups across the entries checked for "
+                   "the same path condition (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> SubsumptionEntryPruning(
+    "subsumption-entry-pruning",
+    llvm::cl::desc("Do not insert a subsumption table entry when an entry of "
+                   "the same program point and call history has the same "
+                   "stores and a subset of its interpolant conjuncts, and "
+                   "remove the entries the inserted entry is so more general "
+                   "than (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> SubsumptionEntryInterning(
+    "subsumption-entry-interning",
+    llvm::cl::desc("Share the equal interpolant conjuncts and store values "
+                   "of the subsumption table entries of a program point, "
+                   "instead of each entry keeping its own copies "
+                   "(default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> LoopEntryGeneralization(
+    "loop-entry-generalization",
+    llvm::cl::desc("At a loop header, merge a new subsumption table entry "
+                   "with an entry of the same call history and stores whose "
+                   "interpolant only differs in bounds on one expression, "
+                   "such as a loop counter, when the union of the bounds is "
+                   "an interval, so that a state within the interval is "
+                   "subsumed by the merged entry (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> SubsumptionSmallArraySize(
+    "subsumption-small-array-size",
+    llvm::cl::desc("The -small-array-size of the arrays first met in a "
+                   "subsumption check, the shadow arrays, which are "
+                   "quantified, keeping the array theory (default=the value "
+                   "of -small-array-size)."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<bool> CompactHistoricalStore(
+    "compact-historical-store",
+    llvm::cl::desc("Remove from the historical stores of a node, when its "
+                   "execution completes, the overwritten entries that are not "
+                   "in the core and that no value references, as they can "
+                   "never be in an interpolant (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> AsyncInterpolants(
+    "async-interpolants",
+    llvm::cl::desc("Build the subsumption table entries of removed nodes in "
+                   "the background instead of when the nodes are removed, "
+                   "building up to this number of pending entries per "
+                   "executed instruction. A state reaching the program point "
+                   "of a pending entry does not see it (default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> SampleNodeMemory(
+    "sample-node-memory",
+    llvm::cl::desc("Measure the lifetime in instructions, and the estimated "
+                   "bytes of the dependency values, store, path condition, "
+                   "weakest precondition and phi values, of every n-th "
+                   "removed interpolation tree node, reported as histograms "
+                   "at the end of the run and as averages in run.stats "
+                   "(default=0 (off))."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<bool> LogSubsumptionQueries(
+    "log-subsumption-queries",
+    llvm::cl::desc("Log the solver queries of the subsumption checks to "
+                   "subsumption-queries.kquery, each preceded by a comment "
+                   "giving the table entry, the state node, the outcome and "
+                   "the time. The log can be replayed by kleaver "
+                   "(default=false)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<std::string> SubsumptionTableFile(
+    "subsumption-table-file",
+    llvm::cl::desc("Load the subsumption table from this file at startup, "
+                   "when it was saved from the same module, and save the "
+                   "table to it at exit. Only the entries without memory "
+                   "fragments are saved (default=off)."),
+    llvm::cl::init(""));
+
+llvm::cl::opt<bool> SeparateSubsumptionSolver(
+    "separate-subsumption-solver",
+    llvm::cl::desc("Send the subsumption checks to a solver chain of their "
+                   "own, with its own core solver and caches, instead of "
+                   "the chain of the branch queries (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> SubsumptionUseCache(
+    "subsumption-use-cache",
+    llvm::cl::desc("Use validity caching in the solver chain of the "
+                   "subsumption checks (default=on)."),
+    llvm::cl::init(true));
+
+llvm::cl::opt<bool> SubsumptionUseCexCache(
+    "subsumption-use-cex-cache",
+    llvm::cl::desc("Use counterexample caching in the solver chain of the "
+                   "subsumption checks (default=on)."),
+    llvm::cl::init(true));
+
+llvm::cl::opt<bool> SubsumptionUseIndependentSolver(
+    "subsumption-use-independent-solver",
+    llvm::cl::desc("Use constraint independence in the solver chain of the "
+                   "subsumption checks (default=on)."),
+    llvm::cl::init(true));
+
+llvm::cl::opt<double> SubsumptionSolverTimeout(
+    "subsumption-solver-timeout",
+    llvm::cl::desc("Timeout in seconds of a subsumption check, instead of "
+                   "the core solver timeout (default=0 (use "
+                   "-max-solver-time))."),
+    llvm::cl::init(0.0));
+
+llvm::cl::opt<double> SubsumptionAdaptiveTimeout(
+    "subsumption-adaptive-timeout",
+    llvm::cl::desc("Use as the timeout of the subsumption checks at a program "
+                   "point this multiple of their longest successful check "
+                   "there, instead of -subsumption-solver-timeout. The "
+                   "timeout is shortened at program points whose checks keep "
+                   "timing out, and lengthened up to four times for the "
+                   "table entries of larger subtrees (default=0 (off))."),
+    llvm::cl::init(0.0));
+
+llvm::cl::opt<double> SubsumptionTimeFraction(
+    "subsumption-time-fraction",
+    llvm::cl::desc("Skip the subsumption checks while their total time "
+                   "exceeds this fraction of the wall time of the "
+                   "exploration (default=0 (off))."),
+    llvm::cl::init(0.0));
+
+llvm::cl::opt<unsigned> Z3RecycleMemory(
+    "z3-recycle-memory",
+    llvm::cl::desc("Recycle a Z3 context between queries when the memory "
+                   "allocated by Z3 exceeds this number of megabytes, "
+                   "rebuilding the translations of the expressions on "
+                   "demand. With Z3 versions not estimating their "
+                   "allocations, the whole heap is measured "
+                   "(default=0 (off))."),
+    llvm::cl::init(0));
+
 llvm::cl::opt<bool>
     DebugTracerX("debug-tracerx",
                  llvm::cl::desc("Output Debug Info for TracerX (default=false)."),
                  llvm::cl::init(false));
 
+llvm::cl::opt<unsigned> TxTimerSampling(
+    "tx-timer-sampling",
+    llvm::cl::desc("Time one in every this many calls of each TracerX "
+                   "profiling statistic, scaling the time accordingly "
+                   "(default=1, 0=no timing)"),
+    llvm::cl::init(1));
+
+llvm::cl::opt<bool> TxCycleTimer(
+    "tx-cycle-timer",
+    llvm::cl::desc("Time the TracerX profiling statistics with the cycle "
+                   "counter of the processor rather than the wall clock "
+                   "(default=on)"),
+    llvm::cl::init(true));
+
 #endif // ENABLE_Z3
 
 #ifdef ENABLE_METASMT
@@ -293,6 +676,16 @@ llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
                                 "Do not cross check (default)"),
                      clEnumValEnd),
     llvm::cl::init(NO_SOLVER));
+
+llvm::cl::list<CoreSolverType> PortfolioSolvers(
+    "portfolio-solvers",
+    llvm::cl::desc("Comma-separated list of core solvers to race with the "
+                   "core solver backend, returning the first answer"),
+    llvm::cl::values(clEnumValN(STP_SOLVER, "stp", "stp"),
+                     clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+                     clEnumValN(Z3_SOLVER, "z3", "Z3"),
+                     clEnumValEnd),
+    llvm::cl::CommaSeparated);
 }
 #undef STP_IS_DEFAULT_STR
 #undef METASMT_IS_DEFAULT_STR
@@ -15,13 +15,46 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+
 namespace klee {
+static const char *getCoreSolverName(CoreSolverType cst) {
+  switch (cst) {
+  case STP_SOLVER:
+    return "stp";
+  case METASMT_SOLVER:
+    return "metasmt";
+  case DUMMY_SOLVER:
+    return "dummy";
+  case Z3_SOLVER:
+    return "z3";
+  default:
+    return "none";
+  }
+}
+
 Solver *constructSolverChain(Solver *coreSolver, std::string querySMT2LogPath,
                              std::string baseSolverQuerySMT2LogPath,
                              std::string queryPCLogPath,
                              std::string baseSolverQueryPCLogPath) {
   Solver *solver = coreSolver;
 
+  if (!PortfolioSolvers.empty()) {
+    std::vector<Solver *> solvers(1, coreSolver);
+    std::vector<std::string> names(1, getCoreSolverName(CoreSolverToUse));
+    for (unsigned i = 0; i < PortfolioSolvers.size(); ++i) {
+      if (PortfolioSolvers[i] == CoreSolverToUse)
+        continue;
+      Solver *s = createCoreSolver(PortfolioSolvers[i]);
+      if (!s)
+        klee_error("Failed to create portfolio solver");
+      solvers.push_back(s);
+      names.push_back(getCoreSolverName(PortfolioSolvers[i]));
+    }
+    solver = createPortfolioSolver(solvers, names);
+    klee_message("Racing %u core solvers\n", (unsigned)solvers.size());
+  }
+
   if (optionIsSet(queryLoggingOptions, SOLVER_PC)) {
     solver = createPCLoggingSolver(solver, baseSolverQueryPCLogPath,
                                    MinQueryTimeToLog);
@@ -36,9 +69,21 @@ Solver *constructSolverChain(Solver *coreSolver, std::string querySMT2LogPath,
                  baseSolverQuerySMT2LogPath.c_str());
   }
 
+  // Below the other caches, so that the file only keeps the queries of the
+  // core solver
+  if (!QueryCacheFile.empty())
+    solver = createPersistentCachingSolver(
+        solver, QueryCacheFile, (uint64_t)QueryCacheMaxSize << 20);
+
   if (UseFastCexSolver)
     solver = createFastCexSolver(solver);
 
+  // Below the caches keyed by the expressions, as the structural hash of a
+  // query costs more than their lookups
+  if (UseAlphaCache)
+    solver = createPersistentCachingSolver(solver, "",
+                                           (uint64_t)QueryCacheMaxSize << 20);
+
   if (UseCexCache)
     solver = createCexCachingSolver(solver);
 
@@ -48,6 +93,14 @@ Solver *constructSolverChain(Solver *coreSolver, std::string querySMT2LogPath,
   if (UseIndependentSolver)
     solver = createIndependentSolver(solver);
 
+  // Above the independent solver, so that the cores are matched against the
+  // whole constraint set
+  if (UseUnsatCoreCache)
+    solver = createUnsatCoreCachingSolver(solver);
+
+  if (UseRangeSolver)
+    solver = createRangeSolver(solver);
+
   if (DebugValidateSolver)
     solver = createValidatingSolver(solver, coreSolver);
 
@@ -63,11 +116,37 @@ Solver *constructSolverChain(Solver *coreSolver, std::string querySMT2LogPath,
     klee_message("Logging all queries in .smt2 format to %s\n",
                  querySMT2LogPath.c_str());
   }
-  if (DebugCrossCheckCoreSolverWith != NO_SOLVER) {
+  if (ValidateSolverSample > 0) {
+    // Without a solver to cross check with, the chain is validated against
+    // its own core solver
+    Solver *oracleSolver = createCoreSolver(
+        DebugCrossCheckCoreSolverWith != NO_SOLVER
+            ? (CoreSolverType)DebugCrossCheckCoreSolverWith
+            : (CoreSolverType)CoreSolverToUse);
+    solver = createSampledValidatingSolver(
+        solver, oracleSolver, std::min(1.0, (double)ValidateSolverSample));
+  } else if (DebugCrossCheckCoreSolverWith != NO_SOLVER) {
     Solver *oracleSolver = createCoreSolver(DebugCrossCheckCoreSolverWith);
     solver = createValidatingSolver(/*s=*/solver, /*oracle=*/oracleSolver);
   }
 
   return solver;
 }
+
+#ifdef ENABLE_Z3
+Solver *constructSubsumptionSolverChain(Solver *coreSolver) {
+  Solver *solver = coreSolver;
+
+  if (SubsumptionUseCexCache)
+    solver = createCexCachingSolver(solver);
+
+  if (SubsumptionUseCache)
+    solver = createCachingSolver(solver);
+
+  if (SubsumptionUseIndependentSolver)
+    solver = createIndependentSolver(solver);
+
+  return solver;
+}
+#endif
 }
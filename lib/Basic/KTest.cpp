@@ -8,10 +8,19 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Internal/ADT/KTest.h"
+#include "klee/Config/config.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
 
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
@@ -20,6 +29,19 @@
 // for compatibility reasons
 #define BOUT_MAGIC "BOUT\n"
 
+#define KTEST_ARCHIVE_VERSION 1
+#define KTEST_ARCHIVE_MAGIC "KTARC"
+#define KTEST_ARCHIVE_HEADER_SIZE (KTEST_MAGIC_SIZE + 4)
+#define KTEST_BLOCK_MAGIC 0x4b54424c /* KTBL */
+#define KTEST_INDEX_MAGIC 0x4b544958 /* KTIX */
+#define KTEST_TRAILER_MAGIC 0x4b544e44 /* KTND */
+#define KTEST_BLOCK_HEADER_SIZE 20
+#define KTEST_TRAILER_SIZE 12
+
+// a block is written when its test cases reach this size or number of names
+#define KTEST_BLOCK_SIZE (64 * 1024)
+#define KTEST_BLOCK_NAMES 256
+
 /***/
 
 static int read_uint32(FILE *f, unsigned *value_out) {
@@ -238,3 +260,567 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+typedef struct ByteBuffer ByteBuffer;
+struct ByteBuffer {
+  unsigned char *data;
+  size_t size, capacity;
+};
+
+static int buffer_append(ByteBuffer *b, const void *data, size_t n) {
+  if (b->size + n > b->capacity) {
+    size_t capacity = b->capacity ? 2 * b->capacity : 4096;
+    while (capacity < b->size + n)
+      capacity *= 2;
+    unsigned char *grown = (unsigned char*) realloc(b->data, capacity);
+    if (!grown)
+      return 0;
+    b->data = grown;
+    b->capacity = capacity;
+  }
+  memcpy(b->data + b->size, data, n);
+  b->size += n;
+  return 1;
+}
+
+static int buffer_append_uint32(ByteBuffer *b, unsigned value) {
+  unsigned char data[4];
+  data[0] = value>>24;
+  data[1] = value>>16;
+  data[2] = value>> 8;
+  data[3] = value>> 0;
+  return buffer_append(b, data, 4);
+}
+
+static int buffer_append_string(ByteBuffer *b, const char *value) {
+  unsigned len = strlen(value);
+  return buffer_append_uint32(b, len) && buffer_append(b, value, len);
+}
+
+static unsigned decode_uint32(const unsigned char *data) {
+  return (((((data[0]<<8) + data[1])<<8) + data[2])<<8) + data[3];
+}
+
+typedef struct Cursor Cursor;
+struct Cursor {
+  const unsigned char *pos, *end;
+};
+
+static int cursor_uint32(Cursor *c, unsigned *value_out) {
+  if (c->end - c->pos < 4)
+    return 0;
+  *value_out = decode_uint32(c->pos);
+  c->pos += 4;
+  return 1;
+}
+
+static int cursor_bytes(Cursor *c, unsigned len, const unsigned char **out) {
+  if ((size_t) (c->end - c->pos) < len)
+    return 0;
+  *out = c->pos;
+  c->pos += len;
+  return 1;
+}
+
+static int cursor_string(Cursor *c, char **value_out) {
+  unsigned len;
+  const unsigned char *data;
+  if (!cursor_uint32(c, &len) || !cursor_bytes(c, len, &data))
+    return 0;
+  *value_out = (char*) malloc(len+1);
+  if (!*value_out)
+    return 0;
+  memcpy(*value_out, data, len);
+  (*value_out)[len] = 0;
+  return 1;
+}
+
+struct KTestArchive {
+  /* writing: the file, the test cases and the names of the current
+     block, and the index of the written blocks */
+  FILE *f;
+  ByteBuffer records;
+  char **names;
+  unsigned numNames;
+  unsigned blockTests;
+  ByteBuffer index;
+  unsigned numBlocks;
+  unsigned long long offset;
+
+  /* reading: the mapped file, the offsets and the first test cases of the
+     blocks, and the current block, decompressed, with its names and the
+     offsets of its test cases */
+  unsigned char *map;
+  size_t mapSize;
+  unsigned long long *blockOffsets;
+  unsigned *blockFirstTests;
+  unsigned numTests;
+  int block;
+  unsigned char *blockData;
+  unsigned blockSize;
+  char **blockNames;
+  unsigned numBlockNames;
+  unsigned *recordOffsets;
+};
+
+static int kTestArchive_checkHeader(FILE *f) {
+  char header[KTEST_MAGIC_SIZE];
+  if (fread(header, KTEST_MAGIC_SIZE, 1, f)!=1)
+    return 0;
+  return memcmp(header, KTEST_ARCHIVE_MAGIC, KTEST_MAGIC_SIZE) == 0;
+}
+
+int kTestArchive_isArchive(const char *path) {
+  FILE *f = fopen(path, "rb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTestArchive_checkHeader(f);
+  fclose(f);
+
+  return res;
+}
+
+KTestArchive *kTestArchive_create(const char *path) {
+  KTestArchive *a = (KTestArchive*) calloc(1, sizeof(*a));
+  if (!a)
+    return 0;
+  a->f = fopen(path, "wb");
+  if (!a->f ||
+      fwrite(KTEST_ARCHIVE_MAGIC, KTEST_MAGIC_SIZE, 1, a->f)!=1 ||
+      !write_uint32(a->f, KTEST_ARCHIVE_VERSION)) {
+    if (a->f)
+      fclose(a->f);
+    free(a);
+    return 0;
+  }
+  a->offset = KTEST_ARCHIVE_HEADER_SIZE;
+  a->block = -1;
+  return a;
+}
+
+static void kTestArchive_clearNames(char **names, unsigned numNames) {
+  unsigned i;
+  for (i=0; i<numNames; i++)
+    free(names[i]);
+}
+
+/* write the current block: its names, then its test cases */
+static int kTestArchive_flush(KTestArchive *a) {
+  ByteBuffer raw = { 0, 0, 0 };
+  unsigned char *stored;
+  size_t storedSize;
+  unsigned compressed = 0, i;
+  int res = 0;
+
+  if (!a->blockTests)
+    return 1;
+
+  if (!buffer_append_uint32(&raw, a->numNames))
+    goto error;
+  for (i=0; i<a->numNames; i++)
+    if (!buffer_append_string(&raw, a->names[i]))
+      goto error;
+  if (!buffer_append(&raw, a->records.data, a->records.size))
+    goto error;
+
+  stored = raw.data;
+  storedSize = raw.size;
+#ifdef HAVE_ZLIB_H
+  {
+    uLongf size = compressBound(raw.size);
+    unsigned char *data = (unsigned char*) malloc(size);
+    if (data && compress(data, &size, raw.data, raw.size) == Z_OK &&
+        size < raw.size) {
+      free(raw.data);
+      raw.data = stored = data;
+      storedSize = size;
+      compressed = 1;
+    } else {
+      free(data);
+    }
+  }
+#endif
+
+  if (!write_uint32(a->f, KTEST_BLOCK_MAGIC) ||
+      !write_uint32(a->f, a->blockTests) ||
+      !write_uint32(a->f, raw.size) ||
+      !write_uint32(a->f, storedSize) ||
+      !write_uint32(a->f, compressed) ||
+      fwrite(stored, storedSize, 1, a->f)!=1)
+    goto error;
+  if (!buffer_append_uint32(&a->index, a->offset >> 32) ||
+      !buffer_append_uint32(&a->index, a->offset) ||
+      !buffer_append_uint32(&a->index, a->blockTests))
+    goto error;
+  ++a->numBlocks;
+  a->offset += KTEST_BLOCK_HEADER_SIZE + storedSize;
+
+  kTestArchive_clearNames(a->names, a->numNames);
+  a->numNames = 0;
+  a->records.size = 0;
+  a->blockTests = 0;
+  res = 1;
+ error:
+  free(raw.data);
+  return res;
+}
+
+static int kTestArchive_name(KTestArchive *a, const char *name,
+                             unsigned *index_out) {
+  unsigned i;
+  char **names;
+  for (i=0; i<a->numNames; i++) {
+    if (strcmp(a->names[i], name) == 0) {
+      *index_out = i;
+      return 1;
+    }
+  }
+  names = (char**) realloc(a->names, (a->numNames + 1) * sizeof(*names));
+  if (!names)
+    return 0;
+  a->names = names;
+  if (!(a->names[a->numNames] = strdup(name)))
+    return 0;
+  *index_out = a->numNames++;
+  return 1;
+}
+
+int kTestArchive_add(KTestArchive *a, const KTest *bo) {
+  unsigned i, name;
+
+  if (!a->f)
+    return 0;
+  if (a->records.size >= KTEST_BLOCK_SIZE ||
+      a->numNames + bo->numObjects > KTEST_BLOCK_NAMES)
+    if (!kTestArchive_flush(a))
+      return 0;
+
+  if (!buffer_append_uint32(&a->records, bo->numArgs))
+    return 0;
+  for (i=0; i<bo->numArgs; i++)
+    if (!buffer_append_string(&a->records, bo->args[i]))
+      return 0;
+  if (!buffer_append_uint32(&a->records, bo->symArgvs) ||
+      !buffer_append_uint32(&a->records, bo->symArgvLen) ||
+      !buffer_append_uint32(&a->records, bo->numObjects))
+    return 0;
+  for (i=0; i<bo->numObjects; i++) {
+    KTestObject *o = &bo->objects[i];
+    if (!kTestArchive_name(a, o->name, &name) ||
+        !buffer_append_uint32(&a->records, name) ||
+        !buffer_append_uint32(&a->records, o->numBytes) ||
+        !buffer_append(&a->records, o->bytes, o->numBytes))
+      return 0;
+  }
+  ++a->blockTests;
+  return 1;
+}
+
+static int kTestArchive_addBlock(KTestArchive *a, unsigned long long offset,
+                                 unsigned numTests) {
+  unsigned long long *offsets = (unsigned long long*) realloc(
+      a->blockOffsets, (a->numBlocks + 1) * sizeof(*offsets));
+  if (!offsets)
+    return 0;
+  a->blockOffsets = offsets;
+  unsigned *firstTests = (unsigned*) realloc(
+      a->blockFirstTests, (a->numBlocks + 2) * sizeof(*firstTests));
+  if (!firstTests)
+    return 0;
+  a->blockFirstTests = firstTests;
+  if (!a->numBlocks)
+    a->blockFirstTests[0] = 0;
+  a->blockOffsets[a->numBlocks] = offset;
+  a->numTests += numTests;
+  a->blockFirstTests[++a->numBlocks] = a->numTests;
+  return 1;
+}
+
+/* locate the blocks from the index at the end of the file */
+static int kTestArchive_readIndex(KTestArchive *a) {
+  Cursor c;
+  unsigned long long offset;
+  unsigned hi, lo, magic, n, i, numTests;
+
+  if (a->mapSize < KTEST_ARCHIVE_HEADER_SIZE + KTEST_TRAILER_SIZE)
+    return 0;
+  c.pos = a->map + a->mapSize - KTEST_TRAILER_SIZE;
+  c.end = a->map + a->mapSize;
+  if (!cursor_uint32(&c, &hi) || !cursor_uint32(&c, &lo) ||
+      !cursor_uint32(&c, &magic) || magic != KTEST_TRAILER_MAGIC)
+    return 0;
+  offset = ((unsigned long long) hi << 32) | lo;
+  if (offset > a->mapSize - KTEST_TRAILER_SIZE)
+    return 0;
+
+  c.pos = a->map + offset;
+  c.end = a->map + a->mapSize - KTEST_TRAILER_SIZE;
+  if (!cursor_uint32(&c, &magic) || magic != KTEST_INDEX_MAGIC ||
+      !cursor_uint32(&c, &n))
+    return 0;
+  for (i=0; i<n; i++) {
+    if (!cursor_uint32(&c, &hi) || !cursor_uint32(&c, &lo) ||
+        !cursor_uint32(&c, &numTests))
+      return 0;
+    offset = ((unsigned long long) hi << 32) | lo;
+    if (offset + KTEST_BLOCK_HEADER_SIZE > a->mapSize ||
+        !kTestArchive_addBlock(a, offset, numTests))
+      return 0;
+  }
+  return 1;
+}
+
+/* locate the blocks by scanning the file, up to the first incomplete
+   block */
+static int kTestArchive_scan(KTestArchive *a) {
+  unsigned long long offset = KTEST_ARCHIVE_HEADER_SIZE;
+  a->numBlocks = 0;
+  a->numTests = 0;
+  while (offset + KTEST_BLOCK_HEADER_SIZE <= a->mapSize) {
+    const unsigned char *header = a->map + offset;
+    unsigned storedSize = decode_uint32(header + 12);
+    if (decode_uint32(header) != KTEST_BLOCK_MAGIC ||
+        offset + KTEST_BLOCK_HEADER_SIZE + storedSize > a->mapSize)
+      break;
+    if (!kTestArchive_addBlock(a, offset, decode_uint32(header + 4)))
+      return 0;
+    offset += KTEST_BLOCK_HEADER_SIZE + storedSize;
+  }
+  return 1;
+}
+
+KTestArchive *kTestArchive_open(const char *path) {
+  KTestArchive *a = 0;
+  struct stat st;
+  unsigned version;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+    goto error;
+  if (fstat(fd, &st) < 0 || st.st_size < KTEST_ARCHIVE_HEADER_SIZE)
+    goto error;
+  a = (KTestArchive*) calloc(1, sizeof(*a));
+  if (!a)
+    goto error;
+  a->block = -1;
+  a->mapSize = st.st_size;
+  a->map = (unsigned char*) mmap(0, a->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (a->map == MAP_FAILED) {
+    a->map = 0;
+    goto error;
+  }
+  close(fd);
+  fd = -1;
+
+  if (memcmp(a->map, KTEST_ARCHIVE_MAGIC, KTEST_MAGIC_SIZE))
+    goto error;
+  version = decode_uint32(a->map + KTEST_MAGIC_SIZE);
+  if (version > KTEST_ARCHIVE_VERSION)
+    goto error;
+  if (!kTestArchive_readIndex(a) && !kTestArchive_scan(a))
+    goto error;
+  return a;
+
+ error:
+  if (fd >= 0)
+    close(fd);
+  if (a)
+    kTestArchive_close(a);
+  return 0;
+}
+
+unsigned kTestArchive_numTests(KTestArchive *a) {
+  return a->numTests;
+}
+
+/* read a test case of a block, or skip it if out is null */
+static int kTestArchive_readRecord(KTestArchive *a, Cursor *c, KTest *out) {
+  unsigned i, n, numArgs, symArgvs, symArgvLen, numObjects, name, numBytes;
+  const unsigned char *data;
+
+  if (!cursor_uint32(c, &numArgs))
+    return 0;
+  if (out) {
+    out->version = KTEST_VERSION;
+    out->numArgs = numArgs;
+    out->args = (char**) calloc(numArgs, sizeof(*out->args));
+    if (!out->args)
+      return 0;
+  }
+  for (i=0; i<numArgs; i++) {
+    if (out) {
+      if (!cursor_string(c, &out->args[i]))
+        return 0;
+    } else if (!cursor_uint32(c, &n) || !cursor_bytes(c, n, &data)) {
+      return 0;
+    }
+  }
+  if (!cursor_uint32(c, &symArgvs) || !cursor_uint32(c, &symArgvLen) ||
+      !cursor_uint32(c, &numObjects))
+    return 0;
+  if (out) {
+    out->symArgvs = symArgvs;
+    out->symArgvLen = symArgvLen;
+    out->numObjects = numObjects;
+    out->objects = (KTestObject*) calloc(numObjects, sizeof(*out->objects));
+    if (!out->objects)
+      return 0;
+  }
+  for (i=0; i<numObjects; i++) {
+    if (!cursor_uint32(c, &name) || name >= a->numBlockNames ||
+        !cursor_uint32(c, &numBytes) || !cursor_bytes(c, numBytes, &data))
+      return 0;
+    if (out) {
+      KTestObject *o = &out->objects[i];
+      o->name = strdup(a->blockNames[name]);
+      o->numBytes = numBytes;
+      o->bytes = (unsigned char*) malloc(numBytes ? numBytes : 1);
+      if (!o->name || !o->bytes)
+        return 0;
+      memcpy(o->bytes, data, numBytes);
+    }
+  }
+  return 1;
+}
+
+static void kTestArchive_releaseBlock(KTestArchive *a) {
+  kTestArchive_clearNames(a->blockNames, a->numBlockNames);
+  free(a->blockNames);
+  free(a->blockData);
+  free(a->recordOffsets);
+  a->blockNames = 0;
+  a->numBlockNames = 0;
+  a->blockData = 0;
+  a->recordOffsets = 0;
+  a->block = -1;
+}
+
+/* decompress a block, and find its names and its test cases */
+static int kTestArchive_loadBlock(KTestArchive *a, unsigned block) {
+  const unsigned char *header = a->map + a->blockOffsets[block];
+  unsigned numTests = decode_uint32(header + 4);
+  unsigned rawSize = decode_uint32(header + 8);
+  unsigned storedSize = decode_uint32(header + 12);
+  unsigned compressed = decode_uint32(header + 16);
+  const unsigned char *stored = header + KTEST_BLOCK_HEADER_SIZE;
+  Cursor c;
+  unsigned i;
+
+  kTestArchive_releaseBlock(a);
+  if (decode_uint32(header) != KTEST_BLOCK_MAGIC ||
+      a->blockOffsets[block] + KTEST_BLOCK_HEADER_SIZE + storedSize >
+          a->mapSize)
+    return 0;
+  a->blockData = (unsigned char*) malloc(rawSize ? rawSize : 1);
+  if (!a->blockData)
+    return 0;
+  if (compressed) {
+#ifdef HAVE_ZLIB_H
+    uLongf size = rawSize;
+    if (uncompress(a->blockData, &size, stored, storedSize) != Z_OK ||
+        size != rawSize)
+      return 0;
+#else
+    return 0;
+#endif
+  } else {
+    if (storedSize != rawSize)
+      return 0;
+    memcpy(a->blockData, stored, rawSize);
+  }
+
+  a->blockSize = rawSize;
+  c.pos = a->blockData;
+  c.end = a->blockData + rawSize;
+  if (!cursor_uint32(&c, &a->numBlockNames))
+    return 0;
+  a->blockNames = (char**) calloc(a->numBlockNames, sizeof(*a->blockNames));
+  if (!a->blockNames)
+    return 0;
+  for (i=0; i<a->numBlockNames; i++) {
+    if (!cursor_string(&c, &a->blockNames[i])) {
+      a->numBlockNames = i;
+      return 0;
+    }
+  }
+  a->recordOffsets =
+      (unsigned*) malloc((numTests ? numTests : 1) * sizeof(unsigned));
+  if (!a->recordOffsets)
+    return 0;
+  for (i=0; i<numTests; i++) {
+    a->recordOffsets[i] = c.pos - a->blockData;
+    if (!kTestArchive_readRecord(a, &c, 0))
+      return 0;
+  }
+  a->block = block;
+  return 1;
+}
+
+KTest *kTestArchive_get(KTestArchive *a, unsigned index) {
+  unsigned lo = 0, hi, block;
+  KTest *res;
+  Cursor c;
+
+  if (!a->map || index >= a->numTests)
+    return 0;
+
+  /* the last block whose first test case is at most index */
+  hi = a->numBlocks;
+  while (hi - lo > 1) {
+    unsigned mid = (lo + hi) / 2;
+    if (a->blockFirstTests[mid] <= index)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  block = lo;
+  if (a->block != (int) block && !kTestArchive_loadBlock(a, block)) {
+    kTestArchive_releaseBlock(a);
+    return 0;
+  }
+
+  res = (KTest*) calloc(1, sizeof(*res));
+  if (!res)
+    return 0;
+  c.pos = a->blockData +
+          a->recordOffsets[index - a->blockFirstTests[block]];
+  c.end = a->blockData + a->blockSize;
+  if (!kTestArchive_readRecord(a, &c, res)) {
+    kTest_free(res);
+    return 0;
+  }
+  return res;
+}
+
+int kTestArchive_close(KTestArchive *a) {
+  int res = 1;
+
+  if (a->f) {
+    res = kTestArchive_flush(a) &&
+          write_uint32(a->f, KTEST_INDEX_MAGIC) &&
+          write_uint32(a->f, a->numBlocks) &&
+          (!a->index.size ||
+           fwrite(a->index.data, a->index.size, 1, a->f)==1) &&
+          write_uint32(a->f, a->offset >> 32) &&
+          write_uint32(a->f, a->offset) &&
+          write_uint32(a->f, KTEST_TRAILER_MAGIC);
+    if (fclose(a->f))
+      res = 0;
+    kTestArchive_clearNames(a->names, a->numNames);
+    free(a->names);
+    free(a->records.data);
+    free(a->index.data);
+  }
+
+  if (a->map)
+    munmap(a->map, a->mapSize);
+  kTestArchive_releaseBlock(a);
+  free(a->blockOffsets);
+  free(a->blockFirstTests);
+  free(a);
+  return res;
+}
@@ -13,17 +13,57 @@
 
 using namespace klee;
 
+__thread StatisticManager::ThreadStatistics *
+    StatisticManager::currentThreadStats = 0;
+
 StatisticManager::StatisticManager()
   : enabled(true),
     globalStats(0),
     indexedStats(0),
     contextStats(0),
-    index(0) {
+    index(0),
+    threadStats(0) {
+  pthread_mutex_init(&threadLock, 0);
 }
 
 StatisticManager::~StatisticManager() {
   if (globalStats) delete[] globalStats;
   if (indexedStats) delete[] indexedStats;
+  while (ThreadStatistics *ts = threadStats) {
+    threadStats = ts->next;
+    delete[] ts->data;
+    delete ts;
+  }
+  pthread_mutex_destroy(&threadLock);
+}
+
+void StatisticManager::beginThread() {
+  pthread_mutex_lock(&threadLock);
+  ThreadStatistics *ts;
+  if (!freeThreadStats.empty()) {
+    ts = freeThreadStats.back();
+    freeThreadStats.pop_back();
+  } else {
+    ts = new ThreadStatistics();
+    ts->data = new uint64_t[stats.size()];
+    memset(ts->data, 0, sizeof(*ts->data) * stats.size());
+    ts->next = threadStats;
+    // The statistics are complete before the readers can reach them
+    __sync_synchronize();
+    threadStats = ts;
+  }
+  pthread_mutex_unlock(&threadLock);
+  currentThreadStats = ts;
+}
+
+void StatisticManager::endThread() {
+  ThreadStatistics *ts = currentThreadStats;
+  if (!ts)
+    return;
+  currentThreadStats = 0;
+  pthread_mutex_lock(&threadLock);
+  freeThreadStats.push_back(ts);
+  pthread_mutex_unlock(&threadLock);
 }
 
 void StatisticManager::useIndexedStats(unsigned totalIndices) {  
@@ -15,8 +15,41 @@
 #include "klee/Expr.h"
 #include "klee/TimerStatIncrementer.h"
 
+#include "llvm/Support/CommandLine.h"
+
 using namespace klee;
 
+namespace {
+  llvm::cl::opt<bool>
+  ResolveByRange("resolve-by-range",
+                 llvm::cl::desc("Resolve a symbolic pointer by first bounding "
+                                "the objects it may point to, then only "
+                                "checking the objects within the bounds "
+                                "(default=off)"),
+                 llvm::cl::init(false));
+}
+
+// The solver queries of pointer resolution, counted in
+// stats::resolveQueries
+
+static bool resolveGetValue(ExecutionState &state, TimingSolver *solver,
+                            ref<Expr> e, ref<ConstantExpr> &result) {
+  ++stats::resolveQueries;
+  return solver->getValue(state, e, result);
+}
+
+static bool resolveMayBeTrue(ExecutionState &state, TimingSolver *solver,
+                             ref<Expr> e, bool &result) {
+  ++stats::resolveQueries;
+  return solver->mayBeTrue(state, e, result);
+}
+
+static bool resolveMustBeTrue(ExecutionState &state, TimingSolver *solver,
+                              ref<Expr> e, bool &result) {
+  ++stats::resolveQueries;
+  return solver->mustBeTrue(state, e, result);
+}
+
 ///
 
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
@@ -49,6 +82,61 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
   }
 }
 
+bool AddressSpace::getCandidates(ExecutionState &state, TimingSolver *solver,
+                                 ref<Expr> address, uint64_t example,
+                                 ResolutionList &candidates) {
+  // The objects in address order, split at the example: the objects before
+  // split start at or below it.
+  ResolutionList ordered;
+  ordered.reserve(objects.size());
+  unsigned split = 0;
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); it != ie;
+       ++it) {
+    ordered.push_back(*it);
+    if (it->first->address <= example)
+      split = ordered.size();
+  }
+
+  // Binary search below the example for the first object the address may
+  // be below. The address may only point to that object's predecessor and
+  // the objects after it.
+  unsigned lo = 0, hi = split;
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    bool mustBeTrue;
+    if (!resolveMustBeTrue(
+            state, solver,
+            UgeExpr::create(address, ordered[mid].first->getBaseExpr()),
+            mustBeTrue))
+      return false;
+    if (mustBeTrue)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  unsigned first = lo ? lo - 1 : 0;
+
+  // Binary search above the example for the first object the address must
+  // be below.
+  lo = split, hi = ordered.size();
+  while (lo < hi) {
+    unsigned mid = lo + (hi - lo) / 2;
+    bool mustBeTrue;
+    if (!resolveMustBeTrue(
+            state, solver,
+            UltExpr::create(address, ordered[mid].first->getBaseExpr()),
+            mustBeTrue))
+      return false;
+    if (mustBeTrue)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  candidates.assign(ordered.begin() + first, ordered.begin() + lo);
+  return true;
+}
+
 /// 
 
 bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr, 
@@ -80,11 +168,12 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     return true;
   } else {
     TimerStatIncrementer timer(stats::resolveTime);
+    ++stats::resolutions;
 
     // try cheap search, will succeed for any inbounds pointer
 
     ref<ConstantExpr> cex;
-    if (!solver->getValue(state, address, cex))
+    if (!resolveGetValue(state, solver, address, cex))
       return false;
     uint64_t example = cex->getZExtValue();
     MemoryObject hack(example);
@@ -100,6 +189,27 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     }
 
     // didn't work, now we have to search
+
+    if (ResolveByRange) {
+      ResolutionList candidates;
+      if (!getCandidates(state, solver, address, example, candidates))
+        return false;
+      for (ResolutionList::iterator it = candidates.begin(),
+             ie = candidates.end(); it != ie; ++it) {
+        bool mayBeTrue;
+        if (!resolveMayBeTrue(state, solver,
+                              it->first->getBoundsCheckPointer(address),
+                              mayBeTrue))
+          return false;
+        if (mayBeTrue) {
+          result = *it;
+          success = true;
+          return true;
+        }
+      }
+      success = false;
+      return true;
+    }
        
     MemoryMap::iterator oi = objects.upper_bound(&hack);
     MemoryMap::iterator begin = objects.begin();
@@ -111,8 +221,8 @@ bool AddressSpace::resolveOne(ExecutionState &state,
       const MemoryObject *mo = oi->first;
         
       bool mayBeTrue;
-      if (!solver->mayBeTrue(state, 
-                             mo->getBoundsCheckPointer(address), mayBeTrue))
+      if (!resolveMayBeTrue(state, solver,
+                            mo->getBoundsCheckPointer(address), mayBeTrue))
         return false;
       if (mayBeTrue) {
         result = *oi;
@@ -120,9 +230,9 @@ bool AddressSpace::resolveOne(ExecutionState &state,
         return true;
       } else {
         bool mustBeTrue;
-        if (!solver->mustBeTrue(state, 
-                                UgeExpr::create(address, mo->getBaseExpr()),
-                                mustBeTrue))
+        if (!resolveMustBeTrue(state, solver,
+                               UgeExpr::create(address, mo->getBaseExpr()),
+                               mustBeTrue))
           return false;
         if (mustBeTrue)
           break;
@@ -134,18 +244,18 @@ bool AddressSpace::resolveOne(ExecutionState &state,
       const MemoryObject *mo = oi->first;
 
       bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UltExpr::create(address, mo->getBaseExpr()),
-                              mustBeTrue))
+      if (!resolveMustBeTrue(state, solver,
+                             UltExpr::create(address, mo->getBaseExpr()),
+                             mustBeTrue))
         return false;
       if (mustBeTrue) {
         break;
       } else {
         bool mayBeTrue;
 
-        if (!solver->mayBeTrue(state, 
-                               mo->getBoundsCheckPointer(address),
-                               mayBeTrue))
+        if (!resolveMayBeTrue(state, solver,
+                              mo->getBoundsCheckPointer(address),
+                              mayBeTrue))
           return false;
         if (mayBeTrue) {
           result = *oi;
@@ -190,10 +300,44 @@ bool AddressSpace::resolve(ExecutionState &state,
     // to hit the fast path with exactly 2 queries). we could also
     // just get this by inspection of the expr.
     
+    ++stats::resolutions;
     ref<ConstantExpr> cex;
-    if (!solver->getValue(state, p, cex))
+    if (!resolveGetValue(state, solver, p, cex))
       return true;
     uint64_t example = cex->getZExtValue();
+
+    if (ResolveByRange) {
+      ResolutionList candidates;
+      if (!getCandidates(state, solver, p, example, candidates))
+        return true;
+      for (ResolutionList::iterator it = candidates.begin(),
+             ie = candidates.end(); it != ie; ++it) {
+        if (timeout_us && timeout_us < timer.check())
+          return true;
+
+        ref<Expr> inBounds = it->first->getBoundsCheckPointer(p);
+        bool mayBeTrue;
+        if (!resolveMayBeTrue(state, solver, inBounds, mayBeTrue))
+          return true;
+        if (mayBeTrue) {
+          rl.push_back(*it);
+
+          // fast path check
+          unsigned size = rl.size();
+          if (size==1) {
+            bool mustBeTrue;
+            if (!resolveMustBeTrue(state, solver, inBounds, mustBeTrue))
+              return true;
+            if (mustBeTrue)
+              return false;
+          } else if (size==maxResolutions) {
+            return true;
+          }
+        }
+      }
+      return false;
+    }
+
     MemoryObject hack(example);
     
     MemoryMap::iterator oi = objects.upper_bound(&hack);
@@ -219,7 +363,7 @@ bool AddressSpace::resolve(ExecutionState &state,
       // XXX I think there is some query wasteage here?
       ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
       bool mayBeTrue;
-      if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
+      if (!resolveMayBeTrue(state, solver, inBounds, mayBeTrue))
         return true;
       if (mayBeTrue) {
         rl.push_back(*oi);
@@ -228,7 +372,7 @@ bool AddressSpace::resolve(ExecutionState &state,
         unsigned size = rl.size();
         if (size==1) {
           bool mustBeTrue;
-          if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
+          if (!resolveMustBeTrue(state, solver, inBounds, mustBeTrue))
             return true;
           if (mustBeTrue)
             return false;
@@ -238,9 +382,9 @@ bool AddressSpace::resolve(ExecutionState &state,
       }
         
       bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UgeExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
+      if (!resolveMustBeTrue(state, solver,
+                             UgeExpr::create(p, mo->getBaseExpr()),
+                             mustBeTrue))
         return true;
       if (mustBeTrue)
         break;
@@ -252,9 +396,9 @@ bool AddressSpace::resolve(ExecutionState &state,
         return true;
 
       bool mustBeTrue;
-      if (!solver->mustBeTrue(state, 
-                              UltExpr::create(p, mo->getBaseExpr()),
-                              mustBeTrue))
+      if (!resolveMustBeTrue(state, solver,
+                             UltExpr::create(p, mo->getBaseExpr()),
+                             mustBeTrue))
         return true;
       if (mustBeTrue)
         break;
@@ -262,7 +406,7 @@ bool AddressSpace::resolve(ExecutionState &state,
       // XXX I think there is some query wasteage here?
       ref<Expr> inBounds = mo->getBoundsCheckPointer(p);
       bool mayBeTrue;
-      if (!solver->mayBeTrue(state, inBounds, mayBeTrue))
+      if (!resolveMayBeTrue(state, solver, inBounds, mayBeTrue))
         return true;
       if (mayBeTrue) {
         rl.push_back(*oi);
@@ -271,7 +415,7 @@ bool AddressSpace::resolve(ExecutionState &state,
         unsigned size = rl.size();
         if (size==1) {
           bool mustBeTrue;
-          if (!solver->mustBeTrue(state, inBounds, mustBeTrue))
+          if (!resolveMustBeTrue(state, solver, inBounds, mustBeTrue))
             return true;
           if (mustBeTrue)
             return false;
@@ -301,7 +445,7 @@ void AddressSpace::copyOutConcretes() {
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
       if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+        os->concreteStore.copyOut(address, 0, mo->size);
     }
   }
 }
@@ -315,12 +459,13 @@ bool AddressSpace::copyInConcretes() {
       const ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (memcmp(address, os->concreteStore, mo->size)!=0) {
+      if (!os->concreteStore.equals(address, 0, mo->size)) {
         if (os->readOnly) {
           return false;
         } else {
           ObjectState *wos = getWriteable(mo, os);
-          memcpy(wos->concreteStore, address, mo->size);
+          wos->concreteStore.copyIn(address, 0, mo->size);
+          wos->clearReadCache();
         }
       }
     }
@@ -40,6 +40,19 @@ namespace klee {
 
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace&); 
+
+    /// Bound the objects \a address may point to, using binary searches
+    /// over the objects in address order on either side of the feasible
+    /// value \a example.
+    ///
+    /// \param[out] candidates The objects within the bounds, in address
+    ///               order.
+    /// \return false iff a query failed.
+    bool getCandidates(ExecutionState &state,
+                       TimingSolver *solver,
+                       ref<Expr> address,
+                       uint64_t example,
+                       ResolutionList &candidates);
     
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
@@ -19,11 +19,21 @@
 #include "llvm/Function.h"
 #endif
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 using namespace klee;
 
+namespace {
+cl::opt<unsigned> CallPathDepth(
+    "call-path-depth", cl::init(0),
+    cl::desc("Beyond this depth, fold the call of a function onto its "
+             "nearest call on the call path from any call site, so that the "
+             "call paths of deep recursions stay bounded.  Calls from the "
+             "same call site are always folded (default=0 (no limit))"));
+}
+
 ///
 
 CallPathNode::CallPathNode(CallPathNode *_parent, 
@@ -32,6 +42,7 @@ CallPathNode::CallPathNode(CallPathNode *_parent,
   : parent(_parent),
     callSite(_callSite),
     function(_function),
+    depth(_parent ? _parent->depth + 1 : 0),
     count(0) {
 }
 
@@ -83,7 +94,12 @@ CallPathNode *CallPathManager::computeCallPath(CallPathNode *parent,
   for (CallPathNode *p=parent; p; p=p->parent)
     if (cs==p->callSite && f==p->function)
       return p;
-  
+
+  if (CallPathDepth && parent->depth >= CallPathDepth)
+    for (CallPathNode *p = parent; p; p = p->parent)
+      if (f == p->function)
+        return p;
+
   CallPathNode *cp = new CallPathNode(parent, cs, f);
   paths.push_back(cp);
   return cp;
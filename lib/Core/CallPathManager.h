@@ -15,6 +15,15 @@
 #include <map>
 #include <vector>
 
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_map std::unordered_map
+#else
+#include <tr1/unordered_map>
+#define unordered_map std::tr1::unordered_map
+#endif
+
 namespace llvm {
   class Instruction;
   class Function;
@@ -38,8 +47,15 @@ namespace klee {
     friend class CallPathManager;
 
   public:
-    typedef std::map<std::pair<llvm::Instruction*, 
-                               llvm::Function*>, CallPathNode*> children_ty;
+    typedef std::pair<llvm::Instruction *, llvm::Function *> key_ty;
+
+    struct KeyHash {
+      size_t operator()(const key_ty &key) const {
+        return (size_t)key.first * 31 ^ (size_t)key.second;
+      }
+    };
+
+    typedef unordered_map<key_ty, CallPathNode *, KeyHash> children_ty;
 
     // form list of (callSite,function) path
     CallPathNode *parent;
@@ -47,6 +63,10 @@ namespace klee {
     llvm::Function *function;
     children_ty children;
 
+    /// The number of calls of the path, but for the calls folded onto an
+    /// ancestor
+    unsigned depth;
+
     StatisticRecord statistics;
     StatisticRecord summaryStatistics;
     unsigned count;
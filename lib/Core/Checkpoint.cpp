@@ -0,0 +1,159 @@
+//===--- Checkpoint.cpp - Checkpoints of the exploration ------------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the checkpoints of the
+/// exploration written with -checkpoint-dir and restored with
+/// -restore-checkpoint.
+///
+//===----------------------------------------------------------------------===//
+
+#include "Checkpoint.h"
+
+#include "TxTableFile.h"
+#include "TxTree.h"
+
+#include "klee/CommandLine.h"
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+const char *const checkpointMagic = "tracerx-checkpoint";
+const unsigned checkpointVersion = 1;
+
+/// \brief Write the file aside, and rename it over the previous one
+bool writeFile(const std::string &fileName, const std::string &contents) {
+  std::string tempName = fileName + ".tmp";
+  {
+    std::ofstream out(tempName.c_str(), std::ios::out | std::ios::binary);
+    if (!out)
+      return false;
+    out.write(contents.data(), contents.size());
+    if (!out)
+      return false;
+  }
+  return rename(tempName.c_str(), fileName.c_str()) == 0;
+}
+}
+
+CheckpointNode::~CheckpointNode() {
+  for (std::map<unsigned, CheckpointNode *>::iterator it = children.begin(),
+                                                      ie = children.end();
+       it != ie; ++it)
+    delete it->second;
+}
+
+const CheckpointNode *CheckpointNode::getChild(unsigned choice) const {
+  std::map<unsigned, CheckpointNode *>::const_iterator it =
+      children.find(choice);
+  return it != children.end() ? it->second : 0;
+}
+
+std::string Checkpoint::tableDir;
+
+uint64_t Checkpoint::tableInsertionCount = 0;
+
+Checkpoint *Checkpoint::load(const std::string &dir, llvm::Module *module,
+                             ArrayCache &arrayCache) {
+  std::string fileName = dir + "/states";
+  std::ifstream in(fileName.c_str());
+  if (!in) {
+    klee_warning("cannot read checkpoint %s", fileName.c_str());
+    return 0;
+  }
+
+  std::string magic;
+  unsigned version = 0;
+  uint64_t moduleHash = 0;
+  in >> magic >> version >> moduleHash;
+  if (!in || magic != checkpointMagic || version != checkpointVersion) {
+    klee_warning("malformed checkpoint %s", fileName.c_str());
+    return 0;
+  }
+  if (moduleHash != TxTableFile::computeModuleHash(module)) {
+    klee_warning("ignoring checkpoint %s of a different module",
+                 fileName.c_str());
+    return 0;
+  }
+
+  Checkpoint *checkpoint = new Checkpoint();
+  std::string line;
+  std::getline(in, line);
+  while (std::getline(in, line)) {
+    std::istringstream choices(line);
+    CheckpointNode *node = &checkpoint->root;
+    unsigned choice;
+    while (choices >> choice) {
+      CheckpointNode *&child = node->children[choice];
+      if (!child)
+        child = new CheckpointNode();
+      node = child;
+    }
+    node->end = true;
+    ++checkpoint->stateCount;
+  }
+
+#ifdef ENABLE_Z3
+  if (INTERPOLATION_ENABLED)
+    TxTableFile::load(dir + "/table", module, arrayCache);
+#endif
+
+  klee_message("restoring %u states from checkpoint %s",
+               checkpoint->stateCount, dir.c_str());
+  return checkpoint;
+}
+
+void Checkpoint::save(const std::string &dir, llvm::Module *module,
+                      const std::set<ExecutionState *> &states) {
+  std::ostringstream out;
+  out << checkpointMagic << " " << checkpointVersion << " "
+      << TxTableFile::computeModuleHash(module) << "\n";
+
+  std::vector<unsigned> choices;
+  for (std::set<ExecutionState *>::const_iterator it = states.begin(),
+                                                  ie = states.end();
+       it != ie; ++it) {
+    choices.clear();
+    for (ForkChoice *fc = (*it)->forkChoices.get(); fc; fc = fc->previous.get())
+      choices.push_back(fc->choice);
+    for (std::vector<unsigned>::reverse_iterator ci = choices.rbegin(),
+                                                 ce = choices.rend();
+         ci != ce; ++ci)
+      out << (ci == choices.rbegin() ? "" : " ") << *ci;
+    out << "\n";
+  }
+
+  if (!writeFile(dir + "/states", out.str())) {
+    klee_warning("cannot write checkpoint to %s", dir.c_str());
+    return;
+  }
+
+#ifdef ENABLE_Z3
+  if (INTERPOLATION_ENABLED) {
+    std::string tableName = dir + "/table";
+    uint64_t insertionCount = TxSubsumptionTable::getInsertionCount();
+    if (dir == tableDir) {
+      TxTableFile::save(tableName, module, tableInsertionCount, true);
+    } else {
+      TxTableFile::save(tableName + ".tmp", module);
+      if (rename((tableName + ".tmp").c_str(), tableName.c_str()) != 0)
+        klee_warning("cannot write checkpoint table to %s", dir.c_str());
+      tableDir = dir;
+    }
+    tableInsertionCount = insertionCount;
+  }
+#endif
+}
@@ -0,0 +1,104 @@
+//===--- Checkpoint.h - Checkpoints of the exploration ----------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the checkpoints of the exploration
+/// written with -checkpoint-dir and restored with -restore-checkpoint.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CHECKPOINT_H
+#define KLEE_CHECKPOINT_H
+
+#include <map>
+#include <set>
+#include <string>
+
+#include <stdint.h>
+
+namespace llvm {
+class Module;
+}
+
+namespace klee {
+class ArrayCache;
+class ExecutionState;
+
+/// \brief A fork on the paths recorded in a checkpoint
+class CheckpointNode {
+  friend class Checkpoint;
+
+  std::map<unsigned, CheckpointNode *> children;
+
+  /// \brief Whether a recorded path ends at this fork
+  bool end;
+
+  CheckpointNode() : end(false) {}
+
+  ~CheckpointNode();
+
+public:
+  /// \brief The node reached by the choice, or null when no recorded path
+  /// takes it
+  const CheckpointNode *getChild(unsigned choice) const;
+
+  bool isEnd() const { return end; }
+};
+
+/// \brief A checkpoint of the exploration.
+///
+/// A state is identified by the choices of the forks on its path, each the
+/// index of the side it took, so that a later run on the same module reaches
+/// it again by following them. The checkpoint directory holds the choices of
+/// the live states, and the subsumption table when interpolation is enabled.
+/// The choices are written aside and renamed over the previous ones, so that
+/// a run interrupted while checkpointing leaves the last checkpoint intact.
+/// The table is written in full at the first checkpoint of the run, and the
+/// later checkpoints append only the entries inserted since, so that a
+/// segment cut short by an interruption only loses its own entries.
+///
+/// A run restored from the checkpoint drops at each fork the sides that no
+/// recorded path takes, which were explored before the checkpoint, until
+/// each state reaches the end of its recorded path and is explored as usual
+/// from there. The solver caches and the statistics are not part of the
+/// checkpoint, and the states are rebuilt by reexecuting their paths.
+class Checkpoint {
+  CheckpointNode root;
+
+  unsigned stateCount;
+
+  Checkpoint() : stateCount(0) {}
+
+  /// \brief The directory the run last wrote the table into, and the
+  /// insertion count of the table then
+  static std::string tableDir;
+
+  static uint64_t tableInsertionCount;
+
+public:
+  /// \brief Load the checkpoint in the directory, or return null when it is
+  /// missing or was written from another module. The subsumption table is
+  /// inserted into the table of the run.
+  static Checkpoint *load(const std::string &dir, llvm::Module *module,
+                          ArrayCache &arrayCache);
+
+  /// \brief Write the fork choices of the states, and the subsumption table,
+  /// into the directory
+  static void save(const std::string &dir, llvm::Module *module,
+                   const std::set<ExecutionState *> &states);
+
+  /// \brief The node of the initial state, or null when the checkpoint was
+  /// taken before the first fork
+  const CheckpointNode *getRoot() const { return root.end ? 0 : &root; }
+
+  unsigned getStateCount() const { return stateCount; }
+};
+}
+
+#endif
@@ -16,13 +16,19 @@ Statistic stats::coveredInstructions("CoveredInstructions", "Icov");
 Statistic stats::falseBranches("FalseBranches", "Bf");
 Statistic stats::forkTime("ForkTime", "Ftime");
 Statistic stats::forks("Forks", "Forks");
+Statistic stats::functionSummaryHits("FunctionSummaryHits", "FShits");
 Statistic stats::instructionRealTime("InstructionRealTimes", "Ireal");
 Statistic stats::instructionTime("InstructionTimes", "Itime");
 Statistic stats::instructions("Instructions", "I");
 Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
+Statistic stats::nativeCalls("NativeCalls", "Ncalls");
+Statistic stats::rangeDecidedBranches("RangeDecidedBranches", "RDbranches");
 Statistic stats::reachableUncovered("ReachableUncovered", "IuncovReach");
+Statistic stats::resolutions("Resolutions", "Res");
+Statistic stats::resolveQueries("ResolveQueries", "Rq");
 Statistic stats::resolveTime("ResolveTime", "Rtime");
+Statistic stats::reusedTestModels("ReusedTestModels", "RTmodels");
 Statistic stats::solverTime("SolverTime", "Stime");
 Statistic stats::states("States", "States");
 Statistic stats::trueBranches("TrueBranches", "Bt");
@@ -17,6 +17,12 @@ namespace stats {
 
   extern Statistic allocations;
   extern Statistic resolveTime;
+
+  /// The number of resolutions of symbolic pointers, and the number of
+  /// solver queries they made.
+  extern Statistic resolutions;
+  extern Statistic resolveQueries;
+
   extern Statistic instructions;
   extern Statistic instructionTime;
   extern Statistic instructionRealTime;
@@ -30,6 +36,18 @@ namespace stats {
   /// The number of process forks.
   extern Statistic forks;
 
+  /// The number of calls given their return value by -function-summaries.
+  extern Statistic functionSummaryHits;
+
+  /// The calls run natively by -native-concrete-calls.
+  extern Statistic nativeCalls;
+
+  /// The number of branches decided by -range-branch-check.
+  extern Statistic rangeDecidedBranches;
+
+  /// The number of test cases given the model kept by -reuse-state-model.
+  extern Statistic reusedTestModels;
+
   /// Number of states, this is a "fake" statistic used by istats, it
   /// isn't normally up-to-date.
   extern Statistic states;
@@ -0,0 +1,155 @@
+//===-- CoverageLogger.cpp - Basic block coverage output --------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the sink of the basic block
+/// coverage events reported with -write-BB-cov.
+///
+//===----------------------------------------------------------------------===//
+
+#include "CoverageLogger.h"
+
+#include "klee/Config/config.h"
+#include "klee/Config/Version.h"
+#include "klee/Interpreter.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#ifdef HAVE_ZLIB_H
+#include "klee/Internal/Support/CompressionStream.h"
+#endif
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#else
+#include "llvm/BasicBlock.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#endif
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+
+using namespace klee;
+
+namespace {
+#ifdef HAVE_ZLIB_H
+llvm::cl::opt<bool> CompressCoverageLog(
+    "compress-BB-cov-log", llvm::cl::init(false),
+    llvm::cl::desc("Compress the live coverage files of -write-BB-cov "
+                   "(default=off)"));
+#endif
+}
+
+CoverageLogger::CoverageLogger(InterpreterHandler *_handler, int _level)
+    : handler(_handler), level(_level), livePercentCovFile(0),
+      bbPlottingFile(0) {}
+
+CoverageLogger::~CoverageLogger() {
+  delete livePercentCovFile;
+  delete bbPlottingFile;
+}
+
+llvm::raw_ostream *CoverageLogger::openFile(const std::string &name) {
+#ifdef HAVE_ZLIB_H
+  if (CompressCoverageLog) {
+    std::string error;
+    std::string path = handler->getOutputFilename(name + ".gz");
+    llvm::raw_ostream *os = new compressed_fd_ostream(path.c_str(), error);
+    if (error != "") {
+      klee_warning("Could not open file %s : %s", path.c_str(), error.c_str());
+      delete os;
+      return 0;
+    }
+    return os;
+  }
+#endif
+  return handler->openOutputFile(name);
+}
+
+void CoverageLogger::logLivePercentage(unsigned visitedCount, int allCount,
+                                       float percent) {
+  if (!livePercentCovFile) {
+    livePercentCovFile = openFile("LivePercentCov.txt");
+    if (!livePercentCovFile)
+      return;
+  }
+  // [No. Visited - Total - %]
+  *livePercentCovFile << "[" << visitedCount << "," << allCount << ","
+                      << llvm::format("%g", percent) << "]\n";
+}
+
+unsigned CoverageLogger::logLiveBlock(llvm::BasicBlock *bb, int order) {
+  liveBlocks.push_back(std::make_pair(bb, order));
+
+  unsigned icmpCount = 0;
+  for (llvm::BasicBlock::iterator it = bb->begin(), ie = bb->end(); it != ie;
+       ++it) {
+    if (llvm::isa<llvm::ICmpInst>(it))
+      ++icmpCount;
+  }
+  return icmpCount;
+}
+
+void CoverageLogger::logPlotting(double time, float percent) {
+  if (!bbPlottingFile) {
+    bbPlottingFile = openFile("BBPlotting.txt");
+    if (!bbPlottingFile)
+      return;
+  }
+  *bbPlottingFile << llvm::format("%g", time) << "     "
+                  << llvm::format("%.2f", percent) << "\n";
+}
+
+void CoverageLogger::finish() {
+  if (livePercentCovFile)
+    livePercentCovFile->flush();
+  if (bbPlottingFile)
+    bbPlottingFile->flush();
+
+  if (level >= 3) {
+    llvm::raw_ostream *liveBBFile = openFile("LiveBB.txt");
+    if (liveBBFile) {
+      for (std::vector<std::pair<llvm::BasicBlock *, int> >::iterator
+               it = liveBlocks.begin(),
+               ie = liveBlocks.end();
+           it != ie; ++it) {
+        llvm::BasicBlock *bb = it->first;
+        *liveBBFile << "-- BlockScopeStarts --\n";
+        *liveBBFile << "Function: " << bb->getParent()->getName() << "\n";
+        *liveBBFile << "Block Order: " << it->second;
+        bb->print(*liveBBFile);
+        *liveBBFile << "-- BlockScopeEnds --\n\n";
+      }
+      delete liveBBFile;
+    }
+  }
+
+  if (level >= 4) {
+    llvm::raw_ostream *icmpFile = openFile("coveredICMP.txt");
+    if (icmpFile) {
+      for (std::vector<std::pair<llvm::BasicBlock *, int> >::iterator
+               it = liveBlocks.begin(),
+               ie = liveBlocks.end();
+           it != ie; ++it) {
+        llvm::BasicBlock *bb = it->first;
+        for (llvm::BasicBlock::iterator icmp = bb->begin(), iie = bb->end();
+             icmp != iie; ++icmp) {
+          if (llvm::isa<llvm::ICmpInst>(icmp)) {
+            *icmpFile << "Function: " << bb->getParent()->getName() << " ";
+            *icmpFile << "Block Order: " << it->second;
+            icmp->print(*icmpFile);
+            *icmpFile << "\n";
+          }
+        }
+      }
+      delete icmpFile;
+    }
+  }
+  liveBlocks.clear();
+}
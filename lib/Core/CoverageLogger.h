@@ -0,0 +1,75 @@
+//===--- CoverageLogger.h - Basic block coverage output ---------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the sink of the basic block coverage
+/// events reported with -write-BB-cov.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COVERAGELOGGER_H
+#define KLEE_COVERAGELOGGER_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+}
+
+namespace klee {
+class InterpreterHandler;
+
+/// \brief Writer of the live coverage files of -write-BB-cov.
+///
+/// The numeric live coverage records are written through output streams that
+/// are kept open and buffered for the whole run. The textual dump of the
+/// newly-covered blocks, which requires printing LLVM basic blocks, is only
+/// produced by CoverageLogger#finish from the recorded blocks.
+class CoverageLogger {
+  InterpreterHandler *handler;
+
+  /// \brief The coverage level, as given by -write-BB-cov
+  int level;
+
+  llvm::raw_ostream *livePercentCovFile;
+
+  llvm::raw_ostream *bbPlottingFile;
+
+  /// \brief Blocks covered the first time outside speculation, with their
+  /// order numbers, in the order they were covered
+  std::vector<std::pair<llvm::BasicBlock *, int> > liveBlocks;
+
+  llvm::raw_ostream *openFile(const std::string &name);
+
+public:
+  CoverageLogger(InterpreterHandler *_handler, int _level);
+
+  ~CoverageLogger();
+
+  /// \brief Record the coverage percentage upon visiting a new block.
+  void logLivePercentage(unsigned visitedCount, int allCount, float percent);
+
+  /// \brief Record a block covered the first time outside speculation.
+  ///
+  /// \return The number of ICMP instructions in the block.
+  unsigned logLiveBlock(llvm::BasicBlock *bb, int order);
+
+  /// \brief Record the coverage percentage at the given time into the run.
+  void logPlotting(double time, float percent);
+
+  /// \brief Write the dumps of the recorded blocks, and flush all streams.
+  void finish();
+};
+}
+
+#endif
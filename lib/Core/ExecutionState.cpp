@@ -40,30 +40,65 @@ using namespace klee;
 namespace { 
   cl::opt<bool>
   DebugLogStateMerge("debug-log-state-merge");
+
+  typedef CopyOnWrite<std::vector<Cell> > RegisterFile;
+
+  /// The maximum number of register files kept for reuse
+  const unsigned MaxFreeRegisterFiles = 256;
+
+  /// The register files of the returned frames no other frame shares. They
+  /// are reused by the frames of the next calls, so that calls in loops do
+  /// not allocate the shared value and the cells of a register file.
+  std::vector<RegisterFile> freeRegisterFiles;
+
+  RegisterFile acquireRegisterFile(unsigned size) {
+    if (freeRegisterFiles.empty())
+      return RegisterFile(std::vector<Cell>(size));
+    RegisterFile registers(freeRegisterFiles.back());
+    freeRegisterFiles.pop_back();
+    // Not shared once popped, so that the cells are assigned in place
+    registers.mutate().assign(size, Cell());
+    return registers;
+  }
+
+  void releaseRegisterFile(RegisterFile &registers) {
+    if (registers.isShared() ||
+        freeRegisterFiles.size() >= MaxFreeRegisterFiles)
+      return;
+    // The cells are cleared to drop their expressions, keeping the storage
+    registers.mutate().clear();
+    freeRegisterFiles.push_back(registers);
+  }
 }
 
 /***/
 
 StackFrame::StackFrame(KInstIterator _caller, KFunction *_kf)
   : caller(_caller), kf(_kf), callPathNode(0), 
+    locals(acquireRegisterFile(kf->numRegisters)),
     minDistToUncoveredOnReturn(0), varargs(0) {
-  locals = new Cell[kf->numRegisters];
 }
 
-StackFrame::StackFrame(const StackFrame &s) 
-  : caller(s.caller),
-    kf(s.kf),
-    callPathNode(s.callPathNode),
-    allocas(s.allocas),
-    minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
-    varargs(s.varargs) {
-  locals = new Cell[s.kf->numRegisters];
-  for (unsigned i=0; i<s.kf->numRegisters; i++)
-    locals[i] = s.locals[i];
+/***/
+
+SymbolicList::SymbolicList(const SymbolicList &b) : list(b.list) {
+  for (unsigned i = 0; i < list.size(); i++)
+    list[i].first->refCount++;
+}
+
+SymbolicList::~SymbolicList() {
+  for (unsigned i = 0; i < list.size(); i++) {
+    const MemoryObject *mo = list[i].first;
+    assert(mo->refCount > 0);
+    mo->refCount--;
+    if (mo->refCount == 0)
+      delete mo;
+  }
 }
 
-StackFrame::~StackFrame() { 
-  delete[] locals; 
+void SymbolicList::push_back(const value_type &symbolic) {
+  symbolic.first->refCount++;
+  list.push_back(symbolic);
 }
 
 /***/
@@ -71,7 +106,7 @@ StackFrame::~StackFrame() {
 ExecutionState::ExecutionState(KFunction *kf)
     : pc(kf->instructions), prevPC(pc), queryCost(0.), weight(1), depth(0),
       instsSinceCovNew(0), coveredNew(false), forkDisabled(false), ptreeNode(0),
-      txTreeNode(0) {
+      txTreeNode(0), checkpointNode(0) {
   pushFrame(0, kf);
 }
 
@@ -79,22 +114,14 @@ ExecutionState::ExecutionState(KFunction *kf)
 ExecutionState::ExecutionState(const KInstIterator &srcPrevPC,
                                const std::vector<ref<Expr> > &assumptions)
     : prevPC(srcPrevPC), constraints(assumptions), queryCost(0.), ptreeNode(0),
-      txTreeNode(0) {}
+      txTreeNode(0), checkpointNode(0) {}
 #else
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
-    : constraints(assumptions), queryCost(0.), ptreeNode(0), txTreeNode(0) {}
+    : constraints(assumptions), queryCost(0.), ptreeNode(0), txTreeNode(0),
+      checkpointNode(0) {}
 #endif
 
 ExecutionState::~ExecutionState() {
-  for (unsigned int i=0; i<symbolics.size(); i++)
-  {
-    const MemoryObject *mo = symbolics[i].first;
-    assert(mo->refCount > 0);
-    mo->refCount--;
-    if (mo->refCount == 0)
-      delete mo;
-  }
-
   while (!stack.empty())
     popFrame(0, ConstantExpr::alloc(0, Expr::Bool));
 }
@@ -108,10 +135,10 @@ ExecutionState::ExecutionState(const ExecutionState &state)
       instsSinceCovNew(state.instsSinceCovNew), coveredNew(state.coveredNew),
       forkDisabled(state.forkDisabled), coveredLines(state.coveredLines),
       ptreeNode(state.ptreeNode), txTreeNode(state.txTreeNode),
-      symbolics(state.symbolics), arrayNames(state.arrayNames) {
-  for (unsigned int i=0; i<symbolics.size(); i++)
-    symbolics[i].first->refCount++;
-}
+      symbolics(state.symbolics), arrayNames(state.arrayNames),
+      model(state.model), uniqueValues(state.uniqueValues),
+      impliedBytes(state.impliedBytes), forkChoices(state.forkChoices),
+      checkpointNode(state.checkpointNode) {}
 
 void ExecutionState::addTxTreeConstraint(ref<Expr> e,
                                          llvm::Instruction *instr) {
@@ -141,7 +168,7 @@ ExecutionState *ExecutionState::branch() {
 
   ExecutionState *falseState = new ExecutionState(*this);
   falseState->coveredNew = false;
-  falseState->coveredLines.clear();
+  falseState->coveredLines.reset();
 
   weight *= .5;
   falseState->weight -= weight;
@@ -160,6 +187,7 @@ void ExecutionState::popFrame(KInstruction *ki, ref<Expr> returnValue) {
   for (std::vector<const MemoryObject*>::iterator it = sf.allocas.begin(), 
          ie = sf.allocas.end(); it != ie; ++it)
     addressSpace.unbindObject(*it);
+  releaseRegisterFile(sf.locals);
   stack.pop_back();
 
   if (INTERPOLATION_ENABLED && site && ki)
@@ -167,24 +195,25 @@ void ExecutionState::popFrame(KInstruction *ki, ref<Expr> returnValue) {
 }
 
 void ExecutionState::addSymbolic(const MemoryObject *mo, const Array *array) { 
-  mo->refCount++;
-  symbolics.push_back(std::make_pair(mo, array));
+  symbolics.mutate().push_back(std::make_pair(mo, array));
 }
 ///
 
 std::string ExecutionState::getFnAlias(std::string fn) {
-  std::map < std::string, std::string >::iterator it = fnAliases.find(fn);
-  if (it != fnAliases.end())
+  std::map < std::string, std::string >::const_iterator it =
+      fnAliases->find(fn);
+  if (it != fnAliases->end())
     return it->second;
   else return "";
 }
 
 void ExecutionState::addFnAlias(std::string old_fn, std::string new_fn) {
-  fnAliases[old_fn] = new_fn;
+  fnAliases.mutate()[old_fn] = new_fn;
 }
 
 void ExecutionState::removeFnAlias(std::string fn) {
-  fnAliases.erase(fn);
+  if (fnAliases->count(fn))
+    fnAliases.mutate().erase(fn);
 }
 
 /**/
@@ -326,13 +355,13 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
+      const ref<Expr> &av = af.getLocal(i).value;
+      const ref<Expr> &bv = bf.getLocal(i).value;
       if (av.isNull() || bv.isNull()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
       } else {
-        av = SelectExpr::create(inA, av, bv);
+        af.getWriteableLocal(i).value = SelectExpr::create(inA, av, bv);
       }
     }
   }
@@ -355,6 +384,7 @@ bool ExecutionState::merge(const ExecutionState &b) {
   }
 
   constraints = ConstraintManager();
+  uniqueValues.reset();
   for (std::set< ref<Expr> >::iterator it = commonConstraints.begin(), 
          ie = commonConstraints.end(); it != ie; ++it)
     constraints.addConstraint(*it);
@@ -385,7 +415,7 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 
       out << ai->getName().str();
       // XXX should go through function
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value;
+      ref<Expr> value = sf.getLocal(sf.kf->getArgRegister(index++)).value;
       if (value.get() && isa<ConstantExpr>(value))
         out << "=" << value;
     }
@@ -8,13 +8,20 @@
 //===----------------------------------------------------------------------===//
 
 #include "Executor.h"
+#include "Checkpoint.h"
 #include "Context.h"
 #include "CoreStats.h"
+#include "CoverageLogger.h"
 #include "ExternalDispatcher.h"
+#include "FunctionSummaries.h"
+#include "NativeCalls.h"
 #include "ImpliedValue.h"
 #include "Memory.h"
 #include "MemoryManager.h"
 #include "PTree.h"
+#include "PriorProfile.h"
+#include "ProgressEstimator.h"
+#include "SamplingProfiler.h"
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
@@ -48,6 +55,7 @@
 #include "klee/Internal/System/MemoryUsage.h"
 #include "klee/SolverStats.h"
 #include "TxShadowArray.h"
+#include "TxTableFile.h"
 #include "TxTree.h"
 #include "TxSpeculation.h"
 
@@ -125,6 +133,68 @@ cl::opt<bool> RandomizeFork(
     cl::desc(
         "Randomly swap the true and false states on a fork (default=off)"));
 
+cl::opt<bool> BulkMemoryFunctions(
+    "bulk-memory-functions", cl::init(false),
+    cl::desc("Perform the calls of memcpy, mempcpy, memmove and memset with "
+             "concrete arguments as bulk operations on the memory objects "
+             "rather than executing their bodies.  With interpolation, only "
+             "the calls writing to objects of no recorded stores are "
+             "performed so, as a single store of the region (default=off)"));
+
+cl::opt<bool> BulkFileReads(
+    "bulk-file-reads", cl::init(true),
+    cl::desc("Perform the copies of the contents of the symbolic files by "
+             "read and write of the POSIX runtime as bulk operations on the "
+             "memory objects, as with -bulk-memory-functions, rather than "
+             "copying a byte per instruction (default=on)"));
+
+cl::opt<bool> FunctionSummaryCalls(
+    "function-summaries", cl::init(false),
+    cl::desc("Give the calls of pure functions with concrete arguments the "
+             "return value of an earlier call with the same arguments rather "
+             "than executing their bodies.  A function is pure when it only "
+             "takes and returns integers, and only accesses its own stack "
+             "allocations and constant globals.  (default=off)"));
+
+cl::opt<bool> NativeConcreteCalls(
+    "native-concrete-calls", cl::init(false),
+    cl::desc("Compile the functions that only access their own stack "
+             "allocations, globals and the objects of their pointer "
+             "arguments, and run their calls natively when the arguments and "
+             "the objects they access are concrete, as for external calls.  "
+             "The memory errors of such calls are not reported, and their "
+             "writes are not tracked by the interpolation.  (default=off)"));
+
+cl::opt<bool> RangeBranchCheck(
+    "range-branch-check", cl::init(false),
+    cl::desc("Decide the branches comparing a term with a constant from the "
+             "unsigned range of the term known from the comparisons of the "
+             "path condition with constants, before calling the solver "
+             "(default=off)"));
+
+cl::opt<bool> SwitchModelEnumeration(
+    "switch-model-enumeration", cl::init(false),
+    cl::desc("Find the feasible successors of a switch on a symbolic value "
+             "from models of the value among the successors not found "
+             "feasible yet, with one query per feasible successor and a "
+             "last one for the infeasible successors, instead of one query "
+             "per case (default=off)"));
+
+cl::opt<bool> ReuseStateModel(
+    "reuse-state-model", cl::init(false),
+    cl::desc("Keep with each state the last model of its path condition "
+             "found by the counterexample cache at a fork, and generate the "
+             "test case of the state from it when it still satisfies the "
+             "path condition and the counterexample preferences, without "
+             "calling the solver (default=off)"));
+
+cl::opt<bool> CacheUniqueValues(
+    "cache-unique-values", cl::init(false),
+    cl::desc("Keep with each state the expressions it concretized that have "
+             "a single value under its path condition, so that concretizing "
+             "them again along the path does not call the solver "
+             "(default=off)"));
+
 cl::opt<bool> AllowExternalSymCalls(
     "allow-external-sym-calls", cl::init(false),
     cl::desc("Allow calls with symbolic arguments to external functions.  This "
@@ -170,6 +240,13 @@ cl::opt<bool> DebugCompressInstructions(
 
 cl::opt<bool> DebugCheckForImpliedValues("debug-check-for-implied-values");
 
+cl::opt<bool> ImpliedValueConcretization(
+    "implied-value-concretization", cl::init(false),
+    cl::desc("Write into the symbolic objects the byte values implied by "
+             "the equalities added to the path condition, so that later "
+             "reads of the bytes are constants. Ignored with interpolation "
+             "(default=off)"));
+
 cl::opt<bool>
 SimplifySymIndices("simplify-sym-indices", cl::init(false),
                    cl::desc("Simplify symbolic accesses using equalities "
@@ -182,6 +259,34 @@ EqualitySubstitution("equality-substitution", cl::init(true),
 
 cl::opt<unsigned> MaxSymArraySize("max-sym-array-size", cl::init(0));
 
+cl::opt<unsigned> SymbolicSizeCapacity(
+    "symbolic-size-capacity", cl::init(0),
+    cl::desc("Allocate the objects of a symbolic size of at most this many "
+             "bytes with this capacity, bounded by their symbolic size, "
+             "rather than concretizing the size.  The larger sizes are still "
+             "concretized.  Not used with interpolation, whose bound "
+             "interpolation needs concrete sizes (default=0 (off))"));
+
+cl::opt<bool> BlockDispatch(
+    "block-dispatch", cl::init(false),
+    cl::desc("Execute the instructions of a basic block up to a call in a "
+             "single step, with the timers, the memory checks and the "
+             "searcher run once per step. -max-instruction-time then bounds "
+             "the time of a step (default=off)"));
+
+cl::opt<bool> FuseInstructions(
+    "fuse-instructions", cl::init(true),
+    cl::desc("Execute a concrete icmp together with the branch on it, and a "
+             "getelementptr together with the load of it, without "
+             "interpolation (default=on)"));
+
+cl::opt<bool> BatchResolution(
+    "batch-resolution", cl::init(false),
+    cl::desc("Fork the states of a pointer resolving to several objects at "
+             "once, deciding the objects against the constraints of the "
+             "pointer rather than of a chain of out-of-bound states "
+             "(default=off)"));
+
 cl::opt<bool> SuppressExternalWarnings(
     "suppress-external-warnings", cl::init(false),
     cl::desc("Supress warnings about calling external functions."));
@@ -292,6 +397,50 @@ MaxDepth("max-depth",
          cl::desc("Only allow this many symbolic branches (default=0 (off))"),
          cl::init(0));
 
+cl::opt<bool>
+ReplayPathPrefix("replay-path-prefix",
+                 cl::desc("Follow the path given by --replay-path as a prefix "
+                          "only, and explore all the paths extending it"),
+                 cl::init(false));
+
+cl::opt<unsigned>
+PartitionCount("partition-count",
+               cl::desc("Split the exploration among this many processes, "
+                        "which must be a power of two (default=1 (off))"),
+               cl::init(1));
+
+cl::opt<unsigned>
+PartitionIndex("partition-index",
+               cl::desc("The part of the exploration done by this process, "
+                        "below -partition-count (default=0)"),
+               cl::init(0));
+
+cl::opt<std::string>
+CheckpointDir("checkpoint-dir",
+              cl::desc("Periodically write the paths of the live states, and "
+                       "the subsumption table, to this existing directory, "
+                       "for -restore-checkpoint (default=off)"),
+              cl::init(""));
+
+cl::opt<double>
+CheckpointInterval("checkpoint-interval",
+                   cl::desc("Seconds between the checkpoints of "
+                            "-checkpoint-dir (default=600)"),
+                   cl::init(600));
+
+cl::opt<std::string>
+RestoreCheckpoint("restore-checkpoint",
+                  cl::desc("Only explore the paths extending the states of "
+                           "the checkpoint in this directory (default=off)"),
+                  cl::init(""));
+
+cl::opt<std::string>
+PriorIStats("prior-istats",
+            cl::desc("Load the run.istats of an earlier run on the same "
+                     "module, for -search=nurs:prior and to add the blocks "
+                     "that forked to the subsumption points (default=off)"),
+            cl::init(""));
+
 cl::opt<unsigned> MaxMemory("max-memory",
                             cl::desc("Refuse to fork when above this amount of "
                                      "memory (in MB, default=2000)"),
@@ -302,6 +451,23 @@ cl::opt<bool> MaxMemoryInhibit(
     cl::desc(
         "Inhibit forking at memory cap (vs. random terminate) (default=on)"),
     cl::init(true));
+
+cl::opt<bool> MaxMemoryPark(
+    "max-memory-park",
+    cl::desc("Park states out of the searcher instead of terminating them "
+             "when over the memory cap, and resume them once below it "
+             "(default=off)"),
+    cl::init(false));
+
+class CheckpointTimer : public Executor::Timer {
+  Executor *executor;
+
+public:
+  CheckpointTimer(Executor *_executor) : executor(_executor) {}
+  ~CheckpointTimer() {}
+
+  void run() { executor->writeCheckpoint(); }
+};
 } // namespace
 
 namespace klee {
@@ -318,17 +484,23 @@ const char *Executor::TerminateReasonNames[] =
 
 Executor::Executor(const InterpreterOptions &opts, InterpreterHandler *ih)
     : Interpreter(opts), kmodule(0), interpreterHandler(ih), searcher(0),
+      searcherUpdatesCurrent(true),
       externalDispatcher(new ExternalDispatcher()), statsTracker(0),
       pathWriter(0), symPathWriter(0), specialFunctionHandler(0),
       processTree(0), txTree(0), replayKTest(0), replayPath(0), usingSeeds(0),
-      atMemoryLimit(false), inhibitForking(false), haltExecution(false),
-      ivcEnabled(false),
+      atMemoryLimit(false), lastMallocUsage(0), lastCountedUsage(0),
+      checksSinceMallocUsage(0), inhibitForking(false), haltExecution(false),
+      ivcEnabled(ImpliedValueConcretization),
       coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
                             ? std::min(MaxCoreSolverTime, MaxInstructionTime)
                             : std::max(MaxCoreSolverTime, MaxInstructionTime)),
-      debugInstFile(0), debugLogBuffer(debugBufferString) {
+      debugInstFile(0), coverageLogger(0),
+      functionSummaries(FunctionSummaryCalls ? new FunctionSummaries() : 0),
+      nativeCalls(NativeConcreteCalls ? new NativeCalls() : 0),
+      restoredCheckpoint(0), debugLogBuffer(debugBufferString) {
 
   // Basic Block Coverage Counters
+  visitedBlockCount = 0;
   if (BBCoverage >= 1) {
     allBlockCount = 0;
     allBlockCollected = false;
@@ -336,6 +508,19 @@ Executor::Executor(const InterpreterOptions &opts, InterpreterHandler *ih)
     allICMPCount = 0;
     coveredICMPCount = 0;
   }
+  if (BBCoverage >= 2)
+    coverageLogger = new CoverageLogger(interpreterHandler, BBCoverage);
+
+  // The size of the subsumption table is part of the memory accounting
+  if (MaxMemory)
+    TxSubsumptionTable::trackSize = true;
+
+  // The writes of the implied values are not seen by the dependency
+  // analysis, so the interpolants would miss them
+  if (ivcEnabled && INTERPOLATION_ENABLED) {
+    klee_warning("-implied-value-concretization is ignored with interpolation");
+    ivcEnabled = false;
+  }
 
   if (coreSolverTimeout)
     UseForkedCoreSolver = true;
@@ -350,6 +535,19 @@ Executor::Executor(const InterpreterOptions &opts, InterpreterHandler *ih)
       interpreterHandler->getOutputFilename(ALL_QUERIES_PC_FILE_NAME),
       interpreterHandler->getOutputFilename(SOLVER_QUERIES_PC_FILE_NAME));
 
+#ifdef ENABLE_Z3
+  // The subsumption checks need the existential quantification of Z3
+  if (INTERPOLATION_ENABLED &&
+      (SeparateSubsumptionSolver || CoreSolverToUse != Z3_SOLVER)) {
+    Solver *subsumptionCoreSolver = klee::createCoreSolver(Z3_SOLVER);
+    if (!subsumptionCoreSolver) {
+      klee_error("Failed to create subsumption core solver\n");
+    }
+    solver = createClassifyingSolver(
+        solver, constructSubsumptionSolverChain(subsumptionCoreSolver));
+  }
+#endif
+
   this->solver = new TimingSolver(solver, EqualitySubstitution);
   memory = new MemoryManager(&arrayCache);
 
@@ -410,7 +608,9 @@ const Module *Executor::setModule(llvm::Module *module,
         userSearcherRequiresMD2U());
   }
 
-  return module;
+  // The prepared module replaces the given one when it is loaded from
+  // -prepared-module-cache.
+  return kmodule->module;
 }
 
 Executor::~Executor() {
@@ -431,6 +631,13 @@ Executor::~Executor() {
   if (debugInstFile) {
     delete debugInstFile;
   }
+  if (coverageLogger)
+    delete coverageLogger;
+  if (functionSummaries)
+    delete functionSummaries;
+  if (nativeCalls)
+    delete nativeCalls;
+  delete restoredCheckpoint;
 }
 
 /***/
@@ -449,9 +656,8 @@ void Executor::initializeGlobalObject(ExecutionState &state, ObjectState *os,
       initializeGlobalObject(state, os, cp->getOperand(i),
                              offset + i * elementSize);
   } else if (isa<ConstantAggregateZero>(c)) {
-    unsigned i, size = targetData->getTypeStoreSize(c->getType());
-    for (i = 0; i < size; i++)
-      os->write8(offset + i, (uint8_t)0);
+    unsigned size = targetData->getTypeStoreSize(c->getType());
+    os->fill(offset, 0, size);
   } else if (const ConstantArray *ca = dyn_cast<ConstantArray>(c)) {
     unsigned elementSize =
         targetData->getTypeStoreSize(ca->getType()->getElementType());
@@ -490,8 +696,7 @@ MemoryObject *Executor::addExternalObject(ExecutionState &state, void *addr,
   MemoryObject *mo =
       memory->allocateFixed((uint64_t)(unsigned long)addr, size, 0);
   ObjectState *os = bindObjectInState(state, mo, false);
-  for (unsigned i = 0; i < size; i++)
-    os->write8(i, ((uint8_t *)addr)[i]);
+  os->writeConcrete(0, (uint8_t *)addr, size);
   if (isReadOnly)
     os->setReadOnly(true);
   return mo;
@@ -616,8 +821,7 @@ void Executor::initializeGlobals(ExecutionState &state) {
           klee_error("unable to load symbol(%s) while initializing globals.",
                      i->getName().data());
 
-        for (unsigned offset = 0; offset < mo->size; offset++)
-          os->write8(offset, ((unsigned char *)addr)[offset]);
+        os->writeConcrete(0, (uint8_t *)addr, mo->size);
       }
     } else {
       LLVM_TYPE_Q Type *ty = i->getType()->getElementType();
@@ -683,11 +887,13 @@ void Executor::branch(ExecutionState &state,
       ExecutionState *ns = es->branch();
       addedStates.push_back(ns);
       result.push_back(ns);
-      es->ptreeNode->data = 0;
-      std::pair<PTree::Node *, PTree::Node *> res =
-          processTree->split(es->ptreeNode, ns, es);
-      ns->ptreeNode = res.first;
-      es->ptreeNode = res.second;
+      if (processTree) {
+        es->ptreeNode->data = 0;
+        std::pair<PTree::Node *, PTree::Node *> res =
+            processTree->split(es->ptreeNode, ns, es);
+        ns->ptreeNode = res.first;
+        es->ptreeNode = res.second;
+      }
 
       if (INTERPOLATION_ENABLED) {
         if (DebugTracerX)
@@ -709,25 +915,26 @@ void Executor::branch(ExecutionState &state,
   std::map<ExecutionState *, std::vector<SeedInfo> >::iterator it =
       seedMap.find(&state);
   if (it != seedMap.end()) {
-    std::vector<SeedInfo> seeds = it->second;
+    std::vector<SeedInfo> seeds;
+    seeds.swap(it->second);
     seedMap.erase(it);
 
+    std::vector<std::vector<ref<ConstantExpr> > > values(N);
+    for (unsigned i = 0; i < N; ++i) {
+      bool success = SeedInfo::evaluate(state, solver, conditions[i], seeds,
+                                        values[i]);
+      assert(success && "FIXME: Unhandled solver failure");
+      (void)success;
+    }
+
     // Assume each seed only satisfies one condition (necessarily true
     // when conditions are mutually exclusive and their conjunction is
     // a tautology).
-    for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
-                                         siie = seeds.end();
-         siit != siie; ++siit) {
+    for (unsigned s = 0; s < seeds.size(); ++s) {
       unsigned i;
-      for (i = 0; i < N; ++i) {
-        ref<ConstantExpr> res;
-        bool success = solver->getValue(
-            state, siit->assignment.evaluate(conditions[i]), res);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void)success;
-        if (res->isTrue())
+      for (i = 0; i < N; ++i)
+        if (values[i][s]->isTrue())
           break;
-      }
 
       // If we didn't find a satisfying condition randomly pick one
       // (the seed will be patched).
@@ -735,8 +942,11 @@ void Executor::branch(ExecutionState &state,
         i = theRNG.getInt32() % N;
 
       // Extra check in case we're replaying seeds with a max-fork
-      if (result[i])
-        seedMap[result[i]].push_back(*siit);
+      if (result[i]) {
+        std::vector<SeedInfo> &v = seedMap[result[i]];
+        v.push_back(SeedInfo(0));
+        v.back().swap(seeds[s]);
+      }
     }
 
     if (OnlyReplaySeeds) {
@@ -752,10 +962,112 @@ void Executor::branch(ExecutionState &state,
   for (unsigned i = 0; i < N; ++i)
     if (result[i])
       addConstraint(*result[i], conditions[i]);
+
+  if (N > 1) {
+    for (unsigned i = 0; i < N; ++i)
+      if (result[i] && !followForkChoice(*result[i], i))
+        result[i] = NULL;
+  }
+}
+
+void Executor::getFeasibleSwitchTargets(
+    ExecutionState &state, ref<Expr> value, BasicBlock *defaultDest,
+    const std::map<ref<Expr>, BasicBlock *> &caseTargets,
+    std::vector<BasicBlock *> &targets,
+    std::map<BasicBlock *, ref<Expr> > &targetConditions) {
+  // The successors with the conditions of all their cases, the default
+  // destination possibly being the successor of some cases
+  std::vector<BasicBlock *> candidates;
+  std::map<BasicBlock *, ref<Expr> > conditions;
+  ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
+  for (std::map<ref<Expr>, BasicBlock *>::const_iterator
+           it = caseTargets.begin(),
+           ie = caseTargets.end();
+       it != ie; ++it) {
+    ref<Expr> match = EqExpr::create(value, it->first);
+    defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
+    std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> res =
+        conditions.insert(
+            std::make_pair(it->second, ConstantExpr::alloc(0, Expr::Bool)));
+    res.first->second = OrExpr::create(match, res.first->second);
+    if (res.second)
+      candidates.push_back(it->second);
+  }
+  std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> res =
+      conditions.insert(
+          std::make_pair(defaultDest, ConstantExpr::alloc(0, Expr::Bool)));
+  res.first->second = OrExpr::create(defaultValue, res.first->second);
+  if (res.second)
+    candidates.push_back(defaultDest);
+
+  std::vector<const Array *> objects;
+  findSymbolicObjects(value, objects);
+
+  std::set<BasicBlock *> feasible;
+  while (feasible.size() < candidates.size()) {
+    ref<Expr> remaining = ConstantExpr::alloc(0, Expr::Bool);
+    for (std::vector<BasicBlock *>::iterator it = candidates.begin(),
+                                             ie = candidates.end();
+         it != ie; ++it) {
+      if (!feasible.count(*it))
+        remaining = OrExpr::create(conditions[*it], remaining);
+    }
+
+    std::vector<std::vector<unsigned char> > values;
+    std::vector<ref<Expr> > unsatCore;
+    bool hasSolution;
+    bool success = solver->getModel(state, remaining, objects, values,
+                                    hasSolution, unsatCore);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void)success;
+    if (!hasSolution) {
+      // None of the remaining successors can be taken: Mark the
+      // unsatisfiability core
+      if (INTERPOLATION_ENABLED)
+        state.txTreeNode->unsatCoreInterpolation(unsatCore);
+      break;
+    }
+
+    Assignment model(objects, values);
+    ref<Expr> concrete = model.evaluate(value);
+    std::map<ref<Expr>, BasicBlock *>::const_iterator it =
+        caseTargets.find(concrete);
+    if (feasible.insert(it != caseTargets.end() ? it->second : defaultDest)
+            .second)
+      continue;
+
+    // The model is not of a remaining successor, which are then checked one
+    // by one
+    for (std::vector<BasicBlock *>::iterator bi = candidates.begin(),
+                                             be = candidates.end();
+         bi != be; ++bi) {
+      if (feasible.count(*bi))
+        continue;
+      bool result;
+      std::vector<ref<Expr> > core;
+      success = solver->mayBeTrue(state, conditions[*bi], result, core);
+      assert(success && "FIXME: Unhandled solver failure");
+      if (result)
+        feasible.insert(*bi);
+      else if (INTERPOLATION_ENABLED)
+        state.txTreeNode->unsatCoreInterpolation(core);
+    }
+    break;
+  }
+
+  for (std::vector<BasicBlock *>::iterator it = candidates.begin(),
+                                           ie = candidates.end();
+       it != ie; ++it) {
+    if (!feasible.count(*it))
+      continue;
+    targets.push_back(*it);
+    targetConditions[*it] = conditions[*it];
+  }
 }
 
 Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
                                    bool isInternal) {
+  SolverPhaseScope solverPhase(BranchPhase);
   Solver::Validity res;
   std::map<ExecutionState *, std::vector<SeedInfo> >::iterator it =
       seedMap.find(&current);
@@ -795,10 +1107,18 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
   // llvm::errs() << "Calling solver->evaluate on query:\n";
   // ExprPPrinter::printQuery(llvm::errs(), current.constraints, condition);
 
-  solver->setTimeout(timeout);
   std::vector<ref<Expr> > unsatCore;
-  bool success = solver->evaluate(current, condition, res, unsatCore);
-  solver->setTimeout(0);
+  bool success, rangeValue;
+  if (RangeBranchCheck && !isSeeding &&
+      current.constraints.evaluateRange(condition, rangeValue, unsatCore)) {
+    res = rangeValue ? Solver::True : Solver::False;
+    success = true;
+    ++stats::rangeDecidedBranches;
+  } else {
+    solver->setTimeout(timeout);
+    success = solver->evaluate(current, condition, res, unsatCore);
+    solver->setTimeout(0);
+  }
 
   if (!success) {
     current.pc = current.prevPC;
@@ -807,7 +1127,7 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
   }
 
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
+    if (followsReplayPath() && !isInternal) {
       assert(replayPosition < replayPath->size() &&
              "ran out of branches in replay path mode");
       bool branch = (*replayPath)[replayPosition++];
@@ -817,6 +1137,11 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
       } else if (res == Solver::False) {
         assert(!branch && "hit invalid branch in replay path mode");
       } else {
+        // The other side is explored elsewhere, hence the interpolant of
+        // the node would be incomplete.
+        if (ReplayPathPrefix && INTERPOLATION_ENABLED)
+          current.txTreeNode->setGenericEarlyTermination();
+
         // add constraints
         if (branch) {
           res = Solver::True;
@@ -859,21 +1184,17 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
       res == Solver::Unknown) {
     bool trueSeed = false, falseSeed = false;
     // Is seed extension still ok here?
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
-                                         siie = it->second.end();
-         siit != siie; ++siit) {
-      ref<ConstantExpr> res;
-      bool success =
-          solver->getValue(current, siit->assignment.evaluate(condition), res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      if (res->isTrue()) {
+    std::vector<ref<ConstantExpr> > values;
+    bool success =
+        SeedInfo::evaluate(current, solver, condition, it->second, values);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void)success;
+    for (unsigned i = 0; i < values.size() && !(trueSeed && falseSeed); ++i) {
+      if (values[i]->isTrue()) {
         trueSeed = true;
       } else {
         falseSeed = true;
       }
-      if (trueSeed && falseSeed)
-        break;
     }
     if (!(trueSeed && falseSeed)) {
       assert(trueSeed || falseSeed);
@@ -939,23 +1260,22 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
       std::swap(trueState, falseState);
 
     if (it != seedMap.end()) {
-      std::vector<SeedInfo> seeds = it->second;
-      it->second.clear();
+      std::vector<SeedInfo> seeds;
+      seeds.swap(it->second);
+      std::vector<ref<ConstantExpr> > values;
+      bool success =
+          SeedInfo::evaluate(current, solver, condition, seeds, values);
+      assert(success && "FIXME: Unhandled solver failure");
+      (void)success;
+      // Move the seeds to the states whose condition they satisfy, without
+      // copying them.
       std::vector<SeedInfo> &trueSeeds = seedMap[trueState];
       std::vector<SeedInfo> &falseSeeds = seedMap[falseState];
-      for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
-                                           siie = seeds.end();
-           siit != siie; ++siit) {
-        ref<ConstantExpr> res;
-        bool success = solver->getValue(
-            current, siit->assignment.evaluate(condition), res);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void)success;
-        if (res->isTrue()) {
-          trueSeeds.push_back(*siit);
-        } else {
-          falseSeeds.push_back(*siit);
-        }
+      for (unsigned i = 0; i < seeds.size(); ++i) {
+        std::vector<SeedInfo> &v =
+            values[i]->isTrue() ? trueSeeds : falseSeeds;
+        v.push_back(SeedInfo(0));
+        v.back().swap(seeds[i]);
       }
 
       bool swapInfo = false;
@@ -975,11 +1295,13 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
       }
     }
 
-    current.ptreeNode->data = 0;
-    std::pair<PTree::Node *, PTree::Node *> res =
-        processTree->split(current.ptreeNode, falseState, trueState);
-    falseState->ptreeNode = res.first;
-    trueState->ptreeNode = res.second;
+    if (processTree) {
+      current.ptreeNode->data = 0;
+      std::pair<PTree::Node *, PTree::Node *> res =
+          processTree->split(current.ptreeNode, falseState, trueState);
+      falseState->ptreeNode = res.first;
+      trueState->ptreeNode = res.second;
+    }
 
     if (!isInternal) {
       if (pathWriter) {
@@ -1007,6 +1329,15 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
     addConstraint(*trueState, condition);
     addConstraint(*falseState, Expr::createIsZero(condition));
 
+    if (ReuseStateModel) {
+      keepStateModel(*trueState, condition);
+      keepStateModel(*falseState, Expr::createIsZero(condition));
+    }
+
+    if (!followForkChoices(trueState, falseState) ||
+        partitionFork(trueState, falseState))
+      return StatePair(trueState, falseState);
+
     // Kinda gross, do we even really still want this option?
     if (MaxDepth && MaxDepth <= trueState->depth) {
       terminateStateEarly(*trueState, "max-depth exceeded.");
@@ -1018,44 +1349,88 @@ Executor::StatePair Executor::fork(ExecutionState &current, ref<Expr> condition,
   }
 }
 
-std::set<std::string> Executor::extractVarNames(ExecutionState &current,
-                                                llvm::Value *v) {
-  std::set<std::string> res;
-  if (isa<GlobalVariable>(v)) {
-    GlobalVariable *gv = cast<GlobalVariable>(v);
-    res.insert(gv->getName().data());
-  } else if (isa<Instruction>(v)) {
-    Instruction *ins = dyn_cast<Instruction>(v);
-    switch (ins->getOpcode()) {
-    case Instruction::Alloca: {
-      AllocaInst *ai = cast<AllocaInst>(ins);
-      if (ai->getName() == "") {
-        llvm::Function *f = ai->getParent()->getParent();
-        if (ai == &f->getEntryBlock().front()) {
-          res.insert(f->arg_begin()->getName().data());
-        } else if (ai == f->getEntryBlock().front().getNextNode()) {
-          res.insert(f->arg_begin()->getNextNode()->getName().data());
-        }
-      } else {
-        res.insert(ai->getName().data());
-      }
-      break;
-    }
-    default: {
-      for (unsigned i = 0u; i < ins->getNumOperands(); i++) {
-        std::set<std::string> tmp =
-            extractVarNames(current, ins->getOperand(i));
-        res.insert(tmp.begin(), tmp.end());
-      }
-    }
-    }
+void Executor::keepStateModel(ExecutionState &state, ref<Expr> condition) {
+  Assignment *model = getLastCexCacheModel();
+  if (!model)
+    return;
+  ref<Expr> value = model->evaluate(condition);
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value))
+    if (CE->isTrue())
+      state.model = CopyOnWrite<Assignment>(*model);
+}
+
+bool Executor::followForkChoice(ExecutionState &state, unsigned choice) {
+  if (!CheckpointDir.empty())
+    state.forkChoices = new ForkChoice(state.forkChoices, choice);
+  if (!state.checkpointNode)
+    return true;
+
+  // Past the end of its recorded path, the state is explored as usual
+  state.checkpointNode = state.checkpointNode->getChild(choice);
+  if (state.checkpointNode) {
+    if (state.checkpointNode->isEnd())
+      state.checkpointNode = 0;
+    return true;
   }
-  return res;
+
+  // The side has no test case, and as in partitionFork the interpolants of
+  // its ancestors must not be tabled.
+  if (INTERPOLATION_ENABLED)
+    state.txTreeNode->setGenericEarlyTermination();
+  terminateState(state);
+  return false;
+}
+
+bool Executor::followForkChoices(ExecutionState *&trueState,
+                                 ExecutionState *&falseState) {
+  if (CheckpointDir.empty() && !restoredCheckpoint)
+    return true;
+  if (!followForkChoice(*trueState, 1))
+    trueState = 0;
+  if (!followForkChoice(*falseState, 0))
+    falseState = 0;
+  return trueState && falseState;
+}
+
+bool Executor::followsReplayPath() const {
+  return replayPath &&
+         (!ReplayPathPrefix || replayPosition < replayPath->size());
+}
+
+bool Executor::partitionFork(ExecutionState *&trueState,
+                             ExecutionState *&falseState) {
+  // The first symbolic forks of a path each follow one bit of the partition
+  // index, so that the processes explore disjoint subtrees. The partition
+  // count is a power of two, so the forks of bit indices from its logarithm
+  // on are not partitioned.
+  unsigned bit = trueState->depth - 1;
+  if (PartitionCount <= 1 || trueState->depth == 0 || bit >= 32 ||
+      (PartitionCount >> bit) <= 1)
+    return false;
+
+  bool keepTrue = (PartitionIndex >> bit) & 1;
+  ExecutionState *&dropped = keepTrue ? falseState : trueState;
+
+  // The dropped side has no test case, and as its ancestors are now
+  // incompletely explored, their interpolants must not be tabled.
+  if (INTERPOLATION_ENABLED)
+    dropped->txTreeNode->setGenericEarlyTermination();
+  terminateState(*dropped);
+  dropped = 0;
+  return true;
+}
+
+const TxSpeculationAvoidance::Bitset &
+Executor::extractVariables(ExecutionState &current, llvm::Value *v) {
+  return specAvoidance.getBranchVariables(v, varNamesCache);
 }
 
 Executor::StatePair Executor::branchFork(ExecutionState &current,
                                          ref<Expr> condition, bool isInternal) {
-  start = clock();
+  SolverPhaseScope solverPhase(BranchPhase);
+  // The time is only accounted in speculation mode
+  if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC)
+    start = clock();
   // The current node is in the speculation node
   if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC &&
       txTree->isSpeculationNode()) {
@@ -1118,7 +1493,7 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
   }
 
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
+    if (followsReplayPath() && !isInternal) {
       assert(replayPosition < replayPath->size() &&
              "ran out of branches in replay path mode");
       bool branch = (*replayPath)[replayPosition++];
@@ -1128,6 +1503,11 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
       } else if (res == Solver::False) {
         assert(!branch && "hit invalid branch in replay path mode");
       } else {
+        // The other side is explored elsewhere, hence the interpolant of
+        // the node would be incomplete.
+        if (ReplayPathPrefix && INTERPOLATION_ENABLED)
+          current.txTreeNode->setGenericEarlyTermination();
+
         // add constraints
         if (branch) {
           res = Solver::True;
@@ -1170,21 +1550,17 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
       res == Solver::Unknown) {
     bool trueSeed = false, falseSeed = false;
     // Is seed extension still ok here?
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
-                                         siie = it->second.end();
-         siit != siie; ++siit) {
-      ref<ConstantExpr> res;
-      bool success =
-          solver->getValue(current, siit->assignment.evaluate(condition), res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      if (res->isTrue()) {
+    std::vector<ref<ConstantExpr> > values;
+    bool success =
+        SeedInfo::evaluate(current, solver, condition, it->second, values);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void)success;
+    for (unsigned i = 0; i < values.size() && !(trueSeed && falseSeed); ++i) {
+      if (values[i]->isTrue()) {
         trueSeed = true;
       } else {
         falseSeed = true;
       }
-      if (trueSeed && falseSeed)
-        break;
     }
     if (!(trueSeed && falseSeed)) {
       assert(trueSeed || falseSeed);
@@ -1202,24 +1578,24 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         TxSpeculationHelper::isStateSpeculable(current)) {
       llvm::BranchInst *binst =
           llvm::dyn_cast<llvm::BranchInst>(current.prevPC->inst);
-      llvm::BasicBlock *curBB = current.txTreeNode->getBasicBlock();
+      unsigned curBB = current.txTreeNode->getBasicBlockId();
 
       if (SpecTypeToUse == SAFETY) {
         if (SpecStrategyToUse == TIMID) {
           klee_error("SPECULATION: timid is not supported with safety!");
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // open speculation & result may be success or fail
-          StatsTracker::increaseEle(curBB, 0, true);
+          StatsTracker::increaseEle(curBB, 0);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    true);
+                                    true, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // open speculation & result may be success or fail and Now second
           // check
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             dynamicYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      true);
+                                      true, unsatCore);
           } else {
             dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1229,50 +1605,53 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         }
       } else {
         if (SpecStrategyToUse == TIMID) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
           } else {
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 1, true);
+            StatsTracker::increaseEle(curBB, 1);
           }
           return StatePair(&current, 0);
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // check independency
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
             return StatePair(&current, 0);
           } else {
             // open speculation & result may be success or fail
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      true);
+                                      true, unsatCore);
           }
         } else if (SpecStrategyToUse == CUSTOM) {
           // check independency
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            //          StatsTracker::increaseEle(curBB, 0, true);
-            //          StatsTracker::increaseEle(curBB, 2, false);
+            //          StatsTracker::increaseEle(curBB, 0);
+            //          StatsTracker::increaseEle(curBB, 2);
             return StatePair(&current, 0);
           } else {
             // open speculation & result may be success or fail and Now second
             // check
             independenceNo++;
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               dynamicYes++;
-              StatsTracker::increaseEle(curBB, 0, true);
+              StatsTracker::increaseEle(curBB, 0);
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        true);
+                                        true, unsatCore);
             } else {
               dynamicNo++;
               // then close speculation & do marking as deletion
@@ -1290,24 +1669,24 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         TxSpeculationHelper::isStateSpeculable(current)) {
       llvm::BranchInst *binst =
           llvm::dyn_cast<llvm::BranchInst>(current.prevPC->inst);
-      llvm::BasicBlock *curBB = current.txTreeNode->getBasicBlock();
+      unsigned curBB = current.txTreeNode->getBasicBlockId();
 
       if (SpecTypeToUse == SAFETY) {
         if (SpecStrategyToUse == TIMID) {
           klee_error("SPECULATION: timid is not supported with safety!");
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // open speculation & result may be success or fail
-          StatsTracker::increaseEle(curBB, 0, true);
+          StatsTracker::increaseEle(curBB, 0);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    false);
+                                    false, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // open speculation & result may be success or fail and Now second
           // check
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             dynamicYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      false);
+                                      false, unsatCore);
           } else {
             dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1317,48 +1696,51 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         }
       } else {
         if (SpecStrategyToUse == TIMID) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
           } else {
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 1, true);
+            StatsTracker::increaseEle(curBB, 1);
           }
           return StatePair(0, &current);
         } else if (SpecStrategyToUse == AGGRESSIVE) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
             return StatePair(0, &current);
           } else {
             // open speculation & result may be success or fail
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      false);
+                                      false, unsatCore);
           }
         } else if (SpecStrategyToUse == CUSTOM) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            //          StatsTracker::increaseEle(curBB, 0, true);
-            //          StatsTracker::increaseEle(curBB, 2, false);
+            //          StatsTracker::increaseEle(curBB, 0);
+            //          StatsTracker::increaseEle(curBB, 2);
             return StatePair(0, &current);
           } else {
             independenceNo++;
             // open speculation & result may be success or fail and Now second
             // check
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               dynamicYes++;
-              StatsTracker::increaseEle(curBB, 0, true);
+              StatsTracker::increaseEle(curBB, 0);
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        false);
+                                        false, unsatCore);
             } else {
               dynamicNo++;
               // then close speculation & do marking as deletion
@@ -1391,7 +1773,7 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         TxSpeculationHelper::isStateSpeculable(current)) {
       llvm::BranchInst *binst =
           llvm::dyn_cast<llvm::BranchInst>(current.prevPC->inst);
-      llvm::BasicBlock *curBB = current.txTreeNode->getBasicBlock();
+      unsigned curBB = current.txTreeNode->getBasicBlockId();
 
       if (SpecTypeToUse == SAFETY) {
         if (SpecStrategyToUse == TIMID) {
@@ -1399,19 +1781,19 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // save unsat core
           // open speculation & result may be success or fail
-          StatsTracker::increaseEle(curBB, 0, true);
+          StatsTracker::increaseEle(curBB, 0);
           txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    true);
+                                    true, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // save unsat core
           // open speculation & result may be success or fail
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             dynamicYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      true);
+                                      true, unsatCore);
           } else {
             dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1421,55 +1803,58 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         }
       } else {
         if (SpecStrategyToUse == TIMID) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
             return StatePair(&current, 0);
           } else {
             // marking
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 1, true);
+            StatsTracker::increaseEle(curBB, 1);
             txTree->markPathCondition(current, unsatCore);
             return StatePair(&current, 0);
           }
         } else if (SpecStrategyToUse == AGGRESSIVE) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
             return StatePair(&current, 0);
           } else {
             // save unsat core
             // open speculation & result may be success or fail
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      true);
+                                      true, unsatCore);
           }
         } else if (SpecStrategyToUse == CUSTOM) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            //          StatsTracker::increaseEle(curBB, 0, true);
-            //          StatsTracker::increaseEle(curBB, 2, false);
+            //          StatsTracker::increaseEle(curBB, 0);
+            //          StatsTracker::increaseEle(curBB, 2);
             return StatePair(&current, 0);
           } else {
             independenceNo++;
             // save unsat core
             // open speculation & result may be success or fail
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               dynamicYes++;
-              StatsTracker::increaseEle(curBB, 0, true);
+              StatsTracker::increaseEle(curBB, 0);
               txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        true);
+                                        true, unsatCore);
             } else {
               dynamicNo++;
               // then close speculation & do marking as deletion
@@ -1506,7 +1891,7 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         TxSpeculationHelper::isStateSpeculable(current)) {
       llvm::BranchInst *binst =
           llvm::dyn_cast<llvm::BranchInst>(current.prevPC->inst);
-      llvm::BasicBlock *curBB = current.txTreeNode->getBasicBlock();
+      unsigned curBB = current.txTreeNode->getBasicBlockId();
 
       if (SpecTypeToUse == SAFETY) {
         if (SpecStrategyToUse == TIMID) {
@@ -1514,19 +1899,19 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // save unsat core
           // open speculation & result may be success or fail
-          StatsTracker::increaseEle(curBB, 0, true);
+          StatsTracker::increaseEle(curBB, 0);
           txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    false);
+                                    false, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // save unsat core
           // open speculation & result may be success or fail
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             dynamicYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      false);
+                                      false, unsatCore);
           } else {
             dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1536,56 +1921,59 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
         }
       } else {
         if (SpecStrategyToUse == TIMID) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
             return StatePair(0, &current);
           } else {
             // marking
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 1, true);
+            StatsTracker::increaseEle(curBB, 1);
             txTree->markPathCondition(current, unsatCore);
             return StatePair(0, &current);
           }
         } else if (SpecStrategyToUse == AGGRESSIVE) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            StatsTracker::increaseEle(curBB, 0, true);
-            StatsTracker::increaseEle(curBB, 2, false);
+            StatsTracker::increaseEle(curBB, 0);
+            StatsTracker::increaseEle(curBB, 2);
             return StatePair(0, &current);
           } else {
             // save unsat core
             // open speculation & result may be success or fail
             independenceNo++;
-            StatsTracker::increaseEle(curBB, 0, true);
+            StatsTracker::increaseEle(curBB, 0);
             txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      false);
+                                      false, unsatCore);
           }
         } else if (SpecStrategyToUse == CUSTOM) {
 
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             independenceYes++;
-            //          StatsTracker::increaseEle(curBB, 0, true);
-            //          StatsTracker::increaseEle(curBB, 2, false);
+            //          StatsTracker::increaseEle(curBB, 0);
+            //          StatsTracker::increaseEle(curBB, 2);
             return StatePair(0, &current);
           } else {
             independenceNo++;
             // save unsat core
             // open speculation & result may be success or fail
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               dynamicYes++;
-              StatsTracker::increaseEle(curBB, 0, true);
+              StatsTracker::increaseEle(curBB, 0);
               txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        false);
+                                        false, unsatCore);
             } else {
               dynamicNo++;
               // then close speculation & do marking as deletion
@@ -1623,23 +2011,22 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
       std::swap(trueState, falseState);
 
     if (it != seedMap.end()) {
-      std::vector<SeedInfo> seeds = it->second;
-      it->second.clear();
+      std::vector<SeedInfo> seeds;
+      seeds.swap(it->second);
+      std::vector<ref<ConstantExpr> > values;
+      bool success =
+          SeedInfo::evaluate(current, solver, condition, seeds, values);
+      assert(success && "FIXME: Unhandled solver failure");
+      (void)success;
+      // Move the seeds to the states whose condition they satisfy, without
+      // copying them.
       std::vector<SeedInfo> &trueSeeds = seedMap[trueState];
       std::vector<SeedInfo> &falseSeeds = seedMap[falseState];
-      for (std::vector<SeedInfo>::iterator siit = seeds.begin(),
-                                           siie = seeds.end();
-           siit != siie; ++siit) {
-        ref<ConstantExpr> res;
-        bool success = solver->getValue(
-            current, siit->assignment.evaluate(condition), res);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void)success;
-        if (res->isTrue()) {
-          trueSeeds.push_back(*siit);
-        } else {
-          falseSeeds.push_back(*siit);
-        }
+      for (unsigned i = 0; i < seeds.size(); ++i) {
+        std::vector<SeedInfo> &v =
+            values[i]->isTrue() ? trueSeeds : falseSeeds;
+        v.push_back(SeedInfo(0));
+        v.back().swap(seeds[i]);
       }
 
       bool swapInfo = false;
@@ -1659,11 +2046,13 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
       }
     }
 
-    current.ptreeNode->data = 0;
-    std::pair<PTree::Node *, PTree::Node *> res =
-        processTree->split(current.ptreeNode, falseState, trueState);
-    falseState->ptreeNode = res.first;
-    trueState->ptreeNode = res.second;
+    if (processTree) {
+      current.ptreeNode->data = 0;
+      std::pair<PTree::Node *, PTree::Node *> res =
+          processTree->split(current.ptreeNode, falseState, trueState);
+      falseState->ptreeNode = res.first;
+      trueState->ptreeNode = res.second;
+    }
 
     if (!isInternal) {
       if (pathWriter) {
@@ -1691,6 +2080,10 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
     addConstraint(*trueState, condition);
     addConstraint(*falseState, Expr::createIsZero(condition));
 
+    if (!followForkChoices(trueState, falseState) ||
+        partitionFork(trueState, falseState))
+      return StatePair(trueState, falseState);
+
     // Kinda gross, do we even really still want this option?
     if (MaxDepth && MaxDepth <= trueState->depth) {
       terminateStateEarly(*trueState, "max-depth exceeded.");
@@ -1702,11 +2095,18 @@ Executor::StatePair Executor::branchFork(ExecutionState &current,
   }
 }
 
-Executor::StatePair Executor::addSpeculationNode(ExecutionState &current,
-                                                 ref<Expr> condition,
-                                                 llvm::Instruction *binst,
-                                                 bool isInternal,
-                                                 bool falseBranchIsInfeasible) {
+Executor::StatePair Executor::addSpeculationNode(
+    ExecutionState &current, ref<Expr> condition, llvm::Instruction *binst,
+    bool isInternal, bool falseBranchIsInfeasible,
+    std::vector<ref<Expr> > &unsatCore) {
+  if (isSpeculationThrottled(binst)) {
+    // close speculation & do marking as deletion
+    txTree->markPathCondition(current, unsatCore);
+    if (falseBranchIsInfeasible)
+      return StatePair(&current, 0);
+    return StatePair(0, &current);
+  }
+
   current.txTreeNode->secondCheckInst = binst;
   if (falseBranchIsInfeasible == true) {
     // At this point the speculation node should be created and
@@ -1721,11 +2121,14 @@ Executor::StatePair Executor::addSpeculationNode(ExecutionState &current,
     trueState = speculationFalseState->branch();
     addedStates.push_back(trueState);
 
-    current.ptreeNode->data = 0;
-    std::pair<PTree::Node *, PTree::Node *> res =
-        processTree->split(current.ptreeNode, speculationFalseState, trueState);
-    speculationFalseState->ptreeNode = res.first;
-    trueState->ptreeNode = res.second;
+    if (processTree) {
+      current.ptreeNode->data = 0;
+      std::pair<PTree::Node *, PTree::Node *> res =
+          processTree->split(current.ptreeNode, speculationFalseState,
+                             trueState);
+      speculationFalseState->ptreeNode = res.first;
+      trueState->ptreeNode = res.second;
+    }
 
     if (!isInternal) {
       if (pathWriter) {
@@ -1771,11 +2174,14 @@ Executor::StatePair Executor::addSpeculationNode(ExecutionState &current,
     falseState = speculationTrueState->branch();
     addedStates.push_back(falseState);
 
-    current.ptreeNode->data = 0;
-    std::pair<PTree::Node *, PTree::Node *> res =
-        processTree->split(current.ptreeNode, speculationTrueState, falseState);
-    speculationTrueState->ptreeNode = res.first;
-    falseState->ptreeNode = res.second;
+    if (processTree) {
+      current.ptreeNode->data = 0;
+      std::pair<PTree::Node *, PTree::Node *> res =
+          processTree->split(current.ptreeNode, speculationTrueState,
+                             falseState);
+      speculationTrueState->ptreeNode = res.first;
+      falseState->ptreeNode = res.second;
+    }
 
     if (!isInternal) {
       if (pathWriter) {
@@ -1815,6 +2221,7 @@ Executor::StatePair Executor::addSpeculationNode(ExecutionState &current,
 Executor::StatePair Executor::speculationFork(ExecutionState &current,
                                               ref<Expr> condition,
                                               bool isInternal) {
+  SolverPhaseScope solverPhase(SpeculationPhase);
 
   // Anayzing Speculation node
   // Seeding is removed intentionally
@@ -1849,13 +2256,13 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // open speculation & result may be success or fail
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    true);
+                                    true, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // open speculation & result may be success or fail
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             //            dynamicYes++;
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      true);
+                                      true, unsatCore);
           } else {
             //            dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1870,21 +2277,22 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // open speculation & result may be success or fail
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    true);
+                                    true, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
 
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             //          independenceYes++;
             return StatePair(&current, 0);
           } else {
             //          independenceNo++;
             // open speculation & result may be success or fail
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               //            dynamicYes++;
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        true);
+                                        true, unsatCore);
             } else {
               //            dynamicNo++;
               // then close speculation & do marking as deletion
@@ -1905,13 +2313,13 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // open speculation & result may be success or fail
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    false);
+                                    false, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // open speculation & result may be success or fail
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             //            dynamicYes++;
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      false);
+                                      false, unsatCore);
           } else {
             //            dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1926,20 +2334,21 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           // open speculation & result may be success or fail
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    false);
+                                    false, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             //          independenceYes++;
             return StatePair(0, &current);
           } else {
             //          independenceNo++;
             // open speculation & result may be success or fail
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               //            dynamicYes++;
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        false);
+                                        false, unsatCore);
             } else {
               //            dynamicNo++;
               // then close speculation & do marking as deletion
@@ -1973,15 +2382,15 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    true);
+                                    true, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // save unsat core
           // open speculation & result may be success or fail
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             //            dynamicYes++;
             txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      true);
+                                      true, unsatCore);
           } else {
             //            dynamicNo++;
             // then close speculation & do marking as deletion
@@ -1996,10 +2405,11 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    true);
+                                    true, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             //          independenceYes++;
             return StatePair(&current, 0);
@@ -2007,11 +2417,11 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
             //          independenceNo++;
             // save unsat core
             // open speculation & result may be success or fail
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               //            dynamicYes++;
               txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        true);
+                                        true, unsatCore);
             } else {
               //            dynamicNo++;
               // then close speculation & do marking as deletion
@@ -2053,15 +2463,15 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    false);
+                                    false, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
           // save unsat core
           // open speculation & result may be success or fail
-          if (specSnap[binst] != visitedBlocks.size()) {
+          if (specSnap[binst] != visitedBlockCount) {
             //            dynamicYes++;
             txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
             return addSpeculationNode(current, condition, binst, isInternal,
-                                      false);
+                                      false, unsatCore);
           } else {
             //            dynamicNo++;
             // then close speculation & do marking as deletion
@@ -2076,10 +2486,11 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
         } else if (SpecStrategyToUse == AGGRESSIVE) {
           txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
           return addSpeculationNode(current, condition, binst, isInternal,
-                                    false);
+                                    false, unsatCore);
         } else if (SpecStrategyToUse == CUSTOM) {
-          std::set<std::string> vars = extractVarNames(current, binst);
-          if (TxSpeculationHelper::isIndependent(vars, bbOrderToSpecAvoid)) {
+          const TxSpeculationAvoidance::Bitset &vars =
+              extractVariables(current, binst);
+          if (specAvoidance.isIndependent(vars)) {
             // open speculation & assume success
             //          independenceYes++;
             return StatePair(0, &current);
@@ -2087,11 +2498,11 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
             //          independenceNo++;
             // save unsat core
             // open speculation & result may be success or fail
-            if (specSnap[binst] != visitedBlocks.size()) {
+            if (specSnap[binst] != visitedBlockCount) {
               //            dynamicYes++;
               txTree->storeSpeculationUnsatCore(solver, unsatCore, binst);
               return addSpeculationNode(current, condition, binst, isInternal,
-                                        false);
+                                        false, unsatCore);
             } else {
               //            dynamicNo++;
               // then close speculation & do marking as deletion
@@ -2130,11 +2541,13 @@ Executor::StatePair Executor::speculationFork(ExecutionState &current,
     if (RandomizeFork && theRNG.getBool())
       std::swap(trueState, falseState);
 
-    current.ptreeNode->data = 0;
-    std::pair<PTree::Node *, PTree::Node *> resNode =
-        processTree->split(current.ptreeNode, falseState, trueState);
-    falseState->ptreeNode = resNode.first;
-    trueState->ptreeNode = resNode.second;
+    if (processTree) {
+      current.ptreeNode->data = 0;
+      std::pair<PTree::Node *, PTree::Node *> resNode =
+          processTree->split(current.ptreeNode, falseState, trueState);
+      falseState->ptreeNode = resNode.first;
+      trueState->ptreeNode = resNode.second;
+    }
 
     if (!isInternal) {
       if (pathWriter) {
@@ -2186,36 +2599,48 @@ void Executor::speculativeBackJump(ExecutionState &current) {
     parent = parent->getParent();
   }
 
-  StatsTracker::increaseEle(parent->getBasicBlock(), 1, false);
+  StatsTracker::increaseEle(parent->getBasicBlockId(), 1);
 
   // interpolant marking on parent node
   if (parent && !parent->speculationUnsatCore.empty()) {
     parent->mark();
   }
-  specSnap[parent->secondCheckInst] = visitedBlocks.size();
+  specSnap[parent->secondCheckInst] = visitedBlockCount;
 
-  // collect & mark speculation fail all nodes in the sub tree
-  std::vector<TxTreeNode *> deletedNodes = collectSpeculationNodes(currentNode);
+  // The nodes deferred by -async-interpolants may descend from the subtree,
+  // and their entries are built while their ancestors are still there
+  txTree->publishPendingEntries();
 
-  // collect removed states which pointing to speculation fail node
+  // mark speculation fail all nodes in the sub tree, and collect the states
+  // of its leaves
   std::vector<ExecutionState *> removedSpeculationStates;
-  for (std::set<ExecutionState *>::const_iterator it = states.begin(),
-                                                  ie = states.end();
-       it != ie; ++it) {
-    ExecutionState *tmp = (*it);
-    if (tmp->txTreeNode->isSpeculationFailedNode()) {
-      removedSpeculationStates.push_back(tmp);
-    }
-  }
+  collectSpeculationStates(currentNode, removedSpeculationStates);
 
-  // update states in search
-  searcher->update(0, std::vector<ExecutionState *>(),
-                   removedSpeculationStates);
-  // remove fail nodes in subtree
-  for (std::vector<TxTreeNode *>::iterator it = deletedNodes.begin(),
-                                           ie = deletedNodes.end();
+  // update states in search, where the parked states are not
+  std::vector<ExecutionState *> searchedStates;
+  for (std::vector<ExecutionState *>::iterator
+           it = removedSpeculationStates.begin(),
+           ie = removedSpeculationStates.end();
        it != ie; ++it) {
-    txTree->removeSpeculationFailedNodes(*it);
+    if (!parkedStates.erase(*it))
+      searchedStates.push_back(*it);
+  }
+  searcher->update(0, std::vector<ExecutionState *>(), searchedStates);
+  // remove fail nodes in subtree, children first
+  TxTreeNode *node = currentNode;
+  while (true) {
+    if (node->getLeft()) {
+      node = node->getLeft();
+    } else if (node->getRight()) {
+      node = node->getRight();
+    } else {
+      TxTreeNode *p = node->getParent();
+      bool isRoot = node == currentNode;
+      txTree->removeSpeculationFailedNodes(node);
+      if (isRoot)
+        break;
+      node = p;
+    }
   }
   // remove state in states
   for (std::vector<ExecutionState *>::iterator
@@ -2232,22 +2657,74 @@ void Executor::speculativeBackJump(ExecutionState &current) {
 
   // add fail time for spec subtree
   totalSpecFailTime += thisSpecTreeTime;
+
+  if (SpecBackoff) {
+    SpeculationSite &site = speculationSites[parent->secondCheckInst];
+    ++site.failureCount;
+    site.failTime += thisSpecTreeTime;
+    site.failedSinceAttempt = true;
+    if (++site.consecutiveFailureCount >= SpecBackoff) {
+      site.gap = site.gap ? std::min(site.gap * 2, (unsigned)SpecBackoffMaxGap)
+                          : 1;
+      site.countdown = site.gap;
+    }
+  }
 }
 
-std::vector<TxTreeNode *> Executor::collectSpeculationNodes(TxTreeNode *root) {
-  if (!root)
-    return std::vector<TxTreeNode *>();
-  std::vector<TxTreeNode *> leftNodes =
-      collectSpeculationNodes(root->getLeft());
-  std::vector<TxTreeNode *> rightNodes =
-      collectSpeculationNodes(root->getRight());
-  std::vector<TxTreeNode *> result;
-  result.insert(result.end(), leftNodes.begin(), leftNodes.end());
-  result.insert(result.end(), rightNodes.begin(), rightNodes.end());
-  // mark root fail & add to result
-  root->setSpeculationFailed();
-  result.insert(result.end(), root);
-  return result;
+bool Executor::isSpeculationThrottled(llvm::Instruction *binst) {
+  if (!SpecBackoff)
+    return false;
+
+  SpeculationSite &site = speculationSites[binst];
+  if (site.countdown) {
+    --site.countdown;
+    ++site.skipCount;
+    ++specThrottled;
+    return true;
+  }
+  // A speculation not failed by the next attempt at its branch is taken as
+  // a success, which ends the backoff
+  if (site.attemptCount && !site.failedSinceAttempt) {
+    site.consecutiveFailureCount = 0;
+    site.gap = 0;
+  }
+  site.failedSinceAttempt = false;
+  ++site.attemptCount;
+  return false;
+}
+
+void Executor::collectSpeculationStates(
+    TxTreeNode *root, std::vector<ExecutionState *> &result) {
+  // Walk the subtree in preorder using the parent links
+  TxTreeNode *node = root;
+  while (node) {
+    node->setSpeculationFailed();
+    if (node->getLeft()) {
+      node = node->getLeft();
+      continue;
+    }
+    if (node->getRight()) {
+      node = node->getRight();
+      continue;
+    }
+
+    // A leaf: its state, if still live and at the node, is removed
+    ExecutionState *es = node->getState();
+    if (es && states.count(es) && es->txTreeNode == node)
+      result.push_back(es);
+
+    // Climb to the next right subtree not yet visited
+    while (node != root) {
+      TxTreeNode *p = node->getParent();
+      if (node == p->getLeft() && p->getRight()) {
+        node = p->getRight();
+        break;
+      }
+      node = p;
+    }
+    if (node == root)
+      node = 0;
+  }
 }
 
 void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
@@ -2361,8 +2838,8 @@ const Cell &Executor::eval(KInstruction *ki, unsigned index,
     return kmodule->constantTable[index];
   } else {
     unsigned index = vnumber;
-    StackFrame &sf = state.stack.back();
-    return sf.locals[index];
+    const StackFrame &sf = state.stack.back();
+    return sf.getLocal(index);
   }
 }
 
@@ -2376,7 +2853,27 @@ void Executor::bindArgument(KFunction *kf, unsigned index,
   getArgumentCell(state, kf, index).value = value;
 }
 
+bool Executor::getUniqueValue(const ExecutionState &state, ref<Expr> e,
+                              ref<ConstantExpr> &value, bool &isUnique) {
+  if (CacheUniqueValues) {
+    ExprHashMap<ref<ConstantExpr> >::const_iterator it =
+        state.uniqueValues->find(e);
+    if (it != state.uniqueValues->end()) {
+      value = it->second;
+      isUnique = true;
+      return true;
+    }
+  }
+
+  if (!solver->getUniqueValue(state, e, value, isUnique))
+    return false;
+  if (CacheUniqueValues && isUnique)
+    state.uniqueValues.mutate()[e] = value;
+  return true;
+}
+
 ref<Expr> Executor::toUnique(const ExecutionState &state, ref<Expr> &e) {
+  SolverPhaseScope solverPhase(ConcretizationPhase);
   ref<Expr> result = e;
 
   if (!isa<ConstantExpr>(e)) {
@@ -2384,8 +2881,7 @@ ref<Expr> Executor::toUnique(const ExecutionState &state, ref<Expr> &e) {
     bool isTrue = false;
 
     solver->setTimeout(coreSolverTimeout);
-    if (solver->getValue(state, e, value) &&
-        solver->mustBeTrue(state, EqExpr::create(e, value), isTrue) && isTrue)
+    if (getUniqueValue(state, e, value, isTrue) && isTrue)
       result = value;
     solver->setTimeout(0);
   }
@@ -2393,16 +2889,63 @@ ref<Expr> Executor::toUnique(const ExecutionState &state, ref<Expr> &e) {
   return result;
 }
 
+bool Executor::toConstants(const ExecutionState &state,
+                           std::vector<ref<Expr> > &values, bool unique) {
+  SolverPhaseScope solverPhase(ConcretizationPhase);
+  ref<Expr> all;
+  for (std::vector<ref<Expr> >::iterator it = values.begin(),
+                                         ie = values.end();
+       it != ie; ++it) {
+    if (!isa<ConstantExpr>(*it))
+      all = all.isNull() ? *it : ConcatExpr::create(all, *it);
+  }
+  if (all.isNull())
+    return true;
+
+  ref<ConstantExpr> value;
+  bool isTrue = !unique;
+  bool success;
+  if (unique) {
+    solver->setTimeout(coreSolverTimeout);
+    success = getUniqueValue(state, all, value, isTrue);
+    solver->setTimeout(0);
+  } else {
+    success = solver->getValue(state, all, value);
+  }
+  if (!success || !isTrue)
+    return false;
+
+  // The last expression concatenated is the least significant.
+  unsigned offset = 0;
+  for (unsigned i = values.size(); i-- > 0;) {
+    if (!isa<ConstantExpr>(values[i])) {
+      Expr::Width width = values[i]->getWidth();
+      values[i] = value->Extract(offset, width);
+      offset += width;
+    }
+  }
+  return true;
+}
+
 /* Concretize the given expression, and return a possible constant value.
    'reason' is just a documentation string stating the reason for
    concretization. */
 ref<klee::ConstantExpr> Executor::toConstant(ExecutionState &state, ref<Expr> e,
                                              const char *reason) {
+  SolverPhaseScope solverPhase(ConcretizationPhase);
   e = state.constraints.simplifyExpr(e);
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e))
     return CE;
 
   ref<ConstantExpr> value;
+  if (CacheUniqueValues) {
+    // An expression with a single value is not concretized by the constraint
+    ExprHashMap<ref<ConstantExpr> >::const_iterator it =
+        state.uniqueValues->find(e);
+    if (it != state.uniqueValues->end())
+      return it->second;
+  }
+
   bool success = solver->getValue(state, e, value);
   assert(success && "FIXME: Unhandled solver failure");
   (void)success;
@@ -2419,12 +2962,15 @@ ref<klee::ConstantExpr> Executor::toConstant(ExecutionState &state, ref<Expr> e,
     klee_warning_once(reason, "%s", os.str().c_str());
 
   addConstraint(state, EqExpr::create(e, value));
+  if (CacheUniqueValues)
+    state.uniqueValues.mutate()[e] = value;
 
   return value;
 }
 
 void Executor::executeGetValue(ExecutionState &state, ref<Expr> e,
                                KInstruction *target) {
+  SolverPhaseScope solverPhase(ConcretizationPhase);
   e = state.constraints.simplifyExpr(e);
   std::map<ExecutionState *, std::vector<SeedInfo> >::iterator it =
       seedMap.find(&state);
@@ -2446,17 +2992,11 @@ void Executor::executeGetValue(ExecutionState &state, ref<Expr> e,
       }
     }
   } else {
-    std::set<ref<Expr> > values;
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
-                                         siie = it->second.end();
-         siit != siie; ++siit) {
-      ref<ConstantExpr> value;
-      bool success =
-          solver->getValue(state, siit->assignment.evaluate(e), value);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      values.insert(value);
-    }
+    std::vector<ref<ConstantExpr> > seedValues;
+    bool success = SeedInfo::evaluate(state, solver, e, it->second, seedValues);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void)success;
+    std::set<ref<Expr> > values(seedValues.begin(), seedValues.end());
 
     std::vector<ref<Expr> > conditions;
     for (std::set<ref<Expr> >::iterator vit = values.begin(),
@@ -2535,14 +3075,60 @@ void Executor::stepInstruction(ExecutionState &state) {
     haltExecution = true;
 }
 
+void Executor::executeConcreteBranch(ExecutionState &state, bool taken) {
+  // The branch is also a step, of its own statistics and coverage
+  KInstruction *ki = state.pc;
+  stepInstruction(state);
+  BranchInst *bi = cast<BranchInst>(ki->inst);
+
+  // As for a branch on a constant in branchFork and executeInstruction
+  if (pathWriter)
+    state.pathOS << (taken ? "1" : "0");
+  if (statsTracker && state.stack.back().kf->trackCoverage)
+    statsTracker->markBranchVisited(taken ? &state : 0, taken ? 0 : &state);
+  transferToBasicBlock(bi->getSuccessor(taken ? 0 : 1), bi->getParent(),
+                       state);
+}
+
+void Executor::executeBlock(ExecutionState &state, KInstruction *ki) {
+  // The subsumption check is only made at the first instruction of a node,
+  // and a node only starts at a new block or at a fork, which adds a state.
+  // The calls and the terminator of the block are left to the run loop, so
+  // that a block branching to itself still runs the timers between visits.
+  llvm::BasicBlock *bb = ki->inst->getParent();
+  TxTreeNode *node = state.txTreeNode;
+  while (!haltExecution && addedStates.empty() && removedStates.empty() &&
+         state.txTreeNode == node && state.pc->inst->getParent() == bb &&
+         !isa<TerminatorInst>(state.pc->inst) &&
+         state.pc->inst->getOpcode() != Instruction::Call) {
+    if (INTERPOLATION_ENABLED)
+      txTree->setCurrentINode(state);
+    ki = state.pc;
+    SamplingProfiler::setInstruction(ki, state.depth);
+    stepInstruction(state);
+    executeInstruction(state, ki);
+    if (INTERPOLATION_ENABLED)
+      state.txTreeNode->incInstructionsDepth();
+  }
+}
+
+/// Whether the function is read or write of the POSIX runtime, whose copies
+/// to and from the contents of the symbolic files are bulk operations with
+/// -bulk-file-reads
+static bool isFileFunction(const Function *f) {
+  return f->getName() == "read" || f->getName() == "write";
+}
+
 void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
                            std::vector<ref<Expr> > &arguments) {
   // BB Coverage
-  bool isInterested = (fBBOrder.find(f) != fBBOrder.end());
-  if (isInterested) {
-    bool isInSpecMode = (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC &&
-                         state.txTreeNode->isSpeculationNode());
-    processBBCoverage(BBCoverage, &(f->front()), isInSpecMode);
+  if (BBCoverage >= 1 && f && !f->isDeclaration()) {
+    KInstruction *entry = kmodule->functionMap[f]->instructions[0];
+    if (basicBlockOrder[entry->basicBlockId]) {
+      bool isInSpecMode = (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC &&
+                           state.txTreeNode->isSpeculationNode());
+      processBBCoverage(BBCoverage, entry, isInSpecMode);
+    }
   }
 
   Instruction *i = ki->inst;
@@ -2611,6 +3197,30 @@ void Executor::executeCall(ExecutionState &state, KInstruction *ki, Function *f,
     if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
       transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
   } else {
+    if ((BulkMemoryFunctions ||
+         (BulkFileReads && isFileFunction(state.stack.back().kf->function))) &&
+        specialFunctionHandler->handleBulkMemory(state, f, ki, arguments)) {
+      if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
+        transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+      return;
+    }
+
+    ref<Expr> summary;
+    if (functionSummaries && isa<CallInst>(i) &&
+        functionSummaries->lookup(f, arguments, summary) &&
+        summary->getWidth() == getWidthForLLVMType(i->getType())) {
+      ++stats::functionSummaryHits;
+      bindLocal(ki, state, summary);
+      if (INTERPOLATION_ENABLED)
+        state.txTreeNode->bindSummaryReturnValue(cast<CallInst>(i), arguments,
+                                                 summary);
+      return;
+    }
+
+    if (nativeCalls && isa<CallInst>(i) &&
+        callNatively(state, ki, f, arguments))
+      return;
+
     // FIXME: I'm not really happy about this reliance on prevPC but it is ok, I
     // guess. This just done to avoid having to pass KInstIterator everywhere
     // instead of the actual instruction, since we can't make a KInstIterator
@@ -2748,87 +3358,42 @@ void Executor::transferToBasicBlock(BasicBlock *dst, BasicBlock *src,
   }
 
   // process BB Coverage
-  bool isInterested = (fBBOrder.find(dst->getParent()) != fBBOrder.end());
-  if (isInterested) {
-
+  if (BBCoverage >= 1 && basicBlockOrder[state.pc->basicBlockId]) {
     bool isInSpecMode = (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC &&
                          state.txTreeNode->isSpeculationNode());
-    processBBCoverage(BBCoverage, dst, isInSpecMode);
+    processBBCoverage(BBCoverage, state.pc, isInSpecMode);
   }
 }
 
-void Executor::processBBCoverage(int BBCoverage, llvm::BasicBlock *bb,
+void Executor::processBBCoverage(int BBCoverage, KInstruction *entry,
                                  bool isInSpecMode) {
   if (BBCoverage >= 1) {
-    bool isNew = (visitedBlocks.find(bb) == visitedBlocks.end());
-    int order = fBBOrder[bb->getParent()][bb];
+    unsigned id = entry->basicBlockId;
+    bool isNew = !visitedBlocks[id];
+    int order = basicBlockOrder[id];
     if (!isInSpecMode && isNew) {
       // add to visited BBs if not in speculation mode
-      visitedBlocks.insert(bb);
+      visitedBlocks[id] = true;
+      ++visitedBlockCount;
     }
-    float percent = ((float)visitedBlocks.size() / (float)allBlockCount) * 100;
+    float percent = ((float)visitedBlockCount / (float)allBlockCount) * 100;
     // print percentage if this is a new BB
     if (BBCoverage >= 2 && isNew) {
       // print live %
-
-      std::string livePercentCovFile =
-          interpreterHandler->getOutputFilename("LivePercentCov.txt");
-      std::ofstream livePercentCovFileOut(livePercentCovFile.c_str(),
-                                          std::ofstream::app);
-      // [BB order - No. Visited - Total - %]
-      livePercentCovFileOut << "[" << visitedBlocks.size() << ","
-                            << allBlockCount << "," << percent << "]\n";
-      livePercentCovFileOut.close();
+      coverageLogger->logLivePercentage(visitedBlockCount, allBlockCount,
+                                        percent);
     }
 
-    // print live BB
+    // record live BB, its content is printed at the end of the run
     if (BBCoverage >= 3 && isNew && !isInSpecMode) {
-      std::string liveBBFile =
-          interpreterHandler->getOutputFilename("LiveBB.txt");
-      std::ofstream liveBBFileOut(liveBBFile.c_str(), std::ofstream::app);
-      liveBBFileOut << "-- BlockScopeStarts --\n";
-      liveBBFileOut << "Function: " << bb->getParent()->getName().str() << "\n";
-      liveBBFileOut << "Block Order: " << order;
-      // block content
-      std::string tmp;
-      raw_string_ostream tmpOS(tmp);
-      bb->print(tmpOS);
-      liveBBFileOut << tmp;
-      liveBBFileOut << "-- BlockScopeEnds --\n\n";
-      liveBBFileOut.close();
-    }
-    if (BBCoverage >= 4 && isNew && !isInSpecMode) {
-      // Print covered atomic condition covered
-      std::string liveBBFileICMP =
-          interpreterHandler->getOutputFilename("coveredICMP.txt");
-      std::ofstream liveBBFileICMPOut(liveBBFileICMP.c_str(),
-                                      std::ofstream::app);
-
-      // block content
-      std::string tmpICMP;
-      raw_string_ostream tmpICMPOS(tmpICMP);
-      for (llvm::BasicBlock::iterator icmp = bb->begin(); icmp != bb->end();
-           icmp++) {
-        if (llvm::isa<llvm::ICmpInst>(icmp)) {
-          coveredICMPCount++;
-          liveBBFileICMPOut << "Function: " << bb->getParent()->getName().str()
-                            << " ";
-          liveBBFileICMPOut << "Block Order: " << order;
-          icmp->print(tmpICMPOS);
-          liveBBFileICMPOut << tmpICMP << "\n";
-        }
-      }
-      liveBBFileICMPOut.close();
+      unsigned icmpCount =
+          coverageLogger->logLiveBlock(entry->inst->getParent(), order);
+      if (BBCoverage >= 4)
+        coveredICMPCount += icmpCount;
     }
     if (BBCoverage >= 5) {
       double diff = time(0) - startingBBPlottingTime;
-      std::string bbPlottingFile =
-          interpreterHandler->getOutputFilename("BBPlotting.txt");
-      std::ofstream bbPlotingFileOut(bbPlottingFile.c_str(),
-                                     std::ofstream::app);
-      bbPlotingFileOut << diff << "     " << std::fixed << std::setprecision(2)
-                       << percent << "\n";
-      bbPlotingFileOut.close();
+      coverageLogger->logPlotting(diff, percent);
     }
   }
 }
@@ -2936,8 +3501,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // check new BB
     if (SpecTypeToUse == COVERAGE) {
-      llvm::BasicBlock *currentBB = state.txTreeNode->getBasicBlock();
-      if (visitedBlocks.find(currentBB) == visitedBlocks.end()) {
+      if (!visitedBlocks[state.txTreeNode->getBasicBlockId()]) {
         if (specFailNew.find(pp) != specFailNew.end()) {
           specFailNew[pp] = specFailNew[pp] + 1;
         } else {
@@ -2982,6 +3546,14 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       assert(!caller && "caller set on initial stack frame");
       terminateStateOnExit(state);
     } else {
+      if (functionSummaries && !isVoidReturn) {
+        // The arguments are the first registers, which are not reassigned
+        StackFrame &sf = state.stack.back();
+        std::vector<ref<Expr> > arguments;
+        for (unsigned i = 0, n = sf.kf->function->arg_size(); i < n; ++i)
+          arguments.push_back(sf.getLocal(sf.kf->getArgRegister(i)).value);
+        functionSummaries->insert(sf.kf->function, arguments, result);
+      }
       state.popFrame(ki, result);
 
       if (statsTracker)
@@ -3175,74 +3747,81 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
         expressionOrder.insert(std::make_pair(value, caseSuccessor));
       }
 
-      // Track default branch values
-      ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
+      if (SwitchModelEnumeration) {
+        getFeasibleSwitchTargets(state, cond, si->getDefaultDest(),
+                                 expressionOrder, bbOrder, branchTargets);
+      } else {
+        // Track default branch values
+        ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
+
+        // iterate through all non-default cases but in order of the expressions
+        for (std::map<ref<Expr>, BasicBlock *>::iterator
+                 it = expressionOrder.begin(),
+                 itE = expressionOrder.end();
+             it != itE; ++it) {
+          std::vector<ref<Expr> > unsatCore;
+          ref<Expr> match = EqExpr::create(cond, it->first);
+
+          // Make sure that the default value does not contain this target's
+          // value
+          defaultValue =
+              AndExpr::create(defaultValue, Expr::createIsZero(match));
+
+          // Check if control flow could take this case
+          bool result;
+          bool success = solver->mayBeTrue(state, match, result, unsatCore);
+          assert(success && "FIXME: Unhandled solver failure");
+          (void)success;
+          if (result) {
+            BasicBlock *caseSuccessor = it->second;
+
+            // Handle the case that a basic block might be the target of
+            // multiple switch cases.
+            // Currently we generate an expression containing all switch-case
+            // values for the same target basic block. We spare us forking too
+            // many times but we generate more complex condition expressions
+            // TODO Add option to allow to choose between those behaviors
+            std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> res =
+                branchTargets.insert(std::make_pair(
+                    caseSuccessor, ConstantExpr::alloc(0, Expr::Bool)));
+
+            res.first->second = OrExpr::create(match, res.first->second);
+
+            // Only add basic blocks which have not been target of a branch yet
+            if (res.second) {
+              bbOrder.push_back(caseSuccessor);
+            }
+          } else if (INTERPOLATION_ENABLED) {
+            // The solver returned no solution, which means there is an
+            // infeasible branch: Mark the unsatisfiability core
+            state.txTreeNode->unsatCoreInterpolation(unsatCore);
+            if (DebugTracerX)
+              llvm::errs() << "[executeInstruction:unsatCoreInterpolation] Switch, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
+          }
+        }
 
-      // iterate through all non-default cases but in order of the expressions
-      for (std::map<ref<Expr>, BasicBlock *>::iterator
-               it = expressionOrder.begin(),
-               itE = expressionOrder.end();
-           it != itE; ++it) {
+        // Check if control could take the default case
         std::vector<ref<Expr> > unsatCore;
-        ref<Expr> match = EqExpr::create(cond, it->first);
-
-        // Make sure that the default value does not contain this target's value
-        defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
-
-        // Check if control flow could take this case
-        bool result;
-        bool success = solver->mayBeTrue(state, match, result, unsatCore);
+        bool res;
+        bool success = solver->mayBeTrue(state, defaultValue, res, unsatCore);
         assert(success && "FIXME: Unhandled solver failure");
         (void)success;
-        if (result) {
-          BasicBlock *caseSuccessor = it->second;
-
-          // Handle the case that a basic block might be the target of multiple
-          // switch cases.
-          // Currently we generate an expression containing all switch-case
-          // values for the same target basic block. We spare us forking too
-          // many times but we generate more complex condition expressions
-          // TODO Add option to allow to choose between those behaviors
-          std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> res =
-              branchTargets.insert(std::make_pair(
-                  caseSuccessor, ConstantExpr::alloc(0, Expr::Bool)));
-
-          res.first->second = OrExpr::create(match, res.first->second);
-
-          // Only add basic blocks which have not been target of a branch yet
-          if (res.second) {
-            bbOrder.push_back(caseSuccessor);
+        if (res) {
+          std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> ret =
+              branchTargets.insert(
+                  std::make_pair(si->getDefaultDest(), defaultValue));
+          if (ret.second) {
+            bbOrder.push_back(si->getDefaultDest());
           }
         } else if (INTERPOLATION_ENABLED) {
-          // The solver returned no solution, which means there is an infeasible
-          // branch: Mark the unsatisfiability core
+          // The solver returned no solution, which means the default branch
+          // cannot be taken: Mark the unsatisfiability core
           state.txTreeNode->unsatCoreInterpolation(unsatCore);
           if (DebugTracerX)
             llvm::errs() << "[executeInstruction:unsatCoreInterpolation] Switch, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
         }
       }
 
-      // Check if control could take the default case
-      std::vector<ref<Expr> > unsatCore;
-      bool res;
-      bool success = solver->mayBeTrue(state, defaultValue, res, unsatCore);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      if (res) {
-        std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> ret =
-            branchTargets.insert(
-                std::make_pair(si->getDefaultDest(), defaultValue));
-        if (ret.second) {
-          bbOrder.push_back(si->getDefaultDest());
-        }
-      } else if (INTERPOLATION_ENABLED) {
-        // The solver returned no solution, which means the default branch
-        // cannot be taken: Mark the unsatisfiability core
-        state.txTreeNode->unsatCoreInterpolation(unsatCore);
-        if (DebugTracerX)
-          llvm::errs() << "[executeInstruction:unsatCoreInterpolation] Switch, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
-      }
-
       // Fork the current state with each state having one of the possible
       // successors of this switch
       std::vector<ref<Expr> > conditions;
@@ -3774,6 +4353,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       if (DebugTracerX)
         llvm::errs() << "[executeInstruction:execute] ICMP, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
     }
+
+    if (ki->fusedWithNext && FuseInstructions && !INTERPOLATION_ENABLED &&
+        !followsReplayPath() && !result.isNull()) {
+      if (ConstantExpr *ce = dyn_cast<ConstantExpr>(result))
+        executeConcreteBranch(state, ce->isTrue());
+    }
     break;
   }
 
@@ -3839,6 +4424,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       if (DebugTracerX)
         llvm::errs() << "[executeInstruction:execute] GetElementPtr, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
     }
+
+    if (ki->fusedWithNext && FuseInstructions && !INTERPOLATION_ENABLED) {
+      KInstruction *load = state.pc;
+      stepInstruction(state);
+      executeMemoryOperation(state, false, address, 0, load);
+    }
     break;
   }
 
@@ -4430,7 +5021,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 }
 
 void Executor::updateStates(ExecutionState *current) {
-  if (searcher) {
+  if (searcher && (searcherUpdatesCurrent || !addedStates.empty() ||
+                   !removedStates.empty())) {
     searcher->update(current, addedStates, removedStates);
   }
 
@@ -4441,14 +5033,14 @@ void Executor::updateStates(ExecutionState *current) {
                                                ie = removedStates.end();
        it != ie; ++it) {
     ExecutionState *es = *it;
-    std::set<ExecutionState *>::iterator it2 = states.find(es);
-    assert(it2 != states.end());
-    states.erase(it2);
+    states.erase(es);
+    parkedStates.erase(es);
     std::map<ExecutionState *, std::vector<SeedInfo> >::iterator it3 =
         seedMap.find(es);
     if (it3 != seedMap.end())
       seedMap.erase(it3);
-    processTree->remove(es->ptreeNode);
+    if (processTree)
+      processTree->remove(es->ptreeNode);
     if (INTERPOLATION_ENABLED) {
       txTree->remove(es, solver, (current == 0));
       if (DebugTracerX)
@@ -4521,21 +5113,125 @@ void Executor::bindModuleConstants() {
   }
 }
 
-void Executor::checkMemoryUsage() {
+unsigned Executor::parkStates(ExecutionState &current, unsigned count) {
+  std::vector<ExecutionState *> candidates;
+  for (LiveStates::iterator it = states.begin(), ie = states.end();
+       it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es != &current && !parkedStates.count(es) &&
+        std::find(removedStates.begin(), removedStates.end(), es) ==
+            removedStates.end())
+      candidates.push_back(es);
+  }
+
+  // Keep the states that covered new code running, as when killing
+  std::vector<ExecutionState *> toPark;
+  for (unsigned pass = 0; pass < 2 && toPark.size() < count; ++pass) {
+    for (std::vector<ExecutionState *>::iterator it = candidates.begin(),
+                                                 ie = candidates.end();
+         it != ie && toPark.size() < count; ++it) {
+      if ((*it)->coveredNew == (pass == 1))
+        toPark.push_back(*it);
+    }
+  }
+
+  if (toPark.empty())
+    return 0;
+  searcher->update(0, std::vector<ExecutionState *>(), toPark);
+  parkedStates.insert(toPark.begin(), toPark.end());
+  return toPark.size();
+}
+
+void Executor::resumeParkedStates() {
+  if (parkedStates.empty())
+    return;
+  std::vector<ExecutionState *> resumed(parkedStates.begin(),
+                                        parkedStates.end());
+  parkedStates.clear();
+  if (searcher)
+    searcher->update(0, resumed, std::vector<ExecutionState *>());
+}
+
+Executor::MemoryBreakdown Executor::getMemoryBreakdown() const {
+  MemoryBreakdown breakdown;
+  breakdown.expressions = Expr::allocatedBytes;
+  breakdown.objectStates = ObjectState::getAllocatedBytes();
+  breakdown.txTree = TxArena::getAllocatedBytes();
+  breakdown.subsumptionTable = TxSubsumptionTable::getSize();
+  breakdown.deterministic = memory->getUsedDeterministicSize();
+  return breakdown;
+}
+
+void Executor::checkMemoryUsage(ExecutionState &current) {
   if (!MaxMemory)
     return;
   if ((stats::instructions & 0xFFFF) == 0) {
     // We need to avoid calling GetTotalMallocUsage() often because it
     // is O(elts on freelist). This is really bad since we start
-    // to pummel the freelist once we hit the memory cap.
-    unsigned mbs = (util::GetTotalMallocUsage() >> 20) +
-                   (memory->getUsedDeterministicSize() >> 20);
+    // to pummel the freelist once we hit the memory cap. Between its
+    // calls the usage is estimated from the memory counted by the
+    // subsystems, and it is only measured again near the cap, or every 16
+    // checks to follow the memory not counted.
+    MemoryBreakdown breakdown = getMemoryBreakdown();
+    uint64_t counted = breakdown.getTotal();
+    uint64_t estimate = lastMallocUsage + counted - lastCountedUsage;
+    if (counted < lastCountedUsage)
+      estimate = lastMallocUsage > lastCountedUsage - counted
+                     ? lastMallocUsage - (lastCountedUsage - counted)
+                     : 0;
+    if (!lastMallocUsage || ++checksSinceMallocUsage >= 16 ||
+        (estimate >> 20) + (breakdown.deterministic >> 20) >=
+            (uint64_t)MaxMemory * 9 / 10) {
+      lastMallocUsage = util::GetTotalMallocUsage();
+      lastCountedUsage = counted;
+      checksSinceMallocUsage = 0;
+      estimate = lastMallocUsage;
+    }
+    unsigned mbs = (estimate >> 20) + (breakdown.deterministic >> 20);
 
     if (mbs > MaxMemory) {
+      klee_warning_once(0, "memory usage of %u MB over the cap: %lu MB of "
+                           "expressions, %lu MB of object states, %lu MB of "
+                           "the interpolation tree, %lu MB of the subsumption "
+                           "table, %lu MB of deterministic allocations",
+                        mbs, (unsigned long)(breakdown.expressions >> 20),
+                        (unsigned long)(breakdown.objectStates >> 20),
+                        (unsigned long)(breakdown.txTree >> 20),
+                        (unsigned long)(breakdown.subsumptionTable >> 20),
+                        (unsigned long)(breakdown.deterministic >> 20));
+#ifdef ENABLE_Z3
+      // Shrink the subsumption table before resorting to killing states
+      if (INTERPOLATION_ENABLED && MaxSubsumptionTableMemory &&
+          mbs > MaxMemory + 100) {
+        uint64_t freed = TxSubsumptionTable::shrink(0.5);
+        if (freed) {
+          klee_warning("evicted %lu MB of subsumption table entries (over "
+                       "memory cap)",
+                       (unsigned long)(freed >> 20));
+          atMemoryLimit = true;
+          return;
+        }
+      }
+#endif
+      if (mbs > MaxMemory + 100 && MaxMemoryPark) {
+        // Parked states no longer fork or allocate, so the running ones
+        // can terminate and release memory without losing the others
+        unsigned numStates = states.size() - parkedStates.size();
+        unsigned toPark =
+            std::max(1U, numStates - numStates * MaxMemory / mbs);
+        unsigned parked = parkStates(current, toPark);
+        if (parked) {
+          klee_warning("parking %d states (over memory cap)", parked);
+          atMemoryLimit = true;
+          return;
+        }
+      }
       if (mbs > MaxMemory + 100) {
         // just guess at how many to kill
         unsigned numStates = states.size();
         unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
+        // Killing a parked state needs it back in the searcher
+        resumeParkedStates();
         klee_warning("killing %d states (over memory cap)", toKill);
         std::vector<ExecutionState *> arr(states.begin(), states.end());
         for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
@@ -4551,17 +5247,21 @@ void Executor::checkMemoryUsage() {
       }
       atMemoryLimit = true;
     } else {
+      if (!parkedStates.empty()) {
+        klee_message("resuming %d parked states", (int)parkedStates.size());
+        resumeParkedStates();
+      }
       atMemoryLimit = false;
     }
   }
 }
 
 void Executor::doDumpStates() {
+  resumeParkedStates();
   if (!DumpStatesOnHalt || states.empty())
     return;
   klee_message("halting execution, dumping remaining states");
-  for (std::set<ExecutionState *>::iterator it = states.begin(),
-                                            ie = states.end();
+  for (LiveStates::iterator it = states.begin(), ie = states.end();
        it != ie; ++it) {
     ExecutionState &state = **it;
     stepInstruction(state); // keep stats rolling
@@ -4570,87 +5270,28 @@ void Executor::doDumpStates() {
   updateStates(0);
 }
 
-std::map<int, std::set<std::string> >
-Executor::readBBOrderToSpecAvoid(std::string folderName) {
-  std::map<int, std::set<std::string> > res;
-  DIR *dirp = opendir(folderName.c_str());
-  dirent *dp;
-  while ((dp = readdir(dirp)) != NULL) {
-    std::string name(dp->d_name);
-    if (strcmp(name.substr(0, 10).c_str(), "SpecAvoid_") == 0) {
-      std::string absPath = folderName + "/" + name;
-      std::pair<int, std::set<std::string> > tmp = readBBSpecAvoid(absPath);
-      res[tmp.first] = tmp.second;
-    }
-  }
-  (void)closedir(dirp);
-  return res;
-}
-
-std::pair<int, std::set<std::string> >
-Executor::readBBSpecAvoid(std::string fileName) {
-  bool isFirst = true;
-  int bb;
-  std::set<std::string> avoid;
-  std::ifstream in(fileName.c_str());
-  std::string str;
-  while (std::getline(in, str)) {
-    if (isFirst) {
-      bb = atoi(str.c_str());
-      isFirst = false;
-    } else {
-      if (!TxSpeculationHelper::trim(str).empty())
-        avoid.insert(TxSpeculationHelper::trim(str));
-    }
-  }
-  in.close();
-  return std::make_pair(bb, avoid);
-}
-std::set<llvm::BasicBlock *> Executor::readVisitedBB(std::string fileName) {
-  std::set<int> bbs;
-  std::ifstream in(fileName.c_str());
-  std::string str;
-  while (std::getline(in, str)) {
-    if (!TxSpeculationHelper::trim(str).empty()) {
-      int bb = atoi(str.c_str());
-      bbs.insert(bb);
+void Executor::setVisitedBB(const std::set<int> &bbs) {
+  visitedBlocks.assign(kmodule->numBasicBlocks, false);
+  visitedBlockCount = 0;
+  for (unsigned id = 0, n = basicBlockOrder.size(); id < n; ++id) {
+    if (basicBlockOrder[id] && bbs.find(basicBlockOrder[id]) != bbs.end()) {
+      visitedBlocks[id] = true;
+      ++visitedBlockCount;
     }
   }
-  in.close();
-  std::set<llvm::BasicBlock *> res;
-  for (std::map<llvm::Function *, std::map<llvm::BasicBlock *, int> >::iterator
-           it = fBBOrder.begin(),
-           ie = fBBOrder.end();
-       it != ie; ++it) {
-    for (std::map<llvm::BasicBlock *, int>::iterator it1 = it->second.begin(),
-                                                     ie1 = it->second.end();
-         it1 != ie1; ++it1) {
-      if (bbs.find(it1->second) != bbs.end()) {
-        res.insert(it1->first);
-      }
-    }
-  }
-  return res;
 }
 
 void Executor::run(ExecutionState &initialState) {
-  if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC) {
-    independenceYes = 0;
-    independenceNo = 0;
-    dynamicYes = 0;
-    dynamicNo = 0;
-    specFail = 0;
-    totalSpecFailTime = 0.0;
-    for (std::map<llvm::Instruction *, unsigned int>::iterator
-             it = specSnap.begin(),
-             ie = specSnap.end();
-         it != ie; ++it) {
-      it->second = 0;
-    }
-    // load avoid BB
-    bbOrderToSpecAvoid = readBBOrderToSpecAvoid(DependencyFolder);
-    visitedBlocks = readVisitedBB(DependencyFolder + "/InitialVisitedBB.txt");
-  }
+  if (PartitionCount == 0 || (PartitionCount & (PartitionCount - 1)) ||
+      PartitionIndex >= PartitionCount)
+    klee_error("-partition-count must be a power of two above "
+               "-partition-index");
+#ifdef ENABLE_Z3
+  // The speculation forks are not recorded in the paths of the states
+  if ((!CheckpointDir.empty() || restoredCheckpoint) && INTERPOLATION_ENABLED &&
+      SpecTypeToUse != NO_SPEC)
+    klee_error("checkpoints are not supported with speculation");
+#endif
 
   startingBBPlottingTime = time(0);
   // get interested source code
@@ -4662,6 +5303,8 @@ void Executor::run(ExecutionState &initialState) {
 
   // BB to order
   allBlockCount = 0;
+  basicBlockOrder.assign(kmodule->numBasicBlocks, 0);
+  visitedBlocks.resize(kmodule->numBasicBlocks, false);
   for (std::map<llvm::Function *, KFunction *>::iterator
            it = kmodule->functionMap.begin(),
            ie = kmodule->functionMap.end();
@@ -4677,9 +5320,9 @@ void Executor::run(ExecutionState &initialState) {
     if ((sourceFileName == covInterestedSourceFileName) &&
         isCoverableFunction(f)) {
       // loop over BBs of function
-      std::vector<llvm::BasicBlock *> bbs;
+      unsigned id = kf->instructions[0]->basicBlockId;
       for (llvm::Function::iterator b = f->begin(); b != f->end(); ++b) {
-        fBBOrder[f][b] = ++allBlockCount;
+        basicBlockOrder[id++] = ++allBlockCount;
         if (BBCoverage >= 4) {
           // Print All atomic condition covered
           std::string liveBBFileAICMP =
@@ -4707,19 +5350,49 @@ void Executor::run(ExecutionState &initialState) {
     }
   }
 
+  // The speculation data is loaded after the orders of the basic blocks,
+  // which set the initially-visited blocks and the analyzed blocks
+  if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC) {
+    independenceYes = 0;
+    independenceNo = 0;
+    dynamicYes = 0;
+    dynamicNo = 0;
+    specFail = 0;
+    specThrottled = 0;
+    totalSpecFailTime = 0.0;
+    speculationSites.clear();
+    for (std::map<llvm::Instruction *, unsigned int>::iterator
+             it = specSnap.begin(),
+             ie = specSnap.end();
+         it != ie; ++it) {
+      it->second = 0;
+    }
+    TxSpeculationHelper::initialize(kmodule);
+    // load avoid BB
+    if (SpecDependencyAnalysis)
+      specAvoidance.analyze(kmodule, basicBlockOrder, SpecTypeToUse == SAFETY,
+                            DependencyFolder);
+    else
+      specAvoidance.load(
+          DependencyFolder,
+          interpreterHandler->getOutputFilename("SpecAvoid.bin"));
+    specAvoidance.indexBranches(kmodule, varNamesCache);
+    setVisitedBB(specAvoidance.getInitialVisitedBlocks());
+  }
+
   // first BB of main()
   KInstruction *ki = initialState.pc;
-  BasicBlock *firstBB = ki->inst->getParent();
-  if (fBBOrder.find(firstBB->getParent()) != fBBOrder.end() &&
-      fBBOrder[firstBB->getParent()].find(firstBB) !=
-          fBBOrder[firstBB->getParent()].end()) {
-    processBBCoverage(BBCoverage, ki->inst->getParent(), false);
+  if (basicBlockOrder[ki->basicBlockId]) {
+    processBBCoverage(BBCoverage, ki, false);
   }
   bindModuleConstants();
 
   // Delay init till now so that ticks don't accrue during
   // optimization and such.
   initTimers();
+  if (!CheckpointDir.empty())
+    addTimer(new CheckpointTimer(this), CheckpointInterval);
+  SamplingProfiler::start();
 
   states.insert(&initialState);
 
@@ -4758,6 +5431,7 @@ void Executor::run(ExecutionState &initialState) {
 
       stepInstruction(state);
 
+      SamplingProfiler::setInstruction(ki, state.depth);
       executeInstruction(state, ki);
       processTimers(&state, MaxInstructionTime * numSeeds);
       updateStates(&state);
@@ -4789,8 +5463,7 @@ void Executor::run(ExecutionState &initialState) {
 
     // XXX total hack, just because I like non uniform better but want
     // seed results to be equally weighted.
-    for (std::set<ExecutionState *>::iterator it = states.begin(),
-                                              ie = states.end();
+    for (LiveStates::iterator it = states.begin(), ie = states.end();
          it != ie; ++it) {
       (*it)->weight = 1.;
     }
@@ -4802,11 +5475,14 @@ void Executor::run(ExecutionState &initialState) {
   }
 
   searcher = constructUserSearcher(*this);
+  searcherUpdatesCurrent = searcher->updatesCurrent();
 
   std::vector<ExecutionState *> newStates(states.begin(), states.end());
   searcher->update(0, newStates, std::vector<ExecutionState *>());
 
   while (!states.empty() && !haltExecution) {
+    if (searcher->empty())
+      resumeParkedStates();
     ExecutionState &state = searcher->selectState();
 
 #ifdef ENABLE_Z3
@@ -4814,6 +5490,8 @@ void Executor::run(ExecutionState &initialState) {
       // We synchronize the node id to that of the state. The node id
       // is set only when it was the address of the first instruction
       // in the node.
+      if (AsyncInterpolants)
+        txTree->publishPendingEntries(AsyncInterpolants);
       txTree->setCurrentINode(state);
       if (DebugTracerX)
         llvm::errs() << "[run:setCurrentINode] Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
@@ -4826,8 +5504,10 @@ void Executor::run(ExecutionState &initialState) {
         llvm::raw_string_ostream stream(debugMessage);
         if (debugLevel > 1) {
           stream << "\nCurrent state:\n";
-          processTree->print(stream);
-          stream << "\n";
+          if (processTree) {
+            processTree->print(stream);
+            stream << "\n";
+          }
           txTree->print(stream);
           stream << "\n";
           stream << "--------------------------- Current Node "
@@ -4848,8 +5528,12 @@ void Executor::run(ExecutionState &initialState) {
     }
 #endif
 
+    SamplingProfiler::setInstruction(state.pc, state.depth);
     if (INTERPOLATION_ENABLED &&
-        txTree->subsumptionCheck(solver, state, coreSolverTimeout)) {
+        txTree->subsumptionCheck(solver, state,
+                                 SubsumptionSolverTimeout
+                                     ? SubsumptionSolverTimeout
+                                     : coreSolverTimeout)) {
       terminateStateOnSubsumption(state);
       if (DebugTracerX)
         llvm::errs() << "[run:subsumptionCheck] Pass, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
@@ -4863,9 +5547,11 @@ void Executor::run(ExecutionState &initialState) {
         if (DebugTracerX)
           llvm::errs() << "[run:subsumptionCheck] Fail, Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
       }
+      if (BlockDispatch)
+        executeBlock(state, ki);
       processTimers(&state, MaxInstructionTime);
 
-      checkMemoryUsage();
+      checkMemoryUsage(state);
     }
     updateStates(&state);
   }
@@ -4873,9 +5559,24 @@ void Executor::run(ExecutionState &initialState) {
   delete searcher;
   searcher = 0;
 
+  // The last checkpoint of a halted run, whose remaining states are dumped
+  if (!CheckpointDir.empty())
+    writeCheckpoint();
+
   doDumpStates();
 }
 
+void Executor::writeCheckpoint() {
+  // The timers run before the states of the step are updated
+  std::set<ExecutionState *> live(states.begin(), states.end());
+  live.insert(addedStates.begin(), addedStates.end());
+  for (std::vector<ExecutionState *>::iterator it = removedStates.begin(),
+                                               ie = removedStates.end();
+       it != ie; ++it)
+    live.erase(*it);
+  Checkpoint::save(CheckpointDir, kmodule->module, live);
+}
+
 std::string Executor::getAddressInfo(ExecutionState &state,
                                      ref<Expr> address) const {
   std::string Str;
@@ -4925,6 +5626,8 @@ std::string Executor::getAddressInfo(ExecutionState &state,
 }
 
 void Executor::terminateState(ExecutionState &state) {
+  ProgressEstimator::recordTermination(state.depth);
+
   if (replayKTest && replayPosition != replayKTest->numObjects) {
     klee_warning_once(replayKTest,
                       "replay did not consume all objects in test input.");
@@ -5187,30 +5890,25 @@ void Executor::callExternalFunction(ExecutionState &state, KInstruction *target,
   uint64_t *args =
       (uint64_t *)alloca(2 * sizeof(*args) * (arguments.size() + 1));
   memset(args, 0, 2 * sizeof(*args) * (arguments.size() + 1));
+  // Concretize the symbolic arguments together, rather than with queries
+  // for each of them. Unless AllowExternalSymCalls is set, their values
+  // have to be unique.
+  std::vector<ref<Expr> > concreteArguments(arguments);
+  if (!toConstants(state, concreteArguments, !AllowExternalSymCalls)) {
+    assert(!AllowExternalSymCalls && "FIXME: Unhandled solver failure");
+    terminateStateOnExecError(state,
+                              "external call with symbolic argument: " +
+                                  function->getName());
+    return;
+  }
   unsigned wordIndex = 2;
-  for (std::vector<ref<Expr> >::iterator ai = arguments.begin(),
-                                         ae = arguments.end();
+  for (std::vector<ref<Expr> >::iterator ai = concreteArguments.begin(),
+                                         ae = concreteArguments.end();
        ai != ae; ++ai) {
-    if (AllowExternalSymCalls) { // don't bother checking uniqueness
-      ref<ConstantExpr> ce;
-      bool success = solver->getValue(state, *ai, ce);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      ce->toMemory(&args[wordIndex]);
-      wordIndex += (ce->getWidth() + 63) / 64;
-    } else {
-      ref<Expr> arg = toUnique(state, *ai);
-      if (ConstantExpr *ce = dyn_cast<ConstantExpr>(arg)) {
-        // XXX kick toMemory functions from here
-        ce->toMemory(&args[wordIndex]);
-        wordIndex += (ce->getWidth() + 63) / 64;
-      } else {
-        terminateStateOnExecError(state,
-                                  "external call with symbolic argument: " +
-                                      function->getName());
-        return;
-      }
-    }
+    ConstantExpr *ce = cast<ConstantExpr>(*ai);
+    // XXX kick toMemory functions from here
+    ce->toMemory(&args[wordIndex]);
+    wordIndex += (ce->getWidth() + 63) / 64;
   }
 
   state.addressSpace.copyOutConcretes();
@@ -5266,6 +5964,94 @@ void Executor::callExternalFunction(ExecutionState &state, KInstruction *target,
   }
 }
 
+bool Executor::callNatively(ExecutionState &state, KInstruction *target,
+                            Function *function,
+                            std::vector<ref<Expr> > &arguments) {
+  if (arguments.size() != function->arg_size() ||
+      !nativeCalls->isNative(function))
+    return false;
+  for (std::vector<ref<Expr> >::iterator ai = arguments.begin(),
+                                         ae = arguments.end();
+       ai != ae; ++ai) {
+    if (!isa<ConstantExpr>(*ai))
+      return false;
+  }
+
+  // Only the concrete bytes of the objects are copied to the native memory,
+  // so that the objects the call may access have to be concrete
+  unsigned index = 0;
+  for (Function::arg_iterator ai = function->arg_begin(),
+                              ae = function->arg_end();
+       ai != ae; ++ai, ++index) {
+    if (!ai->getType()->isPointerTy())
+      continue;
+    ref<ConstantExpr> address = cast<ConstantExpr>(arguments[index]);
+    if (address->isZero())
+      continue;
+    ObjectPair op;
+    if (!state.addressSpace.resolveOne(address, op) ||
+        !op.second->isConcrete(0, op.first->size))
+      return false;
+  }
+  const NativeCalls::Closure &closure = nativeCalls->getClosure(function);
+  std::map<GlobalVariable *, uint64_t> globalAddresses;
+  for (std::set<GlobalVariable *>::const_iterator it = closure.globals.begin(),
+                                                  ie = closure.globals.end();
+       it != ie; ++it) {
+    std::map<const llvm::GlobalValue *, MemoryObject *>::iterator mo =
+        globalObjects.find(*it);
+    if (mo == globalObjects.end())
+      return false;
+    const ObjectState *os = state.addressSpace.findObject(mo->second);
+    if (!os || !os->isConcrete(0, mo->second->size))
+      return false;
+    globalAddresses[*it] = mo->second->address;
+  }
+
+  externalDispatcher->addNativeFunction(function, closure.functions,
+                                        globalAddresses);
+
+  uint64_t *args =
+      (uint64_t *)alloca(2 * sizeof(*args) * (arguments.size() + 1));
+  memset(args, 0, 2 * sizeof(*args) * (arguments.size() + 1));
+  unsigned wordIndex = 2;
+  for (std::vector<ref<Expr> >::iterator ai = arguments.begin(),
+                                         ae = arguments.end();
+       ai != ae; ++ai) {
+    ConstantExpr *ce = cast<ConstantExpr>(*ai);
+    ce->toMemory(&args[wordIndex]);
+    wordIndex += (ce->getWidth() + 63) / 64;
+  }
+
+  state.addressSpace.copyOutConcretes();
+
+  // The states are left as they were, and the next copyOutConcretes
+  // overwrites what the call wrote, so that the call is interpreted instead
+  if (!externalDispatcher->executeCall(function, target->inst, args)) {
+    klee_warning_once(function, "cannot run %s natively, interpreting it",
+                      function->getName().str().c_str());
+    return false;
+  }
+
+  ++stats::nativeCalls;
+  if (!state.addressSpace.copyInConcretes()) {
+    terminateStateOnError(state, "native call modified read-only object",
+                          External);
+    return true;
+  }
+
+  LLVM_TYPE_Q Type *resultType = target->inst->getType();
+  if (resultType != Type::getVoidTy(getGlobalContext())) {
+    ref<Expr> e =
+        ConstantExpr::fromMemory((void *)args, getWidthForLLVMType(resultType));
+    bindLocal(target, state, e);
+    if (INTERPOLATION_ENABLED)
+      state.txTreeNode->bindSummaryReturnValue(cast<CallInst>(target->inst),
+                                               arguments, e);
+  }
+  return true;
+}
+
 /***/
 
 ref<Expr> Executor::replaceReadWithSymbolic(ExecutionState &state,
@@ -5296,11 +6082,9 @@ ref<Expr> Executor::replaceReadWithSymbolic(ExecutionState &state,
   if (INTERPOLATION_ENABLED) {
     // We create shadow array as existentially-quantified
     // variables for subsumption checking
-    const Array *shadow = arrayCache.CreateArray(
-        TxShadowArray::getShadowName(arrayName), arrayWidth);
-    TxShadowArray::addShadowArrayMap(array, shadow);
+    TxShadowArray::createShadowArray(arrayCache, array);
     if (DebugTracerX)
-      llvm::errs() << "[replaceReadWithSymbolic:addShadowArrayMap] Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
+      llvm::errs() << "[replaceReadWithSymbolic:createShadowArray] Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
   }
 
   return res;
@@ -5351,95 +6135,143 @@ void Executor::executeAlloc(ExecutionState &state, ref<Expr> size, bool isLocal,
 
       if (reallocFrom) {
         unsigned count = std::min(reallocFrom->size, os->size);
-        for (unsigned i = 0; i < count; i++)
-          os->write(i, reallocFrom->read8(i));
+        os->copy(0, reallocFrom, 0, count);
         state.addressSpace.unbindObject(reallocFrom->getObject());
       }
     }
+  } else if (SymbolicSizeCapacity && !INTERPOLATION_ENABLED) {
+    // The sizes up to the capacity need no concretization
+    ref<Expr> capacity =
+        ConstantExpr::create(SymbolicSizeCapacity, size->getWidth());
+    StatePair bounded = fork(state, UleExpr::create(size, capacity), true);
+    if (bounded.first)
+      executeBoundedAlloc(*bounded.first, size, isLocal, target, zeroMemory,
+                          reallocFrom);
+    if (bounded.second)
+      executeConcretizedAlloc(*bounded.second, size, isLocal, target,
+                              zeroMemory, reallocFrom);
   } else {
-    // XXX For now we just pick a size. Ideally we would support
-    // symbolic sizes fully but even if we don't it would be better to
-    // "smartly" pick a value, for example we could fork and pick the
-    // min and max values and perhaps some intermediate (reasonable
-    // value).
-    //
-    // It would also be nice to recognize the case when size has
-    // exactly two values and just fork (but we need to get rid of
-    // return argument first). This shows up in pcre when llvm
-    // collapses the size expression with a select.
+    executeConcretizedAlloc(state, size, isLocal, target, zeroMemory,
+                            reallocFrom);
+  }
+}
+
+void Executor::executeBoundedAlloc(ExecutionState &state, ref<Expr> size,
+                                   bool isLocal, KInstruction *target,
+                                   bool zeroMemory,
+                                   const ObjectState *reallocFrom) {
+  MemoryObject *mo = memory->allocate(SymbolicSizeCapacity, isLocal, false,
+                                      state.prevPC->inst);
+  if (!mo) {
+    bindLocal(target, state,
+              ConstantExpr::alloc(0, Context::get().getPointerWidth()));
+    return;
+  }
+  mo->symbolicSize = ZExtExpr::create(size, Context::get().getPointerWidth());
 
-    ref<ConstantExpr> example;
-    bool success = solver->getValue(state, size, example);
+  ObjectState *os = bindObjectInState(state, mo, isLocal);
+  if (zeroMemory) {
+    os->initializeToZero();
+  } else {
+    os->initializeToRandom();
+  }
+  bindLocal(target, state, mo->getBaseExpr());
+
+  // The bytes of the old object beyond the new size are copied too, and are
+  // out of the bounds of the new object
+  if (reallocFrom) {
+    unsigned count = std::min(reallocFrom->size, os->size);
+    os->copy(0, reallocFrom, 0, count);
+    state.addressSpace.unbindObject(reallocFrom->getObject());
+  }
+}
+
+void Executor::executeConcretizedAlloc(ExecutionState &state, ref<Expr> size,
+                                       bool isLocal, KInstruction *target,
+                                       bool zeroMemory,
+                                       const ObjectState *reallocFrom) {
+  // XXX For now we just pick a size. Ideally we would support
+  // symbolic sizes fully but even if we don't it would be better to
+  // "smartly" pick a value, for example we could fork and pick the
+  // min and max values and perhaps some intermediate (reasonable
+  // value).
+  //
+  // It would also be nice to recognize the case when size has
+  // exactly two values and just fork (but we need to get rid of
+  // return argument first). This shows up in pcre when llvm
+  // collapses the size expression with a select.
+
+  ref<ConstantExpr> example;
+  bool success = solver->getValue(state, size, example);
+  assert(success && "FIXME: Unhandled solver failure");
+  (void)success;
+
+  // Try and start with a small example.
+  Expr::Width W = example->getWidth();
+  while (example->Ugt(ConstantExpr::alloc(128, W))->isTrue()) {
+    ref<ConstantExpr> tmp = example->LShr(ConstantExpr::alloc(1, W));
+    bool res;
+    bool success = solver->mayBeTrue(state, EqExpr::create(tmp, size), res);
     assert(success && "FIXME: Unhandled solver failure");
     (void)success;
+    if (!res)
+      break;
+    example = tmp;
+  }
 
-    // Try and start with a small example.
-    Expr::Width W = example->getWidth();
-    while (example->Ugt(ConstantExpr::alloc(128, W))->isTrue()) {
-      ref<ConstantExpr> tmp = example->LShr(ConstantExpr::alloc(1, W));
-      bool res;
-      bool success = solver->mayBeTrue(state, EqExpr::create(tmp, size), res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      if (!res)
-        break;
-      example = tmp;
-    }
-
-    StatePair fixedSize = fork(state, EqExpr::create(example, size), true);
+  StatePair fixedSize = fork(state, EqExpr::create(example, size), true);
 
-    if (fixedSize.second) {
-      // Check for exactly two values
-      ref<ConstantExpr> tmp;
-      bool success = solver->getValue(*fixedSize.second, size, tmp);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      bool res;
-      success =
-          solver->mustBeTrue(*fixedSize.second, EqExpr::create(tmp, size), res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void)success;
-      if (res) {
-        executeAlloc(*fixedSize.second, tmp, isLocal, target, zeroMemory,
-                     reallocFrom);
-      } else {
-        // See if a *really* big value is possible. If so assume
-        // malloc will fail for it, so lets fork and return 0.
-        StatePair hugeSize =
-            fork(*fixedSize.second,
-                 UltExpr::create(ConstantExpr::alloc(1 << 31, W), size), true);
-        if (hugeSize.first) {
-          klee_message("NOTE: found huge malloc, returning 0");
-          ref<Expr> result =
-              ConstantExpr::alloc(0, Context::get().getPointerWidth());
-          bindLocal(target, *hugeSize.first, result);
+  if (fixedSize.second) {
+    // Check for exactly two values
+    ref<ConstantExpr> tmp;
+    bool success = solver->getValue(*fixedSize.second, size, tmp);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void)success;
+    bool res;
+    success =
+        solver->mustBeTrue(*fixedSize.second, EqExpr::create(tmp, size), res);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void)success;
+    if (res) {
+      executeAlloc(*fixedSize.second, tmp, isLocal, target, zeroMemory,
+                   reallocFrom);
+    } else {
+      // See if a *really* big value is possible. If so assume
+      // malloc will fail for it, so lets fork and return 0.
+      StatePair hugeSize =
+          fork(*fixedSize.second,
+               UltExpr::create(ConstantExpr::alloc(1 << 31, W), size), true);
+      if (hugeSize.first) {
+        klee_message("NOTE: found huge malloc, returning 0");
+        ref<Expr> result =
+            ConstantExpr::alloc(0, Context::get().getPointerWidth());
+        bindLocal(target, *hugeSize.first, result);
 
-          // Update dependency
-          if (INTERPOLATION_ENABLED) {
-            txTree->execute(target->inst, result);
-            if (DebugTracerX)
-              llvm::errs() << "[executeAlloc:execute] symbolic, Node:" << state.txTreeNode->getNodeSequenceNumber()
-                           << ", Inst:" << target->inst->getOpcodeName()  << "\n";
-          }
+        // Update dependency
+        if (INTERPOLATION_ENABLED) {
+          txTree->execute(target->inst, result);
+          if (DebugTracerX)
+            llvm::errs() << "[executeAlloc:execute] symbolic, Node:" << state.txTreeNode->getNodeSequenceNumber()
+                         << ", Inst:" << target->inst->getOpcodeName()  << "\n";
         }
+      }
 
-        if (hugeSize.second) {
+      if (hugeSize.second) {
 
-          std::string Str;
-          llvm::raw_string_ostream info(Str);
-          ExprPPrinter::printOne(info, "  size expr", size);
-          info << "  concretization : " << example << "\n";
-          info << "  unbound example: " << tmp << "\n";
-          terminateStateOnError(*hugeSize.second, "concretized symbolic size",
-                                Model, NULL, info.str());
-        }
+        std::string Str;
+        llvm::raw_string_ostream info(Str);
+        ExprPPrinter::printOne(info, "  size expr", size);
+        info << "  concretization : " << example << "\n";
+        info << "  unbound example: " << tmp << "\n";
+        terminateStateOnError(*hugeSize.second, "concretized symbolic size",
+                              Model, NULL, info.str());
       }
     }
-
-    if (fixedSize.first) // can be zero when fork fails
-      executeAlloc(*fixedSize.first, example, isLocal, target, zeroMemory,
-                   reallocFrom);
   }
+
+  if (fixedSize.first) // can be zero when fork fails
+    executeAlloc(*fixedSize.first, example, isLocal, target, zeroMemory,
+                 reallocFrom);
 }
 
 void Executor::executeFree(ExecutionState &state, ref<Expr> address,
@@ -5503,6 +6335,7 @@ void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
                                       ref<Expr> address,
                                       ref<Expr> value /* undef if read */,
                                       KInstruction *target) {
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::MemoryOperation);
   Expr::Width type = (isWrite ? value->getWidth()
                               : getWidthForLLVMType(target->inst->getType()));
   unsigned bytes = Expr::getMinBytesForWidth(type);
@@ -5607,13 +6440,26 @@ void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
   // XXX there is some query wasteage here. who cares?
   ExecutionState *unbound = &state;
 
-  for (ResolutionList::iterator i = rl.begin(), ie = rl.end(); i != ie; ++i) {
-    const MemoryObject *mo = i->first;
-    const ObjectState *os = i->second;
-    ref<Expr> inBounds = mo->getBoundsCheckPointer(address, bytes);
+  std::vector<ExecutionState *> batched;
+  if (BatchResolution && rl.size() > 1 &&
+      !branchOnResolution(state, address, bytes, rl, incomplete, batched,
+                          unbound)) {
+    terminateStateEarly(state, "Query timed out (resolve).");
+    return;
+  }
 
-    StatePair branches = fork(*unbound, inBounds, true);
-    ExecutionState *bound = branches.first;
+  for (unsigned i = 0; i < rl.size(); ++i) {
+    const MemoryObject *mo = rl[i].first;
+    const ObjectState *os = rl[i].second;
+    ExecutionState *bound;
+    if (batched.empty()) {
+      ref<Expr> inBounds = mo->getBoundsCheckPointer(address, bytes);
+      StatePair branches = fork(*unbound, inBounds, true);
+      bound = branches.first;
+      unbound = branches.second;
+    } else {
+      bound = batched[i];
+    }
 
     // bound can be 0 on failure or overlapped
     if (bound) {
@@ -5650,8 +6496,7 @@ void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
       }
     }
 
-    unbound = branches.second;
-    if (!unbound)
+    if (batched.empty() && !unbound)
       break;
   }
 
@@ -5681,6 +6526,74 @@ void Executor::executeMemoryOperation(ExecutionState &state, bool isWrite,
   }
 }
 
+bool Executor::branchOnResolution(ExecutionState &state, ref<Expr> address,
+                                  unsigned bytes, const ResolutionList &rl,
+                                  bool incomplete,
+                                  std::vector<ExecutionState *> &bound,
+                                  ExecutionState *&unbound) {
+  SolverPhaseScope solverPhase(BranchPhase);
+
+  // The bounds of distinct objects are disjoint, so the feasible objects
+  // need no constraint of the others excluded
+  std::vector<ref<Expr> > inBounds;
+  std::vector<unsigned> feasible;
+  ref<Expr> anyInBounds = ConstantExpr::alloc(0, Expr::Bool);
+  for (unsigned i = 0; i < rl.size(); ++i) {
+    ref<Expr> e = rl[i].first->getBoundsCheckPointer(address, bytes);
+    std::vector<ref<Expr> > unsatCore;
+    bool infeasible;
+    solver->setTimeout(coreSolverTimeout);
+    bool success = solver->mustBeFalse(state, e, infeasible, unsatCore);
+    solver->setTimeout(0);
+    if (!success)
+      return false;
+    if (infeasible) {
+      if (INTERPOLATION_ENABLED)
+        txTree->markPathCondition(state, unsatCore);
+      continue;
+    }
+    inBounds.push_back(e);
+    feasible.push_back(i);
+    anyInBounds = OrExpr::create(anyInBounds, e);
+  }
+
+  // The state out of bounds of all objects is also feasible when the
+  // resolution was incomplete, for the objects not resolved
+  bool allInBounds = false;
+  if (!incomplete) {
+    std::vector<ref<Expr> > unsatCore;
+    solver->setTimeout(coreSolverTimeout);
+    bool success = solver->mustBeTrue(state, anyInBounds, allInBounds,
+                                      unsatCore);
+    solver->setTimeout(0);
+    if (!success)
+      return false;
+    if (allInBounds && INTERPOLATION_ENABLED)
+      txTree->markPathCondition(state, unsatCore);
+  }
+
+  std::vector<ref<Expr> > conditions(inBounds);
+  if (!allInBounds)
+    conditions.push_back(Expr::createIsZero(anyInBounds));
+
+  std::vector<ExecutionState *> branches;
+  if (conditions.empty()) {
+    // Only with inconsistent constraints, which the solver failed to tell
+    return false;
+  } else if (conditions.size() == 1) {
+    // The only feasible alternative is implied, as with fork
+    branches.push_back(&state);
+  } else {
+    branch(state, conditions, branches);
+  }
+
+  bound.assign(rl.size(), 0);
+  for (unsigned i = 0; i < feasible.size(); ++i)
+    bound[feasible[i]] = branches[i];
+  unbound = allInBounds ? 0 : branches.back();
+  return true;
+}
+
 void Executor::executeMakeSymbolic(ExecutionState &state,
                                    const MemoryObject *mo,
                                    const std::string &name) {
@@ -5690,16 +6603,14 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
     // or if that fails try adding a unique identifier.
     unsigned id = 0;
     std::string uniqueName = name;
-    while (!state.arrayNames.insert(uniqueName).second) {
+    while (!state.arrayNames.mutate().insert(uniqueName).second) {
       uniqueName = name + "_" + llvm::utostr(++id);
     }
     const Array *array = arrayCache.CreateArray(uniqueName, mo->size);
     if (INTERPOLATION_ENABLED) {
       // We create shadow array as existentially-quantified
       // variables for subsumption checking
-      const Array *shadow = arrayCache.CreateArray(
-          TxShadowArray::getShadowName(uniqueName), mo->size);
-      TxShadowArray::addShadowArrayMap(array, shadow);
+      TxShadowArray::createShadowArray(arrayCache, array);
       txTree->executeMakeSymbolic(state.prevPC->inst, mo->getBaseExpr(), array);
       if (DebugTracerX)
         llvm::errs() << "[executeMakeSymbolic:executeMakeSymbolic] Node:" << state.txTreeNode->getNodeSequenceNumber() << "\n";
@@ -5733,7 +6644,7 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
                 obj->numBytes < mo->size) ||
                (!AllowSeedTruncation && obj->numBytes > mo->size))) {
             std::stringstream msg;
-            msg << "replace size mismatch: " << mo->name << "[" << mo->size
+            msg << "replace size mismatch: " << mo->getName() << "[" << mo->size
                 << "]"
                 << " vs " << obj->name << "[" << obj->numBytes << "]"
                 << " in test\n";
@@ -5761,8 +6672,7 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
       if (obj->numBytes != mo->size) {
         terminateStateOnError(state, "replay size mismatch", User);
       } else {
-        for (unsigned i = 0; i < mo->size; i++)
-          os->write8(i, obj->bytes[i]);
+        os->writeConcrete(0, obj->bytes, mo->size);
       }
     }
   }
@@ -5772,6 +6682,11 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
 
 void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
                                  char **envp) {
+  // The caller may have looked up the function in the module given to
+  // setModule, rather than in the prepared module.
+  if (f->getParent() != kmodule->module)
+    f = kmodule->module->getFunction(f->getName());
+  assert(f && "entry function is missing from the prepared module");
 
   std::vector<ref<Expr> > arguments;
 
@@ -5839,15 +6754,14 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
         argvOS->write(i * NumPtrBytes, Expr::createPointer(0));
       } else {
         char *s = i < argc ? argv[i] : envp[i - (argc + 1)];
-        int j, len = strlen(s);
+        int len = strlen(s);
 
         MemoryObject *arg =
             memory->allocate(len + 1, false, true, state->pc->inst);
         if (!arg)
           klee_error("Could not allocate memory for function arguments");
         ObjectState *os = bindObjectInState(*state, arg, false);
-        for (j = 0; j < len + 1; j++)
-          os->write8(j, s[j]);
+        os->writeConcrete(0, (const uint8_t *)s, len + 1);
 
         // Write pointer to newly allocated and initialised argv/envp c-string
         argvOS->write(i * NumPtrBytes, arg->getBaseExpr());
@@ -5857,23 +6771,77 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
 
   initializeGlobals(*state);
 
-  processTree = new PTree(state);
-  state->ptreeNode = processTree->root;
+  if (!PriorIStats.empty())
+    PriorProfile::load(PriorIStats, kmodule);
+
+  // The interpolation tree has the same structure, and replaces the process
+  // tree under interpolation
+  if (!INTERPOLATION_ENABLED) {
+    processTree = new PTree(state);
+    state->ptreeNode = processTree->root;
+  }
 
   if (INTERPOLATION_ENABLED) {
+    TxVersionedValues::initialize(kmodule);
+#ifdef ENABLE_Z3
+    if (SubsumptionPoints != ALL_POINTS) {
+      unsigned char kinds = KModule::LoopHeader | KModule::FunctionEntry;
+      if (SubsumptionPoints == JOIN_POINTS)
+        kinds |= KModule::JoinPoint;
+      TxTreeNode::subsumptionPoints.resize(kmodule->numBasicBlocks);
+      for (unsigned i = 0; i < kmodule->numBasicBlocks; ++i)
+        TxTreeNode::subsumptionPoints[i] =
+            (kmodule->basicBlockKinds[i] & kinds) ||
+            PriorProfile::getForks(i) > 0;
+    }
+    if (LoopEntryGeneralization) {
+      TxTreeNode::loopHeaders.resize(kmodule->numBasicBlocks);
+      for (unsigned i = 0; i < kmodule->numBasicBlocks; ++i)
+        TxTreeNode::loopHeaders[i] =
+            kmodule->basicBlockKinds[i] & KModule::LoopHeader;
+    }
+#endif
     txTree = new TxTree(state, kmodule->targetData, &globalAddresses);
     state->txTreeNode = txTree->root;
-    TxTreeGraph::initialize(txTree->root);
+#ifdef ENABLE_Z3
+    if (!SubsumptionTableFile.empty())
+      TxTableFile::load(SubsumptionTableFile, kmodule->module, arrayCache);
+    if (LogSubsumptionQueries)
+      TxSubsumptionTableEntry::setQueryLog(
+          interpreterHandler->openOutputFile("subsumption-queries.kquery"));
+#endif
+    TxTreeGraph::initialize(txTree->root,
+                            interpreterHandler->getOutputFilename("tree.dot"));
     if (DebugTracerX)
       llvm::errs() << "[runFunctionAsMain:initialize]\n";
   }
 
+  if (!RestoreCheckpoint.empty()) {
+    restoredCheckpoint =
+        Checkpoint::load(RestoreCheckpoint, kmodule->module, arrayCache);
+    if (restoredCheckpoint)
+      state->checkpointNode = restoredCheckpoint->getRoot();
+  }
+
   run(*state);
+  if (SamplingProfiler::enabled()) {
+    SamplingProfiler::stop();
+    llvm::raw_ostream *os = interpreterHandler->openOutputFile("profile.folded");
+    if (os) {
+      SamplingProfiler::write(*os);
+      delete os;
+    }
+  }
   delete processTree;
   processTree = 0;
 
   if (INTERPOLATION_ENABLED) {
-    TxTreeGraph::save(interpreterHandler->getOutputFilename("tree.dot"));
+    txTree->publishPendingEntries();
+#ifdef ENABLE_Z3
+    if (!SubsumptionTableFile.empty())
+      TxTableFile::save(SubsumptionTableFile, kmodule->module);
+#endif
+    TxTreeGraph::save();
     TxTreeGraph::deallocate();
     if (DebugTracerX)
       llvm::errs() << "[runFunctionAsMain:save]\n";
@@ -5882,8 +6850,11 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
     txTree = 0;
 
 #ifdef ENABLE_Z3
+    TxSubsumptionTableEntry::setQueryLog(0);
+
     // Print interpolation time statistics
     interpreterHandler->assignSubsumptionStats(TxTree::getInterpolationStat());
+    Z3Simplification::deallocate();
 #endif
   }
 
@@ -5910,13 +6881,10 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
     unsigned int statsTrackerTotal = 0;
     unsigned int statsTrackerFail = 0;
     unsigned int statsTrackerSucc = 0;
-    for (std::map<llvm::BasicBlock *, std::vector<unsigned int> >::iterator
-             it = StatsTracker::bbSpecCount.begin(),
-             ie = StatsTracker::bbSpecCount.end();
-         it != ie; ++it) {
-      statsTrackerTotal += it->second[0];
-      statsTrackerFail += it->second[1];
-      statsTrackerSucc += it->second[2];
+    for (unsigned i = 0; i + 2 < StatsTracker::bbSpecCount.size(); i += 3) {
+      statsTrackerTotal += StatsTracker::bbSpecCount[i];
+      statsTrackerFail += StatsTracker::bbSpecCount[i + 1];
+      statsTrackerSucc += StatsTracker::bbSpecCount[i + 2];
     }
     outSpec << "StatsTracker Total: " << statsTrackerTotal << "\n";
     outSpec << "StatsTracker Fail: " << statsTrackerFail << "\n";
@@ -5972,6 +6940,33 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
     outSpec << "Total speculation fail time: "
             << totalSpecFailTime / double(CLOCKS_PER_SEC) << "\n";
 
+    if (SpecBackoff) {
+      outSpec << "Total speculations skipped by backoff: " << specThrottled
+              << "\n";
+      // The branches by their time spent in failed speculation subtrees
+      std::vector<std::pair<double, llvm::Instruction *> > sites;
+      for (std::map<llvm::Instruction *, SpeculationSite>::iterator
+               it = speculationSites.begin(),
+               ie = speculationSites.end();
+           it != ie; ++it) {
+        if (it->second.failureCount)
+          sites.push_back(std::make_pair(it->second.failTime, it->first));
+      }
+      std::sort(sites.rbegin(), sites.rend());
+      outSpec << "Speculation branches by fail time (attempts, failures, "
+                 "skipped, seconds):\n";
+      for (std::vector<std::pair<double, llvm::Instruction *> >::iterator
+               it = sites.begin(),
+               ie = sites.end();
+           it != ie; ++it) {
+        const SpeculationSite &site = speculationSites[it->second];
+        const InstructionInfo &info = kmodule->infos->getInfo(it->second);
+        outSpec << info.file << ":" << info.line << " " << site.attemptCount
+                << " " << site.failureCount << " " << site.skipCount << " "
+                << site.failTime / double(CLOCKS_PER_SEC) << "\n";
+      }
+    }
+
     // print frequency of failure at each program point
     outSpec << "Frequency of failures because New BB with no interpolation:\n";
     for (std::map<uintptr_t, unsigned int>::iterator
@@ -5996,13 +6991,13 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
         << "\n";
     interpreterHandler->getInfoStream()
         << "KLEE: done: Total number of single time Visited Basic Blocks: "
-        << visitedBlocks.size() << "\n";
+        << visitedBlockCount << "\n";
     interpreterHandler->getInfoStream()
         << "KLEE: done: Total number of Basic Blocks: " << allBlockCount
         << "\n";
     llvm::errs()
         << "KLEE: done: Total number of single time Visited Basic Blocks: "
-        << visitedBlocks.size() << "\n";
+        << visitedBlockCount << "\n";
     llvm::errs() << "KLEE: done: Total number of Basic Blocks: "
                  << allBlockCount << "\n";
     llvm::errs()
@@ -6010,18 +7005,16 @@ void Executor::runFunctionAsMain(Function *f, int argc, char **argv,
         << "\n";
   }
   if (BBCoverage >= 2) {
+    coverageLogger->finish();
+
     // VisitedBB.txt
     std::string visitedBBFile =
         interpreterHandler->getOutputFilename("VisitedBB.txt");
     std::ofstream visitedBBFileOut(visitedBBFile.c_str(), std::ofstream::app);
 
-    for (std::set<llvm::BasicBlock *>::iterator it = visitedBlocks.begin(),
-                                                ie = visitedBlocks.end();
-         it != ie; ++it) {
-
-      int order = fBBOrder[(*it)->getParent()][*it];
-      std::string functionName = ((*it)->getParent())->getName();
-      visitedBBFileOut << order << "\n";
+    for (unsigned id = 0, n = visitedBlocks.size(); id < n; ++id) {
+      if (visitedBlocks[id])
+        visitedBBFileOut << basicBlockOrder[id] << "\n";
     }
 
     visitedBBFileOut.close();
@@ -6111,6 +7104,10 @@ void Executor::getConstraintLog(const ExecutionState &state, std::string &res,
 bool Executor::getSymbolicSolution(
     const ExecutionState &state,
     std::vector<std::pair<std::string, std::vector<unsigned char> > > &res) {
+  if (ReuseStateModel && getStateModelSolution(state, res))
+    return true;
+
+  SolverPhaseScope solverPhase(TestGenerationPhase);
   solver->setTimeout(coreSolverTimeout);
 
   ExecutionState tmp(state);
@@ -6122,10 +7119,11 @@ bool Executor::getSymbolicSolution(
   // the preferred constraints.  See test/Features/PreferCex.c for
   // an example) While this process can be very expensive, it can
   // also make understanding individual test cases much easier.
-  for (unsigned i = 0; i != state.symbolics.size(); ++i) {
-    const MemoryObject *mo = state.symbolics[i].first;
-    std::vector<ref<Expr> >::const_iterator pi = mo->cexPreferences.begin(),
-                                            pie = mo->cexPreferences.end();
+  for (unsigned i = 0; i != state.symbolics->size(); ++i) {
+    const MemoryObject *mo = (*state.symbolics)[i].first;
+    const std::vector<ref<Expr> > &preferences = mo->getCexPreferences();
+    std::vector<ref<Expr> >::const_iterator pi = preferences.begin(),
+                                            pie = preferences.end();
     for (; pi != pie; ++pi) {
       bool mustBeTrue;
       // Attempt to bound byte to constraints held in cexPreferences
@@ -6149,8 +7147,8 @@ bool Executor::getSymbolicSolution(
   std::vector<std::vector<unsigned char> > values;
   std::vector<const Array *> objects;
   std::vector<ref<Expr> > unsatCore;
-  for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    objects.push_back(state.symbolics[i].second);
+  for (unsigned i = 0; i != state.symbolics->size(); ++i)
+    objects.push_back((*state.symbolics)[i].second);
   bool success = solver->getInitialValues(tmp, objects, values, unsatCore);
   solver->setTimeout(0);
   if (!success) {
@@ -6160,22 +7158,53 @@ bool Executor::getSymbolicSolution(
     return false;
   }
 
-  for (unsigned i = 0; i != state.symbolics.size(); ++i)
-    res.push_back(std::make_pair(state.symbolics[i].first->name, values[i]));
+  for (unsigned i = 0; i != state.symbolics->size(); ++i)
+    res.push_back(
+        std::make_pair((*state.symbolics)[i].first->getName(), values[i]));
+  return true;
+}
+
+bool Executor::getStateModelSolution(
+    const ExecutionState &state,
+    std::vector<std::pair<std::string, std::vector<unsigned char> > > &res) {
+  if (state.model->bindings.empty())
+    return false;
+
+  // The model may be of the path condition before some of its constraints
+  // were added, and the counterexample preferences are all to hold, as the
+  // solver would try to satisfy them
+  Assignment model(*state.model);
+  if (!model.satisfies(state.constraints.begin(), state.constraints.end()))
+    return false;
+  for (unsigned i = 0; i != state.symbolics->size(); ++i) {
+    const MemoryObject *mo = (*state.symbolics)[i].first;
+    const std::vector<ref<Expr> > &preferences = mo->getCexPreferences();
+    if (!model.satisfies(preferences.begin(), preferences.end()))
+      return false;
+  }
+
+  // The arrays not in the model are not constrained
+  for (unsigned i = 0; i != state.symbolics->size(); ++i) {
+    const Array *array = (*state.symbolics)[i].second;
+    Assignment::bindings_ty::const_iterator it = model.bindings.find(array);
+    res.push_back(std::make_pair(
+        (*state.symbolics)[i].first->getName(),
+        it != model.bindings.end() ? it->second
+                                   : std::vector<unsigned char>(array->size,
+                                                                0)));
+  }
+  ++stats::reusedTestModels;
   return true;
 }
 
 void Executor::getCoveredLines(
     const ExecutionState &state,
     std::map<const std::string *, std::set<unsigned> > &res) {
-  res = state.coveredLines;
+  res = *state.coveredLines;
 }
 
 void Executor::doImpliedValueConcretization(ExecutionState &state, ref<Expr> e,
                                             ref<ConstantExpr> value) {
-
-  abort(); // FIXME: Broken until we sort out how to do the write back.
-
   if (DebugCheckForImpliedValues)
     ImpliedValue::checkForImpliedValues(solver->solver, e, value);
 
@@ -6184,24 +7213,36 @@ void Executor::doImpliedValueConcretization(ExecutionState &state, ref<Expr> e,
   for (ImpliedValueList::iterator it = results.begin(), ie = results.end();
        it != ie; ++it) {
     ReadExpr *re = it->first.get();
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index);
+    // Only the reads of the initial contents of a symbolic array are known
+    // to be of the object made symbolic with it
+    if (!CE || re->updates.head || re->getWidth() != Expr::Int8)
+      continue;
 
-    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index)) {
-      // FIXME: This is the sole remaining usage of the Array object
-      // variable. Kill me.
-      const MemoryObject *mo = 0; // re->updates.root->object;
-      const ObjectState *os = state.addressSpace.findObject(mo);
+    unsigned index = CE->getZExtValue(32);
+    std::pair<const Array *, unsigned> byte(re->updates.root, index);
+    if (state.impliedBytes->count(byte))
+      continue;
+    state.impliedBytes.mutate().insert(byte);
 
-      if (!os) {
-        // object has been free'd, no need to concretize (although as
-        // in other cases we would like to concretize the outstanding
-        // reads, but we have no facility for that yet)
-      } else {
-        assert(!os->readOnly &&
-               "not possible? read only object with static read?");
-        ObjectState *wos = state.addressSpace.getWriteable(mo, os);
-        wos->write(CE, it->second);
+    const MemoryObject *mo = 0;
+    for (unsigned i = 0; i < state.symbolics->size(); ++i) {
+      if ((*state.symbolics)[i].second == re->updates.root) {
+        mo = (*state.symbolics)[i].first;
+        break;
       }
     }
+    if (!mo)
+      continue;
+
+    // The object may have been freed, or the byte overwritten since it was
+    // made symbolic, in which case the value is only a fact of the array
+    const ObjectState *os = state.addressSpace.findObject(mo);
+    if (!os || os->readOnly || index >= os->size ||
+        os->read8(index) != ref<Expr>(re))
+      continue;
+    ObjectState *wos = state.addressSpace.getWriteable(mo, os);
+    wos->write(index, it->second);
   }
 }
 
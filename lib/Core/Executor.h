@@ -21,6 +21,8 @@
 #include "klee/Internal/Module/KModule.h"
 #include "klee/Interpreter.h"
 #include "klee/util/ArrayCache.h"
+#include "LiveStates.h"
+#include "TxSpeculation.h"
 #include "llvm/ADT/Twine.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Support/raw_ostream.h"
@@ -55,7 +57,11 @@ class Value;
 namespace klee {
 class Array;
 struct Cell;
+class Checkpoint;
+class CoverageLogger;
 class ExecutionState;
+class FunctionSummaries;
+class NativeCalls;
 class ExternalDispatcher;
 class Expr;
 class InstructionInfoTable;
@@ -84,6 +90,7 @@ template <class T> class ref;
 
 class Executor : public Interpreter {
   friend class BumpMergingSearcher;
+  friend class LoopMergingSearcher;
   friend class MergingSearcher;
   friend class RandomPathSearcher;
   friend class OwningSearcher;
@@ -97,13 +104,22 @@ public:
   int allICMPCount;
   int coveredICMPCount;
   bool allBlockCollected;
-  std::set<llvm::BasicBlock *> visitedBlocks;
+  /// Whether each basic block was visited, by KInstruction::basicBlockId
+  std::vector<bool> visitedBlocks;
+  /// The number of the visited basic blocks
+  unsigned visitedBlockCount;
   float blockCoverage;
   std::string covInterestedSourceFileName;
-  std::map<llvm::Function *, std::map<llvm::BasicBlock *, int> > fBBOrder;
+  /// The order of each basic block of the source file of interest among
+  /// the blocks measured for coverage, by KInstruction::basicBlockId, or
+  /// 0 for the blocks that are not measured
+  std::vector<int> basicBlockOrder;
 
-  std::map<int, std::set<std::string> > bbOrderToSpecAvoid; // used in the
-                                                            // speculation mode.
+  TxSpeculationAvoidance specAvoidance; // used in the speculation mode.
+
+  /// The variable names of the values, memoized by extractVariables as they
+  /// only depend on the program
+  std::map<llvm::Value *, std::set<std::string> > varNamesCache;
   int independenceYes;
   int independenceNo;
   int dynamicYes;
@@ -112,6 +128,28 @@ public:
   // int specSnap;
   std::map<llvm::Instruction *, unsigned int> specSnap;
   int specFail;
+
+  /// The speculation record of a branch under -spec-backoff: the numbers of
+  /// speculations and of failures, the consecutive failures, the current gap
+  /// in speculations, the speculations still to skip, the skipped ones, and
+  /// the time spent in the failed subtrees, in clock ticks
+  struct SpeculationSite {
+    unsigned attemptCount;
+    unsigned failureCount;
+    unsigned consecutiveFailureCount;
+    unsigned gap;
+    unsigned countdown;
+    unsigned skipCount;
+    bool failedSinceAttempt;
+    double failTime;
+
+    SpeculationSite()
+        : attemptCount(0), failureCount(0), consecutiveFailureCount(0),
+          gap(0), countdown(0), skipCount(0), failedSinceAttempt(false),
+          failTime(0.0) {}
+  };
+  std::map<llvm::Instruction *, SpeculationSite> speculationSites;
+  int specThrottled;
   std::map<uintptr_t, unsigned int> specFailNew;     // fail because of new BB
   std::map<uintptr_t, unsigned int> specFailNoInter; // fail because of new BB &
                                                      // no interpolant
@@ -134,6 +172,26 @@ public:
 
   typedef std::pair<ExecutionState *, ExecutionState *> StatePair;
 
+  /// The bytes counted by the subsystems of the executor, which are cheap
+  /// to read, unlike the usage of the allocator. \see checkMemoryUsage()
+  struct MemoryBreakdown {
+    /// The expressions, including those in the solver caches
+    uint64_t expressions;
+    /// The object states of the address spaces, with their pages
+    uint64_t objectStates;
+    /// The objects of the interpolation tree allocated in arenas
+    uint64_t txTree;
+    /// The estimated size of the subsumption table entries
+    uint64_t subsumptionTable;
+    /// The deterministic allocations of the program
+    uint64_t deterministic;
+
+    uint64_t getTotal() const {
+      return expressions + objectStates + txTree + subsumptionTable +
+             deterministic;
+    }
+  };
+
   enum TerminateReason {
     Abort,
     Assert,
@@ -158,10 +216,14 @@ private:
   InterpreterHandler *interpreterHandler;
   Searcher *searcher;
 
+  /// Whether the searcher is updated after the steps that do not change the
+  /// states, as given by its updatesCurrent
+  bool searcherUpdatesCurrent;
+
   ExternalDispatcher *externalDispatcher;
   TimingSolver *solver;
   MemoryManager *memory;
-  std::set<ExecutionState *> states;
+  LiveStates states;
   StatsTracker *statsTracker;
   TreeStreamWriter *pathWriter, *symPathWriter;
   SpecialFunctionHandler *specialFunctionHandler;
@@ -181,6 +243,11 @@ private:
   /// \invariant \ref addedStates and \ref removedStates are disjoint.
   std::vector<ExecutionState *> removedStates;
 
+  /// States taken out of the searcher at the memory cap, which stay
+  /// parked until memory is available again. \see checkMemoryUsage()
+  /// \invariant \ref parkedStates is a subset of \ref states.
+  std::set<ExecutionState *> parkedStates;
+
   /// When non-empty the Executor is running in "seed" mode. The
   /// states in this map will be executed in an arbitrary order
   /// (outside the normal search interface) until they terminate. When
@@ -218,6 +285,15 @@ private:
   /// needed to control memory usage. \see fork()
   bool atMemoryLimit;
 
+  /// The usage of the allocator at its last measurement, and the counted
+  /// memory of the subsystems then. Between the measurements the usage is
+  /// estimated from the change of the counted memory. \see checkMemoryUsage()
+  uint64_t lastMallocUsage, lastCountedUsage;
+
+  /// The number of memory checks since the last measurement of the usage of
+  /// the allocator
+  unsigned checksSinceMallocUsage;
+
   /// Disables forking, set by client. \see setInhibitForking()
   bool inhibitForking;
 
@@ -225,8 +301,9 @@ private:
   /// step.
   bool haltExecution;
 
-  /// Whether implied-value concretization is enabled. Currently
-  /// false, it is buggy (it needs to validate its writes).
+  /// Whether implied-value concretization is enabled, with
+  /// -implied-value-concretization. The values are only written over the
+  /// bytes of the symbolic objects that still read their initial array.
   bool ivcEnabled;
 
   /// The maximum time to allow for a single core solver query.
@@ -239,6 +316,19 @@ private:
   /// File to print executed instructions to
   llvm::raw_ostream *debugInstFile;
 
+  /// Sink of the live basic block coverage records of -write-BB-cov
+  CoverageLogger *coverageLogger;
+
+  /// The return values of the calls of pure functions of -function-summaries
+  FunctionSummaries *functionSummaries;
+
+  /// The functions whose concrete calls are run natively with
+  /// -native-concrete-calls
+  NativeCalls *nativeCalls;
+
+  /// The checkpoint of -restore-checkpoint, whose paths the states follow
+  Checkpoint *restoredCheckpoint;
+
   // @brief Buffer used by logBuffer
   std::string debugBufferString;
 
@@ -250,6 +340,15 @@ private:
 
   void executeInstruction(ExecutionState &state, KInstruction *ki);
 
+  /// Execute the instructions following the executed instruction in its
+  /// basic block, without the bookkeeping of the executor between them,
+  /// until the state calls, leaves the block, or changes the states
+  void executeBlock(ExecutionState &state, KInstruction *ki);
+
+  /// Execute the conditional branch at the program counter of the state,
+  /// fused with the concrete comparison on which it branches
+  void executeConcreteBranch(ExecutionState &state, bool taken);
+
   void printFileLine(ExecutionState &state, KInstruction *ki,
                      llvm::raw_ostream &file);
 
@@ -262,10 +361,8 @@ private:
            (f->getName() != "memcpy") && (f->getName() != "memmove") &&
            (f->getName() != "mempcpy") && (f->getName() != "memset");
   }
-  std::map<int, std::set<std::string> >
-  readBBOrderToSpecAvoid(std::string folderName);
-  std::pair<int, std::set<std::string> > readBBSpecAvoid(std::string fileName);
-  std::set<llvm::BasicBlock *> readVisitedBB(std::string fileName);
+  /// Mark as visited the basic blocks of the given orders
+  void setVisitedBB(const std::set<int> &bbs);
   // end functions used in speculation mode.
 
   // Given a concrete object in our [klee's] address space, add it to
@@ -281,13 +378,22 @@ private:
   void updateStates(ExecutionState *current);
   void transferToBasicBlock(llvm::BasicBlock *dst, llvm::BasicBlock *src,
                             ExecutionState &state);
-  void processBBCoverage(int BBCoverage, llvm::BasicBlock *bb,
+  /// Record the coverage of the basic block of the given first
+  /// instruction
+  void processBBCoverage(int BBCoverage, KInstruction *entry,
                          bool isInSpecMode);
 
   void callExternalFunction(ExecutionState &state, KInstruction *target,
                             llvm::Function *function,
                             std::vector<ref<Expr> > &arguments);
 
+  /// Run the call of the function of the module natively, or return false
+  /// if it has to be interpreted as its arguments or the objects it may
+  /// access are not concrete
+  bool callNatively(ExecutionState &state, KInstruction *target,
+                    llvm::Function *function,
+                    std::vector<ref<Expr> > &arguments);
+
   ObjectState *bindObjectInState(ExecutionState &state, const MemoryObject *mo,
                                  bool isLocal, const Array *array = 0);
 
@@ -324,6 +430,19 @@ private:
                     KInstruction *target, bool zeroMemory = false,
                     const ObjectState *reallocFrom = 0);
 
+  /// Allocate an object of a symbolic size of at most
+  /// -symbolic-size-capacity bytes, with the capacity and the size as its
+  /// bound.
+  void executeBoundedAlloc(ExecutionState &state, ref<Expr> size,
+                           bool isLocal, KInstruction *target, bool zeroMemory,
+                           const ObjectState *reallocFrom);
+
+  /// Allocate an object of a symbolic size by concretizing the size.
+  void executeConcretizedAlloc(ExecutionState &state, ref<Expr> size,
+                               bool isLocal, KInstruction *target,
+                               bool zeroMemory,
+                               const ObjectState *reallocFrom);
+
   /// Free the given address with checking for errors. If target is
   /// given it will be bound to 0 in the resulting states (this is a
   /// convenience for realloc). Note that this function can cause the
@@ -335,6 +454,20 @@ private:
   void executeCall(ExecutionState &state, KInstruction *ki, llvm::Function *f,
                    std::vector<ref<Expr> > &arguments);
 
+  /// Fork the state of an access of the given number of bytes at a pointer
+  /// resolving to the objects of the list at once, with -batch-resolution.
+  /// The objects in bounds are decided against the constraints of the
+  /// state, which are the same for all of them, and then one state per
+  /// feasible object is made with a single branch. The states are given in
+  /// the order of the list, null for the infeasible objects, and the state
+  /// out of bounds of all objects, or null. Returns false on a solver
+  /// failure, with the state unchanged.
+  bool branchOnResolution(ExecutionState &state, ref<Expr> address,
+                          unsigned bytes, const ResolutionList &rl,
+                          bool incomplete,
+                          std::vector<ExecutionState *> &bound,
+                          ExecutionState *&unbound);
+
   // do address resolution / object binding / out of bounds checking
   // and perform the operation
   void executeMemoryOperation(ExecutionState &state, bool isWrite,
@@ -352,17 +485,61 @@ private:
   void branch(ExecutionState &state, const std::vector<ref<Expr> > &conditions,
               std::vector<ExecutionState *> &result);
 
+  /// Keep the last model of the counterexample cache with the state under
+  /// -reuse-state-model, if it satisfies the condition just added to the
+  /// path condition of the state.
+  void keepStateModel(ExecutionState &state, ref<Expr> condition);
+
+  /// Give the test case of the state from its kept model, if the model
+  /// satisfies its path condition and the counterexample preferences.
+  bool getStateModelSolution(
+      const ExecutionState &state,
+      std::vector<std::pair<std::string, std::vector<unsigned char> > > &res);
+
+  /// Compute the feasible successors of a switch on the symbolic value, with
+  /// their branch conditions, under -switch-model-enumeration: a model of the
+  /// value among the successors not found feasible yet gives a feasible
+  /// successor, until none remains. The successors are in the order of their
+  /// case values, the default destination last.
+  void getFeasibleSwitchTargets(
+      ExecutionState &state, ref<Expr> value, llvm::BasicBlock *defaultDest,
+      const std::map<ref<Expr>, llvm::BasicBlock *> &caseTargets,
+      std::vector<llvm::BasicBlock *> &targets,
+      std::map<llvm::BasicBlock *, ref<Expr> > &targetConditions);
+
   // Fork current and return states in which condition holds / does
   // not hold, respectively. One of the states is necessarily the
   // current state, and one of the states may be null.
   StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal);
 
+  // Under -partition-count, terminate the side of a symbolic fork that is
+  // explored by another process, nulling its pointer. Returns true if a side
+  // was dropped.
+  bool partitionFork(ExecutionState *&trueState, ExecutionState *&falseState);
+
+  // Record the choice of a fork on the path of the state, for the
+  // checkpoints. Within a restored checkpoint, a side that no recorded path
+  // takes was explored before the checkpoint, and the state is terminated.
+  // Returns false if the state was terminated.
+  bool followForkChoice(ExecutionState &state, unsigned choice);
+
+  // followForkChoice for the sides of a two-way fork, nulling the pointers
+  // of the terminated sides. Returns true if both sides remain.
+  bool followForkChoices(ExecutionState *&trueState,
+                         ExecutionState *&falseState);
+
+  // Whether the next branch is to follow the replay path. Under
+  // -replay-path-prefix, this holds only until the path is exhausted.
+  bool followsReplayPath() const;
+
   // used in speculation mode
   StatePair branchFork(ExecutionState &current, ref<Expr> condition,
                        bool isInternal);
 
-  std::set<std::string> extractVarNames(ExecutionState &current,
-                                        llvm::Value *v);
+  /// The ids of the variables of the branch, looked up in the table of
+  /// specAvoidance
+  const TxSpeculationAvoidance::Bitset &
+  extractVariables(ExecutionState &current, llvm::Value *v);
 
   // Generally the nodes are in normal mode. In case an infeasible path
   // is found, an speculation node is generated for the infeasible path
@@ -370,12 +547,20 @@ private:
   // node will be continued in speculationFork.
   StatePair addSpeculationNode(ExecutionState &current, ref<Expr> condition,
                                llvm::Instruction *binst, bool isInternal,
-                               bool falseBranchIsInfeasible);
+                               bool falseBranchIsInfeasible,
+                               std::vector<ref<Expr> > &unsatCore);
+
+  /// Whether the speculation at the branch is skipped under -spec-backoff,
+  /// counting the attempt otherwise
+  bool isSpeculationThrottled(llvm::Instruction *binst);
 
   void speculativeBackJump(ExecutionState &current);
   bool checkSpeculation(ExecutionState &current);
 
-  std::vector<TxTreeNode *> collectSpeculationNodes(TxTreeNode *);
+  /// Mark the nodes of a speculation subtree as failed, and collect the live
+  /// states at its leaves.
+  void collectSpeculationStates(TxTreeNode *root,
+                                std::vector<ExecutionState *> &result);
 
   // Speculation fork performs fork in the speculation mode.
   StatePair speculationFork(ExecutionState &current, ref<Expr> condition,
@@ -395,11 +580,11 @@ private:
                    ExecutionState &state) const;
 
   Cell &getArgumentCell(ExecutionState &state, KFunction *kf, unsigned index) {
-    return state.stack.back().locals[kf->getArgRegister(index)];
+    return state.stack.back().getWriteableLocal(kf->getArgRegister(index));
   }
 
   Cell &getDestCell(ExecutionState &state, KInstruction *target) {
-    return state.stack.back().locals[target->dest];
+    return state.stack.back().getWriteableLocal(target->dest);
   }
 
   void bindLocal(KInstruction *target, ExecutionState &state, ref<Expr> value);
@@ -408,11 +593,25 @@ private:
 
   ref<klee::ConstantExpr> evalConstantExpr(const llvm::ConstantExpr *ce);
 
+  /// Get a value of the expression in the state, and whether it is the only
+  /// one, looking it up first among the unique values of the state under
+  /// -cache-unique-values.
+  bool getUniqueValue(const ExecutionState &state, ref<Expr> e,
+                      ref<klee::ConstantExpr> &value, bool &isUnique);
+
   /// Return a unique constant value for the given expression in the
   /// given state, if it has one (i.e. it provably only has a single
   /// value). Otherwise return the original expression.
   ref<Expr> toUnique(const ExecutionState &state, ref<Expr> &e);
 
+  /// Replace the non-constant expressions of the vector by values from a
+  /// single model of the given state, with one solver query for all of
+  /// them. If unique is set, fail unless these are the only values they can
+  /// have, which is checked by one more query. Return false on failure,
+  /// leaving the vector unchanged.
+  bool toConstants(const ExecutionState &state,
+                   std::vector<ref<Expr> > &values, bool unique);
+
   /// Return a constant value for the given expression, forcing it to
   /// be constant in the given state by adding a constraint if
   /// necessary. Note that this function breaks completeness and
@@ -485,16 +684,27 @@ private:
 
   void initTimers();
   void processTimers(ExecutionState *current, double maxInstTime);
-  void checkMemoryUsage();
+  void checkMemoryUsage(ExecutionState &current);
+  /// Take up to count states other than the current one out of the
+  /// searcher, leaving at least one state in it. Returns the number of
+  /// parked states.
+  unsigned parkStates(ExecutionState &current, unsigned count);
+  void resumeParkedStates();
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
 
 public:
+  /// Write the live states and the subsumption table to -checkpoint-dir.
+  void writeCheckpoint();
+
   Executor(const InterpreterOptions &opts, InterpreterHandler *ie);
   virtual ~Executor();
 
   const InterpreterHandler &getHandler() { return *interpreterHandler; }
 
+  /// Return the memory counted by the subsystems of the executor.
+  MemoryBreakdown getMemoryBreakdown() const;
+
   // XXX should just be moved out to utility module
   ref<klee::ConstantExpr> evalConstant(const llvm::Constant *c);
 
@@ -10,6 +10,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "PTree.h"
+#include "SamplingProfiler.h"
 #include "StatsTracker.h"
 #include "ExecutorTimerInfo.h"
 
@@ -29,9 +30,11 @@
 #include "llvm/Support/CommandLine.h"
 
 #include <unistd.h>
+#include <pthread.h>
 #include <signal.h>
 #include <sys/time.h>
 #include <math.h>
+#include <time.h>
 
 
 using namespace llvm;
@@ -59,6 +62,16 @@ public:
 
 ///
 
+class SamplingProfilerTimer : public Executor::Timer {
+public:
+  SamplingProfilerTimer() {}
+  ~SamplingProfilerTimer() {}
+
+  void run() { SamplingProfiler::drain(); }
+};
+
+///
+
 static const double kSecondsPerTick = .1;
 static volatile unsigned timerTicks = 0;
 
@@ -66,10 +79,32 @@ static volatile unsigned timerTicks = 0;
 extern "C" unsigned dumpStates, dumpPTree;
 unsigned dumpStates = 0, dumpPTree = 0;
 
+/// Whether the ticks are counted by the ticker thread rather than by the
+/// alarm signal
+static bool tickerThread = false;
+
 static void onAlarm(int) {
   ++timerTicks;
 }
 
+/// The ticker thread, counting the ticks in timerTicks, so that the executor
+/// only loads the counter between instructions and reads the clock only when
+/// a tick passed, without the alarm signal interrupting its system calls
+static void *runTicker(void *) {
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, 0);
+
+  struct timespec tick;
+  tick.tv_sec = (time_t) kSecondsPerTick;
+  tick.tv_nsec = (long) (fmod(kSecondsPerTick, 1.)*1000000000);
+  for (;;) {
+    nanosleep(&tick, 0);
+    __sync_fetch_and_add(&timerTicks, 1);
+  }
+  return 0;
+}
+
 // oooogalay
 static void setupHandler() {
   struct itimerval t;
@@ -89,12 +124,22 @@ void Executor::initTimers() {
 
   if (first) {
     first = false;
-    setupHandler();
+    pthread_t thread;
+    if (pthread_create(&thread, 0, runTicker, 0) == 0) {
+      pthread_detach(thread);
+      tickerThread = true;
+    } else {
+      setupHandler();
+    }
   }
 
   if (MaxTime) {
     addTimer(new HaltTimer(this), MaxTime.getValue());
   }
+
+  if (SamplingProfiler::enabled()) {
+    addTimer(new SamplingProfilerTimer(), 1.0);
+  }
 }
 
 ///
@@ -112,7 +157,8 @@ void Executor::processTimers(ExecutionState *current,
   static unsigned callsWithoutCheck = 0;
   unsigned ticks = timerTicks;
 
-  if (!ticks && ++callsWithoutCheck > 1000) {
+  // The alarm may be disarmed by the code the executor calls
+  if (!ticks && !tickerThread && ++callsWithoutCheck > 1000) {
     setupHandler();
     ticks = 1;
   }
@@ -121,7 +167,9 @@ void Executor::processTimers(ExecutionState *current,
     if (dumpPTree) {
       char name[32];
       sprintf(name, "ptree%08d.dot", (int) stats::instructions);
-      llvm::raw_ostream *os = interpreterHandler->openOutputFile(name);
+      // Under interpolation, the tree is the one written to tree.dot
+      llvm::raw_ostream *os =
+          processTree ? interpreterHandler->openOutputFile(name) : 0;
       if (os) {
         processTree->dump(*os);
         delete os;
@@ -15,18 +15,21 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/LLVMContext.h"
 #else
 #include "llvm/Module.h"
 #include "llvm/Constants.h"
 #include "llvm/DerivedTypes.h"
 #include "llvm/Instructions.h"
+#include "llvm/IntrinsicInst.h"
 #include "llvm/LLVMContext.h"
 #endif
 #include "llvm/ExecutionEngine/JIT.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 0)
 #include "llvm/Target/TargetSelect.h"
@@ -119,6 +122,30 @@ ExternalDispatcher::~ExternalDispatcher() {
   delete executionEngine;
 }
 
+static CallSite getCallSite(Instruction *inst) {
+  if (inst->getOpcode()==Instruction::Call)
+    return CallSite(cast<CallInst>(inst));
+  return CallSite(cast<InvokeInst>(inst));
+}
+
+/// Return the types the arguments of the call of the target are passed as
+/// by the stub. This accomodates for the corresponding code in Executor.cpp
+/// for handling calls to bitcasted functions.
+static std::vector<const Type*> getArgumentTypes(Function *target,
+                                                 Instruction *inst) {
+  CallSite cs = getCallSite(inst);
+  LLVM_TYPE_Q FunctionType *FTy =
+    cast<FunctionType>(cast<PointerType>(target->getType())->getElementType());
+
+  std::vector<const Type*> types;
+  unsigned i = 0;
+  for (CallSite::arg_iterator ai = cs.arg_begin(), ae = cs.arg_end();
+       ai!=ae; ++ai, ++i)
+    types.push_back(i < FTy->getNumParams() ? FTy->getParamType(i) :
+                    (*ai)->getType());
+  return types;
+}
+
 bool ExternalDispatcher::executeCall(Function *f, Instruction *i, uint64_t *args) {
   dispatchers_ty::iterator it = dispatchers.find(i);
   Function *dispatcher;
@@ -137,17 +164,24 @@ bool ExternalDispatcher::executeCall(Function *f, Instruction *i, uint64_t *args
     }
 #endif
 
-    dispatcher = createDispatcher(f,i);
+    stubs_ty::key_type key(f, getArgumentTypes(f, i));
+    stubs_ty::iterator si = stubs.find(key);
+    if (si != stubs.end()) {
+      dispatcher = si->second;
+    } else {
+      dispatcher = createDispatcher(f,i);
+      stubs.insert(std::make_pair(key, dispatcher));
+
+      if (dispatcher) {
+        // Force the JIT execution engine to go ahead and build the function.
+        // This ensures that any errors or assertions in the compilation
+        // process will trigger crashes instead of being caught as aborts in
+        // the external function.
+        executionEngine->recompileAndRelinkFunction(dispatcher);
+      }
+    }
 
     dispatchers.insert(std::make_pair(i, dispatcher));
-
-    if (dispatcher) {
-      // Force the JIT execution engine to go ahead and build the function. This
-      // ensures that any errors or assertions in the compilation process will
-      // trigger crashes instead of being caught as aborts in the external
-      // function.
-      executionEngine->recompileAndRelinkFunction(dispatcher);
-    }
   } else {
     dispatcher = it->second;
   }
@@ -155,6 +189,77 @@ bool ExternalDispatcher::executeCall(Function *f, Instruction *i, uint64_t *args
   return runProtectedCall(dispatcher, args);
 }
 
+void ExternalDispatcher::addNativeFunction(
+    Function *f, const std::set<Function*> &functions,
+    const std::map<GlobalVariable*, uint64_t> &globals) {
+  if (nativeFunctions.count(f))
+    return;
+
+  ValueToValueMapTy valueMap;
+  for (std::map<GlobalVariable*, uint64_t>::const_iterator
+         it = globals.begin(), ie = globals.end(); it != ie; ++it) {
+    GlobalVariable *&global = nativeGlobals[it->first];
+    if (!global) {
+      // The native code accesses the memory object of the global, which
+      // copyOutConcretes keeps up to date
+      global = new GlobalVariable(*dispatchModule,
+                                  it->first->getType()->getElementType(),
+                                  it->first->isConstant(),
+                                  GlobalValue::ExternalLinkage, 0,
+                                  it->first->getName());
+      executionEngine->addGlobalMapping(global,
+                                        (void*) (unsigned long) it->second);
+    }
+    valueMap[it->first] = global;
+  }
+
+  // All the functions are declared before any is cloned, as they call each
+  // other. The functions already added by the closure of an earlier function
+  // are reused.
+  std::vector<Function*> cloned;
+  for (std::set<Function*>::const_iterator it = functions.begin(),
+         ie = functions.end(); it != ie; ++it) {
+    Function *&function = nativeFunctions[*it];
+    if (!function) {
+      if ((*it)->isDeclaration()) {
+        function = cast<Function>(
+            dispatchModule->getOrInsertFunction((*it)->getName(),
+                                                (*it)->getFunctionType()));
+      } else {
+        function = Function::Create((*it)->getFunctionType(),
+                                    GlobalValue::InternalLinkage,
+                                    (*it)->getName(), dispatchModule);
+        cloned.push_back(*it);
+      }
+    }
+    valueMap[*it] = function;
+  }
+
+  for (std::vector<Function*>::iterator it = cloned.begin(),
+         ie = cloned.end(); it != ie; ++it) {
+    Function *function = nativeFunctions[*it];
+    Function::arg_iterator ni = function->arg_begin();
+    for (Function::arg_iterator ai = (*it)->arg_begin(),
+           ae = (*it)->arg_end(); ai != ae; ++ai, ++ni)
+      valueMap[&*ai] = &*ni;
+    SmallVector<ReturnInst*, 8> returns;
+    CloneFunctionInto(function, *it, valueMap, false, returns);
+
+    // The debug information stays with the module of the interpreter
+    for (Function::iterator bb = function->begin(), be = function->end();
+         bb != be; ++bb) {
+      for (BasicBlock::iterator ii = bb->begin(), ie = bb->end(); ii != ie;) {
+        Instruction *inst = &*ii;
+        ++ii;
+        if (isa<DbgInfoIntrinsic>(inst))
+          inst->eraseFromParent();
+        else
+          inst->setDebugLoc(DebugLoc());
+      }
+    }
+  }
+}
+
 // FIXME: This is not reentrant.
 static uint64_t *gTheArgsP;
 
@@ -192,15 +297,12 @@ bool ExternalDispatcher::runProtectedCall(Function *f, uint64_t *args) {
 // done, then the jit will end up generating a nullary stub just to call our
 // stub, for every single function call.
 Function *ExternalDispatcher::createDispatcher(Function *target, Instruction *inst) {
-  if (!resolveSymbol(target->getName()))
+  std::map<const Function*, Function*>::iterator native =
+    nativeFunctions.find(target);
+  if (native == nativeFunctions.end() && !resolveSymbol(target->getName()))
     return 0;
 
-  CallSite cs;
-  if (inst->getOpcode()==Instruction::Call) {
-    cs = CallSite(cast<CallInst>(inst));
-  } else {
-    cs = CallSite(cast<InvokeInst>(inst));
-  }
+  CallSite cs = getCallSite(inst);
 
   Value **args = new Value*[cs.arg_size()];
 
@@ -251,6 +353,7 @@ Function *ExternalDispatcher::createDispatcher(Function *target, Instruction *in
   }
 
   Constant *dispatchTarget =
+    native != nativeFunctions.end() ? native->second :
     dispatchModule->getOrInsertFunction(target->getName(), FTy,
                                         target->getAttributes());
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
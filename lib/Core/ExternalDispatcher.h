@@ -11,7 +11,9 @@
 #define KLEE_EXTERNALDISPATCHER_H
 
 #include <map>
+#include <set>
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 namespace llvm {
@@ -19,7 +21,9 @@ namespace llvm {
   class Instruction;
   class Function;
   class FunctionType;
+  class GlobalVariable;
   class Module;
+  class Type;
 }
 
 namespace klee {
@@ -27,9 +31,21 @@ namespace klee {
   private:
     typedef std::map<const llvm::Instruction*,llvm::Function*> dispatchers_ty;
     dispatchers_ty dispatchers;
+    /// The stubs by target and types of the arguments passed to it, shared
+    /// by the call sites passing the same types, so that each is only
+    /// compiled once.
+    typedef std::map<std::pair<const llvm::Function*,
+                               std::vector<const llvm::Type*> >,
+                     llvm::Function*> stubs_ty;
+    stubs_ty stubs;
     llvm::Module *dispatchModule;
     llvm::ExecutionEngine *executionEngine;
     std::map<std::string, void*> preboundFunctions;
+    /// The copies in the dispatch module of the functions compiled by
+    /// addNativeFunction, and of the declarations of the globals they use.
+    std::map<const llvm::Function*, llvm::Function*> nativeFunctions;
+    std::map<const llvm::GlobalVariable*,
+             llvm::GlobalVariable*> nativeGlobals;
     
     llvm::Function *createDispatcher(llvm::Function *f, llvm::Instruction *i);
     bool runProtectedCall(llvm::Function *f, uint64_t *args);
@@ -44,6 +60,15 @@ namespace klee {
      */
     bool executeCall(llvm::Function *function, llvm::Instruction *i, uint64_t *args);
     void *resolveSymbol(const std::string &name);
+
+    /// Compile the function of the module and the functions it calls into
+    /// the dispatch module, so that the calls of it made by executeCall run
+    /// the native code. The globals it uses are bound to the given
+    /// addresses.
+    void addNativeFunction(llvm::Function *f,
+                           const std::set<llvm::Function*> &functions,
+                           const std::map<llvm::GlobalVariable*,
+                                          uint64_t> &globals);
   };  
 }
 
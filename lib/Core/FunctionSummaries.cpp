@@ -0,0 +1,172 @@
+//===--- FunctionSummaries.cpp - Summaries of pure functions --------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the cache of the summaries of
+/// the calls of pure functions enabled with -function-summaries.
+///
+//===----------------------------------------------------------------------===//
+
+#include "FunctionSummaries.h"
+
+#include "klee/Config/Version.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#else
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/IntrinsicInst.h"
+#include "llvm/Operator.h"
+#endif
+
+using namespace klee;
+
+namespace {
+/// The maximum number of summaries, the cache being cleared when full
+const unsigned MaxSummaries = 65536;
+
+/// Whether values of the type can be the arguments or the return value of
+/// a summarizable function
+bool isSummarizableType(llvm::Type *type) {
+  return type->isIntegerTy() && type->getIntegerBitWidth() <= 64;
+}
+}
+
+llvm::Value *FunctionSummaries::getBaseObject(llvm::Value *address) {
+  for (;;) {
+    if (llvm::GEPOperator *gep = llvm::dyn_cast<llvm::GEPOperator>(address))
+      address = gep->getPointerOperand();
+    else if (llvm::BitCastOperator *cast =
+                 llvm::dyn_cast<llvm::BitCastOperator>(address))
+      address = cast->getOperand(0);
+    else
+      return address;
+  }
+}
+
+bool FunctionSummaries::analyze(llvm::Function *f) {
+  if (f->isDeclaration() || f->isVarArg() ||
+      !isSummarizableType(f->getReturnType()) ||
+      f->getName().startswith("klee_"))
+    return false;
+  for (llvm::Function::arg_iterator it = f->arg_begin(), ie = f->arg_end();
+       it != ie; ++it) {
+    if (!isSummarizableType(it->getType()))
+      return false;
+  }
+
+  for (llvm::Function::iterator bb = f->begin(), be = f->end(); bb != be;
+       ++bb) {
+    for (llvm::BasicBlock::iterator it = bb->begin(), ie = bb->end();
+         it != ie; ++it) {
+      llvm::Instruction *inst = &*it;
+      switch (inst->getOpcode()) {
+      case llvm::Instruction::Load: {
+        // Bounds errors still terminate the state before the return
+        llvm::Value *base = getBaseObject(
+            llvm::cast<llvm::LoadInst>(inst)->getPointerOperand());
+        if (llvm::isa<llvm::AllocaInst>(base))
+          break;
+        llvm::GlobalVariable *global =
+            llvm::dyn_cast<llvm::GlobalVariable>(base);
+        if (!global || !global->isConstant() ||
+            !global->hasDefinitiveInitializer())
+          return false;
+        break;
+      }
+      case llvm::Instruction::Store: {
+        // A stored address may escape, and is then loaded from a register
+        // which is not an allocation
+        if (!llvm::isa<llvm::AllocaInst>(getBaseObject(
+                llvm::cast<llvm::StoreInst>(inst)->getPointerOperand())))
+          return false;
+        break;
+      }
+      case llvm::Instruction::Call: {
+        if (llvm::isa<llvm::DbgInfoIntrinsic>(inst))
+          break;
+        llvm::Function *callee =
+            llvm::cast<llvm::CallInst>(inst)->getCalledFunction();
+        if (!callee || !isSummarizable(callee))
+          return false;
+        break;
+      }
+      case llvm::Instruction::Invoke:
+      case llvm::Instruction::VAArg:
+      case llvm::Instruction::AtomicCmpXchg:
+      case llvm::Instruction::AtomicRMW:
+      case llvm::Instruction::Fence:
+        return false;
+      default:
+        break;
+      }
+    }
+  }
+  return true;
+}
+
+bool FunctionSummaries::isSummarizable(llvm::Function *f) {
+  std::map<llvm::Function *, bool>::iterator it = summarizable.find(f);
+  if (it != summarizable.end())
+    return it->second;
+
+  // A recursive function is not summarizable, as it is analyzed while it is
+  // not yet known to be
+  summarizable[f] = false;
+  bool result = analyze(f);
+  summarizable[f] = result;
+  return result;
+}
+
+bool FunctionSummaries::getKey(llvm::Function *f,
+                               const std::vector<ref<Expr> > &arguments,
+                               Key &key) {
+  if (arguments.size() != f->arg_size())
+    return false;
+  key.first = f;
+  key.second.clear();
+  for (std::vector<ref<Expr> >::const_iterator it = arguments.begin(),
+                                               ie = arguments.end();
+       it != ie; ++it) {
+    ConstantExpr *ce = llvm::dyn_cast<ConstantExpr>(*it);
+    if (!ce || ce->getWidth() > Expr::Int64)
+      return false;
+    key.second.push_back(ce->getZExtValue());
+  }
+  return true;
+}
+
+bool FunctionSummaries::lookup(llvm::Function *f,
+                               const std::vector<ref<Expr> > &arguments,
+                               ref<Expr> &result) {
+  Key key;
+  if (!isSummarizable(f) || !getKey(f, arguments, key))
+    return false;
+  std::map<Key, ref<Expr> >::iterator it = summaries.find(key);
+  if (it == summaries.end())
+    return false;
+  result = it->second;
+  return true;
+}
+
+void FunctionSummaries::insert(llvm::Function *f,
+                               const std::vector<ref<Expr> > &arguments,
+                               ref<Expr> result) {
+  Key key;
+  if (!llvm::isa<ConstantExpr>(result) || !isSummarizable(f) ||
+      !getKey(f, arguments, key))
+    return;
+  if (summaries.size() >= MaxSummaries)
+    summaries.clear();
+  summaries[key] = result;
+}
@@ -0,0 +1,74 @@
+//===--- FunctionSummaries.h - Summaries of pure functions ------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the cache of the summaries of the
+/// calls of pure functions enabled with -function-summaries.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FUNCTIONSUMMARIES_H
+#define KLEE_FUNCTIONSUMMARIES_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Value;
+}
+
+namespace klee {
+
+/// \brief Cache of the return values of the calls of pure functions.
+///
+/// A function is summarizable when its arguments and its return value are
+/// integers and it only reads its arguments, its own stack allocations and
+/// constant globals, and only writes its own stack allocations, calling only
+/// summarizable functions. A call of such a function with concrete arguments
+/// then always returns the same concrete value, without forking, so that
+/// once a call has returned, the later calls with the same arguments are
+/// given the return value instead of executing the body of the function.
+class FunctionSummaries {
+  typedef std::pair<llvm::Function *, std::vector<uint64_t> > Key;
+
+  /// \brief Whether the functions are summarizable, or being analyzed
+  std::map<llvm::Function *, bool> summarizable;
+
+  std::map<Key, ref<Expr> > summaries;
+
+  bool analyze(llvm::Function *f);
+
+  /// \brief The key of the call of the function with the arguments, or false
+  /// if an argument is symbolic
+  bool getKey(llvm::Function *f, const std::vector<ref<Expr> > &arguments,
+              Key &key);
+
+public:
+  /// \brief The allocation, global or argument the address is derived from
+  static llvm::Value *getBaseObject(llvm::Value *address);
+
+  /// \brief Whether the calls of the function can be summarized
+  bool isSummarizable(llvm::Function *f);
+
+  /// \brief Retrieve the return value of an earlier call of the function
+  /// with the same arguments
+  bool lookup(llvm::Function *f, const std::vector<ref<Expr> > &arguments,
+              ref<Expr> &result);
+
+  /// \brief Record the return value of a call of the function
+  void insert(llvm::Function *f, const std::vector<ref<Expr> > &arguments,
+              ref<Expr> result);
+};
+}
+
+#endif
@@ -0,0 +1,40 @@
+//===--- LiveStates.cpp - The states being explored -----------------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the set of the live states of
+/// the executor.
+///
+//===----------------------------------------------------------------------===//
+
+#include "LiveStates.h"
+
+#include <cassert>
+
+using namespace klee;
+
+void LiveStates::insert(ExecutionState *es) {
+  if (!positions.insert(std::make_pair(es, states.size())).second)
+    return;
+  states.push_back(es);
+}
+
+void LiveStates::erase(ExecutionState *es) {
+  llvm::DenseMap<const ExecutionState *, unsigned>::iterator it =
+      positions.find(es);
+  assert(it != positions.end() && "removing a state that is not live");
+  unsigned position = it->second;
+  positions.erase(it);
+  ExecutionState *last = states.back();
+  states.pop_back();
+  if (last != es) {
+    states[position] = last;
+    positions[last] = position;
+  }
+}
@@ -0,0 +1,73 @@
+//===--- LiveStates.h - The states being explored ---------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the set of the live states of the
+/// executor.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_LIVESTATES_H
+#define KLEE_LIVESTATES_H
+
+#include "klee/ExecutionState.h"
+
+#include "llvm/ADT/DenseMap.h"
+
+#include <vector>
+
+namespace klee {
+
+/// \brief The live states of the executor.
+///
+/// The states are kept densely in a vector, with their positions in it
+/// indexed by address, so that a state is inserted, removed and found in
+/// constant time, the removal moving the last state into the freed position,
+/// and that a state is sampled by its position. A state is found by its
+/// address alone, so that a state already terminated and deleted can be
+/// asked for.
+class LiveStates {
+  std::vector<ExecutionState *> states;
+
+  llvm::DenseMap<const ExecutionState *, unsigned> positions;
+
+public:
+  typedef std::vector<ExecutionState *>::const_iterator iterator;
+
+  typedef iterator const_iterator;
+
+  void insert(ExecutionState *es);
+
+  template <typename InputIterator>
+  void insert(InputIterator first, InputIterator last) {
+    for (; first != last; ++first)
+      insert(*first);
+  }
+
+  /// \brief Remove a live state
+  void erase(ExecutionState *es);
+
+  unsigned count(const ExecutionState *es) const {
+    return positions.count(es);
+  }
+
+  bool empty() const { return states.empty(); }
+
+  std::size_t size() const { return states.size(); }
+
+  iterator begin() const { return states.begin(); }
+
+  iterator end() const { return states.end(); }
+
+  /// \brief The state at a position, below size(), e.g., for sampling
+  ExecutionState *operator[](unsigned index) const { return states[index]; }
+};
+}
+
+#endif
@@ -13,7 +13,6 @@
 #include "klee/CommandLine.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
-#include "klee/util/BitArray.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/util/ArrayCache.h"
 
@@ -34,7 +33,9 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <set>
 #include <sstream>
 
 using namespace llvm;
@@ -44,6 +45,30 @@ namespace {
   cl::opt<bool>
   UseConstantArrays("use-constant-arrays",
                     cl::init(true));
+
+  cl::opt<unsigned>
+  CompactUpdatesSize("compact-updates-size",
+                     cl::desc("Compact the update list of an object once it "
+                              "reaches this many writes, and again each time "
+                              "it doubles (default=64, 0=off)"),
+                     cl::init(64));
+
+  cl::opt<bool>
+  CacheSymbolicReads("cache-symbolic-reads",
+                     cl::desc("Return the same expression for the reads of "
+                              "an object at the same symbolic offset until "
+                              "it is written (default=on)"),
+                     cl::init(true));
+
+  /// The number of memory objects in a slab
+  const size_t MemoryObjectSlabSize = 256;
+
+  /// The first freed memory object, whose first word links to the next
+  void *freeMemoryObjects = 0;
+
+  /// The unused part of the last slab. The slabs live as long as the
+  /// process, as the memory objects are freed by the states at exit.
+  char *memoryObjectSlabNext = 0, *memoryObjectSlabEnd = 0;
 }
 
 /***/
@@ -74,6 +99,46 @@ int MemoryObject::counter = 0;
 MemoryObject::~MemoryObject() {
   if (parent)
     parent->markFreed(this);
+  delete cexPreferences;
+}
+
+void *MemoryObject::operator new(size_t size) {
+  if (size != sizeof(MemoryObject))
+    return ::operator new(size);
+
+  if (freeMemoryObjects) {
+    void *ret = freeMemoryObjects;
+    freeMemoryObjects = *static_cast<void **>(freeMemoryObjects);
+    return ret;
+  }
+  if (memoryObjectSlabNext == memoryObjectSlabEnd) {
+    memoryObjectSlabNext = static_cast<char *>(
+        ::operator new(sizeof(MemoryObject) * MemoryObjectSlabSize));
+    memoryObjectSlabEnd =
+        memoryObjectSlabNext + sizeof(MemoryObject) * MemoryObjectSlabSize;
+  }
+  void *ret = memoryObjectSlabNext;
+  memoryObjectSlabNext += sizeof(MemoryObject);
+  return ret;
+}
+
+void MemoryObject::operator delete(void *p, size_t size) {
+  if (size != sizeof(MemoryObject)) {
+    ::operator delete(p);
+    return;
+  }
+  *static_cast<void **>(p) = freeMemoryObjects;
+  freeMemoryObjects = p;
+}
+
+const std::string &MemoryObject::getName() const {
+  static const std::string unnamed("unnamed");
+  return name.empty() ? unnamed : name;
+}
+
+const std::vector<ref<Expr> > &MemoryObject::getCexPreferences() const {
+  static const std::vector<ref<Expr> > none;
+  return cexPreferences ? *cexPreferences : none;
 }
 
 void MemoryObject::getAllocInfo(std::string &result) const {
@@ -100,17 +165,22 @@ void MemoryObject::getAllocInfo(std::string &result) const {
 
 /***/
 
+size_t ObjectState::liveCount = 0;
+
 ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    concreteStore(mo->size, 0),
+    concreteMask(mo->size, true),
+    flushMask(mo->size, true),
+    knownSymbolics(mo->size, 0),
     updates(0, 0),
+    compactedSize(0),
+    readCache(0),
     size(mo->size),
     readOnly(false) {
+  ++liveCount;
   mo->refCount++;
   if (!UseConstantArrays) {
     static unsigned id = 0;
@@ -123,15 +193,13 @@ ObjectState::ObjectState(const MemoryObject *mo)
     if (INTERPOLATION_ENABLED) {
       // We create shadow array as existentially-quantified
       // variables for subsumption checking
-      const Array *shadow = getArrayCache()->CreateArray(TxShadowArray::getShadowName(arrayName), arrayWidth);
-      TxShadowArray::addShadowArrayMap(array, shadow);
+      TxShadowArray::createShadowArray(*getArrayCache(), array);
       if (DebugTracerX) {
-        llvm::errs() << "[getUpdates:addShadowArrayMap] arrayName:" << arrayName
+        llvm::errs() << "[getUpdates:createShadowArray] arrayName:" << arrayName
                      << " arrayWidth:" << arrayWidth << "\n";
       }
     }
   }
-  memset(concreteStore, 0, size);
 }
 
 
@@ -139,48 +207,42 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
-    concreteMask(0),
-    flushMask(0),
-    knownSymbolics(0),
+    concreteStore(mo->size, 0),
+    concreteMask(mo->size, true),
+    flushMask(mo->size, true),
+    knownSymbolics(mo->size, 0),
     updates(array, 0),
+    compactedSize(0),
+    readCache(0),
     size(mo->size),
     readOnly(false) {
+  ++liveCount;
   mo->refCount++;
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
-    concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
-    flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
-    knownSymbolics(0),
+    concreteStore(os.concreteStore),
+    concreteMask(os.concreteMask),
+    flushMask(os.flushMask),
+    knownSymbolics(os.knownSymbolics),
     updates(os.updates),
+    compactedSize(os.compactedSize),
+    readCache(0),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
+  ++liveCount;
   if (object)
     object->refCount++;
-
-  if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
-    for (unsigned i=0; i<size; i++)
-      knownSymbolics[i] = os.knownSymbolics[i];
-  }
-
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
 }
 
 ObjectState::~ObjectState() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
-
+  --liveCount;
+  delete readCache;
   if (object)
   {
     assert(object->refCount > 0);
@@ -236,65 +298,126 @@ const UpdateList &ObjectState::getUpdates() const {
       Contents[Index->getZExtValue()] = Value;
     }
 
-    static unsigned id = 0;
-    const std::string arrayName = "const_arr" + llvm::utostr(++id);
-    const unsigned arrayWidth = size;
-    const Array *array = getArrayCache()->CreateArray(
-        arrayName, arrayWidth, &Contents[0],
-        &Contents[0] + Contents.size());
-    updates = UpdateList(array, 0);
+    updates = UpdateList(createConstantArray(Contents), 0);
 
     // Apply the remaining (non-constant) writes.
     for (; Begin != End; ++Begin)
       updates.extend(Writes[Begin].first, Writes[Begin].second);
+  }
 
-    if (INTERPOLATION_ENABLED) {
-      // We create shadow array as existentially-quantified
-      // variables for subsumption checking
-      const Array *shadow = getArrayCache()->CreateArray(TxShadowArray::getShadowName(arrayName), arrayWidth);
-      TxShadowArray::addShadowArrayMap(array, shadow);
-      if (DebugTracerX) {
-        llvm::errs() << "[getUpdates:addShadowArrayMap] arrayName:" << arrayName
-                     << " arrayWidth:" << arrayWidth << "\n";
+  return updates;
+}
+
+const Array *ObjectState::createConstantArray(
+    const std::vector<ref<ConstantExpr> > &Contents) const {
+  static unsigned id = 0;
+  const std::string arrayName = "const_arr" + llvm::utostr(++id);
+  const unsigned arrayWidth = size;
+  const Array *array = getArrayCache()->CreateArray(
+      arrayName, arrayWidth, &Contents[0], &Contents[0] + Contents.size());
+
+  if (INTERPOLATION_ENABLED) {
+    // We create shadow array as existentially-quantified
+    // variables for subsumption checking
+    TxShadowArray::createShadowArray(*getArrayCache(), array);
+    if (DebugTracerX) {
+      llvm::errs() << "[getUpdates:createShadowArray] arrayName:" << arrayName
+                   << " arrayWidth:" << arrayWidth << "\n";
+    }
+  }
+
+  return array;
+}
+
+void ObjectState::compactUpdates() {
+  // Collect the list of writes, with the oldest writes first.
+  unsigned NumWrites = updates.getSize();
+  std::vector<const UpdateNode *> Writes(NumWrites);
+  const UpdateNode *un = updates.head;
+  for (unsigned i = NumWrites; i != 0; un = un->next)
+    Writes[--i] = un;
+
+  // A write to a constant index is dead if a later write is to the same
+  // index.
+  std::vector<bool> Live(NumWrites, true);
+  std::set<uint64_t> Written;
+  bool changed = false;
+  for (unsigned i = NumWrites; i != 0;) {
+    --i;
+    if (ConstantExpr *Index = dyn_cast<ConstantExpr>(Writes[i]->index)) {
+      if (!Written.insert(Index->getZExtValue()).second) {
+        Live[i] = false;
+        changed = true;
       }
     }
   }
 
-  return updates;
+  // Snapshot the oldest run of concrete writes into a new constant array, if
+  // the writes are on top of one.
+  const Array *root = updates.root;
+  unsigned Begin = 0;
+  if (root && root->isConstantArray()) {
+    std::vector<ref<ConstantExpr> > Contents(root->constantValues);
+    bool folded = false;
+    for (; Begin != NumWrites; ++Begin) {
+      if (!Live[Begin])
+        continue;
+
+      ConstantExpr *Index = dyn_cast<ConstantExpr>(Writes[Begin]->index);
+      if (!Index || Index->getZExtValue() >= Contents.size())
+        break;
+
+      ConstantExpr *Value = dyn_cast<ConstantExpr>(Writes[Begin]->value);
+      if (!Value)
+        break;
+
+      Contents[Index->getZExtValue()] = Value;
+      folded = true;
+    }
+
+    if (folded) {
+      root = createConstantArray(Contents);
+      changed = true;
+    }
+  }
+
+  if (!changed)
+    return;
+
+  UpdateList compacted(root, 0);
+  for (unsigned i = Begin; i != NumWrites; ++i)
+    if (Live[i])
+      compacted.extend(Writes[i]->index, Writes[i]->value);
+  updates = compacted;
 }
 
 void ObjectState::makeConcrete() {
-  if (concreteMask) delete concreteMask;
-  if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  concreteMask = 0;
-  flushMask = 0;
-  knownSymbolics = 0;
+  clearReadCache();
+  concreteMask.assign(true);
+  flushMask.assign(true);
+  knownSymbolics.assign(0);
 }
 
 void ObjectState::makeSymbolic() {
   assert(!updates.head &&
          "XXX makeSymbolic of objects with symbolic values is unsupported");
 
-  // XXX simplify this, can just delete various arrays I guess
-  for (unsigned i=0; i<size; i++) {
-    markByteSymbolic(i);
-    setKnownSymbolic(i, 0);
-    markByteFlushed(i);
-  }
+  clearReadCache();
+
+  concreteMask.assign(false);
+  knownSymbolics.assign(0);
+  flushMask.assign(false);
 }
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  concreteStore.assign(0);
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
-    // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
-  }
+  // randomly selected by 256 sided die
+  concreteStore.assign(0xAB);
 }
 
 /*
@@ -314,42 +437,38 @@ void ObjectState::fastRangeCheckOffset(ref<Expr> offset,
 
 void ObjectState::flushRangeForRead(unsigned rangeBase, 
                                     unsigned rangeSize) const {
-  if (!flushMask) flushMask = new BitArray(size, true);
- 
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(concreteStore.get(offset), Expr::Int8));
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       knownSymbolics.get(offset));
       }
 
-      flushMask->unset(offset);
+      flushMask.unset(offset);
     }
   } 
 }
 
 void ObjectState::flushRangeForWrite(unsigned rangeBase, 
                                      unsigned rangeSize) {
-  if (!flushMask) flushMask = new BitArray(size, true);
-
   for (unsigned offset=rangeBase; offset<rangeBase+rangeSize; offset++) {
     if (!isByteFlushed(offset)) {
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(concreteStore.get(offset), Expr::Int8));
         markByteSymbolic(offset);
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       knownSymbolics[offset]);
+                       knownSymbolics.get(offset));
         setKnownSymbolic(offset, 0);
       }
 
-      flushMask->unset(offset);
+      flushMask.unset(offset);
     } else {
       // flushed bytes that are written over still need
       // to be marked out
@@ -363,60 +482,48 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase,
 }
 
 bool ObjectState::isByteConcrete(unsigned offset) const {
-  return !concreteMask || concreteMask->get(offset);
+  return concreteMask.get(offset);
 }
 
 bool ObjectState::isByteFlushed(unsigned offset) const {
-  return flushMask && !flushMask->get(offset);
+  return !flushMask.get(offset);
 }
 
 bool ObjectState::isByteKnownSymbolic(unsigned offset) const {
-  return knownSymbolics && knownSymbolics[offset].get();
+  return knownSymbolics.get(offset).get();
 }
 
 void ObjectState::markByteConcrete(unsigned offset) {
-  if (concreteMask)
-    concreteMask->set(offset);
+  concreteMask.set(offset);
 }
 
 void ObjectState::markByteSymbolic(unsigned offset) {
-  if (!concreteMask)
-    concreteMask = new BitArray(size, true);
-  concreteMask->unset(offset);
+  concreteMask.unset(offset);
 }
 
 void ObjectState::markByteUnflushed(unsigned offset) {
-  if (flushMask)
-    flushMask->set(offset);
+  flushMask.set(offset);
 }
 
 void ObjectState::markByteFlushed(unsigned offset) {
-  if (!flushMask) {
-    flushMask = new BitArray(size, false);
-  } else {
-    flushMask->unset(offset);
-  }
+  flushMask.unset(offset);
 }
 
 void ObjectState::setKnownSymbolic(unsigned offset, 
                                    Expr *value /* can be null */) {
-  if (knownSymbolics) {
-    knownSymbolics[offset] = value;
-  } else {
-    if (value) {
-      knownSymbolics = new ref<Expr>[size];
-      knownSymbolics[offset] = value;
-    }
-  }
+  if (value)
+    knownSymbolics.getWriteable(offset) = value;
+  else
+    knownSymbolics.reset(offset);
 }
 
 /***/
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
   if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
+    return ConstantExpr::create(concreteStore.get(offset), Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
-    return knownSymbolics[offset];
+    return knownSymbolics.get(offset);
   } else {
     assert(isByteFlushed(offset) && "unflushed byte without cache value");
     
@@ -444,7 +551,8 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  clearReadCache();
+  concreteStore.set(offset, value);
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
@@ -456,6 +564,7 @@ void ObjectState::write8(unsigned offset, ref<Expr> value) {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
     write8(offset, (uint8_t) CE->getZExtValue(8));
   } else {
+    clearReadCache();
     setKnownSymbolic(offset, value.get());
       
     markByteSymbolic(offset);
@@ -465,6 +574,7 @@ void ObjectState::write8(unsigned offset, ref<Expr> value) {
 
 void ObjectState::write8(ref<Expr> offset, ref<Expr> value) {
   assert(!isa<ConstantExpr>(offset) && "constant offset passed to symbolic write8");
+  clearReadCache();
   unsigned base, size;
   fastRangeCheckOffset(offset, &base, &size);
   flushRangeForWrite(base, size);
@@ -478,6 +588,13 @@ void ObjectState::write8(ref<Expr> offset, ref<Expr> value) {
   }
   
   updates.extend(ZExtExpr::create(offset, Expr::Int32), value);
+
+  if (CompactUpdatesSize &&
+      updates.getSize() >= std::max((unsigned) CompactUpdatesSize,
+                                    2 * compactedSize)) {
+    compactUpdates();
+    compactedSize = updates.getSize();
+  }
 }
 
 /***/
@@ -490,22 +607,35 @@ ref<Expr> ObjectState::read(ref<Expr> offset, Expr::Width width) const {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(offset))
     return read(CE->getZExtValue(32), width);
 
-  // Treat bool specially, it is the only non-byte sized write we allow.
-  if (width == Expr::Bool)
-    return ExtractExpr::create(read8(offset), 0, Expr::Bool);
+  // The writes clear the cache, so that a cached read is over the current
+  // contents
+  if (CacheSymbolicReads) {
+    if (!readCache)
+      readCache = new ExprHashMap<ref<Expr> >();
+    ExprHashMap<ref<Expr> >::iterator it = readCache->find(offset);
+    if (it != readCache->end() && it->second->getWidth() == width)
+      return it->second;
+  }
 
-  // Otherwise, follow the slow general case.
-  unsigned NumBytes = width / 8;
-  assert(width == NumBytes * 8 && "Invalid read size!");
   ref<Expr> Res(0);
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    ref<Expr> Byte = read8(AddExpr::create(offset, 
-                                           ConstantExpr::create(idx, 
-                                                                Expr::Int32)));
-    Res = i ? ConcatExpr::create(Byte, Res) : Byte;
+  if (width == Expr::Bool) {
+    // Treat bool specially, it is the only non-byte sized write we allow.
+    Res = ExtractExpr::create(read8(offset), 0, Expr::Bool);
+  } else {
+    // Otherwise, follow the slow general case.
+    unsigned NumBytes = width / 8;
+    assert(width == NumBytes * 8 && "Invalid read size!");
+    for (unsigned i = 0; i != NumBytes; ++i) {
+      unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
+      ref<Expr> Byte = read8(AddExpr::create(offset, 
+                                             ConstantExpr::create(idx, 
+                                                                  Expr::Int32)));
+      Res = i ? ConcatExpr::create(Byte, Res) : Byte;
+    }
   }
 
+  if (CacheSymbolicReads)
+    (*readCache)[offset] = Res;
   return Res;
 }
 
@@ -514,9 +644,22 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid width for read size!");
+
+  // Read concrete values of up to 64 bits as a whole.
+  if (width <= 64 && isConcrete(offset, NumBytes)) {
+    uint8_t Bytes[8];
+    readConcrete(offset, Bytes, NumBytes);
+    uint64_t Value = 0;
+    for (unsigned i = 0; i != NumBytes; ++i) {
+      unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
+      Value |= (uint64_t) Bytes[idx] << (8 * i);
+    }
+    return ConstantExpr::create(Value, width);
+  }
+
+  // Otherwise, follow the slow general case.
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -589,26 +732,88 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
 
 void ObjectState::write16(unsigned offset, uint16_t value) {
   unsigned NumBytes = 2;
+  uint8_t Bytes[2];
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
+    Bytes[idx] = (uint8_t) (value >> (8 * i));
   }
+  writeConcrete(offset, Bytes, NumBytes);
 }
 
 void ObjectState::write32(unsigned offset, uint32_t value) {
   unsigned NumBytes = 4;
+  uint8_t Bytes[4];
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
+    Bytes[idx] = (uint8_t) (value >> (8 * i));
   }
+  writeConcrete(offset, Bytes, NumBytes);
 }
 
 void ObjectState::write64(unsigned offset, uint64_t value) {
   unsigned NumBytes = 8;
+  uint8_t Bytes[8];
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
+    Bytes[idx] = (uint8_t) (value >> (8 * i));
   }
+  writeConcrete(offset, Bytes, NumBytes);
+}
+
+bool ObjectState::isConcrete(unsigned offset, unsigned n) const {
+  return concreteMask.allEqual(offset, n, true);
+}
+
+void ObjectState::readConcrete(unsigned offset, uint8_t *bytes,
+                               unsigned n) const {
+  assert(isConcrete(offset, n) && "reading symbolic bytes as concrete");
+  concreteStore.copyOut(bytes, offset, n);
+}
+
+void ObjectState::writeConcrete(unsigned offset, const uint8_t *bytes,
+                                unsigned n) {
+  clearReadCache();
+  concreteStore.copyIn(bytes, offset, n);
+  // Concrete bytes have no known symbolic values
+  if (!isConcrete(offset, n)) {
+    for (unsigned i = offset, e = offset + n; i != e; ++i)
+      setKnownSymbolic(i, 0);
+    concreteMask.set(offset, n, true);
+  }
+  flushMask.set(offset, n, true);
+}
+
+void ObjectState::fill(unsigned offset, uint8_t value, unsigned n) {
+  clearReadCache();
+  concreteStore.assign(offset, n, value);
+  if (!isConcrete(offset, n)) {
+    for (unsigned i = offset, e = offset + n; i != e; ++i)
+      setKnownSymbolic(i, 0);
+    concreteMask.set(offset, n, true);
+  }
+  flushMask.set(offset, n, true);
+}
+
+void ObjectState::copy(unsigned offset, const ObjectState *src,
+                       unsigned srcOffset, unsigned n) {
+  if (n == 0)
+    return;
+
+  if (src->isConcrete(srcOffset, n)) {
+    std::vector<uint8_t> Bytes(n);
+    src->readConcrete(srcOffset, &Bytes[0], n);
+    writeConcrete(offset, &Bytes[0], n);
+    return;
+  }
+
+  // Read all the bytes before writing any, for overlapping copies within the
+  // object.
+  std::vector<ref<Expr> > Bytes;
+  Bytes.reserve(n);
+  for (unsigned i = 0; i != n; ++i)
+    Bytes.push_back(src->read8(srcOffset + i));
+  for (unsigned i = 0; i != n; ++i)
+    write8(offset + i, Bytes[i]);
 }
 
 void ObjectState::print() {
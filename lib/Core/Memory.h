@@ -12,6 +12,8 @@
 
 #include "Context.h"
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/PagedArray.h"
+#include "klee/util/ExprHashMap.h"
 
 #include "llvm/ADT/StringExtras.h"
 
@@ -24,7 +26,6 @@ namespace llvm {
 
 namespace klee {
 
-class BitArray;
 class MemoryManager;
 class Solver;
 class ArrayCache;
@@ -33,18 +34,38 @@ class MemoryObject {
   friend class STPBuilder;
   friend class ObjectState;
   friend class ExecutionState;
+  friend class SymbolicList;
+  friend class MemoryManager;
 
 private:
   static int counter;
   mutable unsigned refCount;
 
+  /// The neighbours in the list of the live objects of the memory manager
+  MemoryObject *prevObject, *nextObject;
+
+  /// The user-given name, empty for the unnamed objects, so that the many
+  /// unnamed objects do not each hold a string
+  mutable std::string name;
+
+  /// A list of boolean expressions the user has requested be true of
+  /// a counterexample. Mutable since we play a little fast and loose
+  /// with allowing it to be added to during execution (although
+  /// should sensibly be only at creation time). Allocated by the first
+  /// preference, as few objects have any.
+  mutable std::vector< ref<Expr> > *cexPreferences;
+
 public:
   unsigned id;
   uint64_t address;
 
   /// size in bytes
   unsigned size;
-  mutable std::string name;
+
+  /// The size in bytes of an object allocated with a symbolic size by
+  /// -symbolic-size-capacity, at most the size, which is then its capacity.
+  /// Null for the other objects.
+  ref<Expr> symbolicSize;
 
   bool isLocal;
   mutable bool isGlobal;
@@ -60,12 +81,6 @@ public:
   /// should be either the allocating instruction or the global object
   /// it was allocated for (or whatever else makes sense).
   const llvm::Value *allocSite;
-  
-  /// A list of boolean expressions the user has requested be true of
-  /// a counterexample. Mutable since we play a little fast and loose
-  /// with allowing it to be added to during execution (although
-  /// should sensibly be only at creation time).
-  mutable std::vector< ref<Expr> > cexPreferences;
 
   // DO NOT IMPLEMENT
   MemoryObject(const MemoryObject &b);
@@ -76,6 +91,9 @@ public:
   explicit
   MemoryObject(uint64_t _address) 
     : refCount(0),
+      prevObject(0),
+      nextObject(0),
+      cexPreferences(0),
       id(counter++), 
       address(_address),
       size(0),
@@ -89,10 +107,12 @@ public:
                const llvm::Value *_allocSite,
                MemoryManager *_parent)
     : refCount(0), 
+      prevObject(0),
+      nextObject(0),
+      cexPreferences(0),
       id(counter++),
       address(_address),
       size(_size),
-      name("unnamed"),
       isLocal(_isLocal),
       isGlobal(_isGlobal),
       isFixed(_isFixed),
@@ -104,13 +124,27 @@ public:
 
   ~MemoryObject();
 
+  /// The objects are carved out of slabs, and the freed ones are reused
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   /// Get an identifying string for this allocation.
   void getAllocInfo(std::string &result) const;
 
+  const std::string &getName() const;
+
   void setName(std::string name) const {
     this->name = name;
   }
 
+  const std::vector<ref<Expr> > &getCexPreferences() const;
+
+  void addCexPreference(ref<Expr> cond) const {
+    if (!cexPreferences)
+      cexPreferences = new std::vector<ref<Expr> >();
+    cexPreferences->push_back(cond);
+  }
+
   ref<ConstantExpr> getBaseExpr() const { 
     return ConstantExpr::create(address, Context::get().getPointerWidth());
   }
@@ -128,7 +162,9 @@ public:
   }
 
   ref<Expr> getBoundsCheckOffset(ref<Expr> offset) const {
-    if (size==0) {
+    if (!symbolicSize.isNull()) {
+      return UltExpr::create(offset, symbolicSize);
+    } else if (size==0) {
       return EqExpr::create(offset, 
                             ConstantExpr::alloc(0, Context::get().getPointerWidth()));
     } else {
@@ -136,7 +172,14 @@ public:
     }
   }
   ref<Expr> getBoundsCheckOffset(ref<Expr> offset, unsigned bytes) const {
-    if (bytes<=size) {
+    if (!symbolicSize.isNull() && bytes<=size) {
+      // offset + bytes <= symbolicSize, without overflow
+      ref<Expr> width = ConstantExpr::alloc(bytes,
+                                            Context::get().getPointerWidth());
+      return AndExpr::create(
+          UleExpr::create(width, symbolicSize),
+          UleExpr::create(offset, SubExpr::create(symbolicSize, width)));
+    } else if (bytes<=size) {
       return UltExpr::create(offset, 
                              ConstantExpr::alloc(size - bytes + 1, 
                                                  Context::get().getPointerWidth()));
@@ -156,18 +199,32 @@ private:
 
   const MemoryObject *object;
 
-  uint8_t *concreteStore;
+  // The contents are kept in copy-on-write pages, so that a copy of a large
+  // object shares the pages its writes do not touch
+  PagedArray<uint8_t> concreteStore;
   // XXX cleanup name of flushMask (its backwards or something)
-  BitArray *concreteMask;
+  PagedBitArray<> concreteMask;
 
   // mutable because may need flushed during read of const
-  mutable BitArray *flushMask;
+  mutable PagedBitArray<> flushMask;
 
-  ref<Expr> *knownSymbolics;
+  PagedArray<ref<Expr>, 9> knownSymbolics;
 
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
+  /// The size of the update list after it was last compacted
+  unsigned compactedSize;
+
+  /// The values of the reads at symbolic offsets since the last write, so
+  /// that a load repeated in a loop returns the same expression. Allocated
+  /// by the first such read under -cache-symbolic-reads, as most objects
+  /// are only read at constant offsets.
+  mutable ExprHashMap<ref<Expr> > *readCache;
+
+  /// The number of live object states
+  static size_t liveCount;
+
 public:
   unsigned size;
 
@@ -188,6 +245,14 @@ public:
 
   const MemoryObject *getObject() const { return object; }
 
+  /// Return the bytes of the live object states and of their pages
+  static size_t getAllocatedBytes() {
+    return liveCount * sizeof(ObjectState) +
+           PagedArray<uint8_t>::getAllocatedBytes() +
+           PagedBitArray<>::getAllocatedBytes() +
+           PagedArray<ref<Expr>, 9>::getAllocatedBytes();
+  }
+
   void setReadOnly(bool ro) { readOnly = ro; }
 
   // make contents all concrete and zero
@@ -208,9 +273,31 @@ public:
   void write32(unsigned offset, uint32_t value);
   void write64(unsigned offset, uint64_t value);
 
+  /// Return whether the n bytes from offset are all concrete.
+  bool isConcrete(unsigned offset, unsigned n) const;
+  /// Read n concrete bytes from offset. The bytes have to be concrete.
+  void readConcrete(unsigned offset, uint8_t *bytes, unsigned n) const;
+  /// Write n concrete bytes from offset, as write8 of each byte does.
+  void writeConcrete(unsigned offset, const uint8_t *bytes, unsigned n);
+  /// Write the concrete value to the n bytes from offset.
+  void fill(unsigned offset, uint8_t value, unsigned n);
+  /// Copy n bytes from srcOffset in src, which may be this object and
+  /// overlap the destination, to offset.
+  void copy(unsigned offset, const ObjectState *src, unsigned srcOffset,
+            unsigned n);
+
 private:
   const UpdateList &getUpdates() const;
 
+  /// Create a constant array of the contents, and its shadow array.
+  const Array *
+  createConstantArray(const std::vector<ref<ConstantExpr> > &Contents) const;
+
+  /// Remove the writes to constant indices that later writes overwrite, and
+  /// fold the oldest concrete writes into a new constant array if the
+  /// update list is over a constant array.
+  void compactUpdates();
+
   void makeConcrete();
 
   void makeSymbolic();
@@ -234,6 +321,11 @@ private:
   void markByteUnflushed(unsigned offset);
   void setKnownSymbolic(unsigned offset, Expr *value);
 
+  void clearReadCache() {
+    if (readCache)
+      readCache->clear();
+  }
+
   void print();
   ArrayCache *getArrayCache() const;
 };
@@ -18,6 +18,7 @@
 #include "llvm/Support/MathExtras.h"
 
 #include <sys/mman.h>
+#include <unistd.h>
 using namespace klee;
 
 namespace {
@@ -29,9 +30,15 @@ llvm::cl::opt<bool> DeterministicAllocation(
 llvm::cl::opt<unsigned> DeterministicAllocationSize(
     "allocate-determ-size",
     llvm::cl::desc(
-        "Preallocated memory for deterministic allocation in MB (default=100)"),
+        "Maximum memory for deterministic allocation in MB (default=100)"),
     llvm::cl::init(100));
 
+llvm::cl::opt<unsigned> DeterministicAllocationChunkSize(
+    "allocate-determ-chunk-size",
+    llvm::cl::desc("Memory mapped at a time for deterministic allocation in MB "
+                   "(default=8)"),
+    llvm::cl::init(8));
+
 llvm::cl::opt<bool>
 NullOnZeroMalloc("return-null-on-zero-malloc",
                  llvm::cl::desc("Returns NULL in case malloc(size) was "
@@ -53,14 +60,19 @@ llvm::cl::opt<unsigned long long> DeterministicStartAddress(
 
 /***/
 MemoryManager::MemoryManager(ArrayCache *_arrayCache)
-    : arrayCache(_arrayCache), deterministicSpace(0), nextFreeSlot(0),
-      spaceSize(DeterministicAllocationSize.getValue() * 1024 * 1024) {
+    : objects(0), arrayCache(_arrayCache), deterministicSpace(0), nextFreeSlot(0),
+      spaceSize(0), chunkSize(0) {
   if (DeterministicAllocation) {
+    size_t pageSize = getpagesize();
+    chunkSize = std::max(DeterministicAllocationChunkSize.getValue(), 1u) *
+                1024 * 1024;
+    chunkSize = llvm::RoundUpToAlignment(chunkSize, pageSize);
+
     // Page boundary
     void *expectedAddress = (void *)DeterministicStartAddress.getValue();
 
     char *newSpace =
-        (char *)mmap(expectedAddress, spaceSize, PROT_READ | PROT_WRITE,
+        (char *)mmap(expectedAddress, chunkSize, PROT_READ | PROT_WRITE,
                      MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 
     if (newSpace == MAP_FAILED) {
@@ -73,15 +85,17 @@ MemoryManager::MemoryManager(ArrayCache *_arrayCache)
     klee_message("Deterministic memory allocation starting from %p", newSpace);
     deterministicSpace = newSpace;
     nextFreeSlot = newSpace;
+    spaceSize = chunkSize;
+    chunkObjects.push_back(0);
   }
 }
 
 MemoryManager::~MemoryManager() {
-  while (!objects.empty()) {
-    MemoryObject *mo = *objects.begin();
+  while (objects) {
+    MemoryObject *mo = objects;
     if (!mo->isFixed && !DeterministicAllocation)
       free((void *)mo->address);
-    objects.erase(mo);
+    unlink(mo);
     delete mo;
   }
 
@@ -89,6 +103,51 @@ MemoryManager::~MemoryManager() {
     munmap(deterministicSpace, spaceSize);
 }
 
+bool MemoryManager::growDeterministicSpace(char *end) {
+  size_t maxSize = (size_t)DeterministicAllocationSize.getValue() * 1024 * 1024;
+  if (end > deterministicSpace + maxSize)
+    return false;
+
+  while (deterministicSpace + spaceSize < end) {
+    // The next chunk has to follow the previous one, the addresses would
+    // otherwise depend on the other mappings of the process
+    char *expectedAddress = deterministicSpace + spaceSize;
+    char *newChunk =
+        (char *)mmap(expectedAddress, chunkSize, PROT_READ | PROT_WRITE,
+                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (newChunk == MAP_FAILED)
+      return false;
+    if (newChunk != expectedAddress) {
+      munmap(newChunk, chunkSize);
+      return false;
+    }
+    spaceSize += chunkSize;
+    chunkObjects.push_back(0);
+  }
+  return true;
+}
+
+void MemoryManager::countDeterministicObject(const MemoryObject *mo,
+                                             bool live) {
+  size_t offset = (char *)mo->address - deterministicSpace;
+  size_t first = offset / chunkSize;
+  size_t last = (offset + std::max(mo->size, (uint64_t)1) - 1) / chunkSize;
+
+  for (size_t i = first; i <= last; ++i) {
+    if (live) {
+      ++chunkObjects[i];
+      continue;
+    }
+    assert(chunkObjects[i] && "object count of a chunk underflow");
+
+    // A chunk no longer receiving objects keeps its addresses, which are
+    // never reused, while its pages go back to the OS
+    char *chunk = deterministicSpace + i * chunkSize;
+    if (--chunkObjects[i] == 0 && chunk + chunkSize <= nextFreeSlot)
+      madvise(chunk, chunkSize, MADV_DONTNEED);
+  }
+}
+
 MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
                                       bool isGlobal,
                                       const llvm::Value *allocSite,
@@ -115,7 +174,7 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
     // Handle the case of 0-sized allocations as 1-byte allocations.
     // This way, we make sure we have this allocation between its own red zones
     size_t alloc_size = std::max(size, (uint64_t)1);
-    if ((char *)address + alloc_size < deterministicSpace + spaceSize) {
+    if (growDeterministicSpace((char *)address + alloc_size + 1)) {
       nextFreeSlot = (char *)address + alloc_size + RedZoneSpace;
     } else {
       klee_warning_once(
@@ -143,16 +202,16 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
   ++stats::allocations;
   MemoryObject *res = new MemoryObject(address, size, isLocal, isGlobal, false,
                                        allocSite, this);
-  objects.insert(res);
+  link(res);
+  if (DeterministicAllocation)
+    countDeterministicObject(res, true);
   return res;
 }
 
 MemoryObject *MemoryManager::allocateFixed(uint64_t address, uint64_t size,
                                            const llvm::Value *allocSite) {
 #ifndef NDEBUG
-  for (objects_ty::iterator it = objects.begin(), ie = objects.end(); it != ie;
-       ++it) {
-    MemoryObject *mo = *it;
+  for (MemoryObject *mo = objects; mo; mo = mo->nextObject) {
     if (address + size > mo->address && address < mo->address + mo->size)
       klee_error("Trying to allocate an overlapping object");
   }
@@ -161,17 +220,41 @@ MemoryObject *MemoryManager::allocateFixed(uint64_t address, uint64_t size,
   ++stats::allocations;
   MemoryObject *res =
       new MemoryObject(address, size, false, true, true, allocSite, this);
-  objects.insert(res);
+  link(res);
   return res;
 }
 
+void MemoryManager::link(MemoryObject *mo) {
+  mo->prevObject = 0;
+  mo->nextObject = objects;
+  if (objects)
+    objects->prevObject = mo;
+  objects = mo;
+}
+
+void MemoryManager::unlink(MemoryObject *mo) {
+  if (mo->prevObject)
+    mo->prevObject->nextObject = mo->nextObject;
+  else
+    objects = mo->nextObject;
+  if (mo->nextObject)
+    mo->nextObject->prevObject = mo->prevObject;
+  mo->prevObject = mo->nextObject = 0;
+}
+
 void MemoryManager::deallocate(const MemoryObject *mo) { assert(0); }
 
 void MemoryManager::markFreed(MemoryObject *mo) {
-  if (objects.find(mo) != objects.end()) {
-    if (!mo->isFixed && !DeterministicAllocation)
-      free((void *)mo->address);
-    objects.erase(mo);
+  // The objects already unlinked by the destructor of the manager are
+  // neither first nor linked to a previous object
+  if (mo->prevObject || objects == mo) {
+    if (!mo->isFixed) {
+      if (DeterministicAllocation)
+        countDeterministicObject(mo, false);
+      else
+        free((void *)mo->address);
+    }
+    unlink(mo);
   }
 }
 
@@ -10,8 +10,9 @@
 #ifndef KLEE_MEMORYMANAGER_H
 #define KLEE_MEMORYMANAGER_H
 
-#include <set>
+#include <stddef.h>
 #include <stdint.h>
+#include <vector>
 
 namespace llvm {
 class Value;
@@ -23,13 +24,28 @@ class ArrayCache;
 
 class MemoryManager {
 private:
-  typedef std::set<MemoryObject *> objects_ty;
-  objects_ty objects;
+  /// The list of the live objects, linked through the objects themselves
+  MemoryObject *objects;
   ArrayCache *const arrayCache;
 
+  /// The deterministic space is mapped in chunks on demand, each chunk
+  /// right after the previous one so that the addresses stay reproducible
   char *deterministicSpace;
   char *nextFreeSlot;
   size_t spaceSize;
+  size_t chunkSize;
+
+  /// The number of the live objects overlapping each chunk
+  std::vector<unsigned> chunkObjects;
+
+  void link(MemoryObject *mo);
+  void unlink(MemoryObject *mo);
+
+  /// Maps the chunks of the deterministic space up to the given address
+  bool growDeterministicSpace(char *end);
+  /// Updates the object counts of the chunks overlapping the object, and
+  /// returns the pages of the chunks no longer used to the OS
+  void countDeterministicObject(const MemoryObject *mo, bool live);
 
 public:
   MemoryManager(ArrayCache *arrayCache);
@@ -0,0 +1,146 @@
+//===--- MetricsExporter.cpp - Live metrics of the executor ---------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the exporter of the live metrics
+/// enabled with -metrics-socket.
+///
+//===----------------------------------------------------------------------===//
+
+#include "MetricsExporter.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace klee;
+
+MetricsExporter::MetricsExporter(const std::string &_path, int _listenFd)
+    : path(_path), listenFd(_listenFd) {
+  pthread_mutex_init(&lock, 0);
+}
+
+MetricsExporter *MetricsExporter::create(const std::string &path) {
+  struct sockaddr_un address;
+  if (path.size() >= sizeof(address.sun_path)) {
+    klee_warning("metrics socket path too long: %s", path.c_str());
+    return 0;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path.c_str());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    klee_warning("unable to create metrics socket: %s", strerror(errno));
+    return 0;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  unlink(path.c_str());
+  if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+      listen(fd, 4) < 0) {
+    klee_warning("unable to listen on metrics socket %s: %s", path.c_str(),
+                 strerror(errno));
+    close(fd);
+    return 0;
+  }
+
+  MetricsExporter *exporter = new MetricsExporter(path, fd);
+  if (pthread_create(&exporter->thread, 0, run, exporter)) {
+    klee_warning("unable to start the metrics thread");
+    close(fd);
+    unlink(path.c_str());
+    exporter->listenFd = -1;
+    delete exporter;
+    return 0;
+  }
+  return exporter;
+}
+
+MetricsExporter::~MetricsExporter() {
+  if (listenFd >= 0) {
+    // Shutting the socket down wakes the thread blocked in accept
+    shutdown(listenFd, SHUT_RDWR);
+    pthread_join(thread, 0);
+    close(listenFd);
+    unlink(path.c_str());
+  }
+  pthread_mutex_destroy(&lock);
+}
+
+void MetricsExporter::publish(const std::string &_text) {
+  pthread_mutex_lock(&lock);
+  text = _text;
+  pthread_mutex_unlock(&lock);
+}
+
+void *MetricsExporter::run(void *exporter) {
+  // The signals of the executor are left to the thread of the executor
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, 0);
+  static_cast<MetricsExporter *>(exporter)->serve();
+  return 0;
+}
+
+void MetricsExporter::serve() {
+  for (;;) {
+    int fd = accept(listenFd, 0, 0);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+
+    // The request is read until the end of its header, and not parsed, as
+    // any request gets the metrics. A silent client is given up after a
+    // second, so that it does not hold the other clients.
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char buffer[4096];
+    size_t received = 0;
+    while (received < sizeof(buffer) - 1) {
+      ssize_t n = recv(fd, buffer + received, sizeof(buffer) - 1 - received, 0);
+      if (n <= 0)
+        break;
+      received += n;
+      buffer[received] = 0;
+      if (strstr(buffer, "\r\n\r\n") || strstr(buffer, "\n\n"))
+        break;
+    }
+
+    pthread_mutex_lock(&lock);
+    std::string body = text;
+    pthread_mutex_unlock(&lock);
+
+    char header[128];
+    snprintf(header, sizeof(header),
+             "HTTP/1.0 200 OK\r\n"
+             "Content-Type: text/plain; version=0.0.4\r\n"
+             "Content-Length: %lu\r\n\r\n",
+             (unsigned long)body.size());
+    std::string response = std::string(header) + body;
+    for (size_t sent = 0; sent < response.size();) {
+      ssize_t n = send(fd, response.data() + sent, response.size() - sent,
+                       MSG_NOSIGNAL);
+      if (n <= 0)
+        break;
+      sent += n;
+    }
+    close(fd);
+  }
+}
@@ -0,0 +1,59 @@
+//===--- MetricsExporter.h - Live metrics of the executor -------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the exporter of the live metrics
+/// enabled with -metrics-socket.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_METRICSEXPORTER_H
+#define KLEE_METRICSEXPORTER_H
+
+#include <pthread.h>
+#include <string>
+
+namespace klee {
+
+/// \brief Exporter of the live metrics of a run.
+///
+/// A background thread serves the metrics over HTTP on a Unix socket, in
+/// the Prometheus text exposition format, for example to
+/// curl --unix-socket. The thread only serves the last text published by
+/// the executor, so that the executor does not wait on the clients, and
+/// the clients do not read the executor data structures as they change.
+class MetricsExporter {
+  std::string path;
+  int listenFd;
+  pthread_t thread;
+  pthread_mutex_t lock;
+
+  /// \brief The last published metrics, guarded by lock
+  std::string text;
+
+  static void *run(void *exporter);
+
+  void serve();
+
+  MetricsExporter(const std::string &_path, int _listenFd);
+
+public:
+  /// \brief Listen on the socket at the path and start serving, or return
+  /// null if the socket could not be created
+  static MetricsExporter *create(const std::string &path);
+
+  /// \brief Stop serving and remove the socket
+  ~MetricsExporter();
+
+  /// \brief Replace the metrics served
+  void publish(const std::string &_text);
+};
+}
+
+#endif
@@ -0,0 +1,181 @@
+//===--- NativeCalls.cpp - Native execution of concrete calls -------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the analysis of the functions
+/// whose calls with concrete arguments are run natively with
+/// -native-concrete-calls.
+///
+//===----------------------------------------------------------------------===//
+
+#include "NativeCalls.h"
+
+#include "FunctionSummaries.h"
+
+#include "klee/Config/Version.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#else
+#include "llvm/Constants.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalAlias.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Instructions.h"
+#include "llvm/IntrinsicInst.h"
+#endif
+
+using namespace klee;
+
+bool NativeCalls::isNativeType(llvm::Type *type) {
+  if (type->isIntegerTy())
+    return type->getIntegerBitWidth() <= 64;
+  return type->isVoidTy() || type->isPointerTy() || type->isFloatTy() ||
+         type->isDoubleTy();
+}
+
+bool NativeCalls::addGlobals(llvm::Value *operand, Closure &closure) {
+  if (llvm::GlobalVariable *global =
+          llvm::dyn_cast<llvm::GlobalVariable>(operand)) {
+    closure.globals.insert(global);
+    return true;
+  }
+  // The address of a function would be that of the native code, and an
+  // alias may be of a function
+  if (llvm::isa<llvm::Function>(operand) ||
+      llvm::isa<llvm::GlobalAlias>(operand))
+    return false;
+  if (llvm::Constant *c = llvm::dyn_cast<llvm::Constant>(operand)) {
+    for (unsigned i = 0, e = c->getNumOperands(); i != e; ++i) {
+      if (!addGlobals(c->getOperand(i), closure))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool NativeCalls::isRootedAddress(llvm::Value *address) {
+  llvm::Value *base = FunctionSummaries::getBaseObject(address);
+  return llvm::isa<llvm::AllocaInst>(base) || llvm::isa<llvm::Argument>(base) ||
+         llvm::isa<llvm::GlobalVariable>(base);
+}
+
+bool NativeCalls::analyze(llvm::Function *f, Closure &closure) {
+  if (f->isDeclaration() || f->isVarArg() ||
+      !isNativeType(f->getReturnType()) || f->getName().startswith("klee_"))
+    return false;
+  for (llvm::Function::arg_iterator it = f->arg_begin(), ie = f->arg_end();
+       it != ie; ++it) {
+    if (!isNativeType(it->getType()))
+      return false;
+  }
+  closure.functions.insert(f);
+
+  for (llvm::Function::iterator bb = f->begin(), be = f->end(); bb != be;
+       ++bb) {
+    for (llvm::BasicBlock::iterator it = bb->begin(), ie = bb->end();
+         it != ie; ++it) {
+      llvm::Instruction *inst = &*it;
+      switch (inst->getOpcode()) {
+      case llvm::Instruction::Load: {
+        // An address loaded from memory may be of any object of the state,
+        // which is then not known to be concrete
+        if (!isRootedAddress(
+                llvm::cast<llvm::LoadInst>(inst)->getPointerOperand()))
+          return false;
+        break;
+      }
+      case llvm::Instruction::Store: {
+        if (!isRootedAddress(
+                llvm::cast<llvm::StoreInst>(inst)->getPointerOperand()))
+          return false;
+        break;
+      }
+      case llvm::Instruction::Call: {
+        llvm::CallInst *call = llvm::cast<llvm::CallInst>(inst);
+        if (llvm::isa<llvm::DbgInfoIntrinsic>(call))
+          continue;
+        llvm::Function *callee = call->getCalledFunction();
+        if (!callee)
+          return false;
+        if (llvm::MemIntrinsic *mi = llvm::dyn_cast<llvm::MemIntrinsic>(call)) {
+          if (!isRootedAddress(mi->getRawDest()))
+            return false;
+          if (llvm::MemTransferInst *mt =
+                  llvm::dyn_cast<llvm::MemTransferInst>(mi)) {
+            if (!isRootedAddress(mt->getRawSource()))
+              return false;
+          }
+          closure.functions.insert(callee);
+        } else if (callee->isIntrinsic()) {
+          if (callee->getIntrinsicID() != llvm::Intrinsic::lifetime_start &&
+              callee->getIntrinsicID() != llvm::Intrinsic::lifetime_end)
+            return false;
+          closure.functions.insert(callee);
+        } else {
+          if (!isNative(callee))
+            return false;
+          const Closure &calleeClosure = closures[callee];
+          closure.functions.insert(calleeClosure.functions.begin(),
+                                   calleeClosure.functions.end());
+          closure.globals.insert(calleeClosure.globals.begin(),
+                                 calleeClosure.globals.end());
+          for (unsigned i = 0, e = call->getNumArgOperands(); i != e; ++i) {
+            llvm::Value *argument = call->getArgOperand(i);
+            if (argument->getType()->isPointerTy() &&
+                !isRootedAddress(argument))
+              return false;
+          }
+        }
+        // The called function is not an address taken
+        for (unsigned i = 0, e = call->getNumArgOperands(); i != e; ++i) {
+          if (!addGlobals(call->getArgOperand(i), closure))
+            return false;
+        }
+        continue;
+      }
+      case llvm::Instruction::Invoke:
+      case llvm::Instruction::VAArg:
+      case llvm::Instruction::IntToPtr:
+      case llvm::Instruction::AtomicCmpXchg:
+      case llvm::Instruction::AtomicRMW:
+      case llvm::Instruction::Fence:
+        return false;
+      default:
+        break;
+      }
+      for (unsigned i = 0, e = inst->getNumOperands(); i != e; ++i) {
+        if (!addGlobals(inst->getOperand(i), closure))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool NativeCalls::isNative(llvm::Function *f) {
+  std::map<llvm::Function *, bool>::iterator it = native.find(f);
+  if (it != native.end())
+    return it->second;
+
+  // A recursive function is not run natively, as it is analyzed while it is
+  // not yet known to be
+  native[f] = false;
+  Closure closure;
+  bool result = analyze(f, closure);
+  if (result)
+    closures[f] = closure;
+  native[f] = result;
+  return result;
+}
@@ -0,0 +1,82 @@
+//===--- NativeCalls.h - Native execution of concrete calls -----*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the analysis of the functions whose
+/// calls with concrete arguments are run natively with -native-concrete-calls.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_NATIVECALLS_H
+#define KLEE_NATIVECALLS_H
+
+#include <map>
+#include <set>
+
+namespace llvm {
+class Function;
+class GlobalVariable;
+class Type;
+class Value;
+}
+
+namespace klee {
+
+/// \brief The functions whose calls can be compiled and run natively.
+///
+/// A function can be run natively when it only accesses memory through the
+/// addresses of its own stack allocations, of globals, and of its pointer
+/// arguments, only calls such functions directly, and does not take the
+/// address of a function. A call of it whose arguments are concrete, and
+/// whose pointer arguments and accessed globals point to objects that are
+/// concrete in the state, then computes the same as its interpretation
+/// would, once the objects are copied to the native memory, as for an
+/// external call. The closure of the function is the set of the functions
+/// it calls, transitively, which are compiled along with it.
+class NativeCalls {
+public:
+  struct Closure {
+    /// \brief The function and its callees, including the intrinsics
+    std::set<llvm::Function *> functions;
+
+    /// \brief The globals whose addresses the functions use
+    std::set<llvm::GlobalVariable *> globals;
+  };
+
+private:
+  /// \brief Whether the functions can be run natively, or are being
+  /// analyzed
+  std::map<llvm::Function *, bool> native;
+
+  std::map<llvm::Function *, Closure> closures;
+
+  /// \brief Whether values of the type can be passed to or returned by the
+  /// stub of the external dispatcher
+  static bool isNativeType(llvm::Type *type);
+
+  /// \brief Add the globals the operand refers to into the closure, or
+  /// return false if it refers to a function or an alias
+  static bool addGlobals(llvm::Value *operand, Closure &closure);
+
+  /// \brief Whether the address is that of a stack allocation, a global or
+  /// an argument, or derived from one
+  static bool isRootedAddress(llvm::Value *address);
+
+  bool analyze(llvm::Function *f, Closure &closure);
+
+public:
+  /// \brief Whether the calls of the function can be run natively
+  bool isNative(llvm::Function *f);
+
+  /// \brief The closure of a function that can be run natively
+  const Closure &getClosure(llvm::Function *f) { return closures[f]; }
+};
+}
+
+#endif
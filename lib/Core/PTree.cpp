@@ -10,7 +10,6 @@
 #include "PTree.h"
 
 #include <klee/Expr.h>
-#include <klee/util/ExprPPrinter.h>
 
 #include <vector>
 
@@ -18,41 +17,82 @@ using namespace klee;
 
   /* *** */
 
-PTree::PTree(const data_type &_root) : root(new Node(0,_root)) {
+PTree::PTree(const data_type &_root) : freeNodes(0) {
+  root = allocateNode(0, _root);
 }
 
-PTree::~PTree() {}
+PTree::~PTree() {
+  for (std::vector<Node *>::iterator it = chunks.begin(), ie = chunks.end();
+       it != ie; ++it)
+    delete[] *it;
+}
+
+PTreeNode *PTree::allocateNode(Node *parent, ExecutionState *data) {
+  if (!freeNodes) {
+    Node *chunk = new Node[NodesPerChunk];
+    chunks.push_back(chunk);
+    for (unsigned i = 0; i < NodesPerChunk; ++i) {
+      chunk[i].parent = freeNodes;
+      freeNodes = &chunk[i];
+    }
+  }
+  Node *n = freeNodes;
+  freeNodes = n->parent;
+  n->parent = parent;
+  n->left = 0;
+  n->right = 0;
+  n->data = data;
+  return n;
+}
+
+void PTree::freeNode(Node *n) {
+  n->parent = freeNodes;
+  freeNodes = n;
+}
 
 std::pair<PTreeNode*, PTreeNode*>
 PTree::split(Node *n, 
              const data_type &leftData, 
              const data_type &rightData) {
   assert(n && !n->left && !n->right);
-  n->left = new Node(n, leftData);
-  n->right = new Node(n, rightData);
+  n->left = allocateNode(n, leftData);
+  n->right = allocateNode(n, rightData);
   return std::make_pair(n->left, n->right);
 }
 
 void PTree::remove(Node *n) {
   assert(!n->left && !n->right);
-  do {
-    Node *p = n->parent;
-    if (p) {
-      if (n == p->left) {
-        p->left = 0;
-      } else {
-        assert(n == p->right);
-        p->right = 0;
-      }
-    }
-    delete n;
-    n = p;
-  } while (n && !n->left && !n->right);
+  Node *p = n->parent;
+  freeNode(n);
+  if (!p) {
+    root = 0;
+    return;
+  }
+
+  // The other child of an inner node always remains, as the removal of the
+  // last state of a subtree replaces its root by the sibling subtree
+  Node *sibling;
+  if (n == p->left) {
+    sibling = p->right;
+  } else {
+    assert(n == p->right);
+    sibling = p->left;
+  }
+  assert(sibling && "inner node with a single child");
+
+  Node *grandparent = p->parent;
+  sibling->parent = grandparent;
+  if (!grandparent) {
+    root = sibling;
+  } else if (p == grandparent->left) {
+    grandparent->left = sibling;
+  } else {
+    grandparent->right = sibling;
+  }
+  freeNode(p);
 }
 
 void PTree::dump(llvm::raw_ostream &os) {
-  ExprPPrinter *pp = ExprPPrinter::create(os);
-  pp->setNewline("\\l");
   os << "digraph G {\n";
   os << "\tsize=\"10,7.5\";\n";
   os << "\tratio=fill;\n";
@@ -61,17 +101,12 @@ void PTree::dump(llvm::raw_ostream &os) {
   os << "\tnode [style=\"filled\",width=.1,height=.1,fontname=\"Terminus\"]\n";
   os << "\tedge [arrowsize=.3]\n";
   std::vector<PTree::Node*> stack;
-  stack.push_back(root);
+  if (root)
+    stack.push_back(root);
   while (!stack.empty()) {
     PTree::Node *n = stack.back();
     stack.pop_back();
-    if (n->condition.isNull()) {
-      os << "\tn" << n << " [label=\"\"";
-    } else {
-      os << "\tn" << n << " [label=\"";
-      pp->print(n->condition);
-      os << "\",shape=diamond";
-    }
+    os << "\tn" << n << " [label=\"\"";
     if (n->data)
       os << ",fillcolor=green";
     os << "];\n";
@@ -85,7 +120,6 @@ void PTree::dump(llvm::raw_ostream &os) {
     }
   }
   os << "}\n";
-  delete pp;
 }
 
 void PTree::dump() {
@@ -111,19 +145,7 @@ void PTree::print(llvm::raw_ostream& stream) {
   llvm::errs() << "------------------------- PTree Structure ---------------------------\n";
   stream << this->root;
   stream << "\n";
-  this->printNode(stream, this->root, "");
-}
-
-
-PTreeNode::PTreeNode(PTreeNode *_parent, 
-                     ExecutionState *_data) 
-  : parent(_parent),
-    left(0),
-    right(0),
-    data(_data),
-    condition(0) {
-}
-
-PTreeNode::~PTreeNode() {
+  if (this->root)
+    this->printNode(stream, this->root, "");
 }
 
@@ -12,13 +12,31 @@
 
 #include <klee/Expr.h>
 
+#include <vector>
+
 namespace klee {
   class ExecutionState;
   class PTreeNode;
 
+  /// The tree of the forks of the states. The nodes are allocated from a
+  /// pool, and an inner node left with a single child by the removal of a
+  /// state is replaced by the child, so that only the branching nodes are
+  /// walked from the root to a state.
   class PTree { 
     typedef ExecutionState* data_type;
 
+    /// The number of nodes allocated at once by the pool
+    static const unsigned NodesPerChunk = 4096;
+
+    std::vector<PTreeNode *> chunks;
+
+    /// The freed nodes, linked by their parent
+    PTreeNode *freeNodes;
+
+    PTreeNode *allocateNode(PTreeNode *parent, ExecutionState *data);
+
+    void freeNode(PTreeNode *n);
+
     void printNode(llvm::raw_ostream& stream, PTreeNode *n, std::string edges);
 
   public:
@@ -41,15 +59,9 @@ namespace klee {
   };
 
   class PTreeNode {
-    friend class PTree;
   public:
     PTreeNode *parent, *left, *right;
     ExecutionState *data;
-    ref<Expr> condition;
-
-  private:
-    PTreeNode(PTreeNode *_parent, ExecutionState *_data);
-    ~PTreeNode();
   };
 }
 
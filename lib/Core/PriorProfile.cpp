@@ -0,0 +1,127 @@
+//===--- PriorProfile.cpp - Profile of an earlier run ---------------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the profile of an earlier run
+/// loaded with -prior-istats.
+///
+//===----------------------------------------------------------------------===//
+
+#include "PriorProfile.h"
+
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <ctype.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+using namespace klee;
+
+std::vector<uint64_t> PriorProfile::instructions;
+
+std::vector<uint64_t> PriorProfile::forks;
+
+std::vector<uint64_t> PriorProfile::queryTime;
+
+bool PriorProfile::load(const std::string &fileName, KModule *kmodule) {
+  std::ifstream in(fileName.c_str());
+  if (!in) {
+    klee_warning("cannot read prior istats file %s", fileName.c_str());
+    return false;
+  }
+
+  std::map<unsigned, unsigned> blockOfLine;
+  for (std::vector<KFunction *>::iterator it = kmodule->functions.begin(),
+                                          ie = kmodule->functions.end();
+       it != ie; ++it) {
+    KFunction *kf = *it;
+    for (unsigned i = 0; i < kf->numInstructions; ++i)
+      blockOfLine[kf->instructions[i]->info->assemblyLine] =
+          kf->instructions[i]->basicBlockId;
+  }
+
+  instructions.assign(kmodule->numBasicBlocks, 0);
+  forks.assign(kmodule->numBasicBlocks, 0);
+  queryTime.assign(kmodule->numBasicBlocks, 0);
+
+  // The columns of the counters follow those of the assembly and source
+  // lines
+  int instructionsColumn = -1, forksColumn = -1, queryTimeColumn = -1;
+  unsigned unknownLines = 0;
+  bool callSite = false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.compare(0, 8, "events: ") == 0) {
+      std::istringstream events(line.substr(8));
+      std::string event;
+      for (int column = 0; events >> event; ++column) {
+        if (event == "I")
+          instructionsColumn = column;
+        else if (event == "Forks")
+          forksColumn = column;
+        else if (event == "Qtime")
+          queryTimeColumn = column;
+      }
+      continue;
+    }
+    // The counters of a call site follow its calls= line, and are already
+    // counted in the callee
+    if (line.compare(0, 6, "calls=") == 0) {
+      callSite = true;
+      continue;
+    }
+    if (line.empty() || !isdigit(line[0]))
+      continue;
+    if (callSite) {
+      callSite = false;
+      continue;
+    }
+
+    std::istringstream record(line);
+    unsigned assemblyLine, sourceLine;
+    if (!(record >> assemblyLine >> sourceLine))
+      continue;
+    std::map<unsigned, unsigned>::iterator block =
+        blockOfLine.find(assemblyLine);
+    if (block == blockOfLine.end()) {
+      ++unknownLines;
+      continue;
+    }
+    uint64_t value;
+    for (int column = 0; record >> value; ++column) {
+      if (column == instructionsColumn)
+        instructions[block->second] += value;
+      else if (column == forksColumn)
+        forks[block->second] += value;
+      else if (column == queryTimeColumn)
+        queryTime[block->second] += value;
+    }
+  }
+
+  if (instructionsColumn < 0) {
+    klee_warning("no instruction counts in prior istats file %s",
+                 fileName.c_str());
+    instructions.clear();
+    return false;
+  }
+  if (unknownLines)
+    klee_warning("%u lines of prior istats file %s are not of this module",
+                 unknownLines, fileName.c_str());
+  return true;
+}
+
+double PriorProfile::getQueryCost(unsigned bbId) {
+  if (bbId >= instructions.size() || !instructions[bbId])
+    return 0.;
+  return (double)queryTime[bbId] / instructions[bbId];
+}
@@ -0,0 +1,60 @@
+//===--- PriorProfile.h - Profile of an earlier run -------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the profile of an earlier run
+/// loaded with -prior-istats.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PRIORPROFILE_H
+#define KLEE_PRIORPROFILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace klee {
+class KModule;
+
+/// \brief The profile of an earlier run on the same module.
+///
+/// The counters of the run.istats file of the earlier run are summed per
+/// basic block, the instructions being identified by their assembly lines.
+/// The query time per executed instruction of a block weighs the states
+/// under -search=nurs:prior, and the blocks that forked are added to the
+/// subsumption points under -subsumption-points=loops or joins, as the
+/// subtrees below them are those worth pruning.
+class PriorProfile {
+  /// \brief The instructions executed in each basic block
+  static std::vector<uint64_t> instructions;
+
+  /// \brief The forks in each basic block
+  static std::vector<uint64_t> forks;
+
+  /// \brief The query time in each basic block, in microseconds
+  static std::vector<uint64_t> queryTime;
+
+public:
+  /// \brief Load the run.istats file, returning false when it cannot be read
+  static bool load(const std::string &fileName, KModule *kmodule);
+
+  static bool isLoaded() { return !instructions.empty(); }
+
+  static uint64_t getForks(unsigned bbId) {
+    return bbId < forks.size() ? forks[bbId] : 0;
+  }
+
+  /// \brief The query time per instruction executed in the block, in
+  /// microseconds, zero for a block the earlier run did not reach
+  static double getQueryCost(unsigned bbId);
+};
+}
+
+#endif
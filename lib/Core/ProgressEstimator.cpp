@@ -0,0 +1,44 @@
+//===--- ProgressEstimator.cpp - Estimates of the exploration progress ----===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the online estimates of the
+/// progress of the exploration written with -estimate-progress.
+///
+//===----------------------------------------------------------------------===//
+
+#include "ProgressEstimator.h"
+
+#include <math.h>
+
+using namespace klee;
+
+double ProgressEstimator::completedFraction = 0.;
+
+double ProgressEstimator::knuthSum = 0.;
+
+uint64_t ProgressEstimator::terminatedPaths = 0;
+
+void ProgressEstimator::recordTermination(unsigned depth) {
+  completedFraction += ldexp(1., -(int)depth);
+  knuthSum += ldexp(1., depth);
+  ++terminatedPaths;
+}
+
+double ProgressEstimator::getCompletedFraction() {
+  // Multi-way forks and merges make the sum inexact
+  return completedFraction < 1. ? completedFraction : 1.;
+}
+
+double ProgressEstimator::getRemainingTime(double elapsed) {
+  double fraction = getCompletedFraction();
+  if (fraction <= 0.)
+    return -1.;
+  return elapsed * (1. - fraction) / fraction;
+}
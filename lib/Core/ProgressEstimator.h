@@ -0,0 +1,61 @@
+//===--- ProgressEstimator.h - Estimates of the exploration progress ------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the online estimates of the
+/// progress of the exploration written with -estimate-progress.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_PROGRESSESTIMATOR_H
+#define KLEE_PROGRESSESTIMATOR_H
+
+#include <stdint.h>
+
+namespace klee {
+
+/// \brief Online estimates of the size of the execution tree and of the
+/// remaining time.
+///
+/// Each fork splits the probability mass of its parent between its two
+/// sides, so that a terminated path of depth d, in number of forks, has
+/// completed 2^-d of the tree. The sum over the terminated paths, including
+/// the subsumed ones whose subtrees are pruned, is the completed fraction of
+/// the tree, from which the remaining time is extrapolated. Each terminated
+/// path is also a probe of Knuth's estimator, estimating 2^d paths; the mean
+/// over the paths is biased by the search order, as the probes are not
+/// random, but converges as the tree completes.
+class ProgressEstimator {
+  static double completedFraction;
+
+  static double knuthSum;
+
+  static uint64_t terminatedPaths;
+
+public:
+  /// \brief Record the termination of a path of the given depth
+  static void recordTermination(unsigned depth);
+
+  /// \brief The fraction of the tree completed, in [0, 1]
+  static double getCompletedFraction();
+
+  /// \brief The estimated number of paths of the tree
+  static double getEstimatedPaths() {
+    return terminatedPaths ? knuthSum / terminatedPaths : 0.;
+  }
+
+  static uint64_t getTerminatedPaths() { return terminatedPaths; }
+
+  /// \brief The estimated remaining time in seconds, given the time elapsed,
+  /// or -1 before a path terminates
+  static double getRemainingTime(double elapsed);
+};
+}
+
+#endif
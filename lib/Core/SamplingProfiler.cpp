@@ -0,0 +1,201 @@
+//===--- SamplingProfiler.cpp - Sampling profiler of the executor ---------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the sampling profiler enabled
+/// with -sampling-profile-interval.
+///
+//===----------------------------------------------------------------------===//
+
+#include "SamplingProfiler.h"
+
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#else
+#include "llvm/BasicBlock.h"
+#include "llvm/Function.h"
+#include "llvm/Instruction.h"
+#endif
+
+#include "llvm/Support/CommandLine.h"
+
+#include <signal.h>
+#include <sys/time.h>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+cl::opt<unsigned> SamplingProfileInterval(
+    "sampling-profile-interval",
+    cl::desc("Sample the executed instruction, executor phase and state depth "
+             "every given microseconds of CPU time, and write the samples as "
+             "folded stacks to profile.folded (default=0 (off))"),
+    cl::init(0));
+}
+
+SamplingProfiler::Sample SamplingProfiler::ring[SamplingProfiler::RingSize];
+
+volatile unsigned SamplingProfiler::head = 0;
+
+unsigned SamplingProfiler::tail = 0;
+
+volatile unsigned SamplingProfiler::droppedCount = 0;
+
+bool SamplingProfiler::running = false;
+
+std::map<SamplingProfiler::Sample, uint64_t> SamplingProfiler::counts;
+
+const KInstruction *volatile SamplingProfiler::instruction = 0;
+
+volatile unsigned SamplingProfiler::phases = 0;
+
+volatile unsigned SamplingProfiler::depth = 0;
+
+void SamplingProfiler::onSignal(int) {
+  unsigned h = head;
+  // The ring is full until it is drained: drop the sample rather than
+  // overwriting the samples not yet counted.
+  if (h - tail >= RingSize) {
+    ++droppedCount;
+    return;
+  }
+  Sample &s = ring[h & (RingSize - 1)];
+  s.instruction = instruction;
+  s.phases = phases;
+  s.depth = depth;
+  head = h + 1;
+}
+
+bool SamplingProfiler::enabled() { return SamplingProfileInterval != 0; }
+
+void SamplingProfiler::start() {
+  if (!enabled() || running)
+    return;
+
+  struct sigaction sa;
+  sa.sa_handler = onSignal;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  if (::sigaction(SIGPROF, &sa, 0) != 0) {
+    klee_warning("unable to install the sampling profiler signal handler");
+    return;
+  }
+
+  struct itimerval t;
+  t.it_interval.tv_sec = SamplingProfileInterval / 1000000;
+  t.it_interval.tv_usec = SamplingProfileInterval % 1000000;
+  t.it_value = t.it_interval;
+  if (::setitimer(ITIMER_PROF, &t, 0) != 0) {
+    klee_warning("unable to start the sampling profiler timer");
+    return;
+  }
+  running = true;
+}
+
+void SamplingProfiler::stop() {
+  if (!running)
+    return;
+
+  struct itimerval t;
+  t.it_interval.tv_sec = t.it_interval.tv_usec = 0;
+  t.it_value = t.it_interval;
+  ::setitimer(ITIMER_PROF, &t, 0);
+  ::signal(SIGPROF, SIG_IGN);
+  running = false;
+
+  drain();
+}
+
+void SamplingProfiler::drain() {
+  sigset_t set, old;
+  sigemptyset(&set);
+  sigaddset(&set, SIGPROF);
+  sigprocmask(SIG_BLOCK, &set, &old);
+
+  unsigned h = head;
+  for (; tail != h; ++tail) {
+    Sample s = ring[tail & (RingSize - 1)];
+    // Bucket the depths by powers of two, so that the stacks of deep states
+    // do not each get a separate frame.
+    unsigned bucket = 0;
+    while ((1u << bucket) <= s.depth && bucket < 31)
+      ++bucket;
+    s.depth = bucket;
+    ++counts[s];
+  }
+
+  sigprocmask(SIG_SETMASK, &old, 0);
+}
+
+static const char *getPhaseName(unsigned phase) {
+  switch (phase) {
+  case SamplingProfiler::Solver:
+    return "solver";
+  case SamplingProfiler::Subsumption:
+    return "subsumption";
+  case SamplingProfiler::Split:
+    return "split";
+  case SamplingProfiler::WeakestPrecondition:
+    return "wp";
+  case SamplingProfiler::MemoryOperation:
+    return "memory";
+  default:
+    return "unknown";
+  }
+}
+
+void SamplingProfiler::write(llvm::raw_ostream &os) {
+  drain();
+
+  uint64_t total = 0;
+  for (std::map<Sample, uint64_t>::iterator it = counts.begin(),
+                                            ie = counts.end();
+       it != ie; ++it) {
+    const Sample &s = it->first;
+
+    // The phases are nested outermost first, from the most significant
+    // nibble to the least significant one.
+    os << "interpreter";
+    unsigned n = 0;
+    for (unsigned p = s.phases; p; p >>= 4)
+      ++n;
+    for (unsigned i = n; i > 0; --i)
+      os << ";" << getPhaseName((s.phases >> (4 * (i - 1))) & 0xF);
+
+    if (s.depth == 0)
+      os << ";depth 0";
+    else
+      os << ";depth " << (1u << (s.depth - 1)) << "-"
+         << ((1u << s.depth) - 1);
+
+    if (const KInstruction *ki = s.instruction) {
+      os << ";" << ki->inst->getParent()->getParent()->getName();
+      if (ki->info->file != "")
+        os << ";" << ki->info->file << ":" << ki->info->line;
+      else
+        os << ";[assembly]:" << ki->info->assemblyLine;
+    } else {
+      os << ";[no instruction]";
+    }
+    os << " " << it->second << "\n";
+    total += it->second;
+  }
+
+  if (droppedCount)
+    klee_warning("sampling profiler dropped %u samples", droppedCount);
+  klee_message("sampling profiler recorded %lu samples",
+               (unsigned long)total);
+}
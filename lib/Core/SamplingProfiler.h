@@ -0,0 +1,118 @@
+//===--- SamplingProfiler.h - Sampling profiler of the executor -*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the sampling profiler enabled with
+/// -sampling-profile-interval.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SAMPLINGPROFILER_H
+#define KLEE_SAMPLINGPROFILER_H
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <stdint.h>
+
+namespace klee {
+struct KInstruction;
+
+/// \brief Sampling profiler of the executor.
+///
+/// A CPU-time interval timer signal records the instruction being executed,
+/// the nesting of the executor phases it is in and the depth of its state
+/// into a ring buffer. The executor only stores the instruction and depth
+/// before each instruction, and the phase scopes only store the phase, so
+/// that the profiler can be enabled on production runs. The ring buffer is
+/// drained into the sample counts by a timer of the executor, and the counts
+/// are written at exit as folded stacks, the input of flamegraph.pl.
+class SamplingProfiler {
+public:
+  /// \brief The phases nested in the interpretation of an instruction. A
+  /// phase is stored as a nibble of the phase stack, where zero is empty.
+  enum Phase {
+    Solver = 1,
+    Subsumption,
+    Split,
+    WeakestPrecondition,
+    MemoryOperation
+  };
+
+  /// \brief Nesting of a phase for the lifetime of the object
+  class PhaseScope {
+    unsigned savedPhases;
+
+  public:
+    PhaseScope(Phase phase) : savedPhases(phases) {
+      phases = (savedPhases << 4) | phase;
+    }
+    ~PhaseScope() { phases = savedPhases; }
+  };
+
+private:
+  struct Sample {
+    const KInstruction *instruction;
+    unsigned phases;
+    unsigned depth;
+
+    bool operator<(const Sample &b) const {
+      if (instruction != b.instruction)
+        return instruction < b.instruction;
+      if (phases != b.phases)
+        return phases < b.phases;
+      return depth < b.depth;
+    }
+  };
+
+  static const unsigned RingSize = 1 << 16;
+
+  static Sample ring[RingSize];
+
+  /// \brief The number of samples recorded and drained so far
+  static volatile unsigned head;
+  static unsigned tail;
+
+  static volatile unsigned droppedCount;
+
+  static bool running;
+
+  /// \brief The sample counts by instruction, phases and depth bucket
+  static std::map<Sample, uint64_t> counts;
+
+  static void onSignal(int);
+
+  /// \brief The current sample, as updated by the executor
+  static const KInstruction *volatile instruction;
+  static volatile unsigned phases;
+  static volatile unsigned depth;
+
+public:
+  static bool enabled();
+
+  /// \brief Start the timer, if -sampling-profile-interval is set
+  static void start();
+
+  /// \brief Stop the timer and drain the remaining samples
+  static void stop();
+
+  /// \brief Move the samples of the ring buffer into the counts
+  static void drain();
+
+  static void setInstruction(const KInstruction *ki, unsigned _depth) {
+    instruction = ki;
+    depth = _depth;
+  }
+
+  /// \brief Write the counts as folded stacks
+  static void write(llvm::raw_ostream &os);
+};
+}
+
+#endif
@@ -12,7 +12,9 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "PTree.h"
+#include "PriorProfile.h"
 #include "StatsTracker.h"
+#include "TxTree.h"
 
 #include "klee/ExecutionState.h"
 #include "klee/Statistics.h"
@@ -41,6 +43,7 @@
 #include "llvm/IR/CallSite.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
 #include <fstream>
 #include <climits>
@@ -51,6 +54,12 @@ using namespace llvm;
 namespace {
   cl::opt<bool>
   DebugLogMerge("debug-log-merge");
+
+  cl::opt<unsigned>
+  InterpolationSearchWindow("interpolation-search-window",
+                            cl::desc("Number of most recent states considered "
+                                     "by --search=interpolation (default=32)"),
+                            cl::init(32));
 }
 
 namespace klee {
@@ -62,6 +71,55 @@ Searcher::~Searcher() {
 
 ///
 
+void OrderedStates::add(ExecutionState *es) {
+  positions[es] = first + states.size();
+  states.push_back(es);
+}
+
+void OrderedStates::remove(ExecutionState *es) {
+  llvm::DenseMap<ExecutionState *, uint64_t>::iterator it = positions.find(es);
+  assert(it != positions.end() && "invalid state removed");
+  states[it->second - first] = 0;
+  positions.erase(it);
+  ++removed;
+
+  // Keep a state at both ends, for the selection and for empty()
+  while (!states.empty() && !states.back()) {
+    states.pop_back();
+    --removed;
+  }
+  while (!states.empty() && !states.front()) {
+    states.pop_front();
+    ++first;
+    --removed;
+  }
+  if (removed > 32 && 2 * removed > states.size())
+    compact();
+}
+
+void OrderedStates::compact() {
+  states.erase(std::remove(states.begin(), states.end(),
+                           (ExecutionState *)0),
+               states.end());
+  first = 0;
+  removed = 0;
+  for (unsigned i = 0; i < states.size(); ++i)
+    positions[states[i]] = i;
+}
+
+std::vector<ExecutionState *> OrderedStates::getStates() const {
+  std::vector<ExecutionState *> result;
+  result.reserve(states.size() - removed);
+  for (std::deque<ExecutionState *>::const_iterator it = states.begin(),
+                                                    ie = states.end();
+       it != ie; ++it)
+    if (*it)
+      result.push_back(*it);
+  return result;
+}
+
+///
+
 ExecutionState &DFSSearcher::selectState() {
   return *states.back();
 }
@@ -69,30 +127,14 @@ ExecutionState &DFSSearcher::selectState() {
 void DFSSearcher::update(ExecutionState *current,
                          const std::vector<ExecutionState *> &addedStates,
                          const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it)
+    states.add(*it);
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
-       it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.back()) {
-      states.pop_back();
-    } else {
-      bool ok = false;
-
-      for (std::vector<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      assert(ok && "invalid state removed");
-    }
-  }
+       it != ie; ++it)
+    states.remove(*it);
 }
 
 ///
@@ -104,30 +146,14 @@ ExecutionState &BFSSearcher::selectState() {
 void BFSSearcher::update(ExecutionState *current,
                          const std::vector<ExecutionState *> &addedStates,
                          const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it)
+    states.add(*it);
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
-       it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.front()) {
-      states.pop_front();
-    } else {
-      bool ok = false;
-
-      for (std::deque<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      assert(ok && "invalid state removed");
-    }
-  }
+       it != ie; ++it)
+    states.remove(*it);
 }
 
 ///
@@ -166,7 +192,7 @@ RandomSearcher::update(ExecutionState *current,
 
 WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   : states(new DiscretePDF<ExecutionState*>()),
-    type(_type) {
+    type(_type), weightEpoch(getMinDistToUncoveredEpoch()) {
   switch(type) {
   case Depth: 
     updateWeights = false;
@@ -176,6 +202,7 @@ WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   case QueryCost:
   case MinDistToUncovered:
   case CoveringNew:
+  case PriorQueryCost:
     updateWeights = true;
     break;
   default:
@@ -210,6 +237,13 @@ double WeightedRandomSearcher::getWeight(ExecutionState *es) {
   }
   case QueryCost:
     return (es->queryCost < .1) ? 1. : 1./es->queryCost;
+  case PriorQueryCost: {
+    // The query time per instruction of the block in the earlier run, in
+    // milliseconds, the blocks it did not reach weighing most
+    double cost = PriorProfile::getQueryCost(es->pc->basicBlockId) / 1000.;
+    double inv = 1. / (1. + cost);
+    return inv * inv;
+  }
   case CoveringNew:
   case MinDistToUncovered: {
     uint64_t md2u = computeMinDistToUncovered(es->pc,
@@ -228,10 +262,30 @@ double WeightedRandomSearcher::getWeight(ExecutionState *es) {
   }
 }
 
+struct WeightedRandomSearcher::StateWeight {
+  WeightedRandomSearcher *searcher;
+
+  StateWeight(WeightedRandomSearcher *_searcher) : searcher(_searcher) {}
+
+  double operator()(ExecutionState *es) { return searcher->getWeight(es); }
+};
+
 void WeightedRandomSearcher::update(
     ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
     const std::vector<ExecutionState *> &removedStates) {
-  if (current && updateWeights &&
+  // The weights derived from the distances to uncovered instructions are
+  // stale for every state once the distances change, and for no state
+  // otherwise, so they are invalidated by epoch and recomputed in a batch.
+  bool reweighAll = false;
+  if (updateWeights && (type == MinDistToUncovered || type == CoveringNew)) {
+    unsigned epoch = getMinDistToUncoveredEpoch();
+    if (epoch != weightEpoch) {
+      weightEpoch = epoch;
+      reweighAll = true;
+    }
+  }
+
+  if (current && updateWeights && !reweighAll &&
       std::find(removedStates.begin(), removedStates.end(), current) ==
           removedStates.end())
     states->update(current, getWeight(current));
@@ -248,6 +302,11 @@ void WeightedRandomSearcher::update(
        it != ie; ++it) {
     states->remove(*it);
   }
+
+  if (reweighAll) {
+    StateWeight weightOf(this);
+    states->updateAll(weightOf);
+  }
 }
 
 bool WeightedRandomSearcher::empty() { 
@@ -263,16 +322,65 @@ RandomPathSearcher::RandomPathSearcher(Executor &_executor)
 RandomPathSearcher::~RandomPathSearcher() {
 }
 
+ExecutionState &RandomPathSearcher::selectRunningState() {
+  unsigned size = executor.states.size();
+  unsigned start = theRNG.getInt32() % size;
+  for (unsigned i = 0; i < size; ++i) {
+    ExecutionState *es = executor.states[(start + i) % size];
+    if (!executor.parkedStates.count(es))
+      return *es;
+  }
+  assert(0 && "all the states are parked");
+  return *executor.states[start];
+}
+
 ExecutionState &RandomPathSearcher::selectState() {
   unsigned flips=0, bits=0;
-  PTree::Node *n = executor.processTree->root;
-  
-  while (!n->data) {
-    if (!n->left) {
-      n = n->right;
-    } else if (!n->right) {
-      n = n->left;
-    } else {
+  // The walks that end at a parked state, after which a running state is
+  // sampled among the live states instead
+  unsigned parkedHits = 0;
+
+  // Under interpolation the states are the leaves of the interpolation tree,
+  // which stands for the process tree. A removed state may leave a chain of
+  // nodes with a single child, and a failed speculation a leaf without one.
+  if (!executor.processTree) {
+    ExecutionState *es;
+    do {
+      TxTreeNode *n = executor.txTree->root;
+      while (n->getLeft() || n->getRight()) {
+        if (!n->getLeft()) {
+          n = n->getRight();
+        } else if (!n->getRight()) {
+          n = n->getLeft();
+        } else {
+          if (bits==0) {
+            flips = theRNG.getInt32();
+            bits = 32;
+          }
+          --bits;
+          n = (flips&(1<<bits)) ? n->getLeft() : n->getRight();
+        }
+      }
+      es = n->getState();
+      if (es && (!executor.states.count(es) || es->txTreeNode != n))
+        es = 0;
+      if (es && executor.parkedStates.count(es)) {
+        if (++parkedHits == MaxParkedHits)
+          return selectRunningState();
+        es = 0;
+      }
+    } while (!es);
+    return *es;
+  }
+
+  PTree::Node *n;
+
+  // The states parked at the memory cap are still leaves of the process
+  // tree, pick again when one is hit. The inner nodes of the tree are kept
+  // with two children.
+  while (true) {
+    n = executor.processTree->root;
+    while (!n->data) {
       if (bits==0) {
         flips = theRNG.getInt32();
         bits = 32;
@@ -280,9 +388,11 @@ ExecutionState &RandomPathSearcher::selectState() {
       --bits;
       n = (flips&(1<<bits)) ? n->left : n->right;
     }
+    if (!executor.parkedStates.count(n->data))
+      return *n->data;
+    if (++parkedHits == MaxParkedHits)
+      return selectRunningState();
   }
-
-  return *n->data;
 }
 
 void
@@ -292,7 +402,72 @@ RandomPathSearcher::update(ExecutionState *current,
 }
 
 bool RandomPathSearcher::empty() { 
-  return executor.states.empty(); 
+  return executor.states.size() == executor.parkedStates.size();
+}
+
+///
+
+unsigned InterpolationSearcher::getScore(ExecutionState *es) {
+  TxTreeNode *node = es->txTreeNode;
+  if (!node)
+    return 0;
+
+  unsigned score = 0;
+  if (TxSubsumptionTable::hasEntries(reinterpret_cast<uintptr_t>(es->pc->inst)))
+    score += 2;
+  if (!node->hasLiveSibling())
+    score += 1;
+  return score;
+}
+
+ExecutionState &InterpolationSearcher::selectState() {
+  if (selected)
+    return *selected;
+
+  // Scan the most recent states only, so that the search stays close to
+  // depth-first and the selection does not cost time linear in the number of
+  // states.
+  unsigned bestScore = 0;
+  selected = states.back();
+  unsigned window = std::min<size_t>(InterpolationSearchWindow, states.size());
+  for (std::vector<ExecutionState *>::reverse_iterator it = states.rbegin(),
+                                                       ie = it + window;
+       it != ie; ++it) {
+    unsigned score = getScore(*it);
+    if (score > bestScore) {
+      bestScore = score;
+      selected = *it;
+      if (score == 3)
+        break;
+    }
+  }
+  return *selected;
+}
+
+void
+InterpolationSearcher::update(ExecutionState *current,
+                              const std::vector<ExecutionState *> &addedStates,
+                              const std::vector<ExecutionState *> &removedStates) {
+  // New states or completed subtrees may change the preferred state.
+  if (!addedStates.empty() || !removedStates.empty())
+    selected = 0;
+
+  states.insert(states.end(),
+                addedStates.begin(),
+                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
+                                                     ie = removedStates.end();
+       it != ie; ++it) {
+    ExecutionState *es = *it;
+    if (es == states.back()) {
+      states.pop_back();
+    } else {
+      std::vector<ExecutionState *>::iterator pos =
+          std::find(states.begin(), states.end(), es);
+      assert(pos != states.end() && "invalid state removed");
+      states.erase(pos);
+    }
+  }
 }
 
 ///
@@ -506,6 +681,93 @@ MergingSearcher::update(ExecutionState *current,
 
 ///
 
+LoopMergingSearcher::LoopMergingSearcher(Executor &_executor,
+                                         Searcher *_baseSearcher)
+    : executor(_executor), baseSearcher(_baseSearcher) {}
+
+LoopMergingSearcher::~LoopMergingSearcher() { delete baseSearcher; }
+
+Instruction *LoopMergingSearcher::getMergePoint(ExecutionState &es) {
+  Instruction *i = es.pc->inst;
+  if (i != &i->getParent()->front() ||
+      !(executor.kmodule->basicBlockKinds[es.pc->basicBlockId] &
+        KModule::LoopHeader))
+    return 0;
+  return i;
+}
+
+ExecutionState &LoopMergingSearcher::selectState() {
+  for (;;) {
+    // out of base states, bump a waiting state
+    if (baseSearcher->empty()) {
+      std::map<Instruction *, ExecutionState *>::iterator it =
+          statesAtMerge.begin();
+      ExecutionState *es = it->second;
+      statesAtMerge.erase(it);
+      bumped.insert(es);
+      baseSearcher->addState(es);
+    }
+
+    ExecutionState &es = baseSearcher->selectState();
+    Instruction *mp = getMergePoint(es);
+    if (!mp || bumped.erase(&es))
+      return es;
+
+    baseSearcher->removeState(&es);
+    std::map<Instruction *, ExecutionState *>::iterator it =
+        statesAtMerge.find(mp);
+    if (it == statesAtMerge.end()) {
+      statesAtMerge.insert(std::make_pair(mp, &es));
+      continue;
+    }
+
+    // The phi nodes of the loop head select their values by the block the
+    // state comes from
+    ExecutionState *mergeWith = it->second;
+    if (mergeWith->incomingBBIndex == es.incomingBBIndex &&
+        mergeWith->merge(es)) {
+      if (INTERPOLATION_ENABLED) {
+        mergeWith->txTreeNode->setMerged();
+        es.txTreeNode->setGenericEarlyTermination();
+      }
+      // as for BumpMergingSearcher, the terminated state is given back to
+      // the base searcher, which is told of its removal
+      baseSearcher->addState(&es);
+      executor.terminateState(es);
+    } else {
+      it->second = &es;
+      bumped.insert(mergeWith);
+      baseSearcher->addState(mergeWith);
+    }
+  }
+}
+
+void LoopMergingSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  // A waiting state is not in the base searcher. It is looked up by value,
+  // as the program counter of a terminated state is reset.
+  std::vector<ExecutionState *> alt;
+  for (std::vector<ExecutionState *>::const_iterator
+           it = removedStates.begin(),
+           ie = removedStates.end();
+       it != ie; ++it) {
+    ExecutionState *es = *it;
+    bumped.erase(es);
+    std::map<Instruction *, ExecutionState *>::iterator it2 =
+        statesAtMerge.begin();
+    while (it2 != statesAtMerge.end() && it2->second != es)
+      ++it2;
+    if (it2 != statesAtMerge.end())
+      statesAtMerge.erase(it2);
+    else
+      alt.push_back(es);
+  }
+  baseSearcher->update(current, addedStates, alt);
+}
+
+///
+
 BatchingSearcher::BatchingSearcher(Searcher *_baseSearcher,
                                    double _timeBudget,
                                    unsigned _instructionBudget) 
@@ -10,6 +10,7 @@
 #ifndef KLEE_SEARCHER_H
 #define KLEE_SEARCHER_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/raw_ostream.h"
 #include <vector>
 #include <set>
@@ -40,6 +41,11 @@ namespace klee {
 
     virtual bool empty() = 0;
 
+    /// Whether the searcher has to be updated for the current state when no
+    /// state is added or removed, e.g. to reweigh it. The executor otherwise
+    /// skips the update after the steps that do not change the states.
+    virtual bool updatesCurrent() { return true; }
+
     // prints name of searcher as a klee_message()
     // TODO: could probably make prettier or more flexible
     virtual void printName(llvm::raw_ostream &os) {
@@ -80,40 +86,77 @@ namespace klee {
       NURS_Depth,
       NURS_ICnt,
       NURS_CPICnt,
-      NURS_QC
+      NURS_QC,
+      NURS_Prior,
+      Interpolation
     };
   };
 
+  /// The states of DFSSearcher and BFSSearcher in the order they were
+  /// added. A removed state leaves a null in its place, found through the
+  /// positions of the states, and the nulls are dropped once they are half
+  /// of the list, so that removing many states at once, as subsumption and
+  /// the speculation do, takes time linear in their number rather than in
+  /// the number of states times theirs.
+  class OrderedStates {
+    std::deque<ExecutionState *> states;
+
+    /// The position of each state, counted from the first state ever added
+    llvm::DenseMap<ExecutionState *, uint64_t> positions;
+
+    /// The number of positions popped from the front
+    uint64_t first;
+
+    unsigned removed;
+
+    void compact();
+
+  public:
+    OrderedStates() : first(0), removed(0) {}
+
+    void add(ExecutionState *es);
+    void remove(ExecutionState *es);
+
+    bool empty() const { return states.empty(); }
+    ExecutionState *front() const { return states.front(); }
+    ExecutionState *back() const { return states.back(); }
+    std::vector<ExecutionState *> getStates() const;
+  };
+
   class DFSSearcher : public Searcher {
-    std::vector<ExecutionState*> states;
+    OrderedStates states;
 
   public:
     ExecutionState &selectState();
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return false; }
     bool empty() { return states.empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "DFSSearcher\n";
     }
 
-    virtual std::vector<ExecutionState *> getStates() { return states; }
+    virtual std::vector<ExecutionState *> getStates() {
+      return states.getStates();
+    }
   };
 
   class BFSSearcher : public Searcher {
-    std::deque<ExecutionState*> states;
+    OrderedStates states;
 
   public:
     ExecutionState &selectState();
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return false; }
     bool empty() { return states.empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "BFSSearcher\n";
     }
     virtual std::vector<ExecutionState *> getStates() {
-      return std::vector<ExecutionState *>(states.begin(), states.end());
+      return states.getStates();
     }
   };
 
@@ -125,6 +168,7 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return false; }
     bool empty() { return states.empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "RandomSearcher\n";
@@ -141,13 +185,19 @@ namespace klee {
       InstCount,
       CPInstCount,
       MinDistToUncovered,
-      CoveringNew
+      CoveringNew,
+      PriorQueryCost
     };
 
   private:
     DiscretePDF<ExecutionState*> *states;
     WeightType type;
     bool updateWeights;
+    /// The distance epoch the weights of all the states were computed in,
+    /// for the weights derived from the distances to uncovered instructions
+    unsigned weightEpoch;
+
+    struct StateWeight;
     
     double getWeight(ExecutionState*);
 
@@ -169,6 +219,7 @@ namespace klee {
       case CPInstCount        : os << "CPInstCount\n"; return;
       case MinDistToUncovered : os << "MinDistToUncovered\n"; return;
       case CoveringNew        : os << "CoveringNew\n"; return;
+      case PriorQueryCost     : os << "PriorQueryCost\n"; return;
       default                 : os << "<unknown type>\n"; return;
       }
     }
@@ -180,6 +231,13 @@ namespace klee {
   class RandomPathSearcher : public Searcher {
     Executor &executor;
 
+    /// The walks ending at parked states before a running state is sampled
+    /// among the live states
+    static const unsigned MaxParkedHits = 8;
+
+    /// Sample a running state uniformly among the live states
+    ExecutionState &selectRunningState();
+
   public:
     RandomPathSearcher(Executor &_executor);
     ~RandomPathSearcher();
@@ -188,6 +246,7 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return false; }
     bool empty();
     void printName(llvm::raw_ostream &os) {
       os << "RandomPathSearcher\n";
@@ -197,6 +256,38 @@ namespace klee {
 	}
   };
 
+  /// \brief A depth-first searcher that favors subsumption opportunities.
+  ///
+  /// Among the most recently added states, it prefers one whose next program
+  /// point already has subsumption table entries, as that state may be
+  /// subsumed right away, and next one whose sibling subtree has been
+  /// completely traversed, as finishing it tables the interpolant of the
+  /// parent. Ties, and states without a Tracer-X tree node, are resolved in
+  /// depth-first order.
+  class InterpolationSearcher : public Searcher {
+    std::vector<ExecutionState*> states;
+
+    /// \brief The state to keep running until the set of states changes
+    ExecutionState *selected;
+
+    unsigned getScore(ExecutionState *es);
+
+  public:
+    InterpolationSearcher() : selected(0) {}
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return false; }
+    bool empty() { return states.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "InterpolationSearcher\n";
+    }
+
+    virtual std::vector<ExecutionState *> getStates() { return states; }
+  };
+
   class MergingSearcher : public Searcher {
     Executor &executor;
     std::set<ExecutionState*> statesAtMerge;
@@ -214,6 +305,7 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return baseSearcher->updatesCurrent(); }
     bool empty() { return baseSearcher->empty() && statesAtMerge.empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "MergingSearcher\n";
@@ -240,6 +332,7 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return baseSearcher->updatesCurrent(); }
     bool empty() { return baseSearcher->empty() && statesAtMerge.empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "BumpMergingSearcher\n";
@@ -249,6 +342,45 @@ namespace klee {
 	}
   };
 
+  /// Merging of the states reaching the head of a loop, without klee_merge
+  /// markers. A state reaching a loop head waits there until another state
+  /// reaches it, and the two are merged if they are at the same stack and
+  /// come from the same block, so that the equivalent iterations of a loop
+  /// are explored once. Otherwise the waiting state is bumped by the new
+  /// one, and executes the loop head. With interpolation, a merged state is
+  /// no longer checked for subsumption and its interpolants, and those of
+  /// the ancestors of the merged states, are not tabled, as its path
+  /// condition and store are those of one of the merged states only.
+  class LoopMergingSearcher : public Searcher {
+    Executor &executor;
+    std::map<llvm::Instruction *, ExecutionState *> statesAtMerge;
+
+    /// The states bumped from a loop head, which execute it unmerged
+    std::set<ExecutionState *> bumped;
+
+    Searcher *baseSearcher;
+
+  private:
+    llvm::Instruction *getMergePoint(ExecutionState &es);
+
+  public:
+    LoopMergingSearcher(Executor &executor, Searcher *baseSearcher);
+    ~LoopMergingSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return baseSearcher->updatesCurrent(); }
+    bool empty() { return baseSearcher->empty() && statesAtMerge.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "LoopMergingSearcher\n";
+    }
+    virtual std::vector<ExecutionState *> getStates() {
+      return std::vector<ExecutionState *>();
+    }
+  };
+
   class BatchingSearcher : public Searcher {
     Searcher *baseSearcher;
     double timeBudget;
@@ -268,6 +400,7 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() { return baseSearcher->updatesCurrent(); }
     bool empty() { return baseSearcher->empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "<BatchingSearcher> timeBudget: " << timeBudget
@@ -317,6 +450,13 @@ namespace klee {
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
                 const std::vector<ExecutionState *> &removedStates);
+    bool updatesCurrent() {
+      for (searchers_ty::iterator it = searchers.begin(), ie = searchers.end();
+           it != ie; ++it)
+        if ((*it)->updatesCurrent())
+          return true;
+      return false;
+    }
     bool empty() { return searchers[0]->empty(); }
     void printName(llvm::raw_ostream &os) {
       os << "<InterleavedSearcher> containing "
@@ -13,10 +13,13 @@
 
 #include "klee/ExecutionState.h"
 #include "klee/Expr.h"
+#include "klee/util/CompiledExpr.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/Internal/ADT/KTest.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 
+#include <map>
+
 using namespace klee;
 
 KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
@@ -26,7 +29,7 @@ KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
     
     for (i=0; i<input->numObjects; ++i) {
       KTestObject *obj = &input->objects[i];
-      if (std::string(obj->name) == mo->name)
+      if (std::string(obj->name) == mo->getName())
         if (used.insert(obj).second)
           return obj;
     }
@@ -41,12 +44,12 @@ KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
       if (obj->numBytes == mo->size) {
         used.insert(obj);
         klee_warning_once(mo, "using seed input %s[%d] for: %s (no name match)",
-                          obj->name, obj->numBytes, mo->name.c_str());
+                          obj->name, obj->numBytes, mo->getName().c_str());
         return obj;
       }
     }
     
-    klee_warning_once(mo, "no seed input for: %s", mo->name.c_str());
+    klee_warning_once(mo, "no seed input for: %s", mo->getName().c_str());
     return 0;
   } else {
     if (inputPosition >= input->numObjects) {
@@ -166,3 +169,85 @@ void SeedInfo::patchSeed(const ExecutionState &state,
   }
 #endif
 }
+
+void SeedInfo::swap(SeedInfo &b) {
+  std::swap(assignment.allowFreeValues, b.assignment.allowFreeValues);
+  assignment.bindings.swap(b.assignment.bindings);
+  std::swap(input, b.input);
+  std::swap(inputPosition, b.inputPosition);
+  used.swap(b.used);
+}
+
+bool SeedInfo::evaluate(const ExecutionState &state, TimingSolver *solver,
+                        ref<Expr> e, std::vector<SeedInfo> &seeds,
+                        std::vector<ref<ConstantExpr> > &values) {
+  values.clear();
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(e)) {
+    values.resize(seeds.size(), CE);
+    return true;
+  }
+
+  // The bytes the expression reads: the constant indices of its reads, and
+  // the whole arrays it reads at symbolic indices.
+  std::vector<ref<ReadExpr> > reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  std::vector<std::pair<const Array *, unsigned> > bytes;
+  std::set<const Array *> wholeArrays;
+  for (std::vector<ref<ReadExpr> >::iterator it = reads.begin(),
+                                             ie = reads.end();
+       it != ie; ++it) {
+    const Array *array = (*it)->updates.root;
+    if (ConstantExpr *index = dyn_cast<ConstantExpr>((*it)->index))
+      bytes.push_back(std::make_pair(array, index->getZExtValue()));
+    else
+      wholeArrays.insert(array);
+  }
+
+  // The values of the seeds agreeing on the bytes, with -1 for the bytes a
+  // seed does not bind
+  std::map<std::vector<int>, ref<ConstantExpr> > results;
+  std::vector<int> key;
+  CompiledExpr compiled(e);
+  values.reserve(seeds.size());
+  for (std::vector<SeedInfo>::iterator it = seeds.begin(), ie = seeds.end();
+       it != ie; ++it) {
+    const Assignment::bindings_ty &bindings = it->assignment.bindings;
+    key.clear();
+    for (std::vector<std::pair<const Array *, unsigned> >::iterator
+             bit = bytes.begin(),
+             bie = bytes.end();
+         bit != bie; ++bit) {
+      Assignment::bindings_ty::const_iterator found =
+          bindings.find(bit->first);
+      key.push_back(found != bindings.end() &&
+                            bit->second < found->second.size()
+                        ? found->second[bit->second]
+                        : -1);
+    }
+    for (std::set<const Array *>::iterator ait = wholeArrays.begin(),
+                                           aie = wholeArrays.end();
+         ait != aie; ++ait) {
+      Assignment::bindings_ty::const_iterator found = bindings.find(*ait);
+      if (found == bindings.end()) {
+        key.push_back(-1);
+        continue;
+      }
+      key.push_back(found->second.size());
+      key.insert(key.end(), found->second.begin(), found->second.end());
+    }
+
+    std::map<std::vector<int>, ref<ConstantExpr> >::iterator result =
+        results.find(key);
+    if (result == results.end()) {
+      ref<ConstantExpr> value;
+      uint64_t constant;
+      if (compiled.evaluate(it->assignment, constant))
+        value = ConstantExpr::create(constant, e->getWidth());
+      else if (!solver->getValue(state, it->assignment.evaluate(e), value))
+        return false;
+      result = results.insert(std::make_pair(key, value)).first;
+    }
+    values.push_back(result->second);
+  }
+  return true;
+}
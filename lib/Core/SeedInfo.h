@@ -42,6 +42,19 @@ namespace klee {
     void patchSeed(const ExecutionState &state, 
                    ref<Expr> condition,
                    TimingSolver *solver);
+
+    /// Exchange the contents of two seeds, without copying their
+    /// assignments.
+    void swap(SeedInfo &b);
+
+    /// Compute the value of an expression with each of the seeds, as the
+    /// evaluation with the seed assignment followed by a value of the
+    /// solver when it leaves the expression symbolic. The expression is
+    /// evaluated once for all the seeds that agree on the bytes it reads.
+    /// Return false on a solver failure.
+    static bool evaluate(const ExecutionState &state, TimingSolver *solver,
+                         ref<Expr> e, std::vector<SeedInfo> &seeds,
+                         std::vector<ref<ConstantExpr> > &values);
   };
 }
 
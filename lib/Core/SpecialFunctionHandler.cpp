@@ -38,6 +38,7 @@
 #include "llvm/IR/DataLayout.h"
 #endif
 
+#include <algorithm>
 #include <errno.h>
 
 using namespace llvm;
@@ -235,6 +236,88 @@ bool SpecialFunctionHandler::handle(ExecutionState &state, Function *f,
   }
 }
 
+/// Resolve the n bytes from a constant address to a single object, and set
+/// the offset of the address in it. Return false if the address is not
+/// constant or the bytes are not within a single object, whose size is its
+/// symbolic size when it has one.
+static bool resolveConcreteRange(ExecutionState &state, ref<Expr> address,
+                                 uint64_t n, ObjectPair &op,
+                                 unsigned &offset) {
+  klee::ConstantExpr *ce = dyn_cast<klee::ConstantExpr>(address);
+  if (!ce || !state.addressSpace.resolveOne(ce, op))
+    return false;
+  uint64_t size = op.first->size;
+  if (!op.first->symbolicSize.isNull()) {
+    klee::ConstantExpr *symbolicSize =
+        dyn_cast<klee::ConstantExpr>(op.first->symbolicSize);
+    if (!symbolicSize)
+      return false;
+    size = std::min(size, symbolicSize->getZExtValue());
+  }
+  uint64_t begin = ce->getZExtValue() - op.first->address;
+  if (begin > size || n > size - begin)
+    return false;
+  offset = begin;
+  return true;
+}
+
+bool SpecialFunctionHandler::handleBulkMemory(
+    ExecutionState &state, Function *f, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  bool isSet = f->getName() == "memset";
+  bool isPCopy = f->getName() == "mempcpy";
+  if (!isSet && !isPCopy && f->getName() != "memcpy" &&
+      f->getName() != "memmove")
+    return false;
+  if (arguments.size() != 3)
+    return false;
+  klee::ConstantExpr *n = dyn_cast<klee::ConstantExpr>(arguments[2]);
+  if (!n)
+    return false;
+  uint64_t count = n->getZExtValue();
+
+  ObjectPair dest;
+  unsigned destOffset;
+  if (!resolveConcreteRange(state, arguments[0], count, dest, destOffset) ||
+      dest.second->readOnly)
+    return false;
+
+  // mempcpy returns the end of the copy rather than the destination
+  ref<Expr> result =
+      isPCopy ? AddExpr::create(arguments[0], arguments[2]) : arguments[0];
+  CallInst *site = dyn_cast<CallInst>(target->inst);
+
+  if (isSet) {
+    klee::ConstantExpr *value = dyn_cast<klee::ConstantExpr>(arguments[1]);
+    if (!value)
+      return false;
+    if (INTERPOLATION_ENABLED &&
+        (!site ||
+         !state.txTreeNode->executeBulkMemory(site, arguments, result)))
+      return false;
+    ObjectState *wos =
+        state.addressSpace.getWriteable(dest.first, dest.second);
+    wos->fill(destOffset, (uint8_t) value->getZExtValue(), count);
+  } else {
+    ObjectPair src;
+    unsigned srcOffset;
+    if (!resolveConcreteRange(state, arguments[1], count, src, srcOffset))
+      return false;
+    if (INTERPOLATION_ENABLED &&
+        (!site ||
+         !state.txTreeNode->executeBulkMemory(site, arguments, result)))
+      return false;
+    ObjectState *wos =
+        state.addressSpace.getWriteable(dest.first, dest.second);
+    // The writeable state replaces the source if they are of one object
+    const ObjectState *ros = src.first == dest.first ? wos : src.second;
+    wos->copy(destOffset, ros, srcOffset, count);
+  }
+
+  executor.bindLocal(target, state, result);
+  return true;
+}
+
 /****/
 
 // reads a concrete string from memory
@@ -448,7 +531,7 @@ void SpecialFunctionHandler::handlePreferCex(
   assert(rl.size() == 1 &&
          "prefer_cex target must resolve to precisely one object");
 
-  rl[0].first.first->cexPreferences.push_back(cond);
+  rl[0].first.first->addCexPreference(cond);
 }
 
 void SpecialFunctionHandler::handlePosixPreferCex(
@@ -11,6 +11,9 @@
 #define KLEE_SPECIALFUNCTIONHANDLER_H
 
 #include "TxTree.h"
+
+#include "llvm/ADT/DenseMap.h"
+
 #include <iterator>
 #include <map>
 #include <string>
@@ -33,8 +36,11 @@ namespace klee {
                                                     KInstruction *target, 
                                                     std::vector<ref<Expr> > 
                                                       &arguments);
-    typedef std::map<const llvm::Function*, 
-                     std::pair<Handler,bool> > handlers_ty;
+    /// The handlers and whether they have a return value, by function.
+    /// This is looked up on every call of a declaration, so it is hashed on
+    /// the function pointer rather than ordered.
+    typedef llvm::DenseMap<const llvm::Function*,
+                           std::pair<Handler,bool> > handlers_ty;
 
     handlers_ty handlers;
     class Executor &executor;
@@ -104,6 +110,16 @@ namespace klee {
                 KInstruction *target,
                 std::vector< ref<Expr> > &arguments);
 
+    /// Perform a call of memcpy, mempcpy, memmove or memset whose arguments
+    /// are concrete and within single objects as a bulk operation on the
+    /// objects, rather than by executing the function body. With
+    /// interpolation, the operation is recorded as a single store of the
+    /// destination. Return false if the call is not of this kind, and is to
+    /// be executed normally.
+    bool handleBulkMemory(ExecutionState &state, llvm::Function *f,
+                          KInstruction *target,
+                          std::vector<ref<Expr> > &arguments);
+
     /* Convenience routines */
 
     std::string readStringAtAddress(ExecutionState &state, ref<Expr> address);
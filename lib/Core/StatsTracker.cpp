@@ -25,6 +25,10 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "MetricsExporter.h"
+#include "ProgressEstimator.h"
+#include "TimingSolver.h"
+#include "TxTree.h"
 #include "UserSearcher.h"
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
@@ -57,6 +61,8 @@
 #include "llvm/IR/CFG.h"
 #endif
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <unistd.h>
 
@@ -75,6 +81,16 @@ cl::opt<bool>
 OutputStats("output-stats", cl::init(true),
             cl::desc("Write running stats trace file (default=on)"));
 
+cl::opt<bool> OutputBinaryStats(
+    "output-binary-stats", cl::init(false),
+    cl::desc("Write the running stats trace to run.stats.bin in a columnar "
+             "binary format instead of to run.stats (default=off)"));
+
+cl::opt<unsigned> BinaryStatsBlockRows(
+    "binary-stats-block-rows", cl::init(16),
+    cl::desc("Number of stats rows buffered into each block of "
+             "run.stats.bin (default=16)"));
+
 cl::opt<bool> OutputIStats(
     "output-istats", cl::init(true),
     cl::desc(
@@ -90,6 +106,13 @@ cl::opt<unsigned> StatsWriteAfterInstructions(
     cl::desc("Write statistics after each n instructions, 0 to disable "
              "(default=0)"));
 
+cl::opt<bool> IStatsDelta(
+    "istats-delta", cl::init(false),
+    cl::desc("At each istats write, append the counters that changed to "
+             "run.istats.delta instead of rewriting run.istats, which is "
+             "then only written at the end. klee-istats-compact rebuilds "
+             "run.istats from the log (default=off)"));
+
 cl::opt<double>
 IStatsWriteInterval("istats-write-interval", cl::init(10.),
                     cl::desc("Approximate number of seconds between istats "
@@ -105,6 +128,29 @@ cl::opt<double> UncoveredUpdateInterval("uncovered-update-interval",
                                         cl::init(30.),
                                         cl::desc("(default=30.0s)"));
 
+cl::opt<bool> IncrementalReachableUncovered(
+    "incremental-reachable-uncovered", cl::init(true),
+    cl::desc("Only recompute the distances to uncovered instructions in the "
+             "functions whose coverage changed and in their transitive "
+             "callers (default=on)"));
+
+cl::opt<std::string> MetricsSocket(
+    "metrics-socket",
+    cl::desc("Serve live metrics of the run over HTTP on a Unix socket at the "
+             "given path, in the Prometheus text format (default=off)"));
+
+cl::opt<double> MetricsUpdateInterval(
+    "metrics-update-interval", cl::init(1.),
+    cl::desc("Approximate number of seconds between updates of the metrics "
+             "served on -metrics-socket (default=1.0s)"));
+
+cl::opt<bool> EstimateProgress(
+    "estimate-progress", cl::init(false),
+    cl::desc("Write to run.stats and to the metrics online estimates of the "
+             "completed fraction of the execution tree, of its number of "
+             "paths and of the remaining time, with the depth distribution "
+             "of the live states (default=off)"));
+
 cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
                            cl::desc("Enable calltree tracking for instruction "
                                     "level statistics (default=on)"));
@@ -113,7 +159,7 @@ cl::opt<bool> UseCallPaths("use-call-paths", cl::init(true),
 ///
 
 bool StatsTracker::useStatistics() {
-  return OutputStats || OutputIStats;
+  return OutputStats || OutputIStats || !MetricsSocket.empty();
 }
 
 namespace klee {
@@ -124,7 +170,12 @@ namespace klee {
     WriteIStatsTimer(StatsTracker *_statsTracker) : statsTracker(_statsTracker) {}
     ~WriteIStatsTimer() {}
     
-    void run() { statsTracker->writeIStats(); }
+    void run() {
+      if (IStatsDelta)
+        statsTracker->writeIStatsDelta();
+      else
+        statsTracker->writeIStats();
+    }
   };
   
   class WriteStatsTimer : public Executor::Timer {
@@ -137,6 +188,17 @@ namespace klee {
     void run() { statsTracker->writeStatsLine(); }
   };
 
+  class PublishMetricsTimer : public Executor::Timer {
+    StatsTracker *statsTracker;
+
+  public:
+    PublishMetricsTimer(StatsTracker *_statsTracker)
+        : statsTracker(_statsTracker) {}
+    ~PublishMetricsTimer() {}
+
+    void run() { statsTracker->publishMetrics(); }
+  };
+
   class UpdateReachableTimer : public Executor::Timer {
     StatsTracker *statsTracker;
     
@@ -179,7 +241,10 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     objectFilename(_objectFilename),
     statsFile(0),
     istatsFile(0),
+    istatsDeltaFile(0),
+    istatsDeltaDumps(0),
     startWallTime(util::getWallTime()),
+    metricsExporter(0),
     numBranches(0),
     fullBranches(0),
     partialBranches(0),
@@ -241,7 +306,8 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 
   if (OutputStats) {
-    statsFile = executor.interpreterHandler->openOutputFile("run.stats");
+    statsFile = executor.interpreterHandler->openOutputFile(
+        OutputBinaryStats ? "run.stats.bin" : "run.stats");
     assert(statsFile && "unable to open statistics trace file");
     writeStatsHeader();
     writeStatsLine();
@@ -260,9 +326,24 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
     assert(istatsFile && "unable to open istats file");
 
+    if (IStatsDelta) {
+      istatsDeltaFile =
+          executor.interpreterHandler->openOutputFile("run.istats.delta");
+      assert(istatsDeltaFile && "unable to open istats delta file");
+    }
+
     if (IStatsWriteInterval > 0)
       executor.addTimer(new WriteIStatsTimer(this), IStatsWriteInterval);
   }
+
+  if (!MetricsSocket.empty()) {
+    metricsExporter = MetricsExporter::create(MetricsSocket);
+    if (metricsExporter) {
+      TxSubsumptionTable::trackSize = true;
+      publishMetrics();
+      executor.addTimer(new PublishMetricsTimer(this), MetricsUpdateInterval);
+    }
+  }
 }
 
 StatsTracker::~StatsTracker() {  
@@ -270,15 +351,29 @@ StatsTracker::~StatsTracker() {
     delete statsFile;
   if (istatsFile)
     delete istatsFile;
+  if (istatsDeltaFile)
+    delete istatsDeltaFile;
+  delete metricsExporter;
 }
 
 void StatsTracker::done() {
-  if (statsFile)
+  if (statsFile) {
     writeStatsLine();
+    if (OutputBinaryStats) {
+      std::vector<StatsField> row;
+      getStatsRow(row);
+      flushBinaryStats(row.size());
+    }
+  }
+
+  if (metricsExporter)
+    publishMetrics();
 
   if (OutputIStats) {
     if (updateMinDistToUncovered)
       computeReachableUncovered();
+    if (istatsDeltaFile)
+      writeIStatsDelta();
     writeIStats();
   }
 }
@@ -320,11 +415,13 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         //
         // FIXME: This trick no longer works, we should fix this in the line
         // number propogation.
-          es.coveredLines[&ii.file].insert(ii.line);
+          es.coveredLines.mutate()[&ii.file].insert(ii.line);
 	es.coveredNew = true;
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
+        if (updateMinDistToUncovered)
+          coverageChangedFunctions.insert(sf.kf->function);
       }
     }
   }
@@ -334,8 +431,12 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
     writeStatsLine();
 
   if (istatsFile && IStatsWriteAfterInstructions &&
-      stats::instructions % IStatsWriteAfterInstructions.getValue() == 0)
-    writeIStats();
+      stats::instructions % IStatsWriteAfterInstructions.getValue() == 0) {
+    if (IStatsDelta)
+      writeIStatsDelta();
+    else
+      writeIStats();
+  }
 }
 
 ///
@@ -397,60 +498,270 @@ void StatsTracker::markBranchVisited(ExecutionState *visitedTrue,
   }
 }
 
-void StatsTracker::writeStatsHeader() {
-  *statsFile << "('Instructions',"
-             << "'FullBranches',"
-             << "'PartialBranches',"
-             << "'NumBranches',"
-             << "'UserTime',"
-             << "'NumStates',"
-             << "'MallocUsage',"
-             << "'NumQueries',"
-             << "'NumQueryConstructs',"
-             << "'NumObjects',"
-             << "'WallTime',"
-             << "'CoveredInstructions',"
-             << "'UncoveredInstructions',"
-             << "'QueryTime',"
-             << "'SolverTime',"
-             << "'CexCacheTime',"
-             << "'ForkTime',"
-             << "'ResolveTime',"
+void StatsTracker::getStatsRow(std::vector<StatsField> &row) {
+  row.clear();
+  row.push_back(StatsField("Instructions", stats::instructions));
+  row.push_back(StatsField("FullBranches", (uint64_t) fullBranches));
+  row.push_back(StatsField("PartialBranches", (uint64_t) partialBranches));
+  row.push_back(StatsField("NumBranches", (uint64_t) numBranches));
+  row.push_back(StatsField("UserTime", util::getUserTime()));
+  row.push_back(StatsField("NumStates", (uint64_t) executor.states.size()));
+  row.push_back(StatsField(
+      "MallocUsage", (uint64_t) (util::GetTotalMallocUsage() +
+                                 executor.memory->getUsedDeterministicSize())));
+  row.push_back(StatsField("NumQueries", stats::queries));
+  row.push_back(StatsField("NumQueryConstructs", stats::queryConstructs));
+  row.push_back(StatsField("NumObjects", (uint64_t) 0)); // was numObjects
+  row.push_back(StatsField("WallTime", elapsed()));
+  row.push_back(StatsField("CoveredInstructions", stats::coveredInstructions));
+  row.push_back(
+      StatsField("UncoveredInstructions", stats::uncoveredInstructions));
+  row.push_back(StatsField("QueryTime", stats::queryTime / 1000000.));
+  row.push_back(StatsField("SolverTime", stats::solverTime / 1000000.));
+  row.push_back(StatsField("CexCacheTime", stats::cexCacheTime / 1000000.));
+  row.push_back(StatsField("ForkTime", stats::forkTime / 1000000.));
+  row.push_back(StatsField("ResolveTime", stats::resolveTime / 1000000.));
+  for (unsigned i = 0; i < NumSolverPhases; ++i) {
+    SolverPhaseStatistics &s = SolverPhaseStatistics::get((SolverPhase)i);
+    row.push_back(StatsField(s.time.getName().c_str(), s.time / 1000000.));
+    row.push_back(StatsField(s.queries.getName().c_str(), s.queries));
+    row.push_back(StatsField(s.failures.getName().c_str(), s.failures));
+    row.push_back(StatsField(s.cacheHits.getName().c_str(), s.cacheHits));
+  }
+#ifdef ENABLE_Z3
+  if (SampleNodeMemory) {
+    row.push_back(
+        StatsField("TxNodeSamples", TxTree::getSampledNodeCount()));
+    row.push_back(
+        StatsField("TxNodeLifetime", TxTree::getAverageNodeLifetime()));
+    row.push_back(StatsField(
+        "TxNodeValuesBytes",
+        TxTree::getAverageNodeMemory(TxTree::ValuesMemory)));
+    row.push_back(StatsField(
+        "TxNodeStoreBytes", TxTree::getAverageNodeMemory(TxTree::StoreMemory)));
+    row.push_back(StatsField(
+        "TxNodePathConditionBytes",
+        TxTree::getAverageNodeMemory(TxTree::PathConditionMemory)));
+    row.push_back(StatsField("TxNodeWPBytes",
+                             TxTree::getAverageNodeMemory(TxTree::WPMemory)));
+    row.push_back(StatsField(
+        "TxNodePhiValuesBytes",
+        TxTree::getAverageNodeMemory(TxTree::PhiValuesMemory)));
+  }
+#endif
+  if (EstimateProgress) {
+    unsigned maxDepth = 0;
+    double depthSum = 0.;
+    for (LiveStates::iterator it = executor.states.begin(),
+                              ie = executor.states.end();
+         it != ie; ++it) {
+      depthSum += (*it)->depth;
+      maxDepth = std::max(maxDepth, (*it)->depth);
+    }
+    row.push_back(StatsField("CompletedFraction",
+                             ProgressEstimator::getCompletedFraction()));
+    row.push_back(
+        StatsField("EstimatedPaths", ProgressEstimator::getEstimatedPaths()));
+    row.push_back(StatsField("RemainingTime",
+                             ProgressEstimator::getRemainingTime(elapsed())));
+    row.push_back(StatsField(
+        "FrontierDepthMean",
+        executor.states.empty() ? 0. : depthSum / executor.states.size()));
+    row.push_back(StatsField("FrontierDepthMax", (uint64_t)maxDepth));
+    if (INTERPOLATION_ENABLED)
+      row.push_back(StatsField("TxPrunedSubtreeNodes",
+                               TxSubsumptionTable::getPrunedSubtreeNodes()));
+  }
 #ifdef DEBUG
-	     << "'ArrayHashTime',"
+  row.push_back(StatsField("ArrayHashTime", stats::arrayHashTime / 1000000.));
 #endif
-             << ")\n";
+}
+
+void StatsTracker::writeStatsHeader() {
+  std::vector<StatsField> row;
+  getStatsRow(row);
+
+  if (OutputBinaryStats) {
+    // The header of the binary trace: the magic, a byte order mark, the
+    // version and the columns, each a type character and a name.
+    uint32_t header[3] = { 0x01020304, 1, (uint32_t) row.size() };
+    statsFile->write("KLEESTAT", 8);
+    statsFile->write((const char *) header, sizeof(header));
+    for (std::vector<StatsField>::iterator it = row.begin(), ie = row.end();
+         it != ie; ++it) {
+      *statsFile << (it->isDouble ? 'd' : 'u') << it->name;
+      statsFile->write('\0');
+    }
+    statsFile->flush();
+    return;
+  }
+
+  *statsFile << "(";
+  for (std::vector<StatsField>::iterator it = row.begin(), ie = row.end();
+       it != ie; ++it)
+    *statsFile << "'" << it->name << "',";
+  *statsFile << ")\n";
   statsFile->flush();
 }
 
+void StatsTracker::publishMetrics() {
+  std::string text;
+  llvm::raw_string_ostream os(text);
+
+  os << "# TYPE klee_states gauge\n";
+  os << "klee_states " << executor.states.size() << "\n";
+  os << "# TYPE klee_instructions_total counter\n";
+  os << "klee_instructions_total " << stats::instructions << "\n";
+  os << "# TYPE klee_covered_instructions gauge\n";
+  os << "klee_covered_instructions " << stats::coveredInstructions << "\n";
+  os << "# TYPE klee_uncovered_instructions gauge\n";
+  os << "klee_uncovered_instructions " << stats::uncoveredInstructions
+     << "\n";
+  if (BBCoverage >= 1) {
+    os << "# TYPE klee_covered_basic_blocks gauge\n";
+    os << "klee_covered_basic_blocks " << executor.visitedBlockCount << "\n";
+    os << "# TYPE klee_basic_blocks gauge\n";
+    os << "klee_basic_blocks " << executor.allBlockCount << "\n";
+  }
+  os << "# TYPE klee_malloc_bytes gauge\n";
+  os << "klee_malloc_bytes "
+     << (util::GetTotalMallocUsage() +
+         executor.memory->getUsedDeterministicSize()) << "\n";
+  Executor::MemoryBreakdown breakdown = executor.getMemoryBreakdown();
+  os << "# TYPE klee_memory_bytes gauge\n";
+  os << "klee_memory_bytes{subsystem=\"expressions\"} "
+     << breakdown.expressions << "\n";
+  os << "klee_memory_bytes{subsystem=\"object_states\"} "
+     << breakdown.objectStates << "\n";
+  os << "klee_memory_bytes{subsystem=\"tx_tree\"} " << breakdown.txTree
+     << "\n";
+  os << "klee_memory_bytes{subsystem=\"subsumption_table\"} "
+     << breakdown.subsumptionTable << "\n";
+  os << "klee_memory_bytes{subsystem=\"deterministic\"} "
+     << breakdown.deterministic << "\n";
+  os << "# TYPE klee_wall_time_seconds gauge\n";
+  os << "klee_wall_time_seconds " << elapsed() << "\n";
+
+  if (INTERPOLATION_ENABLED) {
+    os << "# TYPE tracerx_tree_nodes_total counter\n";
+    os << "tracerx_tree_nodes_total " << TxTreeNode::getVisitedNodeCount()
+       << "\n";
+    os << "# TYPE tracerx_subsumption_table_entries gauge\n";
+    os << "tracerx_subsumption_table_entries "
+       << TxSubsumptionTable::getEntryCount() << "\n";
+    os << "# TYPE tracerx_subsumption_table_bytes gauge\n";
+    os << "tracerx_subsumption_table_bytes " << TxSubsumptionTable::getSize()
+       << "\n";
+    os << "# TYPE tracerx_subsumption_checks_total counter\n";
+    os << "tracerx_subsumption_checks_total " << TxTree::subsumptionCheckCount
+       << "\n";
+    os << "# TYPE tracerx_subsumptions_total counter\n";
+    os << "tracerx_subsumptions_total " << TxTree::subsumptionSuccessCount
+       << "\n";
+    os << "# TYPE tracerx_subsumption_hit_ratio gauge\n";
+    os << "tracerx_subsumption_hit_ratio "
+       << (TxTree::subsumptionCheckCount
+               ? (double)TxTree::subsumptionSuccessCount /
+                     TxTree::subsumptionCheckCount
+               : 0.0) << "\n";
+  }
+
+  if (EstimateProgress) {
+    os << "# TYPE klee_completed_fraction gauge\n";
+    os << "klee_completed_fraction "
+       << ProgressEstimator::getCompletedFraction() << "\n";
+    os << "# TYPE klee_estimated_paths gauge\n";
+    os << "klee_estimated_paths " << ProgressEstimator::getEstimatedPaths()
+       << "\n";
+    os << "# TYPE klee_remaining_seconds gauge\n";
+    os << "klee_remaining_seconds "
+       << ProgressEstimator::getRemainingTime(elapsed()) << "\n";
+    if (INTERPOLATION_ENABLED) {
+      os << "# TYPE tracerx_pruned_subtree_nodes_total counter\n";
+      os << "tracerx_pruned_subtree_nodes_total "
+         << TxSubsumptionTable::getPrunedSubtreeNodes() << "\n";
+    }
+  }
+
+  // The solver query times, as a histogram in seconds by phase
+  os << "# TYPE klee_solver_query_seconds histogram\n";
+  for (unsigned i = 0; i < NumSolverPhases; ++i) {
+    SolverPhaseStatistics &s = SolverPhaseStatistics::get((SolverPhase)i);
+    uint64_t count = 0;
+    for (unsigned j = 0; j < SolverPhaseStatistics::NumLatencyBuckets; ++j) {
+      count += s.latencyHistogram[j];
+      os << "klee_solver_query_seconds_bucket{phase=\"" << s.name
+         << "\",le=\"";
+      if (j + 1 < SolverPhaseStatistics::NumLatencyBuckets)
+        os << SolverPhaseStatistics::getLatencyBound(j) / 1000000.;
+      else
+        os << "+Inf";
+      os << "\"} " << count << "\n";
+    }
+    os << "klee_solver_query_seconds_sum{phase=\"" << s.name << "\"} "
+       << s.time / 1000000. << "\n";
+    os << "klee_solver_query_seconds_count{phase=\"" << s.name << "\"} "
+       << count << "\n";
+  }
+
+  metricsExporter->publish(os.str());
+}
+
 double StatsTracker::elapsed() {
   return util::getWallTime() - startWallTime;
 }
 
 void StatsTracker::writeStatsLine() {
-  *statsFile << "(" << stats::instructions << "," << fullBranches << ","
-             << partialBranches << "," << numBranches << ","
-             << util::getUserTime() << "," << executor.states.size() << ","
-             << util::GetTotalMallocUsage() +
-                    executor.memory->getUsedDeterministicSize() << ","
-             << stats::queries << "," << stats::queryConstructs << ","
-             << 0 // was numObjects
-             << "," << elapsed() << "," << stats::coveredInstructions << ","
-             << stats::uncoveredInstructions << ","
-             << stats::queryTime / 1000000. << ","
-             << stats::solverTime / 1000000. << ","
-             << stats::cexCacheTime / 1000000. << ","
-             << stats::forkTime / 1000000. << ","
-             << stats::resolveTime / 1000000.
-#ifdef DEBUG
-             << "," << stats::arrayHashTime / 1000000.
-#endif
-             << ")\n";
+  std::vector<StatsField> row;
+  getStatsRow(row);
+
+  if (OutputBinaryStats) {
+    for (std::vector<StatsField>::iterator it = row.begin(), ie = row.end();
+         it != ie; ++it) {
+      uint64_t bits = it->value;
+      if (it->isDouble)
+        memcpy(&bits, &it->time, sizeof(bits));
+      pendingStatsRows.push_back(bits);
+    }
+    if (pendingStatsRows.size() >= row.size() * BinaryStatsBlockRows)
+      flushBinaryStats(row.size());
+    return;
+  }
+
+  *statsFile << "(";
+  for (std::vector<StatsField>::iterator it = row.begin(), ie = row.end();
+       it != ie; ++it) {
+    if (it != row.begin())
+      *statsFile << ",";
+    if (it->isDouble)
+      *statsFile << it->time;
+    else
+      *statsFile << it->value;
+  }
+  *statsFile << ")\n";
   statsFile->flush();
 }
 
+void StatsTracker::flushBinaryStats(unsigned numColumns) {
+  if (pendingStatsRows.empty())
+    return;
+
+  // A block is its number of rows followed by each column in turn, so that
+  // a reader can pick out columns without decoding whole rows.
+  uint32_t numRows = pendingStatsRows.size() / numColumns;
+  std::vector<uint64_t> block(pendingStatsRows.size());
+  for (unsigned r = 0; r != numRows; ++r)
+    for (unsigned c = 0; c != numColumns; ++c)
+      block[c * numRows + r] = pendingStatsRows[r * numColumns + c];
+
+  statsFile->write((const char *) &numRows, sizeof(numRows));
+  statsFile->write((const char *) &block[0], block.size() * sizeof(block[0]));
+  statsFile->flush();
+  pendingStatsRows.clear();
+}
+
 void StatsTracker::updateStateStatistics(uint64_t addend) {
-  for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
+  for (LiveStates::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
     ExecutionState &state = **it;
     const InstructionInfo &ii = *state.pc->info;
@@ -460,24 +771,9 @@ void StatsTracker::updateStateStatistics(uint64_t addend) {
   }
 }
 
-void StatsTracker::writeIStats() {
-  Module *m = executor.kmodule->module;
-  uint64_t istatsMask = 0;
-  llvm::raw_fd_ostream &of = *istatsFile;
-  
-  // We assume that we didn't move the file pointer
-  unsigned istatsSize = of.tell();
-
-  of.seek(0);
-
-  of << "version: 1\n";
-  of << "creator: klee\n";
-  of << "pid: " << getpid() << "\n";
-  of << "cmd: " << m->getModuleIdentifier() << "\n\n";
-  of << "\n";
-  
+uint64_t StatsTracker::getIStatsMask() {
   StatisticManager &sm = *theStatisticManager;
-  unsigned nStats = sm.getNumStatistics();
+  uint64_t istatsMask = 0;
 
   // Max is 13, sadly
   istatsMask |= 1<<sm.getStatisticID("Queries");
@@ -493,6 +789,20 @@ void StatsTracker::writeIStats() {
   istatsMask |= 1<<sm.getStatisticID("UncoveredInstructions");
   istatsMask |= 1<<sm.getStatisticID("States");
   istatsMask |= 1<<sm.getStatisticID("MinDistToUncovered");
+  return istatsMask;
+}
+
+void StatsTracker::writeIStatsHeader(llvm::raw_ostream &of,
+                                     uint64_t istatsMask) {
+  Module *m = executor.kmodule->module;
+  StatisticManager &sm = *theStatisticManager;
+  unsigned nStats = sm.getNumStatistics();
+
+  of << "version: 1\n";
+  of << "creator: klee\n";
+  of << "pid: " << getpid() << "\n";
+  of << "cmd: " << m->getModuleIdentifier() << "\n\n";
+  of << "\n";
 
   of << "positions: instr line\n";
 
@@ -510,7 +820,25 @@ void StatsTracker::writeIStats() {
       of << sm.getStatistic(i).getShortName() << " ";
   }
   of << "\n";
+
+  of << "ob=" << objectFilename << "\n";
+}
+
+void StatsTracker::writeIStats() {
+  Module *m = executor.kmodule->module;
+  uint64_t istatsMask = getIStatsMask();
+  llvm::raw_fd_ostream &of = *istatsFile;
   
+  // We assume that we didn't move the file pointer
+  unsigned istatsSize = of.tell();
+
+  of.seek(0);
+
+  writeIStatsHeader(of, istatsMask);
+
+  StatisticManager &sm = *theStatisticManager;
+  unsigned nStats = sm.getNumStatistics();
+
   // set state counts, decremented after we process so that we don't
   // have to zero all records each time.
   if (istatsMask & (1<<stats::states.getID()))
@@ -522,8 +850,6 @@ void StatsTracker::writeIStats() {
   if (UseCallPaths)
     callPathManager.getSummaryStatistics(callSiteStats);
 
-  of << "ob=" << objectFilename << "\n";
-
   for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
        fnIt != fn_ie; ++fnIt) {
     if (!fnIt->isDeclaration()) {
@@ -612,6 +938,127 @@ void StatsTracker::writeIStats() {
   of.flush();
 }
 
+void StatsTracker::writeIStatsDelta() {
+  Module *m = executor.kmodule->module;
+  uint64_t istatsMask = getIStatsMask();
+  llvm::raw_fd_ostream &of = *istatsDeltaFile;
+  StatisticManager &sm = *theStatisticManager;
+  unsigned nStats = sm.getNumStatistics();
+
+  std::vector<Statistic *> events;
+  for (unsigned i=0; i<nStats; i++)
+    if (istatsMask & (1<<i))
+      events.push_back(&sm.getStatistic(i));
+  unsigned nEvents = events.size();
+
+  // The first dump starts with the run.istats header and the layout of the
+  // instructions, as tab-separated "fn" and "i" records, so that the later
+  // dumps only name instruction ids.
+  if (istatsDeltaDumps++ == 0) {
+    writeIStatsHeader(of, istatsMask);
+    of << "# layout\n";
+    for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+         fnIt != fn_ie; ++fnIt) {
+      if (fnIt->isDeclaration())
+        continue;
+      const InstructionInfo &fii =
+          executor.kmodule->infos->getFunctionInfo(fnIt);
+      of << "fn\t" << fii.file << "\t" << fnIt->getName().str() << "\n";
+      for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+           bbIt != bb_ie; ++bbIt) {
+        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+             it != ie; ++it) {
+          const InstructionInfo &ii = executor.kmodule->infos->getInfo(&*it);
+          of << "i\t" << ii.id << "\t" << ii.assemblyLine << "\t" << ii.line
+             << "\t" << ii.file << "\n";
+        }
+      }
+    }
+    istatsDeltaValues.assign(
+        (executor.kmodule->infos->getMaxID() + 1) * nEvents, 0);
+  }
+
+  if (istatsMask & (1<<stats::states.getID()))
+    updateStateStatistics(1);
+
+  CallSiteSummaryTable callSiteStats;
+  if (UseCallPaths)
+    callPathManager.getSummaryStatistics(callSiteStats);
+
+  // Each dump has the counters of the instructions, and the summaries of
+  // the call sites, that changed since the last dump, as "v" and "c"
+  // records of their current values.
+  of << "dump\t" << elapsed() << "\n";
+  std::vector<uint64_t> values(nEvents);
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt) {
+    if (fnIt->isDeclaration())
+      continue;
+    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+         bbIt != bb_ie; ++bbIt) {
+      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+           it != ie; ++it) {
+        Instruction *instr = &*it;
+        const InstructionInfo &ii = executor.kmodule->infos->getInfo(instr);
+        uint64_t *last = &istatsDeltaValues[ii.id * nEvents];
+        bool changed = false;
+        for (unsigned i = 0; i != nEvents; ++i) {
+          uint64_t value = sm.getIndexedValue(*events[i], ii.id);
+          changed |= value != last[i];
+          last[i] = value;
+        }
+        if (changed) {
+          of << "v\t" << ii.id;
+          for (unsigned i = 0; i != nEvents; ++i)
+            of << "\t" << last[i];
+          of << "\n";
+        }
+
+        if (!UseCallPaths ||
+            !(isa<CallInst>(instr) || isa<InvokeInst>(instr)))
+          continue;
+        CallSiteSummaryTable::iterator cit = callSiteStats.find(instr);
+        if (cit == callSiteStats.end())
+          continue;
+        for (std::map<llvm::Function*, CallSiteInfo>::iterator
+               fit = cit->second.begin(), fie = cit->second.end();
+             fit != fie; ++fit) {
+          Function *f = fit->first;
+          CallSiteInfo &csi = fit->second;
+          values.assign(1, csi.count);
+          for (unsigned i = 0; i != nEvents; ++i) {
+            // Hack, ignore things that don't make sense on call paths.
+            if (events[i] == &stats::uncoveredInstructions)
+              values.push_back(0);
+            else
+              values.push_back(csi.statistics.getValue(*events[i]));
+          }
+
+          std::vector<uint64_t> &lastCall =
+              istatsDeltaCalls[std::make_pair(ii.id, f)];
+          if (lastCall == values)
+            continue;
+          lastCall = values;
+
+          const InstructionInfo &fii =
+              executor.kmodule->infos->getFunctionInfo(f);
+          of << "c\t" << ii.id << "\t" << f->getName().str() << "\t"
+             << fii.file << "\t" << fii.assemblyLine << "\t" << fii.line;
+          for (std::vector<uint64_t>::iterator vit = values.begin(),
+                 vie = values.end(); vit != vie; ++vit)
+            of << "\t" << *vit;
+          of << "\n";
+        }
+      }
+    }
+  }
+
+  if (istatsMask & (1<<stats::states.getID()))
+    updateStateStatistics((uint64_t)-1);
+
+  of.flush();
+}
+
 ///
 
 typedef std::map<Instruction*, std::vector<Function*> > calltargets_ty;
@@ -656,15 +1103,18 @@ uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
   }
 }
 
-std::map<llvm::BasicBlock *, std::vector<unsigned int> > StatsTracker::bbSpecCount;
+static unsigned minDistToUncoveredEpoch = 0;
 
-void StatsTracker::increaseEle(llvm::BasicBlock *bb, int indx, bool check) {
-  if (check) {
-    if (StatsTracker::bbSpecCount.find(bb) == StatsTracker::bbSpecCount.end()) {
-      StatsTracker::bbSpecCount[bb] = std::vector<unsigned int>(3, 0);
-    }
-  }
-  StatsTracker::bbSpecCount[bb][indx] = StatsTracker::bbSpecCount[bb][indx] + 1;
+unsigned klee::getMinDistToUncoveredEpoch() {
+  return minDistToUncoveredEpoch;
+}
+
+std::vector<unsigned int> StatsTracker::bbSpecCount;
+
+void StatsTracker::increaseEle(unsigned bbId, int indx) {
+  if (StatsTracker::bbSpecCount.size() <= 3 * bbId + indx)
+    StatsTracker::bbSpecCount.resize(3 * (bbId + 1), 0);
+  ++StatsTracker::bbSpecCount[3 * bbId + indx];
 }
 
 void StatsTracker::computeReachableUncovered() {
@@ -805,10 +1255,40 @@ void StatsTracker::computeReachableUncovered() {
     } while (changed);
   }
 
+  // Only the distances in the functions whose coverage changed since the
+  // last computation, and in their transitive callers, can change. The
+  // distances in the other functions only depend on their callees, which
+  // are not among those functions either.
+  static bool computedMinDistToUncovered = false;
+  bool recomputeAll =
+      !computedMinDistToUncovered || !IncrementalReachableUncovered;
+  computedMinDistToUncovered = true;
+  std::set<Function *> affected(coverageChangedFunctions);
+  if (!recomputeAll) {
+    std::vector<Function *> worklist(affected.begin(), affected.end());
+    while (!worklist.empty()) {
+      Function *f = worklist.back();
+      worklist.pop_back();
+      std::vector<Instruction *> &callers = functionCallers[f];
+      for (std::vector<Instruction *>::iterator it = callers.begin(),
+             ie = callers.end(); it != ie; ++it) {
+        Function *caller = (*it)->getParent()->getParent();
+        if (affected.insert(caller).second)
+          worklist.push_back(caller);
+      }
+    }
+  }
+  coverageChangedFunctions.clear();
+  if (recomputeAll || !affected.empty())
+    ++minDistToUncoveredEpoch;
+
   // compute minDistToUncovered, 0 is unreachable
   std::vector<Instruction *> instructions;
   for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
        fnIt != fn_ie; ++fnIt) {
+    if (!recomputeAll && !affected.count(&*fnIt))
+      continue;
+
     // Not sure if I should bother to preorder here.
     for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
          bbIt != bb_ie; ++bbIt) {
@@ -884,7 +1364,7 @@ void StatsTracker::computeReachableUncovered() {
     }
   } while (changed);
 
-  for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
+  for (LiveStates::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
     ExecutionState *es = *it;
     uint64_t currentFrameMinDist = 0;
@@ -13,6 +13,8 @@
 #include "CallPathManager.h"
 
 #include <set>
+#include <stdint.h>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -20,6 +22,7 @@ namespace llvm {
   class Function;
   class Instruction;
   class raw_fd_ostream;
+  class raw_ostream;
 }
 
 namespace klee {
@@ -28,17 +31,30 @@ namespace klee {
   class InstructionInfoTable;
   class InterpreterHandler;
   struct KInstruction;
+  class MetricsExporter;
   struct StackFrame;
 
   class StatsTracker {
     friend class WriteStatsTimer;
     friend class WriteIStatsTimer;
+    friend class PublishMetricsTimer;
 
     Executor &executor;
     std::string objectFilename;
 
     llvm::raw_fd_ostream *statsFile, *istatsFile;
+
+    /// The istats delta log, with the number of dumps written to it and the
+    /// counters of each instruction and call site as of the last dump
+    llvm::raw_fd_ostream *istatsDeltaFile;
+    unsigned istatsDeltaDumps;
+    std::vector<uint64_t> istatsDeltaValues;
+    std::map<std::pair<unsigned, llvm::Function *>, std::vector<uint64_t> >
+    istatsDeltaCalls;
     double startWallTime;
+
+    /// The exporter of the live metrics, under -metrics-socket
+    MetricsExporter *metricsExporter;
     
     unsigned numBranches;
     unsigned fullBranches, partialBranches;
@@ -47,14 +63,40 @@ namespace klee {
 
     bool updateMinDistToUncovered;
 
+    /// The functions with instructions covered since the distances to
+    /// uncovered instructions were last computed
+    std::set<llvm::Function *> coverageChangedFunctions;
+
+    /// A column of the stats trace, and its current value
+    struct StatsField {
+      const char *name;
+      bool isDouble;
+      uint64_t value;
+      double time;
+
+      StatsField(const char *_name, uint64_t _value)
+          : name(_name), isDouble(false), value(_value), time(0) {}
+      StatsField(const char *_name, double _time)
+          : name(_name), isDouble(true), value(0), time(_time) {}
+    };
+
+    /// The rows of the binary stats trace not yet written, row after row
+    std::vector<uint64_t> pendingStatsRows;
+
   public:
     static bool useStatistics();
 
   private:
     void updateStateStatistics(uint64_t addend);
+    void getStatsRow(std::vector<StatsField> &row);
     void writeStatsHeader();
     void writeStatsLine();
+    void flushBinaryStats(unsigned numColumns);
+    uint64_t getIStatsMask();
+    void writeIStatsHeader(llvm::raw_ostream &of, uint64_t istatsMask);
     void writeIStats();
+    void writeIStatsDelta();
+    void publishMetrics();
 
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
@@ -85,14 +127,23 @@ namespace klee {
 
     void computeReachableUncovered();
 
-    static std::map<llvm::BasicBlock *, std::vector<unsigned int> > bbSpecCount;
+    /// The speculation counters of the basic blocks, three per block in the
+    /// order of KInstruction::basicBlockId: the speculations opened, failed
+    /// and succeeded at the block
+    static std::vector<unsigned int> bbSpecCount;
 
-    static void increaseEle(llvm::BasicBlock *bb, int indx, bool check);
+    static void increaseEle(unsigned bbId, int indx);
   };
 
   uint64_t computeMinDistToUncovered(const KInstruction *ki,
                                      uint64_t minDistAtRA);
 
+  /// getMinDistToUncoveredEpoch - Return a counter incremented each time
+  /// the distances to uncovered instructions are recomputed with a change,
+  /// so that values derived from computeMinDistToUncovered can be cached
+  /// until it moves.
+  unsigned getMinDistToUncoveredEpoch();
+
 }
 
 #endif
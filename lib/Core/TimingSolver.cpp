@@ -13,18 +13,86 @@
 #include "klee/Config/Version.h"
 #include "klee/ExecutionState.h"
 #include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
 #include "klee/Statistics.h"
-#include "klee/Internal/System/Time.h"
 
 #include "CoreStats.h"
+#include "SamplingProfiler.h"
 
-#include "llvm/Support/TimeValue.h"
 
 using namespace klee;
 using namespace llvm;
 
 /***/
 
+SolverPhase SolverPhaseStatistics::current = OtherPhase;
+
+SolverPhaseStatistics::SolverPhaseStatistics(const char *_name,
+                                             const std::string &shortName)
+    : name(_name), time(std::string(_name) + "SolverTime", shortName + "Stime"),
+      queries(std::string(_name) + "Queries", shortName + "Q"),
+      failures(std::string(_name) + "SolverFailures", shortName + "Sfail"),
+      cacheHits(std::string(_name) + "QueryCacheHits", shortName + "QChits") {
+  for (unsigned i = 0; i < NumLatencyBuckets; ++i)
+    latencyHistogram[i] = 0;
+}
+
+uint64_t SolverPhaseStatistics::getLatencyBound(unsigned bucket) {
+  // From 100 microseconds to 10 seconds, by factors of ten
+  uint64_t bound = 100;
+  for (unsigned i = 0; i < bucket; ++i)
+    bound *= 10;
+  return bound;
+}
+
+SolverPhaseStatistics &SolverPhaseStatistics::get(SolverPhase phase) {
+  static SolverPhaseStatistics other("Other", "Oth");
+  static SolverPhaseStatistics branch("Branch", "Br");
+  static SolverPhaseStatistics subsumption("Subsumption", "Sub");
+  static SolverPhaseStatistics speculation("Speculation", "Spec");
+  static SolverPhaseStatistics concretization("Concretization", "Conc");
+  static SolverPhaseStatistics testGeneration("TestGeneration", "Test");
+  static SolverPhaseStatistics *phases[NumSolverPhases] = {
+    &other, &branch, &subsumption, &speculation, &concretization,
+    &testGeneration
+  };
+  return *phases[phase];
+}
+
+void SolverPhaseStatistics::print(std::stringstream &stream) {
+  for (unsigned i = 0; i < NumSolverPhases; ++i) {
+    SolverPhaseStatistics &s = get((SolverPhase)i);
+    stream << "KLEE: done:     " << s.name << " = "
+           << ((double)s.time.getValue()) / 1000 << " ms, "
+           << s.queries.getValue() << " queries, " << s.failures.getValue()
+           << " failed, " << s.cacheHits.getValue() << " cache hits\n";
+  }
+}
+
+SolverQueryTimer::SolverQueryTimer()
+    : startCacheHits(stats::queryCacheHits + stats::queryCexCacheHits) {}
+
+uint64_t SolverQueryTimer::finish(bool success) {
+  uint64_t delta = timer.check();
+  SolverPhaseStatistics &s =
+      SolverPhaseStatistics::get(SolverPhaseStatistics::current);
+  s.time += delta;
+  ++s.queries;
+  if (!success)
+    ++s.failures;
+  s.cacheHits +=
+      stats::queryCacheHits + stats::queryCexCacheHits - startCacheHits;
+  unsigned bucket = 0;
+  while (bucket + 1 < SolverPhaseStatistics::NumLatencyBuckets &&
+         delta >= SolverPhaseStatistics::getLatencyBound(bucket))
+    ++bucket;
+  ++s.latencyHistogram[bucket];
+  return delta;
+}
+
+/***/
+
 bool TimingSolver::evaluate(const ExecutionState &state, ref<Expr> expr,
                             Solver::Validity &result,
                             std::vector<ref<Expr> > &unsatCore) {
@@ -34,7 +102,8 @@ bool TimingSolver::evaluate(const ExecutionState &state, ref<Expr> expr,
     return true;
   }
 
-  sys::TimeValue now = util::getWallTimeVal();
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
+  SolverQueryTimer timer;
 
   std::vector<ref<Expr> > simplificationCore;
   if (simplifyExprs)
@@ -53,10 +122,9 @@ bool TimingSolver::evaluate(const ExecutionState &state, ref<Expr> expr,
     }
   }
 
-  sys::TimeValue delta = util::getWallTimeVal();
-  delta -= now;
-  stats::solverTime += delta.usec();
-  state.queryCost += delta.usec()/1000000.;
+  uint64_t delta = timer.finish(success);
+  stats::solverTime += delta;
+  state.queryCost += delta / 1000000.;
 
   return success;
 }
@@ -70,7 +138,8 @@ bool TimingSolver::mustBeTrue(const ExecutionState &state, ref<Expr> expr,
     return true;
   }
 
-  sys::TimeValue now = util::getWallTimeVal();
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
+  SolverQueryTimer timer;
 
   std::vector<ref<Expr> > simplificationCore;
   if (simplifyExprs)
@@ -84,10 +153,9 @@ bool TimingSolver::mustBeTrue(const ExecutionState &state, ref<Expr> expr,
                      simplificationCore.end());
   }
 
-  sys::TimeValue delta = util::getWallTimeVal();
-  delta -= now;
-  stats::solverTime += delta.usec();
-  state.queryCost += delta.usec()/1000000.;
+  uint64_t delta = timer.finish(success);
+  stats::solverTime += delta;
+  state.queryCost += delta / 1000000.;
 
   return success;
 }
@@ -125,7 +193,8 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
   
-  sys::TimeValue now = util::getWallTimeVal();
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
+  SolverQueryTimer timer;
 
   std::vector<ref<Expr> > simplificationCore;
   if (simplifyExprs)
@@ -133,10 +202,36 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
 
   bool success = solver->getValue(Query(state.constraints, expr), result);
 
-  sys::TimeValue delta = util::getWallTimeVal();
-  delta -= now;
-  stats::solverTime += delta.usec();
-  state.queryCost += delta.usec()/1000000.;
+  uint64_t delta = timer.finish(success);
+  stats::solverTime += delta;
+  state.queryCost += delta / 1000000.;
+
+  return success;
+}
+
+bool TimingSolver::getUniqueValue(const ExecutionState &state, ref<Expr> expr,
+                                  ref<ConstantExpr> &result, bool &isUnique) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr)) {
+    result = CE;
+    isUnique = true;
+    return true;
+  }
+
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
+  SolverQueryTimer timer;
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  bool success = solver->getValue(Query(state.constraints, expr), result);
+  isUnique = false;
+  if (success)
+    success = solver->mustBeTrue(
+        Query(state.constraints, EqExpr::create(expr, result)), isUnique);
+
+  uint64_t delta = timer.finish(success);
+  stats::solverTime += delta;
+  state.queryCost += delta / 1000000.;
 
   return success;
 }
@@ -149,22 +244,55 @@ TimingSolver::getInitialValues(const ExecutionState &state,
   if (objects.empty())
     return true;
 
-  sys::TimeValue now = util::getWallTimeVal();
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
+  SolverQueryTimer timer;
 
   bool success = solver->getInitialValues(
       Query(state.constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
       result, unsatCore);
 
-  sys::TimeValue delta = util::getWallTimeVal();
-  delta -= now;
-  stats::solverTime += delta.usec();
-  state.queryCost += delta.usec()/1000000.;
+  uint64_t delta = timer.finish(success);
+  stats::solverTime += delta;
+  state.queryCost += delta / 1000000.;
   
   return success;
 }
 
+bool TimingSolver::getModel(const ExecutionState &state, ref<Expr> expr,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &result,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore) {
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
+  SolverQueryTimer timer;
+
+  std::vector<ref<Expr> > simplificationCore;
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr, simplificationCore);
+
+  unsatCore.clear();
+
+  // The solution is of the constraints and the negation of the query
+  // expression
+  bool success = solver->impl->computeInitialValues(
+      Query(state.constraints, Expr::createIsZero(expr)), objects, result,
+      hasSolution, unsatCore);
+
+  if (INTERPOLATION_ENABLED && simplifyExprs && success && !hasSolution) {
+    unsatCore.insert(unsatCore.begin(), simplificationCore.begin(),
+                     simplificationCore.end());
+  }
+
+  uint64_t delta = timer.finish(success);
+  stats::solverTime += delta;
+  state.queryCost += delta / 1000000.;
+
+  return success;
+}
+
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Solver);
   std::pair<ref<Expr>, ref<Expr> > ret =
       solver->getRange(Query(state.constraints, expr));
   return ret;
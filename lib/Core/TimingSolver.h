@@ -12,13 +12,82 @@
 
 #include "klee/Expr.h"
 #include "klee/Solver.h"
+#include "klee/Statistic.h"
+#include "klee/Internal/Support/Timer.h"
 
+#include <sstream>
 #include <vector>
 
 namespace klee {
   class ExecutionState;
   class Solver;
 
+  /// The phases of the execution that query the solver, each with its own
+  /// statistics of the solver queries
+  enum SolverPhase {
+    OtherPhase,
+    BranchPhase,
+    SubsumptionPhase,
+    SpeculationPhase,
+    ConcretizationPhase,
+    TestGenerationPhase,
+    NumSolverPhases
+  };
+
+  /// The statistics of the solver queries of a phase
+  struct SolverPhaseStatistics {
+    const char *name;
+    Statistic time;
+    Statistic queries;
+    /// The queries that failed, mostly by timing out
+    Statistic failures;
+    /// The queries answered by the query or counterexample caches
+    Statistic cacheHits;
+
+    /// The number of queries by their time, in buckets bounded by
+    /// getLatencyBound, the last bucket being unbounded
+    static const unsigned NumLatencyBuckets = 7;
+    uint64_t latencyHistogram[NumLatencyBuckets];
+
+    /// The upper bound of the times of a bucket of the latency histogram, in
+    /// microseconds
+    static uint64_t getLatencyBound(unsigned bucket);
+
+    SolverPhaseStatistics(const char *_name, const std::string &shortName);
+
+    static SolverPhaseStatistics &get(SolverPhase phase);
+
+    /// The phase the queries are attributed to
+    static SolverPhase current;
+
+    static void print(std::stringstream &stream);
+  };
+
+  /// Attribution of the solver queries to a phase for the lifetime of the
+  /// object
+  class SolverPhaseScope {
+    SolverPhase savedPhase;
+
+  public:
+    SolverPhaseScope(SolverPhase phase)
+        : savedPhase(SolverPhaseStatistics::current) {
+      SolverPhaseStatistics::current = phase;
+    }
+    ~SolverPhaseScope() { SolverPhaseStatistics::current = savedPhase; }
+  };
+
+  /// Measurement of a solver query for the statistics of the current phase
+  class SolverQueryTimer {
+    WallTimer timer;
+    uint64_t startCacheHits;
+
+  public:
+    SolverQueryTimer();
+
+    /// Record the query, returning its time in microseconds
+    uint64_t finish(bool success);
+  };
+
   /// TimingSolver - A simple class which wraps a solver and handles
   /// tracking the statistics that we care about.
   class TimingSolver {
@@ -85,11 +154,25 @@ namespace klee {
     bool getValue(const ExecutionState &, ref<Expr> expr, 
                   ref<ConstantExpr> &result);
 
+    /// getUniqueValue - Compute one possible value for the expression, and
+    /// whether it is the only one, simplifying the expression and timing
+    /// both queries once.
+    bool getUniqueValue(const ExecutionState &, ref<Expr> expr,
+                        ref<ConstantExpr> &result, bool &isUnique);
+
     bool getInitialValues(const ExecutionState &,
                           const std::vector<const Array *> &objects,
                           std::vector<std::vector<unsigned char> > &result,
                           std::vector<ref<Expr> > &unsatCore);
 
+    /// getModel - Find values of the objects satisfying both the constraints
+    /// of the state and the expression, in a single query. Without a
+    /// solution, hasSolution is false and the unsatisfiability core is given.
+    bool getModel(const ExecutionState &, ref<Expr> expr,
+                  const std::vector<const Array *> &objects,
+                  std::vector<std::vector<unsigned char> > &result,
+                  bool &hasSolution, std::vector<ref<Expr> > &unsatCore);
+
     std::pair< ref<Expr>, ref<Expr> >
     getRange(const ExecutionState&, ref<Expr> query);
   };
@@ -0,0 +1,160 @@
+//===-- TxArena.cpp ---------------------------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementations for the slab allocator of the
+/// Tracer-X tree nodes and the objects allocated together with them.
+///
+//===----------------------------------------------------------------------===//
+
+#include "TxArena.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <new>
+#include <stdlib.h>
+
+using namespace klee;
+
+namespace klee {
+
+/// \brief The minimum number of objects in a slab
+static const size_t slabObjects = 256;
+
+/// \brief The alignment of the slots
+static const size_t slotAlignment = 16;
+
+/// \brief The offset of the first slot of a slab, after its header, a
+/// multiple of the slot alignment
+static const size_t slotOffset = 64;
+
+std::vector<TxArena *> &TxArena::getArenas() {
+  static std::vector<TxArena *> arenas;
+  return arenas;
+}
+
+TxArena::TxArena(const char *_name, size_t objectSize)
+    : name(_name), available(0), slabCount(0), liveCount(0), peakCount(0),
+      allocationCount(0), otherSizeBytes(0) {
+  slotSize = objectSize < sizeof(void *) ? sizeof(void *) : objectSize;
+  slotSize = (slotSize + slotAlignment - 1) / slotAlignment * slotAlignment;
+  slabSize = 1;
+  while (slabSize < slotOffset + slotSize * slabObjects)
+    slabSize <<= 1;
+  getArenas().push_back(this);
+}
+
+TxArena::Slab *TxArena::createSlab() {
+  void *memory;
+  if (posix_memalign(&memory, slabSize, slabSize))
+    klee_error("failed to allocate a %s slab", name);
+  ++slabCount;
+
+  Slab *slab = static_cast<Slab *>(memory);
+  slab->prev = slab->next = 0;
+  slab->freeList = 0;
+  slab->liveCount = 0;
+  char *slots = static_cast<char *>(memory) + slotOffset;
+  for (size_t i = (slabSize - slotOffset) / slotSize; i-- > 0;) {
+    *reinterpret_cast<void **>(slots + i * slotSize) = slab->freeList;
+    slab->freeList = slots + i * slotSize;
+  }
+  return slab;
+}
+
+void TxArena::link(Slab *slab) {
+  slab->prev = 0;
+  slab->next = available;
+  if (available)
+    available->prev = slab;
+  available = slab;
+}
+
+void TxArena::unlink(Slab *slab) {
+  if (slab->prev)
+    slab->prev->next = slab->next;
+  else
+    available = slab->next;
+  if (slab->next)
+    slab->next->prev = slab->prev;
+  slab->prev = slab->next = 0;
+}
+
+void *TxArena::allocate(size_t size) {
+  if (size > slotSize || size + slotAlignment <= slotSize) {
+    otherSizeBytes += size;
+    return ::operator new(size);
+  }
+
+  if (!available)
+    link(createSlab());
+  Slab *slab = available;
+  void *ret = slab->freeList;
+  slab->freeList = *static_cast<void **>(ret);
+  ++slab->liveCount;
+  if (!slab->freeList)
+    unlink(slab);
+
+  ++allocationCount;
+  if (++liveCount > peakCount)
+    peakCount = liveCount;
+  return ret;
+}
+
+void TxArena::deallocate(void *p, size_t size) {
+  if (!p)
+    return;
+  if (size > slotSize || size + slotAlignment <= slotSize) {
+    otherSizeBytes -= size;
+    ::operator delete(p);
+    return;
+  }
+
+  Slab *slab = reinterpret_cast<Slab *>(reinterpret_cast<uintptr_t>(p) &
+                                        ~(uintptr_t)(slabSize - 1));
+  if (!slab->freeList)
+    link(slab);
+  *static_cast<void **>(p) = slab->freeList;
+  slab->freeList = p;
+  --liveCount;
+
+  // An empty slab is kept when it is the only one with free slots, so that
+  // a single object allocated and deleted in turn does not create a slab
+  // each time
+  if (--slab->liveCount == 0 && (slab->prev || slab->next)) {
+    unlink(slab);
+    free(slab);
+    --slabCount;
+  }
+}
+
+uint64_t TxArena::getAllocatedBytes() {
+  uint64_t bytes = 0;
+  std::vector<TxArena *> &arenas = getArenas();
+  for (std::vector<TxArena *>::iterator it = arenas.begin(),
+                                        ie = arenas.end();
+       it != ie; ++it) {
+    bytes += (*it)->slabCount * (*it)->slabSize + (*it)->otherSizeBytes;
+  }
+  return bytes;
+}
+
+void TxArena::printStat(std::stringstream &stream) {
+  std::vector<TxArena *> &arenas = getArenas();
+  for (std::vector<TxArena *>::iterator it = arenas.begin(),
+                                        ie = arenas.end();
+       it != ie; ++it) {
+    TxArena *arena = *it;
+    stream << "KLEE: done:     " << arena->name
+           << " allocations (live, peak) = " << arena->allocationCount << " ("
+           << arena->liveCount << ", " << arena->peakCount
+           << "), slab bytes = " << arena->slabCount * arena->slabSize << "\n";
+  }
+}
+}
@@ -0,0 +1,96 @@
+//===--- TxArena.h ----------------------------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations for the slab allocator of the
+/// Tracer-X tree nodes and the objects allocated together with them.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TXARENA_H
+#define KLEE_TXARENA_H
+
+#include <sstream>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+
+/// \brief A slab allocator of objects of one size
+///
+/// The objects are carved out of slabs of many objects, aligned to their
+/// size so that the slab of an object is found from its address. Each slab
+/// keeps its freed objects in a free list of its own, and is released as soon
+/// as none of its objects is live, which happens when the subtree of the
+/// Tracer-X tree allocated from it dies, unless it is the only slab with
+/// free slots. Objects of other sizes, e.g., of derived classes, are
+/// allocated by the global operator new.
+class TxArena {
+  /// \brief The header of a slab, followed by its slots
+  struct Slab {
+    /// \brief The neighbors in the list of the slabs with free slots
+    Slab *prev, *next;
+
+    /// \brief The first free slot, whose first word links to the next
+    void *freeList;
+
+    unsigned liveCount;
+  };
+
+  /// \brief The name of the kind of objects, for statistics
+  const char *name;
+
+  /// \brief The size of a slot of an object
+  size_t slotSize;
+
+  /// \brief The size and alignment of a slab, a power of two
+  size_t slabSize;
+
+  /// \brief The slabs with free slots
+  Slab *available;
+
+  uint64_t slabCount;
+
+  uint64_t liveCount, peakCount, allocationCount;
+
+  /// \brief The bytes of the live objects of other sizes
+  uint64_t otherSizeBytes;
+
+  /// \brief All arenas, for statistics
+  static std::vector<TxArena *> &getArenas();
+
+  Slab *createSlab();
+
+  void link(Slab *slab);
+
+  void unlink(Slab *slab);
+
+public:
+  TxArena(const char *_name, size_t objectSize);
+
+  void *allocate(size_t size);
+
+  void deallocate(void *p, size_t size);
+
+  /// \brief Get the arena of objects of type T
+  template <typename T> static TxArena &get(const char *name) {
+    static TxArena arena(name, sizeof(T));
+    return arena;
+  }
+
+  static void printStat(std::stringstream &stream);
+
+  /// \brief The bytes allocated by all arenas, in slabs and for the objects
+  /// of other sizes
+  static uint64_t getAllocatedBytes();
+};
+}
+
+#endif
@@ -60,7 +60,7 @@ bool TxDependency::isMainArgument(const llvm::Value *loc) {
 ref<TxStateValue>
 TxDependency::registerNewTxStateValue(llvm::Value *value,
                                       ref<TxStateValue> vvalue) {
-  valuesMap[value].push_back(vvalue);
+  valuesMap.bind(value, vvalue);
   return vvalue;
 }
 
@@ -84,10 +84,10 @@ ref<TxStateValue> TxDependency::getLatestValueNoConstantCheck(
     llvm::Value *value, ref<Expr> valueExpr, bool allowInconsistency) const {
   assert(value && "value cannot be null");
 
-  std::map<llvm::Value *, std::vector<ref<TxStateValue> > >::const_iterator
-  valuesMapIter = valuesMap.find(value);
-
-  if (valuesMapIter != valuesMap.end()) {
+  for (TxVersionedValues::Binding binding = valuesMap.find(value);
+       binding.owner; binding = binding.owner->getParent()
+                                    ? binding.owner->getParent()->find(value)
+                                    : TxVersionedValues::Binding()) {
     if (!valueExpr.isNull()) {
       // Slight complication here that the latest version of an LLVM
       // value may not be at the end of the vector; it is possible other
@@ -95,7 +95,7 @@ ref<TxStateValue> TxDependency::getLatestValueNoConstantCheck(
       // the function returned, so the end part of the vector contains
       // local values in a call already returned. To resolve this issue,
       // here we naively search for values with equivalent expression.
-      const std::vector<ref<TxStateValue> > &allValues = valuesMapIter->second;
+      const std::vector<ref<TxStateValue> > &allValues = *binding.versions;
 
       // In case this was for adding constraints, simply assume the
       // latest value is the one without checking for its consistency. This is
@@ -113,14 +113,10 @@ ref<TxStateValue> TxDependency::getLatestValueNoConstantCheck(
           return *it;
       }
     } else {
-      return valuesMapIter->second.back();
+      return binding.versions->back();
     }
   }
 
-  if (parent)
-    return parent->getLatestValueNoConstantCheck(value, valueExpr,
-                                                 allowInconsistency);
-
   return 0;
 }
 
@@ -240,16 +236,10 @@ void TxDependency::addDependencyViaExternalFunction(
     return;
 
   if (source->isPointer()) {
-    std::string reason = "";
-    if (debugSubsumptionLevel >= 1) {
-      llvm::raw_string_ostream stream(reason);
-      stream << "parameter [";
-      source->getValue()->print(stream);
-      stream << "] of external call [";
-      target->getValue()->print(stream);
-      stream << "]";
-      stream.flush();
-    }
+    TxMarkReason reason;
+    if (debugSubsumptionLevel >= 1)
+      reason = TxMarkReason(TxMarkReason::ExternalCallParameter,
+                            source->getValue(), target->getValue());
     store->markPointerFlow(source, source, reason);
   }
 
@@ -303,7 +293,8 @@ void TxDependency::populateArgumentValuesList(
 TxDependency::TxDependency(
     TxDependency *parent, llvm::DataLayout *_targetData,
     std::map<const llvm::GlobalValue *, ref<ConstantExpr> > *_globalAddresses)
-    : parent(parent), left(0), right(0), targetData(_targetData),
+    : parent(parent), left(0), right(0),
+      valuesMap(parent ? &parent->valuesMap : 0), targetData(_targetData),
       globalAddresses(_globalAddresses) {
 
 
@@ -329,16 +320,8 @@ TxDependency::TxDependency(
 }
 
 TxDependency::~TxDependency() {
-  // Delete valuesMap
-  for (std::map<llvm::Value *, std::vector<ref<TxStateValue> > >::iterator
-           it = valuesMap.begin(),
-           ie = valuesMap.end();
-       it != ie; ++it) {
-    it->second.clear();
-  }
   delete pathCondition;
   delete store;
-  valuesMap.clear();
 }
 
 TxDependency *TxDependency::cdr() const { return parent; }
@@ -516,22 +499,9 @@ void TxDependency::execute(llvm::Instruction *instr,
       llvm::BranchInst *binst = llvm::dyn_cast<llvm::BranchInst>(instr);
       if (binst && binst->isConditional()) {
         ref<Expr> unknownExpression;
-        std::string reason = "";
-        if (debugSubsumptionLevel >= 1) {
-          llvm::raw_string_ostream stream(reason);
-          stream << "branch instruction [";
-          if (binst->getParent()->getParent()) {
-            stream << binst->getParent()->getParent()->getName().str() << ": ";
-          }
-          if (llvm::MDNode *n = binst->getMetadata("dbg")) {
-            llvm::DILocation loc(n);
-            stream << "Line " << loc.getLineNumber();
-          } else {
-            binst->print(stream);
-          }
-          stream << "]";
-          stream.flush();
-        }
+        TxMarkReason reason;
+        if (debugSubsumptionLevel >= 1)
+          reason = TxMarkReason(TxMarkReason::BranchInstruction, binst);
         markAllValues(binst->getCondition(), unknownExpression, reason);
       }
       break;
@@ -578,18 +548,9 @@ void TxDependency::execute(llvm::Instruction *instr,
       // constant. Here we interpolate since a constant switch argument means
       // that there are infeasible branches.
 
-      std::string reason = "";
-      if (debugSubsumptionLevel > 1) {
-        llvm::raw_string_ostream stream(reason);
-        stream << "infeasible switch case [";
-        stream << instr->getParent()->getParent()->getName().str() << ": ";
-        if (llvm::MDNode *n = instr->getMetadata("dbg")) {
-          llvm::DILocation loc(n);
-          stream << "Line " << loc.getLineNumber();
-        }
-        stream << "]";
-        stream.flush();
-      }
+      TxMarkReason reason;
+      if (debugSubsumptionLevel > 1)
+        reason = TxMarkReason(TxMarkReason::InfeasibleSwitchCase, instr);
       markAllValues(instr->getOperand(0), argExpr, reason);
       break;
     }
@@ -1003,18 +964,9 @@ bool TxDependency::executeMemoryOperation(
 
     ref<TxStateValue> val(getLatestValueForMarking(addressOperand, address));
     if (val->isPointer()) {
-      std::string reason = "";
-      if (debugSubsumptionLevel > 1) {
-        llvm::raw_string_ostream stream(reason);
-        stream << "pointer use [";
-        stream << instr->getParent()->getParent()->getName().str() << ": ";
-        if (llvm::MDNode *n = instr->getMetadata("dbg")) {
-          llvm::DILocation loc(n);
-          stream << "Line " << loc.getLineNumber();
-        }
-        stream << "]";
-        stream.flush();
-      }
+      TxMarkReason reason;
+      if (debugSubsumptionLevel > 1)
+        reason = TxMarkReason(TxMarkReason::PointerUse, instr);
       if (ExactAddressInterpolant) {
         markAllValues(val, reason);
       } else {
@@ -1032,7 +984,7 @@ bool TxDependency::executeMemoryOperation(
 
 void
 TxDependency::bindCallArguments(llvm::Instruction *i,
-                                std::vector<llvm::Instruction *> &callHistory,
+                                const TxCallHistory *&callHistory,
                                 std::vector<ref<Expr> > &arguments) {
   llvm::CallInst *site = llvm::dyn_cast<llvm::CallInst>(i);
 
@@ -1047,10 +999,11 @@ TxDependency::bindCallArguments(llvm::Instruction *i,
     return;
 
   argumentValuesList.clear();
-  populateArgumentValuesList(site, callHistory, arguments, argumentValuesList);
+  populateArgumentValuesList(site, callHistory->getHistory(), arguments,
+                             argumentValuesList);
 
   unsigned index = 0;
-  callHistory.push_back(i);
+  callHistory = callHistory->push(i);
   for (llvm::Function::ArgumentListType::iterator
            it = callee->getArgumentList().begin(),
            ie = callee->getArgumentList().end();
@@ -1059,7 +1012,7 @@ TxDependency::bindCallArguments(llvm::Instruction *i,
 
       addDependency(
           argumentValuesList.back(),
-          getNewTxStateValue(it, callHistory,
+          getNewTxStateValue(it, callHistory->getHistory(),
                              argumentValuesList.back()->getExpression()));
     }
     argumentValuesList.pop_back();
@@ -1069,24 +1022,62 @@ TxDependency::bindCallArguments(llvm::Instruction *i,
 
 void
 TxDependency::bindReturnValue(llvm::CallInst *site,
-                              std::vector<llvm::Instruction *> &callHistory,
+                              const TxCallHistory *&callHistory,
                               llvm::Instruction *i, ref<Expr> returnValue) {
   llvm::ReturnInst *retInst = llvm::dyn_cast<llvm::ReturnInst>(i);
   if (site && retInst &&
       retInst->getReturnValue() // For functions returning void
       ) {
-    ref<TxStateValue> value =
-        getLatestValue(retInst->getReturnValue(), callHistory, returnValue);
-    if (!callHistory.empty()) {
-      callHistory.pop_back();
-    }
+    ref<TxStateValue> value = getLatestValue(
+        retInst->getReturnValue(), callHistory->getHistory(), returnValue);
+    callHistory = callHistory->pop();
     if (!value.isNull())
-      addDependency(value, getNewTxStateValue(site, callHistory, returnValue));
+      addDependency(value, getNewTxStateValue(site, callHistory->getHistory(),
+                                              returnValue));
   }
 }
 
+void TxDependency::bindSummaryReturnValue(
+    llvm::CallInst *site, const std::vector<llvm::Instruction *> &callHistory,
+    std::vector<ref<Expr> > &arguments, ref<Expr> returnValue) {
+  // The body of the callee is not executed, so that the return value depends
+  // directly on the arguments, which determine it
+  ref<TxStateValue> value = getNewTxStateValue(site, callHistory, returnValue);
+  for (unsigned i = 0, n = arguments.size(); i < n; ++i)
+    addDependency(
+        getLatestValue(site->getArgOperand(i), callHistory, arguments[i]),
+        value);
+}
+
+bool TxDependency::executeBulkMemory(
+    llvm::CallInst *site, const std::vector<llvm::Instruction *> &callHistory,
+    std::vector<ref<Expr> > &arguments, ref<Expr> returnValue) {
+  ref<TxStateValue> addressValue =
+      getLatestValue(site->getArgOperand(0), callHistory, arguments[0]);
+  if (addressValue.isNull() || !addressValue->isPointer())
+    return false;
+  // The loads from the region find no entry for their offsets, and record
+  // the loaded values as new entries, so that the entries would be of the
+  // contents before the operation
+  ref<TxStateAddress> loc = addressValue->getPointerInfo();
+  if (store->isAllocationStored(loc))
+    return false;
+
+  ref<TxStateValue> storedValue = getNewTxStateValue(
+      site, callHistory, ConstantExpr::create(0, Expr::Bool));
+  for (unsigned i = 1, n = arguments.size(); i < n; ++i)
+    addDependencyToNonPointer(
+        getLatestValue(site->getArgOperand(i), callHistory, arguments[i]),
+        storedValue);
+  store->updateStore(valuesMap, loc, addressValue, storedValue);
+
+  addDependency(addressValue,
+                getNewTxStateValue(site, callHistory, returnValue));
+  return true;
+}
+
 void TxDependency::markAllValues(ref<TxStateValue> value,
-                                 const std::string &reason) {
+                                 const TxMarkReason &reason) {
   if (value.isNull())
     return;
 
@@ -1100,7 +1091,7 @@ void TxDependency::markAllValues(ref<TxStateValue> value,
 }
 
 void TxDependency::markGlobalVars(ref<TxStateValue> value,
-                                  const std::string &reason) {
+                                  const TxMarkReason &reason) {
   const std::set<ref<TxStoreEntry> > &allowBoundEntryList(
       value->getAllowBoundEntryList());
   for (std::set<ref<TxStoreEntry> >::const_iterator
@@ -1139,7 +1130,7 @@ void TxDependency::recursivelyMarkGlobalVars(ref<TxStoreEntry> se) {
 
 bool TxDependency::markAllPointerValues(ref<TxStateValue> value,
                                         std::set<uint64_t> &bounds,
-                                        const std::string &reason) {
+                                        const TxMarkReason &reason) {
   if (value.isNull())
     return false;
 
@@ -1195,18 +1186,9 @@ void TxDependency::memoryBoundViolationInterpolation(llvm::Instruction *inst,
 
   ref<TxStateValue> val(getLatestValueForMarking(addressOperand, address));
   if (val->isPointer()) {
-    std::string reason = "";
-    if (debugSubsumptionLevel > 1) {
-      llvm::raw_string_ostream stream(reason);
-      stream << "memory bound violation [";
-      stream << inst->getParent()->getParent()->getName().str() << ": ";
-      if (llvm::MDNode *n = inst->getMetadata("dbg")) {
-        llvm::DILocation loc(n);
-        stream << "Line " << loc.getLineNumber();
-      }
-      stream << "]";
-      stream.flush();
-    }
+    TxMarkReason reason;
+    if (debugSubsumptionLevel > 1)
+      reason = TxMarkReason(TxMarkReason::MemoryBoundViolation, inst);
     markAllValues(val, reason);
   }
 }
@@ -184,7 +184,7 @@ class TxDependency {
   std::vector<ref<TxStateValue> > argumentValuesList;
 
   /// \brief The store of the versioned values
-  std::map<llvm::Value *, std::vector<ref<TxStateValue> > > valuesMap;
+  TxVersionedValues valuesMap;
 
   /// \brief The data layout of the analysis target program
   llvm::DataLayout *targetData;
@@ -292,20 +292,6 @@ class TxDependency {
       std::vector<ref<Expr> > &arguments,
       std::vector<ref<TxStateValue> > &argumentValuesList);
 
-  void getStoredExpressions(
-      const TxStore *referenceStore,
-      const std::vector<llvm::Instruction *> &callHistory,
-      const std::map<ref<Expr>, ref<Expr> > &substitution,
-      std::set<const Array *> &replacements, bool coreOnly, bool leftRetrieval,
-      TxStore::TopStateStore &__internalStore,
-      TxStore::LowerStateStore &__concretelyAddressedHistoricalStore,
-      TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore) {
-    store->getStoredExpressions(
-        referenceStore, callHistory, substitution, replacements, coreOnly,
-        leftRetrieval, __internalStore, __concretelyAddressedHistoricalStore,
-        __symbolicallyAddressedHistoricalStore);
-  }
-
   void getStoredCoreExpressions(
       const TxStore *referenceStore,
       const std::vector<llvm::Instruction *> &callHistory,
@@ -335,6 +321,15 @@ public:
 
   ~TxDependency();
 
+  /// \brief Allocate from the TxDependency arena
+  static void *operator new(size_t size) {
+    return TxArena::get<TxDependency>("TxDependency").allocate(size);
+  }
+
+  static void operator delete(void *p, size_t size) {
+    TxArena::get<TxDependency>("TxDependency").deallocate(p, size);
+  }
+
   std::set<ref<TxStoreEntry> > &getMarkedGlobal() { return markedGlobal; }
 
   bool isEntryInParent(ref<TxStoreEntry> se) {
@@ -350,52 +345,17 @@ public:
 
   TxDependency *cdr() const;
 
-  /// \brief This retrieves the locations known at this state, and the
-  /// expressions stored in the locations. Returns as the last argument a pair
-  /// of the store part indexed by constants, and the store part indexed by
-  /// symbolic expressions.
+  /// \brief The store of the parent, which holds the locations known at
+  /// this state, as the allocations to be stored in the subsumption table are
+  /// obtained from the parent.
   ///
-  /// \param callHistory The current call history context of the state
-  /// \param replacements The replacement bound variables when
-  /// retrieving state for creating subsumption table entry: As the
-  /// resulting expression will be used for storing in the
-  /// subsumption table, the variables need to be replaced with the
-  /// bound ones.
-  /// \param coreOnly Indicates whether we are retrieving only data
-  /// for locations relevant to an unsatisfiability core.
-  /// \param leftRetrieval Whether the retrieval is requested by the left
-  /// child of the store, otherwise, we assume it is requested by the right
-  /// child of the store.
-  /// \param [out] concretelyAddressedStore The output concretely-addressed
-  /// store.
-  /// \param [out] symbolicallyAddressedStore The output
-  /// symbolically-addressed store.
-  /// \param [out] concretelyAddressedHistoricalStore The output
-  /// concretely-addressed historical store, whose domain consists of
-  /// historical concrete addresses that are no longer valid due to exiting of
-  /// scope.
-  /// \param [out] symbolicallyAddressedHistoricalStore The output
-  /// symbolically-addressed historical store, whose domain consists of
-  /// historical symbolic addresses that are no longer valid due to exiting of
-  /// scope.
-  ///
-  /// \sa TxStore#getStoredExpressions()
-  void getParentStoredExpressions(
-      const std::vector<llvm::Instruction *> &callHistory,
-      const std::map<ref<Expr>, ref<Expr> > &substitution,
-      std::set<const Array *> &replacements, bool coreOnly, bool &leftRetrieval,
-      TxStore::TopStateStore &__internalStore,
-      TxStore::LowerStateStore &__concretelyAddressedHistoricalStore,
-      TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore) {
-    if (parent->left == this)
-      leftRetrieval = true;
-    else
+  /// \param [out] leftRetrieval Whether this is the left child of the parent,
+  /// otherwise it is the right child.
+  const TxStore *getParentStore(bool &leftRetrieval) const {
+    leftRetrieval = parent->left == this;
+    if (!leftRetrieval)
       assert(parent->right == this && "mismatched tree edge");
-
-    parent->getStoredExpressions(store, callHistory, substitution, replacements,
-                                 coreOnly, leftRetrieval, __internalStore,
-                                 __concretelyAddressedHistoricalStore,
-                                 __symbolicallyAddressedHistoricalStore);
+    return parent->store;
   }
 
   /// \brief This retrieves the locations known at this state, and the
@@ -450,8 +410,9 @@ public:
         symbolicallyAddressedHistoricalStore);
   }
 
-  std::map<llvm::Value *, std::vector<ref<TxStateValue> > > getvaluesMap() {
-    return valuesMap;
+  const std::map<llvm::Value *, std::vector<ref<TxStateValue> > > &
+  getvaluesMap() const {
+    return valuesMap.getLocalValues();
   }
 
   ref<TxStateValue>
@@ -486,29 +447,49 @@ public:
                          std::vector<ref<Expr> > &args, bool inBounds,
                          bool symbolicExecutionError);
 
-  /// \brief Record call arguments in a function call
+  /// \brief Record call arguments in a function call, extending the call
+  /// history by the call
   void bindCallArguments(llvm::Instruction *instr,
-                         std::vector<llvm::Instruction *> &callHistory,
+                         const TxCallHistory *&callHistory,
                          std::vector<ref<Expr> > &arguments);
 
-  /// \brief This propagates the dependency due to the return value of a call
-  void bindReturnValue(llvm::CallInst *site,
-                       std::vector<llvm::Instruction *> &callHistory,
+  /// \brief This propagates the dependency due to the return value of a
+  /// call, removing the call from the call history
+  void bindReturnValue(llvm::CallInst *site, const TxCallHistory *&callHistory,
                        llvm::Instruction *inst, ref<Expr> returnValue);
 
+  /// \brief Make the return value of a call given by its function summary
+  /// depend on the arguments of the call
+  void
+  bindSummaryReturnValue(llvm::CallInst *site,
+                         const std::vector<llvm::Instruction *> &callHistory,
+                         std::vector<ref<Expr> > &arguments,
+                         ref<Expr> returnValue);
+
+  /// \brief Record a call of memcpy, mempcpy, memmove or memset performed as
+  /// a bulk operation, rather than by executing its body, as a single store
+  /// of the whole destination region depending on the other arguments.
+  /// Returns false, recording nothing, when entries of the destination
+  /// allocation are already stored, which the bulk operation would leave
+  /// out of date.
+  bool
+  executeBulkMemory(llvm::CallInst *site,
+                    const std::vector<llvm::Instruction *> &callHistory,
+                    std::vector<ref<Expr> > &arguments, ref<Expr> returnValue);
+
   /// \brief Given an LLVM value and the expression it is associated with,
   /// retrieve all the sources and mark them as in the core
   void markAllValues(llvm::Value *value, ref<Expr> expr,
-                     const std::string &reason) {
+                     const TxMarkReason &reason) {
     ref<TxStateValue> stateValue = getLatestValueForMarking(value, expr);
     markAllValues(stateValue, reason);
   }
 
   /// \brief Given a state value, retrieve all its sources and mark them as in
   /// the core
-  void markAllValues(ref<TxStateValue> value, const std::string &reason);
+  void markAllValues(ref<TxStateValue> value, const TxMarkReason &reason);
 
-  void markGlobalVars(ref<TxStateValue> value, const std::string &reason);
+  void markGlobalVars(ref<TxStateValue> value, const TxMarkReason &reason);
 
   void recursivelyMarkGlobalVars(ref<TxStoreEntry> se);
 
@@ -516,7 +497,7 @@ public:
   /// sources and mark them as in the core. Returns true if bounds error was
   /// detected; false otherwise.
   bool markAllPointerValues(ref<TxStateValue> value,
-                            const std::string &reason) {
+                            const TxMarkReason &reason) {
     std::set<uint64_t> bounds;
     return markAllPointerValues(value, bounds, reason);
   }
@@ -525,7 +506,7 @@ public:
   /// sources and mark them as in the core. Returns true if bounds error was
   /// detected; false otherwise.
   bool markAllPointerValues(ref<TxStateValue> value, std::set<uint64_t> &bounds,
-                            const std::string &reason);
+                            const TxMarkReason &reason);
 
   /// \brief Tests if bound interpolation shold be enabled
   static bool boundInterpolation(llvm::Value *val = 0);
@@ -540,6 +521,8 @@ public:
   /// \brief Set the right child
   void setRightChild(TxDependency *child) {
     right = child;
+    valuesMap.releaseSlots();
+    valuesMap.pruneShadowedVersions();
     pathCondition->setRightChild(child->pathCondition);
     store->setRightChild(child->store);
   }
@@ -547,7 +530,7 @@ public:
   /// \brief Add constraint onto the path condition
   ref<TxPCConstraint>
   addConstraint(ref<Expr> constraint, llvm::Value *condition,
-                std::vector<llvm::Instruction *> &callHistory) {
+                const std::vector<llvm::Instruction *> &callHistory) {
     return pathCondition->addConstraint(
         constraint, getLatestValue(condition, callHistory, constraint, true));
   }
@@ -571,6 +554,18 @@ public:
 
   TxStore *getStore() const { return store; }
 
+  /// \brief Estimate of the bytes of the values bound in this node
+  uint64_t getValuesByteSize() const {
+    return valuesMap.getByteSize() +
+           argumentValuesList.capacity() * sizeof(ref<TxStateValue>);
+  }
+
+  /// \brief Estimate of the bytes of the path condition markings of this
+  /// node
+  uint64_t getPathConditionByteSize() const {
+    return pathCondition->getOwnedByteSize();
+  }
+
   /// \brief Print the content of the object to the LLVM error stream
   void dump() const {
     this->print(llvm::errs());
@@ -0,0 +1,217 @@
+//===-- TxExistentialElimination.cpp ----------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementations for the elimination of the
+/// existentially-quantified variables from subsumption check queries.
+///
+//===----------------------------------------------------------------------===//
+
+#include "TxExistentialElimination.h"
+
+#include "klee/util/TxExprUtil.h"
+
+using namespace klee;
+
+namespace klee {
+
+uint64_t TxExistentialElimination::queryCount = 0;
+
+uint64_t TxExistentialElimination::eliminatedCount = 0;
+
+bool TxExistentialElimination::hasBoundVariable(ref<Expr> expr) {
+  std::map<const Expr *, std::pair<ref<Expr>, bool> >::iterator it =
+      boundOccurrence.find(expr.get());
+  if (it != boundOccurrence.end())
+    return it->second.second;
+
+  bool ret = false;
+  if (ReadExpr *readExpr = llvm::dyn_cast<ReadExpr>(expr)) {
+    ret = bound.find(readExpr->updates.root) != bound.end();
+  }
+  for (unsigned i = 0, numKids = expr->getNumKids(); !ret && i < numKids;
+       ++i) {
+    ret = hasBoundVariable(expr->getKid(i));
+  }
+
+  boundOccurrence[expr.get()] = std::make_pair(expr, ret);
+  return ret;
+}
+
+bool TxExistentialElimination::solve(ref<Expr> side, ref<Expr> other) {
+  if (hasBoundVariable(other))
+    return false;
+
+  // Invert the operations around the bound variable, which are all
+  // bijective over the bitvectors.
+  while (true) {
+    if (!hasBoundVariable(side))
+      return false;
+
+    if (isVariable(side)) {
+      if (side->getWidth() != other->getWidth() || substitution.count(side))
+        return false;
+      substitution[side] = other;
+      return true;
+    }
+
+    switch (side->getKind()) {
+    case Expr::Add: {
+      ref<Expr> lhs = side->getKid(0), rhs = side->getKid(1);
+      if (!hasBoundVariable(lhs)) {
+        other = SubExpr::create(other, lhs);
+        side = rhs;
+      } else if (!hasBoundVariable(rhs)) {
+        other = SubExpr::create(other, rhs);
+        side = lhs;
+      } else {
+        return false;
+      }
+      break;
+    }
+    case Expr::Sub: {
+      ref<Expr> lhs = side->getKid(0), rhs = side->getKid(1);
+      if (!hasBoundVariable(rhs)) {
+        other = AddExpr::create(other, rhs);
+        side = lhs;
+      } else if (!hasBoundVariable(lhs)) {
+        other = SubExpr::create(lhs, other);
+        side = rhs;
+      } else {
+        return false;
+      }
+      break;
+    }
+    case Expr::Xor: {
+      ref<Expr> lhs = side->getKid(0), rhs = side->getKid(1);
+      if (!hasBoundVariable(lhs)) {
+        other = XorExpr::create(other, lhs);
+        side = rhs;
+      } else if (!hasBoundVariable(rhs)) {
+        other = XorExpr::create(other, rhs);
+        side = lhs;
+      } else {
+        return false;
+      }
+      break;
+    }
+    case Expr::Not: {
+      other = NotExpr::create(other);
+      side = side->getKid(0);
+      break;
+    }
+    case Expr::SExt: {
+      // Here we skin matching sign extensions
+      SExtExpr *otherSExt = llvm::dyn_cast<SExtExpr>(other);
+      if (!otherSExt ||
+          otherSExt->getKid(0)->getWidth() != side->getKid(0)->getWidth())
+        return false;
+      other = otherSExt->getKid(0);
+      side = side->getKid(0);
+      break;
+    }
+    case Expr::ZExt: {
+      // Here we skin matching zero extensions
+      ZExtExpr *otherZExt = llvm::dyn_cast<ZExtExpr>(other);
+      if (!otherZExt ||
+          otherZExt->getKid(0)->getWidth() != side->getKid(0)->getWidth())
+        return false;
+      other = otherZExt->getKid(0);
+      side = side->getKid(0);
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+}
+
+void TxExistentialElimination::collectRemaining(
+    ref<Expr> equalities, std::vector<ref<Expr> > &remaining) {
+  if (llvm::isa<AndExpr>(equalities)) {
+    collectRemaining(equalities->getKid(0), remaining);
+    collectRemaining(equalities->getKid(1), remaining);
+    return;
+  }
+
+  if (llvm::isa<EqExpr>(equalities) &&
+      equalities->getKid(0)->getWidth() != Expr::Bool) {
+    ref<Expr> lhs = equalities->getKid(0), rhs = equalities->getKid(1);
+    if (solve(lhs, rhs) || solve(rhs, lhs))
+      return;
+  }
+
+  if (!equalities->isTrue())
+    remaining.push_back(equalities);
+}
+
+ref<Expr> TxExistentialElimination::removeUnsubstituted(ref<Expr> equality) {
+  // As before, an equality whose lhs is a bound variable, possibly inside
+  // matching extensions, is dropped.
+  if (!llvm::isa<EqExpr>(equality))
+    return equality;
+
+  ref<Expr> lhs = equality->getKid(0), rhs = equality->getKid(1);
+  if ((llvm::isa<SExtExpr>(lhs) && llvm::isa<SExtExpr>(rhs)) ||
+      (llvm::isa<ZExtExpr>(lhs) && llvm::isa<ZExtExpr>(rhs))) {
+    if (lhs->getKid(0)->getWidth() == rhs->getKid(0)->getWidth())
+      lhs = lhs->getKid(0);
+  }
+  if (isVariable(lhs) && hasBoundVariable(lhs))
+    return ConstantExpr::create(1, Expr::Bool);
+  return equality;
+}
+
+ref<Expr> TxExistentialElimination::eliminate(ref<Expr> existsExpr) {
+  assert(llvm::isa<ExistsExpr>(existsExpr));
+
+  ExistsExpr *expr = llvm::dyn_cast<ExistsExpr>(existsExpr);
+  ref<Expr> body = expr->body;
+
+  assert(llvm::isa<AndExpr>(body));
+
+  ++queryCount;
+
+  std::vector<ref<Expr> > remaining;
+  collectRemaining(body->getKid(1), remaining);
+
+  // One substitution pass, memoized by the visitor, over the interpolant and
+  // the remaining equalities
+  TxSubstitutionVisitor visitor(substitution);
+  ref<Expr> interpolant = visitor.visit(body->getKid(0));
+
+  ref<Expr> equalities = ConstantExpr::create(1, Expr::Bool);
+  for (std::vector<ref<Expr> >::iterator it = remaining.begin(),
+                                         ie = remaining.end();
+       it != ie; ++it) {
+    ref<Expr> equality = *it;
+    if (hasBoundVariable(equality))
+      equality = removeUnsubstituted(visitor.visit(equality));
+    if (!equality->isTrue())
+      equalities = equalities->isTrue()
+                       ? equality
+                       : AndExpr::create(equalities, equality);
+  }
+
+  ref<Expr> newBody = AndExpr::create(interpolant, equalities);
+
+  if (!hasBoundVariable(newBody)) {
+    ++eliminatedCount;
+    return newBody;
+  }
+
+  return existsExpr->rebuild(&newBody);
+}
+
+void TxExistentialElimination::printStat(std::stringstream &stream) {
+  stream << "KLEE: done:     Number of existentially-quantified subsumption "
+            "queries (made quantifier-free) = " << queryCount << " ("
+         << eliminatedCount << ")\n";
+}
+}
@@ -0,0 +1,89 @@
+//===--- TxExistentialElimination.h -----------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations for the elimination of the
+/// existentially-quantified variables from subsumption check queries.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TXEXISTENTIALELIMINATION_H
+#define KLEE_TXEXISTENTIALELIMINATION_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace klee {
+
+/// \brief Eliminates the existentially-quantified variables of a subsumption
+/// check query of the form exists bound. (interpolant /\ equalities)
+///
+/// The equalities are solved for the bound variables, inverting bitvector
+/// additions, subtractions, exclusive ors, negations and matching
+/// extensions. A solved equality is dropped from the query, and its solution
+/// substituted in one memoized pass over the rest of the query. Whether a
+/// subexpression has bound variables is also memoized, so that each
+/// subexpression is visited once.
+class TxExistentialElimination {
+  /// \brief The existentially-quantified arrays
+  const std::set<const Array *> &bound;
+
+  /// \brief Whether a subexpression has a read from a bound array. The
+  /// reference keeps the subexpression from being freed and its address
+  /// reused.
+  std::map<const Expr *, std::pair<ref<Expr>, bool> > boundOccurrence;
+
+  /// \brief The solutions of the bound variables
+  std::map<ref<Expr>, ref<Expr> > substitution;
+
+  /// \brief The number of queries given to the elimination
+  static uint64_t queryCount;
+
+  /// \brief The number of queries made quantifier-free
+  static uint64_t eliminatedCount;
+
+  static bool isVariable(ref<Expr> expr) {
+    return llvm::isa<ConcatExpr>(expr) || llvm::isa<ReadExpr>(expr);
+  }
+
+  /// \brief Solve the equality side == other for a bound variable in side,
+  /// returning true when a new solution is recorded
+  bool solve(ref<Expr> side, ref<Expr> other);
+
+  /// \brief Split the equalities into the ones solved for a bound variable
+  /// and the remaining ones
+  void collectRemaining(ref<Expr> equalities,
+                        std::vector<ref<Expr> > &remaining);
+
+  /// \brief Remove the remaining equalities whose lhs is still a bound
+  /// variable
+  ref<Expr> removeUnsubstituted(ref<Expr> equality);
+
+public:
+  TxExistentialElimination(const std::set<const Array *> &_bound)
+      : bound(_bound) {}
+
+  /// \brief Test if the expression has a read from a bound array
+  bool hasBoundVariable(ref<Expr> expr);
+
+  /// \brief Eliminate the bound variables of the existentially-quantified
+  /// expression, whose body is a conjunction of the interpolant and the
+  /// equalities. The result is quantifier-free when all bound variables
+  /// could be eliminated.
+  ref<Expr> eliminate(ref<Expr> existsExpr);
+
+  static void printStat(std::stringstream &stream);
+};
+}
+
+#endif
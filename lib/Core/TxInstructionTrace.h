@@ -0,0 +1,148 @@
+//===--- TxInstructionTrace.h -----------------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the trace of the instructions
+/// executed in a Tracer-X tree node, used by the weakest precondition
+/// interpolation.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TXINSTRUCTIONTRACE_H
+#define KLEE_TXINSTRUCTIONTRACE_H
+
+#include "klee/Config/Version.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Instruction.h"
+#else
+#include "llvm/BasicBlock.h"
+#include "llvm/Instruction.h"
+#endif
+
+#include <stddef.h>
+#include <vector>
+
+namespace klee {
+
+/// \brief The instructions executed in a node, in execution order
+///
+/// The trace is stored as runs of consecutive instructions of a basic block,
+/// so that it takes a record per executed block rather than per executed
+/// instruction. Only the last instruction of a run can be a terminator,
+/// hence the mark of a branch instruction is stored in the run it ends.
+class TxInstructionTrace {
+public:
+  /// \brief The marks of the branch instructions. The branch condition, or
+  /// its negation, is needed by a target if the branch is marked.
+  enum Mark {
+    Unmarked = 0,
+    ConditionNeeded = 1,
+    NegatedConditionNeeded = 2
+  };
+
+private:
+  struct Run {
+    llvm::Instruction *last;
+    unsigned length;
+    Mark mark;
+  };
+
+  std::vector<Run> runs;
+
+public:
+  /// \brief Iterator over the instructions from the last executed one
+  class reverse_iterator {
+    friend class TxInstructionTrace;
+
+    const std::vector<Run> *runs;
+
+    /// \brief The number of runs from the first one to the current one,
+    /// inclusive, which is zero at the end
+    size_t run;
+
+    /// \brief The position of the instruction from the end of its run
+    unsigned offset;
+
+    llvm::Instruction *instruction;
+
+    reverse_iterator(const std::vector<Run> *_runs, size_t _run)
+        : runs(_runs), run(_run), offset(0),
+          instruction(_run ? (*_runs)[_run - 1].last : 0) {}
+
+  public:
+    llvm::Instruction *getInstruction() const { return instruction; }
+
+    Mark getMark() const {
+      return offset == 0 ? (*runs)[run - 1].mark : Unmarked;
+    }
+
+    reverse_iterator &operator++() {
+      if (++offset < (*runs)[run - 1].length) {
+        llvm::BasicBlock::iterator it(instruction);
+        instruction = &*--it;
+      } else {
+        --run;
+        offset = 0;
+        instruction = run ? (*runs)[run - 1].last : 0;
+      }
+      return *this;
+    }
+
+    bool operator==(const reverse_iterator &b) const {
+      return run == b.run && offset == b.offset;
+    }
+    bool operator!=(const reverse_iterator &b) const { return !(*this == b); }
+  };
+
+  reverse_iterator rbegin() const { return reverse_iterator(&runs, runs.size()); }
+  reverse_iterator rend() const { return reverse_iterator(&runs, 0); }
+
+  bool empty() const { return runs.empty(); }
+
+  size_t getByteSize() const { return runs.capacity() * sizeof(Run); }
+
+  /// \brief The last executed instruction
+  llvm::Instruction *back() const { return runs.back().last; }
+
+  void push_back(llvm::Instruction *instruction) {
+    if (!runs.empty()) {
+      Run &r = runs.back();
+      if (!r.last->isTerminator()) {
+        llvm::BasicBlock::iterator next(r.last);
+        if (&*++next == instruction) {
+          r.last = instruction;
+          ++r.length;
+          return;
+        }
+      }
+    }
+    Run r = { instruction, 1, Unmarked };
+    runs.push_back(r);
+  }
+
+  /// \brief Mark the last execution of a terminator instruction, which is
+  /// normally the last instruction of the trace. Return false if it has no
+  /// unmarked execution.
+  bool mark(llvm::Instruction *instruction, Mark mark) {
+    for (std::vector<Run>::reverse_iterator it = runs.rbegin(),
+                                            ie = runs.rend();
+         it != ie; ++it) {
+      if (it->last == instruction && it->mark == Unmarked) {
+        it->mark = mark;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+}
+
+#endif
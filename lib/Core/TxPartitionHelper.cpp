@@ -15,6 +15,8 @@
 
 #include "TxPartitionHelper.h"
 
+#include "klee/util/TxExprUtil.h"
+
 using namespace klee;
 
 std::vector<ref<Expr> > TxPartitionHelper::getExprsFromAndExpr(ref<Expr> e) {
@@ -36,123 +38,102 @@ std::vector<ref<Expr> > TxPartitionHelper::getExprsFromAndExpr(ref<Expr> e) {
   return ret;
 }
 
-std::set<std::string> TxPartitionHelper::getExprVars(ref<Expr> expr) {
-  std::set<std::string> vars;
-
-  switch (expr->getKind()) {
-  case Expr::InvalidKind:
-  case Expr::Constant: {
-    return vars;
-  }
-
-  case Expr::WPVar: {
-    ref<WPVarExpr> WPVar = dyn_cast<WPVarExpr>(expr);
-    vars.insert(WPVar->address->getName());
-    return vars;
-  }
-
-  case Expr::Read: {
-    ref<ReadExpr> readExpr = dyn_cast<ReadExpr>(expr);
-    vars.insert(readExpr->getName());
-    return vars;
-  }
+namespace {
+/// \brief Collection of the names of the variables of an expression, used by
+/// TxPartitionHelper::getExprVars
+class TxExprVarCollector : public TxExprWalker {
+  bool visit(const ref<Expr> &expr) {
+    switch (expr->getKind()) {
+    case Expr::InvalidKind:
+    case Expr::Constant: {
+      return true;
+    }
 
-  case Expr::Concat: {
-    ref<ConcatExpr> concatExpr = dyn_cast<ConcatExpr>(expr);
-    std::set<std::string> vars1 = getExprVars(concatExpr->getLeft());
-    std::set<std::string> vars2 = getExprVars(concatExpr->getRight());
-    vars1.insert(vars2.begin(), vars2.end());
-    return vars1;
-  }
+    case Expr::WPVar: {
+      ref<WPVarExpr> WPVar = dyn_cast<WPVarExpr>(expr);
+      vars.insert(WPVar->address->getName());
+      return true;
+    }
 
-  case Expr::NotOptimized:
-  case Expr::Not:
-  case Expr::Extract:
-  case Expr::ZExt:
-  case Expr::SExt: {
-    return getExprVars(expr->getKid(0));
-  }
+    case Expr::Read: {
+      ref<ReadExpr> readExpr = dyn_cast<ReadExpr>(expr);
+      vars.insert(readExpr->getName());
+      return true;
+    }
 
-  case Expr::Eq:
-  case Expr::Ne:
-  case Expr::Ult:
-  case Expr::Ule:
-  case Expr::Ugt:
-  case Expr::Uge:
-  case Expr::Slt:
-  case Expr::Sle:
-  case Expr::Sgt:
-  case Expr::Sge:
-  case Expr::LastKind:
-  case Expr::Add:
-  case Expr::Sub:
-  case Expr::Mul:
-  case Expr::UDiv:
-  case Expr::SDiv:
-  case Expr::URem:
-  case Expr::SRem:
-  case Expr::And:
-  case Expr::Or:
-  case Expr::Xor:
-  case Expr::Shl:
-  case Expr::LShr:
-  case Expr::AShr: {
-    ref<Expr> kids[2];
-    kids[0] = expr->getKid(0);
-    kids[1] = expr->getKid(1);
-    std::set<std::string> left = getExprVars(kids[0]);
-    std::set<std::string> right = getExprVars(kids[1]);
-    left.insert(right.begin(), right.end());
-    return left;
-  }
+    case Expr::NotOptimized:
+    case Expr::Not:
+    case Expr::Extract:
+    case Expr::ZExt:
+    case Expr::SExt: {
+      push(expr->getKid(0));
+      return true;
+    }
 
-  case Expr::Select: {
-    std::set<std::string> vars1;
-    ref<Expr> kids[2];
-    kids[0] = expr->getKid(0);
-    if (kids[0]->getKind() != Expr::WPVar) {
-      vars1 = getExprVars(kids[0]);
+    case Expr::Concat:
+    case Expr::Eq:
+    case Expr::Ne:
+    case Expr::Ult:
+    case Expr::Ule:
+    case Expr::Ugt:
+    case Expr::Uge:
+    case Expr::Slt:
+    case Expr::Sle:
+    case Expr::Sgt:
+    case Expr::Sge:
+    case Expr::LastKind:
+    case Expr::Add:
+    case Expr::Sub:
+    case Expr::Mul:
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+    case Expr::And:
+    case Expr::Or:
+    case Expr::Xor:
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr:
+    case Expr::Sel: {
+      push(expr->getKid(0));
+      push(expr->getKid(1));
+      return true;
     }
-    kids[1] = expr->getKid(1);
-    std::set<std::string> vars2 = getExprVars(kids[1]);
-    vars1.insert(vars2.begin(), vars2.end());
-    return vars1;
-  }
 
-  case Expr::Upd: {
-    std::set<std::string> vars1;
-    ref<Expr> kids[3];
-    kids[0] = expr->getKid(0);
-    if (kids[0]->getKind() != Expr::WPVar) {
-      vars1 = getExprVars(kids[0]);
+    case Expr::Select: {
+      if (expr->getKid(0)->getKind() != Expr::WPVar)
+        push(expr->getKid(0));
+      push(expr->getKid(1));
+      return true;
     }
 
-    kids[1] = expr->getKid(1);
-    std::set<std::string> vars2 = getExprVars(kids[1]);
-    vars1.insert(vars2.begin(), vars2.end());
-    kids[2] = expr->getKid(2);
-    std::set<std::string> vars3 = getExprVars(kids[2]);
-    vars1.insert(vars3.begin(), vars3.end());
-    return vars1;
-  }
-  case Expr::Sel: {
-    ref<Expr> kids[2];
-    kids[0] = expr->getKid(0);
-    kids[1] = expr->getKid(1);
-    std::set<std::string> vars1 = getExprVars(kids[0]);
-    std::set<std::string> vars2 = getExprVars(kids[1]);
-    vars1.insert(vars2.begin(), vars2.end());
-    return vars1;
-  }
-  default: {
-    // Sanity check
-    expr->dump();
-    klee_error("Control should not reach here in "
-               "TxPartitionHelper::getExprVars!");
-  }
+    case Expr::Upd: {
+      if (expr->getKid(0)->getKind() != Expr::WPVar)
+        push(expr->getKid(0));
+      push(expr->getKid(1));
+      push(expr->getKid(2));
+      return true;
+    }
+    default: {
+      // Sanity check
+      expr->dump();
+      klee_error("Control should not reach here in "
+                 "TxPartitionHelper::getExprVars!");
+    }
+    }
+    return true;
   }
 
-  return vars;
+public:
+  std::set<std::string> vars;
+};
+}
+
+std::set<std::string> TxPartitionHelper::getExprVars(ref<Expr> expr) {
+  TxExprVarCollector collector;
+  collector.walk(expr);
+  return collector.vars;
 }
 
 bool TxPartitionHelper::isShared(std::set<std::string> ss1,
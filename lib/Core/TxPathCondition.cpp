@@ -77,75 +77,82 @@ TxPathCondition::addConstraint(ref<Expr> constraint,
                                ref<TxStateValue> condition) {
   ref<TxPCConstraint> pcConstraint(
       new TxPCConstraint(constraint, condition, depth));
-  pcDepth[constraint] = pcConstraint;
+  pcDepth = pcDepth.replace(std::make_pair(constraint, pcConstraint));
   if (llvm::isa<OrExpr>(constraint)) {
     // FIXME: Break up disjunction into its components, because each disjunct is
     // solved separately. The or constraint was due to state merge. Hence, the
     // following is just a makeshift for when state merge is properly
     // implemented.
-    pcDepth[constraint->getKid(0)] = pcConstraint;
-    pcDepth[constraint->getKid(1)] = pcConstraint;
+    pcDepth =
+        pcDepth.replace(std::make_pair(constraint->getKid(0), pcConstraint));
+    pcDepth =
+        pcDepth.replace(std::make_pair(constraint->getKid(1), pcConstraint));
   }
   return pcConstraint;
 }
 
+namespace {
+/// \brief Order the constraints by their depths, and then as the sets do
+struct PCConstraintDepthLess {
+  bool operator()(const ref<TxPCConstraint> &a,
+                  const ref<TxPCConstraint> &b) const {
+    if (a->getDepth() != b->getDepth())
+      return a->getDepth() < b->getDepth();
+    return a < b;
+  }
+};
+}
+
 void TxPathCondition::unsatCoreInterpolation(
     const std::vector<ref<Expr> > &unsatCore) {
-  std::map<uint64_t, std::set<ref<TxPCConstraint> > > depthToConstraintSet;
-  std::set<uint64_t> keySet;
-  std::vector<uint64_t> sortedKeys;
+  std::vector<ref<TxPCConstraint> > coreConstraints;
+  coreConstraints.reserve(unsatCore.size());
 
   for (std::vector<ref<Expr> >::const_iterator it = unsatCore.begin(),
                                                ie = unsatCore.end();
        it != ie; ++it) {
-    std::map<ref<Expr>, ref<TxPCConstraint> >::iterator pcDepthIter =
-        pcDepth.find(*it);
+    const PCDepthMap::value_type *pcDepthEntry = pcDepth.lookup(*it);
     // FIXME: Sometimes some constraints are not in the PC. This is
     // because constraints are not properly added at state merge.
-    if (pcDepthIter != pcDepth.end()) {
-      ref<TxPCConstraint> &pcConstraint = pcDepthIter->second;
-      depthToConstraintSet[pcConstraint->getDepth()].insert(pcConstraint);
-      keySet.insert(pcConstraint->getDepth());
+    if (pcDepthEntry) {
+      const ref<TxPCConstraint> &pcConstraint = pcDepthEntry->second;
+      coreConstraints.push_back(pcConstraint);
 
       TxTreeGraph::setAsCore(pcConstraint.get());
     }
   }
-
-  for (std::set<uint64_t>::iterator it = keySet.begin(), ie = keySet.end();
-       it != ie; ++it) {
-    sortedKeys.push_back(*it);
-  }
-
-  std::sort(sortedKeys.begin(), sortedKeys.end());
-
-  std::set<ref<TxPCConstraint> > currentSet;
-  for (std::vector<uint64_t>::iterator it = sortedKeys.begin(),
-                                       ie = sortedKeys.end();
-       it != ie; ++it) {
-    std::set<ref<TxPCConstraint> > &constraintSet = depthToConstraintSet[*it];
-    currentSet.insert(constraintSet.begin(), constraintSet.end());
-    depthToConstraintSet[*it] = currentSet;
-  }
-
-  for (std::vector<uint64_t>::reverse_iterator it = sortedKeys.rbegin(),
-                                               ie = sortedKeys.rend();
-       it != ie; ++it) {
-    uint64_t constraintDepth = *it;
-    std::set<ref<TxPCConstraint> > &constraintSet =
-        depthToConstraintSet[constraintDepth];
-    TxPathCondition *currentPC = this;
-
-    while (currentPC && currentPC->parent && currentPC->depth >= constraintDepth) {
-      if (currentPC->parent->left == currentPC) {
-        currentPC = currentPC->parent;
-        currentPC->usedByLeftPath.insert(constraintSet.begin(),
-                                         constraintSet.end());
-      } else if (currentPC->parent->right == currentPC) {
-        currentPC = currentPC->parent;
-        currentPC->usedByRightPath.insert(constraintSet.begin(),
-                                          constraintSet.end());
-      }
+  if (coreConstraints.empty())
+    return;
+
+  std::sort(coreConstraints.begin(), coreConstraints.end(),
+            PCConstraintDepthLess());
+  coreConstraints.erase(
+      std::unique(coreConstraints.begin(), coreConstraints.end()),
+      coreConstraints.end());
+
+  // A single walk to the root marks the constraints in all the ancestors
+  // at once: the parent of a node on the path uses the core constraints
+  // introduced at the depth of the node or above. As the depth decreases
+  // along the walk, these are a shrinking prefix of the sorted constraints.
+  uint64_t minDepth = coreConstraints.front()->getDepth();
+  std::vector<ref<TxPCConstraint> >::iterator prefixEnd =
+      coreConstraints.end();
+  TxPathCondition *currentPC = this;
+  while (currentPC && currentPC->parent && currentPC->depth >= minDepth) {
+    while (prefixEnd != coreConstraints.begin() &&
+           (*(prefixEnd - 1))->getDepth() > currentPC->depth)
+      --prefixEnd;
+
+    std::set<ref<TxPCConstraint> > *usedList;
+    if (currentPC->parent->left == currentPC) {
+      usedList = &currentPC->parent->usedByLeftPath;
+    } else if (currentPC->parent->right == currentPC) {
+      usedList = &currentPC->parent->usedByRightPath;
+    } else {
+      break;
     }
+    usedList->insert(coreConstraints.begin(), prefixEnd);
+    currentPC = currentPC->parent;
   }
 }
 
@@ -206,9 +213,8 @@ void TxPathCondition::print(llvm::raw_ostream &stream,
   std::string tabsNext = appendTab(tabs);
 
   stream << tabs << "path condition = [";
-  for (std::map<ref<Expr>, ref<TxPCConstraint> >::const_iterator
-           is = pcDepth.begin(),
-           it = is, ie = pcDepth.end();
+  for (PCDepthMap::iterator is = pcDepth.begin(), it = is,
+                            ie = pcDepth.end();
        it != ie; ++it) {
     if (it != is)
       stream << ",";
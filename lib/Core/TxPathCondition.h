@@ -16,7 +16,9 @@
 #ifndef KLEE_TXPATHCONDITION_H
 #define KLEE_TXPATHCONDITION_H
 
+#include "TxArena.h"
 #include "klee/Constraints.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
 #include "klee/util/TxPrintUtil.h"
 #include "klee/Internal/Module/TxValues.h"
 
@@ -66,8 +68,12 @@ public:
 };
 
 class TxPathCondition {
-  /// \brief The path condition, with the levels each one is introduced
-  std::map<ref<Expr>, ref<TxPCConstraint> > pcDepth;
+  typedef ImmutableMap<ref<Expr>, ref<TxPCConstraint> > PCDepthMap;
+
+  /// \brief The path condition, with the levels each one is introduced. This
+  /// is a persistent map so that a child shares the nodes of its parent's
+  /// path condition, making the creation of a child constant time.
+  PCDepthMap pcDepth;
 
   /// \brief Store elements used by left path
   std::set<ref<TxPCConstraint> > usedByLeftPath;
@@ -87,6 +93,22 @@ class TxPathCondition {
 public:
   ~TxPathCondition() {}
 
+  /// \brief Estimate of the bytes of the markings of this node. The path
+  /// condition map itself is shared with the ancestors.
+  uint64_t getOwnedByteSize() const {
+    return (usedByLeftPath.size() + usedByRightPath.size()) *
+           (sizeof(ref<TxPCConstraint>) + 4 * sizeof(void *));
+  }
+
+  /// \brief Allocate from the TxPathCondition arena
+  static void *operator new(size_t size) {
+    return TxArena::get<TxPathCondition>("TxPathCondition").allocate(size);
+  }
+
+  static void operator delete(void *p, size_t size) {
+    TxArena::get<TxPathCondition>("TxPathCondition").deallocate(p, size);
+  }
+
   static TxPathCondition *create(TxPathCondition *src) {
     TxPathCondition *ret = new TxPathCondition();
     if (!src) {
@@ -16,11 +16,32 @@
 
 #include "TxShadowArray.h"
 
+#include "klee/Internal/Support/Timer.h"
+
+#include "llvm/Support/CommandLine.h"
+
 using namespace klee;
 
+namespace {
+llvm::cl::opt<unsigned> ShadowMemoSize(
+    "shadow-memo-size",
+    llvm::cl::desc("Maximum number of memoized shadow expressions, which are "
+                   "the interpolant expressions with their arrays replaced "
+                   "by existentially-quantified ones (0=off, default=65536)."),
+    llvm::cl::init(65536));
+}
+
 namespace klee {
 
-std::map<const Array *, const Array *> TxShadowArray::shadowArray;
+std::map<ref<Expr>, TxShadowArray::ShadowMemo> TxShadowArray::shadowMemo;
+
+uint64_t TxShadowArray::memoHits = 0;
+
+uint64_t TxShadowArray::memoMisses = 0;
+
+uint64_t TxShadowArray::shadowTime = 0;
+
+unsigned TxShadowArray::depth = 0;
 
 UpdateNode *
 TxShadowArray::getShadowUpdate(const UpdateNode *source,
@@ -44,19 +65,59 @@ ref<Expr> TxShadowArray::createBinaryOfSameKind(ref<Expr> originalExpr,
   return Expr::createFromKind(originalExpr->getKind(), exprs);
 }
 
-void TxShadowArray::addShadowArrayMap(const Array *source, const Array *target) {
-  shadowArray[source] = target;
-}
-
 ref<Expr>
 TxShadowArray::getShadowExpression(ref<Expr> expr,
                                  std::set<const Array *> &replacements) {
+  if (!ShadowMemoSize)
+    return createShadowExpression(expr, replacements);
+
+  if (depth > 0)
+    return getMemoizedShadowExpression(expr, replacements);
+
+  WallTimer timer;
+  ++depth;
+  ref<Expr> ret = getMemoizedShadowExpression(expr, replacements);
+  --depth;
+  shadowTime += timer.check();
+  return ret;
+}
+
+ref<Expr> TxShadowArray::getMemoizedShadowExpression(
+    ref<Expr> expr, std::set<const Array *> &replacements) {
+  if (llvm::isa<ConstantExpr>(expr))
+    return expr;
+
+  std::map<ref<Expr>, ShadowMemo>::iterator it = shadowMemo.find(expr);
+  if (it != shadowMemo.end()) {
+    ++memoHits;
+    replacements.insert(it->second.replacements.begin(),
+                        it->second.replacements.end());
+    return it->second.shadow;
+  }
+  ++memoMisses;
+
+  std::set<const Array *> newReplacements;
+  ref<Expr> ret = createShadowExpression(expr, newReplacements);
+  replacements.insert(newReplacements.begin(), newReplacements.end());
+
+  // Bound the memo table: we simply start afresh when it is full
+  if (shadowMemo.size() >= ShadowMemoSize)
+    shadowMemo.clear();
+  ShadowMemo &memo = shadowMemo[expr];
+  memo.shadow = ret;
+  memo.replacements.assign(newReplacements.begin(), newReplacements.end());
+  return ret;
+}
+
+ref<Expr>
+TxShadowArray::createShadowExpression(ref<Expr> expr,
+                                      std::set<const Array *> &replacements) {
   ref<Expr> ret;
 
   switch (expr->getKind()) {
   case Expr::Read: {
     ReadExpr *readExpr = llvm::dyn_cast<ReadExpr>(expr);
-    const Array *replacementArray = shadowArray[readExpr->updates.root];
+    const Array *replacementArray = readExpr->updates.root->getShadow();
 
     if (std::find(replacements.begin(), replacements.end(), replacementArray) ==
         replacements.end()) {
@@ -141,4 +202,20 @@ TxShadowArray::getShadowExpression(ref<Expr> expr,
   return ret;
 }
 
+void TxShadowArray::printStat(std::stringstream &stream) {
+  uint64_t lookups = memoHits + memoMisses;
+  stream << "KLEE: done:     Shadow expression memo hits = " << memoHits
+         << " of " << lookups << " lookups";
+  if (lookups)
+    stream << " (" << (memoHits * 100 / lookups) << "%)";
+  stream << "\n";
+  stream << "KLEE: done:     Shadow expression construction time (ms) = "
+         << ((double)shadowTime) / 1000 << "\n";
+  // Each hit avoids, at least, the construction of one node, hence we
+  // estimate the time saved from the average time per constructed node.
+  if (memoMisses)
+    stream << "KLEE: done:     Estimated time saved by memo (ms) = "
+           << ((double)shadowTime * memoHits / memoMisses) / 1000 << "\n";
+}
+
 }
@@ -19,21 +19,62 @@
 
 #include "AddressSpace.h"
 
+#include "klee/util/ArrayCache.h"
+
+#include <sstream>
+
 namespace klee {
 
   /// \brief Implements the replacement mechanism for replacing variables, used in
   /// replacing free with bound variables.
   class TxShadowArray {
-    static std::map<const Array *, const Array *> shadowArray;
+    /// \brief A memoized shadow expression, with the shadow arrays it
+    /// introduces.
+    struct ShadowMemo {
+      ref<Expr> shadow;
+
+      std::vector<const Array *> replacements;
+    };
+
+    /// \brief The memo table of shadow expressions, keyed by the original
+    /// expressions. The shadow expression is a function of the original
+    /// expression only (the replacement set being an output), hence the
+    /// replacement set is not part of the key.
+    static std::map<ref<Expr>, ShadowMemo> shadowMemo;
+
+    /// \brief Statistics of the memo table
+    static uint64_t memoHits;
+    static uint64_t memoMisses;
+
+    /// \brief The total time in microseconds of the outermost calls to
+    /// TxShadowArray#getShadowExpression
+    static uint64_t shadowTime;
+
+    /// \brief The nesting of the calls to TxShadowArray#getShadowExpression
+    static unsigned depth;
 
     static UpdateNode *getShadowUpdate(const UpdateNode *chain,
 				       std::set<const Array *> &replacements);
 
+    /// \brief Rebuild the expression with the shadow arrays, memoizing the
+    /// subexpressions.
+    static ref<Expr> createShadowExpression(ref<Expr> expr,
+                                            std::set<const Array *> &replacements);
+
+    /// \brief Get the shadow expression, using the memo table.
+    static ref<Expr> getMemoizedShadowExpression(
+        ref<Expr> expr, std::set<const Array *> &replacements);
+
   public:
     static ref<Expr> createBinaryOfSameKind(ref<Expr> originalExpr,
 					    ref<Expr> newLhs, ref<Expr> newRhs);
 
-    static void addShadowArrayMap(const Array *source, const Array *target);
+    /// \brief Create the shadow of an array in the array cache, referenced
+    /// from the array by Array#getShadow
+    static const Array *createShadowArray(ArrayCache &arrayCache,
+                                          const Array *source) {
+      return arrayCache.CreateShadowArray(source, getShadowName(source->name));
+    }
 
     static ref<Expr> getShadowExpression(ref<Expr> expr,
 					 std::set<const Array *> &replacements);
@@ -41,6 +82,9 @@ namespace klee {
     static std::string getShadowName(std::string name) {
       return "__shadow__" + name;
     }
+
+    /// \brief Print the memo table statistics
+    static void printStat(std::stringstream &stream);
   };
 
 }
@@ -15,27 +15,42 @@
 
 #include "TxSpeculation.h"
 
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+
+#include "llvm/IR/GlobalVariable.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace klee;
 
 std::string TxSpeculationHelper::WHITESPACE = " \n\r\t\f\v";
 
-bool TxSpeculationHelper::isStateSpeculable(ExecutionState &current) {
-  if (current.stack.back().kf->function->getName().substr(0, 5) == "klee_" ||
-      current.stack.back().kf->function->getName().substr(0, 3) == "tx_") {
+std::vector<bool> TxSpeculationHelper::speculable;
+
+bool TxSpeculationHelper::computeSpeculable(llvm::Instruction *inst) {
+  llvm::Function *f = inst->getParent()->getParent();
+  if (f->getName().substr(0, 5) == "klee_" ||
+      f->getName().substr(0, 3) == "tx_") {
     return false;
   }
 
-  if (isa<llvm::BranchInst>(current.prevPC->inst)) {
-    llvm::BranchInst *bi = dyn_cast<llvm::BranchInst>(current.prevPC->inst);
+  if (llvm::BranchInst *bi = dyn_cast<llvm::BranchInst>(inst)) {
+    if (bi->getNumOperands() < 2)
+      return true;
     llvm::BasicBlock *bb = dyn_cast<llvm::BasicBlock>(bi->getOperand(1));
-    if (isa<llvm::CallInst>(bb->getInstList().front())) {
+    if (bb && isa<llvm::CallInst>(bb->getInstList().front())) {
       llvm::CallInst *ci = dyn_cast<llvm::CallInst>(&bb->getInstList().front());
       std::string str;
       llvm::raw_string_ostream os(str);
       ci->getCalledValue()->print(os);
-      //      llvm::outs() << "os: " << os.str() << "\n";
-      //      llvm::outs() << "assert fail = " <<
-      //      (os.str().find("@__assert_fail") != std::string::npos) << "\n";
       if (os.str().find("@__assert_fail") != std::string::npos) {
         return false;
       }
@@ -44,6 +59,26 @@ bool TxSpeculationHelper::isStateSpeculable(ExecutionState &current) {
   return true;
 }
 
+void TxSpeculationHelper::initialize(KModule *kmodule) {
+  speculable.assign(kmodule->infos->getMaxID() + 1, true);
+  for (std::vector<KFunction *>::iterator it = kmodule->functions.begin(),
+                                          ie = kmodule->functions.end();
+       it != ie; ++it) {
+    KFunction *kf = *it;
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      speculable[ki->info->id] = computeSpeculable(ki->inst);
+    }
+  }
+}
+
+bool TxSpeculationHelper::isStateSpeculable(ExecutionState &current) {
+  unsigned id = current.prevPC->info->id;
+  if (id < speculable.size())
+    return speculable[id];
+  return computeSpeculable(current.prevPC->inst);
+}
+
 bool TxSpeculationHelper::isOverlap(std::set<std::string> &s1,
                                     std::set<std::string> &s2) {
   for (std::set<std::string>::iterator it1 = s1.begin(), ie1 = s1.end();
@@ -58,15 +93,442 @@ bool TxSpeculationHelper::isOverlap(std::set<std::string> &s1,
   return false;
 }
 
-bool TxSpeculationHelper::isIndependent(
-    std::set<std::string> &vars,
-    std::map<int, std::set<std::string> > &avoidance) {
-  for (std::map<int, std::set<std::string> >::iterator it = avoidance.begin(),
-                                                       ie = avoidance.end();
+const std::set<std::string> &TxSpeculationHelper::getVarNames(
+    llvm::Value *v, std::map<llvm::Value *, std::set<std::string> > &cache) {
+  std::map<llvm::Value *, std::set<std::string> >::iterator cached =
+      cache.find(v);
+  if (cached != cache.end())
+    return cached->second;
+
+  // The entry is created before visiting the operands, so that a cycle of
+  // phi nodes ends
+  std::set<std::string> &ret = cache[v];
+  if (llvm::GlobalVariable *gv = llvm::dyn_cast<llvm::GlobalVariable>(v)) {
+    ret.insert(gv->getName().data());
+  } else if (llvm::Instruction *ins = llvm::dyn_cast<llvm::Instruction>(v)) {
+    switch (ins->getOpcode()) {
+    case llvm::Instruction::Alloca: {
+      llvm::AllocaInst *ai = llvm::cast<llvm::AllocaInst>(ins);
+      if (ai->getName() == "") {
+        llvm::Function *f = ai->getParent()->getParent();
+        if (ai == &f->getEntryBlock().front()) {
+          ret.insert(f->arg_begin()->getName().data());
+        } else if (ai == f->getEntryBlock().front().getNextNode()) {
+          ret.insert(f->arg_begin()->getNextNode()->getName().data());
+        }
+      } else {
+        ret.insert(ai->getName().data());
+      }
+      break;
+    }
+    default: {
+      for (unsigned i = 0u; i < ins->getNumOperands(); i++) {
+        const std::set<std::string> &tmp =
+            getVarNames(ins->getOperand(i), cache);
+        ret.insert(tmp.begin(), tmp.end());
+      }
+    }
+    }
+  }
+  return ret;
+}
+
+static const char avoidanceMagic[4] = { 'T', 'X', 'S', 'A' };
+
+static const uint32_t avoidanceVersion = 2;
+
+/// \brief The FNV-1a hash of the names and contents of the files, a missing
+/// file hashing as empty
+static uint64_t hashFiles(const std::vector<std::string> &fileNames) {
+  uint64_t hash = 14695981039346656037ULL;
+  char buffer[4096];
+  for (std::vector<std::string>::const_iterator it = fileNames.begin(),
+                                                ie = fileNames.end();
        it != ie; ++it) {
-    if (isOverlap(it->second, vars)) {
-      return false;
+    // The name is terminated by its null character
+    for (const char *c = it->c_str(), *ce = c + it->size() + 1; c != ce; ++c)
+      hash = (hash ^ (unsigned char)*c) * 1099511628211ULL;
+    std::ifstream in(it->c_str(), std::ios::in | std::ios::binary);
+    while (in) {
+      in.read(buffer, sizeof(buffer));
+      for (std::streamsize i = 0, n = in.gcount(); i < n; ++i)
+        hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ULL;
     }
   }
+  return hash;
+}
+
+unsigned TxSpeculationAvoidance::getVariableId(const std::string &name) {
+  std::map<std::string, unsigned>::iterator it = variableIds.find(name);
+  if (it != variableIds.end())
+    return it->second;
+  unsigned id = variableIds.size();
+  variableIds[name] = id;
+  return id;
+}
+
+TxSpeculationAvoidance::Bitset TxSpeculationAvoidance::getVariables(
+    const std::set<std::string> &vars) const {
+  Bitset ret;
+  for (std::set<std::string>::const_iterator it = vars.begin(),
+                                             ie = vars.end();
+       it != ie; ++it) {
+    std::map<std::string, unsigned>::const_iterator it1 =
+        variableIds.find(*it);
+    if (it1 != variableIds.end())
+      setBit(ret, it1->second);
+  }
+  return ret;
+}
+
+bool TxSpeculationAvoidance::isIndependent(const std::set<std::string> &vars,
+                                           int bbOrder) const {
+  std::map<int, Bitset>::const_iterator it = avoidance.find(bbOrder);
+  if (it == avoidance.end())
+    return true;
+  return !intersects(getVariables(vars), it->second);
+}
+
+void TxSpeculationAvoidance::indexBranches(
+    KModule *kmodule, std::map<llvm::Value *, std::set<std::string> > &cache) {
+  branchVariables.clear();
+  for (std::vector<KFunction *>::iterator it = kmodule->functions.begin(),
+                                          ie = kmodule->functions.end();
+       it != ie; ++it) {
+    KFunction *kf = *it;
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      llvm::BranchInst *bi =
+          llvm::dyn_cast<llvm::BranchInst>(kf->instructions[i]->inst);
+      if (bi && bi->isConditional())
+        getBranchVariables(bi, cache);
+    }
+  }
+}
+
+const TxSpeculationAvoidance::Bitset &
+TxSpeculationAvoidance::getBranchVariables(
+    llvm::Value *v, std::map<llvm::Value *, std::set<std::string> > &cache) {
+  std::map<llvm::Value *, Bitset>::iterator it = branchVariables.find(v);
+  if (it != branchVariables.end())
+    return it->second;
+  Bitset &ret = branchVariables[v];
+  ret = getVariables(TxSpeculationHelper::getVarNames(v, cache));
+  return ret;
+}
+
+void TxSpeculationAvoidance::load(const std::string &folderName,
+                                  const std::string &binaryFile) {
+  branchVariables.clear();
+  variableIds.clear();
+  avoidance.clear();
+  allAvoided.clear();
+  initialVisitedBlocks.clear();
+
+  std::vector<std::string> avoidFiles;
+  if (DIR *dirp = opendir(folderName.c_str())) {
+    while (dirent *dp = readdir(dirp)) {
+      std::string name(dp->d_name);
+      if (name.substr(0, 10) == "SpecAvoid_")
+        avoidFiles.push_back(folderName + "/" + name);
+    }
+    closedir(dirp);
+  }
+  // In a fixed order for the hash
+  std::sort(avoidFiles.begin(), avoidFiles.end());
+
+  // The binary file is only valid when written from the same text files
+  std::vector<std::string> textFiles(avoidFiles);
+  textFiles.push_back(folderName + "/InitialVisitedBB.txt");
+  uint64_t textHash = hashFiles(textFiles);
+  if (readBinary(binaryFile, textHash))
+    return;
+
+  variableIds.clear();
+  avoidance.clear();
+  allAvoided.clear();
+  initialVisitedBlocks.clear();
+  readText(folderName, avoidFiles);
+  writeBinary(binaryFile, textHash);
+}
+
+void TxSpeculationAvoidance::readText(
+    const std::string &folderName, const std::vector<std::string> &avoidFiles) {
+  for (std::vector<std::string>::const_iterator it = avoidFiles.begin(),
+                                                ie = avoidFiles.end();
+       it != ie; ++it) {
+    std::ifstream in(it->c_str());
+    std::string str;
+    int bb = 0;
+    bool isFirst = true;
+    Bitset bits;
+    while (std::getline(in, str)) {
+      if (isFirst) {
+        bb = atoi(str.c_str());
+        isFirst = false;
+      } else {
+        std::string var = TxSpeculationHelper::trim(str);
+        if (!var.empty()) {
+          unsigned id = getVariableId(var);
+          setBit(bits, id);
+          setBit(allAvoided, id);
+        }
+      }
+    }
+    avoidance[bb] = bits;
+  }
+
+  readInitialVisitedBlocks(folderName);
+}
+
+void TxSpeculationAvoidance::readInitialVisitedBlocks(
+    const std::string &folderName) {
+  std::ifstream in((folderName + "/InitialVisitedBB.txt").c_str());
+  std::string str;
+  while (std::getline(in, str)) {
+    if (!TxSpeculationHelper::trim(str).empty())
+      initialVisitedBlocks.insert(atoi(str.c_str()));
+  }
+}
+
+/// \brief Whether the block calls __assert_fail
+static bool callsAssertFail(llvm::BasicBlock *bb) {
+  for (llvm::BasicBlock::iterator it = bb->begin(), ie = bb->end(); it != ie;
+       ++it) {
+    if (llvm::CallInst *ci = llvm::dyn_cast<llvm::CallInst>(it)) {
+      llvm::Function *f = llvm::dyn_cast<llvm::Function>(
+          ci->getCalledValue()->stripPointerCasts());
+      if (f && f->getName() == "__assert_fail")
+        return true;
+    }
+  }
+  return false;
+}
+
+void TxSpeculationAvoidance::analyze(KModule *kmodule,
+                                     const std::vector<int> &blockOrder,
+                                     bool safety,
+                                     const std::string &folderName) {
+  branchVariables.clear();
+  variableIds.clear();
+  avoidance.clear();
+  allAvoided.clear();
+  initialVisitedBlocks.clear();
+  readInitialVisitedBlocks(folderName);
+
+  std::map<llvm::Value *, std::set<std::string> > cache;
+  // The variables of the values stored to each variable
+  std::map<std::string, std::set<std::string> > flows;
+  // The variables of the conditions of the branches into each block
+  std::map<llvm::BasicBlock *, std::set<std::string> > guards;
+  // The analyzed blocks with their orders
+  std::map<llvm::BasicBlock *, int> targets;
+
+  for (std::vector<KFunction *>::iterator it = kmodule->functions.begin(),
+                                          ie = kmodule->functions.end();
+       it != ie; ++it) {
+    KFunction *kf = *it;
+    if (!kf->numInstructions)
+      continue;
+    // The blocks of a function are numbered consecutively, as in KModule
+    unsigned id = kf->instructions[0]->basicBlockId;
+    for (llvm::Function::iterator b = kf->function->begin(),
+                                  be = kf->function->end();
+         b != be; ++b, ++id) {
+      llvm::BasicBlock *bb = &*b;
+      int order = id < blockOrder.size() ? blockOrder[id] : 0;
+      if (order && (safety ? callsAssertFail(bb)
+                           : !initialVisitedBlocks.count(order)))
+        targets[bb] = order;
+
+      for (llvm::BasicBlock::iterator i = bb->begin(), ie1 = bb->end();
+           i != ie1; ++i) {
+        llvm::StoreInst *si = llvm::dyn_cast<llvm::StoreInst>(i);
+        if (!si)
+          continue;
+        const std::set<std::string> &sources =
+            TxSpeculationHelper::getVarNames(si->getValueOperand(), cache);
+        if (sources.empty())
+          continue;
+        const std::set<std::string> &stored =
+            TxSpeculationHelper::getVarNames(si->getPointerOperand(), cache);
+        for (std::set<std::string>::const_iterator it1 = stored.begin(),
+                                                   ie2 = stored.end();
+             it1 != ie2; ++it1) {
+          flows[*it1].insert(sources.begin(), sources.end());
+        }
+      }
+
+      llvm::TerminatorInst *term = bb->getTerminator();
+      llvm::Value *condition = 0;
+      if (llvm::BranchInst *bi = llvm::dyn_cast<llvm::BranchInst>(term)) {
+        if (bi->isConditional())
+          condition = bi->getCondition();
+      } else if (llvm::SwitchInst *sw =
+                     llvm::dyn_cast<llvm::SwitchInst>(term)) {
+        condition = sw->getCondition();
+      }
+      if (!condition)
+        continue;
+      const std::set<std::string> &vars =
+          TxSpeculationHelper::getVarNames(condition, cache);
+      for (unsigned i = 0, n = term->getNumSuccessors(); i < n; ++i)
+        guards[term->getSuccessor(i)].insert(vars.begin(), vars.end());
+    }
+  }
+
+  for (std::map<llvm::BasicBlock *, int>::iterator it = targets.begin(),
+                                                   ie = targets.end();
+       it != ie; ++it) {
+    std::set<std::string> vars = guards[it->first];
+    std::vector<std::string> worklist(vars.begin(), vars.end());
+    while (!worklist.empty()) {
+      std::string var = worklist.back();
+      worklist.pop_back();
+      std::map<std::string, std::set<std::string> >::iterator flow =
+          flows.find(var);
+      if (flow == flows.end())
+        continue;
+      for (std::set<std::string>::iterator it1 = flow->second.begin(),
+                                           ie1 = flow->second.end();
+           it1 != ie1; ++it1) {
+        if (vars.insert(*it1).second)
+          worklist.push_back(*it1);
+      }
+    }
+
+    Bitset bits;
+    for (std::set<std::string>::iterator it1 = vars.begin(),
+                                         ie1 = vars.end();
+         it1 != ie1; ++it1) {
+      unsigned id = getVariableId(*it1);
+      setBit(bits, id);
+      setBit(allAvoided, id);
+    }
+    avoidance[it->second] = bits;
+  }
+}
+
+template <typename T> static bool readValue(const char *&p, const char *end,
+                                            T &value) {
+  if (end - p < (ptrdiff_t)sizeof(T))
+    return false;
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
   return true;
 }
+
+template <typename T> static void writeValue(std::ofstream &out,
+                                             const T &value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+// The binary file consists of the magic bytes and the version, followed by
+// the variable names in the order of their ids, the bitsets of the basic
+// blocks, and the initially-visited basic blocks, each prefixed by its count.
+bool TxSpeculationAvoidance::readBinary(const std::string &fileName,
+                                        uint64_t textHash) {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  const char *p = static_cast<const char *>(data);
+  const char *end = p + st.st_size;
+  bool valid = (end - p >= 4) && memcmp(p, avoidanceMagic, 4) == 0;
+  p += 4;
+
+  uint32_t version = 0, count = 0;
+  uint64_t hash = 0;
+  valid = valid && readValue(p, end, version) && version == avoidanceVersion;
+  valid = valid && readValue(p, end, hash) && hash == textHash;
+
+  valid = valid && readValue(p, end, count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    uint32_t length;
+    valid = readValue(p, end, length) && (uint32_t)(end - p) >= length;
+    if (valid) {
+      variableIds[std::string(p, length)] = i;
+      p += length;
+    }
+  }
+
+  valid = valid && readValue(p, end, count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    int32_t bb;
+    uint32_t words;
+    valid = readValue(p, end, bb) && readValue(p, end, words);
+    Bitset &bits = avoidance[bb];
+    for (uint32_t j = 0; valid && j < words; ++j) {
+      uint64_t word;
+      valid = readValue(p, end, word);
+      bits.push_back(word);
+      if (allAvoided.size() <= j)
+        allAvoided.resize(j + 1, 0);
+      allAvoided[j] |= word;
+    }
+  }
+
+  valid = valid && readValue(p, end, count);
+  for (uint32_t i = 0; valid && i < count; ++i) {
+    int32_t bb;
+    valid = readValue(p, end, bb);
+    initialVisitedBlocks.insert(bb);
+  }
+
+  munmap(data, st.st_size);
+  return valid;
+}
+
+void TxSpeculationAvoidance::writeBinary(const std::string &fileName,
+                                         uint64_t textHash) const {
+  std::vector<const std::string *> names(variableIds.size());
+  for (std::map<std::string, unsigned>::const_iterator
+           it = variableIds.begin(),
+           ie = variableIds.end();
+       it != ie; ++it) {
+    names[it->second] = &it->first;
+  }
+
+  std::ofstream out(fileName.c_str(), std::ios::out | std::ios::binary);
+  if (!out)
+    return;
+  out.write(avoidanceMagic, 4);
+  writeValue(out, avoidanceVersion);
+  writeValue(out, textHash);
+
+  writeValue(out, (uint32_t)names.size());
+  for (std::vector<const std::string *>::iterator it = names.begin(),
+                                                  ie = names.end();
+       it != ie; ++it) {
+    writeValue(out, (uint32_t)(*it)->size());
+    out.write((*it)->data(), (*it)->size());
+  }
+
+  writeValue(out, (uint32_t)avoidance.size());
+  for (std::map<int, Bitset>::const_iterator it = avoidance.begin(),
+                                             ie = avoidance.end();
+       it != ie; ++it) {
+    writeValue(out, (int32_t)it->first);
+    writeValue(out, (uint32_t)it->second.size());
+    for (Bitset::const_iterator it1 = it->second.begin(),
+                                ie1 = it->second.end();
+         it1 != ie1; ++it1) {
+      writeValue(out, *it1);
+    }
+  }
+
+  writeValue(out, (uint32_t)initialVisitedBlocks.size());
+  for (std::set<int>::const_iterator it = initialVisitedBlocks.begin(),
+                                     ie = initialVisitedBlocks.end();
+       it != ie; ++it) {
+    writeValue(out, (int32_t)*it);
+  }
+}
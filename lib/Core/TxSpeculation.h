@@ -21,23 +21,43 @@
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
+#include <algorithm>
 #include <iostream>
 #include <map>
+#include <stdint.h>
+#include <set>
+#include <string>
 #include <vector>
 
 namespace klee {
 
 /// \brief Implements the speculation mode
 class TxSpeculationHelper {
+  /// \brief Whether a speculation fork is allowed at an instruction, indexed
+  /// by the instruction id
+  static std::vector<bool> speculable;
+
+  static bool computeSpeculable(llvm::Instruction *inst);
+
 public:
   static std::string WHITESPACE;
-  static bool isStateSpeculable(ExecutionState &current);
 
-  static bool isIndependent(std::set<std::string> &vars,
-                            std::map<int, std::set<std::string> > &avoidance);
+  /// \brief Precompute the speculability of all instructions of the module
+  static void initialize(KModule *kmodule);
+
+  /// \brief Test if a speculation fork is allowed at the branch that was just
+  /// executed by the state: not in KLEE or Tracer-X functions, and not into a
+  /// block that calls __assert_fail
+  static bool isStateSpeculable(ExecutionState &current);
 
   static bool isOverlap(std::set<std::string> &s1, std::set<std::string> &s2);
 
+  /// \brief The names of the variables, the globals and the allocas, the
+  /// value is computed from, memoized in the cache
+  static const std::set<std::string> &
+  getVarNames(llvm::Value *v,
+              std::map<llvm::Value *, std::set<std::string> > &cache);
+
   static std::string ltrim(const std::string &s) {
     size_t start = s.find_first_not_of(WHITESPACE);
     return (start == std::string::npos) ? "" : s.substr(start);
@@ -50,6 +70,122 @@ public:
 
   static std::string trim(const std::string &s) { return rtrim(ltrim(s)); }
 };
+
+/// \brief The variables to avoid in speculation, from the dependency folder
+///
+/// The dependency folder contains a SpecAvoid_* text file per basic block,
+/// listing the block order followed by the variables to avoid, and the
+/// InitialVisitedBB.txt file listing the orders of the blocks visited before.
+/// The variable names are interned to integer ids, and the variables of each
+/// block are stored as a bitset. After parsing the text files, the data is
+/// saved in a binary file, SpecAvoid.bin of the output directory, with a
+/// hash of the names and contents of the text files. The binary file is
+/// memory-mapped instead of parsing the text files by a later run into the
+/// same output directory, as long as the hash of the text files is the same.
+class TxSpeculationAvoidance {
+public:
+  typedef std::vector<uint64_t> Bitset;
+
+private:
+  /// \brief The ids of the variable names
+  std::map<std::string, unsigned> variableIds;
+
+  /// \brief The variables to avoid of each basic block order
+  std::map<int, Bitset> avoidance;
+
+  /// \brief The union of the variables to avoid of all basic blocks
+  Bitset allAvoided;
+
+  /// \brief The orders of the initially-visited basic blocks
+  std::set<int> initialVisitedBlocks;
+
+  /// \brief The ids of the variables of each branch instruction, computed
+  /// once as they only depend on the program and the loaded data
+  std::map<llvm::Value *, Bitset> branchVariables;
+
+  unsigned getVariableId(const std::string &name);
+
+  static void setBit(Bitset &bits, unsigned id) {
+    if (bits.size() <= id / 64)
+      bits.resize(id / 64 + 1, 0);
+    bits[id / 64] |= ((uint64_t)1) << (id % 64);
+  }
+
+  static bool intersects(const Bitset &a, const Bitset &b) {
+    for (unsigned i = 0, n = std::min(a.size(), b.size()); i < n; ++i) {
+      if (a[i] & b[i])
+        return true;
+    }
+    return false;
+  }
+
+  /// \brief Parse the text files of the folder
+  void readText(const std::string &folderName,
+                const std::vector<std::string> &avoidFiles);
+
+  /// \brief Read InitialVisitedBB.txt of the folder, if it exists
+  void readInitialVisitedBlocks(const std::string &folderName);
+
+  /// \brief Memory-map and read the binary file, returning false if it is
+  /// not valid or was written from text files of another hash
+  bool readBinary(const std::string &fileName, uint64_t textHash);
+
+  /// \brief Write the binary file, ignoring failures
+  void writeBinary(const std::string &fileName, uint64_t textHash) const;
+
+public:
+  /// \brief Load the data from the dependency folder, or from the binary
+  /// file when it was written from the same text files
+  void load(const std::string &folderName, const std::string &binaryFile);
+
+  /// \brief Compute the data with an analysis of the module, with
+  /// -spec-dependency-analysis, instead of loading the SpecAvoid_* files.
+  /// The variables to avoid of a block are those of the conditions of the
+  /// branches into it, closed under the stores to the variables. The blocks
+  /// analyzed are those of a nonzero order in blockOrder, indexed by
+  /// KInstruction::basicBlockId, that call __assert_fail when safety is set,
+  /// or that are not initially visited otherwise. The initially-visited
+  /// blocks are still read from InitialVisitedBB.txt of the folder, when it
+  /// exists.
+  void analyze(KModule *kmodule, const std::vector<int> &blockOrder,
+               bool safety, const std::string &folderName);
+
+  /// \brief Get the set of ids of the given variables; variables not to be
+  /// avoided anywhere are left out
+  Bitset getVariables(const std::set<std::string> &vars) const;
+
+  /// \brief Compute the ids of the variables of all conditional branches of
+  /// the module, after load or analyze, with the variable names memoized in
+  /// the cache
+  void indexBranches(KModule *kmodule,
+                     std::map<llvm::Value *, std::set<std::string> > &cache);
+
+  /// \brief Get the ids of the variables of the branch, computing them when
+  /// the branch was not indexed
+  const Bitset &
+  getBranchVariables(llvm::Value *v,
+                     std::map<llvm::Value *, std::set<std::string> > &cache);
+
+  /// \brief Test if none of the variables is to be avoided in any basic
+  /// block
+  bool isIndependent(const std::set<std::string> &vars) const {
+    return !intersects(getVariables(vars), allAvoided);
+  }
+
+  /// \brief Test if none of the variables of the ids is to be avoided in any
+  /// basic block
+  bool isIndependent(const Bitset &vars) const {
+    return !intersects(vars, allAvoided);
+  }
+
+  /// \brief Test if none of the variables is to be avoided in the given basic
+  /// block
+  bool isIndependent(const std::set<std::string> &vars, int bbOrder) const;
+
+  const std::set<int> &getInitialVisitedBlocks() const {
+    return initialVisitedBlocks;
+  }
+};
 } // namespace klee
 
 #endif /* TXSPECULATION_H_ */
@@ -24,21 +24,41 @@ using namespace klee;
 
 namespace klee {
 
+uint64_t TxStore::pointerFlowEpoch = 0;
+
+uint64_t TxStore::compactedEntryCount = 0;
+
+/// \brief Remove the unmarkable entries of the store, returning their number
+static uint64_t compactStore(TxStore::LowerStateStore &store) {
+  uint64_t ret = 0;
+  for (TxStore::LowerStateStore::iterator it = store.begin(),
+                                          ie = store.end();
+       it != ie;) {
+    if (it->second->isUnmarkable()) {
+      store.erase(it++);
+      ++ret;
+    } else {
+      ++it;
+    }
+  }
+  return ret;
+}
+
 ref<TxStoreEntry>
 TxStore::MiddleStateStore::find(ref<TxStateAddress> loc) const {
   ref<TxStoreEntry> ret;
 
   if (loc->hasConstantAddress()) {
     TxStore::LowerStateStore::const_iterator lowerStoreIter =
-        concretelyAddressedStore.find(loc->getAsVariable());
+        concretelyAddressedStore.get().find(loc->getAsVariable());
 
-    if (lowerStoreIter != concretelyAddressedStore.end()) {
+    if (lowerStoreIter != concretelyAddressedStore.get().end()) {
       ret = lowerStoreIter->second;
     }
   } else {
     TxStore::LowerStateStore::const_iterator lowerStoreIter =
-        symbolicallyAddressedStore.find(loc->getAsVariable());
-    if (lowerStoreIter != symbolicallyAddressedStore.end()) {
+        symbolicallyAddressedStore.get().find(loc->getAsVariable());
+    if (lowerStoreIter != symbolicallyAddressedStore.get().end()) {
       ret = lowerStoreIter->second;
     }
   }
@@ -51,16 +71,16 @@ TxStore::MiddleStateStore::find(ref<TxAllocationContext> alc) const {
   ref<TxStoreEntry> ret;
 
   for (LowerStateStore::const_iterator
-           lowerIs = concretelyAddressedStore.begin(),
-           lowerIe = concretelyAddressedStore.end(), lowerIt = lowerIs;
+           lowerIs = concretelyAddressedStore.get().begin(),
+           lowerIe = concretelyAddressedStore.get().end(), lowerIt = lowerIs;
        lowerIt != lowerIe; ++lowerIt) {
     if (lowerIt->first->getAllocationInfo()->getContext() == alc)
       return lowerIt->second;
   }
 
   for (LowerStateStore::const_iterator
-           lowerIs = symbolicallyAddressedStore.begin(),
-           lowerIe = symbolicallyAddressedStore.end(), lowerIt = lowerIs;
+           lowerIs = symbolicallyAddressedStore.get().begin(),
+           lowerIe = symbolicallyAddressedStore.get().end(), lowerIt = lowerIs;
        lowerIt != lowerIe; ++lowerIt) {
     if (lowerIt->first->getAllocationInfo()->getContext() == alc)
       return lowerIt->second;
@@ -75,13 +95,13 @@ ref<TxStoreEntry> TxStore::MiddleStateStore::findConcrete(
     const {
   ref<TxStoreEntry> ret;
   TxStore::LowerStateStore::const_iterator lowerStoreIter =
-      concretelyAddressedStore.find(var);
-  if (lowerStoreIter != concretelyAddressedStore.end()) {
+      concretelyAddressedStore.get().find(var);
+  if (lowerStoreIter != concretelyAddressedStore.get().end()) {
     ret = lowerStoreIter->second;
   } else {
     for (TxStore::LowerStateStore::const_iterator
-             it = concretelyAddressedStore.begin(),
-             ie = concretelyAddressedStore.end();
+             it = concretelyAddressedStore.get().begin(),
+             ie = concretelyAddressedStore.get().end();
          it != ie; ++it) {
       if (it->first->getOffset() == var->getOffset()) {
         if (it->first->getAllocationInfo()->translate(var->getAllocationInfo(),
@@ -99,8 +119,8 @@ ref<TxStoreEntry>
 TxStore::MiddleStateStore::findSymbolic(ref<TxVariable> var) const {
   ref<TxStoreEntry> ret;
   TxStore::LowerStateStore::const_iterator lowerStoreIter =
-      symbolicallyAddressedStore.find(var);
-  if (lowerStoreIter != symbolicallyAddressedStore.end()) {
+      symbolicallyAddressedStore.get().find(var);
+  if (lowerStoreIter != symbolicallyAddressedStore.get().end()) {
     ret = lowerStoreIter->second;
   }
   return ret;
@@ -108,18 +128,19 @@ TxStore::MiddleStateStore::findSymbolic(ref<TxVariable> var) const {
 
 ref<TxStoreEntry> TxStore::MiddleStateStore::updateStore(
     const TxStore *store, ref<TxStateAddress> loc, ref<TxStateValue> address,
-    ref<TxStateValue> value, uint64_t _depth) {
+    ref<TxStateValue> value, uint64_t _depth, unsigned pathId) {
   ref<TxStoreEntry> ret;
 
   // Return null entry in case allocation info do not match
   if (loc->getAllocationInfo() != allocInfo)
     return ret;
 
-  ret = ref<TxStoreEntry>(new TxStoreEntry(loc, address, value, store, _depth));
+  ret = ref<TxStoreEntry>(
+      new TxStoreEntry(loc, address, value, store, _depth, pathId));
   if (loc->hasConstantAddress()) {
-    concretelyAddressedStore[loc->getAsVariable()] = ret;
+    concretelyAddressedStore.getMutable()[loc->getAsVariable()] = ret;
   } else {
-    symbolicallyAddressedStore[loc->getAsVariable()] = ret;
+    symbolicallyAddressedStore.getMutable()[loc->getAsVariable()] = ret;
   }
   return ret;
 }
@@ -132,11 +153,11 @@ void TxStore::MiddleStateStore::print(llvm::raw_ostream &stream,
   allocInfo->print(stream, prefix);
   stream << ":";
   stream << "\n" << prefix << "concretely-addressed store = [";
-  if (!concretelyAddressedStore.empty()) {
+  if (!concretelyAddressedStore.get().empty()) {
     stream << "\n";
     for (LowerStateStore::const_iterator
-             lowerIs = concretelyAddressedStore.begin(),
-             lowerIe = concretelyAddressedStore.end(), lowerIt = lowerIs;
+             lowerIs = concretelyAddressedStore.get().begin(),
+             lowerIe = concretelyAddressedStore.get().end(), lowerIt = lowerIs;
          lowerIt != lowerIe; ++lowerIt) {
       if (lowerIt != lowerIs)
         stream << tabsNext << "------------------------------------------\n";
@@ -152,11 +173,11 @@ void TxStore::MiddleStateStore::print(llvm::raw_ostream &stream,
   stream << "]";
 
   stream << "\n" << prefix << "symbolically-addressed store = [";
-  if (!symbolicallyAddressedStore.empty()) {
+  if (!symbolicallyAddressedStore.get().empty()) {
     stream << "\n";
     for (LowerStateStore::const_iterator
-             lowerIs = symbolicallyAddressedStore.begin(),
-             lowerIe = symbolicallyAddressedStore.end(), lowerIt = lowerIs;
+             lowerIs = symbolicallyAddressedStore.get().begin(),
+             lowerIe = symbolicallyAddressedStore.get().end(), lowerIt = lowerIs;
          lowerIt != lowerIe; ++lowerIt) {
       if (lowerIt != lowerIs)
         stream << tabsNext << "------------------------------------------\n";
@@ -174,6 +195,100 @@ void TxStore::MiddleStateStore::print(llvm::raw_ostream &stream,
 
 /**/
 
+namespace {
+/// \brief Estimate of the bytes of a tree map, each node holding the value
+/// and the links and color of the tree
+template <typename T> uint64_t getTreeByteSize(const T &tree) {
+  return tree.size() * (sizeof(typename T::value_type) + 4 * sizeof(void *));
+}
+}
+
+uint64_t TxStore::MiddleStateStore::getOwnedByteSize() const {
+  uint64_t size = 0;
+  if (!concretelyAddressedStore.isShared())
+    size += getTreeByteSize(concretelyAddressedStore.get());
+  if (!symbolicallyAddressedStore.isShared())
+    size += getTreeByteSize(symbolicallyAddressedStore.get());
+  return size;
+}
+
+uint64_t TxStore::getOwnedByteSize() const {
+  uint64_t size = 0;
+  if (!concretelyAddressedHistoricalStore.isShared())
+    size += getTreeByteSize(concretelyAddressedHistoricalStore.get());
+  if (!symbolicallyAddressedHistoricalStore.isShared())
+    size += getTreeByteSize(symbolicallyAddressedHistoricalStore.get());
+  if (!internalStore.isShared()) {
+    const TopStateStore &top = internalStore.get();
+    size += getTreeByteSize(top);
+    for (TopStateStore::const_iterator it = top.begin(), ie = top.end();
+         it != ie; ++it)
+      size += it->second.getOwnedByteSize();
+  }
+  return size;
+}
+
+void TxStore::compactHistory() {
+  historyCompacted = true;
+  if (!CompactHistoricalStore)
+    return;
+  ++version;
+
+  // A shared store is also the store of an ancestor, whose entries are
+  // referenced by each of its copies
+  if (!concretelyAddressedHistoricalStore.isShared())
+    compactedEntryCount +=
+        compactStore(concretelyAddressedHistoricalStore.getMutable());
+  if (!symbolicallyAddressedHistoricalStore.isShared())
+    compactedEntryCount +=
+        compactStore(symbolicallyAddressedHistoricalStore.getMutable());
+}
+
+namespace {
+uint64_t getLowerStoreFingerprint(TxStore::LowerStateStore::const_iterator it,
+                                  TxStore::LowerStateStore::const_iterator ie) {
+  uint64_t hash = 0;
+  for (; it != ie; ++it) {
+    hash = Expr::combineHash(
+        hash, reinterpret_cast<uintptr_t>(it->first->getValue()));
+    hash = Expr::combineHash(hash, it->first->getOffset()->hash());
+    ref<Expr> content = it->second->getExpression();
+    hash = Expr::combineHash(hash, content.isNull() ? 0 : content->hash());
+  }
+  return hash;
+}
+}
+
+uint64_t TxStore::getFingerprint() const {
+  if (fingerprintVersion == version)
+    return fingerprint;
+
+  uint64_t hash = 0;
+  for (TopStateStore::const_iterator it = internalStore.get().begin(),
+                                     ie = internalStore.get().end();
+       it != ie; ++it) {
+    hash = Expr::combineHash(
+        hash, reinterpret_cast<uintptr_t>(it->first->getValue()));
+    hash = Expr::combineHash(hash,
+                             getLowerStoreFingerprint(it->second.concreteBegin(),
+                                                      it->second.concreteEnd()));
+    hash = Expr::combineHash(hash,
+                             getLowerStoreFingerprint(it->second.symbolicBegin(),
+                                                      it->second.symbolicEnd()));
+  }
+  hash = Expr::combineHash(
+      hash,
+      getLowerStoreFingerprint(concretelyAddressedHistoricalStore.get().begin(),
+                               concretelyAddressedHistoricalStore.get().end()));
+  hash = Expr::combineHash(
+      hash, getLowerStoreFingerprint(
+                symbolicallyAddressedHistoricalStore.get().begin(),
+                symbolicallyAddressedHistoricalStore.get().end()));
+  fingerprint = hash;
+  fingerprintVersion = version;
+  return fingerprint;
+}
+
 bool TxStore::isInLeftSubtree(uint64_t targetDepth) const {
   const TxStore *current = this;
   bool inLeftSubtree = false;
@@ -199,7 +314,7 @@ bool TxStore::isInLeftSubtree(uint64_t targetDepth) const {
 bool TxStore::adjustOffsetBound(ref<TxStoreEntry> entry, bool leftMarking,
                                 ref<TxStateValue> checkedAddress,
                                 std::set<uint64_t> &bounds,
-                                const std::string &reason, bool &boundUpdated) {
+                                const TxMarkReason &reason, bool &boundUpdated) {
   bool memoryError = false;
   if (entry->canInterpolateBound(leftMarking)) {
     memoryError = entry->getPointerInfo(leftMarking)
@@ -218,8 +333,8 @@ bool TxStore::adjustOffsetBound(ref<TxStoreEntry> entry, bool leftMarking,
 
 ref<TxStoreEntry> TxStore::find(ref<TxStateAddress> loc) const {
   TopStateStore::const_iterator storeIter =
-      internalStore.find(loc->getContext());
-  if (storeIter != internalStore.end()) {
+      internalStore.get().find(loc->getContext());
+  if (storeIter != internalStore.get().end()) {
     return storeIter->second.find(loc);
   }
 
@@ -228,8 +343,8 @@ ref<TxStoreEntry> TxStore::find(ref<TxStateAddress> loc) const {
 }
 
 ref<TxStoreEntry> TxStore::find(ref<TxAllocationContext> alc) const {
-  TopStateStore::const_iterator storeIter = internalStore.find(alc);
-  if (storeIter != internalStore.end()) {
+  TopStateStore::const_iterator storeIter = internalStore.get().find(alc);
+  if (storeIter != internalStore.get().end()) {
     return storeIter->second.find(alc);
   }
 
@@ -241,8 +356,8 @@ ref<TxStoreEntry> TxStore::find(ref<TxAllocationContext> alc,
                                 ref<Expr> offset) const {
   assert(isa<ConstantExpr>(offset) &&
          "TxStore::find, offset is not a constant value");
-  TopStateStore::const_iterator storeIter = internalStore.find(alc);
-  if (storeIter != internalStore.end()) {
+  TopStateStore::const_iterator storeIter = internalStore.get().find(alc);
+  if (storeIter != internalStore.get().end()) {
     MiddleStateStore array = storeIter->second;
     for (LowerStateStore::const_iterator it = array.concreteBegin(),
                                          ie = array.concreteEnd();
@@ -263,19 +378,6 @@ ref<TxStoreEntry> TxStore::find(ref<TxAllocationContext> alc,
   return nullEntry;
 }
 
-void TxStore::getStoredExpressions(
-    const TxStore *referenceStore,
-    const std::vector<llvm::Instruction *> &callHistory,
-    const std::map<ref<Expr>, ref<Expr> > &substitution,
-    std::set<const Array *> &replacements, bool coreOnly, bool leftRetrieval,
-    TopStateStore &__internalStore,
-    LowerStateStore &__concretelyAddressedHistoricalStore,
-    LowerStateStore &__symbolicallyAddressedHistoricalStore) const {
-  __internalStore = internalStore;
-  __concretelyAddressedHistoricalStore = concretelyAddressedHistoricalStore;
-  __symbolicallyAddressedHistoricalStore = symbolicallyAddressedHistoricalStore;
-}
-
 void TxStore::getStoredCoreExpressions(
     const TxStore *referenceStore,
     const std::vector<llvm::Instruction *> &callHistory,
@@ -297,8 +399,8 @@ ref<TxAllocationContext>
 TxStore::getAddressofLatestCopyLLVMValue(llvm::Value *val) {
   ref<TxAllocationContext> address;
   bool foundValue = false;
-  for (TopStateStore::const_iterator it = internalStore.begin(),
-                                     ie = internalStore.end();
+  for (TopStateStore::const_iterator it = internalStore.get().begin(),
+                                     ie = internalStore.get().end();
        it != ie; ++it) {
     ref<TxAllocationContext> temp = (*it).first;
     if (temp->getValue() == val) {
@@ -340,8 +442,8 @@ inline void TxStore::concreteToInterpolant(
     } else if (usedByRightPath.find(entry) == usedByRightPath.end()) {
       return;
     }*/
-    if (usedByLeftPath.find(entry) == usedByLeftPath.end() &&
-        usedByRightPath.find(entry) == usedByRightPath.end())
+    if (!usedByLeftPath.test(entry->getPathId()) &&
+        !usedByRightPath.test(entry->getPathId()))
       return;
 
 // An address is in the core if it stores a value that is in the core
@@ -383,8 +485,8 @@ inline void TxStore::symbolicToInterpolant(
     } else if (usedByRightPath.find(entry) == usedByRightPath.end()) {
       return;
     }*/
-    if (usedByRightPath.find(entry) == usedByRightPath.end() &&
-        usedByLeftPath.find(entry) == usedByLeftPath.end())
+    if (!usedByRightPath.test(entry->getPathId()) &&
+        !usedByLeftPath.test(entry->getPathId()))
       return;
 
 // An address is in the core if it stores a value that is in the core
@@ -413,8 +515,8 @@ void TxStore::getConcreteStore(
     std::set<const Array *> &replacements, bool coreOnly, bool leftRetrieval,
     TopInterpolantStore &_concretelyAddressedStore,
     LowerInterpolantStore &_concretelyAddressedHistoricalStore) const {
-  for (TopStateStore::const_iterator it = internalStore.begin(),
-                                     ie = internalStore.end();
+  for (TopStateStore::const_iterator it = internalStore.get().begin(),
+                                     ie = internalStore.get().end();
        it != ie; ++it) {
     TopInterpolantStore::iterator storeIter =
         _concretelyAddressedStore.find(it->first);
@@ -450,8 +552,8 @@ void TxStore::getConcreteStore(
   }
 
   for (LowerStateStore::const_iterator
-           it = concretelyAddressedHistoricalStore.begin(),
-           ie = concretelyAddressedHistoricalStore.end();
+           it = concretelyAddressedHistoricalStore.get().begin(),
+           ie = concretelyAddressedHistoricalStore.get().end();
        it != ie; ++it) {
 
     concreteToInterpolant(
@@ -468,8 +570,8 @@ void TxStore::getSymbolicStore(
     std::set<const Array *> &replacements, bool coreOnly, bool leftRetrieval,
     TopInterpolantStore &_symbolicallyAddressedStore,
     LowerInterpolantStore &_symbolicallyAddressedHistoricalStore) const {
-  for (TopStateStore::const_iterator it = internalStore.begin(),
-                                     ie = internalStore.end();
+  for (TopStateStore::const_iterator it = internalStore.get().begin(),
+                                     ie = internalStore.get().end();
        it != ie; ++it) {
     TopInterpolantStore::iterator storeIter =
         _symbolicallyAddressedStore.find(it->first);
@@ -505,8 +607,8 @@ void TxStore::getSymbolicStore(
   }
 
   for (LowerStateStore::const_iterator
-           it = symbolicallyAddressedHistoricalStore.begin(),
-           ie = symbolicallyAddressedHistoricalStore.end();
+           it = symbolicallyAddressedHistoricalStore.get().begin(),
+           ie = symbolicallyAddressedHistoricalStore.get().end();
        it != ie; ++it) {
     symbolicToInterpolant(
         it->first, it->second, substitution, replacements, coreOnly,
@@ -516,7 +618,7 @@ void TxStore::getSymbolicStore(
 }
 
 void TxStore::updateStoreWithLoadedValue(
-    std::map<llvm::Value *, std::vector<ref<TxStateValue> > > &valuesMap,
+    TxVersionedValues &valuesMap,
     ref<TxStateAddress> loc, ref<TxStateValue> address,
     ref<TxStateValue> value) {
   updateStore(valuesMap, loc, address, value);
@@ -524,29 +626,32 @@ void TxStore::updateStoreWithLoadedValue(
 }
 
 void TxStore::updateStore(
-    std::map<llvm::Value *, std::vector<ref<TxStateValue> > > &valuesMap,
+    TxVersionedValues &valuesMap,
     ref<TxStateAddress> location, ref<TxStateValue> address,
     ref<TxStateValue> value) {
   if (location.isNull())
     return;
+  ++version;
 
   // Here we also mark the entries used to build the value as used. Only used
   // entries will be in the interpolant
   markUsed(value->getAllowBoundEntryList());
   markUsed(value->getDisableBoundEntryList());
 
+  TopStateStore &store = internalStore.getMutable();
   TopStateStore::iterator middleStoreIter =
-      internalStore.find(location->getContext());
+      store.find(location->getContext());
 
-  if (middleStoreIter != internalStore.end()) {
+  if (middleStoreIter != store.end()) {
     MiddleStateStore &middleStore = middleStoreIter->second;
     if (middleStore.hasAllocationInfo(location->getAllocationInfo())) {
       if (value->getDepth() < depth) {
         value = value->copy(depth);
-        valuesMap[value->getValue()].push_back(value);
+        valuesMap.bind(value->getValue(), value);
       }
       ref<TxStoreEntry> entry =
-          middleStore.updateStore(this, location, address, value, depth);
+          middleStore.updateStore(this, location, address, value, depth,
+                                  entryCount++);
       if (!entry.isNull()) {
         // We want to renew the table entry list, so we first remove the old
         // ones
@@ -561,21 +666,22 @@ void TxStore::updateStore(
     }
 
     // Here we save the old store
-    concretelyAddressedHistoricalStore.insert(middleStore.concreteBegin(),
-                                              middleStore.concreteEnd());
-    symbolicallyAddressedHistoricalStore.insert(middleStore.symbolicBegin(),
-                                                middleStore.symbolicEnd());
+    concretelyAddressedHistoricalStore.getMutable().insert(
+        middleStore.concreteBegin(), middleStore.concreteEnd());
+    symbolicallyAddressedHistoricalStore.getMutable().insert(
+        middleStore.symbolicBegin(), middleStore.symbolicEnd());
   }
 
   MiddleStateStore newMiddleStateStore(location->getAllocationInfo());
-  internalStore[location->getContext()] = newMiddleStateStore;
-  MiddleStateStore &middleStateStore = internalStore[location->getContext()];
+  store[location->getContext()] = newMiddleStateStore;
+  MiddleStateStore &middleStateStore = store[location->getContext()];
   if (value->getDepth() < depth) {
     value = value->copy(depth);
-    valuesMap[value->getValue()].push_back(value);
+    valuesMap.bind(value->getValue(), value);
   }
   ref<TxStoreEntry> entry =
-      middleStateStore.updateStore(this, location, address, value, depth);
+      middleStateStore.updateStore(this, location, address, value, depth,
+                                   entryCount++);
   if (!entry.isNull()) {
     // We associate this value with the store entry, signifying that the entry
     // is important whenever the value is used. This is used for computing the
@@ -589,6 +695,7 @@ void TxStore::markUsed(const std::set<ref<TxStoreEntry> > &entryList) {
                                                     ie = entryList.end();
        it != ie; ++it) {
     uint64_t entryDepth = (*it)->getDepth();
+    unsigned pathId = (*it)->getPathId();
 
     // Note that it is possible that entryDepth > depth, due to the association
     // of values with newly-created entries in TxStore::updateStore().
@@ -606,21 +713,13 @@ void TxStore::markUsed(const std::set<ref<TxStoreEntry> > &entryList) {
         constPrev = prev;
       }
       if (current->left == constPrev) {
-        std::set<ref<TxStoreEntry> >::iterator usedEntryIter =
-            current->usedByLeftPath.find(*it);
-        if (usedEntryIter == current->usedByLeftPath.end()) {
-          current->usedByLeftPath.insert(*it);
-        } else {
+        if (current->usedByLeftPath.test(pathId))
           break;
-        }
+        current->usedByLeftPath.set(pathId);
       } else if (current->right == constPrev) {
-        std::set<ref<TxStoreEntry> >::iterator usedEntryIter =
-            current->usedByRightPath.find(*it);
-        if (usedEntryIter == current->usedByRightPath.end()) {
-          current->usedByRightPath.insert(*it);
-        } else {
+        if (current->usedByRightPath.test(pathId))
           break;
-        }
+        current->usedByRightPath.set(pathId);
       } else {
         assert(!"child is neither left not right");
       }
@@ -631,7 +730,7 @@ void TxStore::markUsed(const std::set<ref<TxStoreEntry> > &entryList) {
 }
 
 void TxStore::recursivelyMarkFlow(ref<TxStoreEntry> entry, bool leftMarking,
-                                  const std::string &reason) const {
+                                  const TxMarkReason &reason) const {
   if (entry.isNull())
     return;
 
@@ -663,7 +762,7 @@ void TxStore::recursivelyMarkFlow(ref<TxStoreEntry> entry, bool leftMarking,
 }
 
 void TxStore::markFlow(ref<TxStateValue> target,
-                       const std::string &reason) const {
+                       const TxMarkReason &reason) const {
   if (target.isNull())
     return;
 
@@ -690,12 +789,13 @@ bool TxStore::recursivelyMarkPointerFlow(ref<TxStoreEntry> entry,
                                          bool leftMarking,
                                          ref<TxStateValue> checkedAddress,
                                          std::set<uint64_t> &bounds,
-                                         const std::string &reason,
+                                         const TxMarkReason &reason,
                                          uint64_t startingDepth) const {
   bool memoryError = false;
   bool boundUpdated = false;
 
-  if (entry.isNull())
+  if (entry.isNull() ||
+      !entry->visitPointerFlow(leftMarking, pointerFlowEpoch))
     return memoryError;
 
   if (entry->getDepth() == startingDepth) {
@@ -759,12 +859,14 @@ bool TxStore::recursivelyMarkPointerFlow(ref<TxStoreEntry> entry,
 bool TxStore::markPointerFlow(ref<TxStateValue> target,
                               ref<TxStateValue> checkedAddress,
                               std::set<uint64_t> &bounds,
-                              const std::string &reason) const {
+                              const TxMarkReason &reason) const {
   bool memoryError = false;
 
   if (target.isNull())
     return memoryError;
 
+  ++pointerFlowEpoch;
+
   const std::set<ref<TxStoreEntry> > &allowBoundEntryList(
       target->getAllowBoundEntryList());
   for (std::set<ref<TxStoreEntry> >::const_iterator
@@ -804,10 +906,10 @@ void TxStore::print(llvm::raw_ostream &stream,
   std::string tabsNextNext = appendTab(tabsNext);
 
   stream << tabs << "store = [";
-  if (!internalStore.empty()) {
+  if (!internalStore.get().empty()) {
     stream << "\n";
-    for (TopStateStore::const_iterator topIs = internalStore.begin(),
-                                       topIe = internalStore.end(),
+    for (TopStateStore::const_iterator topIs = internalStore.get().begin(),
+                                       topIe = internalStore.get().end(),
                                        topIt = topIs;
          topIt != topIe; ++topIt) {
       if (topIt != topIs) {
@@ -822,11 +924,11 @@ void TxStore::print(llvm::raw_ostream &stream,
   stream << "]";
 
   stream << "\n" << tabs << "concretely-addressed historical store = [";
-  if (!concretelyAddressedHistoricalStore.empty()) {
+  if (!concretelyAddressedHistoricalStore.get().empty()) {
     stream << "\n";
     for (TxStore::LowerStateStore::const_iterator
-             is1 = concretelyAddressedHistoricalStore.begin(),
-             ie1 = concretelyAddressedHistoricalStore.end(), it1 = is1;
+             is1 = concretelyAddressedHistoricalStore.get().begin(),
+             ie1 = concretelyAddressedHistoricalStore.get().end(), it1 = is1;
          it1 != ie1; ++it1) {
       if (it1 != is1)
         stream << tabsNext << "------------------------------------------\n";
@@ -838,11 +940,11 @@ void TxStore::print(llvm::raw_ostream &stream,
   stream << "]";
 
   stream << "\n" << tabs << "symbolically-addressed historical store = [";
-  if (!symbolicallyAddressedHistoricalStore.empty()) {
+  if (!symbolicallyAddressedHistoricalStore.get().empty()) {
     stream << "\n";
     for (TxStore::LowerStateStore::const_iterator
-             is1 = symbolicallyAddressedHistoricalStore.begin(),
-             ie1 = symbolicallyAddressedHistoricalStore.end(), it1 = is1;
+             is1 = symbolicallyAddressedHistoricalStore.get().begin(),
+             ie1 = symbolicallyAddressedHistoricalStore.get().end(), it1 = is1;
          it1 != ie1; ++it1) {
       if (it1 != is1)
         stream << tabsNext << "------------------------------------------\n";
@@ -17,13 +17,48 @@
 #ifndef KLEE_TXSTORE_H
 #define KLEE_TXSTORE_H
 
+#include "TxArena.h"
 #include "klee/Internal/Module/TxValues.h"
 #include "klee/util/Ref.h"
 
+#include "llvm/ADT/SparseBitVector.h"
+
 #include <map>
 
 namespace klee {
 
+/// \brief A value shared between copies of its container until one of them
+/// modifies it, at which point that container gets its own copy.
+template <typename T> class TxCopyOnWrite {
+  struct Shared {
+    unsigned refCount;
+
+    T value;
+
+    Shared() : refCount(0) {}
+
+    Shared(const T &_value) : refCount(0), value(_value) {}
+  };
+
+  ref<Shared> shared;
+
+public:
+  TxCopyOnWrite() : shared(new Shared()) {}
+
+  const T &get() const { return shared->value; }
+
+  /// \brief Whether another container shares the value
+  bool isShared() const { return shared->refCount > 1; }
+
+  /// \brief Get the value for modification, copying it first when it is
+  /// shared.
+  T &getMutable() {
+    if (shared->refCount > 1)
+      shared = ref<Shared>(new Shared(shared->value));
+    return shared->value;
+  }
+};
+
 class TxStore {
 public:
   class MiddleStateStore;
@@ -37,9 +72,11 @@ public:
 
   class MiddleStateStore {
   private:
-    LowerStateStore concretelyAddressedStore;
+    /// \brief The stores, which copies of this object share until they are
+    /// updated
+    TxCopyOnWrite<LowerStateStore> concretelyAddressedStore;
 
-    LowerStateStore symbolicallyAddressedStore;
+    TxCopyOnWrite<LowerStateStore> symbolicallyAddressedStore;
 
     ref<TxAllocationInfo> allocInfo;
 
@@ -49,27 +86,20 @@ public:
     MiddleStateStore(ref<TxAllocationInfo> _allocInfo)
         : allocInfo(_allocInfo) {}
 
-    /// \brief The copy constructor
-    MiddleStateStore(const MiddleStateStore &obj) {
-      concretelyAddressedStore = obj.concretelyAddressedStore;
-      symbolicallyAddressedStore = obj.symbolicallyAddressedStore;
-      allocInfo = obj.allocInfo;
-    }
-
     LowerStateStore::const_iterator concreteBegin() const {
-      return concretelyAddressedStore.begin();
+      return concretelyAddressedStore.get().begin();
     }
 
     LowerStateStore::const_iterator concreteEnd() const {
-      return concretelyAddressedStore.end();
+      return concretelyAddressedStore.get().end();
     }
 
     LowerStateStore::const_iterator symbolicBegin() const {
-      return symbolicallyAddressedStore.begin();
+      return symbolicallyAddressedStore.get().begin();
     }
 
     LowerStateStore::const_iterator symbolicEnd() const {
-      return symbolicallyAddressedStore.end();
+      return symbolicallyAddressedStore.get().end();
     }
 
     bool hasAllocationInfo(ref<TxAllocationInfo> _allocInfo) const {
@@ -88,9 +118,13 @@ public:
 
     ref<TxStoreEntry> findSymbolic(ref<TxVariable> var) const;
 
+    /// \brief Estimate of the bytes of the stores not shared with a copy
+    uint64_t getOwnedByteSize() const;
+
     ref<TxStoreEntry> updateStore(const TxStore *store, ref<TxStateAddress> loc,
                                   ref<TxStateValue> address,
-                                  ref<TxStateValue> value, uint64_t depth);
+                                  ref<TxStateValue> value, uint64_t depth,
+                                  unsigned pathId);
 
     /// \brief Print the content of the object to the LLVM error stream
     void dump() const {
@@ -112,29 +146,62 @@ public:
   };
 
 private:
+  // The stores below are shared with the parent store until they are
+  // updated, such that creating a child does not copy the whole shadow
+  // memory. Within the internal store, a child also shares the middle stores
+  // of the allocation contexts it does not update.
+
   /// \brief A concretely-addressed store of the earlier versions of all
   /// addresses
-  LowerStateStore concretelyAddressedHistoricalStore;
+  TxCopyOnWrite<LowerStateStore> concretelyAddressedHistoricalStore;
 
   /// \brief A symbolically-addressed store of the earlier versions of all
   /// addresses
-  LowerStateStore symbolicallyAddressedHistoricalStore;
+  TxCopyOnWrite<LowerStateStore> symbolicallyAddressedHistoricalStore;
 
   /// \brief The mapping of locations to stored value
-  TopStateStore internalStore;
+  TxCopyOnWrite<TopStateStore> internalStore;
 
-  /// \brief Store elements used by left path
-  std::set<ref<TxStoreEntry> > usedByLeftPath;
+  /// \brief Store elements used by left path, as a set of the path ids of
+  /// the entries. The entries of a store are created by its ancestors, so
+  /// their path ids are distinct. Mutable as the lookup of a sparse bit
+  /// vector updates its position.
+  mutable llvm::SparseBitVector<> usedByLeftPath;
 
   /// \brief Store elements used by right path
-  std::set<ref<TxStoreEntry> > usedByRightPath;
+  mutable llvm::SparseBitVector<> usedByRightPath;
 
   /// \brief The depth level of this store
   uint64_t depth;
 
+  /// \brief The number of entries created on the path to this store,
+  /// numbering the entries by TxStoreEntry#pathId
+  unsigned entryCount;
+
   /// \brief The parent and left and right children of this store
   TxStore *parent, *left, *right;
 
+  /// \brief Whether the historical stores have been compacted, when the
+  /// first child was created
+  bool historyCompacted;
+
+  /// \brief The number of updates of the stores, which invalidate the
+  /// fingerprint computed from them
+  uint64_t version;
+
+  /// \brief The fingerprint of the stores, computed at fingerprintVersion
+  mutable uint64_t fingerprint;
+
+  mutable uint64_t fingerprintVersion;
+
+  /// \brief The number of historical store entries removed by compaction
+  static uint64_t compactedEntryCount;
+
+  /// \brief Remove the unmarkable entries of the historical stores not
+  /// shared with another store, under -compact-historical-store. They can
+  /// never be in an interpolant.
+  void compactHistory();
+
   void concreteToInterpolant(ref<TxVariable> variable, ref<TxStoreEntry> entry,
                              const std::map<ref<Expr>, ref<Expr> > &substition,
                              std::set<const Array *> &replacements,
@@ -164,48 +231,86 @@ private:
       LowerInterpolantStore &_symbolicallyAddressedHistoricalStore) const;
 
   void recursivelyMarkFlow(ref<TxStoreEntry> entry, bool leftMarking,
-                           const std::string &reason) const;
+                           const TxMarkReason &reason) const;
+
+  /// \brief The number of pointer flow markings so far. Within a marking,
+  /// the checked address and the bounds are fixed, so an entry reached by
+  /// several flows has its bound adjusted, and its flow followed, only once.
+  static uint64_t pointerFlowEpoch;
 
   bool recursivelyMarkPointerFlow(ref<TxStoreEntry> entry, bool leftMarking,
                                   ref<TxStateValue> checkedAddress,
                                   std::set<uint64_t> &bounds,
-                                  const std::string &reason,
+                                  const TxMarkReason &reason,
                                   uint64_t startingDepth) const;
 
   static bool adjustOffsetBound(ref<TxStoreEntry> entry, bool leftMarking,
                                 ref<TxStateValue> checkedAddress,
                                 std::set<uint64_t> &bounds,
-                                const std::string &reason, bool &boundUpdated);
+                                const TxMarkReason &reason, bool &boundUpdated);
 
   /// \brief Constructor for an empty store.
-  TxStore() : depth(0), parent(0), left(0), right(0) {}
+  TxStore()
+      : depth(0), entryCount(0), parent(0), left(0), right(0),
+        historyCompacted(false), version(1), fingerprint(0),
+        fingerprintVersion(0) {}
 
 public:
   ~TxStore() {}
 
   bool isInInternalStateStore(ref<TxAllocationContext> ctx) {
-    TopStateStore::iterator middleStoreIter = internalStore.find(ctx);
-    if (middleStoreIter == internalStore.end()) {
+    TopStateStore::const_iterator middleStoreIter =
+        internalStore.get().find(ctx);
+    if (middleStoreIter == internalStore.get().end()) {
       return false;
     }
     return true;
   }
 
+  /// \brief Whether any entry of the allocation of the location is stored
+  bool isAllocationStored(ref<TxStateAddress> loc) const {
+    TopStateStore::const_iterator middleStoreIter =
+        internalStore.get().find(loc->getContext());
+    return middleStoreIter != internalStore.get().end() &&
+           middleStoreIter->second.hasAllocationInfo(
+               loc->getAllocationInfo());
+  }
+
+  /// \brief Allocate from the TxStore arena
+  static void *operator new(size_t size) {
+    return TxArena::get<TxStore>("TxStore").allocate(size);
+  }
+
+  static void operator delete(void *p, size_t size) {
+    TxArena::get<TxStore>("TxStore").deallocate(p, size);
+  }
+
   static TxStore *create(TxStore *src) {
     TxStore *ret = new TxStore();
     if (!src) {
       return ret;
     }
+    // The execution of the node of the source store is complete when its
+    // first child is created
+    if (!src->historyCompacted)
+      src->compactHistory();
     ret->concretelyAddressedHistoricalStore =
         src->concretelyAddressedHistoricalStore;
     ret->symbolicallyAddressedHistoricalStore =
         src->symbolicallyAddressedHistoricalStore;
     ret->internalStore = src->internalStore;
     ret->depth = src->depth + 1;
+    ret->entryCount = src->entryCount;
     ret->parent = src;
     return ret;
   }
 
+  static uint64_t getCompactedEntryCount() { return compactedEntryCount; }
+
+  /// \brief Estimate of the bytes of the stores not shared with another
+  /// store, which are the copies this store made on update
+  uint64_t getOwnedByteSize() const;
+
   /// \brief Returns true if this store is in the left subtree of its ancestor
   /// at level targetDepth, false otherwise (either local or in the right
   /// subtree of its ancestor at level targetDepth).
@@ -224,28 +329,26 @@ public:
   /// \brief Finds a store entry given an LLVM value
   ref<TxStoreEntry> find(ref<TxAllocationContext> alc, ref<Expr> offset) const;
 
-  /// \brief This retrieves the locations known at this state, and the
-  /// expressions stored in the locations. Returns as the last argument a pair
-  /// of the store part indexed by constants, and the store part indexed by
-  /// symbolic expressions.
-  ///
-  /// \param replacements The replacement bound variables when
-  /// retrieving state for creating subsumption table entry: As the
-  /// resulting expression will be used for storing in the
-  /// subsumption table, the variables need to be replaced with the
-  /// bound ones.
-  /// \param coreOnly Indicate whether we are retrieving only data
-  /// for locations relevant to an unsatisfiability core.
-  /// \param leftRetrieval Whether the retrieval is requested by the left child
-  /// of the store, otherwise, we assume it is requested by the right child of
-  /// the store.
-  void getStoredExpressions(
-      const TxStore *store, const std::vector<llvm::Instruction *> &callHistory,
-      const std::map<ref<Expr>, ref<Expr> > &substitution,
-      std::set<const Array *> &replacements, bool coreOnly, bool leftRetrieval,
-      TopStateStore &__internalStore,
-      LowerStateStore &__concretelyAddressedHistoricalStore,
-      LowerStateStore &__symbolicallyAddressedHistoricalStore) const;
+  /// \brief The mapping of locations to stored value, shared with this
+  /// store rather than copied
+  const TopStateStore &getInternalStore() const { return internalStore.get(); }
+
+  /// \brief The concretely-addressed historical store, shared with this
+  /// store rather than copied
+  const LowerStateStore &getConcretelyAddressedHistoricalStore() const {
+    return concretelyAddressedHistoricalStore.get();
+  }
+
+  /// \brief The symbolically-addressed historical store, shared with this
+  /// store rather than copied
+  const LowerStateStore &getSymbolicallyAddressedHistoricalStore() const {
+    return symbolicallyAddressedHistoricalStore.get();
+  }
+
+  /// \brief A hash of the internal and historical stores. It is computed
+  /// once per version of the stores, so that the subsumption checks of both
+  /// children of the node of the store share it.
+  uint64_t getFingerprint() const;
 
   /// \brief This retrieves the locations known at this state, and the
   /// expressions stored in the locations. Returns as the last argument a pair
@@ -276,13 +379,13 @@ public:
   /// \brief Newly relate a location with its stored value, when the value is
   /// loaded from the location
   void updateStoreWithLoadedValue(
-      std::map<llvm::Value *, std::vector<ref<TxStateValue> > > &valuesMap,
+      TxVersionedValues &valuesMap,
       ref<TxStateAddress> loc, ref<TxStateValue> address,
       ref<TxStateValue> value);
 
   /// \brief Newly relate an location with its stored value
   void updateStore(
-      std::map<llvm::Value *, std::vector<ref<TxStateValue> > > &valuesMap,
+      TxVersionedValues &valuesMap,
       ref<TxStateAddress> location, ref<TxStateValue> address,
       ref<TxStateValue> value);
 
@@ -291,7 +394,7 @@ public:
 
   /// \brief Mark as core all the values and locations that flows to the
   /// target
-  void markFlow(ref<TxStateValue> target, const std::string &reason) const;
+  void markFlow(ref<TxStateValue> target, const TxMarkReason &reason) const;
 
   void markGlobalVariables(ref<TxAllocationContext> ctx, ref<Expr> expr) const;
 
@@ -301,7 +404,7 @@ public:
   /// otherwise.
   bool markPointerFlow(ref<TxStateValue> target,
                        ref<TxStateValue> checkedOffset,
-                       const std::string &reason) const {
+                       const TxMarkReason &reason) const {
     std::set<uint64_t> bounds;
     return markPointerFlow(target, checkedOffset, bounds, reason);
   }
@@ -312,7 +415,7 @@ public:
   bool markPointerFlow(ref<TxStateValue> target,
                        ref<TxStateValue> checkedOffset,
                        std::set<uint64_t> &bounds,
-                       const std::string &reason) const;
+                       const TxMarkReason &reason) const;
 
   uint64_t getDepth() const { return depth; }
 
@@ -0,0 +1,820 @@
+//===--- TxTableFile.cpp ----------------------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementations for saving the subsumption table to
+/// a file, and for reloading it in a later run on the same module.
+///
+//===----------------------------------------------------------------------===//
+
+#include "TxTableFile.h"
+
+#include "TxTree.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/ArrayCache.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/Module.h"
+#endif
+#include "llvm/Support/raw_ostream.h"
+
+#include <fcntl.h>
+#include <fstream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace klee;
+
+namespace {
+const char tableMagic[4] = { 'T', 'X', 'S', 'T' };
+const uint32_t tableVersion = 1;
+
+/// \brief The index of no expression or no instruction
+const uint32_t none = ~0u;
+
+template <typename T> void writeValue(std::string &out, T value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void writeString(std::string &out, const std::string &s) {
+  writeValue(out, (uint32_t)s.size());
+  out.append(s);
+}
+
+template <typename T>
+bool readValue(const char *&p, const char *end, T &value) {
+  if ((size_t)(end - p) < sizeof(T))
+    return false;
+  memcpy(&value, p, sizeof(T));
+  p += sizeof(T);
+  return true;
+}
+
+bool readString(const char *&p, const char *end, std::string &s) {
+  uint32_t length;
+  if (!readValue(p, end, length) || (uint32_t)(end - p) < length)
+    return false;
+  s.assign(p, length);
+  p += length;
+  return true;
+}
+
+/// \brief An instruction identified by function, basic block and instruction
+/// indices
+struct InstructionId {
+  uint32_t function, block, instruction;
+
+  InstructionId() : function(none), block(0), instruction(0) {}
+};
+
+/// \brief A stream computing the FNV-1a hash of the text written to it,
+/// without keeping the text
+class HashStream : public llvm::raw_ostream {
+  uint64_t hash;
+  uint64_t pos;
+
+  virtual void write_impl(const char *ptr, size_t size) {
+    for (const char *it = ptr, *ie = ptr + size; it != ie; ++it)
+      hash = (hash ^ (unsigned char)*it) * 1099511628211ULL;
+    pos += size;
+  }
+
+  virtual uint64_t current_pos() const { return pos; }
+
+public:
+  HashStream() : hash(14695981039346656037ULL), pos(0) {}
+
+  uint64_t getHash() {
+    flush();
+    return hash;
+  }
+};
+}
+
+/// \brief Encodes the table entries into a byte string. The functions,
+/// arrays and expressions referred to are numbered in the order they are
+/// first encountered, and an expression is only written after its kids.
+class TxTableFile::TableWriter {
+  std::string &out;
+
+  std::map<llvm::Function *, uint32_t> functionIds;
+  std::vector<llvm::Function *> functions;
+  std::map<llvm::Instruction *, InstructionId> instructionIds;
+
+  std::map<const Array *, uint32_t> arrayIds;
+  std::string arrays;
+
+  std::map<const Expr *, uint32_t> exprIds;
+  std::string exprs;
+
+  bool writeArray(const Array *array, uint32_t &id);
+  bool writeExpr(ref<Expr> e, uint32_t &id);
+
+public:
+  TableWriter(std::string &_out) : out(_out) {}
+
+  InstructionId getId(llvm::Instruction *inst);
+
+  /// \brief Encode the entry into the output, or return false if it has
+  /// parts that cannot be saved
+  bool writeEntry(const std::vector<llvm::Instruction *> &callHistory,
+                  TxSubsumptionTableEntry *entry);
+
+  /// \brief The function names, arrays and expressions, to be written
+  /// before the entries
+  void writeTables(std::string &tables) const;
+};
+
+InstructionId TxTableFile::TableWriter::getId(llvm::Instruction *inst) {
+  std::map<llvm::Instruction *, InstructionId>::iterator it =
+      instructionIds.find(inst);
+  if (it != instructionIds.end())
+    return it->second;
+
+  // Number all the instructions of the function at once
+  llvm::Function *f = inst->getParent()->getParent();
+  uint32_t functionId = functions.size();
+  functionIds[f] = functionId;
+  functions.push_back(f);
+  uint32_t block = 0;
+  for (llvm::Function::iterator bb = f->begin(), bbe = f->end(); bb != bbe;
+       ++bb, ++block) {
+    uint32_t instruction = 0;
+    for (llvm::BasicBlock::iterator i = bb->begin(), ie = bb->end(); i != ie;
+         ++i, ++instruction) {
+      InstructionId &id = instructionIds[&*i];
+      id.function = functionId;
+      id.block = block;
+      id.instruction = instruction;
+    }
+  }
+  return instructionIds[inst];
+}
+
+bool TxTableFile::TableWriter::writeArray(const Array *array, uint32_t &id) {
+  std::map<const Array *, uint32_t>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end()) {
+    id = it->second;
+    return true;
+  }
+
+  if (array->range > 64)
+    return false;
+
+  writeString(arrays, array->name);
+  writeValue(arrays, (uint64_t)array->size);
+  writeValue(arrays, (uint32_t)array->domain);
+  writeValue(arrays, (uint32_t)array->range);
+  writeValue(arrays, (uint32_t)array->constantValues.size());
+  for (std::vector<ref<ConstantExpr> >::const_iterator
+           it1 = array->constantValues.begin(),
+           ie1 = array->constantValues.end();
+       it1 != ie1; ++it1) {
+    writeValue(arrays, (*it1)->getZExtValue());
+  }
+
+  id = arrayIds.size();
+  arrayIds[array] = id;
+  return true;
+}
+
+bool TxTableFile::TableWriter::writeExpr(ref<Expr> e, uint32_t &id) {
+  std::map<const Expr *, uint32_t>::iterator it = exprIds.find(e.get());
+  if (it != exprIds.end()) {
+    id = it->second;
+    return true;
+  }
+
+  // The kids and the other referred objects are written first
+  std::string node;
+  writeValue(node, (uint32_t)e->getKind());
+  writeValue(node, (uint32_t)e->getWidth());
+
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    ConstantExpr *ce = cast<ConstantExpr>(e);
+    const llvm::APInt &value = ce->getAPValue();
+    writeValue(node, (uint32_t)value.getNumWords());
+    for (unsigned i = 0; i < value.getNumWords(); ++i)
+      writeValue(node, value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read: {
+    ReadExpr *re = cast<ReadExpr>(e);
+    uint32_t arrayId, indexId;
+    if (!writeArray(re->updates.root, arrayId))
+      return false;
+
+    // The updates are written from the oldest
+    std::vector<const UpdateNode *> updates;
+    for (const UpdateNode *un = re->updates.head; un; un = un->next)
+      updates.push_back(un);
+    std::vector<std::pair<uint32_t, uint32_t> > updateIds;
+    for (std::vector<const UpdateNode *>::reverse_iterator
+             it1 = updates.rbegin(),
+             ie1 = updates.rend();
+         it1 != ie1; ++it1) {
+      uint32_t index, value;
+      if (!writeExpr((*it1)->index, index) || !writeExpr((*it1)->value, value))
+        return false;
+      updateIds.push_back(std::make_pair(index, value));
+    }
+    if (!writeExpr(re->index, indexId))
+      return false;
+
+    writeValue(node, arrayId);
+    writeValue(node, (uint32_t)updateIds.size());
+    for (std::vector<std::pair<uint32_t, uint32_t> >::iterator
+             it1 = updateIds.begin(),
+             ie1 = updateIds.end();
+         it1 != ie1; ++it1) {
+      writeValue(node, it1->first);
+      writeValue(node, it1->second);
+    }
+    writeValue(node, indexId);
+    break;
+  }
+  case Expr::Exists: {
+    ExistsExpr *ee = cast<ExistsExpr>(e);
+    std::vector<uint32_t> variableIds;
+    for (std::set<const Array *>::const_iterator
+             it1 = ee->variables.begin(),
+             ie1 = ee->variables.end();
+         it1 != ie1; ++it1) {
+      uint32_t arrayId;
+      if (!writeArray(*it1, arrayId))
+        return false;
+      variableIds.push_back(arrayId);
+    }
+    uint32_t bodyId;
+    if (!writeExpr(ee->body, bodyId))
+      return false;
+
+    writeValue(node, (uint32_t)variableIds.size());
+    for (std::vector<uint32_t>::iterator it1 = variableIds.begin(),
+                                         ie1 = variableIds.end();
+         it1 != ie1; ++it1) {
+      writeValue(node, *it1);
+    }
+    writeValue(node, bodyId);
+    break;
+  }
+  default: {
+    if (e->getKind() > Expr::LastKind)
+      return false;
+
+    std::vector<uint32_t> kidIds;
+    for (unsigned i = 0; i < e->getNumKids(); ++i) {
+      uint32_t kidId;
+      if (!writeExpr(e->getKid(i), kidId))
+        return false;
+      kidIds.push_back(kidId);
+    }
+
+    writeValue(node, (uint32_t)kidIds.size());
+    for (std::vector<uint32_t>::iterator it1 = kidIds.begin(),
+                                         ie1 = kidIds.end();
+         it1 != ie1; ++it1) {
+      writeValue(node, *it1);
+    }
+    if (ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+      writeValue(node, (uint32_t)ee->offset);
+    break;
+  }
+  }
+
+  exprs.append(node);
+  id = exprIds.size();
+  exprIds[e.get()] = id;
+  return true;
+}
+
+bool TxTableFile::TableWriter::writeEntry(const std::vector<llvm::Instruction *> &callHistory,
+                             TxSubsumptionTableEntry *entry) {
+  if (!isSaveable(entry))
+    return false;
+
+  // The expressions and arrays of an entry that cannot be saved stay in the
+  // tables, which is harmless.
+  ref<Expr> interpolant = getInterpolant(entry);
+  uint32_t interpolantId = none;
+  if (!interpolant.isNull() && !writeExpr(interpolant, interpolantId))
+    return false;
+  const std::set<const Array *> &existentials = getExistentials(entry);
+  std::vector<uint32_t> existentialIds;
+  for (std::set<const Array *>::const_iterator it = existentials.begin(),
+                                               ie = existentials.end();
+       it != ie; ++it) {
+    uint32_t arrayId;
+    if (!writeArray(*it, arrayId))
+      return false;
+    existentialIds.push_back(arrayId);
+  }
+
+  std::vector<InstructionId> ids;
+  ids.push_back(
+      getId(reinterpret_cast<llvm::Instruction *>(entry->programPoint)));
+  uintptr_t prevProgramPoint = getPrevProgramPoint(entry);
+  ids.push_back(prevProgramPoint ? getId(reinterpret_cast<llvm::Instruction *>(
+                                       prevProgramPoint))
+                                 : InstructionId());
+  for (std::vector<llvm::Instruction *>::const_iterator
+           it = callHistory.begin(),
+           ie = callHistory.end();
+       it != ie; ++it) {
+    ids.push_back(getId(*it));
+  }
+
+  writeValue(out, (uint32_t)ids.size());
+  for (std::vector<InstructionId>::iterator it = ids.begin(), ie = ids.end();
+       it != ie; ++it) {
+    writeValue(out, it->function);
+    writeValue(out, it->block);
+    writeValue(out, it->instruction);
+  }
+  writeValue(out, interpolantId);
+  writeValue(out, (uint32_t)existentialIds.size());
+  for (std::vector<uint32_t>::iterator it = existentialIds.begin(),
+                                       ie = existentialIds.end();
+       it != ie; ++it) {
+    writeValue(out, *it);
+  }
+  return true;
+}
+
+void TxTableFile::TableWriter::writeTables(std::string &tables) const {
+  writeValue(tables, (uint32_t)functions.size());
+  for (std::vector<llvm::Function *>::const_iterator it = functions.begin(),
+                                                     ie = functions.end();
+       it != ie; ++it) {
+    writeString(tables, (*it)->getName().str());
+  }
+  writeValue(tables, (uint32_t)arrayIds.size());
+  tables.append(arrays);
+  writeValue(tables, (uint32_t)exprIds.size());
+  tables.append(exprs);
+}
+
+/// \brief Decodes the table entries of a mapped file
+class TxTableFile::TableReader {
+  const char *p;
+  const char *end;
+
+  llvm::Module *module;
+  ArrayCache &arrayCache;
+
+  /// \brief The instructions of the functions, by basic block, or an empty
+  /// vector for a function not in the module
+  std::vector<std::vector<std::vector<llvm::Instruction *> > > functions;
+
+  std::vector<const Array *> arrays;
+  std::vector<ref<Expr> > exprs;
+
+  bool readArray();
+  bool readExpr();
+
+  bool getExpr(uint32_t id, ref<Expr> &e) const {
+    if (id >= exprs.size())
+      return false;
+    e = exprs[id];
+    return true;
+  }
+
+  bool getArray(uint32_t id, const Array *&array) const {
+    if (id >= arrays.size())
+      return false;
+    array = arrays[id];
+    return true;
+  }
+
+  bool getInstruction(const InstructionId &id, llvm::Instruction *&inst) const;
+
+public:
+  TableReader(const char *_p, const char *_end, llvm::Module *_module,
+              ArrayCache &_arrayCache)
+      : p(_p), end(_end), module(_module), arrayCache(_arrayCache) {}
+
+  /// \brief Decode the function names, arrays and expressions, and the
+  /// number of entries that follow
+  bool readTables(uint32_t &entryCount);
+
+  /// \brief Decode the next entry. The entry is null when it refers to a
+  /// program point not in the module. Returns false on malformed input.
+  bool readEntry(uintptr_t &programPoint,
+                 std::vector<llvm::Instruction *> &callHistory,
+                 TxSubsumptionTableEntry *&entry);
+
+  /// \brief The position of the next byte to decode
+  const char *getPosition() const { return p; }
+};
+
+bool TxTableFile::TableReader::getInstruction(const InstructionId &id,
+                                 llvm::Instruction *&inst) const {
+  if (id.function >= functions.size() ||
+      id.block >= functions[id.function].size() ||
+      id.instruction >= functions[id.function][id.block].size())
+    return false;
+  inst = functions[id.function][id.block][id.instruction];
+  return true;
+}
+
+bool TxTableFile::TableReader::readArray() {
+  std::string name;
+  uint64_t size;
+  uint32_t domain, range, constantCount;
+  if (!readString(p, end, name) || !readValue(p, end, size) ||
+      !readValue(p, end, domain) || !readValue(p, end, range) ||
+      !readValue(p, end, constantCount))
+    return false;
+
+  std::vector<ref<ConstantExpr> > constantValues;
+  for (uint32_t i = 0; i < constantCount; ++i) {
+    uint64_t value;
+    if (!readValue(p, end, value))
+      return false;
+    constantValues.push_back(ConstantExpr::create(value, range));
+  }
+
+  if (constantValues.empty()) {
+    arrays.push_back(arrayCache.CreateArray(name, size, 0, 0, domain, range));
+  } else {
+    arrays.push_back(arrayCache.CreateArray(
+        name, size, &constantValues[0],
+        &constantValues[0] + constantValues.size(), domain, range));
+  }
+  return true;
+}
+
+bool TxTableFile::TableReader::readExpr() {
+  uint32_t kind, width;
+  if (!readValue(p, end, kind) || !readValue(p, end, width) ||
+      kind > Expr::LastKind)
+    return false;
+
+  ref<Expr> e;
+  switch (kind) {
+  case Expr::Constant: {
+    uint32_t numWords;
+    if (!readValue(p, end, numWords) || numWords == 0)
+      return false;
+    std::vector<uint64_t> words(numWords);
+    for (uint32_t i = 0; i < numWords; ++i) {
+      if (!readValue(p, end, words[i]))
+        return false;
+    }
+    e = ConstantExpr::alloc(llvm::APInt(width, numWords, &words[0]));
+    break;
+  }
+  case Expr::Read: {
+    uint32_t arrayId, updateCount, indexId;
+    const Array *array;
+    if (!readValue(p, end, arrayId) || !getArray(arrayId, array) ||
+        !readValue(p, end, updateCount))
+      return false;
+    UpdateList updates(array, 0);
+    for (uint32_t i = 0; i < updateCount; ++i) {
+      uint32_t index, value;
+      ref<Expr> indexExpr, valueExpr;
+      if (!readValue(p, end, index) || !readValue(p, end, value) ||
+          !getExpr(index, indexExpr) || !getExpr(value, valueExpr))
+        return false;
+      updates.extend(indexExpr, valueExpr);
+    }
+    ref<Expr> index;
+    if (!readValue(p, end, indexId) || !getExpr(indexId, index))
+      return false;
+    e = ReadExpr::create(updates, index);
+    break;
+  }
+  case Expr::Exists: {
+    uint32_t variableCount, bodyId;
+    if (!readValue(p, end, variableCount))
+      return false;
+    std::set<const Array *> variables;
+    for (uint32_t i = 0; i < variableCount; ++i) {
+      uint32_t arrayId;
+      const Array *array;
+      if (!readValue(p, end, arrayId) || !getArray(arrayId, array))
+        return false;
+      variables.insert(array);
+    }
+    ref<Expr> body;
+    if (!readValue(p, end, bodyId) || !getExpr(bodyId, body))
+      return false;
+    e = ExistsExpr::create(variables, body);
+    break;
+  }
+  default: {
+    uint32_t kidCount;
+    if (!readValue(p, end, kidCount))
+      return false;
+    std::vector<ref<Expr> > kids;
+    for (uint32_t i = 0; i < kidCount; ++i) {
+      uint32_t kidId;
+      ref<Expr> kid;
+      if (!readValue(p, end, kidId) || !getExpr(kidId, kid))
+        return false;
+      kids.push_back(kid);
+    }
+
+    if (kind == Expr::Extract) {
+      uint32_t offset;
+      if (kidCount != 1 || !readValue(p, end, offset))
+        return false;
+      e = ExtractExpr::create(kids[0], offset, width);
+    } else if (kind == Expr::Not) {
+      if (kidCount != 1)
+        return false;
+      e = NotExpr::create(kids[0]);
+    } else {
+      std::vector<Expr::CreateArg> args;
+      for (std::vector<ref<Expr> >::iterator it = kids.begin(),
+                                             ie = kids.end();
+           it != ie; ++it) {
+        args.push_back(Expr::CreateArg(*it));
+      }
+      if (kind == Expr::ZExt || kind == Expr::SExt)
+        args.push_back(Expr::CreateArg(width));
+      unsigned expected = (kind == Expr::Select) ? 3 : 2;
+      if (kind == Expr::NotOptimized)
+        expected = 1;
+      if (args.size() != expected)
+        return false;
+      e = Expr::createFromKind((Expr::Kind)kind, args);
+    }
+    break;
+  }
+  }
+
+  exprs.push_back(e);
+  return true;
+}
+
+bool TxTableFile::TableReader::readTables(uint32_t &entryCount) {
+  uint32_t count;
+  if (!readValue(p, end, count))
+    return false;
+  for (uint32_t i = 0; i < count; ++i) {
+    std::string name;
+    if (!readString(p, end, name))
+      return false;
+    functions.push_back(std::vector<std::vector<llvm::Instruction *> >());
+    llvm::Function *f = module->getFunction(name);
+    if (!f)
+      continue;
+    for (llvm::Function::iterator bb = f->begin(), bbe = f->end(); bb != bbe;
+         ++bb) {
+      functions.back().push_back(std::vector<llvm::Instruction *>());
+      for (llvm::BasicBlock::iterator it = bb->begin(), ie = bb->end();
+           it != ie; ++it) {
+        functions.back().back().push_back(&*it);
+      }
+    }
+  }
+
+  if (!readValue(p, end, count))
+    return false;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!readArray())
+      return false;
+  }
+
+  if (!readValue(p, end, count))
+    return false;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!readExpr())
+      return false;
+  }
+  return readValue(p, end, entryCount);
+}
+
+bool TxTableFile::TableReader::readEntry(uintptr_t &programPoint,
+                            std::vector<llvm::Instruction *> &callHistory,
+                            TxSubsumptionTableEntry *&entry) {
+  uint32_t idCount, interpolantId, existentialCount;
+  if (!readValue(p, end, idCount) || idCount < 2)
+    return false;
+
+  std::vector<InstructionId> ids(idCount);
+  for (uint32_t i = 0; i < idCount; ++i) {
+    if (!readValue(p, end, ids[i].function) ||
+        !readValue(p, end, ids[i].block) ||
+        !readValue(p, end, ids[i].instruction))
+      return false;
+  }
+
+  ref<Expr> interpolant;
+  if (!readValue(p, end, interpolantId) ||
+      (interpolantId != none && !getExpr(interpolantId, interpolant)))
+    return false;
+
+  std::set<const Array *> existentials;
+  if (!readValue(p, end, existentialCount))
+    return false;
+  for (uint32_t i = 0; i < existentialCount; ++i) {
+    uint32_t arrayId;
+    const Array *array;
+    if (!readValue(p, end, arrayId) || !getArray(arrayId, array))
+      return false;
+    existentials.insert(array);
+  }
+
+  entry = 0;
+  llvm::Instruction *inst, *prevInst = 0;
+  if (!getInstruction(ids[0], inst) ||
+      (ids[1].function != none && !getInstruction(ids[1], prevInst)))
+    return true;
+  callHistory.clear();
+  for (uint32_t i = 2; i < idCount; ++i) {
+    llvm::Instruction *call;
+    if (!getInstruction(ids[i], call))
+      return true;
+    callHistory.push_back(call);
+  }
+
+  programPoint = reinterpret_cast<uintptr_t>(inst);
+  entry = new TxSubsumptionTableEntry(
+      programPoint, reinterpret_cast<uintptr_t>(prevInst), interpolant,
+      existentials);
+  return true;
+}
+
+uint64_t TxTableFile::savedCount = 0;
+
+uint64_t TxTableFile::skippedCount = 0;
+
+uint64_t TxTableFile::loadedCount = 0;
+
+uint64_t TxTableFile::rejectedCount = 0;
+
+bool TxTableFile::isSaveable(const TxSubsumptionTableEntry *entry) {
+  return entry->concretelyAddressedStore.empty() &&
+         entry->symbolicallyAddressedStore.empty() &&
+         entry->concretelyAddressedHistoricalStore.empty() &&
+         entry->symbolicallyAddressedHistoricalStore.empty() &&
+         entry->markedGlobal.empty() && entry->wpInterpolant.isNull() &&
+         entry->phiValues.empty();
+}
+
+ref<Expr> TxTableFile::getInterpolant(const TxSubsumptionTableEntry *entry) {
+  return entry->interpolant;
+}
+
+const std::set<const Array *> &
+TxTableFile::getExistentials(const TxSubsumptionTableEntry *entry) {
+  return entry->existentials;
+}
+
+uintptr_t
+TxTableFile::getPrevProgramPoint(const TxSubsumptionTableEntry *entry) {
+  return entry->prevProgramPoint;
+}
+
+uint64_t TxTableFile::computeModuleHash(llvm::Module *module) {
+  // The printed globals and functions, with their types, constants and
+  // operands, but not the module identifier, which is the path it was
+  // loaded from
+  HashStream stream;
+  for (llvm::Module::global_iterator g = module->global_begin(),
+                                     ge = module->global_end();
+       g != ge; ++g)
+    stream << *g << "\n";
+  for (llvm::Module::iterator f = module->begin(), fe = module->end(); f != fe;
+       ++f)
+    stream << *f;
+  return stream.getHash();
+}
+
+void TxTableFile::save(const std::string &fileName, llvm::Module *module,
+                       uint64_t after, bool append) {
+  std::string entries;
+  TableWriter writer(entries);
+  uint32_t entryCount = 0;
+
+  for (std::map<uintptr_t,
+                TxSubsumptionTable::CallHistoryIndexedTable *>::const_iterator
+           it = TxSubsumptionTable::instance.begin(),
+           ie = TxSubsumptionTable::instance.end();
+       it != ie; ++it) {
+    if (!it->second)
+      continue;
+    std::vector<std::pair<std::vector<llvm::Instruction *>,
+                          TxSubsumptionTableEntry *> > tableEntries;
+    it->second->getEntries(tableEntries);
+    for (std::vector<std::pair<std::vector<llvm::Instruction *>,
+                               TxSubsumptionTableEntry *> >::iterator
+             it1 = tableEntries.begin(),
+             ie1 = tableEntries.end();
+         it1 != ie1; ++it1) {
+      if (TxSubsumptionTable::getInsertionNumber(it1->second) <= after)
+        continue;
+      if (writer.writeEntry(it1->first, it1->second)) {
+        ++entryCount;
+      } else {
+        ++skippedCount;
+      }
+    }
+  }
+
+  if (append && !entryCount)
+    return;
+
+  std::string header;
+  header.append(tableMagic, 4);
+  writeValue(header, tableVersion);
+  writeValue(header, computeModuleHash(module));
+  writer.writeTables(header);
+  writeValue(header, entryCount);
+
+  std::ofstream out(fileName.c_str(),
+                    std::ios::out | std::ios::binary |
+                        (append ? std::ios::app : std::ios::trunc));
+  if (!out) {
+    klee_warning("cannot write subsumption table file %s", fileName.c_str());
+    return;
+  }
+  out.write(header.data(), header.size());
+  out.write(entries.data(), entries.size());
+  savedCount += entryCount;
+}
+
+void TxTableFile::load(const std::string &fileName, llvm::Module *module,
+                       ArrayCache &arrayCache) {
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  void *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return;
+
+  const char *p = static_cast<const char *>(data);
+  const char *end = p + st.st_size;
+  uint64_t expectedHash = computeModuleHash(module);
+  bool valid = true;
+  // Each segment appended by a save has its own header and tables
+  while (valid && p != end) {
+    uint32_t version = 0, entryCount = 0;
+    uint64_t moduleHash = 0;
+    valid = (end - p >= 4) && memcmp(p, tableMagic, 4) == 0;
+    if (!valid)
+      break;
+    p += 4;
+    valid = readValue(p, end, version) && version == tableVersion;
+    valid = valid && readValue(p, end, moduleHash);
+    if (valid && moduleHash != expectedHash) {
+      klee_warning("ignoring subsumption table file %s of a different module",
+                   fileName.c_str());
+      break;
+    }
+
+    TableReader reader(p, end, module, arrayCache);
+    valid = valid && reader.readTables(entryCount);
+    for (uint32_t i = 0; valid && i < entryCount; ++i) {
+      uintptr_t programPoint;
+      std::vector<llvm::Instruction *> callHistory;
+      TxSubsumptionTableEntry *entry;
+      valid = reader.readEntry(programPoint, callHistory, entry);
+      if (!valid)
+        break;
+      if (entry) {
+        if (TxSubsumptionTable::insert(
+                programPoint, TxCallHistory::intern(callHistory), entry))
+          ++loadedCount;
+        else
+          delete entry;
+      } else {
+        ++rejectedCount;
+      }
+    }
+    p = reader.getPosition();
+  }
+  if (!valid)
+    klee_warning("malformed subsumption table file %s", fileName.c_str());
+
+  munmap(data, st.st_size);
+}
+
+void TxTableFile::printStat(std::stringstream &stream) {
+  stream << "KLEE: done:     Number of subsumption table entries loaded from "
+            "file (rejected) = " << loadedCount << " (" << rejectedCount
+         << ")\n";
+  stream << "KLEE: done:     Number of subsumption table entries saved to file "
+            "(skipped) = " << savedCount << " (" << skippedCount << ")\n";
+}
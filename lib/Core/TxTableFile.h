@@ -0,0 +1,89 @@
+//===--- TxTableFile.h ------------------------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations for saving the subsumption table to a
+/// file, and for reloading it in a later run on the same module.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_TXTABLEFILE_H
+#define KLEE_TXTABLEFILE_H
+
+#include "klee/Expr.h"
+
+#include <set>
+#include <sstream>
+#include <stdint.h>
+#include <string>
+
+namespace llvm {
+class Module;
+}
+
+namespace klee {
+class ArrayCache;
+class TxSubsumptionTableEntry;
+
+/// \brief The subsumption table file.
+///
+/// The file is a versioned binary image of the table entries, read through
+/// mmap. Program points and call histories are identified by function name
+/// and basic block and instruction indices rather than by address, and the
+/// file records a hash of the module, so that it is only reloaded into a run
+/// on an identical module. The arrays of the interpolants are identified by
+/// name and size, which is how the array cache of the executor identifies
+/// them, so that a reloaded entry refers to the arrays the run creates later.
+///
+/// Only the entries consisting of an interpolant over the path condition are
+/// saved. The entries with memory fragments, marked globals, phi values or a
+/// weakest precondition refer to allocation contexts and values of the run,
+/// and are skipped.
+class TxTableFile {
+  class TableWriter;
+  class TableReader;
+
+  /// \brief Whether the entry has no parts that refer to the run
+  static bool isSaveable(const TxSubsumptionTableEntry *entry);
+
+  static ref<Expr> getInterpolant(const TxSubsumptionTableEntry *entry);
+
+  static const std::set<const Array *> &
+  getExistentials(const TxSubsumptionTableEntry *entry);
+
+  static uintptr_t getPrevProgramPoint(const TxSubsumptionTableEntry *entry);
+
+  static uint64_t savedCount;
+  static uint64_t skippedCount;
+  static uint64_t loadedCount;
+  static uint64_t rejectedCount;
+
+public:
+  /// \brief A hash of the printed global variables and functions of the
+  /// module
+  static uint64_t computeModuleHash(llvm::Module *module);
+
+  /// \brief Write the entries of the subsumption table inserted after the
+  /// given insertion number to the file. When appending, they form a new
+  /// segment after those already in the file.
+  static void save(const std::string &fileName, llvm::Module *module,
+                   uint64_t after = 0, bool append = false);
+
+  /// \brief Insert the entries of all the segments of the file into the
+  /// subsumption table. A missing file, or one of another version or
+  /// module, is ignored.
+  static void load(const std::string &fileName, llvm::Module *module,
+                   ArrayCache &arrayCache);
+
+  /// \brief Print the numbers of saved, skipped, loaded and rejected entries
+  static void printStat(std::stringstream &stream);
+};
+}
+
+#endif
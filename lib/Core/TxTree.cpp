@@ -15,18 +15,28 @@
 
 #include "TxTree.h"
 
+#include "CoreStats.h"
 #include "TimingSolver.h"
 
 #include "TxDependency.h"
+#include "TxExistentialElimination.h"
+#include "TxPartitionHelper.h"
 #include "TxShadowArray.h"
+#include "TxTableFile.h"
 #include "Memory.h"
+#include "SamplingProfiler.h"
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <klee/CommandLine.h>
 #include <klee/Expr.h>
 #include <klee/Internal/Support/ErrorHandling.h>
+#include <klee/Internal/Support/Timer.h>
 #include <klee/Solver.h>
 #include <klee/SolverStats.h>
+#include <klee/util/Assignment.h>
 #include <klee/util/ExprPPrinter.h>
+#include <klee/util/ExprUtil.h>
 #include <klee/util/TxExprUtil.h>
 #include <klee/util/TxPrintUtil.h>
 #include <vector>
@@ -48,6 +58,33 @@ TxSubsumptionTableEntry::symbolicallyAddressedStoreExpressionBuildTime(
     "symbolicallyAddressedStoreExpressionBuildTime", "symbolicStoreTime");
 Statistic TxSubsumptionTableEntry::solverAccessTime("solverAccessTime",
                                                     "solverAccessTime");
+Statistic TxSubsumptionTableEntry::prefilterRejectionCount(
+    "prefilterRejectionCount", "prefilterRejects");
+Statistic TxSubsumptionTableEntry::modelRefutationCount(
+    "modelRefutationCount", "modelRefutations");
+Statistic TxSubsumptionTableEntry::queryCacheHitCount("queryCacheHitCount",
+                                                      "queryCacheHits");
+Statistic TxSubsumptionTableEntry::groupCacheHitCount("groupCacheHitCount",
+                                                      "groupCacheHits");
+
+std::map<ref<Expr>, TxSubsumptionTableEntry::GroupResult>
+TxSubsumptionTableEntry::groupCache;
+
+uint64_t TxSubsumptionTableEntry::groupCacheNode = 0;
+
+size_t TxSubsumptionTableEntry::groupCacheConstraints = 0;
+
+uint64_t TxSubsumptionTableEntry::useClock = 0;
+
+llvm::raw_ostream *TxSubsumptionTableEntry::queryLog = 0;
+
+uint64_t TxSubsumptionTableEntry::loggedQueryCount = 0;
+
+#ifdef ENABLE_Z3
+Z3Solver *TxSubsumptionTableEntry::existentialSolver = 0;
+
+Z3Solver *TxSubsumptionTableEntry::concurrentSolver = 0;
+#endif
 
 int debugSubsumptionLevel_g=0;
 void setDebugSubsumptionLevelTxTree(int debugSubsumptionLevel)
@@ -57,8 +94,12 @@ void setDebugSubsumptionLevelTxTree(int debugSubsumptionLevel)
 
 TxSubsumptionTableEntry::TxSubsumptionTableEntry(
     TxTreeNode *node, const std::vector<llvm::Instruction *> &callHistory)
-    : programPoint(node->getProgramPoint()),
-      nodeSequenceNumber(node->getNodeSequenceNumber()) {
+    : globalSnapshotBuilt(false), globalSnapshotUnresolved(false),
+      hitCount(0), missCount(0), checkTime(0), lastUse(++useClock), size(0),
+      insertionNumber(0), programPoint(node->getProgramPoint()),
+      nodeSequenceNumber(node->getNodeSequenceNumber()),
+      subtreeSize(TxTreeNode::getVisitedNodeCount() + 1 -
+                  node->getNodeSequenceNumber()) {
   std::map<ref<Expr>, ref<Expr> > substitution;
   existentials.clear();
   interpolant = node->getInterpolant(existentials, substitution);
@@ -76,10 +117,430 @@ TxSubsumptionTableEntry::TxSubsumptionTableEntry(
 
   if (WPInterpolant)
     wpInterpolant = node->generateWPInterpolant();
+
+  computeSignature();
+}
+
+TxSubsumptionTableEntry::TxSubsumptionTableEntry(
+    uintptr_t _programPoint, uintptr_t _prevProgramPoint,
+    ref<Expr> _interpolant, const std::set<const Array *> &_existentials)
+    : interpolant(_interpolant), globalSnapshotBuilt(false),
+      globalSnapshotUnresolved(false), existentials(_existentials),
+      prevProgramPoint(_prevProgramPoint), hitCount(0), missCount(0),
+      checkTime(0), lastUse(++useClock), size(0), insertionNumber(0),
+      programPoint(_programPoint),
+      nodeSequenceNumber(0), subtreeSize(0) {
+  computeSignature();
 }
 
 TxSubsumptionTableEntry::~TxSubsumptionTableEntry() {}
 
+void TxSubsumptionTableEntry::buildGlobalSnapshot() {
+  globalSnapshotBuilt = true;
+  for (std::set<ref<TxStoreEntry> >::iterator it = markedGlobal.begin(),
+                                              ie = markedGlobal.end();
+       it != ie; ++it) {
+    if ((*it)->getValue()->getType()->isPointerTy() ||
+        (*it)->getValue()->getType()->getTypeID() == 0) {
+      continue;
+    }
+
+    ObjectPair initOp;
+    if (!TxTree::initialGlobals->resolveOne(
+            cast<klee::ConstantExpr>((*it)->getAddress()->getAddress()),
+            initOp)) {
+      globalSnapshotUnresolved = true;
+      globalSnapshot.clear();
+      return;
+    }
+
+    GlobalSnapshot g;
+    g.object = initOp.first;
+    g.initialContents = initOp.second;
+    g.offset = (*it)->getAddress()->getOffset();
+    g.width = (*it)->getAddress()->getSize() * 8;
+    g.initialValue = g.initialContents->read(g.offset, g.width);
+    globalSnapshot.push_back(g);
+  }
+}
+
+bool TxSubsumptionTableEntry::checkGlobals(const ExecutionState &state) {
+  if (!globalSnapshotBuilt)
+    buildGlobalSnapshot();
+  if (globalSnapshotUnresolved)
+    return false;
+
+  for (std::vector<GlobalSnapshot>::const_iterator
+           it = globalSnapshot.begin(),
+           ie = globalSnapshot.end();
+       it != ie; ++it) {
+    const ObjectState *contents = state.addressSpace.findObject(it->object);
+    if (!contents)
+      return false;
+    if (contents != it->initialContents &&
+        contents->read(it->offset, it->width) != it->initialValue)
+      return false;
+  }
+  return true;
+}
+
+void TxSubsumptionTableEntry::computeSignature() {
+  std::set<ref<TxAllocationContext> > contexts;
+  for (TxStore::TopInterpolantStore::const_iterator
+           it = concretelyAddressedStore.begin(),
+           ie = concretelyAddressedStore.end();
+       it != ie; ++it) {
+    contexts.insert(it->first);
+  }
+  for (TxStore::TopInterpolantStore::const_iterator
+           it = symbolicallyAddressedStore.begin(),
+           ie = symbolicallyAddressedStore.end();
+       it != ie; ++it) {
+    contexts.insert(it->first);
+  }
+  signatureContexts.assign(contexts.begin(), contexts.end());
+
+  signatureHistoricalVariables.clear();
+  for (TxStore::LowerInterpolantStore::const_iterator
+           it = concretelyAddressedHistoricalStore.begin(),
+           ie = concretelyAddressedHistoricalStore.end();
+       it != ie; ++it) {
+    signatureHistoricalVariables.push_back(it->first);
+  }
+
+  interpolantArraySignature = 0;
+  if (!interpolant.isNull()) {
+    std::vector<const Array *> arrays;
+    findSymbolicObjects(interpolant, arrays);
+    interpolantArraySignature = getArraySignature(arrays, existentials);
+  }
+}
+
+uint64_t TxSubsumptionTableEntry::getArraySignature(
+    const std::vector<const Array *> &arrays,
+    const std::set<const Array *> &excluded) {
+  uint64_t signature = 0;
+  for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+                                                  ie = arrays.end();
+       it != ie; ++it) {
+    if (excluded.find(*it) != excluded.end())
+      continue;
+    signature |= ((uint64_t)1) << ((*it)->hash() % 64);
+  }
+  return signature;
+}
+
+/// \brief Count the value in its bucket of a histogram in powers of two
+static void addToHistogram(std::vector<uint64_t> &histogram, uint64_t value) {
+  unsigned bucket = 0;
+  while ((((uint64_t)1) << bucket) <= value && bucket < 63)
+    ++bucket;
+  if (histogram.size() <= bucket)
+    histogram.resize(bucket + 1);
+  ++histogram[bucket];
+}
+
+static void printHistogram(std::stringstream &stream,
+                           const std::vector<uint64_t> &histogram) {
+  for (unsigned i = 0; i < histogram.size(); ++i) {
+    if (histogram[i])
+      stream << " <" << (((uint64_t)1) << i) << ":" << histogram[i];
+  }
+  stream << "\n";
+}
+
+/// \brief The estimated number of bytes of the expression nodes not yet
+/// visited
+static uint64_t getExprSize(ref<Expr> expr, std::set<const Expr *> &visited) {
+  uint64_t ret = 0;
+  std::vector<ref<Expr> > worklist;
+  if (!expr.isNull())
+    worklist.push_back(expr);
+  while (!worklist.empty()) {
+    ref<Expr> e = worklist.back();
+    worklist.pop_back();
+    if (!visited.insert(e.get()).second)
+      continue;
+    ret += sizeof(Expr) + e->getNumKids() * sizeof(ref<Expr>);
+    for (unsigned i = 0, n = e->getNumKids(); i < n; ++i)
+      worklist.push_back(e->getKid(i));
+  }
+  return ret;
+}
+
+/// \brief The estimated number of bytes of a store, excluding its key objects
+/// which are shared with the states
+static uint64_t getStoreSize(const TxStore::LowerInterpolantStore &store,
+                             std::set<const Expr *> &visited) {
+  // A red-black tree node holds three pointers and the color besides the
+  // value
+  uint64_t ret = 0;
+  for (TxStore::LowerInterpolantStore::const_iterator it = store.begin(),
+                                                      ie = store.end();
+       it != ie; ++it) {
+    ret += sizeof(TxStore::LowerInterpolantStore::value_type) +
+           4 * sizeof(void *) + sizeof(TxInterpolantValue);
+    ret += getExprSize(it->second->getExpression(), visited);
+  }
+  return ret;
+}
+
+/// \brief Whether the expressions are both null or equal
+static bool isSameExpr(ref<Expr> a, ref<Expr> b) {
+  if (a.isNull() || b.isNull())
+    return a.isNull() && b.isNull();
+  return a == b;
+}
+
+/// \brief Whether the stores have the same variables with equivalent values
+static bool isEquivalentStore(const TxStore::LowerInterpolantStore &a,
+                              const TxStore::LowerInterpolantStore &b) {
+  if (a.size() != b.size())
+    return false;
+  for (TxStore::LowerInterpolantStore::const_iterator ia = a.begin(),
+                                                      ib = b.begin(),
+                                                      ie = a.end();
+       ia != ie; ++ia, ++ib) {
+    if (ia->first != ib->first ||
+        ia->second.isNull() != ib->second.isNull())
+      return false;
+    if (!ia->second.isNull() && !ia->second->isEquivalent(*ib->second))
+      return false;
+  }
+  return true;
+}
+
+static bool isEquivalentStore(const TxStore::TopInterpolantStore &a,
+                              const TxStore::TopInterpolantStore &b) {
+  if (a.size() != b.size())
+    return false;
+  for (TxStore::TopInterpolantStore::const_iterator ia = a.begin(),
+                                                    ib = b.begin(),
+                                                    ie = a.end();
+       ia != ie; ++ia, ++ib) {
+    if (ia->first != ib->first || !isEquivalentStore(ia->second, ib->second))
+      return false;
+  }
+  return true;
+}
+
+/// \brief Collect the conjuncts of the expression, a null expression having
+/// none
+static void getConjuncts(ref<Expr> expr, std::set<ref<Expr> > &conjuncts) {
+  std::vector<ref<Expr> > worklist;
+  if (!expr.isNull())
+    worklist.push_back(expr);
+  while (!worklist.empty()) {
+    ref<Expr> e = worklist.back();
+    worklist.pop_back();
+    if (e->getKind() == Expr::And && e->getWidth() == Expr::Bool) {
+      worklist.push_back(e->getKid(0));
+      worklist.push_back(e->getKid(1));
+    } else if (!e->isTrue()) {
+      conjuncts.insert(e);
+    }
+  }
+}
+
+uint64_t TxSubsumptionTableEntry::estimateSize() const {
+  std::set<const Expr *> visited;
+  uint64_t ret = sizeof(TxSubsumptionTableEntry);
+
+  ret += getExprSize(interpolant, visited);
+  ret += getExprSize(wpInterpolant, visited);
+  ret += getStoreSize(concretelyAddressedHistoricalStore, visited);
+  ret += getStoreSize(symbolicallyAddressedHistoricalStore, visited);
+  for (TxStore::TopInterpolantStore::const_iterator
+           it = concretelyAddressedStore.begin(),
+           ie = concretelyAddressedStore.end();
+       it != ie; ++it) {
+    ret += getStoreSize(it->second, visited);
+  }
+  for (TxStore::TopInterpolantStore::const_iterator
+           it = symbolicallyAddressedStore.begin(),
+           ie = symbolicallyAddressedStore.end();
+       it != ie; ++it) {
+    ret += getStoreSize(it->second, visited);
+  }
+  for (unsigned i = 0, n = phiValues.size(); i < n; ++i)
+    ret += getExprSize(phiValues[i], visited);
+  ret += (existentials.size() + markedGlobal.size()) * 6 * sizeof(void *);
+  ret += signatureContexts.size() * sizeof(ref<TxAllocationContext>) +
+         signatureHistoricalVariables.size() * sizeof(ref<TxVariable>);
+  return ret;
+}
+
+bool TxSubsumptionTableEntry::hasSameContext(
+    const TxSubsumptionTableEntry *other) const {
+  if (prevProgramPoint != other->prevProgramPoint ||
+      existentials != other->existentials ||
+      markedGlobal != other->markedGlobal || phiValues != other->phiValues ||
+      !isSameExpr(wpInterpolant, other->wpInterpolant))
+    return false;
+  return isEquivalentStore(concretelyAddressedStore,
+                           other->concretelyAddressedStore) &&
+         isEquivalentStore(symbolicallyAddressedStore,
+                           other->symbolicallyAddressedStore) &&
+         isEquivalentStore(concretelyAddressedHistoricalStore,
+                           other->concretelyAddressedHistoricalStore) &&
+         isEquivalentStore(symbolicallyAddressedHistoricalStore,
+                           other->symbolicallyAddressedHistoricalStore);
+}
+
+bool TxSubsumptionTableEntry::isAtLeastAsGeneralAs(
+    const TxSubsumptionTableEntry *other) const {
+  if (!hasSameContext(other))
+    return false;
+
+  std::set<ref<Expr> > conjuncts, otherConjuncts;
+  getConjuncts(interpolant, conjuncts);
+  getConjuncts(other->interpolant, otherConjuncts);
+  return std::includes(otherConjuncts.begin(), otherConjuncts.end(),
+                       conjuncts.begin(), conjuncts.end());
+}
+
+void TxPhiValues::set(unsigned slot, ref<Expr> value) {
+  if (slot >= values.size())
+    values.resize(slot + 1);
+  values[slot] = value;
+  fingerprintValid = false;
+}
+
+bool TxPhiValues::isComplete() const {
+  for (std::vector<ref<Expr> >::const_iterator it = values.begin(),
+                                               ie = values.end();
+       it != ie; ++it) {
+    if (it->isNull())
+      return false;
+  }
+  return true;
+}
+
+uint64_t TxPhiValues::getFingerprint() const {
+  if (fingerprintValid)
+    return fingerprint;
+  fingerprint = values.size();
+  for (std::vector<ref<Expr> >::const_iterator it = values.begin(),
+                                               ie = values.end();
+       it != ie; ++it)
+    fingerprint =
+        Expr::combineHash(fingerprint, it->isNull() ? 0 : (*it)->hash());
+  fingerprintValid = true;
+  return fingerprint;
+}
+
+bool TxPhiValues::operator==(const TxPhiValues &other) const {
+  if (values.size() != other.values.size() ||
+      getFingerprint() != other.getFingerprint())
+    return false;
+  for (unsigned i = 0, n = values.size(); i < n; ++i) {
+    if (values[i].isNull() != other.values[i].isNull() ||
+        (!values[i].isNull() && values[i].compare(other.values[i]) != 0))
+      return false;
+  }
+  return true;
+}
+
+const TxStore::TopStateStore TxStateStoreView::emptyTopStore;
+
+const TxStore::LowerStateStore TxStateStoreView::emptyLowerStore;
+
+void TxStateStoreView::retrieve() {
+  if (retrieved)
+    return;
+  retrieved = true;
+  bool leftRetrieval;
+  store = node->getStoredExpressions(leftRetrieval);
+}
+
+TxStateStoreView::~TxStateStoreView() { delete model; }
+
+const TxPhiValues &
+TxStateStoreView::getIncomingPhiValues(ExecutionState &state) {
+  if (incomingPhiValuesComputed)
+    return incomingPhiValues;
+  incomingPhiValuesComputed = true;
+
+  TxTreeNode *parent = state.txTreeNode->getParent();
+  if (!parent || !parent->getDependency())
+    return incomingPhiValues;
+  const std::map<llvm::Value *, std::vector<ref<TxStateValue> > > &valuesMap =
+      parent->getDependency()->getvaluesMap();
+  llvm::BasicBlock *basicBlock = state.txTreeNode->getBasicBlock();
+  unsigned slot = 0;
+  for (llvm::BasicBlock::iterator it = basicBlock->begin(),
+                                  ie = basicBlock->end();
+       it != ie && isa<llvm::PHINode>(&*it); ++it, ++slot) {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
+    llvm::Value *inputArg = it->getOperand(state.incomingBBIndex);
+#else
+    llvm::Value *inputArg = it->getOperand(state.incomingBBIndex * 2);
+#endif
+    std::map<llvm::Value *, std::vector<ref<TxStateValue> > >::const_iterator
+    valuesMapIter = valuesMap.find(inputArg);
+    if (valuesMapIter != valuesMap.end() && !valuesMapIter->second.empty())
+      incomingPhiValues.set(slot,
+                            valuesMapIter->second.back()->getExpression());
+  }
+  return incomingPhiValues;
+}
+
+const Assignment *TxStateStoreView::getModel(TimingSolver *solver,
+                                             ExecutionState &state,
+                                             double timeout) {
+  if (modelComputed)
+    return model;
+  modelComputed = true;
+
+  std::vector<const Array *> objects;
+  findSymbolicObjects(state.constraints.begin(), state.constraints.end(),
+                      objects);
+  std::vector<std::vector<unsigned char> > values;
+  std::vector<ref<Expr> > unsatCore;
+  solver->setTimeout(timeout);
+  bool success = solver->getInitialValues(state, objects, values, unsatCore);
+  solver->setTimeout(0);
+  if (success)
+    model = new Assignment(objects, values, true);
+  return model;
+}
+
+/**/
+
+bool TxSubsumptionTableEntry::mayBeSubsumed(
+    TxStateStoreView &stateStore, uint64_t stateArraySignature) const {
+  // The interpolant mentions an array not mentioned by the state
+  if (interpolantArraySignature & ~stateArraySignature)
+    return false;
+
+  for (std::vector<ref<TxAllocationContext> >::const_iterator
+           it = signatureContexts.begin(),
+           ie = signatureContexts.end();
+       it != ie; ++it) {
+    if (!stateStore.find(*it))
+      return false;
+  }
+
+  if (signatureHistoricalVariables.empty())
+    return true;
+
+  const TxStore::LowerStateStore &__concretelyAddressedHistoricalStore =
+      stateStore.getConcretelyAddressedHistoricalStore();
+  const TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore =
+      stateStore.getSymbolicallyAddressedHistoricalStore();
+  for (std::vector<ref<TxVariable> >::const_iterator
+           it = signatureHistoricalVariables.begin(),
+           ie = signatureHistoricalVariables.end();
+       it != ie; ++it) {
+    if (__concretelyAddressedHistoricalStore.find(*it) ==
+            __concretelyAddressedHistoricalStore.end() &&
+        __symbolicallyAddressedHistoricalStore.find(*it) ==
+            __symbolicallyAddressedHistoricalStore.end())
+      return false;
+  }
+  return true;
+}
+
 ref<Expr> TxSubsumptionTableEntry::makeConstraint(
     ExecutionState &state, ref<TxInterpolantValue> tabledValue,
     ref<TxInterpolantValue> stateValue, ref<Expr> tabledOffset,
@@ -163,20 +624,7 @@ ref<Expr> TxSubsumptionTableEntry::makeConstraint(
 bool
 TxSubsumptionTableEntry::hasVariableInSet(std::set<const Array *> &existentials,
                                           ref<Expr> expr) {
-  for (int i = 0, numKids = expr->getNumKids(); i < numKids; ++i) {
-    if (llvm::isa<ReadExpr>(expr)) {
-      ReadExpr *readExpr = llvm::dyn_cast<ReadExpr>(expr);
-      const Array *array = (readExpr->updates).root;
-      for (std::set<const Array *>::const_iterator it = existentials.begin(),
-                                                   ie = existentials.end();
-           it != ie; ++it) {
-        if ((*it) == array)
-          return true;
-      }
-    } else if (hasVariableInSet(existentials, expr->getKid(i)))
-      return true;
-  }
-  return false;
+  return expr->readsArrayIn(existentials);
 }
 
 ref<Expr> TxSubsumptionTableEntry::getBoundFreeConjunction(
@@ -208,21 +656,7 @@ ref<Expr> TxSubsumptionTableEntry::getBoundFreeConjunction(
 
 bool TxSubsumptionTableEntry::hasVariableNotInSet(
     std::set<const Array *> &existentials, ref<Expr> expr) {
-  for (int i = 0, numKids = expr->getNumKids(); i < numKids; ++i) {
-    if (llvm::isa<ReadExpr>(expr)) {
-      ReadExpr *readExpr = llvm::dyn_cast<ReadExpr>(expr);
-      const Array *array = (readExpr->updates).root;
-      for (std::set<const Array *>::const_iterator it = existentials.begin(),
-                                                   ie = existentials.end();
-           it != ie; ++it) {
-        if ((*it) == array)
-          return false;
-      }
-      return true;
-    } else if (hasVariableNotInSet(existentials, expr->getKid(i)))
-      return true;
-  }
-  return false;
+  return expr->readsArrayNotIn(existentials);
 }
 
 ref<Expr>
@@ -408,37 +842,72 @@ TxSubsumptionTableEntry::simplifyArithmeticBody(ref<Expr> existsExpr,
   return existsExpr->rebuild(&newBody);
 }
 
-ref<Expr> TxSubsumptionTableEntry::replaceExpr(ref<Expr> originalExpr,
-                                               ref<Expr> replacedExpr,
-                                               ref<Expr> replacementExpr) {
-  // We only handle binary expressions
-  if (!llvm::isa<BinaryExpr>(originalExpr) ||
-      llvm::isa<ConcatExpr>(originalExpr))
-    return originalExpr;
+namespace {
+/// \brief Replacement of the operands of binary expressions equal to an
+/// expression, used by TxSubsumptionTableEntry::replaceExpr
+class TxOperandReplacer : public TxExprRewriter {
+  ref<Expr> replacedExpr;
+  ref<Expr> replacementExpr;
+
+  ref<Expr> rewriteNode(const ref<Expr> &originalExpr) {
+    // We only handle binary expressions
+    if (!llvm::isa<BinaryExpr>(originalExpr) ||
+        llvm::isa<ConcatExpr>(originalExpr))
+      return originalExpr;
 
-  if (originalExpr->getKid(0) == replacedExpr)
-    return TxShadowArray::createBinaryOfSameKind(originalExpr, replacementExpr,
-                                                 originalExpr->getKid(1));
+    if (originalExpr->getKid(0) == replacedExpr)
+      return TxShadowArray::createBinaryOfSameKind(
+          originalExpr, replacementExpr, originalExpr->getKid(1));
+
+    if (originalExpr->getKid(1) == replacedExpr)
+      return TxShadowArray::createBinaryOfSameKind(
+          originalExpr, originalExpr->getKid(0), replacementExpr);
 
-  if (originalExpr->getKid(1) == replacedExpr)
     return TxShadowArray::createBinaryOfSameKind(
-        originalExpr, originalExpr->getKid(0), replacementExpr);
+        originalExpr, rewrite(originalExpr->getKid(0)),
+        rewrite(originalExpr->getKid(1)));
+  }
+
+public:
+  TxOperandReplacer(ref<Expr> _replacedExpr, ref<Expr> _replacementExpr)
+      : replacedExpr(_replacedExpr), replacementExpr(_replacementExpr) {}
+};
+
+/// \brief Search of a subexpression within the first two kids of the
+/// expressions, used by TxSubsumptionTableEntry::hasSubExpression
+class TxSubExpressionFinder : public TxExprWalker {
+  ref<Expr> subExpr;
 
-  return TxShadowArray::createBinaryOfSameKind(
-      originalExpr,
-      replaceExpr(originalExpr->getKid(0), replacedExpr, replacementExpr),
-      replaceExpr(originalExpr->getKid(1), replacedExpr, replacementExpr));
+  bool visit(const ref<Expr> &e) {
+    if (e == subExpr) {
+      found = true;
+      return false;
+    }
+    if (e->getNumKids() >= 2) {
+      push(e->getKid(0));
+      push(e->getKid(1));
+    }
+    return true;
+  }
+
+public:
+  bool found;
+
+  TxSubExpressionFinder(ref<Expr> _subExpr) : subExpr(_subExpr), found(false) {}
+};
+}
+
+ref<Expr> TxSubsumptionTableEntry::replaceExpr(ref<Expr> originalExpr,
+                                               ref<Expr> replacedExpr,
+                                               ref<Expr> replacementExpr) {
+  return TxOperandReplacer(replacedExpr, replacementExpr).rewrite(originalExpr);
 }
 
 bool TxSubsumptionTableEntry::hasSubExpression(ref<Expr> expr,
                                                ref<Expr> subExpr) {
-  if (expr == subExpr)
-    return true;
-  if (expr->getNumKids() < 2 && expr != subExpr)
-    return false;
-
-  return hasSubExpression(expr->getKid(0), subExpr) ||
-         hasSubExpression(expr->getKid(1), subExpr);
+  TxSubExpressionFinder finder(subExpr);
+  finder.walk(expr);
+  return finder.found;
 }
 
 ref<Expr> TxSubsumptionTableEntry::simplifyInterpolantExpr(
@@ -568,93 +1037,6 @@ ref<Expr> TxSubsumptionTableEntry::simplifyEqualityExpr(
   assert(!"Invalid expression type.");
 }
 
-void
-TxSubsumptionTableEntry::getSubstitution(std::set<const Array *> &existentials,
-                                         ref<Expr> equalities,
-                                         std::map<ref<Expr>, ref<Expr> > &map) {
-  // It is assumed the rhs is an expression on the free variables.
-  if (llvm::isa<EqExpr>(equalities)) {
-    ref<Expr> lhs = equalities->getKid(0);
-    if (isVariable(lhs) && hasVariableInSet(existentials, lhs)) {
-      map[lhs] = equalities->getKid(1);
-    } else if (SExtExpr *lhsSExt = llvm::dyn_cast<SExtExpr>(lhs)) {
-      // Here we skin a sign-extend expression to retrieve the variable within
-      if (SExtExpr *rhsSExt = llvm::dyn_cast<SExtExpr>(equalities->getKid(1))) {
-        if (lhsSExt->getWidth() == rhsSExt->getWidth()) {
-          lhs = lhsSExt->getKid(0);
-          if (isVariable(lhs) && hasVariableInSet(existentials, lhs)) {
-            map[lhs] = rhsSExt->getKid(0);
-          }
-        }
-      }
-    } else if (ZExtExpr *lhsZExt = llvm::dyn_cast<ZExtExpr>(lhs)) {
-      // Here we skin a zero-extend expression to retrieve the variable within
-      if (ZExtExpr *rhsZExt = llvm::dyn_cast<ZExtExpr>(equalities->getKid(1))) {
-        if (lhsZExt->getWidth() == rhsZExt->getWidth()) {
-          lhs = lhsZExt->getKid(0);
-          if (isVariable(lhs) && hasVariableInSet(existentials, lhs)) {
-            map[lhs] = rhsZExt->getKid(0);
-          }
-        }
-      }
-    }
-  } else if (llvm::isa<AndExpr>(equalities)) {
-    getSubstitution(existentials, equalities->getKid(0), map);
-    getSubstitution(existentials, equalities->getKid(1), map);
-  }
-}
-
-ref<Expr>
-TxSubsumptionTableEntry::removeUnsubstituted(std::set<const Array *> &variables,
-                                             ref<Expr> equalities) {
-  // It is assumed the lhs is an expression on the existentially-quantified
-  // variable whereas the rhs is an expression on the free variables.
-  if (llvm::isa<EqExpr>(equalities)) {
-    ref<Expr> lhs = equalities->getKid(0);
-    if (isVariable(lhs) && hasVariableInSet(variables, lhs)) {
-      return ConstantExpr::create(1, Expr::Bool);
-    } else if (SExtExpr *lhsSExt = llvm::dyn_cast<SExtExpr>(lhs)) {
-      // Here we skin a sign-extend expression to retrieve the variable within
-      if (SExtExpr *rhsSExt = llvm::dyn_cast<SExtExpr>(equalities->getKid(1))) {
-        if (lhsSExt->getWidth() == rhsSExt->getWidth()) {
-          lhs = lhsSExt->getKid(0);
-          if (isVariable(lhs) && hasVariableInSet(variables, lhs)) {
-            return ConstantExpr::create(1, Expr::Bool);
-          }
-        }
-      }
-    } else if (ZExtExpr *lhsZExt = llvm::dyn_cast<ZExtExpr>(lhs)) {
-      // Here we skin a zero-extend expression to retrieve the variable within
-      if (ZExtExpr *rhsZExt = llvm::dyn_cast<ZExtExpr>(equalities->getKid(1))) {
-        if (lhsZExt->getWidth() == rhsZExt->getWidth()) {
-          lhs = lhsZExt->getKid(0);
-          if (isVariable(lhs) && hasVariableInSet(variables, lhs)) {
-            return ConstantExpr::create(1, Expr::Bool);
-          }
-        }
-      }
-    }
-    return equalities;
-  }
-
-  if (llvm::isa<AndExpr>(equalities)) {
-    ref<Expr> lhs = removeUnsubstituted(variables, equalities->getKid(0));
-    ref<Expr> rhs = removeUnsubstituted(variables, equalities->getKid(1));
-    if (lhs->isTrue()) {
-      if (rhs->isTrue()) {
-        return ConstantExpr::create(1, Expr::Bool);
-      }
-      return rhs;
-    } else {
-      if (rhs->isTrue()) {
-        return lhs;
-      }
-      return AndExpr::create(lhs, rhs);
-    }
-  }
-  return equalities;
-}
-
 bool TxSubsumptionTableEntry::detectConflictPrimitives(ExecutionState &state,
                                                        ref<Expr> expr) {
   if (llvm::isa<ExistsExpr>(expr))
@@ -726,34 +1108,7 @@ TxSubsumptionTableEntry::simplifyExistsExpr(ref<Expr> existsExpr,
   assert(llvm::isa<ExistsExpr>(existsExpr));
 
   ExistsExpr *expr = llvm::dyn_cast<ExistsExpr>(existsExpr);
-  ref<Expr> body = expr->body;
-
-  assert(llvm::isa<AndExpr>(body));
-
-  std::map<ref<Expr>, ref<Expr> > substitution;
-  ref<Expr> equalities = body->getKid(1);
-  getSubstitution(expr->variables, equalities, substitution);
-
-  ref<Expr> interpolant =
-      TxSubstitutionVisitor(substitution).visit(body->getKid(0));
-
-  if (hasVariableInSet(expr->variables, equalities)) {
-    // we could also replace the occurrence of some variables with its
-    // corresponding substitution mapping.
-    equalities = TxSubstitutionVisitor(substitution).visit(equalities);
-    equalities = removeUnsubstituted(expr->variables, equalities);
-  }
-
-  ref<Expr> newBody = AndExpr::create(interpolant, equalities);
-
-  // FIXME: Need to test the performance of the following.
-  if (!hasVariableInSet(expr->variables, newBody))
-    return newBody;
-
-  // ref<Expr> ret =
-  // simplifyArithmeticBody(existsExpr->rebuild(&newBody),hasExistentialsOnly);
-  ref<Expr> ret = existsExpr->rebuild(&newBody);
-  return ret;
+  return TxExistentialElimination(expr->variables).eliminate(existsExpr);
 }
 
 void TxSubsumptionTableEntry::interpolateValues(
@@ -761,25 +1116,9 @@ void TxSubsumptionTableEntry::interpolateValues(
     std::map<ref<TxStateValue>, std::set<uint64_t> > &corePointerValues,
     int debugSubsumptionLevel) {
 setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
-  std::string reason = "";
-  if (debugSubsumptionLevel >= 1) {
-    llvm::raw_string_ostream stream(reason);
-    llvm::Instruction *instr = state.pc->inst;
-    stream << "subsumption at ";
-    if (instr->getParent()->getParent()) {
-      std::string functionName(
-          instr->getParent()->getParent()->getName().str());
-      stream << functionName << ": ";
-      if (llvm::MDNode *n = instr->getMetadata("dbg")) {
-        llvm::DILocation loc(n);
-        stream << "Line " << loc.getLineNumber();
-      } else {
-        instr->print(stream);
-      }
-    } else {
-      instr->print(stream);
-    }
-  }
+  TxMarkReason reason;
+  if (debugSubsumptionLevel >= 1)
+    reason = TxMarkReason(TxMarkReason::Subsumption, state.pc->inst);
 
   for (std::set<ref<TxStateValue> >::iterator it = coreValues.begin(),
                                               ie = coreValues.end();
@@ -789,7 +1128,9 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
 
 #ifdef ENABLE_Z3
   if (TxDependency::boundInterpolation() && !ExactAddressInterpolant) {
-    reason = "interpolating memory bound for " + reason;
+    // Reasons are only recorded for debugging
+    if (debugSubsumptionLevel >= 1)
+      reason = TxMarkReason(TxMarkReason::SubsumptionBound, state.pc->inst);
 
     for (std::map<ref<TxStateValue>, std::set<uint64_t> >::iterator
              it = corePointerValues.begin(),
@@ -803,60 +1144,236 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
 #endif
 }
 
-bool TxSubsumptionTableEntry::subsumed(
-    TimingSolver *solver, ExecutionState &state, double timeout,
-    bool leftRetrieval, TxStore::TopStateStore &__internalStore,
-    TxStore::LowerStateStore &__concretelyAddressedHistoricalStore,
-    TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore,
-    int debugSubsumptionLevel) {
-setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
-#ifdef ENABLE_Z3
+static bool compareExprHash(const ref<Expr> &a, const ref<Expr> &b) {
+  return a->hash() < b->hash();
+}
 
-  if (MarkGlobal) {
-    // Global check
-    bool globalSat = true;
-    for (std::set<ref<TxStoreEntry> >::iterator it = markedGlobal.begin(),
-                                                ie = markedGlobal.end();
-         it != ie; ++it) {
-      if ((*it)->getValue()->getType()->isPointerTy() ||
-          (*it)->getValue()->getType()->getTypeID() == 0) {
-        continue;
-      }
+void TxSubsumptionTableEntry::computeQueryKey(ExecutionState &state,
+                                              PendingCheck &pending) {
+  // The constraints are sorted such that the key does not depend on the order
+  // in which they were added to the path condition
+  pending.sortedConstraints.assign(state.constraints.begin(),
+                                   state.constraints.end());
+  std::stable_sort(pending.sortedConstraints.begin(),
+                   pending.sortedConstraints.end(), compareExprHash);
+
+  uint64_t hash = pending.expr->hash();
+  for (std::vector<ref<Expr> >::const_iterator
+           it = pending.sortedConstraints.begin(),
+           ie = pending.sortedConstraints.end();
+       it != ie; ++it) {
+    hash = hash * 1000003 + (*it)->hash();
+  }
+  pending.queryHash = hash;
+}
 
-      ref<Expr> addr = (*it)->getAddress()->getAddress();
-      ref<Expr> offset = (*it)->getAddress()->getOffset();
-      unsigned type = (*it)->getAddress()->getSize();
-      ObjectPair initOp;
-      bool initResolve = TxTree::initialStateCopy->addressSpace.resolveOne(
-          cast<klee::ConstantExpr>(addr), initOp);
+const TxSubsumptionTableEntry::CachedQuery *
+TxSubsumptionTableEntry::findQueryResult(const PendingCheck &pending) const {
+  typedef std::multimap<uint64_t, CachedQuery>::const_iterator Iterator;
+  std::pair<Iterator, Iterator> range =
+      queryCache.equal_range(pending.queryHash);
+  for (Iterator it = range.first; it != range.second; ++it) {
+    if (it->second.expr == pending.expr &&
+        it->second.sortedConstraints == pending.sortedConstraints)
+      return &it->second;
+  }
+  return 0;
+}
 
-      ObjectPair currentOp;
-      bool currentResolve = state.addressSpace.resolveOne(
-          cast<klee::ConstantExpr>(addr), currentOp);
+void TxSubsumptionTableEntry::storeQueryResult(
+    const PendingCheck &pending, bool valid,
+    const std::vector<ref<Expr> > &unsatCore) {
+  if (!SubsumptionQueryCacheSize || pending.expr.isNull())
+    return;
+  if (queryCache.size() >= SubsumptionQueryCacheSize)
+    queryCache.clear();
+  CachedQuery &cached =
+      queryCache.insert(std::make_pair(pending.queryHash, CachedQuery()))
+          ->second;
+  cached.expr = pending.expr;
+  cached.sortedConstraints = pending.sortedConstraints;
+  cached.valid = valid;
+  cached.unsatCore = unsatCore;
+}
 
-      if (!initResolve || !currentResolve) {
-        globalSat = false;
-        break;
-      } else {
-        const ObjectState *initOs = initOp.second;
-        ref<Expr> initValue = initOs->read(offset, type * 8);
-        const ObjectState *currentOs = currentOp.second;
-        ref<Expr> currentValue = currentOs->read(offset, type * 8);
-
-        if (initValue != currentValue) {
-          globalSat = false;
-          break;
-        }
-      }
-    }
+bool TxSubsumptionTableEntry::isRefutedByModel(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    TxStateStoreView &stateStore, PendingCheck &pending,
+    int debugSubsumptionLevel) {
+  // The bound variables of an existential query are not in the model
+  if (!SubsumptionModelRefutation || pending.existential)
+    return false;
+  const Assignment *model = stateStore.getModel(solver, state, timeout);
+  if (!model)
+    return false;
 
-    if (!globalSat) {
-      if (debugSubsumptionLevel >= 1) {
-        klee_message("#%lu=>#%lu: Global check fail",
-                     state.txTreeNode->getNodeSequenceNumber(),
-                     nodeSequenceNumber);
-      }
-      return false;
+  // The arrays not in the path condition are left free, so that a false
+  // evaluation holds for any value of them. The path condition then does not
+  // imply the query expression.
+  ref<Expr> value = const_cast<Assignment *>(model)->evaluate(pending.expr);
+  if (!value->isFalse())
+    return false;
+
+  ++modelRefutationCount;
+  storeQueryResult(pending, false, std::vector<ref<Expr> >());
+  if (debugSubsumptionLevel >= 1) {
+    klee_message("#%lu=>#%lu: Check failure as a solution of the path "
+                 "condition falsifies the query expression",
+                 state.txTreeNode->getNodeSequenceNumber(), nodeSequenceNumber);
+  }
+  return true;
+}
+
+TxSubsumptionTableEntry::CheckStatus
+TxSubsumptionTableEntry::prepareSubsumption(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    TxStateStoreView &stateStore, PendingCheck &pending,
+    int debugSubsumptionLevel) {
+  CheckStatus status = buildSubsumptionQuery(
+      solver, state, timeout, stateStore, pending, debugSubsumptionLevel);
+  if (status != CheckPending)
+    return status;
+
+  // A state with the same query expression and path condition as an earlier
+  // one gets the same solver result
+  const CachedQuery *cached = 0;
+  if (SubsumptionQueryCacheSize) {
+    computeQueryKey(state, pending);
+    cached = findQueryResult(pending);
+  }
+  if (!cached)
+    return isRefutedByModel(solver, state, timeout, stateStore, pending,
+                            debugSubsumptionLevel)
+               ? CheckFailure
+               : CheckPending;
+
+  ++queryCacheHitCount;
+  if (!cached->valid) {
+    if (debugSubsumptionLevel >= 1) {
+      klee_message("#%lu=>#%lu: Check failure as cached query expression not "
+                   "true",
+                   state.txTreeNode->getNodeSequenceNumber(),
+                   nodeSequenceNumber);
+    }
+    return CheckFailure;
+  }
+  completeSubsumption(state, pending, cached->unsatCore,
+                      debugSubsumptionLevel);
+  return CheckSuccess;
+}
+
+bool TxSubsumptionTableEntry::decidePartitioned(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    ref<Expr> expr, bool &success, Solver::Validity &result,
+    std::vector<ref<Expr> > &unsatCore) {
+  std::vector<ref<Expr> > conjuncts =
+      TxPartitionHelper::getExprsFromAndExpr(expr);
+  if (conjuncts.size() < 2)
+    return false;
+
+  // A conjunct joins the groups with which it shares a variable
+  std::vector<std::set<std::string> > groupVars;
+  std::vector<std::vector<ref<Expr> > > groupConjuncts;
+  for (std::vector<ref<Expr> >::iterator it = conjuncts.begin(),
+                                         ie = conjuncts.end();
+       it != ie; ++it) {
+    std::set<std::string> vars = TxPartitionHelper::getExprVars(*it);
+    std::vector<ref<Expr> > members(1, *it);
+    for (unsigned g = 0; g < groupVars.size();) {
+      if (!TxPartitionHelper::isShared(vars, groupVars[g])) {
+        ++g;
+        continue;
+      }
+      vars.insert(groupVars[g].begin(), groupVars[g].end());
+      members.insert(members.end(), groupConjuncts[g].begin(),
+                     groupConjuncts[g].end());
+      groupVars.erase(groupVars.begin() + g);
+      groupConjuncts.erase(groupConjuncts.begin() + g);
+    }
+    groupVars.push_back(vars);
+    groupConjuncts.push_back(members);
+  }
+  if (groupConjuncts.size() < 2)
+    return false;
+
+  // The path condition implies the query expression when it implies each of
+  // the groups, and the solver only considers the constraints that share
+  // variables with a group
+  uint64_t node = state.txTreeNode->getNodeSequenceNumber();
+  if (node != groupCacheNode ||
+      state.constraints.size() != groupCacheConstraints) {
+    groupCache.clear();
+    groupCacheNode = node;
+    groupCacheConstraints = state.constraints.size();
+  }
+
+  std::vector<ref<Expr> > groups;
+  for (unsigned g = 0; g < groupConjuncts.size(); ++g)
+    groups.push_back(TxPartitionHelper::createAnd(groupConjuncts[g]));
+
+  // A group known to be invalid fails the check without any query
+  success = true;
+  for (std::vector<ref<Expr> >::iterator it = groups.begin(),
+                                         ie = groups.end();
+       it != ie; ++it) {
+    std::map<ref<Expr>, GroupResult>::iterator cached = groupCache.find(*it);
+    if (cached != groupCache.end() && !cached->second.valid) {
+      ++groupCacheHitCount;
+      result = Solver::Unknown;
+      return true;
+    }
+  }
+
+  unsatCore.clear();
+  for (std::vector<ref<Expr> >::iterator it = groups.begin(),
+                                         ie = groups.end();
+       it != ie; ++it) {
+    std::map<ref<Expr>, GroupResult>::iterator cached = groupCache.find(*it);
+    if (cached != groupCache.end()) {
+      ++groupCacheHitCount;
+      unsatCore.insert(unsatCore.end(), cached->second.unsatCore.begin(),
+                       cached->second.unsatCore.end());
+      continue;
+    }
+
+    Solver::Validity groupResult;
+    std::vector<ref<Expr> > groupCore;
+    solver->setTimeout(timeout);
+    success = solver->evaluate(state, *it, groupResult, groupCore);
+    solver->setTimeout(0);
+    if (!success)
+      return true;
+
+    GroupResult &stored = groupCache[*it];
+    stored.valid = groupResult == Solver::True;
+    stored.unsatCore = groupCore;
+    if (groupResult != Solver::True) {
+      result = groupResult;
+      return true;
+    }
+    unsatCore.insert(unsatCore.end(), groupCore.begin(), groupCore.end());
+  }
+  result = Solver::True;
+  return true;
+}
+
+TxSubsumptionTableEntry::CheckStatus
+TxSubsumptionTableEntry::buildSubsumptionQuery(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    TxStateStoreView &stateStore, PendingCheck &pending,
+    int debugSubsumptionLevel) {
+setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
+#ifdef ENABLE_Z3
+
+  if (MarkGlobal) {
+    // Global check
+    if (!checkGlobals(state)) {
+      if (debugSubsumptionLevel >= 1) {
+        klee_message("#%lu=>#%lu: Global check fail",
+                     state.txTreeNode->getNodeSequenceNumber(),
+                     nodeSequenceNumber);
+      }
+      return CheckFailure;
     } else {
       if (debugSubsumptionLevel >= 1) {
         klee_message("#%lu=>#%lu: Global check success",
@@ -868,37 +1385,30 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
 
   // WP interpolant check
   if (WPInterpolant && !wpInterpolant.isNull()) {
-    // Checking if weakest pre-condition holds. In case WPInterpolant
-    // flag is set, this serves as the first check when subsuming a node.
-    // If it fails then false is returned. If it succeeds then the
-    // second check is performed.
+    // The weakest precondition has to hold for the subsumption. Unless it is
+    // constant, it is not decided here but conjoined with the query
+    // expression, so that both are decided by one solver call, and not at
+    // all when a later check fails without the solver.
     ref<Expr> wpInstantiatedInterpolant =
         state.txTreeNode->instantiateWPatSubsumption(
             wpInterpolant, state.txTreeNode->getDependency());
 
     if (wpInstantiatedInterpolant.isNull())
-      return false;
+      return CheckFailure;
 
     ref<Expr> wpBoolean =
         ZExtExpr::create(wpInstantiatedInterpolant, Expr::Bool);
 
-    Solver::Validity result;
-    std::vector<ref<Expr> > unsatCore;
-    bool success = solver->evaluate(state, wpBoolean, result, unsatCore);
-
-    if (!success || result != Solver::True) {
+    if (wpBoolean->isFalse()) {
       if (debugSubsumptionLevel >= 1) {
         klee_message("#%lu=>#%lu: Check failure at WP Expr check ",
                      state.txTreeNode->getNodeSequenceNumber(),
                      nodeSequenceNumber);
       }
-      return false;
-    }
-    if (debugSubsumptionLevel >= 1) {
-      klee_message("#%lu=>#%lu: Weakest precondition check success",
-                   state.txTreeNode->getNodeSequenceNumber(),
-                   nodeSequenceNumber);
+      return CheckFailure;
     }
+    if (!wpBoolean->isTrue())
+      pending.wpCondition = wpBoolean;
   }
 
   // PhiNode Check 1 (checking previous BB is the same at subsumption point)
@@ -914,91 +1424,64 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                    state.txTreeNode->getNodeSequenceNumber(),
                    nodeSequenceNumber);
     }
-    return false;
+    return CheckFailure;
   }
 
   // PhiNode Check 2 (checking the value of phi instructions at subsumption
-  // point)
-  for (std::map<llvm::Value *, std::vector<ref<Expr> > >::const_iterator it =
-           phiValues.begin();
-       it != phiValues.end(); ++it) {
-    if (isa<llvm::PHINode>((*it).first)) {
-      llvm::Instruction *phi = dyn_cast<llvm::Instruction>((*it).first);
-      std::vector<ref<Expr> > values = (*it).second;
-      if (values.empty())
-        continue;
-#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
-      llvm::Value *inputArg = phi->getOperand(state.incomingBBIndex);
-#else
-      llvm::Value *inputArg = phi->getOperand(state.incomingBBIndex * 2);
-#endif
+  // point). When both sides have a value in every slot, differing
+  // fingerprints tell the values apart without comparing them.
+  if (!phiValues.empty()) {
+    if (!state.txTreeNode->getParent() ||
+        !state.txTreeNode->getParent()->getDependency()) {
+      if (debugSubsumptionLevel >= 1) {
+        klee_message("#%lu=>#%lu: Check failure as in PHInode: parent node "
+                     "doen't exist. Failing conservatively. ",
+                     state.txTreeNode->getNodeSequenceNumber(),
+                     nodeSequenceNumber);
+      }
+      return CheckFailure;
+    }
 
-      if (state.txTreeNode->getParent() &&
-          state.txTreeNode->getParent()->getDependency()) {
-        std::map<llvm::Value *, std::vector<ref<TxStateValue> > > valuesMap =
-            state.txTreeNode->getParent()->getDependency()->getvaluesMap();
-        std::vector<ref<TxStateValue> > txStateVal =
-            valuesMap[dyn_cast<llvm::Value>(inputArg)];
-        if (txStateVal.empty()) {
+    const TxPhiValues &incomingPhiValues =
+        stateStore.getIncomingPhiValues(state);
+    bool mismatch = false;
+    if (phiValues.size() == incomingPhiValues.size() &&
+        phiValues.isComplete() && incomingPhiValues.isComplete() &&
+        phiValues.getFingerprint() != incomingPhiValues.getFingerprint()) {
+      mismatch = true;
+    } else {
+      for (unsigned i = 0, n = phiValues.size(); i < n && !mismatch; ++i) {
+        ref<Expr> value = phiValues[i];
+        if (value.isNull())
+          continue;
+        ref<Expr> incomingValue = incomingPhiValues[i];
+        if (incomingValue.isNull()) {
           if (debugSubsumptionLevel >= 1) {
-            std::string msg;
-            std::string padding(makeTabs(1));
-            llvm::raw_string_ostream stream(msg);
-            stream.flush();
             klee_message(
                 "#%lu=>#%lu: Check failure as in PHInode: txStateVal is "
                 "empty. Failing conservatively. ",
                 state.txTreeNode->getNodeSequenceNumber(), nodeSequenceNumber);
           }
-          return false;
-        }
-        if (txStateVal.back()->getExpression().compare(values.back()) != 0) {
-          if (debugSubsumptionLevel >= 1) {
-            std::string msg;
-            std::string padding(makeTabs(1));
-            llvm::raw_string_ostream stream(msg);
-            stream.flush();
-            klee_message("#%lu=>#%lu: Check failure as in PHInode: phi values "
-                         "don't match ",
-                         state.txTreeNode->getNodeSequenceNumber(),
-                         nodeSequenceNumber);
-          }
-          return false;
-        }
-      } else {
-        if (debugSubsumptionLevel >= 1) {
-          std::string msg;
-          std::string padding(makeTabs(1));
-          llvm::raw_string_ostream stream(msg);
-          stream.flush();
-          klee_message("#%lu=>#%lu: Check failure as in PHInode: parent node "
-                       "doen't exist. Failing conservatively. ",
-                       state.txTreeNode->getNodeSequenceNumber(),
-                       nodeSequenceNumber);
+          return CheckFailure;
         }
-        return false;
+        mismatch = incomingValue.compare(value) != 0;
       }
-    } else {
+    }
+    if (mismatch) {
       if (debugSubsumptionLevel >= 1) {
-        std::string msg;
-        std::string padding(makeTabs(1));
-        llvm::raw_string_ostream stream(msg);
-        stream.flush();
-        klee_message(
-            "#%lu=>#%lu: Check failure as this part of PHInode check is not "
-            "implemented yet. Failing conservatively. ",
-            state.txTreeNode->getNodeSequenceNumber(), nodeSequenceNumber);
+        klee_message("#%lu=>#%lu: Check failure as in PHInode: phi values "
+                     "don't match ",
+                     state.txTreeNode->getNodeSequenceNumber(),
+                     nodeSequenceNumber);
       }
-      return false;
+      return CheckFailure;
     }
   }
 
-  // Tell the solver implementation that we are checking for subsumption for
-  // collecting statistics of solver calls.
-  SubsumptionCheckMarker subsumptionCheckMarker;
-
   // Quick check for subsumption in case the interpolant is empty
   if (empty()) {
+    if (!pending.wpCondition.isNull())
+      return checkWPConditionOnly(pending);
     if (debugSubsumptionLevel >= 1) {
       klee_message("#%lu=>#%lu: Check success due to empty table entry",
                    state.txTreeNode->getNodeSequenceNumber(),
@@ -1010,24 +1493,34 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
       // This is crucial for generating WP Expr at the parent node.
       state.txTreeNode->setWPatSubsumption(wpInterpolant);
     }
-    return true;
+    return CheckSuccess;
   }
 
   ref<Expr> stateEqualityConstraints;
 
+  // The stores of the state are only retrieved here, past the checks that
+  // fail without them
+  const TxStore::TopStateStore &__internalStore =
+      stateStore.getInternalStore();
+  const TxStore::LowerStateStore &__concretelyAddressedHistoricalStore =
+      stateStore.getConcretelyAddressedHistoricalStore();
+  const TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore =
+      stateStore.getSymbolicallyAddressedHistoricalStore();
+
   // Translation of allocation in the current state into an allocation in the
   // tabled interpolant. This translation is used to equate absolute address
   // values for allocations of matching sizes.
   std::map<ref<TxAllocationInfo>, ref<TxAllocationInfo> > unifiedBases;
 
   // Non-pointer / exact pointer values to be marked as in the interpolant
-  std::set<ref<TxStateValue> > coreValues;
+  std::set<ref<TxStateValue> > &coreValues = pending.coreValues;
 
   // Pointer values in the core for memory bounds interpolation.
-  std::map<ref<TxStateValue>, std::set<uint64_t> > corePointerValues;
+  std::map<ref<TxStateValue>, std::set<uint64_t> > &corePointerValues =
+      pending.corePointerValues;
 
   {
-    TimerStatIncrementer t(concretelyAddressedStoreExpressionBuildTime);
+    TxTimerStatIncrementer t(concretelyAddressedStoreExpressionBuildTime);
 
     // Build constraints from concrete-address interpolant store
     for (TxStore::TopInterpolantStore::const_iterator
@@ -1037,7 +1530,8 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
       assert(!it1->second.empty() && "empty table entry with real index");
 
       const TxStore::LowerInterpolantStore &tabledConcreteMap = it1->second;
-      TxStore::TopStateStore::iterator mIt = __internalStore.find(it1->first);
+      TxStore::TopStateStore::const_iterator mIt =
+          __internalStore.find(it1->first);
       if (mIt == __internalStore.end()) {
         if (debugSubsumptionLevel >= 1) {
           std::string msg;
@@ -1050,10 +1544,10 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                        state.txTreeNode->getNodeSequenceNumber(),
                        nodeSequenceNumber, msg.c_str());
         }
-        return false;
+        return CheckFailure;
       }
 
-      TxStore::MiddleStateStore &m = mIt->second;
+      const TxStore::MiddleStateStore &m = mIt->second;
 
       for (TxStore::LowerInterpolantStore::const_iterator
                it2 = tabledConcreteMap.begin(),
@@ -1077,7 +1571,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                          state.txTreeNode->getNodeSequenceNumber(),
                          nodeSequenceNumber, msg.c_str());
           }
-          return false;
+          return CheckFailure;
         } else {
           bool leftUse =
               state.txTreeNode->getStore()->isInLeftSubtree(e->getDepth());
@@ -1100,7 +1594,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                            state.txTreeNode->getNodeSequenceNumber(),
                            nodeSequenceNumber, msg.c_str());
             }
-            return false;
+            return CheckFailure;
           } else if (TxDependency::boundInterpolation() &&
                      tabledValue->isPointer() && stateValue->isPointer()) {
             ref<Expr> boundsCheck;
@@ -1117,7 +1611,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                                  state.txTreeNode->getNodeSequenceNumber(),
                                  nodeSequenceNumber, msg.c_str());
                   }
-                  return false;
+                  return CheckFailure;
                 }
                 if (!boundsCheck->isTrue())
                   res = boundsCheck;
@@ -1139,7 +1633,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                                state.txTreeNode->getNodeSequenceNumber(),
                                nodeSequenceNumber, msg.c_str());
                 }
-                return false;
+                return CheckFailure;
               }
               if (!offsetsCheck->isTrue())
                 res = offsetsCheck;
@@ -1181,7 +1675,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                                msg.c_str());
                 }
               }
-              return false;
+              return CheckFailure;
             } else if (res->isTrue()) {
               if (debugSubsumptionLevel >= 1) {
                 if (debugSubsumptionLevel >= 2) {
@@ -1232,7 +1726,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                 unifiedBases, debugSubsumptionLevel);
 
             if (constraint.isNull())
-              return false;
+              return CheckFailure;
 
             if (!conjunction.isNull()) {
               conjunction = AndExpr::create(constraint, conjunction);
@@ -1282,7 +1776,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
               e->getAddress()->getOffset(), coreValues, corePointerValues,
               unifiedBases, debugSubsumptionLevel);
           if (constraint.isNull())
-            return false;
+            return CheckFailure;
           if (stateEqualityConstraints.isNull()) {
             stateEqualityConstraints = constraint;
           } else {
@@ -1291,7 +1785,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
           }
         } else {
           // Match not found
-          return false;
+          return CheckFailure;
         }
       } else {
         ref<TxStoreEntry> e = mIt->second;
@@ -1304,7 +1798,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
             e->getAddress()->getOffset(), coreValues, corePointerValues,
             unifiedBases, debugSubsumptionLevel);
         if (constraint.isNull())
-          return false;
+          return CheckFailure;
         if (stateEqualityConstraints.isNull()) {
           stateEqualityConstraints = constraint;
         } else {
@@ -1323,7 +1817,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
   }
 
   {
-    TimerStatIncrementer t(symbolicallyAddressedStoreExpressionBuildTime);
+    TxTimerStatIncrementer t(symbolicallyAddressedStoreExpressionBuildTime);
     // Build constraints from symbolic-address interpolant store
     for (TxStore::TopInterpolantStore::const_iterator
              it1 = symbolicallyAddressedStore.begin(),
@@ -1332,7 +1826,8 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
       assert(!it1->second.empty() && "empty table entry with real index");
 
       const TxStore::LowerInterpolantStore &tabledSymbolicMap = it1->second;
-      TxStore::TopStateStore::iterator mIt = __internalStore.find(it1->first);
+      TxStore::TopStateStore::const_iterator mIt =
+          __internalStore.find(it1->first);
       if (mIt == __internalStore.end()) {
         if (debugSubsumptionLevel >= 1) {
           std::string msg;
@@ -1345,10 +1840,10 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                        state.txTreeNode->getNodeSequenceNumber(),
                        nodeSequenceNumber, msg.c_str());
         }
-        return false;
+        return CheckFailure;
       }
 
-      TxStore::MiddleStateStore &m = mIt->second;
+      const TxStore::MiddleStateStore &m = mIt->second;
 
       ref<Expr> conjunction;
 
@@ -1373,7 +1868,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                 unifiedBases, debugSubsumptionLevel);
 
             if (constraint.isNull())
-              return false;
+              return CheckFailure;
 
             if (!constraint.isNull()) {
               if (!conjunction.isNull()) {
@@ -1401,7 +1896,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                 unifiedBases, debugSubsumptionLevel);
 
             if (constraint.isNull())
-              return false;
+              return CheckFailure;
 
             if (!conjunction.isNull()) {
               conjunction = AndExpr::create(constraint, conjunction);
@@ -1445,7 +1940,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
               e->getAddress()->getOffset(), coreValues, corePointerValues,
               unifiedBases, debugSubsumptionLevel);
           if (constraint.isNull())
-            return false;
+            return CheckFailure;
           if (stateEqualityConstraints.isNull()) {
             stateEqualityConstraints = constraint;
           } else {
@@ -1454,7 +1949,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
           }
         } else {
           // Match not found
-          return false;
+          return CheckFailure;
         }
       } else {
         ref<TxStoreEntry> e = mIt->second;
@@ -1467,7 +1962,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
             e->getAddress()->getOffset(), coreValues, corePointerValues,
             unifiedBases, debugSubsumptionLevel);
         if (constraint.isNull())
-          return false;
+          return CheckFailure;
         if (stateEqualityConstraints.isNull()) {
           stateEqualityConstraints = constraint;
         } else {
@@ -1478,11 +1973,10 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
     }
   }
 
-  Solver::Validity result;
-  ref<Expr> expr; // The query expression
+  ref<Expr> &expr = pending.expr; // The query expression
 
   {
-    TimerStatIncrementer t(solverAccessTime);
+    TxTimerStatIncrementer t(solverAccessTime);
 
     // Here we build the query expression, after which it is always a
     // conjunction of the interpolant and the state equality constraints. Here
@@ -1500,6 +1994,8 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
     } else {
       // Here both the interpolant constraints and state equality
       // constraints are empty, therefore everything gets subsumed
+      if (!pending.wpCondition.isNull())
+        return checkWPConditionOnly(pending);
       if (debugSubsumptionLevel >= 1) {
         std::string msg = "";
         if (!corePointerValues.empty()) {
@@ -1517,7 +2013,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
         // This is crucial for generating WP Expr at the parent node.
         state.txTreeNode->setWPatSubsumption(wpInterpolant);
       }
-      return true;
+      return CheckSuccess;
     }
 
     bool exprHasNoFreeVariables = false;
@@ -1544,22 +2040,18 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                      state.txTreeNode->getNodeSequenceNumber(),
                      nodeSequenceNumber);
       }
-      return false;
+      return CheckFailure;
     }
 
-    bool success = false;
-
     if (!detectConflictPrimitives(state, expr)) {
       if (debugSubsumptionLevel >= 1) {
         klee_message(
             "#%lu=>#%lu: Check failure as contradictory equalities detected",
             state.txTreeNode->getNodeSequenceNumber(), nodeSequenceNumber);
       }
-      return false;
+      return CheckFailure;
     }
 
-    std::vector<ref<Expr> > unsatCore;
-
     // We call the solver only when the simplified query expression is not a
     // constant and no contradictory unary constraints found from
     // solvingUnaryConstraints method.
@@ -1574,6 +2066,8 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
           // check succeeds, as the tabled interpolant with
           // existentially-quantified variables was constructed from satisfiable
           // path.
+          if (!pending.wpCondition.isNull())
+            return checkWPConditionOnly(pending);
 
           if (debugSubsumptionLevel >= 1) {
             std::string msg = "";
@@ -1590,7 +2084,7 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
             // node. This is crucial for generating WP Expr at the parent node.
             state.txTreeNode->setWPatSubsumption(wpInterpolant);
           }
-          return true;
+          return CheckSuccess;
         } else {
           // Here we try to get bound-variables-free conjunction, if there is
           // no constraint with both bound and non-bound variables
@@ -1609,40 +2103,10 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                              state.constraints, expr,debugSubsumptionLevel).c_str()); /*Added 'debugSubsumptionLevel' variable in 'constructQuery' function for Pretty Print*/
           }
 
-          if (llvm::isa<ExistsExpr>(expr)) {
-            // We instantiate a new Z3 solver to make sure that we use Z3
-            // without pre-solving optimizations. It would be nice in the future
-            // to just run solver->evaluate so that the optimizations can be
-            // used, but this requires handling of quantified expressions by
-            // KLEE's pre-solving procedure, which does not exist currently.
-            Z3Solver *z3solver = new Z3Solver();
-            z3solver->setCoreSolverTimeout(timeout);
-            success = z3solver->directComputeValidity(
-                Query(state.constraints, expr), result, unsatCore);
-            z3solver->setCoreSolverTimeout(0);
-            delete z3solver;
-          } else {
-            solver->setTimeout(timeout);
-            success = solver->evaluate(state, expr, result, unsatCore);
-            solver->setTimeout(0);
-          }
-
-          if (!success) {
-            if (debugSubsumptionLevel >= 1) {
-              klee_message("#%lu=>#%lu: Check failure as solver existentially-quantified query not success",
-                           state.txTreeNode->getNodeSequenceNumber(),
-                           nodeSequenceNumber);
-            }
-            return false;
-          }
-          else if (result != Solver::True) {
-            if (debugSubsumptionLevel >= 1) {
-              klee_message("#%lu=>#%lu: Check failure as existentially-quantified query expression not true",
-                           state.txTreeNode->getNodeSequenceNumber(),
-                           nodeSequenceNumber);
-            }
-            return false;
-          }
+          // The solver is called by the caller
+          pending.existential = true;
+          addWPCondition(pending);
+          return CheckPending;
         }
 
       } else {
@@ -1651,32 +2115,16 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
                        TxPrettyExpressionBuilder::constructQuery(
                            state.constraints, expr, debugSubsumptionLevel).c_str());/*Added 'debugSubsumptionLevel' variable in 'constructQuery' function for Pretty Print*/
         }
-        // We call the solver in the standard way if the
-        // formula is unquantified.
-        solver->setTimeout(timeout);
-        success = solver->evaluate(state, expr, result, unsatCore);
-        solver->setTimeout(0);
-
-        if (!success) {
-          if (debugSubsumptionLevel >= 1) {
-            klee_message("#%lu=>#%lu: Check failure as solver query not success",
-                         state.txTreeNode->getNodeSequenceNumber(),
-                         nodeSequenceNumber);
-          }
-          return false;
-        }
-        else if (result != Solver::True) {
-          if (debugSubsumptionLevel >= 1) {
-            klee_message("#%lu=>#%lu: Check failure as query expression not true",
-                         state.txTreeNode->getNodeSequenceNumber(),
-                         nodeSequenceNumber);
-          }
-          return false;
-        }
+        // The solver is called by the caller
+        pending.existential = false;
+        addWPCondition(pending);
+        return CheckPending;
       }
     } else {
       // expr is a constant expression
       if (expr->isTrue()) {
+        if (!pending.wpCondition.isNull())
+          return checkWPConditionOnly(pending);
         if (debugSubsumptionLevel >= 1) {
           std::string msg = "";
           if (!corePointerValues.empty()) {
@@ -1695,41 +2143,249 @@ setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
           // node. This is crucial for generating WP Expr at the parent node.
           state.txTreeNode->setWPatSubsumption(wpInterpolant);
         }
-        return true;
+        return CheckSuccess;
       }
       if (debugSubsumptionLevel >= 1) {
         klee_message(
             "#%lu=>#%lu: Check failure as query expression is non-true",
             state.txTreeNode->getNodeSequenceNumber(), nodeSequenceNumber);
       }
-      return false;
+      return CheckFailure;
     }
+  }
+#endif /* ENABLE_Z3 */
+  return CheckFailure;
+}
 
-    // State subsumed, we mark needed constraints on the
-    // path condition.
+TxSubsumptionTableEntry::CheckStatus
+TxSubsumptionTableEntry::checkWPConditionOnly(PendingCheck &pending) {
+  pending.expr = pending.wpCondition;
+  pending.existential = false;
+  return CheckPending;
+}
+
+void TxSubsumptionTableEntry::addWPCondition(PendingCheck &pending) {
+  if (pending.wpCondition.isNull())
+    return;
+  // The weakest precondition has no bound variables
+  if (ExistsExpr *existsExpr = llvm::dyn_cast<ExistsExpr>(pending.expr)) {
+    pending.expr = ExistsExpr::create(
+        existsExpr->variables,
+        AndExpr::create(pending.wpCondition, existsExpr->getKid(0)));
+  } else {
+    pending.expr = AndExpr::create(pending.wpCondition, pending.expr);
+  }
+}
+
+void TxSubsumptionTableEntry::completeSubsumption(
+    ExecutionState &state, PendingCheck &pending,
+    const std::vector<ref<Expr> > &unsatCore, int debugSubsumptionLevel) {
+  // State subsumed, we mark needed constraints on the
+  // path condition.
+  if (debugSubsumptionLevel >= 1) {
+    std::string msg = "";
+    if (!pending.corePointerValues.empty()) {
+      msg += " (with successful memory bound checks)";
+    }
+    klee_message("#%lu=>#%lu: Check success as solver decided validity%s",
+                 state.txTreeNode->getNodeSequenceNumber(),
+                 nodeSequenceNumber, msg.c_str());
+  }
+
+  // We create path condition marking structure and mark core constraints
+  state.txTreeNode->unsatCoreInterpolation(unsatCore);
+  interpolateValues(state, pending.coreValues, pending.corePointerValues,
+                    debugSubsumptionLevel);
+  if (WPInterpolant) {
+    // In case a node is subsumed, the WP Expr is stored at the parent node.
+    // This is crucial for generating WP Expr at the parent node.
+    state.txTreeNode->setWPatSubsumption(wpInterpolant);
+  }
+}
+
+bool TxSubsumptionTableEntry::subsumed(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    TxStateStoreView &stateStore, int debugSubsumptionLevel) {
+#ifdef ENABLE_Z3
+  PendingCheck pending;
+  CheckStatus status = prepareSubsumption(
+      solver, state, timeout, stateStore, pending, debugSubsumptionLevel);
+  if (status != CheckPending)
+    return status == CheckSuccess;
+  return decideSubsumption(solver, state, timeout, pending,
+                           debugSubsumptionLevel);
+#else
+  return false;
+#endif /* ENABLE_Z3 */
+}
+
+bool TxSubsumptionTableEntry::decideSubsumption(TimingSolver *solver,
+                                                ExecutionState &state,
+                                                double timeout,
+                                                PendingCheck &pending,
+                                                int debugSubsumptionLevel) {
+#ifdef ENABLE_Z3
+  // Tell the solver implementation that we are checking for subsumption for
+  // collecting statistics of solver calls.
+  SubsumptionCheckMarker subsumptionCheckMarker;
+
+  TxTimerStatIncrementer t(solverAccessTime);
+
+  ref<Expr> expr = pending.expr;
+  Solver::Validity result;
+  std::vector<ref<Expr> > unsatCore;
+  bool success = false;
+  WallTimer timer;
+
+  if (llvm::isa<ExistsExpr>(expr)) {
+    // We use a Z3 solver of its own to make sure that we use Z3
+    // without pre-solving optimizations. It would be nice in the future
+    // to just run solver->evaluate so that the optimizations can be
+    // used, but this requires handling of quantified expressions by
+    // KLEE's pre-solving procedure, which does not exist currently.
+    // The solver is kept for the following checks, so that they reuse
+    // the Z3 expressions it has constructed.
+    if (!existentialSolver)
+      existentialSolver = new Z3Solver();
+    SolverQueryTimer queryTimer;
+    existentialSolver->setCoreSolverTimeout(timeout);
+    success = existentialSolver->directComputeValidity(
+        Query(state.constraints, expr), result, unsatCore);
+    existentialSolver->setCoreSolverTimeout(0);
+    queryTimer.finish(success);
+  } else if (SubsumptionPartitioning &&
+             decidePartitioned(solver, state, timeout, expr, success, result,
+                               unsatCore)) {
+    // Decided by the groups of conjuncts of the query expression
+  } else {
+    // We call the solver in the standard way if the
+    // formula is unquantified.
+    solver->setTimeout(timeout);
+    success = solver->evaluate(state, expr, result, unsatCore);
+    solver->setTimeout(0);
+  }
+
+  if (queryLog) {
+    logQuery(state, expr, !success ? "FAIL" : result == Solver::True
+                                                  ? "VALID"
+                                                  : "INVALID",
+             timer.check() / 1000000.0);
+  }
+
+  if (!success) {
     if (debugSubsumptionLevel >= 1) {
-      std::string msg = "";
-      if (!corePointerValues.empty()) {
-        msg += " (with successful memory bound checks)";
-      }
-      klee_message("#%lu=>#%lu: Check success as solver decided validity%s",
+      klee_message(pending.existential
+                       ? "#%lu=>#%lu: Check failure as solver "
+                         "existentially-quantified query not success"
+                       : "#%lu=>#%lu: Check failure as solver query not "
+                         "success",
                    state.txTreeNode->getNodeSequenceNumber(),
-                   nodeSequenceNumber, msg.c_str());
+                   nodeSequenceNumber);
     }
+    return false;
+  }
 
-    // We create path condition marking structure and mark core constraints
-    state.txTreeNode->unsatCoreInterpolation(unsatCore);
-    interpolateValues(state, coreValues, corePointerValues,
-                      debugSubsumptionLevel);
-    if (WPInterpolant) {
-      // In case a node is subsumed, the WP Expr is stored at the parent node.
-      // This is crucial for generating WP Expr at the parent node.
-      state.txTreeNode->setWPatSubsumption(wpInterpolant);
+  storeQueryResult(pending, result == Solver::True, unsatCore);
+
+  if (result != Solver::True) {
+    if (debugSubsumptionLevel >= 1) {
+      klee_message(pending.existential
+                       ? "#%lu=>#%lu: Check failure as "
+                         "existentially-quantified query expression not true"
+                       : "#%lu=>#%lu: Check failure as query expression not "
+                         "true",
+                   state.txTreeNode->getNodeSequenceNumber(),
+                   nodeSequenceNumber);
     }
-    return true;
+    return false;
   }
-#endif /* ENABLE_Z3 */
+
+  completeSubsumption(state, pending, unsatCore, debugSubsumptionLevel);
+  return true;
+#else
   return false;
+#endif /* ENABLE_Z3 */
+}
+
+TxSubsumptionTableEntry *TxSubsumptionTableEntry::decideConcurrently(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    std::vector<TxSubsumptionTableEntry *> &entries,
+    std::vector<PendingCheck> &pending, int debugSubsumptionLevel) {
+#ifdef ENABLE_Z3
+  if (entries.size() == 1) {
+    // A single check is decided through the solver chain
+    bool hit = entries[0]->decideSubsumption(solver, state, timeout,
+                                             pending[0], debugSubsumptionLevel);
+    entries[0]->recordCheck(hit, 0);
+    return hit ? entries[0] : 0;
+  }
+
+  SubsumptionCheckMarker subsumptionCheckMarker;
+
+  TxTimerStatIncrementer t(solverAccessTime);
+
+  std::vector<ref<Expr> > exprs;
+  for (std::vector<PendingCheck>::iterator it = pending.begin(),
+                                           ie = pending.end();
+       it != ie; ++it) {
+    exprs.push_back(it->expr);
+  }
+
+  std::vector<ref<Expr> > unsatCore;
+  WallTimer timer;
+  SolverQueryTimer queryTimer;
+  if (!concurrentSolver)
+    concurrentSolver = new Z3Solver();
+  int valid = concurrentSolver->computeFirstValid(state.constraints, exprs,
+                                                  timeout, unsatCore);
+  queryTimer.finish(true);
+
+  if (queryLog) {
+    // The queries are decided together, so each is logged with their time
+    double time = timer.check() / 1000000.0;
+    for (int i = 0, n = entries.size(); i < n; ++i) {
+      entries[i]->logQuery(state, exprs[i],
+                           i == valid ? "VALID" : "NOT KNOWN VALID", time);
+    }
+  }
+
+  for (int i = 0, n = entries.size(); i < n; ++i) {
+    entries[i]->recordCheck(i == valid, 0);
+  }
+
+  if (debugSubsumptionLevel >= 1) {
+    for (int i = 0, n = entries.size(); i < n; ++i) {
+      if (i != valid) {
+        klee_message("#%lu=>#%lu: Check failure as concurrent query "
+                     "expression not known true",
+                     state.txTreeNode->getNodeSequenceNumber(),
+                     entries[i]->nodeSequenceNumber);
+      }
+    }
+  }
+
+  if (valid < 0)
+    return 0;
+
+  entries[valid]->storeQueryResult(pending[valid], true, unsatCore);
+  entries[valid]->completeSubsumption(state, pending[valid], unsatCore,
+                                      debugSubsumptionLevel);
+  return entries[valid];
+#else
+  return 0;
+#endif /* ENABLE_Z3 */
+}
+
+void TxSubsumptionTableEntry::logQuery(ExecutionState &state, ref<Expr> expr,
+                                       const char *outcome,
+                                       double time) const {
+  *queryLog << "# Subsumption query " << loggedQueryCount++ << ": entry #"
+            << nodeSequenceNumber << ", node #"
+            << state.txTreeNode->getNodeSequenceNumber() << ", "
+            << (llvm::isa<ExistsExpr>(expr) ? "existential" : "quantifier-free")
+            << ", " << outcome << ", " << time << "s\n";
+  ExprPPrinter::printQuery(*queryLog, state.constraints, expr);
+  queryLog->flush();
 }
 
 ref<Expr> TxSubsumptionTableEntry::getInterpolant() const {
@@ -1740,22 +2396,22 @@ ref<Expr> TxSubsumptionTableEntry::getWPInterpolant() const {
   return wpInterpolant;
 }
 
-TxStore::LowerInterpolantStore
+const TxStore::LowerInterpolantStore &
 TxSubsumptionTableEntry::getConcretelyAddressedHistoricalStore() const {
   return concretelyAddressedHistoricalStore;
 }
 
-TxStore::LowerInterpolantStore
+const TxStore::LowerInterpolantStore &
 TxSubsumptionTableEntry::getSymbolicallyAddressedHistoricalStore() const {
   return symbolicallyAddressedHistoricalStore;
 }
 
-TxStore::TopInterpolantStore
+const TxStore::TopInterpolantStore &
 TxSubsumptionTableEntry::getConcretelyAddressedStore() const {
   return concretelyAddressedStore;
 }
 
-TxStore::TopInterpolantStore
+const TxStore::TopInterpolantStore &
 TxSubsumptionTableEntry::getSymbolicallyAddressedStore() const {
   return symbolicallyAddressedStore;
 }
@@ -1766,6 +2422,7 @@ std::set<const Array *> TxSubsumptionTableEntry::getExistentials() const {
 
 void TxSubsumptionTableEntry::setInterpolant(ref<Expr> _interpolant) {
   interpolant = _interpolant;
+  computeSignature();
 }
 
 void TxSubsumptionTableEntry::setWPInterpolant(ref<Expr> _wpInterpolant) {
@@ -1775,6 +2432,7 @@ void TxSubsumptionTableEntry::setWPInterpolant(ref<Expr> _wpInterpolant) {
 void TxSubsumptionTableEntry::setConcretelyAddressedHistoricalStore(
     TxStore::LowerInterpolantStore _concretelyAddressedHistoricalStore) {
   concretelyAddressedHistoricalStore = _concretelyAddressedHistoricalStore;
+  computeSignature();
 }
 
 void TxSubsumptionTableEntry::setSymbolicallyAddressedHistoricalStore(
@@ -1785,16 +2443,19 @@ void TxSubsumptionTableEntry::setSymbolicallyAddressedHistoricalStore(
 void TxSubsumptionTableEntry::setConcretelyAddressedStore(
     TxStore::TopInterpolantStore _concretelyAddressedStore) {
   concretelyAddressedStore = _concretelyAddressedStore;
+  computeSignature();
 }
 
 void TxSubsumptionTableEntry::setSymbolicallyAddressedStore(
     TxStore::TopInterpolantStore _symbolicallyAddressedStore) {
   symbolicallyAddressedStore = _symbolicallyAddressedStore;
+  computeSignature();
 }
 
 void TxSubsumptionTableEntry::setExistentials(
     std::set<const Array *> _existentials) {
   existentials = _existentials;
+  computeSignature();
 }
 
 void TxSubsumptionTableEntry::print(llvm::raw_ostream &stream) const {
@@ -1813,6 +2474,11 @@ void TxSubsumptionTableEntry::print(llvm::raw_ostream &stream,
 
   stream << prefix << "------------ Subsumption Table Entry ------------\n";
   stream << prefix << "Program point = " << programPoint << "\n";
+  stream << prefix << "checks = " << hitCount << " successful, " << missCount
+         << " failed";
+  if (hitCount + missCount)
+    stream << " (average " << (checkTime / (hitCount + missCount)) << " us)";
+  stream << "\n";
   if (MarkGlobal) {
     stream << prefix << "global = [";
     for (std::set<ref<TxStoreEntry> >::iterator it = markedGlobal.begin(),
@@ -1959,6 +2625,14 @@ void TxSubsumptionTableEntry::printStat(std::stringstream &stream) {
   stream << "KLEE: done:     Number of solver calls for subsumption check "
             "(failed) = " << stats::subsumptionQueryCount.getValue() << " ("
          << stats::subsumptionQueryFailureCount.getValue() << ")\n";
+  if (stats::unsatCoreMinimizations.getValue()) {
+    stream << "KLEE: done:     Unsatisfiability core minimization time (ms) = "
+           << ((double)stats::unsatCoreMinimizationTime.getValue()) / 1000
+           << "\n";
+    stream << "KLEE: done:     Sizes of the minimized unsatisfiability cores "
+              "before (after) = " << stats::unsatCoreSize.getValue() << " ("
+           << stats::minimalUnsatCoreSize.getValue() << ")\n";
+  }
   stream << "KLEE: done:     Concrete store expression build time (ms) = "
          << ((double)concretelyAddressedStoreExpressionBuildTime.getValue()) /
                 1000 << "\n";
@@ -1967,6 +2641,16 @@ void TxSubsumptionTableEntry::printStat(std::stringstream &stream) {
                 1000 << "\n";
   stream << "KLEE: done:     Solver access time (ms) = "
          << ((double)solverAccessTime.getValue()) / 1000 << "\n";
+  stream << "KLEE: done:     Number of table entries rejected by pre-filter = "
+         << prefilterRejectionCount.getValue() << "\n";
+  stream << "KLEE: done:     Number of subsumption queries refuted by a "
+            "solution of the path condition = "
+         << modelRefutationCount.getValue() << "\n";
+  stream << "KLEE: done:     Number of subsumption queries answered by the "
+            "query result cache = " << queryCacheHitCount.getValue() << "\n";
+  stream << "KLEE: done:     Number of independent query groups answered by "
+            "the group result cache = " << groupCacheHitCount.getValue()
+         << "\n";
 }
 
 /**/
@@ -1999,8 +2683,7 @@ void TxSubsumptionTable::CallHistoryIndexedTable::Node::print(
     (*it)->print(stream, tabsNext, debugSubsumptionLevel);
     stream << "\n";
   }
-  for (std::map<llvm::Instruction *, Node *>::const_iterator it = next.begin(),
-                                                             ie = next.end();
+  for (Children::const_iterator it = next.begin(), ie = next.end();
        it != ie; ++it) {
     stream << tabsNext << "Next call:\n";
     it->second->print(stream, appendTab(prefix), debugSubsumptionLevel); ///***
@@ -2010,72 +2693,273 @@ void TxSubsumptionTable::CallHistoryIndexedTable::Node::print(
 
 /**/
 
-void TxSubsumptionTable::CallHistoryIndexedTable::clearTree(Node *node) {
-  for (std::map<llvm::Instruction *, Node *>::iterator it = node->next.begin(),
-                                                       ie = node->next.end();
+void TxSubsumptionTable::CallHistoryIndexedTable::clearTree() {
+  for (std::deque<Node>::iterator it = nodes.begin(), ie = nodes.end();
        it != ie; ++it) {
-    clearTree(it->second);
-    delete it->second;
+    for (std::deque<TxSubsumptionTableEntry *>::iterator
+             it1 = it->entryList.begin(),
+             ie1 = it->entryList.end();
+         it1 != ie1; ++it1) {
+      delete (*it1);
+    }
+    it->entryList.clear();
   }
+}
 
-  for (std::deque<TxSubsumptionTableEntry *>::iterator
-           it = node->entryList.begin(),
-           ie = node->entryList.end();
-       it != ie; ++it) {
-    delete (*it);
-  }
+bool TxSubsumptionTable::CallHistoryIndexedTable::Node::lessCall(
+    const std::pair<llvm::Instruction *, Node *> &child,
+    llvm::Instruction *call) {
+  return child.first < call;
 }
 
-void TxSubsumptionTable::CallHistoryIndexedTable::insert(
-    const std::vector<llvm::Instruction *> &callHistory,
-    TxSubsumptionTableEntry *entry) {
-  Node *current = root;
+TxSubsumptionTable::CallHistoryIndexedTable::Node *
+TxSubsumptionTable::CallHistoryIndexedTable::Node::getChild(
+    llvm::Instruction *call) const {
+  Children::const_iterator it =
+      std::lower_bound(next.begin(), next.end(), call, lessCall);
+  return it != next.end() && it->first == call ? it->second : 0;
+}
 
-  for (std::vector<llvm::Instruction *>::const_iterator
-           it = callHistory.begin(),
-           ie = callHistory.end();
+TxSubsumptionTable::CallHistoryIndexedTable::Node *
+TxSubsumptionTable::CallHistoryIndexedTable::getNode(
+    const TxCallHistory *callHistory, bool create) const {
+  std::map<unsigned, Node *>::const_iterator known =
+      nodeOfHistory.find(callHistory->getId());
+  if (known != nodeOfHistory.end())
+    return known->second;
+
+  // The nodes are never removed before the table is deleted, so that only
+  // the histories with a node are remembered
+  const std::vector<llvm::Instruction *> &history = callHistory->getHistory();
+  Node *current = root;
+  for (std::vector<llvm::Instruction *>::const_iterator it = history.begin(),
+                                                        ie = history.end();
        it != ie; ++it) {
     llvm::Instruction *call = *it;
-    std::map<llvm::Instruction *, Node *>::const_iterator it1 =
-        current->next.find(call);
-    if (it1 == current->next.end()) {
-      Node *newNode = new Node(call);
-      current->next[*it] = newNode;
-      current = newNode;
+    Node *child = current->getChild(call);
+    if (!child) {
+      if (!create)
+        return 0;
+      nodes.push_back(Node(call));
+      child = &nodes.back();
+      current->next.insert(
+          std::lower_bound(current->next.begin(), current->next.end(), call,
+                           Node::lessCall),
+          std::make_pair(call, child));
+    }
+    current = child;
+  }
+  nodeOfHistory[callHistory->getId()] = current;
+  return current;
+}
+
+bool TxSubsumptionTable::CallHistoryIndexedTable::insert(
+    const TxCallHistory *callHistory, TxSubsumptionTableEntry *entry,
+    std::vector<TxSubsumptionTableEntry *> &pruned) {
+  Node *node = getNode(callHistory, true);
+  if (SubsumptionEntryPruning) {
+    std::deque<TxSubsumptionTableEntry *> remaining;
+    for (std::deque<TxSubsumptionTableEntry *>::const_iterator
+             it = node->entryList.begin(),
+             ie = node->entryList.end();
+         it != ie; ++it) {
+      if ((*it)->isAtLeastAsGeneralAs(entry))
+        return false;
+      if (entry->isAtLeastAsGeneralAs(*it)) {
+        pruned.push_back(*it);
+        --entryCount;
+      } else {
+        remaining.push_back(*it);
+      }
+    }
+    if (!pruned.empty())
+      node->entryList.swap(remaining);
+  }
+  node->entryList.push_back(entry);
+  ++entryCount;
+  return true;
+}
+
+void TxSubsumptionTable::CallHistoryIndexedTable::purgePools() {
+  for (ExprHashSet::iterator it = conjunctPool.begin();
+       it != conjunctPool.end();) {
+    if (it->get()->refCount == 1)
+      it = conjunctPool.erase(it);
+    else
+      ++it;
+  }
+  for (std::map<ref<TxVariable>,
+                std::vector<ref<TxInterpolantValue> > >::iterator
+           it = valuePool.begin();
+       it != valuePool.end();) {
+    std::vector<ref<TxInterpolantValue> > &values = it->second;
+    std::vector<ref<TxInterpolantValue> > remaining;
+    for (std::vector<ref<TxInterpolantValue> >::iterator vi = values.begin(),
+                                                         ve = values.end();
+         vi != ve; ++vi) {
+      if ((*vi)->refCount > 1)
+        remaining.push_back(*vi);
+    }
+    if (remaining.empty()) {
+      valuePool.erase(it++);
     } else {
-      current = it1->second;
+      values.swap(remaining);
+      ++it;
+    }
+  }
+}
+
+void TxSubsumptionTable::CallHistoryIndexedTable::getEntries(
+    std::vector<TxSubsumptionTableEntry *> &entries) const {
+  std::vector<Node *> worklist;
+  worklist.push_back(root);
+  while (!worklist.empty()) {
+    Node *node = worklist.back();
+    worklist.pop_back();
+    entries.insert(entries.end(), node->entryList.begin(),
+                   node->entryList.end());
+    for (Node::Children::const_iterator
+             it = node->next.begin(),
+             ie = node->next.end();
+         it != ie; ++it) {
+      worklist.push_back(it->second);
+    }
+  }
+}
+
+void TxSubsumptionTable::CallHistoryIndexedTable::getEntries(
+    std::vector<std::pair<std::vector<llvm::Instruction *>,
+                          TxSubsumptionTableEntry *> > &entries) const {
+  std::vector<std::pair<Node *, std::vector<llvm::Instruction *> > > worklist;
+  worklist.push_back(std::make_pair(root, std::vector<llvm::Instruction *>()));
+  while (!worklist.empty()) {
+    Node *node = worklist.back().first;
+    std::vector<llvm::Instruction *> callHistory = worklist.back().second;
+    worklist.pop_back();
+    for (std::deque<TxSubsumptionTableEntry *>::const_iterator
+             it = node->entryList.begin(),
+             ie = node->entryList.end();
+         it != ie; ++it) {
+      entries.push_back(std::make_pair(callHistory, *it));
+    }
+    for (Node::Children::const_iterator
+             it = node->next.begin(),
+             ie = node->next.end();
+         it != ie; ++it) {
+      worklist.push_back(std::make_pair(it->second, callHistory));
+      worklist.back().second.push_back(it->first);
     }
   }
-  current->entryList.push_back(entry);
+}
+
+void TxSubsumptionTable::CallHistoryIndexedTable::erase(
+    const std::set<TxSubsumptionTableEntry *> &victims) {
+  std::vector<Node *> worklist;
+  worklist.push_back(root);
+  while (!worklist.empty()) {
+    Node *node = worklist.back();
+    worklist.pop_back();
+    std::deque<TxSubsumptionTableEntry *> remaining;
+    for (std::deque<TxSubsumptionTableEntry *>::const_iterator
+             it = node->entryList.begin(),
+             ie = node->entryList.end();
+         it != ie; ++it) {
+      if (victims.find(*it) == victims.end())
+        remaining.push_back(*it);
+      else
+        --entryCount;
+    }
+    node->entryList.swap(remaining);
+    for (Node::Children::const_iterator
+             it = node->next.begin(),
+             ie = node->next.end();
+         it != ie; ++it) {
+      worklist.push_back(it->second);
+    }
+  }
+}
+
+void TxSubsumptionTable::CallHistoryIndexedTable::reorder(
+    const TxCallHistory *callHistory, TxSubsumptionTableEntry *hitEntry) {
+  if (SubsumptionEntryOrderToUse == NEWEST_FIRST)
+    return;
+
+  Node *current = getNode(callHistory, false);
+  if (!current)
+    return;
+
+  std::deque<TxSubsumptionTableEntry *> &entryList = current->entryList;
+  if (SubsumptionEntryOrderToUse == MOVE_TO_FRONT) {
+    if (!hitEntry)
+      return;
+    // The entries are tried from the back of the list
+    std::deque<TxSubsumptionTableEntry *>::iterator it =
+        std::find(entryList.begin(), entryList.end(), hitEntry);
+    if (it != entryList.end()) {
+      entryList.erase(it);
+      entryList.push_back(hitEntry);
+    }
+    return;
+  }
+
+  current->unsorted = true;
+}
+
+uint64_t TxSubsumptionTable::CallHistoryIndexedTable::getMissCount() const {
+  uint64_t ret = 0;
+  std::vector<Node *> worklist;
+  worklist.push_back(root);
+  while (!worklist.empty()) {
+    Node *node = worklist.back();
+    worklist.pop_back();
+    for (std::deque<TxSubsumptionTableEntry *>::const_iterator
+             it = node->entryList.begin(),
+             ie = node->entryList.end();
+         it != ie; ++it) {
+      ret += (*it)->missCount;
+    }
+    for (Node::Children::const_iterator
+             it = node->next.begin(),
+             ie = node->next.end();
+         it != ie; ++it) {
+      worklist.push_back(it->second);
+    }
+  }
+  return ret;
 }
 
 std::pair<TxSubsumptionTable::EntryIterator, TxSubsumptionTable::EntryIterator>
 TxSubsumptionTable::CallHistoryIndexedTable::find(
-    const std::vector<llvm::Instruction *> &callHistory, bool &found) const {
-  Node *current = root;
-  std::pair<EntryIterator, EntryIterator> ret;
+    const TxCallHistory *callHistory, bool &found) const {
+  Node *current = getNode(callHistory, false);
+  if (!current) {
+    found = false;
+    return std::pair<EntryIterator, EntryIterator>();
+  }
+  found = true;
 
-  for (std::vector<llvm::Instruction *>::const_iterator
-           it = callHistory.begin(),
-           ie = callHistory.end();
-       it != ie; ++it) {
-    llvm::Instruction *call = *it;
-    std::map<llvm::Instruction *, Node *>::const_iterator it1 =
-        current->next.find(call);
-    if (it1 == current->next.end()) {
-      found = false;
-      return ret;
+  // The list is kept sorted by increasing hit rate, with ties in insertion
+  // order, so that newer entries are still tried first among equals. It is
+  // only sorted when the checks since the last find put it out of order.
+  if (current->unsorted) {
+    current->unsorted = false;
+    std::deque<TxSubsumptionTableEntry *> &entryList = current->entryList;
+    for (unsigned i = 1, n = entryList.size(); i < n; ++i) {
+      if (TxSubsumptionTableEntry::lowerHitRate(entryList[i],
+                                                entryList[i - 1])) {
+        std::stable_sort(entryList.begin(), entryList.end(),
+                         TxSubsumptionTableEntry::lowerHitRate);
+        break;
+      }
     }
-    current = it1->second;
   }
-  found = true;
   return std::pair<EntryIterator, EntryIterator>(current->entryList.rbegin(),
                                                  current->entryList.rend());
 }
 
 void TxSubsumptionTable::CallHistoryIndexedTable::printNode(
     llvm::raw_ostream &stream, Node *n, std::string edges, int debugSubsumptionLevel) const {
-  for (std::map<llvm::Instruction *, Node *>::const_iterator
+  for (Node::Children::const_iterator
            it = n->next.begin(),
            ie = n->next.end();
        it != ie; ++it) {
@@ -2097,29 +2981,412 @@ void TxSubsumptionTable::CallHistoryIndexedTable::print(
 std::map<uintptr_t, TxSubsumptionTable::CallHistoryIndexedTable *>
 TxSubsumptionTable::instance;
 
-void
-TxSubsumptionTable::insert(uintptr_t id,
-                           const std::vector<llvm::Instruction *> &callHistory,
-                           TxSubsumptionTableEntry *entry) {
+uint64_t TxSubsumptionTable::tableSize = 0;
+
+uint64_t TxSubsumptionTable::insertionCount = 0;
+
+uint64_t TxSubsumptionTable::evictedEntryCount = 0;
+
+uint64_t TxSubsumptionTable::evictedSize = 0;
+
+uint64_t TxSubsumptionTable::evictedHitCount = 0;
+
+uint64_t TxSubsumptionTable::prunedEntryCount = 0;
+
+uint64_t TxSubsumptionTable::redundantEntryCount = 0;
+
+uint64_t TxSubsumptionTable::internedConjunctCount = 0;
+
+uint64_t TxSubsumptionTable::generalizedEntryCount = 0;
+
+uint64_t TxSubsumptionTable::prunedSubtreeNodes = 0;
+
+uint64_t TxSubsumptionTable::internedValueCount = 0;
+
+std::map<uintptr_t, TxSubsumptionTable::PointBackoff>
+TxSubsumptionTable::backoffs;
+
+uint64_t TxSubsumptionTable::backoffSkipCount = 0;
+
+std::map<uintptr_t, TxSubsumptionTable::PointTiming>
+TxSubsumptionTable::timings;
+
+uint64_t TxSubsumptionTable::subtreeSizeSum = 0;
+
+uint64_t TxSubsumptionTable::subtreeSizeCount = 0;
+
+uint64_t TxSubsumptionTable::shortenedTimeoutCount = 0;
+
+uint64_t TxSubsumptionTable::lengthenedTimeoutCount = 0;
+
+std::map<uint64_t, std::set<uint64_t> > TxSubsumptionTable::failedChecks;
+
+uint64_t TxSubsumptionTable::sharedFailureSkipCount = 0;
+
+bool TxSubsumptionTable::trackSize = false;
+
+uint64_t TxSubsumptionTable::getEntryCount() {
+  // The entries leave the table only by eviction, pruning or merging, before
+  // it is cleared
+  return (uint64_t)TxTree::entryNumber - evictedEntryCount - prunedEntryCount -
+         generalizedEntryCount;
+}
+
+ref<Expr> TxSubsumptionTable::internConjuncts(ExprHashSet &pool,
+                                              ref<Expr> expr) {
+  if (expr.isNull())
+    return expr;
+  if (expr->getKind() == Expr::And && expr->getWidth() == Expr::Bool) {
+    ref<Expr> left = internConjuncts(pool, expr->getKid(0));
+    ref<Expr> right = internConjuncts(pool, expr->getKid(1));
+    // The conjunction is kept as it is, only its conjuncts are replaced
+    if (left.get() == expr->getKid(0).get() &&
+        right.get() == expr->getKid(1).get())
+      return expr;
+    return AndExpr::alloc(left, right);
+  }
+  std::pair<ExprHashSet::iterator, bool> res = pool.insert(expr);
+  if (!res.second && res.first->get() != expr.get())
+    ++internedConjunctCount;
+  return *res.first;
+}
+
+void TxSubsumptionTable::internValues(CallHistoryIndexedTable *subTable,
+                                      TxStore::LowerInterpolantStore &store) {
+  for (TxStore::LowerInterpolantStore::iterator it = store.begin(),
+                                                ie = store.end();
+       it != ie; ++it) {
+    if (it->second.isNull())
+      continue;
+    std::vector<ref<TxInterpolantValue> > &values =
+        subTable->valuePool[it->first];
+    std::vector<ref<TxInterpolantValue> >::iterator vi = values.begin(),
+                                                    ve = values.end();
+    while (vi != ve && !(*vi)->isEquivalent(*it->second))
+      ++vi;
+    if (vi == ve) {
+      values.push_back(it->second);
+    } else if (vi->get() != it->second.get()) {
+      it->second = *vi;
+      ++internedValueCount;
+    }
+  }
+}
+
+void TxSubsumptionTable::intern(CallHistoryIndexedTable *subTable,
+                                TxSubsumptionTableEntry *entry) {
+  // The conjuncts are interned before the values, whose expressions are
+  // compared by pointer
+  entry->interpolant = internConjuncts(subTable->conjunctPool,
+                                       entry->interpolant);
+  entry->wpInterpolant = internConjuncts(subTable->conjunctPool,
+                                         entry->wpInterpolant);
+  internValues(subTable, entry->concretelyAddressedHistoricalStore);
+  internValues(subTable, entry->symbolicallyAddressedHistoricalStore);
+  for (TxStore::TopInterpolantStore::iterator
+           it = entry->concretelyAddressedStore.begin(),
+           ie = entry->concretelyAddressedStore.end();
+       it != ie; ++it)
+    internValues(subTable, it->second);
+  for (TxStore::TopInterpolantStore::iterator
+           it = entry->symbolicallyAddressedStore.begin(),
+           ie = entry->symbolicallyAddressedStore.end();
+       it != ie; ++it)
+    internValues(subTable, it->second);
+}
+
+bool TxSubsumptionTable::getBounds(const std::set<ref<Expr> > &conjuncts,
+                                   ref<Expr> &e, uint64_t &lo, uint64_t &hi) {
+  e = ref<Expr>();
+  for (std::set<ref<Expr> >::const_iterator it = conjuncts.begin(),
+                                            ie = conjuncts.end();
+       it != ie; ++it) {
+    ref<Expr> c = *it;
+    if (c->getNumKids() != 2)
+      return false;
+    ref<Expr> left = c->getKid(0), right = c->getKid(1);
+    ref<Expr> term = isa<ConstantExpr>(left) ? right : left;
+    ConstantExpr *bound = dyn_cast<ConstantExpr>(
+        isa<ConstantExpr>(left) ? left : right);
+    if (!bound || isa<ConstantExpr>(term) || term->getWidth() > Expr::Int64 ||
+        term->getWidth() == Expr::Bool)
+      return false;
+    if (e.isNull()) {
+      e = term;
+      lo = 0;
+      hi = term->getWidth() == Expr::Int64
+               ? (uint64_t)-1
+               : (((uint64_t)1) << term->getWidth()) - 1;
+    } else if (e != term) {
+      return false;
+    }
+
+    uint64_t value = bound->getZExtValue();
+    bool termLeft = term == left;
+    switch (c->getKind()) {
+    case Expr::Eq:
+      lo = std::max(lo, value);
+      hi = std::min(hi, value);
+      break;
+    case Expr::Ule:
+      if (termLeft)
+        hi = std::min(hi, value);
+      else
+        lo = std::max(lo, value);
+      break;
+    case Expr::Ult:
+      if (termLeft) {
+        if (value == 0)
+          return false;
+        hi = std::min(hi, value - 1);
+      } else {
+        if (value == (uint64_t)-1)
+          return false;
+        lo = std::max(lo, value + 1);
+      }
+      break;
+    default:
+      return false;
+    }
+  }
+  return !e.isNull() && lo <= hi;
+}
+
+void TxSubsumptionTable::generalize(uintptr_t id,
+                                    const TxCallHistory *callHistory,
+                                    TxSubsumptionTableEntry *entry) {
+  std::map<uintptr_t, CallHistoryIndexedTable *>::iterator it =
+      instance.find(id);
+  if (it == instance.end())
+    return;
+  CallHistoryIndexedTable *subTable = it->second;
+  bool found;
+  std::pair<EntryIterator, EntryIterator> entries =
+      subTable->find(callHistory, found);
+  if (!found)
+    return;
+
+  std::set<ref<Expr> > conjuncts;
+  getConjuncts(entry->interpolant, conjuncts);
+  for (EntryIterator it1 = entries.first; it1 != entries.second; ++it1) {
+    TxSubsumptionTableEntry *other = *it1;
+    if (!other->existentials.empty() || !entry->hasSameContext(other))
+      continue;
+
+    std::set<ref<Expr> > otherConjuncts, common, own, otherOwn;
+    getConjuncts(other->interpolant, otherConjuncts);
+    std::set_intersection(conjuncts.begin(), conjuncts.end(),
+                          otherConjuncts.begin(), otherConjuncts.end(),
+                          std::inserter(common, common.begin()));
+    std::set_difference(conjuncts.begin(), conjuncts.end(), common.begin(),
+                        common.end(), std::inserter(own, own.begin()));
+    std::set_difference(otherConjuncts.begin(), otherConjuncts.end(),
+                        common.begin(), common.end(),
+                        std::inserter(otherOwn, otherOwn.begin()));
+    // An entry with a subset of the conjuncts of the other is left to
+    // -subsumption-entry-pruning
+    if (own.empty() || otherOwn.empty())
+      continue;
+
+    ref<Expr> term, otherTerm;
+    uint64_t lo, hi, otherLo, otherHi;
+    if (!getBounds(own, term, lo, hi) ||
+        !getBounds(otherOwn, otherTerm, otherLo, otherHi) || term != otherTerm)
+      continue;
+    // The union of the intervals is an interval when they overlap or are
+    // adjacent
+    if ((hi != (uint64_t)-1 && otherLo > hi + 1) ||
+        (otherHi != (uint64_t)-1 && lo > otherHi + 1))
+      continue;
+    lo = std::min(lo, otherLo);
+    hi = std::max(hi, otherHi);
+
+    Expr::Width width = term->getWidth();
+    ref<Expr> generalized =
+        lo == hi ? EqExpr::create(ConstantExpr::create(lo, width), term)
+                 : AndExpr::create(
+                       UleExpr::create(ConstantExpr::create(lo, width), term),
+                       UleExpr::create(term, ConstantExpr::create(hi, width)));
+    for (std::set<ref<Expr> >::iterator it2 = common.begin(),
+                                        ie2 = common.end();
+         it2 != ie2; ++it2)
+      generalized = AndExpr::create(generalized, *it2);
+    entry->interpolant = generalized;
+    entry->computeSignature();
+
+    std::set<TxSubsumptionTableEntry *> victims;
+    victims.insert(other);
+    subTable->erase(victims);
+    tableSize -= other->size;
+    TxTreeGraph::removeTableEntryMapping(other);
+    delete other;
+    if (SubsumptionEntryInterning)
+      subTable->purgePools();
+    ++generalizedEntryCount;
+    return;
+  }
+}
+
+bool TxSubsumptionTable::insert(uintptr_t id,
+                                const TxCallHistory *callHistory,
+                                TxSubsumptionTableEntry *entry) {
   CallHistoryIndexedTable *subTable = 0;
 
+  std::map<uintptr_t, CallHistoryIndexedTable *>::iterator it =
+      instance.find(id);
+
+  if (it == instance.end()) {
+    subTable = new CallHistoryIndexedTable();
+    instance[id] = subTable;
+  } else {
+    subTable = it->second;
+  }
+  if (SubsumptionEntryInterning)
+    intern(subTable, entry);
+
+  std::vector<TxSubsumptionTableEntry *> pruned;
+  if (!subTable->insert(callHistory, entry, pruned)) {
+    ++redundantEntryCount;
+    return false;
+  }
   TxTree::entryNumber++; // Count of entries in the table
+  entry->insertionNumber = ++insertionCount;
+
+  if (entry->subtreeSize) {
+    subtreeSizeSum += entry->subtreeSize;
+    ++subtreeSizeCount;
+  }
+
+  for (std::vector<TxSubsumptionTableEntry *>::iterator it1 = pruned.begin(),
+                                                        ie1 = pruned.end();
+       it1 != ie1; ++it1) {
+    ++prunedEntryCount;
+    tableSize -= (*it1)->size;
+    TxTreeGraph::removeTableEntryMapping(*it1);
+    delete *it1;
+  }
+  if (SubsumptionEntryInterning && !pruned.empty())
+    subTable->purgePools();
+
+  if (trackSize || MaxSubsumptionTableMemory > 0 ||
+      MaxSubsumptionPointEntries > 0) {
+    entry->size = entry->estimateSize();
+    tableSize += entry->size;
+  }
+
+  // Per-program-point cap on the number of entries
+  if (MaxSubsumptionPointEntries > 0 &&
+      subTable->size() > MaxSubsumptionPointEntries) {
+    std::vector<TxSubsumptionTableEntry *> entries;
+    subTable->getEntries(entries);
+    TxSubsumptionTableEntry *victim = 0;
+    for (std::vector<TxSubsumptionTableEntry *>::iterator
+             it1 = entries.begin(),
+             ie1 = entries.end();
+         it1 != ie1; ++it1) {
+      if (*it1 != entry && (!victim || evictBefore(*it1, victim)))
+        victim = *it1;
+    }
+    if (victim) {
+      std::set<TxSubsumptionTableEntry *> victims;
+      victims.insert(victim);
+      subTable->erase(victims);
+      deleteEvicted(victim);
+      if (SubsumptionEntryInterning)
+        subTable->purgePools();
+    }
+  }
+
+  // Global memory budget. We evict down to 90% of the budget such that the
+  // whole table is not scanned at every insertion.
+  uint64_t budget = static_cast<uint64_t>(MaxSubsumptionTableMemory) << 20;
+  if (budget > 0 && tableSize > budget)
+    evict(budget - budget / 10, entry);
+  return true;
+}
+
+bool TxSubsumptionTable::evictBefore(const TxSubsumptionTableEntry *a,
+                                     const TxSubsumptionTableEntry *b) {
+  switch (SubsumptionEvictionPolicyToUse) {
+  case EVICT_LEAST_HIT:
+    if (a->hitCount != b->hitCount)
+      return a->hitCount < b->hitCount;
+    break;
+  case EVICT_LARGEST:
+    if (a->size != b->size)
+      return a->size > b->size;
+    break;
+  default:
+    break;
+  }
+  return a->lastUse < b->lastUse;
+}
+
+uint64_t TxSubsumptionTable::evict(uint64_t targetSize,
+                                   TxSubsumptionTableEntry *keep) {
+  std::vector<TxSubsumptionTableEntry *> candidates;
+  for (std::map<uintptr_t, CallHistoryIndexedTable *>::const_iterator
+           it = instance.begin(),
+           ie = instance.end();
+       it != ie; ++it) {
+    it->second->getEntries(candidates);
+  }
+  std::sort(candidates.begin(), candidates.end(), evictBefore);
+
+  std::set<TxSubsumptionTableEntry *> victims;
+  uint64_t freed = 0;
+  for (std::vector<TxSubsumptionTableEntry *>::iterator
+           it = candidates.begin(),
+           ie = candidates.end();
+       it != ie && tableSize - freed > targetSize; ++it) {
+    if (*it == keep)
+      continue;
+    victims.insert(*it);
+    freed += (*it)->size;
+  }
+  if (victims.empty())
+    return 0;
+
+  for (std::map<uintptr_t, CallHistoryIndexedTable *>::const_iterator
+           it = instance.begin(),
+           ie = instance.end();
+       it != ie; ++it) {
+    it->second->erase(victims);
+  }
+  for (std::set<TxSubsumptionTableEntry *>::iterator it = victims.begin(),
+                                                     ie = victims.end();
+       it != ie; ++it) {
+    deleteEvicted(*it);
+  }
+  if (SubsumptionEntryInterning) {
+    for (std::map<uintptr_t, CallHistoryIndexedTable *>::const_iterator
+             it = instance.begin(),
+             ie = instance.end();
+         it != ie; ++it) {
+      it->second->purgePools();
+    }
+  }
+  return freed;
+}
 
-  std::map<uintptr_t, CallHistoryIndexedTable *>::iterator it =
-      instance.find(id);
+void TxSubsumptionTable::deleteEvicted(TxSubsumptionTableEntry *entry) {
+  ++evictedEntryCount;
+  evictedSize += entry->size;
+  evictedHitCount += entry->hitCount;
+  tableSize -= entry->size;
+  TxTreeGraph::removeTableEntryMapping(entry);
+  delete entry;
+}
 
-  if (it == instance.end()) {
-    subTable = new CallHistoryIndexedTable();
-    subTable->insert(callHistory, entry);
-    instance[id] = subTable;
-    return;
-  }
-  subTable = it->second;
-  subTable->insert(callHistory, entry);
+uint64_t TxSubsumptionTable::shrink(double fraction) {
+  if (!tableSize)
+    return 0;
+  return evict(static_cast<uint64_t>(tableSize * fraction), 0);
 }
 
 bool TxSubsumptionTable::check(TimingSolver *solver, ExecutionState &state,
                                double timeout, int debugSubsumptionLevel) {
+  SolverPhaseScope solverPhase(SubsumptionPhase);
   CallHistoryIndexedTable *subTable = 0;
   TxTreeNode *txTreeNode = state.txTreeNode;
 
@@ -2146,45 +3413,370 @@ bool TxSubsumptionTable::check(TimingSolver *solver, ExecutionState &state,
     return false;
   }
 
-  if (iterPair.first != iterPair.second) {
-
-    TxStore::TopInterpolantStore concretelyAddressedStore;
-    TxStore::TopInterpolantStore symbolicallyAddressedStore;
-    TxStore::LowerInterpolantStore concretelyAddressedHistoricalStore;
-    TxStore::LowerInterpolantStore symbolicallyAddressedHistoricalStore;
-
-    bool leftRetrieval;
-    TxStore::TopStateStore __internalStore;
-    TxStore::LowerStateStore __concretelyAddressedHistoricalStore;
-    TxStore::LowerStateStore __symbolicallyAddressedHistoricalStore;
-
-    txTreeNode->getStoredExpressions(txTreeNode->entryCallHistory,
-                                     leftRetrieval, __internalStore,
-                                     __concretelyAddressedHistoricalStore,
-                                     __symbolicallyAddressedHistoricalStore);
-
-    // Iterate the subsumption table entry with reverse iterator because
-    // the successful subsumption mostly happen in the newest entry.
-    for (EntryIterator it = iterPair.first, ie = iterPair.second; it != ie;
-         ++it) {
-      if ((*it)->subsumed(solver, state, timeout, leftRetrieval,
-                          __internalStore, __concretelyAddressedHistoricalStore,
-                          __symbolicallyAddressedHistoricalStore,
-                          debugSubsumptionLevel)) {
-        // We mark as subsumed such that the node will not be
-        // stored into table (the table already contains a more
-        // general entry).
-        txTreeNode->isSubsumed = true;
-
-        // Mark the node as subsumed, and create a subsumption edge
-        TxTreeGraph::markAsSubsumed(txTreeNode, (*it));
+  if (iterPair.first == iterPair.second)
+    return false;
+
+  if (!SubsumptionBackoff)
+    return checkEntries(solver, state, timeout, subTable, iterPair,
+                        debugSubsumptionLevel);
+
+  // Exponential backoff of the checks at program points where they keep
+  // failing
+  PointBackoff &backoff = backoffs[state.txTreeNode->getProgramPoint()];
+  if (backoff.countdown) {
+    --backoff.countdown;
+    ++backoff.skipCount;
+    ++backoffSkipCount;
+    if (debugSubsumptionLevel >= 1) {
+      klee_message("#%lu: Check skipped by backoff at the program point",
+                   state.txTreeNode->getNodeSequenceNumber());
+    }
+    return false;
+  }
+
+  bool hit = checkEntries(solver, state, timeout, subTable, iterPair,
+                          debugSubsumptionLevel);
+  if (hit) {
+    backoff.failureCount = 0;
+    backoff.gap = 0;
+  } else if (++backoff.failureCount >= SubsumptionBackoff) {
+    backoff.gap = backoff.gap
+                      ? std::min(backoff.gap * 2,
+                                 (unsigned)SubsumptionBackoffMaxGap)
+                      : 1;
+    backoff.countdown = backoff.gap;
+  }
+  return hit;
+}
+
+double TxSubsumptionTable::getAdaptiveTimeout(
+    uintptr_t programPoint, const TxSubsumptionTableEntry *entry,
+    double timeout) {
+  // A success saves the traversal of a subtree like that of the entry, so
+  // the checks by the entries of larger subtrees than the mean may take
+  // longer
+  double weight = 1.0;
+  if (entry && entry->subtreeSize && subtreeSizeCount)
+    weight = std::min(4.0, std::max(1.0, entry->subtreeSize *
+                                             (double)subtreeSizeCount /
+                                             subtreeSizeSum));
+
+  const PointTiming &timing = timings[programPoint];
+  double result;
+  if (timing.maxHitTime) {
+    result = std::max(SubsumptionAdaptiveTimeout * timing.maxHitTime /
+                          1000000.0,
+                      0.001);
+    if (timeout > 0)
+      result = std::min(result, timeout);
+  } else if (timeout > 0) {
+    // Halve the timeout for each check that ran to it without a success
+    result = timeout / (1 << std::min(timing.timedOutCount, 4U));
+  } else {
+    return 0;
+  }
+  result *= weight;
+
+  if (timeout <= 0 || result < timeout)
+    ++shortenedTimeoutCount;
+  else if (result > timeout)
+    ++lengthenedTimeoutCount;
+  return result;
+}
+
+void TxSubsumptionTable::recordTiming(uintptr_t programPoint, bool hit,
+                                      uint64_t time, double timeout) {
+  PointTiming &timing = timings[programPoint];
+  if (hit) {
+    timing.maxHitTime = std::max(timing.maxHitTime, time);
+    timing.timedOutCount = 0;
+  } else if (timeout > 0 && time >= timeout * 900000.0) {
+    ++timing.timedOutCount;
+  }
+}
+
+static inline uint64_t mixHash(uint64_t hash, uint64_t value) {
+  return hash * 1000003 + value;
+}
+
+uint64_t TxSubsumptionTable::getFingerprint(ExecutionState &state,
+                                            TxStateStoreView &stateStore) {
+  TxTreeNode *txTreeNode = state.txTreeNode;
+  uint64_t hash = txTreeNode->getProgramPoint();
+  for (std::vector<llvm::Instruction *>::const_iterator
+           it = txTreeNode->entryCallHistory->getHistory().begin(),
+           ie = txTreeNode->entryCallHistory->getHistory().end();
+       it != ie; ++it)
+    hash = mixHash(hash, reinterpret_cast<uintptr_t>(*it));
+
+  // The constraints are summed, such that the fingerprint does not depend on
+  // the order in which they were added to the path condition
+  uint64_t constraintHash = 0;
+  for (ConstraintManager::const_iterator it = state.constraints.begin(),
+                                         ie = state.constraints.end();
+       it != ie; ++it)
+    constraintHash += mixHash((*it)->hash(), (*it)->hash());
+  hash = mixHash(hash, constraintHash);
+
+  // The stores are those of the parent, hashed once for both children
+  return mixHash(hash, stateStore.getFingerprint());
+}
+
+bool TxSubsumptionTable::checkEntries(
+    TimingSolver *solver, ExecutionState &state, double timeout,
+    CallHistoryIndexedTable *subTable,
+    std::pair<EntryIterator, EntryIterator> iterPair,
+    int debugSubsumptionLevel) {
+  TxTreeNode *txTreeNode = state.txTreeNode;
+
+  // The store may have changed since the previous check of the node
+  txTreeNode->clearWPInstantiations();
+
+  TxStore::TopInterpolantStore concretelyAddressedStore;
+  TxStore::TopInterpolantStore symbolicallyAddressedStore;
+  TxStore::LowerInterpolantStore concretelyAddressedHistoricalStore;
+  TxStore::LowerInterpolantStore symbolicallyAddressedHistoricalStore;
+
+  // The stores of the state, retrieved when the first entry needs them
+  TxStateStoreView stateStore(txTreeNode);
+
+  // Signature of the arrays constrained in the state, used to reject
+  // entries without building any constraint. When the array pre-filter is
+  // disabled, all bits are set so that no entry is rejected on this basis.
+  uint64_t stateArraySignature = ~((uint64_t)0);
+  if (SubsumptionPrefilter && SubsumptionArrayPrefilter) {
+    std::vector<const Array *> arrays;
+    for (ConstraintManager::const_iterator it = state.constraints.begin(),
+                                           ie = state.constraints.end();
+         it != ie; ++it) {
+      findSymbolicObjects(*it, arrays);
+    }
+    stateArraySignature = TxSubsumptionTableEntry::getArraySignature(
+        arrays, std::set<const Array *>());
+  }
+
+  // The entries that failed for an earlier state of the same fingerprint.
+  // The global check of -mark-global depends on the address space, which is
+  // not in the fingerprint.
+  std::set<uint64_t> *sharedFailures = 0;
+  if (SubsumptionFailureSharing && !MarkGlobal) {
+    uint64_t fingerprint = getFingerprint(state, stateStore);
+    if (failedChecks.size() >= SubsumptionFailureSharing &&
+        !failedChecks.count(fingerprint))
+      failedChecks.clear();
+    sharedFailures = &failedChecks[fingerprint];
+  }
+
+  // The timeout of the concurrent checks, which do not depend on an entry
+  uintptr_t programPoint = txTreeNode->getProgramPoint();
+  if (SubsumptionAdaptiveTimeout > 0 && SubsumptionThreads > 1)
+    timeout = getAdaptiveTimeout(programPoint, 0, timeout);
+
+  // Entries whose solver queries are to be decided concurrently
+  std::vector<TxSubsumptionTableEntry *> pendingEntries;
+  std::vector<TxSubsumptionTableEntry::PendingCheck> pendingChecks;
+
+  // Iterate the subsumption table entry with reverse iterator because
+  // the successful subsumption mostly happen in the newest entry.
+  for (EntryIterator it = iterPair.first, ie = iterPair.second; it != ie;
+       ++it) {
+    if (sharedFailures && sharedFailures->count((*it)->nodeSequenceNumber)) {
+      ++sharedFailureSkipCount;
+      if (debugSubsumptionLevel >= 1) {
+        klee_message("#%lu=>#%lu: Check failure shared by an earlier state",
+                     state.txTreeNode->getNodeSequenceNumber(),
+                     (*it)->nodeSequenceNumber);
+      }
+      continue;
+    }
+
+    if (SubsumptionPrefilter &&
+        !(*it)->mayBeSubsumed(stateStore, stateArraySignature)) {
+      ++TxSubsumptionTableEntry::prefilterRejectionCount;
+      if (debugSubsumptionLevel >= 1) {
+        klee_message("#%lu=>#%lu: Check failure by signature pre-filter",
+                     state.txTreeNode->getNodeSequenceNumber(),
+                     (*it)->nodeSequenceNumber);
+      }
+      continue;
+    }
+
+    if (SubsumptionThreads > 1) {
+      pendingChecks.push_back(TxSubsumptionTableEntry::PendingCheck());
+      TxSubsumptionTableEntry::CheckStatus status =
+          (*it)->prepareSubsumption(solver, state, timeout, stateStore,
+                                    pendingChecks.back(),
+                                    debugSubsumptionLevel);
+      if (status == TxSubsumptionTableEntry::CheckFailure) {
+        (*it)->recordCheck(false, 0);
+        if (sharedFailures)
+          sharedFailures->insert((*it)->nodeSequenceNumber);
+        pendingChecks.pop_back();
+        continue;
+      }
+      if (status == TxSubsumptionTableEntry::CheckSuccess) {
+        (*it)->recordCheck(true, 0);
+        markSubsumed(subTable, txTreeNode, *it);
+        return true;
+      }
+      pendingEntries.push_back(*it);
+      if (pendingEntries.size() < SubsumptionThreads)
+        continue;
+
+      TxSubsumptionTableEntry *entry =
+          TxSubsumptionTableEntry::decideConcurrently(
+              solver, state, timeout, pendingEntries, pendingChecks,
+              debugSubsumptionLevel);
+      if (entry) {
+        markSubsumed(subTable, txTreeNode, entry);
         return true;
       }
+      pendingEntries.clear();
+      pendingChecks.clear();
+      continue;
+    }
+
+    double entryTimeout = timeout;
+    if (SubsumptionAdaptiveTimeout > 0)
+      entryTimeout = getAdaptiveTimeout(programPoint, *it, timeout);
+    WallTimer timer;
+    bool hit = (*it)->subsumed(solver, state, entryTimeout, stateStore,
+                               debugSubsumptionLevel);
+    uint64_t time = timer.check();
+    (*it)->recordCheck(hit, time);
+    if (SubsumptionAdaptiveTimeout > 0)
+      recordTiming(programPoint, hit, time, entryTimeout);
+    if (hit) {
+      markSubsumed(subTable, txTreeNode, *it);
+      return true;
+    }
+    if (sharedFailures)
+      sharedFailures->insert((*it)->nodeSequenceNumber);
+  }
+
+  if (!pendingEntries.empty()) {
+    TxSubsumptionTableEntry *entry =
+        TxSubsumptionTableEntry::decideConcurrently(
+            solver, state, timeout, pendingEntries, pendingChecks,
+            debugSubsumptionLevel);
+    if (entry) {
+      markSubsumed(subTable, txTreeNode, entry);
+      return true;
     }
   }
+
+  // The failures may have changed the ranking of the entries
+  subTable->reorder(txTreeNode->entryCallHistory, 0);
   return false;
 }
 
+void TxSubsumptionTable::markSubsumed(CallHistoryIndexedTable *subTable,
+                                      TxTreeNode *txTreeNode,
+                                      TxSubsumptionTableEntry *entry) {
+  // We mark as subsumed such that the node will not be
+  // stored into table (the table already contains a more
+  // general entry).
+  txTreeNode->isSubsumed = true;
+  prunedSubtreeNodes += entry->subtreeSize;
+
+  // Mark the node as subsumed, and create a subsumption edge
+  TxTreeGraph::markAsSubsumed(txTreeNode, entry);
+
+  subTable->reorder(txTreeNode->entryCallHistory, entry);
+}
+
+void TxSubsumptionTable::printStat(std::stringstream &stream) {
+  uint64_t total = 0, max = 0;
+  uintptr_t maxProgramPoint = 0;
+  for (std::map<uintptr_t, CallHistoryIndexedTable *>::const_iterator
+           it = instance.begin(),
+           ie = instance.end();
+       it != ie; ++it) {
+    uint64_t missCount = it->second->getMissCount();
+    total += missCount;
+    if (missCount > max) {
+      max = missCount;
+      maxProgramPoint = it->first;
+    }
+  }
+  stream << "KLEE: done:     Number of failed table entry checks = " << total
+         << "\n";
+  stream << "KLEE: done:     Maximum failed table entry checks at a program "
+            "point = " << max;
+  if (max) {
+    llvm::Instruction *inst =
+        reinterpret_cast<llvm::Instruction *>(maxProgramPoint);
+    stream << " (" << inst->getParent()->getParent()->getName().str() << ")";
+  }
+  stream << "\n";
+  if (SubsumptionBackoff) {
+    uint64_t backedOff = 0, maxSkip = 0;
+    uintptr_t maxSkipProgramPoint = 0;
+    for (std::map<uintptr_t, PointBackoff>::const_iterator
+             it = backoffs.begin(),
+             ie = backoffs.end();
+         it != ie; ++it) {
+      if (!it->second.skipCount)
+        continue;
+      ++backedOff;
+      if (it->second.skipCount > maxSkip) {
+        maxSkip = it->second.skipCount;
+        maxSkipProgramPoint = it->first;
+      }
+    }
+    stream << "KLEE: done:     Number of checks skipped by backoff = "
+           << backoffSkipCount << "\n";
+    stream << "KLEE: done:     Number of program points backed off = "
+           << backedOff << "\n";
+    stream << "KLEE: done:     Maximum checks skipped at a program point = "
+           << maxSkip;
+    if (maxSkip) {
+      llvm::Instruction *inst =
+          reinterpret_cast<llvm::Instruction *>(maxSkipProgramPoint);
+      stream << " (" << inst->getParent()->getParent()->getName().str()
+             << ")";
+    }
+    stream << "\n";
+  }
+  if (SubsumptionFailureSharing) {
+    stream << "KLEE: done:     Number of checks skipped by shared failures = "
+           << sharedFailureSkipCount << "\n";
+  }
+  if (SubsumptionAdaptiveTimeout > 0) {
+    stream << "KLEE: done:     Number of checks with shortened timeouts = "
+           << shortenedTimeoutCount << "\n";
+    stream << "KLEE: done:     Number of checks with lengthened timeouts = "
+           << lengthenedTimeoutCount << "\n";
+  }
+  if (SubsumptionEntryPruning) {
+    stream << "KLEE: done:     Number of pruned table entries = "
+           << prunedEntryCount << "\n";
+    stream << "KLEE: done:     Number of entries not stored for a more "
+              "general one = "
+           << redundantEntryCount << "\n";
+  }
+  if (LoopEntryGeneralization) {
+    stream << "KLEE: done:     Number of entries merged at loop headers = "
+           << generalizedEntryCount << "\n";
+  }
+  if (SubsumptionEntryInterning) {
+    stream << "KLEE: done:     Number of shared interpolant conjuncts = "
+           << internedConjunctCount << "\n";
+    stream << "KLEE: done:     Number of shared store values = "
+           << internedValueCount << "\n";
+  }
+  if (MaxSubsumptionTableMemory > 0 || MaxSubsumptionPointEntries > 0) {
+    stream << "KLEE: done:     Estimated table size (bytes) = " << tableSize
+           << "\n";
+    stream << "KLEE: done:     Number of evicted table entries = "
+           << evictedEntryCount << "\n";
+    stream << "KLEE: done:     Estimated evicted table entry size (bytes) = "
+           << evictedSize << "\n";
+    stream << "KLEE: done:     Subsumptions by evicted table entries = "
+           << evictedHitCount << "\n";
+  }
+}
+
 bool TxSubsumptionTable::hasInterpolation(ExecutionState &state) {
 
   CallHistoryIndexedTable *subTable = 0;
@@ -2216,6 +3808,7 @@ void TxSubsumptionTable::clear() {
       delete it->second;
     }
   }
+  tableSize = 0;
 }
 
 /**/
@@ -2223,6 +3816,7 @@ void TxSubsumptionTable::clear() {
 Statistic TxTree::setCurrentINodeTime("SetCurrentINodeTime",
                                       "SetCurrentINodeTime");
 Statistic TxTree::removeTime("RemoveTime", "RemoveTime");
+Statistic TxTree::publishTime("PublishTime", "PublishTime");
 Statistic TxTree::subsumptionCheckTime("SubsumptionCheckTime",
                                        "SubsumptionCheckTime");
 Statistic TxTree::markPathConditionTime("MarkPathConditionTime", "MarkPCTime");
@@ -2237,17 +3831,43 @@ double TxTree::programPointNumber;
 
 bool TxTree::symbolicExecutionError = false;
 
+std::vector<ref<Expr> > TxTree::ArgumentBuffer::buffer;
+
 uint64_t TxTree::subsumptionCheckCount = 0;
 
-ExecutionState *TxTree::initialStateCopy = 0;
+uint64_t TxTree::subsumptionSuccessCount = 0;
+
+AddressSpace *TxTree::initialGlobals = 0;
 
 uint64_t TxTree::blockCount = 1;
 
+std::vector<uint64_t> TxTree::interpolantSizeHistogram;
+
+uint64_t TxTree::removedNodeCount = 0;
+
+uint64_t TxTree::sampledNodeCount = 0;
+
+uint64_t TxTree::nodeLifetimeTotal = 0;
+
+std::vector<uint64_t> TxTree::nodeLifetimeHistogram;
+
+uint64_t TxTree::nodeMemoryTotal[TxTree::NodeMemoryComponentCount];
+
+std::vector<uint64_t> TxTree::nodeMemoryHistogram[TxTree::NodeMemoryComponentCount];
+
+uint64_t TxTree::droppedWPInterpolantCount = 0;
+
+uint64_t TxTree::rejectedEntryCount = 0;
+
+uint64_t TxTree::budgetSkipCount = 0;
+
 void TxTree::printTimeStat(std::stringstream &stream) {
   stream << "KLEE: done:     setCurrentINode = "
          << ((double)setCurrentINodeTime.getValue()) / 1000 << "\n";
   stream << "KLEE: done:     remove = " << ((double)removeTime.getValue()) /
                                                1000 << "\n";
+  stream << "KLEE: done:     publishPendingEntries = "
+         << ((double)publishTime.getValue()) / 1000 << "\n";
   stream << "KLEE: done:     subsumptionCheck = "
          << ((double)subsumptionCheckTime.getValue()) / 1000 << "\n";
   stream << "KLEE: done:     markPathCondition = "
@@ -2262,6 +3882,7 @@ void TxTree::printTimeStat(std::stringstream &stream) {
 
 void TxTree::printTableStat(std::stringstream &stream) {
   TxSubsumptionTableEntry::printStat(stream);
+  TxSubsumptionTable::printStat(stream);
 
   stream
       << "KLEE: done:     Average table entries per subsumption checkpoint = "
@@ -2270,9 +3891,80 @@ void TxTree::printTableStat(std::stringstream &stream) {
   stream << "KLEE: done:     Number of subsumption checks = "
          << subsumptionCheckCount << "\n";
 
+  if (SubsumptionTimeFraction > 0) {
+    stream << "KLEE: done:     Number of checks skipped by the time budget = "
+           << budgetSkipCount << "\n";
+  }
+
   stream << "KLEE: done:     Average solver calls per subsumption check = "
          << inTwoDecimalPoints((double)stats::subsumptionQueryCount /
                                (double)subsumptionCheckCount) << "\n";
+
+  stream << "KLEE: done:     Table entries by interpolant nodes =";
+  printHistogram(stream, interpolantSizeHistogram);
+  if (MaxInterpolantNodes || MaxInterpolantDepth) {
+    stream << "KLEE: done:     Number of WP interpolants dropped over budget = "
+           << droppedWPInterpolantCount << "\n";
+    stream << "KLEE: done:     Number of table entries not stored over "
+              "budget = " << rejectedEntryCount << "\n";
+  }
+  if (CompactHistoricalStore) {
+    stream << "KLEE: done:     Number of compacted historical store entries = "
+           << TxStore::getCompactedEntryCount() << "\n";
+  }
+  if (SampleNodeMemory) {
+    stream << "KLEE: done:     Number of sampled nodes = " << sampledNodeCount
+           << " of " << removedNodeCount << "\n";
+    stream << "KLEE: done:     Sampled nodes by lifetime in instructions =";
+    printHistogram(stream, nodeLifetimeHistogram);
+    for (unsigned i = 0; i < NodeMemoryComponentCount; ++i) {
+      stream << "KLEE: done:     Sampled nodes by bytes of "
+             << getNodeMemoryName((NodeMemoryComponent)i) << " =";
+      printHistogram(stream, nodeMemoryHistogram[i]);
+    }
+  }
+}
+
+const char *TxTree::getNodeMemoryName(NodeMemoryComponent component) {
+  switch (component) {
+  case ValuesMemory:
+    return "values";
+  case StoreMemory:
+    return "store";
+  case PathConditionMemory:
+    return "path condition";
+  case WPMemory:
+    return "weakest precondition";
+  case PhiValuesMemory:
+    return "phi values";
+  default:
+    return "unknown";
+  }
+}
+
+void TxTree::sampleNodeMemory(TxTreeNode *node) {
+  ++sampledNodeCount;
+  uint64_t lifetime = stats::instructions - node->creationInstruction;
+  nodeLifetimeTotal += lifetime;
+  addToHistogram(nodeLifetimeHistogram, lifetime);
+
+  // The estimates count the containers owned by the node, and not the
+  // expressions, which are shared with the other nodes and the states
+  uint64_t bytes[NodeMemoryComponentCount];
+  TxDependency *dependency = node->dependency;
+  bytes[ValuesMemory] = dependency->getValuesByteSize();
+  bytes[StoreMemory] = dependency->getStore()->getOwnedByteSize();
+  bytes[PathConditionMemory] = dependency->getPathConditionByteSize();
+  bytes[WPMemory] = node->reverseInstructionList.getByteSize();
+  if (WPInterpolant && node->wp)
+    bytes[WPMemory] += node->wp->markedVariables.size() *
+                       (sizeof(llvm::Value *) + 4 * sizeof(void *));
+  bytes[PhiValuesMemory] = node->phiValues.getByteSize();
+
+  for (unsigned i = 0; i < NodeMemoryComponentCount; ++i) {
+    nodeMemoryTotal[i] += bytes[i];
+    addToHistogram(nodeMemoryHistogram[i], bytes[i]);
+  }
 }
 
 std::string TxTree::inTwoDecimalPoints(const double n) {
@@ -2299,8 +3991,15 @@ std::string TxTree::getInterpolationStat() {
   printTableStat(stream);
   stream << "\nKLEE: done: TxTree method execution times (ms):\n";
   printTimeStat(stream);
+  stream << "\nKLEE: done: Solver queries by phase:\n";
+  SolverPhaseStatistics::print(stream);
   stream << "\nKLEE: done: TxTreeNode method execution times (ms):\n";
   TxTreeNode::printTimeStat(stream);
+  stream << "\nKLEE: done: Shadow expression statistics\n";
+  TxShadowArray::printStat(stream);
+  TxArena::printStat(stream);
+  TxExistentialElimination::printStat(stream);
+  TxTableFile::printStat(stream);
   // printing node count
   return stream.str();
 }
@@ -2313,10 +4012,22 @@ TxTree::TxTree(
   assert(_targetData && "target data layout not provided");
   if (!_root->txTreeNode) {
     currentTxTreeNode = TxTreeNode::createRoot(_targetData, _globalAddresses);
+    currentTxTreeNode->state = _root;
   }
   root = currentTxTreeNode;
-  initialStateCopy = new ExecutionState(*_root);
-  ;
+
+  // Copying the address space makes the objects copy-on-write in the root,
+  // so that the copy keeps the initial contents. Only the global objects,
+  // which are the ones marked by -mark-global, are kept.
+  if (MarkGlobal) {
+    initialGlobals = new AddressSpace(_root->addressSpace);
+    for (MemoryMap::iterator it = _root->addressSpace.objects.begin(),
+                             ie = _root->addressSpace.objects.end();
+         it != ie; ++it) {
+      if (!it->first->isGlobal)
+        initialGlobals->unbindObject(it->first);
+    }
+  }
 }
 
 bool TxTree::subsumptionCheck(TimingSolver *solver, ExecutionState &state,
@@ -2333,6 +4044,14 @@ bool TxTree::subsumptionCheck(TimingSolver *solver, ExecutionState &state,
                                state.txTreeNode->getProgramPoint())
     return false;
 
+  // No entry is stored at the program point
+  if (!state.txTreeNode->storable)
+    return false;
+
+  // The store of a merged state may not hold the values merged into it
+  if (state.txTreeNode->merged)
+    return false;
+
   int debugSubsumptionLevel =
       currentTxTreeNode->dependency->debugSubsumptionLevel;
 
@@ -2345,20 +4064,48 @@ bool TxTree::subsumptionCheck(TimingSolver *solver, ExecutionState &state,
                  state.txTreeNode->getNodeSequenceNumber());
   }
 
+  // The checks wait while they have taken more than their share of the
+  // exploration, which is only measured after its first second
+  if (SubsumptionTimeFraction > 0) {
+    uint64_t elapsed = explorationTimer.check();
+    if (elapsed >= 1000000 &&
+        subsumptionCheckTime.getValue() > SubsumptionTimeFraction * elapsed) {
+      ++budgetSkipCount;
+      if (debugSubsumptionLevel >= 1) {
+        klee_message("#%lu: Check skipped by the subsumption time budget",
+                     state.txTreeNode->getNodeSequenceNumber());
+      }
+      return false;
+    }
+  }
+
   ++subsumptionCheckCount; // For profiling
 
-  TimerStatIncrementer t(subsumptionCheckTime);
+  TxTimerStatIncrementer t(subsumptionCheckTime);
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Subsumption);
 
-  return TxSubsumptionTable::check(solver, state, timeout,
-                                   debugSubsumptionLevel);
+  bool subsumed =
+      TxSubsumptionTable::check(solver, state, timeout, debugSubsumptionLevel);
+  if (subsumed)
+    ++subsumptionSuccessCount;
+  return subsumed;
 #endif
   return false;
 }
 
 void TxTree::setCurrentINode(ExecutionState &state) {
-  TimerStatIncrementer t(setCurrentINodeTime);
+  // The state keeps running in its node after most steps, where only the
+  // program point is updated, and which are not timed
+  if (state.txTreeNode == currentTxTreeNode &&
+      currentTxTreeNode->nodeSequenceNumber) {
+    currentTxTreeNode->setProgramPoint(state.pc, state.prevPC->inst);
+    TxTreeGraph::setCurrentNode(state, currentTxTreeNode->nodeSequenceNumber);
+    return;
+  }
+
+  TxTimerStatIncrementer t(setCurrentINodeTime);
   currentTxTreeNode = state.txTreeNode;
-  currentTxTreeNode->setProgramPoint(state.pc->inst, state.prevPC->inst);
+  currentTxTreeNode->setProgramPoint(state.pc, state.prevPC->inst);
   if (!currentTxTreeNode->nodeSequenceNumber)
     currentTxTreeNode->nodeSequenceNumber =
         TxTreeNode::nextNodeSequenceNumber++;
@@ -2367,6 +4114,8 @@ void TxTree::setCurrentINode(ExecutionState &state) {
 
 void TxTree::removeSpeculationFailedNodes(TxTreeNode *node) {
   assert(!node->left && !node->right);
+  assert(pendingNodes.empty() &&
+         "deferred nodes may refer to the removed subtree");
   TxTreeNode *p = node->parent;
   if (p) {
     if (node == p->left) {
@@ -2382,7 +4131,7 @@ void TxTree::removeSpeculationFailedNodes(TxTreeNode *node) {
 void TxTree::remove(ExecutionState *state, TimingSolver *solver, bool dumping) {
 #ifdef ENABLE_Z3
   TxTreeNode *node = state->txTreeNode;
-  TimerStatIncrementer t(removeTime);
+  TxTimerStatIncrementer t(removeTime);
   assert(!node->left && !node->right);
   do {
     TxTreeNode *p = node->parent;
@@ -2391,8 +4140,7 @@ void TxTree::remove(ExecutionState *state, TimingSolver *solver, bool dumping) {
     if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC &&
         node->isSpeculationNode() && !node->isSpeculationFailedNode() && p &&
         !p->isSpeculationNode()) {
-      llvm::BasicBlock *pbb = p->getBasicBlock();
-      StatsTracker::increaseEle(pbb, 2, false);
+      StatsTracker::increaseEle(p->getBasicBlockId(), 2);
     }
 
     // As the node is about to be deleted, it must have been completely
@@ -2401,70 +4149,173 @@ void TxTree::remove(ExecutionState *state, TimingSolver *solver, bool dumping) {
     // We don't create an interpolant for an error node of generic error type:
     // This is because a generic error returns no information (true), which
     // should not be used for subsuming.
-    if (!dumping && !node->isSubsumed && node->storable &&
-        !node->genericEarlyTermination) {
-      int debugSubsumptionLevel = node->dependency->debugSubsumptionLevel;
-      setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
-      if (debugSubsumptionLevel >= 2) {
+    bool storeEntry = !dumping && !node->isSubsumed && node->storable &&
+                      !node->genericEarlyTermination;
+    if (SampleNodeMemory && removedNodeCount++ % SampleNodeMemory == 0)
+      sampleNodeMemory(node);
+    if (storeEntry && !AsyncInterpolants)
+      storeTableEntry(node);
+
+    if (p) {
+      if (!p->genericEarlyTermination)
+        p->genericEarlyTermination = node->genericEarlyTermination;
+      if (node == p->left) {
+        p->left = 0;
+      } else {
+        assert(node == p->right);
+        p->right = 0;
+      }
+    }
+
+    // A deferred entry is built by publishPendingEntries. The node has to be
+    // kept until then, and so does every node removed after it, as the
+    // dependency of a node refers to those of its ancestors.
+    if (AsyncInterpolants)
+      pendingNodes.push_back(std::make_pair(node, storeEntry));
+    else
+      delete node;
+    node = p;
+  } while (node && !node->left && !node->right);
+#endif
+}
+
+void TxTree::storeTableEntry(TxTreeNode *node) {
+#ifdef ENABLE_Z3
+  int debugSubsumptionLevel = node->dependency->debugSubsumptionLevel;
+  setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
+  if (debugSubsumptionLevel >= 2) {
 	if (debugSubsumptionLevel == 3){ // Printing block info for prettyPrint begin
 	llvm::outs()<<"\n------------------Printing Block Starts------------------\n";
 	llvm::outs()<<node->basicBlock->getName(); 
 	node->basicBlock->dump();
 	llvm::outs()<<"------------------Printing Block Ends------------------\n\n\n";} // Printing block info for prettyPrint ends
-        klee_message("Storing entry for Node #%lu, Program Point %lu",
-                     node->getNodeSequenceNumber(), node->getProgramPoint());
-      } else if (debugSubsumptionLevel >= 1) {
-        klee_message("Storing entry for Node #%lu",
-                     node->getNodeSequenceNumber());
-      }
+    klee_message("Storing entry for Node #%lu, Program Point %lu",
+                 node->getNodeSequenceNumber(), node->getProgramPoint());
+  } else if (debugSubsumptionLevel >= 1) {
+    klee_message("Storing entry for Node #%lu",
+                 node->getNodeSequenceNumber());
+  }
 
-      // generate marking and wp interpolant
-      TxSubsumptionTableEntry *entry =
-          new TxSubsumptionTableEntry(node, node->entryCallHistory);
+  // generate marking and wp interpolant
+  TxSubsumptionTableEntry *entry = new TxSubsumptionTableEntry(
+      node, node->entryCallHistory->getHistory());
 
-      if (WPInterpolant) {
-        ref<Expr> WPExpr = entry->getWPInterpolant();
-        if (!WPExpr.isNull()) {
-          entry = node->wp->updateSubsumptionTableEntry(entry);
-        }
+  uint64_t nodeCount;
+  if (WPInterpolant) {
+    ref<Expr> WPExpr = entry->getWPInterpolant();
+    if (!WPExpr.isNull()) {
+      // An oversized WP interpolant is dropped, leaving the deletion-based
+      // interpolant it would have replaced parts of
+      if (exceedsInterpolantBudget(WPExpr, nodeCount)) {
+        entry->setWPInterpolant(ref<Expr>());
+        ++droppedWPInterpolantCount;
+      } else {
+        entry = node->wp->updateSubsumptionTableEntry(entry);
       }
+    }
+  }
 
-      TxSubsumptionTable::insert(node->getProgramPoint(),
-                                 node->entryCallHistory, entry);
+  // Weakening the deletion-based interpolant itself would be unsound, so an
+  // entry whose interpolant is still oversized is not stored
+  if (exceedsInterpolantBudget(entry->getInterpolant(), nodeCount)) {
+    ++rejectedEntryCount;
+    if (debugSubsumptionLevel >= 1) {
+      klee_message("Entry for Node #%lu not stored: interpolant over budget",
+                   node->getNodeSequenceNumber());
+    }
+    delete entry;
+    return;
+  }
 
-      TxTreeGraph::addTableEntryMapping(node, entry);
+  addToHistogram(interpolantSizeHistogram, nodeCount);
 
-      if (debugSubsumptionLevel >= 2) {
-        std::string msg;
-        llvm::raw_string_ostream out(msg);
-        entry->print(out);
-        if (WPInterpolant) {
-          entry->printWP(out);
-        }
-        out.flush();
-        klee_message("%s", msg.c_str());
-      }
+  if (LoopEntryGeneralization &&
+      node->getBasicBlockId() < TxTreeNode::loopHeaders.size() &&
+      TxTreeNode::loopHeaders[node->getBasicBlockId()])
+    TxSubsumptionTable::generalize(node->getProgramPoint(),
+                                   node->entryCallHistory, entry);
+
+  if (!TxSubsumptionTable::insert(node->getProgramPoint(),
+                                  node->entryCallHistory, entry)) {
+    if (debugSubsumptionLevel >= 1) {
+      klee_message("Entry for Node #%lu not stored: an entry is more general",
+                   node->getNodeSequenceNumber());
     }
+    delete entry;
+    return;
+  }
 
-    if (p) {
-      if (!p->genericEarlyTermination)
-        p->genericEarlyTermination = node->genericEarlyTermination;
-      if (node == p->left) {
-        p->left = 0;
-      } else {
-        assert(node == p->right);
-        p->right = 0;
-      }
+  TxTreeGraph::addTableEntryMapping(node, entry);
+
+  if (debugSubsumptionLevel >= 2) {
+    std::string msg;
+    llvm::raw_string_ostream out(msg);
+    entry->print(out);
+    if (WPInterpolant) {
+      entry->printWP(out);
     }
-    delete node;
-    node = p;
-  } while (node && !node->left && !node->right);
+    out.flush();
+    klee_message("%s", msg.c_str());
+  }
+#endif
+}
+
+bool TxTree::exceedsInterpolantBudget(ref<Expr> interpolant,
+                                      uint64_t &nodeCount) {
+  nodeCount = 0;
+  if (interpolant.isNull())
+    return false;
+
+  // The depths of the distinct nodes, computed in post order from an
+  // explicit stack, where a node is first pushed unvisited
+  std::map<const Expr *, uint64_t> depths;
+  std::vector<std::pair<const Expr *, bool> > stack;
+  stack.push_back(std::make_pair(interpolant.get(), false));
+  while (!stack.empty()) {
+    std::pair<const Expr *, bool> top = stack.back();
+    stack.pop_back();
+    const Expr *e = top.first;
+    if (top.second) {
+      uint64_t depth = 0;
+      for (unsigned i = 0, n = e->getNumKids(); i < n; ++i)
+        depth = std::max(depth, depths[e->getKid(i).get()]);
+      depths[e] = depth + 1;
+      continue;
+    }
+    if (depths.count(e))
+      continue;
+    depths[e] = 0;
+    stack.push_back(std::make_pair(e, true));
+    for (unsigned i = 0, n = e->getNumKids(); i < n; ++i) {
+      const Expr *kid = e->getKid(i).get();
+      if (!depths.count(kid))
+        stack.push_back(std::make_pair(kid, false));
+    }
+  }
+
+  nodeCount = depths.size();
+  uint64_t depth = depths[interpolant.get()];
+  return (MaxInterpolantNodes && nodeCount > MaxInterpolantNodes) ||
+         (MaxInterpolantDepth && depth > MaxInterpolantDepth);
+}
+
+void TxTree::publishPendingEntries(unsigned count) {
+#ifdef ENABLE_Z3
+  TxTimerStatIncrementer t(publishTime);
+  for (unsigned i = 0; !pendingNodes.empty() && (!count || i < count); ++i) {
+    std::pair<TxTreeNode *, bool> pending = pendingNodes.front();
+    pendingNodes.pop_front();
+    if (pending.second)
+      storeTableEntry(pending.first);
+    delete pending.first;
+  }
 #endif
 }
 
 std::pair<TxTreeNode *, TxTreeNode *>
 TxTree::split(TxTreeNode *parent, ExecutionState *left, ExecutionState *right) {
-  TimerStatIncrementer t(splitTime);
+  TxTimerStatIncrementer t(splitTime);
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::Split);
   parent->split(left, right);
   TxTreeGraph::addChildren(parent, parent->left, parent->right);
   std::pair<TxTreeNode *, TxTreeNode *> ret(parent->left, parent->right);
@@ -2473,7 +4324,7 @@ TxTree::split(TxTreeNode *parent, ExecutionState *left, ExecutionState *right) {
 
 void TxTree::markPathCondition(ExecutionState &state,
                                std::vector<ref<Expr> > &unsatCore) {
-  TimerStatIncrementer t(markPathConditionTime);
+  TxTimerStatIncrementer t(markPathConditionTime);
   int debugSubsumptionLevel =
       currentTxTreeNode->dependency->debugSubsumptionLevel;
   setDebugSubsumptionLevelTxTree(debugSubsumptionLevel);
@@ -2481,22 +4332,9 @@ void TxTree::markPathCondition(ExecutionState &state,
       llvm::dyn_cast<llvm::BranchInst>(state.prevPC->inst);
   if (binst) {
     ref<Expr> unknownExpression;
-    std::string reason = "";
-    if (debugSubsumptionLevel >= 4 ) { /*Added 'debugSubsumptionLevel != 3' constraint for Pretty Print*/
-      llvm::raw_string_ostream stream(reason);
-      stream << "branch infeasibility [";
-      if (binst->getParent()->getParent()) {
-        stream << binst->getParent()->getParent()->getName().str() << ": ";
-      }
-      if (llvm::MDNode *n = binst->getMetadata("dbg")) {
-        llvm::DILocation loc(n);
-        stream << "Line " << loc.getLineNumber();
-      } else {
-        binst->print(stream);
-      }
-      stream << "]";
-      stream.flush();
-    }
+    TxMarkReason reason;
+    if (debugSubsumptionLevel >= 4) /*Added 'debugSubsumptionLevel != 3' constraint for Pretty Print*/
+      reason = TxMarkReason(TxMarkReason::BranchInfeasibility, binst);
     currentTxTreeNode->dependency->markAllValues(binst->getCondition(),
                                                  unknownExpression, reason);
   }
@@ -2507,15 +4345,15 @@ void TxTree::markPathCondition(ExecutionState &state,
 
 void TxTree::executePHI(llvm::Instruction *instr, unsigned incomingBlock,
                         ref<Expr> valueExpr) {
-  currentTxTreeNode->dependency->executePHI(instr, incomingBlock,
-                                            currentTxTreeNode->callHistory,
-                                            valueExpr, symbolicExecutionError);
+  currentTxTreeNode->dependency->executePHI(
+      instr, incomingBlock, currentTxTreeNode->callHistory->getHistory(),
+      valueExpr, symbolicExecutionError);
   symbolicExecutionError = false;
 }
 
 void TxTree::executeOnNode(TxTreeNode *node, llvm::Instruction *instr,
                            std::vector<ref<Expr> > &args) {
-  TimerStatIncrementer t(executeOnNodeTime);
+  TxTimerStatIncrementer t(executeOnNodeTime);
   node->execute(instr, args, symbolicExecutionError);
   symbolicExecutionError = false;
 }
@@ -2531,8 +4369,7 @@ void TxTree::storeSpeculationUnsatCore(TimingSolver *solver,
 }
 
 void TxTree::storeInstruction(KInstruction *instr, unsigned incomingBB) {
-  currentTxTreeNode->reverseInstructionList.push_back(
-      std::pair<KInstruction *, bool>(instr, 0));
+  currentTxTreeNode->reverseInstructionList.push_back(instr->inst);
   if (llvm::isa<llvm::PHINode>(instr->inst)) {
     currentTxTreeNode->phiNodeArg.insert(
         std::pair<llvm::Instruction *, unsigned>(instr->inst, incomingBB));
@@ -2540,22 +4377,18 @@ void TxTree::storeInstruction(KInstruction *instr, unsigned incomingBB) {
 }
 
 void TxTree::markInstruction(KInstruction *instr, bool branchFlag) {
-  std::vector<std::pair<KInstruction *, int> >::iterator iter =
-      std::find(currentTxTreeNode->reverseInstructionList.begin(),
-                currentTxTreeNode->reverseInstructionList.end(),
-                std::pair<KInstruction *, int>(instr, 0));
   // Marking all the br instruction that have one branch as infeasible.
   // Other infeasible paths (like the infeasible paths in the internal
   // KLEE function klee_make_symbolic are not tracked by weakest pre-
   // condition approach.
-  std::string fname = iter->first->inst->getParent()->getParent()->getName();
-  if (isa<llvm::BranchInst>(iter->first->inst) &&
+  std::string fname = instr->inst->getParent()->getParent()->getName();
+  if (isa<llvm::BranchInst>(instr->inst) &&
       fname.find("klee_") == std::string::npos &&
       fname.find("tx_") == std::string::npos) {
-    if (branchFlag == true)
-      iter->second = 1;
-    else
-      iter->second = 2;
+    // The branch has just been executed, so this is its last execution.
+    currentTxTreeNode->reverseInstructionList.mark(
+        instr->inst, branchFlag ? TxInstructionTrace::ConditionNeeded
+                                : TxInstructionTrace::NegatedConditionNeeded);
   }
 }
 
@@ -2622,11 +4455,20 @@ TxTreeNode::getStoredCoreExpressionsTime("GetStoredCoreExpressionsTime",
 // The interpolation tree node sequence number
 uint64_t TxTreeNode::nextNodeSequenceNumber = 1;
 
-void TxTreeNode::setPhiValue(llvm::Value *val, ref<Expr> value) {
-  if (isa<llvm::Instruction>(val)) {
-    llvm::Instruction *instr = dyn_cast<llvm::Instruction>(val);
-    phiValues[instr].push_back(value);
-  }
+std::vector<bool> TxTreeNode::subsumptionPoints;
+
+std::vector<bool> TxTreeNode::loopHeaders;
+
+void TxTreeNode::setPhiValue(llvm::Instruction *instr, ref<Expr> value) {
+  // Only the phi nodes of the first block take their values from the
+  // predecessor of the node
+  if (instr->getParent() != basicBlock)
+    return;
+  unsigned slot = 0;
+  for (llvm::BasicBlock::iterator it = basicBlock->begin(); &*it != instr;
+       ++it)
+    ++slot;
+  phiValues.set(slot, value);
 }
 
 void TxTreeNode::printTimeStat(std::stringstream &stream) {
@@ -2654,16 +4496,22 @@ void TxTreeNode::printTimeStat(std::stringstream &stream) {
 TxTreeNode::TxTreeNode(
     TxTreeNode *_parent, llvm::DataLayout *_targetData,
     std::map<const llvm::GlobalValue *, ref<ConstantExpr> > *_globalAddresses)
-    : parent(_parent), left(0), right(0), programPoint(0), prevProgramPoint(0),
+    : parent(_parent), left(0), right(0), state(0), programPoint(0),
+      basicBlockId(0), prevProgramPoint(0),
       phiValuesFlag(1), nodeSequenceNumber(0), storable(true),
       graph(_parent ? _parent->graph : 0),
       instructionsDepth(_parent ? _parent->instructionsDepth : 0),
+      creationInstruction(stats::instructions),
       targetData(_targetData), globalAddresses(_globalAddresses),
-      genericEarlyTermination(false), assertionFail(false),
+      genericEarlyTermination(false), merged(false), assertionFail(false),
       emitAllErrors(false), isSubsumed(false) {
   if (_parent) {
     entryCallHistory = _parent->callHistory;
     callHistory = _parent->callHistory;
+    if (_parent->merged)
+      setMerged();
+  } else {
+    entryCallHistory = callHistory = TxCallHistory::getEmpty();
   }
 
   // Inherit the abstract dependency or NULL
@@ -2687,6 +4535,14 @@ TxTreeNode::TxTreeNode(
 }
 
 TxTreeNode::~TxTreeNode() {
+  TxTreeGraph::removeNode(this);
+  // The root of a speculation subtree owns the data shared by the subtree,
+  // and it is deleted last, whether the speculation succeeded or failed.
+  if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC && speculationFlag &&
+      parent && !parent->speculationFlag) {
+    delete visitedProgramPoints;
+    delete specTime;
+  }
   if (dependency)
     delete dependency;
   if (WPInterpolant && wp) {
@@ -2697,7 +4553,7 @@ TxTreeNode::~TxTreeNode() {
 ref<Expr> TxTreeNode::getInterpolant(
     std::set<const Array *> &replacements,
     std::map<ref<Expr>, ref<Expr> > &substitution) const {
-  TimerStatIncrementer t(getInterpolantTime);
+  TxTimerStatIncrementer t(getInterpolantTime);
   ref<Expr> expr = dependency->packInterpolant(replacements, substitution);
   return expr;
 }
@@ -2724,22 +4580,9 @@ void TxTreeNode::mark() {
   llvm::BranchInst *binst = speculationBInst;
   if (binst) {
     ref<Expr> unknownExpression;
-    std::string reason = "";
-    if (debugSubsumptionLevel >= 1 && debugSubsumptionLevel != 3) { /*Added 'debugSubsumptionLevel != 3' constraint for Pretty Print*/
-      llvm::raw_string_ostream stream(reason);
-      stream << "branch infeasibility [";
-      if (binst->getParent()->getParent()) {
-        stream << binst->getParent()->getParent()->getName().str() << ": ";
-      }
-      if (llvm::MDNode *n = binst->getMetadata("dbg")) {
-        llvm::DILocation loc(n);
-        stream << "Line " << loc.getLineNumber();
-      } else {
-        binst->print(stream);
-      }
-      stream << "]";
-      stream.flush();
-    }
+    TxMarkReason reason;
+    if (debugSubsumptionLevel >= 1 && debugSubsumptionLevel != 3) /*Added 'debugSubsumptionLevel != 3' constraint for Pretty Print*/
+      reason = TxMarkReason(TxMarkReason::BranchInfeasibility, binst);
     this->dependency->markAllValues(binst->getCondition(), unknownExpression,
                                     reason);
   }
@@ -2749,7 +4592,8 @@ void TxTreeNode::mark() {
 }
 
 ref<Expr> TxTreeNode::generateWPInterpolant() {
-  TimerStatIncrementer t(getWPInterpolantTime);
+  TxTimerStatIncrementer t(getWPInterpolantTime);
+  SamplingProfiler::PhaseScope phase(SamplingProfiler::WeakestPrecondition);
 
   ref<Expr> expr;
   if (assertionFail && emitAllErrors) {
@@ -2771,7 +4615,7 @@ ref<Expr> TxTreeNode::generateWPInterpolant() {
     expr = wp->PushUp(reverseInstructionList);
   } else {
     // Get branch condition
-    llvm::Instruction *i = reverseInstructionList.back().first->inst;
+    llvm::Instruction *i = reverseInstructionList.back();
     if (i->getOpcode() == llvm::Instruction::Br) {
       llvm::BranchInst *br = dyn_cast<llvm::BranchInst>(i);
       if (br->isConditional()) {
@@ -2814,12 +4658,12 @@ ref<Expr> TxTreeNode::getChildWPInterpolant(int flag) {
 }
 
 llvm::Instruction *TxTreeNode::getPreviousInstruction(llvm::PHINode *phi) {
-  for (std::vector<std::pair<KInstruction *, int> >::const_reverse_iterator
+  for (TxInstructionTrace::reverse_iterator
            it = reverseInstructionList.rbegin(),
            ie = reverseInstructionList.rend();
        it != ie; ++it) {
-    if ((*it).first->inst == phi)
-      return (*++it).first->inst;
+    if (it.getInstruction() == phi)
+      return (++it).getInstruction();
   }
   klee_error(
       "TxTreeNode::getPreviousInstruction: Control should not reach here!");
@@ -2828,8 +4672,34 @@ llvm::Instruction *TxTreeNode::getPreviousInstruction(llvm::PHINode *phi) {
 // =========================================================================
 // Instantiating WP Expression at Subsumption Point
 // =========================================================================
+ref<TxAllocationContext>
+TxTreeNode::getWPVariableAddress(llvm::Value *address,
+                                 TxDependency *dependency) {
+  std::map<llvm::Value *, ref<TxAllocationContext> >::iterator it =
+      wpVariableAddresses.find(address);
+  if (it != wpVariableAddresses.end())
+    return it->second;
+  ref<TxAllocationContext> alc =
+      dependency->getStore()->getAddressofLatestCopyLLVMValue(address);
+  wpVariableAddresses[address] = alc;
+  return alc;
+}
+
 ref<Expr> TxTreeNode::instantiateWPatSubsumption(ref<Expr> wpInterpolant,
                                                  TxDependency *dependency) {
+  if (wpInterpolant.isNull() || isa<ConstantExpr>(wpInterpolant))
+    return wpInterpolant;
+
+  ExprHashMap<ref<Expr> >::iterator it = wpInstantiations.find(wpInterpolant);
+  if (it != wpInstantiations.end())
+    return it->second;
+  ref<Expr> result = instantiateWPExpr(wpInterpolant, dependency);
+  wpInstantiations[wpInterpolant] = result;
+  return result;
+}
+
+ref<Expr> TxTreeNode::instantiateWPExpr(ref<Expr> wpInterpolant,
+                                        TxDependency *dependency) {
 
   if (wpInterpolant.isNull())
     return wpInterpolant;
@@ -2844,7 +4714,7 @@ ref<Expr> TxTreeNode::instantiateWPatSubsumption(ref<Expr> wpInterpolant,
     ref<WPVarExpr> WPVar = dyn_cast<WPVarExpr>(wpInterpolant);
 
     ref<TxAllocationContext> alc =
-        dependency->getStore()->getAddressofLatestCopyLLVMValue(WPVar->address);
+        getWPVariableAddress(WPVar->address, dependency);
 
     if (!alc.isNull()) {
       ref<TxStoreEntry> entry;
@@ -2959,7 +4829,7 @@ ref<Expr> TxTreeNode::instantiateWPatSubsumption(ref<Expr> wpInterpolant,
     ref<WPVarExpr> WPVar = dyn_cast<WPVarExpr>(wpInterpolant->getKid(0));
 
     ref<TxAllocationContext> alc =
-        dependency->getStore()->getAddressofLatestCopyLLVMValue(WPVar->address);
+        getWPVariableAddress(WPVar->address, dependency);
 
     if (!alc.isNull()) {
       ref<TxStoreEntry> entry;
@@ -3013,17 +4883,21 @@ void TxTreeNode::setWPatSubsumption(ref<Expr> _wpInterpolant) {
 }
 
 void TxTreeNode::addConstraint(ref<Expr> &constraint, llvm::Value *condition) {
-  TimerStatIncrementer t(addConstraintTime);
+  TxTimerStatIncrementer t(addConstraintTime);
   ref<TxPCConstraint> pcConstraint =
-      dependency->addConstraint(constraint, condition, callHistory);
+      dependency->addConstraint(constraint, condition,
+                                callHistory->getHistory());
   graph->addPathCondition(this, pcConstraint.get(), constraint);
 }
 
 void TxTreeNode::split(ExecutionState *leftData, ExecutionState *rightData) {
-  TimerStatIncrementer t(splitTime);
+  TxTimerStatIncrementer t(splitTime);
   assert(left == 0 && right == 0);
   leftData->txTreeNode = createLeftChild();
   rightData->txTreeNode = createRightChild();
+  left->state = leftData;
+  right->state = rightData;
+  state = 0;
   if (INTERPOLATION_ENABLED && SpecTypeToUse != NO_SPEC &&
       this->speculationFlag) {
     leftData->txTreeNode->setSpeculationFlag();
@@ -3038,13 +4912,14 @@ void TxTreeNode::split(ExecutionState *leftData, ExecutionState *rightData) {
 void TxTreeNode::execute(llvm::Instruction *instr,
                          std::vector<ref<Expr> > &args,
                          bool symbolicExecutionError) {
-  TimerStatIncrementer t(executeTime);
-  dependency->execute(instr, callHistory, args, symbolicExecutionError);
+  TxTimerStatIncrementer t(executeTime);
+  dependency->execute(instr, callHistory->getHistory(), args,
+                      symbolicExecutionError);
 }
 
 void TxTreeNode::bindCallArguments(llvm::Instruction *site,
                                    std::vector<ref<Expr> > &arguments) {
-  TimerStatIncrementer t(bindCallArgumentsTime);
+  TxTimerStatIncrementer t(bindCallArgumentsTime);
   dependency->bindCallArguments(site, callHistory, arguments);
 }
 
@@ -3052,28 +4927,36 @@ void TxTreeNode::bindReturnValue(llvm::CallInst *site, llvm::Instruction *inst,
                                  ref<Expr> returnValue) {
   // TODO: This is probably where we should simplify
   // the dependency graph by removing callee values.
-  TimerStatIncrementer t(bindReturnValueTime);
+  TxTimerStatIncrementer t(bindReturnValueTime);
   dependency->bindReturnValue(site, callHistory, inst, returnValue);
 }
 
-void TxTreeNode::getStoredExpressions(
-    const std::vector<llvm::Instruction *> &_callHistory, bool &leftRetrieval,
-    TxStore::TopStateStore &__internalStore,
-    TxStore::LowerStateStore &__concretelyAddressedHistoricalStore,
-    TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore) const {
-  TimerStatIncrementer t(getStoredExpressionsTime);
-  std::map<ref<Expr>, ref<Expr> > dummySubstitution;
-  std::set<const Array *> dummyReplacements;
+void TxTreeNode::bindSummaryReturnValue(llvm::CallInst *site,
+                                        std::vector<ref<Expr> > &arguments,
+                                        ref<Expr> returnValue) {
+  TxTimerStatIncrementer t(bindReturnValueTime);
+  dependency->bindSummaryReturnValue(site, callHistory->getHistory(),
+                                     arguments, returnValue);
+}
+
+bool TxTreeNode::executeBulkMemory(llvm::CallInst *site,
+                                   std::vector<ref<Expr> > &arguments,
+                                   ref<Expr> returnValue) {
+  TxTimerStatIncrementer t(executeTime);
+  return dependency->executeBulkMemory(site, callHistory->getHistory(),
+                                       arguments, returnValue);
+}
+
+const TxStore *TxTreeNode::getStoredExpressions(bool &leftRetrieval) const {
+  TxTimerStatIncrementer t(getStoredExpressionsTime);
 
   // Since a program point index is a first statement in a basic block,
   // the allocations to be stored in subsumption table should be obtained
   // from the parent node.
-  if (parent) {
-    dependency->getParentStoredExpressions(
-        _callHistory, dummySubstitution, dummyReplacements, false,
-        leftRetrieval, __internalStore, __concretelyAddressedHistoricalStore,
-        __symbolicallyAddressedHistoricalStore);
-  }
+  leftRetrieval = false;
+  if (!parent)
+    return 0;
+  return dependency->getParentStore(leftRetrieval);
 }
 
 void TxTreeNode::getStoredCoreExpressions(
@@ -3085,7 +4968,7 @@ void TxTreeNode::getStoredCoreExpressions(
     TxStore::LowerInterpolantStore &concretelyAddressedHistoricalStore,
     TxStore::LowerInterpolantStore &symbolicallyAddressedHistoricalStore)
     const {
-  TimerStatIncrementer t(getStoredCoreExpressionsTime);
+  TxTimerStatIncrementer t(getStoredCoreExpressionsTime);
 
   // Since a program point index is a first statement in a basic block,
   // the allocations to be stored in subsumption table should be obtained
@@ -3142,8 +5025,8 @@ void TxTreeNode::print(llvm::raw_ostream &stream,
   }
   stream << tabsNext << "Call history:\n";
   for (std::vector<llvm::Instruction *>::const_reverse_iterator
-           it = callHistory.rbegin(),
-           ie = callHistory.rend();
+           it = callHistory->getHistory().rbegin(),
+           ie = callHistory->getHistory().rend();
        it != ie; ++it) {
     stream << tabsNext;
     (*it)->print(stream);
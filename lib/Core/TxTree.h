@@ -23,20 +23,165 @@
 #include "klee/Solver.h"
 #include "klee/Statistic.h"
 #include "klee/TimerStatIncrementer.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/util/TxTreeGraph.h"
 
 #include "StatsTracker.h"
+#include "TxArena.h"
 #include "TxDependency.h"
+#include "TxInstructionTrace.h"
 #include "TxSpeculation.h"
 #include "TxWP.h"
 #include "llvm/IR/GlobalValue.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <deque>
+
 namespace klee {
 
+class Assignment;
+
+class TimingSolver;
+
 class TxWeakestPreCondition;
 
+class TxTreeNode;
+
+/// \brief The timer of the TracerX profiling statistics, which times one in
+/// every -tx-timer-sampling calls, as the statistics time per-instruction
+/// hooks
+class TxTimerStatIncrementer : public SampledTimerStatIncrementer {
+public:
+  TxTimerStatIncrementer(Statistic &statistic)
+      : SampledTimerStatIncrementer(statistic, TxTimerSampling, TxCycleTimer) {}
+};
+
+/// \brief The values of the phi nodes at the start of the basic block of a
+/// node.
+///
+/// The values are kept in slots indexed by the position of the phi node in
+/// the block, a slot being null when its phi node has no value. The
+/// fingerprint combines the hashes of the values, such that two sets of
+/// values that differ are mostly told apart without comparing them.
+class TxPhiValues {
+  std::vector<ref<Expr> > values;
+
+  mutable uint64_t fingerprint;
+
+  mutable bool fingerprintValid;
+
+public:
+  TxPhiValues() : fingerprint(0), fingerprintValid(true) {}
+
+  void set(unsigned slot, ref<Expr> value);
+
+  /// \brief Whether no phi node has a value
+  bool empty() const { return values.empty(); }
+
+  unsigned size() const { return values.size(); }
+
+  ref<Expr> operator[](unsigned slot) const {
+    return slot < values.size() ? values[slot] : ref<Expr>();
+  }
+
+  /// \brief Whether every slot has a value
+  bool isComplete() const;
+
+  uint64_t getFingerprint() const;
+
+  uint64_t getByteSize() const { return values.capacity() * sizeof(ref<Expr>); }
+
+  bool operator==(const TxPhiValues &other) const;
+
+  bool operator!=(const TxPhiValues &other) const { return !(*this == other); }
+};
+
+/// \brief The stores of a state that is checked for subsumption.
+///
+/// The stores are those of the parent node of the state, and are retrieved
+/// on the first access, as many checks fail before looking at them, for
+/// example at the global check or on an empty interpolant. The view then
+/// shares the stores of the parent for the duration of the check instead of
+/// copying them, such that an allocation context is only looked up when an
+/// entry needs it.
+class TxStateStoreView {
+  const TxTreeNode *node;
+
+  /// \brief The store of the parent, or null when not yet retrieved or when
+  /// the node is the root
+  const TxStore *store;
+
+  bool retrieved;
+
+  /// \brief A solution of the path condition of the state, or null when not
+  /// yet computed or when the solver failed
+  Assignment *model;
+
+  bool modelComputed;
+
+  /// \brief The values the phi nodes at the start of the block of the state
+  /// take from the predecessor block
+  TxPhiValues incomingPhiValues;
+
+  bool incomingPhiValuesComputed;
+
+  static const TxStore::TopStateStore emptyTopStore;
+
+  static const TxStore::LowerStateStore emptyLowerStore;
+
+  void retrieve();
+
+public:
+  explicit TxStateStoreView(const TxTreeNode *_node)
+      : node(_node), store(0), retrieved(false), model(0),
+        modelComputed(false), incomingPhiValuesComputed(false) {}
+
+  ~TxStateStoreView();
+
+  /// \brief A solution of the path condition of the state, computed on the
+  /// first call for all the entries checked, or null if the solver failed
+  const Assignment *getModel(TimingSolver *solver, ExecutionState &state,
+                             double timeout);
+
+  const TxStore::TopStateStore &getInternalStore() {
+    retrieve();
+    return store ? store->getInternalStore() : emptyTopStore;
+  }
+
+  /// \brief The values of the phi nodes at the start of the block of the
+  /// state, computed from the values map of the parent on the first call
+  /// for all the entries checked. A slot is null when the value of the
+  /// incoming operand is not known.
+  const TxPhiValues &getIncomingPhiValues(ExecutionState &state);
+
+  /// \brief The store of an allocation context, or null if the context is
+  /// not in the internal store
+  const TxStore::MiddleStateStore *find(ref<TxAllocationContext> context) {
+    const TxStore::TopStateStore &internalStore = getInternalStore();
+    TxStore::TopStateStore::const_iterator it = internalStore.find(context);
+    return it == internalStore.end() ? 0 : &it->second;
+  }
+
+  /// \brief The fingerprint of the stores, zero for the root
+  uint64_t getFingerprint() {
+    retrieve();
+    return store ? store->getFingerprint() : 0;
+  }
+
+  const TxStore::LowerStateStore &getConcretelyAddressedHistoricalStore() {
+    retrieve();
+    return store ? store->getConcretelyAddressedHistoricalStore()
+                 : emptyLowerStore;
+  }
+
+  const TxStore::LowerStateStore &getSymbolicallyAddressedHistoricalStore() {
+    retrieve();
+    return store ? store->getSymbolicallyAddressedHistoricalStore()
+                 : emptyLowerStore;
+  }
+};
+
 /// \brief The subsumption table.
 ///
 /// This is the database of states that have been generalized by the
@@ -51,6 +196,8 @@ class TxWeakestPreCondition;
 ///
 /// \see TxSubsumptionTableEntry
 class TxSubsumptionTable {
+  friend class TxTableFile;
+
   typedef std::deque<TxSubsumptionTableEntry *>::const_reverse_iterator
   EntryIterator;
 
@@ -58,13 +205,26 @@ class TxSubsumptionTable {
     class Node {
       friend class CallHistoryIndexedTable;
 
+      /// \brief The children of a node, sorted by their call instructions
+      typedef std::vector<std::pair<llvm::Instruction *, Node *> > Children;
+
       llvm::Instruction *id;
 
       std::deque<TxSubsumptionTableEntry *> entryList;
 
-      std::map<llvm::Instruction *, Node *> next;
+      Children next;
+
+      /// \brief Whether the hit rates of the entries changed since the list
+      /// was last sorted, under -subsumption-entry-order=hit-rate
+      bool unsorted;
+
+      Node(llvm::Instruction *_id) : id(_id), unsorted(false) {}
+
+      static bool lessCall(const std::pair<llvm::Instruction *, Node *> &child,
+                           llvm::Instruction *call);
 
-      Node(llvm::Instruction *_id) : id(_id) {}
+      /// \brief The child of the call, or null
+      Node *getChild(llvm::Instruction *call) const;
 
       void dump() const {
         this->print(llvm::errs());
@@ -78,23 +238,83 @@ class TxSubsumptionTable {
       void print(llvm::raw_ostream &stream, const std::string &prefix, int debugSubsumptionLevel) const;
     };
 
+    /// \brief The nodes of the table, allocated together and only released
+    /// with the table. The first one is the root.
+    mutable std::deque<Node> nodes;
+
     Node *root;
 
+    /// \brief The nodes of the interned call histories, by their ids, so
+    /// that the nodes of the histories seen are found without walking the
+    /// tree
+    mutable std::map<unsigned, Node *> nodeOfHistory;
+
+    /// \brief The number of entries in this table
+    unsigned entryCount;
+
+    /// \brief The node of a call history, created if not found and create
+    /// is set, or null
+    Node *getNode(const TxCallHistory *callHistory, bool create) const;
+
     void printNode(llvm::raw_ostream &stream, Node *n, std::string edges, int debugSubsumptionLevel) const;
 
   public:
-    CallHistoryIndexedTable() { root = new Node(0); }
+    CallHistoryIndexedTable() : entryCount(0) {
+      nodes.push_back(Node(0));
+      root = &nodes.front();
+    }
+
+    ~CallHistoryIndexedTable() { clearTree(); }
+
+    /// \brief Delete the entries of all the nodes
+    void clearTree();
 
-    ~CallHistoryIndexedTable() { clearTree(root); }
+    /// \brief The interpolant conjuncts and the store values of the entries
+    /// of the program point, under -subsumption-entry-interning, so that the
+    /// equal ones of different entries share a single copy
+    ExprHashSet conjunctPool;
+    std::map<ref<TxVariable>, std::vector<ref<TxInterpolantValue> > >
+    valuePool;
 
-    void clearTree(Node *node);
+    /// \brief Drop the pooled conjuncts and values that no entry refers to
+    void purgePools();
 
-    void insert(const std::vector<llvm::Instruction *> &callHistory,
-                TxSubsumptionTableEntry *entry);
+    /// \brief Insert the entry, unless -subsumption-entry-pruning is set and
+    /// an entry of the call history is at least as general, in which case
+    /// false is returned. The entries of the call history the inserted entry
+    /// is at least as general as are then removed into pruned, without
+    /// deleting them.
+    bool insert(const TxCallHistory *callHistory,
+                TxSubsumptionTableEntry *entry,
+                std::vector<TxSubsumptionTableEntry *> &pruned);
 
     std::pair<EntryIterator, EntryIterator>
-    find(const std::vector<llvm::Instruction *> &callHistory,
-         bool &found) const;
+    find(const TxCallHistory *callHistory, bool &found) const;
+
+    /// \brief Reorder the entries of the given call history according to
+    /// -subsumption-entry-order, given the entry that has just subsumed a
+    /// state, if any. The order by hit rate is only restored by the next
+    /// find of the call history.
+    void reorder(const TxCallHistory *callHistory,
+                 TxSubsumptionTableEntry *hitEntry);
+
+    /// \brief The number of failed checks of the entries of this table
+    uint64_t getMissCount() const;
+
+    unsigned size() const { return entryCount; }
+
+    /// \brief Collect all the entries of this table, for all call histories
+    void getEntries(std::vector<TxSubsumptionTableEntry *> &entries) const;
+
+    /// \brief Collect all the entries of this table with their call
+    /// histories
+    void getEntries(
+        std::vector<std::pair<std::vector<llvm::Instruction *>,
+                              TxSubsumptionTableEntry *> > &entries) const;
+
+    /// \brief Remove the given entries from this table, without deleting
+    /// them.
+    void erase(const std::set<TxSubsumptionTableEntry *> &victims);
 
     void dump() const {
       this->print(llvm::errs());
@@ -106,18 +326,218 @@ class TxSubsumptionTable {
 
   static std::map<uintptr_t, CallHistoryIndexedTable *> instance;
 
+  /// \brief The estimated size in bytes of all the entries in the table
+  static uint64_t tableSize;
+
+  /// \brief The number of entries ever inserted into the table
+  static uint64_t insertionCount;
+
+  /// \brief Eviction statistics: the number of evicted entries, their
+  /// estimated size in bytes, and the number of subsumptions they had
+  /// achieved before eviction.
+  static uint64_t evictedEntryCount;
+  static uint64_t evictedSize;
+  static uint64_t evictedHitCount;
+
+  /// \brief The number of entries removed from the table under
+  /// -subsumption-entry-pruning
+  static uint64_t prunedEntryCount;
+
+  /// \brief The number of entries not inserted into the table under
+  /// -subsumption-entry-pruning, for an entry at least as general
+  static uint64_t redundantEntryCount;
+
+  /// \brief The sum of the subtree sizes of the entries over the states they
+  /// subsumed
+  static uint64_t prunedSubtreeNodes;
+
+  /// \brief The number of interpolant conjuncts and store values of inserted
+  /// entries replaced by those of earlier entries, under
+  /// -subsumption-entry-interning
+  static uint64_t internedConjunctCount;
+  static uint64_t internedValueCount;
+
+  /// \brief Replace the conjuncts of the expression by the equal ones of the
+  /// pool, adding those not found
+  static ref<Expr> internConjuncts(ExprHashSet &pool, ref<Expr> expr);
+
+  /// \brief Replace the values of the store by the equivalent ones of the
+  /// pool, adding those not found
+  static void internValues(CallHistoryIndexedTable *subTable,
+                           TxStore::LowerInterpolantStore &store);
+
+  /// \brief Replace the interpolant conjuncts and the store values of the
+  /// entry by those of the earlier entries of the program point
+  static void intern(CallHistoryIndexedTable *subTable,
+                     TxSubsumptionTableEntry *entry);
+
+  /// \brief The number of entries merged into a new entry at a loop header,
+  /// under -loop-entry-generalization
+  static uint64_t generalizedEntryCount;
+
+  /// \brief The bounds lo <= e <= hi the conjuncts of an interpolant put on
+  /// a single expression e, when each conjunct is an equality or an
+  /// unsigned comparison of e with a constant
+  static bool getBounds(const std::set<ref<Expr> > &conjuncts, ref<Expr> &e,
+                        uint64_t &lo, uint64_t &hi);
+
+  /// \brief The backoff state of the checks at a program point: the number
+  /// of consecutive failed checks, the current gap in checks, the number of
+  /// checks still to skip, and the total number of skipped checks
+  struct PointBackoff {
+    unsigned failureCount;
+    unsigned gap;
+    unsigned countdown;
+    uint64_t skipCount;
+
+    PointBackoff() : failureCount(0), gap(0), countdown(0), skipCount(0) {}
+  };
+
+  /// \brief The backoff states of the program points, under
+  /// -subsumption-backoff
+  static std::map<uintptr_t, PointBackoff> backoffs;
+
+  static uint64_t backoffSkipCount;
+
+  /// \brief The timing of the entry checks at a program point, under
+  /// -subsumption-adaptive-timeout: the longest time of a successful check
+  /// in microseconds, and the number of consecutive checks that ran to their
+  /// timeout since the last success
+  struct PointTiming {
+    uint64_t maxHitTime;
+    unsigned timedOutCount;
+
+    PointTiming() : maxHitTime(0), timedOutCount(0) {}
+  };
+
+  static std::map<uintptr_t, PointTiming> timings;
+
+  /// \brief The total and the number of the subtree sizes of the inserted
+  /// entries, for their mean
+  static uint64_t subtreeSizeSum;
+  static uint64_t subtreeSizeCount;
+
+  /// \brief The number of entry checks given a shorter, or a longer,
+  /// timeout than the global one
+  static uint64_t shortenedTimeoutCount;
+  static uint64_t lengthenedTimeoutCount;
+
+  /// \brief The timeout of a check at the program point by the entry, or by
+  /// any entry if null, adapted from the global timeout
+  static double getAdaptiveTimeout(uintptr_t programPoint,
+                                   const TxSubsumptionTableEntry *entry,
+                                   double timeout);
+
+  /// \brief Record the outcome and the time in microseconds of a check at the
+  /// program point given the timeout
+  static void recordTiming(uintptr_t programPoint, bool hit, uint64_t time,
+                           double timeout);
+
+  /// \brief The table entries, by node sequence number, that failed to
+  /// subsume the states of a fingerprint, under -subsumption-failure-sharing.
+  /// A state with the fingerprint of an earlier state, typically a sibling
+  /// reaching the same join point, skips those entries without building
+  /// their queries. Only failures are shared, as a subsumption also marks
+  /// the interpolant of the subsumed state. A fingerprint collision then
+  /// only misses subsumptions.
+  static std::map<uint64_t, std::set<uint64_t> > failedChecks;
+
+  static uint64_t sharedFailureSkipCount;
+
+  /// \brief The fingerprint of the program point, the call history, the path
+  /// condition and the stores of a state
+  static uint64_t getFingerprint(ExecutionState &state,
+                                 TxStateStoreView &stateStore);
+
+  /// \brief Check the state against the given entries of the table
+  static bool checkEntries(TimingSolver *solver, ExecutionState &state,
+                           double timeout, CallHistoryIndexedTable *subTable,
+                           std::pair<EntryIterator, EntryIterator> iterPair,
+                           int debugSubsumptionLevel);
+
+  /// \brief Whether the first entry should be evicted before the second
+  /// under -subsumption-eviction-policy
+  static bool evictBefore(const TxSubsumptionTableEntry *a,
+                          const TxSubsumptionTableEntry *b);
+
+  /// \brief Evict entries until the table size is at most the target size,
+  /// never evicting the kept entry.
+  ///
+  /// \return The estimated number of bytes freed
+  static uint64_t evict(uint64_t targetSize, TxSubsumptionTableEntry *keep);
+
+  /// \brief Account for, and delete, an entry removed from the table
+  static void deleteEvicted(TxSubsumptionTableEntry *entry);
+
+  /// \brief Mark the node as subsumed by the table entry, and reorder the
+  /// table entries.
+  static void markSubsumed(CallHistoryIndexedTable *subTable,
+                           TxTreeNode *txTreeNode,
+                           TxSubsumptionTableEntry *entry);
+
 public:
-  static void insert(uintptr_t id,
-                     const std::vector<llvm::Instruction *> &callHistory,
+  /// \brief Insert the entry at the program point, returning false when it
+  /// is not inserted for being redundant, in which case the caller still
+  /// owns it
+  static bool insert(uintptr_t id, const TxCallHistory *callHistory,
                      TxSubsumptionTableEntry *entry);
 
+  /// \brief Under -loop-entry-generalization, merge into the entry to be
+  /// inserted an entry of the call history with the same stores, whose
+  /// interpolant only differs from that of the entry in the bounds on one
+  /// expression, when the union of the bounds is an interval. The interpolant
+  /// of the entry becomes the common conjuncts with the interval, which is
+  /// equivalent to the disjunction of both interpolants, and the merged
+  /// entry is removed from the table.
+  static void generalize(uintptr_t id, const TxCallHistory *callHistory,
+                         TxSubsumptionTableEntry *entry);
+
   static bool check(TimingSolver *solver, ExecutionState &state, double timeout,
                     int debugSubsumptionLevel);
 
   static bool hasInterpolation(ExecutionState &state);
 
+  /// \brief Whether the table has entries for the program point, regardless
+  /// of call history
+  static bool hasEntries(uintptr_t programPoint) {
+    return instance.find(programPoint) != instance.end();
+  }
+
   static void clear();
 
+  /// \brief Whether to estimate the size of the entries even without a
+  /// budget of the table, for the live metrics
+  static bool trackSize;
+
+  /// \brief The number of entries in the table
+  static uint64_t getEntryCount();
+
+  /// \brief The estimated size in bytes of the entries in the table, when
+  /// tracked
+  static uint64_t getSize() { return tableSize; }
+
+  /// \brief The number of entries ever inserted into the table, which is
+  /// the insertion number of the latest one
+  static uint64_t getInsertionCount() { return insertionCount; }
+
+  /// \brief The number of the entry in the order of insertion
+  static uint64_t getInsertionNumber(const TxSubsumptionTableEntry *entry) {
+    return entry->insertionNumber;
+  }
+
+  /// \brief The sum of the subtree sizes of the entries over the states they
+  /// subsumed, estimating the number of nodes pruned by subsumption
+  static uint64_t getPrunedSubtreeNodes() { return prunedSubtreeNodes; }
+
+  /// \brief Evict entries to reduce the table to the given fraction of its
+  /// current size, to relieve memory pressure.
+  ///
+  /// \return The estimated number of bytes freed
+  static uint64_t shrink(double fraction);
+
+  /// \brief For printing the statistics of failed entry checks
+  static void printStat(std::stringstream &stream);
+
   static void print(llvm::raw_ostream &stream) {
     for (std::map<uintptr_t, CallHistoryIndexedTable *>::const_iterator
              it = instance.begin(),
@@ -161,17 +581,88 @@ public:
 class TxSubsumptionTableEntry {
   friend class TxTree;
 
+  friend class TxTableFile;
+
+  friend class TxSubsumptionTable;
+
 #ifdef ENABLE_Z3
   /// \brief Mark begin and end of subsumption check for use within a scope
   struct SubsumptionCheckMarker {
     SubsumptionCheckMarker() { Z3Solver::subsumptionCheck = true; }
     ~SubsumptionCheckMarker() { Z3Solver::subsumptionCheck = false; }
   };
+
+  /// \brief The Z3 solver of the existentially-quantified checks, created by
+  /// the first one and deleted with the tree
+  static Z3Solver *existentialSolver;
+
+  /// \brief The Z3 solver owning the contexts of the concurrent checks,
+  /// created by the first batch and deleted with the tree
+  static Z3Solver *concurrentSolver;
 #endif
 
+  /// \brief The result of the solver-free part of a subsumption check
+  enum CheckStatus { CheckFailure, CheckSuccess, CheckPending };
+
+  /// \brief A subsumption check waiting for the validity of its query
+  /// expression to be decided by the solver
+  struct PendingCheck {
+    /// \brief The query expression
+    ref<Expr> expr;
+
+    /// \brief Whether the query was built from an existentially-quantified
+    /// expression
+    bool existential;
+
+    /// \brief The instantiated weakest precondition of the entry, to be
+    /// decided with the query expression, or null
+    ref<Expr> wpCondition;
+
+    /// \brief Non-pointer / exact pointer values to be marked as in the
+    /// interpolant
+    std::set<ref<TxStateValue> > coreValues;
+
+    /// \brief Pointer values in the core for memory bounds interpolation
+    std::map<ref<TxStateValue>, std::set<uint64_t> > corePointerValues;
+
+    /// \brief The hash of the query expression and of the path condition of
+    /// the state, and the path condition sorted by expression hash, as the
+    /// key of the query result cache
+    uint64_t queryHash;
+    std::vector<ref<Expr> > sortedConstraints;
+
+    PendingCheck() : existential(false), queryHash(0) {}
+  };
+
+  /// \brief A query result decided by the solver for this entry
+  struct CachedQuery {
+    ref<Expr> expr;
+    std::vector<ref<Expr> > sortedConstraints;
+    bool valid;
+    std::vector<ref<Expr> > unsatCore;
+  };
+
   static Statistic concretelyAddressedStoreExpressionBuildTime;
   static Statistic symbolicallyAddressedStoreExpressionBuildTime;
   static Statistic solverAccessTime;
+  static Statistic prefilterRejectionCount;
+  static Statistic modelRefutationCount;
+  static Statistic queryCacheHitCount;
+  static Statistic groupCacheHitCount;
+
+  /// \brief The result of a group of conjuncts of a query decided by
+  /// decidePartitioned
+  struct GroupResult {
+    bool valid;
+    std::vector<ref<Expr> > unsatCore;
+  };
+
+  /// \brief The results of the groups decided for the path condition of the
+  /// node with sequence number groupCacheNode and groupCacheConstraints
+  /// constraints, shared by the entries checked for it
+  static std::map<ref<Expr>, GroupResult> groupCache;
+  static uint64_t groupCacheNode;
+  static size_t groupCacheConstraints;
 
   ref<Expr> interpolant;
 
@@ -187,12 +678,150 @@ class TxSubsumptionTableEntry {
 
   std::set<ref<TxStoreEntry> > markedGlobal;
 
+  /// \brief A global of markedGlobal with its value in the initial state
+  struct GlobalSnapshot {
+    const MemoryObject *object;
+
+    /// \brief The contents of the object in the initial state. As the
+    /// initial state is a copy, a state writing to the object has other
+    /// contents, so that the value only needs to be read from a state that
+    /// has not the same contents.
+    const ObjectState *initialContents;
+
+    ref<Expr> offset;
+    Expr::Width width;
+    ref<Expr> initialValue;
+  };
+
+  /// \brief The snapshot of markedGlobal, built at the first check as the
+  /// globals are not resolved in the initial state before
+  std::vector<GlobalSnapshot> globalSnapshot;
+  bool globalSnapshotBuilt;
+
+  /// \brief Whether a global of markedGlobal is not in the initial state,
+  /// failing every check
+  bool globalSnapshotUnresolved;
+
+  /// \brief Build globalSnapshot from markedGlobal
+  void buildGlobalSnapshot();
+
+  /// \brief Whether the marked globals have their initial values in the
+  /// state
+  bool checkGlobals(const ExecutionState &state);
+
   std::set<const Array *> existentials;
 
   // Used to ensure at subsumption the value of the phiNodes in the subsumed
   // tree remain the same
   uintptr_t prevProgramPoint;
-  std::map<llvm::Value *, std::vector<ref<Expr> > > phiValues;
+  TxPhiValues phiValues;
+
+  /// \brief The allocation contexts of both the concretely- and
+  /// symbolically-addressed stores, all of which have to be found in the
+  /// state for the subsumption to hold.
+  std::vector<ref<TxAllocationContext> > signatureContexts;
+
+  /// \brief The variables of the historical concretely-addressed store, all
+  /// of which have to be found in the historical stores of the state.
+  std::vector<ref<TxVariable> > signatureHistoricalVariables;
+
+  /// \brief A bloom filter of the free (non-existential, symbolic) arrays of
+  /// the interpolant.
+  uint64_t interpolantArraySignature;
+
+  /// \brief Recompute the signature fields from the interpolant and the
+  /// stores of this entry.
+  void computeSignature();
+
+  /// \brief The numbers of successful and failed subsumption checks by this
+  /// entry, and the total time of the checks in microseconds
+  uint64_t hitCount;
+  uint64_t missCount;
+  uint64_t checkTime;
+
+  /// \brief The time of the last successful use of this entry, or of its
+  /// creation, in number of uses of any entry
+  uint64_t lastUse;
+
+  /// \brief The estimated size in bytes of this entry, computed when the
+  /// entry is inserted into the table
+  uint64_t size;
+
+  /// \brief The number of this entry in the order of insertion into the
+  /// table, or zero when not inserted
+  uint64_t insertionNumber;
+
+  /// \brief The clock in number of creations and successful uses of entries
+  static uint64_t useClock;
+
+  /// \brief The solver results of the subsumption queries of this entry,
+  /// indexed by PendingCheck::queryHash
+  std::multimap<uint64_t, CachedQuery> queryCache;
+
+  /// \brief Make the pending check decide the weakest precondition alone,
+  /// when the rest of the check succeeded without the solver
+  static CheckStatus checkWPConditionOnly(PendingCheck &pending);
+
+  /// \brief Conjoin the weakest precondition of the pending check with its
+  /// query expression, inside the quantifier of an existential query
+  static void addWPCondition(PendingCheck &pending);
+
+  /// \brief Compute the key of the query result cache into the pending check
+  static void computeQueryKey(ExecutionState &state, PendingCheck &pending);
+
+  /// \brief Find the cached result of the pending query, or return null
+  const CachedQuery *findQueryResult(const PendingCheck &pending) const;
+
+  /// \brief Cache the solver result of the pending query
+  void storeQueryResult(const PendingCheck &pending, bool valid,
+                        const std::vector<ref<Expr> > &unsatCore);
+
+  /// \brief The output of -log-subsumption-queries, or null
+  static llvm::raw_ostream *queryLog;
+
+  /// \brief The number of subsumption queries logged
+  static uint64_t loggedQueryCount;
+
+  /// \brief Log a subsumption query with its outcome and time in seconds
+  void logQuery(ExecutionState &state, ref<Expr> expr, const char *outcome,
+                double time) const;
+
+  /// \brief Record the outcome and the time of a subsumption check
+  void recordCheck(bool hit, uint64_t time) {
+    if (hit) {
+      ++hitCount;
+      lastUse = ++useClock;
+    } else {
+      ++missCount;
+    }
+    checkTime += time;
+  }
+
+  /// \brief Estimate the number of bytes retained by this entry. Expressions
+  /// shared with other entries are counted in each of them.
+  uint64_t estimateSize() const;
+
+  /// \brief Whether this entry has the same stores, existentials, globals,
+  /// phi values and weakest precondition as the other entry
+  bool hasSameContext(const TxSubsumptionTableEntry *other) const;
+
+  /// \brief Whether this entry subsumes every state the other entry of the
+  /// same program point and call history subsumes, as it has the same stores
+  /// and existentials, and a subset of the conjuncts of its interpolant. This
+  /// is a syntactic check only.
+  bool isAtLeastAsGeneralAs(const TxSubsumptionTableEntry *other) const;
+
+  /// \brief The estimated probability of a successful check by this entry
+  double getHitRate() const {
+    return (hitCount + 1.0) / (hitCount + missCount + 2.0);
+  }
+
+  /// \brief Order of the entries in a table such that trying the last
+  /// element first tries the best entry first.
+  static bool lowerHitRate(const TxSubsumptionTableEntry *a,
+                           const TxSubsumptionTableEntry *b) {
+    return a->getHitRate() < b->getHitRate();
+  }
 
   /// \brief A procedure for building subsumption check constraints using
   /// symbolically-addressed store elements
@@ -283,15 +912,6 @@ class TxSubsumptionTableEntry {
   static ref<Expr> simplifyArithmeticBody(ref<Expr> existsExpr,
                                           bool &hasExistentialsOnly);
 
-  /// \brief Function to collect substitution from a conjunction of equalities.
-  static void getSubstitution(std::set<const Array *> &existentials,
-                              ref<Expr> equalities,
-                              std::map<ref<Expr>, ref<Expr> > &map);
-
-  /// \brief Function to remove equalities whose lhs is a variable in the set.
-  static ref<Expr> removeUnsubstituted(std::set<const Array *> &variables,
-                                       ref<Expr> equalities);
-
   static void interpolateValues(
       ExecutionState &state, std::set<ref<TxStateValue> > &coreValues,
       std::map<ref<TxStateValue>, std::set<uint64_t> > &corePointerValues,
@@ -302,25 +922,98 @@ class TxSubsumptionTableEntry {
            symbolicallyAddressedStore.empty();
   }
 
+  /// \brief Perform the subsumption check up to, but excluding, the call to
+  /// the solver for deciding the validity of the query expression.
+  ///
+  /// \return CheckPending when the solver has to be called, in which case the
+  /// query is stored in the pending argument, otherwise whether the check
+  /// succeeded without the solver.
+  CheckStatus prepareSubsumption(
+      TimingSolver *solver, ExecutionState &state, double timeout,
+      TxStateStoreView &stateStore, PendingCheck &pending,
+      int debugSubsumptionLevel);
+
+  /// \brief Whether the query expression is false under a solution of the
+  /// path condition of the state, with -subsumption-model-refutation, in
+  /// which case the check fails without the validity query.
+  bool isRefutedByModel(TimingSolver *solver, ExecutionState &state,
+                        double timeout, TxStateStoreView &stateStore,
+                        PendingCheck &pending, int debugSubsumptionLevel);
+
+  /// \brief Decide the validity of an unquantified query expression by its
+  /// groups of conjuncts sharing no variables, with -subsumption-partitioning.
+  /// Return false, deciding nothing, when the expression is a single group.
+  bool decidePartitioned(TimingSolver *solver, ExecutionState &state,
+                         double timeout, ref<Expr> expr, bool &success,
+                         Solver::Validity &result,
+                         std::vector<ref<Expr> > &unsatCore);
+
+  /// \brief Build the query expression of the subsumption check, the part of
+  /// prepareSubsumption before looking up the query result cache
+  CheckStatus buildSubsumptionQuery(
+      TimingSolver *solver, ExecutionState &state, double timeout,
+      TxStateStoreView &stateStore, PendingCheck &pending,
+      int debugSubsumptionLevel);
+
+  /// \brief Complete a successful pending subsumption check by marking the
+  /// interpolant of the state.
+  void completeSubsumption(ExecutionState &state, PendingCheck &pending,
+                           const std::vector<ref<Expr> > &unsatCore,
+                           int debugSubsumptionLevel);
+
+  /// \brief Decide the pending subsumption check with the solver, and
+  /// complete it when successful.
+  bool decideSubsumption(TimingSolver *solver, ExecutionState &state,
+                         double timeout, PendingCheck &pending,
+                         int debugSubsumptionLevel);
+
+  /// \brief Decide the pending subsumption checks of several entries
+  /// concurrently, and complete the first successful one. A single check is
+  /// decided with the solver instead.
+  ///
+  /// \return The entry that subsumes the state, or a null pointer if there is
+  /// none.
+  static TxSubsumptionTableEntry *
+  decideConcurrently(TimingSolver *solver, ExecutionState &state,
+                     double timeout,
+                     std::vector<TxSubsumptionTableEntry *> &entries,
+                     std::vector<PendingCheck> &pending,
+                     int debugSubsumptionLevel);
+
   /// \brief For printing member functions running time statistics,
   static void printStat(std::stringstream &stream);
 
 public:
+  /// \brief Set the output of the subsumption query log, which is then owned
+  /// by the table entries, or null to close the log
+  static void setQueryLog(llvm::raw_ostream *os) {
+    delete queryLog;
+    queryLog = os;
+  }
+
   const uintptr_t programPoint;
 
   const uint64_t nodeSequenceNumber;
 
+  /// \brief The number of nodes of the subtree that produced this entry,
+  /// counted as the nodes created while the subtree was traversed, or 0 if
+  /// unknown
+  const uint64_t subtreeSize;
+
   TxSubsumptionTableEntry(TxTreeNode *node,
                           const std::vector<llvm::Instruction *> &callHistory);
 
+  /// \brief Construct an entry reloaded from a file, which has an
+  /// interpolant over the path condition only
+  TxSubsumptionTableEntry(uintptr_t programPoint, uintptr_t prevProgramPoint,
+                          ref<Expr> interpolant,
+                          const std::set<const Array *> &existentials);
+
   ~TxSubsumptionTableEntry();
 
   bool
   subsumed(TimingSolver *solver, ExecutionState &state, double timeout,
-           bool leftRetrieval, TxStore::TopStateStore &__internalStore,
-           TxStore::LowerStateStore &__concretelyAddressedHistoricalStore,
-           TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore,
-           int debugSubsumptionLevel);
+           TxStateStoreView &stateStore, int debugSubsumptionLevel);
 
   /// Tests if the argument is a variable. A variable here is defined to be
   /// either a symbolic concatenation or a symbolic read. A concatenation in
@@ -334,18 +1027,33 @@ public:
     return llvm::isa<ConcatExpr>(expr) || llvm::isa<ReadExpr>(expr);
   }
 
+  /// \brief Compute a bloom filter of the arrays in the argument,
+  /// ignoring those in the set of excluded arrays.
+  static uint64_t
+  getArraySignature(const std::vector<const Array *> &arrays,
+                    const std::set<const Array *> &excluded);
+
+  /// \brief Cheap necessary condition for the subsumption of the state by
+  /// this entry, checked before building any constraint or calling the
+  /// solver.
+  ///
+  /// \return false if this entry cannot subsume the state, true otherwise.
+  bool mayBeSubsumed(TxStateStoreView &stateStore,
+                     uint64_t stateArraySignature) const;
+
   ref<Expr> getInterpolant() const;
 
   ref<Expr> getWPInterpolant() const;
 
-  TxStore::LowerInterpolantStore getConcretelyAddressedHistoricalStore() const;
+  const TxStore::LowerInterpolantStore &
+  getConcretelyAddressedHistoricalStore() const;
 
-  TxStore::LowerInterpolantStore
+  const TxStore::LowerInterpolantStore &
   getSymbolicallyAddressedHistoricalStore() const;
 
-  TxStore::TopInterpolantStore getConcretelyAddressedStore() const;
+  const TxStore::TopInterpolantStore &getConcretelyAddressedStore() const;
 
-  TxStore::TopInterpolantStore getSymbolicallyAddressedStore() const;
+  const TxStore::TopInterpolantStore &getSymbolicallyAddressedStore() const;
 
   std::set<const Array *> getExistentials() const;
 
@@ -451,13 +1159,22 @@ class TxTreeNode {
 
   TxTreeNode *parent, *left, *right;
 
+  /// \brief The state of a leaf node, as set when the node is created by
+  /// TxTreeNode#split, used to find the states of a subtree without
+  /// scanning all the states. It is only valid while the state points back
+  /// to the node.
+  ExecutionState *state;
+
   uintptr_t programPoint;
   llvm::BasicBlock *basicBlock;
 
+  /// The dense number of basicBlock, see KInstruction::basicBlockId
+  unsigned basicBlockId;
+
   // Used to ensure at subsumption the value of the phiNodes in the subsumed
   // tree remain the same
   uintptr_t prevProgramPoint;
-  std::map<llvm::Value *, std::vector<ref<Expr> > > phiValues;
+  TxPhiValues phiValues;
   bool phiValuesFlag;
 
   uint64_t nodeSequenceNumber;
@@ -470,6 +1187,10 @@ class TxTreeNode {
   /// \brief For statistics on the number of instructions executed along a path.
   uint64_t instructionsDepth;
 
+  /// \brief The number of instructions executed in the run when the node was
+  /// created, for the lifetimes sampled with -sample-node-memory
+  uint64_t creationInstruction;
+
   /// \brief The data layout of the analysis target
   llvm::DataLayout *targetData;
 
@@ -478,17 +1199,42 @@ class TxTreeNode {
   /// is just a pointer to the one in klee::Executor.
   std::map<const llvm::GlobalValue *, ref<ConstantExpr> > *globalAddresses;
 
+  /// \brief The latest copies in the store of the variables of the weakest
+  /// preconditions, and the instantiations of the weakest preconditions and
+  /// of their subexpressions, made during a subsumption check of the node.
+  /// The entries checked at a program point often share the variables and
+  /// the subexpressions, so that each is instantiated once per check.
+  std::map<llvm::Value *, ref<TxAllocationContext> > wpVariableAddresses;
+  ExprHashMap<ref<Expr> > wpInstantiations;
+
+  /// \brief The latest copy of the variable in the store of the dependency
+  ref<TxAllocationContext> getWPVariableAddress(llvm::Value *address,
+                                                TxDependency *dependency);
+
+  /// \brief Instantiate the expression without looking up its cached
+  /// instantiation
+  ref<Expr> instantiateWPExpr(ref<Expr> wpInterpolant,
+                              TxDependency *dependency);
+
   /// \brief Indicates that a generic error was encountered in this node
   bool genericEarlyTermination;
 
+  /// \brief Indicates that the state of this node, or of an ancestor, was
+  /// merged with another state. The path condition and the store of the
+  /// node are then those of one of the merged states only, so that the node
+  /// is neither checked for subsumption nor given a table entry.
+  bool merged;
+
   bool assertionFail;
   bool emitAllErrors;
 
-  void setProgramPoint(llvm::Instruction *instr, llvm::Instruction *prevInstr) {
+  void setProgramPoint(KInstruction *ki, llvm::Instruction *prevInstr) {
+    llvm::Instruction *instr = ki->inst;
     if (!programPoint) {
       programPoint = reinterpret_cast<uintptr_t>(instr);
       prevProgramPoint = reinterpret_cast<uintptr_t>(prevInstr);
       basicBlock = instr->getParent();
+      basicBlockId = ki->basicBlockId;
     }
 
     // Disabling the subsumption check within KLEE's own API
@@ -497,6 +1243,10 @@ class TxTreeNode {
     // storable.
     storable = !(instr->getParent()->getParent()->getName().substr(0, 5).equals(
                     "klee_"));
+
+    // Entries are also only stored, and checked, at the selected points
+    if (!subsumptionPoints.empty() && !subsumptionPoints[basicBlockId])
+      storable = false;
   }
 
   /// \brief for printing member function running time statistics
@@ -513,6 +1263,15 @@ class TxTreeNode {
 
   ~TxTreeNode();
 
+  /// \brief Allocate from the TxTreeNode arena
+  static void *operator new(size_t size) {
+    return TxArena::get<TxTreeNode>("TxTreeNode").allocate(size);
+  }
+
+  static void operator delete(void *p, size_t size) {
+    TxArena::get<TxTreeNode>("TxTreeNode").deallocate(p, size);
+  }
+
   static TxTreeNode *createRoot(llvm::DataLayout *targetData,
                                 std::map<const llvm::GlobalValue *,
                                          ref<ConstantExpr> > *globalAddresses) {
@@ -532,6 +1291,14 @@ class TxTreeNode {
   }
 
 public:
+  /// \brief The basic blocks selected by -subsumption-points, by basic block
+  /// id, or empty when all program points are selected
+  static std::vector<bool> subsumptionPoints;
+
+  /// \brief The loop headers, by basic block id, under
+  /// -loop-entry-generalization
+  static std::vector<bool> loopHeaders;
+
   bool isSubsumed;
 
   // \brief The unsat core from a infeasible path is temporarily stored here
@@ -547,41 +1314,49 @@ public:
     return globalAddresses;
   }
 
-  /// \brief List of the instructions in the node in a reverse order (used only
-  /// in WP interpolation)
-  /// Second argument is 0 means instruction is not dependent to any target
-  /// Second argument is 1 means instruction is dependent to a target
-  /// Second argument is 2 means negation of the instruction is dependent to a
-  /// target
-  std::vector<std::pair<KInstruction *, int> > reverseInstructionList;
+  /// \brief The instructions executed in the node, with the marks of the
+  /// branches whose condition or negated condition is needed by a target
+  /// (used only in WP interpolation)
+  TxInstructionTrace reverseInstructionList;
   std::map<llvm::Instruction *, unsigned> phiNodeArg;
 
-  /// \brief The entry call history
-  std::vector<llvm::Instruction *> entryCallHistory;
+  /// \brief The entry call history, shared with the nodes of the same
+  /// history
+  const TxCallHistory *entryCallHistory;
 
-  /// \brief The current call history
-  std::vector<llvm::Instruction *> callHistory;
+  /// \brief The current call history, shared with the nodes of the same
+  /// history
+  const TxCallHistory *callHistory;
 
   uintptr_t getProgramPoint() { return programPoint; }
   llvm::BasicBlock *getBasicBlock() { return basicBlock; }
 
+  unsigned getBasicBlockId() { return basicBlockId; }
+
   uintptr_t getPrevProgramPoint() { return prevProgramPoint; }
 
   TxTreeNode *getParent() { return parent; }
 
+  /// \brief Whether the subtree of the sibling of this node is still being
+  /// traversed
+  bool hasLiveSibling() { return parent && parent->left && parent->right; }
+
   bool getPhiValuesFlag() { return phiValuesFlag; }
 
   void setPhiValuesFlag(bool _phiValuesFlag) { phiValuesFlag = _phiValuesFlag; }
 
   uint64_t getNodeSequenceNumber() { return nodeSequenceNumber; }
 
+  /// \brief The number of nodes visited so far
+  static uint64_t getVisitedNodeCount() { return nextNodeSequenceNumber - 1; }
+
   TxDependency *getDependency() { return dependency; }
 
-  std::map<llvm::Value *, std::vector<ref<Expr> > > getPhiValue() {
-    return phiValues;
-  };
+  const TxPhiValues &getPhiValue() const { return phiValues; }
 
-  void setPhiValue(llvm::Value *instr, ref<Expr> value);
+  /// \brief Record the value of a phi node at the start of the basic block
+  /// of the node, ignoring those of the later blocks
+  void setPhiValue(llvm::Instruction *instr, ref<Expr> value);
 
   /// \brief Retrieve the interpolant for this node as KLEE expression object
   ///
@@ -592,7 +1367,8 @@ public:
                            std::map<ref<Expr>, ref<Expr> > &substitution) const;
 
   // \brief This object contains the visited program points in the speculation
-  // node
+  // node. This and specTime are shared by the nodes of a speculation subtree
+  // and owned by its root.
   std::set<uintptr_t> *visitedProgramPoints;
   double *specTime;
 
@@ -616,6 +1392,9 @@ public:
   /// \brief Returning the right node
   TxTreeNode *getRight() { return right; }
 
+  /// \brief The state last attached to this node as a leaf
+  ExecutionState *getState() { return state; }
+
   /// \brief Store the solver and unsatcore temporarily, so they can be used for
   /// markings if speculation fails
   void storeSpeculationUnsatCore(TimingSolver *solver,
@@ -648,10 +1427,18 @@ public:
   ref<Expr> getBranchCondition() { return branchCondition; }
 
   // \brief Instantiates the variables in WPExpr by their latest value for the
-  // implication test.
+  // implication test. The instantiations are cached until
+  // clearWPInstantiations is called.
   ref<Expr> instantiateWPatSubsumption(ref<Expr> wpInterpolant,
                                        TxDependency *dependency);
 
+  /// \brief Clear the cached instantiations of the weakest preconditions, as
+  /// the store of the node may have changed since they were made
+  void clearWPInstantiations() {
+    wpVariableAddresses.clear();
+    wpInstantiations.clear();
+  }
+
   /// \brief Copy WP to the parent node at subsumption point
   void setWPatSubsumption(ref<Expr> _wpInterpolant);
 
@@ -678,15 +1465,24 @@ public:
   void bindReturnValue(llvm::CallInst *site, llvm::Instruction *inst,
                        ref<Expr> returnValue);
 
-  /// \brief This retrieves the allocations known at this state, and the
-  /// expressions stored in the allocations. This returns as the two last
-  /// arguments a pair of the store part indexed by constants, and the store
-  /// part indexed by symbolic expressions.
-  void getStoredExpressions(
-      const std::vector<llvm::Instruction *> &callHistory, bool &leftRetrieval,
-      TxStore::TopStateStore &__internalStore,
-      TxStore::LowerStateStore &__concretelyAddressedHistoricalStore,
-      TxStore::LowerStateStore &__symbolicallyAddressedHistoricalStore) const;
+  /// \brief This records the return value of a call given by its function
+  /// summary, which depends on the arguments of the call
+  void bindSummaryReturnValue(llvm::CallInst *site,
+                              std::vector<ref<Expr> > &arguments,
+                              ref<Expr> returnValue);
+
+  /// \brief Record a call of a memory function performed as a bulk
+  /// operation, or return false if it cannot be recorded as one
+  bool executeBulkMemory(llvm::CallInst *site,
+                         std::vector<ref<Expr> > &arguments,
+                         ref<Expr> returnValue);
+
+  /// \brief This retrieves the store holding the allocations known at this
+  /// state, and the expressions stored in the allocations, which is that of
+  /// the parent node, or null for the root.
+  ///
+  /// \param [out] leftRetrieval Whether this is the left child of the parent.
+  const TxStore *getStoredExpressions(bool &leftRetrieval) const;
 
   /// \brief This retrieves the allocations known at this state, and the
   /// expressions stored in the allocations, as long as the allocation is
@@ -721,7 +1517,7 @@ public:
   /// memory bounds check fails somehow.
   bool pointerValuesInterpolation(ref<TxStateValue> value,
                                   std::set<uint64_t> &bounds,
-                                  const std::string &reason) {
+                                  const TxMarkReason &reason) {
     return dependency->markAllPointerValues(value, bounds, reason);
   }
 
@@ -732,12 +1528,20 @@ public:
   }
 
   /// \brief Exact / non-pointer value interpolation
-  void valuesInterpolation(ref<TxStateValue> value, const std::string &reason) {
+  void valuesInterpolation(ref<TxStateValue> value, const TxMarkReason &reason) {
     dependency->markAllValues(value, reason);
   }
 
   void setGenericEarlyTermination() { genericEarlyTermination = true; }
 
+  /// \brief Record that the state of the node absorbed another state. The
+  /// interpolants of the ancestors, which would miss the paths of the merged
+  /// state, are not tabled either.
+  void setMerged() {
+    merged = true;
+    genericEarlyTermination = true;
+  }
+
   void setAssertionFail(bool _emitAllErrors) {
     assertionFail = true;
     emitAllErrors = _emitAllErrors;
@@ -874,6 +1678,47 @@ class TxTree {
   /// variable is just a pointer to the one in klee::Executor.
   std::map<const llvm::GlobalValue *, ref<ConstantExpr> > *globalAddresses;
 
+  /// \brief Nodes removed from the tree, in the order of removal, whose
+  /// deletion and the building of their table entries (if the flag is set)
+  /// are deferred with -async-interpolants
+  std::deque<std::pair<TxTreeNode *, bool> > pendingNodes;
+
+  /// \brief The number of stored table entries by the number of distinct
+  /// expression nodes of their interpolants, in powers of two
+  static std::vector<uint64_t> interpolantSizeHistogram;
+
+  /// \brief The number of weakest precondition interpolants dropped, and of
+  /// table entries not stored, for exceeding the interpolant budgets
+  static uint64_t droppedWPInterpolantCount;
+  static uint64_t rejectedEntryCount;
+
+  /// \brief The wall time of the exploration, and the number of subsumption
+  /// checks skipped for exceeding its fraction -subsumption-time-fraction
+  WallTimer explorationTimer;
+  static uint64_t budgetSkipCount;
+
+  /// \brief The removed nodes, those sampled with -sample-node-memory, and
+  /// the number of sampled nodes by their lifetime in instructions and by
+  /// the estimated bytes of each component, in powers of two
+  static uint64_t removedNodeCount;
+  static uint64_t sampledNodeCount;
+  static uint64_t nodeLifetimeTotal;
+  static std::vector<uint64_t> nodeLifetimeHistogram;
+  static uint64_t nodeMemoryTotal[];
+  static std::vector<uint64_t> nodeMemoryHistogram[];
+
+  /// \brief Record the lifetime and the memory of a removed node
+  static void sampleNodeMemory(TxTreeNode *node);
+
+  /// \brief Test if an interpolant exceeds -max-interpolant-nodes or
+  /// -max-interpolant-depth, and return its number of distinct nodes
+  static bool exceedsInterpolantBudget(ref<Expr> interpolant,
+                                       uint64_t &nodeCount);
+
+  /// \brief Build the subsumption table entry of a removed node and insert it
+  /// into the table
+  void storeTableEntry(TxTreeNode *node);
+
   void printNode(llvm::raw_ostream &stream, TxTreeNode *n,
                  std::string edges, int debugSubsumptionLevel) const;
 
@@ -887,11 +1732,33 @@ class TxTree {
   /// two decimal points.
   static std::string inTwoDecimalPoints(const double n);
 
+  /// \brief The arguments of the fixed-arity execute member functions.
+  ///
+  /// The arguments are collected into a single vector that keeps its
+  /// capacity, so that recording an instruction does not allocate a vector
+  /// per call. The recording does not nest, the buffer is released by the
+  /// destructor.
+  class ArgumentBuffer {
+    static std::vector<ref<Expr> > buffer;
+
+  public:
+    ArgumentBuffer() { assert(buffer.empty() && "nested argument buffer"); }
+    ~ArgumentBuffer() { buffer.clear(); }
+
+    ArgumentBuffer &add(ref<Expr> arg) {
+      buffer.push_back(arg);
+      return *this;
+    }
+
+    std::vector<ref<Expr> > &get() { return buffer; }
+  };
+
 public:
   // Several static member variables for profiling the execution time of
   // this class's member functions.
   static Statistic setCurrentINodeTime;
   static Statistic removeTime;
+  static Statistic publishTime;
   static Statistic subsumptionCheckTime;
   static Statistic markPathConditionTime;
   static Statistic splitTime;
@@ -903,12 +1770,45 @@ public:
   /// \brief Number of subsumption checks for statistical purposes
   static uint64_t subsumptionCheckCount;
 
+  /// \brief Number of the subsumption checks that subsumed the state
+  static uint64_t subsumptionSuccessCount;
+
   /// \brief Number of visited basic blocks for statistical purposes
   static uint64_t blockCount;
 
+  /// \brief The components of a node measured with -sample-node-memory
+  enum NodeMemoryComponent {
+    ValuesMemory,
+    StoreMemory,
+    PathConditionMemory,
+    WPMemory,
+    PhiValuesMemory,
+    NodeMemoryComponentCount
+  };
+
+  static const char *getNodeMemoryName(NodeMemoryComponent component);
+
+  static uint64_t getSampledNodeCount() { return sampledNodeCount; }
+
+  /// \brief The average lifetime of the sampled nodes, in instructions
+  static double getAverageNodeLifetime() {
+    return sampledNodeCount ? (double)nodeLifetimeTotal / sampledNodeCount
+                            : 0.;
+  }
+
+  /// \brief The average estimated bytes of a component of the sampled nodes
+  static double getAverageNodeMemory(NodeMemoryComponent component) {
+    return sampledNodeCount
+               ? (double)nodeMemoryTotal[component] / sampledNodeCount
+               : 0.;
+  }
+
   /// \brief The root node of the tree
   TxTreeNode *root;
-  static ExecutionState *initialStateCopy;
+
+  /// \brief The global objects of the initial state, with their initial
+  /// contents, shared with the states until they write to them
+  static AddressSpace *initialGlobals;
 
   /// \brief This static member variable is to indicate if we recovered from an
   /// error,
@@ -921,8 +1821,20 @@ public:
              _globalAddresses);
 
   ~TxTree() {
+    for (std::deque<std::pair<TxTreeNode *, bool> >::iterator
+             it = pendingNodes.begin(),
+             ie = pendingNodes.end();
+         it != ie; ++it) {
+      delete it->first;
+    }
     TxSubsumptionTable::clear();
-    delete initialStateCopy;
+#ifdef ENABLE_Z3
+    delete TxSubsumptionTableEntry::existentialSolver;
+    TxSubsumptionTableEntry::existentialSolver = 0;
+    delete TxSubsumptionTableEntry::concurrentSolver;
+    TxSubsumptionTableEntry::concurrentSolver = 0;
+#endif
+    delete initialGlobals;
   }
 
   /// \brief Set the reference to the KLEE state in the current interpolation
@@ -942,7 +1854,7 @@ public:
   bool getPhiValuesFlag() { return currentTxTreeNode->getPhiValuesFlag(); }
 
   // \brief stop collecting phi values for the current node
-  void setPhiValue(llvm::Value *instr, ref<Expr> value) {
+  void setPhiValue(llvm::Instruction *instr, ref<Expr> value) {
     currentTxTreeNode->setPhiValue(instr, value);
   }
 
@@ -954,6 +1866,15 @@ public:
   /// table entry.
   void remove(ExecutionState *state, TimingSolver *solver, bool dumping);
 
+  /// \brief Build the deferred table entries of removed nodes and delete the
+  /// nodes, in the order of their removal
+  ///
+  /// \param count The maximum number of nodes to process, or 0 for all
+  void publishPendingEntries(unsigned count = 0);
+
+  /// \brief Delete a leaf of a failed speculation subtree. The deferred
+  /// entries have to be published before, as their nodes may descend from
+  /// the subtree.
   void removeSpeculationFailedNodes(TxTreeNode *node);
 
   /// \brief Invokes the subsumption check
@@ -1011,7 +1932,7 @@ public:
   void executeMakeSymbolic(llvm::Instruction *instr, ref<Expr> address,
                            const Array *array) {
     currentTxTreeNode->dependency->executeMakeSymbolic(
-        instr, currentTxTreeNode->callHistory, address, array);
+        instr, currentTxTreeNode->callHistory->getHistory(), address, array);
   }
 
   /// \brief Abstractly execute a PHI instruction for building dependency
@@ -1034,51 +1955,55 @@ public:
                                            llvm::Instruction *instr,
                                            ref<Expr> value, ref<Expr> address,
                                            bool inBounds) {
-    TimerStatIncrementer t(executeMemoryOperationTime);
-    std::vector<ref<Expr> > args;
-    args.push_back(value);
-    args.push_back(address);
+    TxTimerStatIncrementer t(executeMemoryOperationTime);
+    ArgumentBuffer args;
+    args.add(value).add(address);
     bool ret = node->dependency->executeMemoryOperation(
-        instr, node->callHistory, args, inBounds, symbolicExecutionError);
+        instr, node->callHistory->getHistory(), args.get(), inBounds,
+        symbolicExecutionError);
     symbolicExecutionError = false;
     return ret;
   }
 
   /// \brief Execute an instruction of no argument for building dependency
   /// information, given a particular interpolation tree node.
+  ///
+  /// Only a conditional branch on a computed condition records anything for
+  /// no argument, the other instructions skip the recording and its timers.
   static void executeOnNode(TxTreeNode *node, llvm::Instruction *instr) {
-    std::vector<ref<Expr> > dummyArgs;
-    executeOnNode(node, instr, dummyArgs);
+    llvm::BranchInst *binst = llvm::dyn_cast<llvm::BranchInst>(instr);
+    if (!binst || !binst->isConditional() ||
+        llvm::isa<llvm::ConstantInt>(binst->getCondition()))
+      return;
+    ArgumentBuffer args;
+    executeOnNode(node, instr, args.get());
   }
 
   /// \brief Execute an instruction of one argument for building dependency
   /// information, given a particular interpolation tree node.
   static void executeOnNode(TxTreeNode *node, llvm::Instruction *instr,
                             ref<Expr> arg1) {
-    std::vector<ref<Expr> > args;
-    args.push_back(arg1);
-    executeOnNode(node, instr, args);
+    ArgumentBuffer args;
+    args.add(arg1);
+    executeOnNode(node, instr, args.get());
   }
 
   /// \brief Execute an instruction of two arguments for building dependency
   /// information, given a particular interpolation tree node.
   static void executeOnNode(TxTreeNode *node, llvm::Instruction *instr,
                             ref<Expr> arg1, ref<Expr> arg2) {
-    std::vector<ref<Expr> > args;
-    args.push_back(arg1);
-    args.push_back(arg2);
-    executeOnNode(node, instr, args);
+    ArgumentBuffer args;
+    args.add(arg1).add(arg2);
+    executeOnNode(node, instr, args.get());
   }
 
   /// \brief Execute an instruction of three arguments for building dependency
   /// information, given a particular interpolation tree node.
   static void executeOnNode(TxTreeNode *node, llvm::Instruction *instr,
                             ref<Expr> arg1, ref<Expr> arg2, ref<Expr> arg3) {
-    std::vector<ref<Expr> > args;
-    args.push_back(arg1);
-    args.push_back(arg2);
-    args.push_back(arg3);
-    executeOnNode(node, instr, args);
+    ArgumentBuffer args;
+    args.add(arg1).add(arg2).add(arg3);
+    executeOnNode(node, instr, args.get());
   }
 
   /// \brief General member function for executing an instruction for building
@@ -15,8 +15,13 @@
 
 #include "klee/util/TxTreeGraph.h"
 
+#include "klee/Config/config.h"
 #include "klee/ExecutionState.h"
+#include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/util/TxPrintUtil.h"
+#ifdef HAVE_ZLIB_H
+#include "klee/Internal/Support/CompressionStream.h"
+#endif
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/BasicBlock.h"
@@ -34,30 +39,21 @@
 #include <llvm/Analysis/DebugInfo.h>
 #endif
 
-#include <fstream>
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 5)
+#include "llvm/Support/FileSystem.h"
+#endif
+
+#include <sstream>
 #include <string>
 
 using namespace klee;
 
-/**/
-
-std::string TxTreeGraph::NumberedEdge::render() const {
-  std::ostringstream stream;
-  stream << "Node" << source->nodeSequenceNumber << " -> Node"
-         << destination->nodeSequenceNumber << " [style=dashed,label=\""
-         << number << "\"];";
-  return stream.str();
-}
-
-/**/
-
 uint64_t TxTreeGraph::nodeCount = 1;
 
 TxTreeGraph *TxTreeGraph::instance = 0;
 
-std::string TxTreeGraph::recurseRender(TxTreeGraph::Node *node) {
+std::string TxTreeGraph::getName(TxTreeGraph::Node *node) {
   std::ostringstream stream;
-
   if (node->nodeSequenceNumber) {
     stream << "Node" << node->nodeSequenceNumber;
   } else {
@@ -68,185 +64,183 @@ std::string TxTreeGraph::recurseRender(TxTreeGraph::Node *node) {
     }
     stream << "InternalNode" << node->internalNodeId;
   }
-  std::string sourceNodeName = stream.str();
-
-  size_t pos = 0;
-  std::string replacementName(node->name);
-  std::stringstream repStream1;
-  while ((pos = replacementName.find("{")) != std::string::npos) {
-    if (pos != std::string::npos) {
-      repStream1 << replacementName.substr(0, pos) << "\\{";
-      replacementName = replacementName.substr(pos + 2);
+  return stream.str();
+}
+
+void TxTreeGraph::write(TxTreeGraph::Node *node) {
+  // Write the ancestors waiting for the node without recursion
+  while (node) {
+    assert(!node->falseTarget && !node->trueTarget &&
+           "node written before its children");
+
+    std::ostringstream stream;
+    std::string sourceNodeName = getName(node);
+    stream << sourceNodeName;
+
+    size_t pos = 0;
+    std::string replacementName(node->name);
+    std::stringstream repStream1;
+    while ((pos = replacementName.find("{")) != std::string::npos) {
+      if (pos != std::string::npos) {
+        repStream1 << replacementName.substr(0, pos) << "\\{";
+        replacementName = replacementName.substr(pos + 2);
+      }
     }
-  }
-  repStream1 << replacementName;
-  replacementName = repStream1.str();
-  std::stringstream repStream2;
-  while ((pos = replacementName.find("}")) != std::string::npos) {
-    if (pos != std::string::npos) {
-      repStream2 << replacementName.substr(0, pos) << "\\}";
-      replacementName = replacementName.substr(pos + 2);
+    repStream1 << replacementName;
+    replacementName = repStream1.str();
+    std::stringstream repStream2;
+    while ((pos = replacementName.find("}")) != std::string::npos) {
+      if (pos != std::string::npos) {
+        repStream2 << replacementName.substr(0, pos) << "\\}";
+        replacementName = replacementName.substr(pos + 2);
+      }
     }
-  }
-  repStream2 << replacementName;
-  replacementName = repStream2.str();
+    repStream2 << replacementName;
+    replacementName = repStream2.str();
 
-  stream << " [shape=record,";
-  if (node->errorPath) {
-    stream << "style=bold,";
-  }
-  stream << "label=\"{";
-  if (node->nodeSequenceNumber) {
-    stream << node->nodeSequenceNumber << ": " << replacementName;
-  } else {
-    // The internal node id must have been set earlier
-    assert(node->internalNodeId && "id for internal node must have been set");
-    if (node->falseTarget || node->trueTarget) {
-      stream << "Internal node " << node->internalNodeId << ": ";
+    stream << " [shape=record,";
+    if (node->errorPath) {
+      stream << "style=bold,";
+    }
+    stream << "label=\"{";
+    if (node->nodeSequenceNumber) {
+      stream << node->nodeSequenceNumber << ": " << replacementName;
     } else {
-      stream << "Unvisited node: ";
+      // The internal node id must have been set earlier
+      assert(node->internalNodeId && "id for internal node must have been set");
+      if (node->split) {
+        stream << "Internal node " << node->internalNodeId << ": ";
+      } else {
+        stream << "Unvisited node: ";
+      }
     }
-  }
-  stream << "\\l";
-  for (std::map<TxPCConstraint *, std::pair<std::string, bool> >::const_iterator
-           it = node->pathConditionTable.begin(),
-           ie = node->pathConditionTable.end();
-       it != ie; ++it) {
-    stream << it->second.first;
-    if (it->second.second)
-      stream << " ITP";
     stream << "\\l";
-  }
-  if (node->markCount) {
-    stream << "mark(s): " << node->markCount;
-    if (node->markAddition) {
-      stream << " (+" << node->markAddition << ")";
+    for (std::map<TxPCConstraint *,
+                  std::pair<std::string, bool> >::const_iterator
+             it = node->pathConditionTable.begin(),
+             ie = node->pathConditionTable.end();
+         it != ie; ++it) {
+      stream << it->second.first;
+      if (it->second.second)
+        stream << " ITP";
+      stream << "\\l";
     }
-    stream << "\\l";
-  }
-  switch (node->errorType) {
-  case ASSERTION: {
-    stream << "ASSERTION FAIL: " << node->errorLocation << "\\l";
-    break;
-  }
-  case MEMORY: {
-    stream << "OUT-OF-BOUND: " << node->errorLocation << "\\l";
-    break;
-  }
-  case GENERIC: {
-    stream << "GENERIC FAIL: " << node->errorLocation << "\\l";
-    break;
-  }
-  case NONE:
-  default: { break; }
-  }
-  if (node->subsumed) {
-    stream << "(subsumed)\\l";
-  } else {
-    std::map<TxTreeGraph::Node *, uint64_t>::iterator it =
-        leafToLeafSequenceNumber.find(node);
-    if (it != leafToLeafSequenceNumber.end()) {
-      // This node is a leaf
-      stream << "(terminal #" << it->second << ")\\l";
-    }
-  }
-  if (node->falseTarget || node->trueTarget)
-    stream << "|{<s0>F|<s1>T}";
-  stream << "}\"];\n";
-
-  if (node->falseTarget) {
-    if (node->falseTarget->nodeSequenceNumber) {
-      stream << sourceNodeName << ":s0 -> Node"
-             << node->falseTarget->nodeSequenceNumber;
-    } else {
-      if (!node->falseTarget->internalNodeId) {
-        node->falseTarget->internalNodeId = (++internalNodeId);
+    if (node->markCount) {
+      stream << "mark(s): " << node->markCount;
+      if (node->markAddition) {
+        stream << " (+" << node->markAddition << ")";
       }
-      stream << sourceNodeName << ":s0 -> InternalNode"
-             << node->falseTarget->internalNodeId;
+      stream << "\\l";
     }
-    if (node->falseTarget->errorPath) {
-      stream << " [style=bold,label=\"ERR\"];\n";
-    } else {
-      stream << ";\n";
+    switch (node->errorType) {
+    case ASSERTION: {
+      stream << "ASSERTION FAIL: " << node->errorLocation << "\\l";
+      break;
     }
-  }
-  if (node->trueTarget) {
-    if (node->trueTarget->nodeSequenceNumber) {
-      stream << sourceNodeName + ":s1 -> Node"
-             << node->trueTarget->nodeSequenceNumber;
-    } else {
-      if (!node->trueTarget->internalNodeId) {
-        node->trueTarget->internalNodeId = (++internalNodeId);
-      }
-      stream << sourceNodeName << ":s1 -> InternalNode"
-             << node->trueTarget->internalNodeId;
+    case MEMORY: {
+      stream << "OUT-OF-BOUND: " << node->errorLocation << "\\l";
+      break;
+    }
+    case GENERIC: {
+      stream << "GENERIC FAIL: " << node->errorLocation << "\\l";
+      break;
     }
-    if (node->trueTarget->errorPath) {
-      stream << " [style=bold,label=\"ERR\"];\n";
+    case NONE:
+    default: { break; }
+    }
+    if (node->subsumed) {
+      stream << "(subsumed)\\l";
+    } else if (!node->split && node->nodeSequenceNumber) {
+      // This node is a leaf
+      stream << "(terminal #" << ++leafCount << ")\\l";
+    }
+    if (node->split)
+      stream << "|{<s0>F|<s1>T}";
+    stream << "}\"];\n";
+
+    Node *parent = node->parent;
+    if (parent) {
+      stream << getName(parent);
+      if (node == parent->falseTarget) {
+        stream << ":s0 -> ";
+        parent->falseTarget = 0;
+      } else {
+        assert(node == parent->trueTarget);
+        stream << ":s1 -> ";
+        parent->trueTarget = 0;
+      }
+      stream << sourceNodeName;
+      if (node->errorPath) {
+        stream << " [style=bold,label=\"ERR\"];\n";
+      } else {
+        stream << ";\n";
+      }
     } else {
-      stream << ";\n";
+      assert(node == root);
+      root = 0;
     }
-  }
-  if (node->falseTarget) {
-    stream << recurseRender(node->falseTarget);
-  }
-  if (node->trueTarget) {
-    stream << recurseRender(node->trueTarget);
-  }
-  return stream.str();
-}
-
-std::string TxTreeGraph::render() {
-  std::string res("");
 
-  // Simply return empty string when root is undefined
-  if (!root)
-    return res;
-
-  std::ostringstream stream;
-  for (std::vector<TxTreeGraph::NumberedEdge *>::iterator
-           it = subsumptionEdges.begin(),
-           ie = subsumptionEdges.end();
-       it != ie; ++it) {
-    stream << (*it)->render() << "\n";
-  }
-
-  // Compute leaf indices (TxTreeGraph::leafToNumber)
-  std::map<uint64_t, TxTreeGraph::Node *> sequenceNumberToNode;
-  std::vector<uint64_t> leafSequenceNumbers;
-  for (std::set<TxTreeGraph::Node *>::iterator it = leaves.begin(),
-                                               ie = leaves.end();
-       it != ie; ++it) {
-    // We skip internal nodes with zero sequence number
-    if ((*it)->nodeSequenceNumber) {
-      uint64_t nodeSequenceNumber = (*it)->nodeSequenceNumber;
-      sequenceNumberToNode[nodeSequenceNumber] = *it;
-      leafSequenceNumbers.push_back(nodeSequenceNumber);
+    if (os)
+      *os << stream.str();
+
+    // The path conditions of the node can no longer be marked
+    for (std::map<TxPCConstraint *, std::pair<std::string, bool> >::iterator
+             it = node->pathConditionTable.begin(),
+             ie = node->pathConditionTable.end();
+         it != ie; ++it) {
+      std::map<TxPCConstraint *, TxTreeGraph::Node *>::iterator pit =
+          pathConditionMap.find(it->first);
+      if (pit != pathConditionMap.end() && pit->second == node)
+        pathConditionMap.erase(pit);
     }
+    delete node;
+
+    node = (parent && parent->removed && !parent->falseTarget &&
+            !parent->trueTarget)
+               ? parent
+               : 0;
   }
-  std::sort(leafSequenceNumbers.begin(), leafSequenceNumbers.end());
-  leafToLeafSequenceNumber.clear();
-  uint64_t leafId = 0;
-  for (std::vector<uint64_t>::iterator it = leafSequenceNumbers.begin(),
-                                       ie = leafSequenceNumbers.end();
-       it != ie; ++it) {
-    TxTreeGraph::Node *node = sequenceNumberToNode[*it];
-    leafToLeafSequenceNumber[node] = ++leafId;
-  }
+}
 
-  res = "digraph search_tree {\n";
-  res += recurseRender(root);
-  res += stream.str();
-  res += "}\n";
-  return res;
+void TxTreeGraph::recurseWrite(TxTreeGraph::Node *node) {
+  // A removed node is written, and freed, with its last child
+  TxTreeGraph::Node *trueTarget = node->trueTarget;
+  bool removed = node->removed;
+  if (node->falseTarget)
+    recurseWrite(node->falseTarget);
+  if (trueTarget)
+    recurseWrite(trueTarget);
+  if (!removed)
+    write(node);
 }
 
-TxTreeGraph::TxTreeGraph(TxTreeNode *_root)
-    : subsumptionEdgeNumber(0), internalNodeId(0) {
+TxTreeGraph::TxTreeGraph(TxTreeNode *_root, const std::string &dotFileName)
+    : os(0), leafCount(0), subsumptionEdgeNumber(0), internalNodeId(0) {
   root = TxTreeGraph::Node::createNode(0);
   txTreeNodeMap[_root] = root;
-  leaves.insert(root);
+
+  std::string error;
+#if defined(ENABLE_Z3) && defined(HAVE_ZLIB_H)
+  if (CompressOutputTree) {
+    os = new compressed_fd_ostream((dotFileName + ".gz").c_str(), error);
+  } else
+#endif
+  {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 5)
+    os = new llvm::raw_fd_ostream(dotFileName.c_str(), error,
+                                  llvm::sys::fs::OpenFlags::F_Text);
+#else
+    os = new llvm::raw_fd_ostream(dotFileName.c_str(), error);
+#endif
+  }
+  if (!error.empty()) {
+    klee_warning("unable to write %s: %s", dotFileName.c_str(),
+                 error.c_str());
+    delete os;
+    os = 0;
+    return;
+  }
+  *os << "digraph search_tree {\n";
 }
 
 TxTreeGraph::~TxTreeGraph() {
@@ -254,18 +248,10 @@ TxTreeGraph::~TxTreeGraph() {
     delete root;
 
   txTreeNodeMap.clear();
+  tableEntryMap.clear();
+  pathConditionMap.clear();
 
-  for (std::vector<TxTreeGraph::NumberedEdge *>::iterator
-           it = subsumptionEdges.begin(),
-           ie = subsumptionEdges.end();
-       it != ie; ++it) {
-    delete *it;
-  }
-  subsumptionEdges.clear();
-
-  leaves.clear();
-
-  leafToLeafSequenceNumber.clear();
+  delete os;
 }
 
 void TxTreeGraph::addChildren(TxTreeNode *parent, TxTreeNode *falseChild,
@@ -284,12 +270,25 @@ void TxTreeGraph::addChildren(TxTreeNode *parent, TxTreeNode *falseChild,
   parentNode->falseTarget->parent = parentNode;
   parentNode->trueTarget = TxTreeGraph::Node::createNode(parentNode->markCount);
   parentNode->trueTarget->parent = parentNode;
+  parentNode->split = true;
   instance->txTreeNodeMap[falseChild] = parentNode->falseTarget;
   instance->txTreeNodeMap[trueChild] = parentNode->trueTarget;
+}
+
+void TxTreeGraph::removeNode(TxTreeNode *txTreeNode) {
+  if (!OUTPUT_INTERPOLATION_TREE || !instance)
+    return;
 
-  instance->leaves.erase(parentNode);
-  instance->leaves.insert(parentNode->falseTarget);
-  instance->leaves.insert(parentNode->trueTarget);
+  std::map<TxTreeNode *, TxTreeGraph::Node *>::iterator it =
+      instance->txTreeNodeMap.find(txTreeNode);
+  if (it == instance->txTreeNodeMap.end())
+    return;
+  TxTreeGraph::Node *node = it->second;
+  instance->txTreeNodeMap.erase(it);
+
+  node->removed = true;
+  if (!node->falseTarget && !node->trueTarget)
+    instance->write(node);
 }
 
 void TxTreeGraph::setCurrentNode(ExecutionState &state,
@@ -342,9 +341,15 @@ void TxTreeGraph::markAsSubsumed(TxTreeNode *txTreeNode,
 
   TxTreeGraph::Node *node = instance->txTreeNodeMap[txTreeNode];
   node->subsumed = true;
-  TxTreeGraph::Node *subsuming = instance->tableEntryMap[entry];
-  instance->subsumptionEdges.push_back(new TxTreeGraph::NumberedEdge(
-      node, subsuming, ++(instance->subsumptionEdgeNumber)));
+  // An entry loaded by -subsumption-table-file has no node in the graph
+  std::map<TxSubsumptionTableEntry *, std::string>::iterator it =
+      instance->tableEntryMap.find(entry);
+  if (it == instance->tableEntryMap.end())
+    return;
+  if (instance->os)
+    *instance->os << instance->getName(node) << " -> " << it->second
+                  << " [style=dashed,label=\""
+                  << ++(instance->subsumptionEdgeNumber) << "\"];\n";
 }
 
 void TxTreeGraph::addPathCondition(TxTreeNode *txTreeNode,
@@ -372,7 +377,16 @@ void TxTreeGraph::addTableEntryMapping(TxTreeNode *txTreeNode,
   assert(TxTreeGraph::instance && "Search tree graph not initialized");
 
   TxTreeGraph::Node *node = instance->txTreeNodeMap[txTreeNode];
-  instance->tableEntryMap[entry] = node;
+  instance->tableEntryMap[entry] = instance->getName(node);
+}
+
+void TxTreeGraph::removeTableEntryMapping(TxSubsumptionTableEntry *entry) {
+  if (!OUTPUT_INTERPOLATION_TREE)
+    return;
+
+  assert(TxTreeGraph::instance && "Search tree graph not initialized");
+
+  instance->tableEntryMap.erase(entry);
 }
 
 void TxTreeGraph::setAsCore(TxPCConstraint *pathCondition) {
@@ -381,9 +395,11 @@ void TxTreeGraph::setAsCore(TxPCConstraint *pathCondition) {
 
   assert(TxTreeGraph::instance && "Search tree graph not initialized");
 
-  instance->pathConditionMap[pathCondition]
-      ->pathConditionTable[pathCondition]
-      .second = true;
+  // The node of the path condition may have been written already
+  std::map<TxPCConstraint *, TxTreeGraph::Node *>::iterator it =
+      instance->pathConditionMap.find(pathCondition);
+  if (it != instance->pathConditionMap.end())
+    it->second->pathConditionTable[pathCondition].second = true;
 }
 
 void TxTreeGraph::setError(const ExecutionState &state,
@@ -413,16 +429,16 @@ void TxTreeGraph::setError(const ExecutionState &state,
   }
 }
 
-void TxTreeGraph::save(std::string dotFileName) {
+void TxTreeGraph::save() {
   if (!OUTPUT_INTERPOLATION_TREE)
     return;
 
   assert(TxTreeGraph::instance && "Search tree graph not initialized");
 
-  std::string g(instance->render());
-  std::ofstream out(dotFileName.c_str());
-  if (!out.fail()) {
-    out << g;
-    out.close();
+  if (instance->root)
+    instance->recurseWrite(instance->root);
+  if (instance->os) {
+    *instance->os << "}\n";
+    instance->os->flush();
   }
 }
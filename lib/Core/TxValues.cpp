@@ -25,6 +25,9 @@
 #include "klee/util/TxPrintUtil.h"
 #include "TxShadowArray.h"
 
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Type.h>
@@ -33,12 +36,113 @@
 #include <llvm/Type.h>
 #endif
 
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 5)
+#include <llvm/IR/DebugInfo.h>
+#elif LLVM_VERSION_CODE >= LLVM_VERSION(3, 2)
+#include <llvm/DebugInfo.h>
+#else
+#include <llvm/Analysis/DebugInfo.h>
+#endif
+
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_map std::unordered_map
+#else
+#include <tr1/unordered_map>
+#define unordered_map std::tr1::unordered_map
+#endif
+
 using namespace klee;
 
 namespace klee {
 
 bool concreteBound(uint64_t bound) { return bound < symbolicBoundId; }
 
+/**/
+
+/// \brief Print the function and source line of an instruction, or the
+/// instruction itself when it has no line and printInstruction is set
+static void printLocation(llvm::raw_ostream &stream, llvm::Value *value,
+                          bool printInstruction) {
+  llvm::Instruction *instr = llvm::cast<llvm::Instruction>(value);
+  if (instr->getParent()->getParent()) {
+    stream << instr->getParent()->getParent()->getName().str() << ": ";
+  } else if (printInstruction) {
+    instr->print(stream);
+    return;
+  }
+  if (llvm::MDNode *n = instr->getMetadata("dbg")) {
+    llvm::DILocation loc(n);
+    stream << "Line " << loc.getLineNumber();
+  } else if (printInstruction) {
+    instr->print(stream);
+  }
+}
+
+void TxMarkReason::print(llvm::raw_ostream &stream) const {
+  switch (kind) {
+  case None:
+    break;
+  case Subsumption:
+    stream << "subsumption at ";
+    printLocation(stream, first, true);
+    break;
+  case SubsumptionBound:
+    stream << "interpolating memory bound for subsumption at ";
+    printLocation(stream, first, true);
+    break;
+  case BranchInfeasibility:
+    stream << "branch infeasibility [";
+    printLocation(stream, first, true);
+    stream << "]";
+    break;
+  case BranchInstruction:
+    stream << "branch instruction [";
+    printLocation(stream, first, true);
+    stream << "]";
+    break;
+  case InfeasibleSwitchCase:
+    stream << "infeasible switch case [";
+    printLocation(stream, first, false);
+    stream << "]";
+    break;
+  case ExternalCallParameter:
+    stream << "parameter [";
+    first->print(stream);
+    stream << "] of external call [";
+    second->print(stream);
+    stream << "]";
+    break;
+  case PointerUse:
+    stream << "pointer use [";
+    printLocation(stream, first, false);
+    stream << "]";
+    break;
+  case MemoryBoundViolation:
+    stream << "memory bound violation [";
+    printLocation(stream, first, false);
+    stream << "]";
+    break;
+  }
+}
+
+/**/
+
+std::map<TxMarkReason, unsigned> TxCoreReasons::idTable;
+
+std::vector<TxMarkReason> TxCoreReasons::reasonTable;
+
+unsigned TxCoreReasons::intern(const TxMarkReason &reason) {
+  std::map<TxMarkReason, unsigned>::iterator it = idTable.find(reason);
+  if (it != idTable.end())
+    return it->second;
+  unsigned id = reasonTable.size();
+  reasonTable.push_back(reason);
+  idTable[reason] = id;
+  return id;
+}
+
 /**/
 int debugSubsumptionLevel_g=0;
 void setDebugSubsumptionLevelTxValue(int debugSubsumptionLevel)
@@ -58,31 +162,31 @@ void TxStoreEntry::print(llvm::raw_ostream &stream,
   if (leftCore && rightCore) {
   if (debugSubsumptionLevel_g>=4){
     stream << tabsNext << "a left and right interpolant value:\n"; } /*For prettyPrint*/
-    for (std::set<std::string>::iterator it = leftCoreReasons.begin(),
-                                         ie = leftCoreReasons.end();
+    for (TxCoreReasons::const_iterator it = leftCoreReasons.begin(),
+                                       ie = leftCoreReasons.end();
          it != ie; ++it) {
-      stream << tabsNextNext << *it << "\n";
+      stream << tabsNextNext << TxCoreReasons::getReason(*it) << "\n";
     }
-    for (std::set<std::string>::iterator it = rightCoreReasons.begin(),
-                                         ie = rightCoreReasons.end();
+    for (TxCoreReasons::const_iterator it = rightCoreReasons.begin(),
+                                       ie = rightCoreReasons.end();
          it != ie; ++it) {
-      stream << tabsNextNext << *it << "\n";
+      stream << tabsNextNext << TxCoreReasons::getReason(*it) << "\n";
     }
   } else if (leftCore) {
   if (debugSubsumptionLevel_g>=4){
      stream << tabsNext << "a left and right interpolant value:\n"; } /*For prettyPrint*/
-    for (std::set<std::string>::iterator it = leftCoreReasons.begin(),
-                                         ie = leftCoreReasons.end();
+    for (TxCoreReasons::const_iterator it = leftCoreReasons.begin(),
+                                       ie = leftCoreReasons.end();
          it != ie; ++it) {
-      stream << tabsNextNext << *it << "\n";
+      stream << tabsNextNext << TxCoreReasons::getReason(*it) << "\n";
     }
   } else if (rightCore) {
   if (debugSubsumptionLevel_g>=4){
     stream << tabsNext << "a right interpolant value:\n";}  /*For prettyPrint*/
-    for (std::set<std::string>::iterator it = rightCoreReasons.begin(),
-                                         ie = rightCoreReasons.end();
+    for (TxCoreReasons::const_iterator it = rightCoreReasons.begin(),
+                                       ie = rightCoreReasons.end();
          it != ie; ++it) {
-      stream << tabsNextNext << *it << "\n";
+      stream << tabsNextNext << TxCoreReasons::getReason(*it) << "\n";
     }
   } else {
    if (debugSubsumptionLevel_g>=4){
@@ -164,6 +268,43 @@ void TxAllocationInfo::print(llvm::raw_ostream &stream,
 
 /**/
 
+TxCallHistory TxCallHistory::root;
+
+unsigned TxCallHistory::nextId = 1;
+
+const TxCallHistory *
+TxCallHistory::intern(const std::vector<llvm::Instruction *> &callHistory) {
+  const TxCallHistory *node = &root;
+  for (std::vector<llvm::Instruction *>::const_iterator
+           it = callHistory.begin(),
+           ie = callHistory.end();
+       it != ie; ++it)
+    node = node->push(*it);
+  return node;
+}
+
+const TxCallHistory *TxCallHistory::push(llvm::Instruction *call) const {
+  TxCallHistory *&child = children[call];
+  if (!child) {
+    child = new TxCallHistory();
+    child->id = nextId++;
+    child->parent = this;
+    child->call = call;
+    child->depth = depth + 1;
+  }
+  return child;
+}
+
+const std::vector<llvm::Instruction *> &TxCallHistory::getHistory() const {
+  if (history.size() != depth) {
+    history.resize(depth);
+    unsigned i = depth;
+    for (const TxCallHistory *node = this; node->parent; node = node->parent)
+      history[--i] = node->call;
+  }
+  return history;
+}
+
 ref<TxAllocationContext> TxAllocationContext::create(
     llvm::Value *_value, const std::vector<llvm::Instruction *> &_callHistory) {
   ref<TxAllocationContext> ret(new TxAllocationContext(_value, _callHistory));
@@ -184,11 +325,11 @@ void TxAllocationContext::print(llvm::raw_ostream &stream,
     }
     value->print(stream);
   }
-  if (callHistory.size() > 0) {
+  if (getCallHistory().size() > 0) {
     stream << "\n" << prefix << "Call history:";
     for (std::vector<llvm::Instruction *>::const_iterator
-             it = callHistory.begin(),
-             ie = callHistory.end();
+             it = getCallHistory().begin(),
+             ie = getCallHistory().end();
          it != ie; ++it) {
       stream << "\n" << tabs << prefix;
       (*it)->print(stream);
@@ -233,7 +374,7 @@ void TxVariable::print(llvm::raw_ostream &stream,
 
 void TxInterpolantValue::init(
     llvm::Value *_value, ref<Expr> _expr, bool canInterpolateBound,
-    const std::set<std::string> &_coreReasons, ref<TxStateAddress> _location,
+    const TxCoreReasons &_coreReasons, ref<TxStateAddress> _location,
     const std::map<ref<Expr>, ref<Expr> > &substitution,
     std::set<const Array *> &replacements, bool shadowing) {
   refCount = 0;
@@ -314,6 +455,16 @@ void TxInterpolantValue::init(
   }
 }
 
+bool TxInterpolantValue::isEquivalent(const TxInterpolantValue &other) const {
+  if (doNotUseBound != other.doNotUseBound ||
+      expr.isNull() != other.expr.isNull())
+    return false;
+  if (!expr.isNull() && expr != other.expr)
+    return false;
+  return allocationBounds == other.allocationBounds &&
+         allocationOffsets == other.allocationOffsets;
+}
+
 ref<Expr> TxInterpolantValue::getBoundsCheck(
     ref<TxInterpolantValue> other, std::set<uint64_t> &bounds,
     std::map<ref<TxAllocationInfo>, ref<TxAllocationInfo> > &unifiedBases,
@@ -708,12 +859,12 @@ void TxInterpolantValue::print(llvm::raw_ostream &stream,
    if (!coreReasons.empty()) {
     stream << "\n";
     stream << prefix << "reason(s) for storage:\n";
-    for (std::set<std::string>::const_iterator is = coreReasons.begin(),
-                                               ie = coreReasons.end(), it = is;
+    for (TxCoreReasons::const_iterator is = coreReasons.begin(),
+                                       ie = coreReasons.end(), it = is;
          it != ie; ++it) {
       if (it != is)
         stream << "\n";
-      stream << nextTabs << *it;
+      stream << nextTabs << TxCoreReasons::getReason(*it);
     }
    }
   } /*Commented for Pretty Print*/
@@ -725,16 +876,18 @@ bool TxStateAddress::adjustOffsetBound(ref<TxStateValue> checkedAddress,
                                        std::set<uint64_t> &_bounds,
                                        bool &boundUpdated) {
   const ref<TxStateAddress> location = checkedAddress->getPointerInfo();
-  std::set<uint64_t> bounds(_bounds);
+  std::set<uint64_t> defaultBounds;
 
-  if (bounds.empty()) {
-    bounds.insert(size);
+  if (_bounds.empty()) {
+    defaultBounds.insert(size);
   }
+  const std::set<uint64_t> &bounds(_bounds.empty() ? defaultBounds : _bounds);
+  ref<Expr> checkedOffset = location->getOffset();
 
-  for (std::set<uint64_t>::iterator it1 = bounds.begin(), ie1 = bounds.end();
+  for (std::set<uint64_t>::const_iterator it1 = bounds.begin(),
+                                          ie1 = bounds.end();
        it1 != ie1; ++it1) {
 
-    ref<Expr> checkedOffset = location->getOffset();
     if (ConstantExpr *c = llvm::dyn_cast<ConstantExpr>(checkedOffset)) {
       if (ConstantExpr *o = llvm::dyn_cast<ConstantExpr>(getOffset())) {
         uint64_t offsetInt = o->getZExtValue();
@@ -904,6 +1057,25 @@ TxStateValue::getDisableBoundEntryList() const {
   return disableBoundEntryList;
 }
 
+unsigned TxStateValue::countStoreEntry(const TxStoreEntry *entry) const {
+  unsigned ret = 0;
+  for (std::set<ref<TxStoreEntry> >::const_iterator
+           it = allowBoundEntryList.begin(),
+           ie = allowBoundEntryList.end();
+       it != ie; ++it) {
+    if (it->get() == entry)
+      ++ret;
+  }
+  for (std::set<ref<TxStoreEntry> >::const_iterator
+           it = disableBoundEntryList.begin(),
+           ie = disableBoundEntryList.end();
+       it != ie; ++it) {
+    if (it->get() == entry)
+      ++ret;
+  }
+  return ret;
+}
+
 void TxStateValue::print(llvm::raw_ostream &stream,
                          const std::string &prefix) const {
   std::string tabsNext = appendTab(prefix);
@@ -957,11 +1129,13 @@ void TxStateValue::printMinimal(llvm::raw_ostream &stream,
 TxStoreEntry::TxStoreEntry(ref<TxStateAddress> _address,
                            ref<TxStateValue> _addressValue,
                            ref<TxStateValue> _content, const TxStore *store,
-                           uint64_t _depth)
+                           uint64_t _depth, unsigned _pathId)
     : refCount(0), address(_address), addressValue(_addressValue),
-      content(_content), depth(_depth), value(content->getValue()),
+      content(_content), depth(_depth), pathId(_pathId),
+      value(content->getValue()),
       valueExpr(content->getExpression()), leftDoNotInterpolateBound(false),
       rightDoNotInterpolateBound(false), leftCore(false), rightCore(false) {
+  pointerFlowEpoch[0] = pointerFlowEpoch[1] = 0;
   if (!content->getPointerInfo().isNull()) {
     leftPointerInfo = content->getPointerInfo();
     rightPointerInfo = content->getPointerInfo()->copy();
@@ -984,4 +1158,144 @@ TxStoreEntry::TxStoreEntry(ref<TxStateAddress> _address,
     disableBoundEntryList[*it] = store->isInLeftSubtree((*it)->depth);
   }
 }
+
+bool TxStoreEntry::isUnmarkable() const {
+  if (leftCore || rightCore)
+    return false;
+
+  // The references of the values of this entry, held only by this entry, to
+  // this entry, besides the one of the store
+  unsigned ownReferences = 1;
+  if (!content.isNull()) {
+    if (content->refCount > 1)
+      return false;
+    ownReferences += content->countStoreEntry(this);
+  }
+  if (!addressValue.isNull() && addressValue->countStoreEntry(this)) {
+    if (addressValue->refCount > 1)
+      return false;
+    ownReferences += addressValue->countStoreEntry(this);
+  }
+  return refCount == ownReferences;
+}
+
+/**/
+
+static unordered_map<llvm::Value *, unsigned> valueIds;
+
+static unsigned valueIdCount = 0;
+
+const TxVersionedValues::Versions TxVersionedValues::noVersions;
+
+void TxVersionedValues::initialize(KModule *kmodule) {
+  for (std::vector<KFunction *>::iterator it = kmodule->functions.begin(),
+                                          ie = kmodule->functions.end();
+       it != ie; ++it) {
+    KFunction *kf = *it;
+    unsigned base = valueIdCount;
+    unsigned index = 0;
+    for (llvm::Function::arg_iterator ai = kf->function->arg_begin(),
+                                      ae = kf->function->arg_end();
+         ai != ae; ++ai, ++index) {
+      valueIds[&*ai] = base + kf->getArgRegister(index);
+    }
+    for (unsigned i = 0; i < kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      valueIds[ki->inst] = base + ki->dest;
+    }
+    valueIdCount += kf->numRegisters;
+  }
+}
+
+unsigned TxVersionedValues::getValueId(llvm::Value *value) {
+  std::pair<unordered_map<llvm::Value *, unsigned>::iterator, bool> res =
+      valueIds.insert(std::make_pair(value, valueIdCount));
+  if (res.second)
+    ++valueIdCount;
+  return res.first->second;
+}
+
+void TxVersionedValues::bind(llvm::Value *value, ref<TxStateValue> version) {
+  Versions &versions = localValues[value];
+  versions.push_back(version);
+  if (slotsEnabled)
+    setSlot(getValueId(value), Binding(this, &versions));
 }
+
+void TxVersionedValues::setSlot(unsigned id, const Binding &binding) const {
+  if (!slots) {
+    slots = new Slots();
+  } else if (slots->refCount > 1) {
+    Slots *copy = new Slots();
+    copy->bindings = slots->bindings;
+    --slots->refCount;
+    slots = copy;
+  }
+  if (slots->bindings.size() <= id)
+    slots->bindings.resize(id + 1);
+  slots->bindings[id] = binding;
+}
+
+void TxVersionedValues::pruneShadowedVersions() {
+  for (std::map<llvm::Value *, Versions>::iterator it = localValues.begin(),
+                                                   ie = localValues.end();
+       it != ie; ++it) {
+    Versions &versions = it->second;
+    if (versions.size() < 2)
+      continue;
+
+    std::set<ref<Expr> > seen;
+    Versions::iterator out = versions.end();
+    for (Versions::iterator vit = versions.end(), vib = versions.begin();
+         vit != vib;) {
+      --vit;
+      if (seen.insert((*vit)->getExpression()).second)
+        *--out = *vit;
+    }
+    versions.erase(versions.begin(), out);
+  }
+}
+
+uint64_t TxVersionedValues::getByteSize() const {
+  uint64_t size = 0;
+  if (slots)
+    size += sizeof(Slots) +
+            slots->bindings.capacity() * sizeof(Binding) / slots->refCount;
+  for (std::map<llvm::Value *, Versions>::const_iterator
+           it = localValues.begin(),
+           ie = localValues.end();
+       it != ie; ++it)
+    size += sizeof(*it) + 4 * sizeof(void *) +
+            it->second.capacity() * sizeof(ref<TxStateValue>);
+  return size;
+}
+
+TxVersionedValues::Binding
+TxVersionedValues::findUncached(llvm::Value *value) const {
+  for (const TxVersionedValues *node = this; node; node = node->parent) {
+    std::map<llvm::Value *, Versions>::const_iterator it =
+        node->localValues.find(value);
+    if (it != node->localValues.end())
+      return Binding(node, &it->second);
+  }
+  return Binding();
+}
+
+TxVersionedValues::Binding
+TxVersionedValues::find(llvm::Value *value) const {
+  if (!slotsEnabled)
+    return findUncached(value);
+
+  unsigned id = getValueId(value);
+  if (slots && id < slots->bindings.size() && slots->bindings[id].versions) {
+    if (slots->bindings[id].versions == &noVersions)
+      return Binding();
+    return slots->bindings[id];
+  }
+
+  Binding ret = findUncached(value);
+  setSlot(id, ret.owner ? ret : Binding(0, &noVersions));
+  return ret;
+}
+}
+
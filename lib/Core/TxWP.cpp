@@ -39,9 +39,16 @@ typedef std::map<ref<TxVariable>, ref<TxInterpolantValue> >
 typedef std::map<ref<TxAllocationContext>, LowerInterpolantStore>
     TopInterpolantStore;
 
+llvm::DenseMap<llvm::Value *, ref<Expr> >
+    TxWeakestPreCondition::operandCache;
+
+llvm::DenseMap<llvm::Instruction *, ref<Expr> >
+    TxWeakestPreCondition::conditionCache;
+
 TxWeakestPreCondition::TxWeakestPreCondition(TxTreeNode *_node,
                                              TxDependency *_dependency,
-                                             llvm::DataLayout *_targetData) {
+                                             llvm::DataLayout *_targetData)
+    : nodeDependent(false) {
   WPExpr = True();
 
   // Used to represent constants during the simplification of WPExpr to
@@ -148,9 +155,9 @@ TxSubsumptionTableEntry *TxWeakestPreCondition::updateSubsumptionTableEntry(
     pimiuVars = TxPartitionHelper::getExprVars(entry->getInterpolant());
 
   // vars(miu)
-  TxStore::TopInterpolantStore concretelyAddressedStore =
+  const TxStore::TopInterpolantStore &concretelyAddressedStore =
       entry->getConcretelyAddressedStore();
-  for (TxStore::TopInterpolantStore::iterator
+  for (TxStore::TopInterpolantStore::const_iterator
            it1 = concretelyAddressedStore.begin(),
            ie1 = concretelyAddressedStore.end();
        it1 != ie1; ++it1) {
@@ -194,7 +201,7 @@ TxSubsumptionTableEntry *TxWeakestPreCondition::updateSubsumptionTableEntry(
   }
 
   // closure on miu
-  for (TxStore::TopInterpolantStore::iterator
+  for (TxStore::TopInterpolantStore::const_iterator
            it1 = concretelyAddressedStore.begin(),
            ie1 = concretelyAddressedStore.end();
        it1 != ie1; ++it1) {
@@ -245,7 +252,7 @@ TxSubsumptionTableEntry *TxWeakestPreCondition::updateSubsumptionTableEntry(
 
   // update miu by (miu, v1star)
   std::set<ref<TxAllocationContext> > dels;
-  for (TxStore::TopInterpolantStore::iterator
+  for (TxStore::TopInterpolantStore::const_iterator
            it1 = concretelyAddressedStore.begin(),
            ie1 = concretelyAddressedStore.end();
        it1 != ie1; ++it1) {
@@ -260,13 +267,16 @@ TxSubsumptionTableEntry *TxWeakestPreCondition::updateSubsumptionTableEntry(
       }
     }
   }
-  for (std::set<ref<TxAllocationContext> >::iterator it = dels.begin(),
-                                                     ie = dels.end();
-       it != ie; ++it) {
-    concretelyAddressedStore.erase((*it));
+  // The store of the entry is only copied when it is updated
+  if (!dels.empty()) {
+    TxStore::TopInterpolantStore updatedStore = concretelyAddressedStore;
+    for (std::set<ref<TxAllocationContext> >::iterator it = dels.begin(),
+                                                       ie = dels.end();
+         it != ie; ++it) {
+      updatedStore.erase((*it));
+    }
+    entry->setConcretelyAddressedStore(updatedStore);
   }
-
-  entry->setConcretelyAddressedStore(concretelyAddressedStore);
   return entry;
 }
 
@@ -278,14 +288,14 @@ TxSubsumptionTableEntry *TxWeakestPreCondition::updateSubsumptionTableEntry(
  * Push up expression to top of the  basic block
  */
 ref<Expr> TxWeakestPreCondition::PushUp(
-    std::vector<std::pair<KInstruction *, int> > reverseInstructionList) {
+    const TxInstructionTrace &reverseInstructionList) {
 
-  for (std::vector<std::pair<KInstruction *, int> >::const_reverse_iterator
+  for (TxInstructionTrace::reverse_iterator
            it = reverseInstructionList.rbegin(),
            ie = reverseInstructionList.rend();
        it != ie; ++it) {
-    llvm::Instruction *i = (*it).first->inst;
-    int flag = (*it).second;
+    llvm::Instruction *i = it.getInstruction();
+    int flag = it.getMark();
     if (flag == 1) {
       // 1- call getCondition on the cond argument of the branch instruction
       // 2- create and expression from the condition and this->WPExpr
@@ -391,13 +401,40 @@ ref<Expr> TxWeakestPreCondition::getBrCondition(llvm::Instruction *ins) {
         "TxWeakestPreCondition::getBrCondition: not a Branch instruction!");
     return True();
   }
+  llvm::DenseMap<llvm::Instruction *, ref<Expr> >::iterator it =
+      conditionCache.find(ins);
+  if (it != conditionCache.end())
+    return it->second;
+
+  bool savedNodeDependent = nodeDependent;
+  nodeDependent = false;
   llvm::BranchInst *br = llvm::dyn_cast<llvm::BranchInst>(ins);
   ref<Expr> result = getCondition(br->getCondition());
+  if (!nodeDependent && !result.isNull())
+    conditionCache[ins] = result;
+  nodeDependent = nodeDependent || savedNodeDependent;
   return result;
 }
 
 ref<Expr> TxWeakestPreCondition::generateExprFromOperand(llvm::Value *val,
                                                          ref<Expr> offset) {
+  llvm::DenseMap<llvm::Value *, ref<Expr> >::iterator it =
+      operandCache.find(val);
+  if (it != operandCache.end())
+    return it->second;
+
+  bool savedNodeDependent = nodeDependent;
+  nodeDependent = false;
+  ref<Expr> ret = translateOperand(val);
+  // Null translations are not cached, so that their warnings are still
+  // emitted each time.
+  if (!nodeDependent && !ret.isNull())
+    operandCache[val] = ret;
+  nodeDependent = nodeDependent || savedNodeDependent;
+  return ret;
+}
+
+ref<Expr> TxWeakestPreCondition::translateOperand(llvm::Value *val) {
   ref<Expr> ret;
   //    klee_warning("TxWeakestPreCondition::generateExprFromOperand0");
   //    val->dump();
@@ -969,6 +1006,7 @@ ref<Expr> TxWeakestPreCondition::getSwitchInst(llvm::SwitchInst *si) {
 }
 
 ref<Expr> TxWeakestPreCondition::getPhiInst(llvm::PHINode *phi) {
+  nodeDependent = true;
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
   llvm::Value *inputArg = phi->getOperand(node->phiNodeArg[phi]);
 #else
@@ -979,6 +1017,7 @@ ref<Expr> TxWeakestPreCondition::getPhiInst(llvm::PHINode *phi) {
 }
 
 ref<Expr> TxWeakestPreCondition::getCallInst(llvm::CallInst *ci) {
+  nodeDependent = true;
   llvm::Function *function = ci->getCalledFunction();
 
   // TODO: This loop can further be optimized if we had access to the
@@ -987,13 +1026,13 @@ ref<Expr> TxWeakestPreCondition::getCallInst(llvm::CallInst *ci) {
   // can be accessed from the pushup function. We leave this optimization
   // as future work.
   llvm::Instruction *ret = 0;
-  for (std::vector<std::pair<KInstruction *, int> >::reverse_iterator
+  for (TxInstructionTrace::reverse_iterator
            it = this->node->reverseInstructionList.rbegin(),
            ie = this->node->reverseInstructionList.rend();
        it != ie; ++it) {
-    if (isa<llvm::ReturnInst>(it->first->inst) &&
-        inFunction(it->first->inst, function)) {
-      ret = it->first->inst;
+    if (isa<llvm::ReturnInst>(it.getInstruction()) &&
+        inFunction(it.getInstruction(), function)) {
+      ret = it.getInstruction();
     }
   }
   assert(ret && "Return instruction is null!");
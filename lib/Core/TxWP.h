@@ -23,6 +23,7 @@
 #include "TxWPHelper.h"
 #include "Z3Simplification.h"
 #include "klee/ExecutionState.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/DataLayout.h"
 #include <klee/Expr.h>
 #include <klee/ExprBuilder.h>
@@ -53,12 +54,34 @@ class TxWeakestPreCondition {
 
   llvm::DataLayout *targetData;
 
+  /// \brief The translations of the LLVM values and branch conditions that do
+  /// not depend on the node, that is, on the phi arguments taken or on the
+  /// return instructions executed. They are the same in every node, so that
+  /// pushing up the instructions of an already seen basic block only needs
+  /// to compose the cached expressions with the postcondition.
+  static llvm::DenseMap<llvm::Value *, ref<Expr> > operandCache;
+  static llvm::DenseMap<llvm::Instruction *, ref<Expr> > conditionCache;
+
+  /// \brief Whether the translation being computed depends on the node
+  bool nodeDependent;
+
 public:
   TxWeakestPreCondition(TxTreeNode *_node, TxDependency *_dependency,
                         llvm::DataLayout *_targetData);
 
   ~TxWeakestPreCondition();
 
+  /// \brief Allocate from the TxWeakestPreCondition arena
+  static void *operator new(size_t size) {
+    return TxArena::get<TxWeakestPreCondition>("TxWeakestPreCondition")
+        .allocate(size);
+  }
+
+  static void operator delete(void *p, size_t size) {
+    TxArena::get<TxWeakestPreCondition>("TxWeakestPreCondition")
+        .deallocate(p, size);
+  }
+
   ref<Expr> True() { return ConstantExpr::alloc(1, Expr::Bool); };
   ref<Expr> False() { return ConstantExpr::alloc(0, Expr::Bool); };
 
@@ -89,8 +112,7 @@ public:
   // =========================================================================
 
   // \brief Generate and return the weakest precondition expression.
-  ref<Expr>
-  PushUp(std::vector<std::pair<KInstruction *, int> > reverseInstructionList);
+  ref<Expr> PushUp(const TxInstructionTrace &reverseInstructionList);
 
   ref<Expr> getBrCondition(llvm::Instruction *ins);
 
@@ -104,6 +126,9 @@ public:
 private:
   ref<Expr> getCondition(llvm::Value *value);
 
+  // \brief Generate expression from an operand, without the cache
+  ref<Expr> translateOperand(llvm::Value *val);
+
   // \brief Handling ConstantInt LLVM Value
   ref<Expr> getConstantInt(llvm::ConstantInt *constantInt);
 
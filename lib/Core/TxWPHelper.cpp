@@ -17,107 +17,104 @@
 
 #include "TxWPHelper.h"
 
+#include "klee/util/TxExprUtil.h"
+
 namespace klee {
 
-bool TxWPHelper::isTargetDependent(llvm::Value *inst, ref<Expr> expr) {
-  switch (expr->getKind()) {
-  case Expr::InvalidKind:
-  case Expr::Constant: {
-    return false;
-  }
+namespace {
+/// \brief Search of a WPVar expression of an instruction, used by
+/// TxWPHelper::isTargetDependent
+class TxTargetDependenceFinder : public TxExprWalker {
+  llvm::Value *inst;
 
-  case Expr::WPVar: {
-    ref<WPVarExpr> wp1 = dyn_cast<WPVarExpr>(expr);
-    if (wp1->address == inst) {
+  bool visit(const ref<Expr> &expr) {
+    switch (expr->getKind()) {
+    case Expr::InvalidKind:
+    case Expr::Constant: {
       return true;
-    } else
-      return false;
-  }
+    }
 
-  case Expr::NotOptimized:
-  case Expr::Not:
-  case Expr::Extract:
-  case Expr::ZExt:
-  case Expr::SExt: {
-    ref<Expr> kids[1];
-    kids[0] = expr->getKid(0);
-    return isTargetDependent(inst, kids[0]);
-  }
+    case Expr::WPVar: {
+      ref<WPVarExpr> wp1 = dyn_cast<WPVarExpr>(expr);
+      if (wp1->address == inst) {
+        found = true;
+        return false;
+      }
+      return true;
+    }
 
-  case Expr::Eq:
-  case Expr::Ne:
-  case Expr::Ult:
-  case Expr::Ule:
-  case Expr::Ugt:
-  case Expr::Uge:
-  case Expr::Slt:
-  case Expr::Sle:
-  case Expr::Sgt:
-  case Expr::Sge:
-  case Expr::LastKind:
-  case Expr::Add:
-  case Expr::Sub:
-  case Expr::Mul:
-  case Expr::UDiv:
-  case Expr::SDiv:
-  case Expr::URem:
-  case Expr::SRem:
-  case Expr::And:
-  case Expr::Or:
-  case Expr::Xor:
-  case Expr::Shl:
-  case Expr::LShr:
-  case Expr::AShr: {
-    ref<Expr> kids[2];
-    kids[0] = expr->getKid(0);
-    kids[1] = expr->getKid(1);
-    return (isTargetDependent(inst, kids[0]) ||
-            isTargetDependent(inst, kids[1]));
-  }
+    case Expr::NotOptimized:
+    case Expr::Not:
+    case Expr::Extract:
+    case Expr::ZExt:
+    case Expr::SExt: {
+      push(expr->getKid(0));
+      return true;
+    }
 
-  case Expr::Select: {
-    ref<Expr> kids[3];
-    kids[0] = expr->getKid(0);
-    kids[1] = expr->getKid(1);
-    kids[2] = expr->getKid(2);
-    return (isTargetDependent(inst, kids[0]) ||
-            isTargetDependent(inst, kids[1]) ||
-            isTargetDependent(inst, kids[2]));
-  }
-  case Expr::Upd: {
-    ref<Expr> kids[3];
-    kids[0] = expr->getKid(0);
-    kids[1] = expr->getKid(1);
-    kids[2] = expr->getKid(2);
-    return (isTargetDependent(inst, kids[0]) ||
-            isTargetDependent(inst, kids[1]) ||
-            isTargetDependent(inst, kids[2]));
-  }
-  case Expr::Sel: {
-    ref<Expr> kids[2];
-    kids[0] = expr->getKid(0);
-    kids[1] = expr->getKid(1);
-    return (isTargetDependent(inst, kids[0]) ||
-            isTargetDependent(inst, kids[1]));
-  }
-  default: {
-    // Sanity check
-    expr->dump();
-    klee_error("Control should not reach here in "
-               "TxWPHelper::isTargetDependent!");
-  }
+    case Expr::Eq:
+    case Expr::Ne:
+    case Expr::Ult:
+    case Expr::Ule:
+    case Expr::Ugt:
+    case Expr::Uge:
+    case Expr::Slt:
+    case Expr::Sle:
+    case Expr::Sgt:
+    case Expr::Sge:
+    case Expr::LastKind:
+    case Expr::Add:
+    case Expr::Sub:
+    case Expr::Mul:
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+    case Expr::And:
+    case Expr::Or:
+    case Expr::Xor:
+    case Expr::Shl:
+    case Expr::LShr:
+    case Expr::AShr:
+    case Expr::Sel: {
+      push(expr->getKid(0));
+      push(expr->getKid(1));
+      return true;
+    }
+
+    case Expr::Select:
+    case Expr::Upd: {
+      push(expr->getKid(0));
+      push(expr->getKid(1));
+      push(expr->getKid(2));
+      return true;
+    }
+    default: {
+      // Sanity check
+      expr->dump();
+      klee_error("Control should not reach here in "
+                 "TxWPHelper::isTargetDependent!");
+    }
+    }
+    return true;
   }
-  return false;
-}
 
-ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
-                                     const ref<Expr> rhs) {
+public:
+  bool found;
+
+  TxTargetDependenceFinder(llvm::Value *_inst) : inst(_inst), found(false) {}
+};
+
+/// \brief Substitution of an expression, used by TxWPHelper::substituteExpr.
+/// The expression is substituted by null if the substitution is null.
+class TxWPSubstitution : public TxExprRewriter {
+  const ref<Expr> lhs;
+  const ref<Expr> rhs;
+
+  ref<Expr> rewriteNode(const ref<Expr> &base) {
+    if (base.compare(lhs) == 0) // base case
+      return rhs;
 
-  if (rhs.isNull()) {
-    return rhs;
-  } else if (base.compare(lhs) == 0) { // base case
-    return rhs;
-  } else {
     switch (base->getKind()) {
     case Expr::InvalidKind:
     case Expr::Constant: {
@@ -139,7 +136,7 @@ ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
     case Expr::ZExt:
     case Expr::SExt: {
       ref<Expr> kids[1];
-      kids[0] = substituteExpr(base->getKid(0), lhs, rhs);
+      kids[0] = rewrite(base->getKid(0));
       if (kids[0].isNull())
         return kids[0];
       else
@@ -170,8 +167,8 @@ ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
     case Expr::LShr:
     case Expr::AShr: {
       ref<Expr> kids[2];
-      kids[0] = substituteExpr(base->getKid(0), lhs, rhs);
-      kids[1] = substituteExpr(base->getKid(1), lhs, rhs);
+      kids[0] = rewrite(base->getKid(0));
+      kids[1] = rewrite(base->getKid(1));
 
       if (kids[0].isNull())
         return kids[0];
@@ -185,8 +182,8 @@ ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
     case Expr::Or:
     case Expr::Xor: {
       ref<Expr> kids[2];
-      kids[0] = substituteExpr(base->getKid(0), lhs, rhs);
-      kids[1] = substituteExpr(base->getKid(1), lhs, rhs);
+      kids[0] = rewrite(base->getKid(0));
+      kids[1] = rewrite(base->getKid(1));
       if (kids[0].isNull())
         return kids[1];
       else if (kids[1].isNull())
@@ -198,9 +195,9 @@ ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
     case Expr::Upd:
     case Expr::Select: {
       ref<Expr> kids[3];
-      kids[0] = substituteExpr(base->getKid(0), lhs, rhs);
-      kids[1] = substituteExpr(base->getKid(1), lhs, rhs);
-      kids[2] = substituteExpr(base->getKid(2), lhs, rhs);
+      kids[0] = rewrite(base->getKid(0));
+      kids[1] = rewrite(base->getKid(1));
+      kids[2] = rewrite(base->getKid(2));
       if (kids[0].isNull())
         return kids[0];
       else if (kids[1].isNull())
@@ -218,9 +215,27 @@ ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
       klee_error("TxWPHelper::substituteExpr: Expression not supported yet!");
     }
     }
+
+    return base;
   }
 
-  return base;
+public:
+  TxWPSubstitution(const ref<Expr> _lhs, const ref<Expr> _rhs)
+      : lhs(_lhs), rhs(_rhs) {}
+};
+}
+
+bool TxWPHelper::isTargetDependent(llvm::Value *inst, ref<Expr> expr) {
+  TxTargetDependenceFinder finder(inst);
+  finder.walk(expr);
+  return finder.found;
+}
+
+ref<Expr> TxWPHelper::substituteExpr(ref<Expr> base, const ref<Expr> lhs,
+                                     const ref<Expr> rhs) {
+  if (rhs.isNull())
+    return rhs;
+  return TxWPSubstitution(lhs, rhs).rewrite(base);
 }
 
 } /* namespace klee */
@@ -11,6 +11,7 @@
 
 #include "Searcher.h"
 #include "Executor.h"
+#include "PriorProfile.h"
 
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "llvm/Support/CommandLine.h"
@@ -31,6 +32,8 @@ namespace {
 			clEnumValN(Searcher::NURS_ICnt, "nurs:icnt", "use NURS with Instr-Count"),
 			clEnumValN(Searcher::NURS_CPICnt, "nurs:cpicnt", "use NURS with CallPath-Instr-Count"),
 			clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost"),
+			clEnumValN(Searcher::NURS_Prior, "nurs:prior", "use NURS with the Query-Cost of the blocks in the run of -prior-istats"),
+			clEnumValN(Searcher::Interpolation, "interpolation", "use DFS favoring states likely to be subsumed or to complete a Tracer-X subtree"),
 			clEnumValEnd));
 
   cl::opt<bool>
@@ -61,6 +64,12 @@ namespace {
   UseBumpMerge("use-bump-merge", 
            cl::desc("Enable support for klee_merge() (extra experimental)"));
 
+  cl::opt<bool>
+  UseLoopMerge("use-loop-merge",
+               cl::desc("Merge the states reaching the heads of loops, also "
+                        "with interpolation, which is then not used in the "
+                        "subtrees of the merged states (experimental)"));
+
 }
 
 
@@ -86,6 +95,12 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, Executor &executor) {
   case Searcher::NURS_ICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::InstCount); break;
   case Searcher::NURS_CPICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CPInstCount); break;
   case Searcher::NURS_QC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::QueryCost); break;
+  case Searcher::NURS_Prior:
+    if (!PriorProfile::isLoaded())
+      klee_warning("nurs:prior without -prior-istats weighs the states uniformly");
+    searcher = new WeightedRandomSearcher(WeightedRandomSearcher::PriorQueryCost);
+    break;
+  case Searcher::Interpolation: searcher = new InterpolationSearcher(); break;
   }
 
   return searcher;
@@ -122,6 +137,8 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     searcher = new MergingSearcher(executor, searcher);
   } else if (UseBumpMerge) {
     searcher = new BumpMergingSearcher(executor, searcher);
+  } else if (UseLoopMerge) {
+    searcher = new LoopMergingSearcher(executor, searcher);
   }
   
   if (UseIterativeDeepeningTimeSearch) {
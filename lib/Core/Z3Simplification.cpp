@@ -7,8 +7,33 @@
 
 #include "Z3Simplification.h"
 
+#include "klee/CommandLine.h"
+#include "klee/Solver.h"
+#include "klee/SolverStats.h"
+
+#include "llvm/Support/CommandLine.h"
+
 using namespace klee;
 
+namespace {
+llvm::cl::opt<unsigned> Z3SimplificationCacheSize(
+    "z3-simplification-cache-size",
+    llvm::cl::desc("Maximum number of memoized results of the Z3 "
+                   "simplification of weakest-precondition interpolants "
+                   "(0=off, default=65536)."),
+    llvm::cl::init(65536));
+}
+
+z3::context *Z3Simplification::context = 0;
+
+z3::tactic *Z3Simplification::simplifyTactic = 0;
+
+z3::tactic *Z3Simplification::ctxSolverSimplifyTactic = 0;
+
+std::map<ref<Expr>, ref<Expr> > Z3Simplification::cache;
+
+uint64_t Z3Simplification::usageAfterRecycle = 0;
+
 void Z3Simplification::test() {
   std::cout << "Start test!\n";
   z3::context c;
@@ -26,17 +51,54 @@ ref<Expr> Z3Simplification::simplify(ref<Expr> txe) {
   if (txe.isNull()) {
     return txe;
   }
-  z3::context c;
+
+  std::map<ref<Expr>, ref<Expr> >::iterator it = cache.find(txe);
+  if (it != cache.end())
+    return it->second;
+
+  // The memoized results are kept, as they do not refer to the context
+  if (context && Z3RecycleMemory &&
+      Z3Solver::shouldRecycleContext(usageAfterRecycle)) {
+    std::map<ref<Expr>, ref<Expr> > results;
+    results.swap(cache);
+    deallocate();
+    cache.swap(results);
+    usageAfterRecycle = Z3Solver::getMemoryUsage();
+    ++stats::z3ContextRecycles;
+  }
+
+  if (!context) {
+    context = new z3::context();
+    simplifyTactic = new z3::tactic(*context, "simplify");
+    ctxSolverSimplifyTactic = new z3::tactic(*context, "ctx-solver-simplify");
+  }
+
+  ref<Expr> ret = txe;
   std::map<std::string, ref<Expr> > emap;
-  z3::expr z3e = c.bool_val(false);
-  bool succ = txExpr2z3Expr(z3e, c, txe, emap);
+  z3::expr z3e = context->bool_val(false);
+  bool succ = txExpr2z3Expr(z3e, *context, txe, emap);
   if (succ) {
-    z3e = applyTactic(c, "simplify", z3e);
-    z3e = applyTactic(c, "ctx-solver-simplify", z3e);
-    ref<Expr> ret = z3Expr2TxExpr(z3e, emap);
-    return ret;
+    z3e = applyTactic(*context, *simplifyTactic, z3e);
+    z3e = applyTactic(*context, *ctxSolverSimplifyTactic, z3e);
+    ret = z3Expr2TxExpr(z3e, emap);
   }
-  return txe;
+
+  if (Z3SimplificationCacheSize) {
+    if (cache.size() >= Z3SimplificationCacheSize)
+      cache.clear();
+    cache[txe] = ret;
+  }
+  return ret;
+}
+
+void Z3Simplification::deallocate() {
+  cache.clear();
+  delete simplifyTactic;
+  delete ctxSolverSimplifyTactic;
+  delete context;
+  simplifyTactic = 0;
+  ctxSolverSimplifyTactic = 0;
+  context = 0;
 }
 
 bool Z3Simplification::txExpr2z3Expr(z3::expr &z3e, z3::context &c,
@@ -440,11 +502,10 @@ Z3Simplification::z3Expr2TxExpr(z3::expr e,
   return ret;
 }
 
-z3::expr Z3Simplification::applyTactic(z3::context &c, std::string tactic,
+z3::expr Z3Simplification::applyTactic(z3::context &c, z3::tactic &t,
                                        z3::expr e) {
   z3::goal g(c);
   g.add(e);
-  z3::tactic t(c, tactic.c_str());
   z3::apply_result r = t(g);
   assert(r.size() > 0 && "apply result is empty!");
   z3::expr ret = r[0].as_expr();
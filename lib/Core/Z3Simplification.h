@@ -12,6 +12,7 @@
 #include <cstdlib>
 #include <iostream>
 #include <klee/Expr.h>
+#include <map>
 #include <string>
 
 #include <z3++.h>
@@ -22,16 +23,35 @@ public:
   Z3Simplification();
   virtual ~Z3Simplification();
 
+  /// \brief Simplify an expression with Z3, memoizing the result
   static ref<Expr> simplify(ref<Expr> expr);
+
+  /// \brief Release the Z3 context and the memoized results
+  static void deallocate();
+
   static void test();
 
 private:
+  /// \brief The Z3 context used for all simplifications
+  static z3::context *context;
+
+  /// \brief The tactics applied, built once in the context
+  static z3::tactic *simplifyTactic;
+  static z3::tactic *ctxSolverSimplifyTactic;
+
+  /// \brief The memoized simplification results
+  static std::map<ref<Expr>, ref<Expr> > cache;
+
+  /// \brief The memory usage of Z3 after the last recycling of the context
+  /// under -z3-recycle-memory
+  static uint64_t usageAfterRecycle;
+
   static bool txExpr2z3Expr(z3::expr &z3e, z3::context &c, ref<Expr> txe,
                             std::map<std::string, ref<Expr> > &emap);
 
   static ref<Expr> z3Expr2TxExpr(z3::expr,
                                  std::map<std::string, ref<Expr> > &emap);
-  static z3::expr applyTactic(z3::context &c, std::string tactic, z3::expr e);
+  static z3::expr applyTactic(z3::context &c, z3::tactic &t, z3::expr e);
 
   static bool isaVar(ref<Expr> e);
   static std::string extractVarName(ref<Expr> e);
@@ -2,6 +2,30 @@
 
 namespace klee {
 
+namespace {
+/// Hold the lock of an array cache in the thread-safe build
+class ArrayCacheGuard {
+#ifdef KLEE_THREADSAFE_REFS
+  pthread_mutex_t *lock;
+
+public:
+  ArrayCacheGuard(pthread_mutex_t *_lock) : lock(_lock) {
+    pthread_mutex_lock(lock);
+  }
+  ~ArrayCacheGuard() { pthread_mutex_unlock(lock); }
+#else
+public:
+  ArrayCacheGuard(void *) {}
+#endif
+};
+}
+
+ArrayCache::ArrayCache() {
+#ifdef KLEE_THREADSAFE_REFS
+  pthread_mutex_init(&lock, 0);
+#endif
+}
+
 ArrayCache::~ArrayCache() {
   // Free Allocated Array objects
   for (ArrayHashMap::iterator ai = cachedSymbolicArrays.begin(),
@@ -14,13 +38,32 @@ ArrayCache::~ArrayCache() {
        ai != e; ++ai) {
     delete *ai;
   }
+#ifdef KLEE_THREADSAFE_REFS
+  pthread_mutex_destroy(&lock);
+#endif
 }
 
+#ifdef KLEE_THREADSAFE_REFS
+#define ARRAY_CACHE_LOCK &lock
+#else
+#define ARRAY_CACHE_LOCK 0
+#endif
+
 const Array *
 ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
                         const ref<ConstantExpr> *constantValuesBegin,
                         const ref<ConstantExpr> *constantValuesEnd,
                         Expr::Width _domain, Expr::Width _range) {
+  ArrayCacheGuard guard(ARRAY_CACHE_LOCK);
+  return createArrayUnlocked(_name, _size, constantValuesBegin,
+                             constantValuesEnd, _domain, _range);
+}
+
+const Array *ArrayCache::createArrayUnlocked(
+    const std::string &_name, uint64_t _size,
+    const ref<ConstantExpr> *constantValuesBegin,
+    const ref<ConstantExpr> *constantValuesEnd, Expr::Width _domain,
+    Expr::Width _range) {
 
   const Array *array = new Array(_name, _size, constantValuesBegin,
                                  constantValuesEnd, _domain, _range);
@@ -44,4 +87,13 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
     return array;
   }
 }
+
+const Array *ArrayCache::CreateShadowArray(const Array *source,
+                                           const std::string &shadowName) {
+  ArrayCacheGuard guard(ARRAY_CACHE_LOCK);
+  if (!source->shadow)
+    source->shadow = createArrayUnlocked(shadowName, source->size, 0, 0,
+                                         source->domain, source->range);
+  return source->shadow;
+}
 }
@@ -0,0 +1,386 @@
+//===-- CompiledExpr.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/CompiledExpr.h"
+
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
+
+using namespace klee;
+
+namespace {
+/// The maximum number of programs in the cache of CompiledExpr::get
+const unsigned CacheSize = 4096;
+
+inline uint64_t mask(uint64_t value, unsigned width) {
+  return width >= 64 ? value : value & ((UINT64_C(1) << width) - 1);
+}
+
+inline int64_t toSigned(uint64_t value, unsigned width) {
+  if (width >= 64)
+    return (int64_t)value;
+  return (int64_t)(value << (64 - width)) >> (64 - width);
+}
+}
+
+CompiledExpr::CompiledExpr(const ref<Expr> &e)
+    : resultRegister(0), valid(true) {
+  resultRegister = compile(e);
+  registers.clear();
+  arrayIndices.clear();
+  updateLists.clear();
+  if (!valid) {
+    program.clear();
+    updates.clear();
+    arrays.clear();
+  }
+}
+
+unsigned CompiledExpr::emit(const Instruction &instruction) {
+  program.push_back(instruction);
+  return program.size() - 1;
+}
+
+unsigned CompiledExpr::compileUpdates(const UpdateNode *head) {
+  std::map<const UpdateNode *, std::pair<unsigned, unsigned> >::iterator it =
+      updateLists.find(head);
+  if (it != updateLists.end())
+    return it->second.first;
+
+  std::vector<std::pair<unsigned, unsigned> > list;
+  for (const UpdateNode *un = head; un && valid; un = un->next) {
+    unsigned index = compile(un->index);
+    list.push_back(std::make_pair(index, compile(un->value)));
+  }
+  unsigned begin = updates.size();
+  updates.insert(updates.end(), list.begin(), list.end());
+  updateLists[head] = std::make_pair(begin, (unsigned)updates.size());
+  return begin;
+}
+
+unsigned CompiledExpr::compile(const ref<Expr> &e) {
+  if (!valid)
+    return 0;
+
+  std::map<const Expr *, unsigned>::iterator it = registers.find(e.get());
+  if (it != registers.end())
+    return it->second;
+
+  if (e->getWidth() > 64) {
+    valid = false;
+    return 0;
+  }
+
+  Instruction instruction;
+  instruction.kind = e->getKind();
+  instruction.width = e->getWidth();
+  instruction.ops[0] = instruction.ops[1] = instruction.ops[2] = 0;
+  instruction.value = 0;
+  instruction.array = 0;
+  instruction.updatesBegin = instruction.updatesEnd = 0;
+
+  switch (e->getKind()) {
+  case Expr::Constant:
+    instruction.value = cast<ConstantExpr>(e)->getZExtValue();
+    break;
+
+  case Expr::NotOptimized:
+    return registers[e.get()] = compile(cast<NotOptimizedExpr>(e)->src);
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    const Array *array = re->updates.root;
+    if (array->getRange() > 64) {
+      valid = false;
+      return 0;
+    }
+    std::map<const Array *, unsigned>::iterator found =
+        arrayIndices.find(array);
+    if (found == arrayIndices.end()) {
+      found = arrayIndices.insert(std::make_pair(array, arrays.size())).first;
+      arrays.push_back(array);
+    }
+    instruction.array = found->second;
+    instruction.ops[0] = compile(re->index);
+    instruction.updatesBegin = compileUpdates(re->updates.head);
+    instruction.updatesEnd = updateLists[re->updates.head].second;
+    break;
+  }
+
+  case Expr::Select:
+  case Expr::Concat:
+  case Expr::Extract:
+  case Expr::ZExt:
+  case Expr::SExt:
+  case Expr::Not:
+  case Expr::Add:
+  case Expr::Sub:
+  case Expr::Mul:
+  case Expr::UDiv:
+  case Expr::SDiv:
+  case Expr::URem:
+  case Expr::SRem:
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor:
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr:
+  case Expr::Eq:
+  case Expr::Ne:
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Ugt:
+  case Expr::Uge:
+  case Expr::Slt:
+  case Expr::Sle:
+  case Expr::Sgt:
+  case Expr::Sge: {
+    // The operands past those of the node repeat the first, so that they
+    // are always known
+    unsigned n = e->getNumKids();
+    for (unsigned i = 0; i < n; ++i)
+      instruction.ops[i] = compile(e->getKid(i));
+    for (unsigned i = n; i < 3; ++i)
+      instruction.ops[i] = instruction.ops[0];
+    if (e->getKind() == Expr::Extract)
+      instruction.value = cast<ExtractExpr>(e)->offset;
+    else if (e->getKind() == Expr::Concat)
+      instruction.value = e->getKid(1)->getWidth();
+    else if (e->getKind() == Expr::SExt || e->getKind() >= Expr::CmpKindFirst)
+      instruction.value = e->getKid(0)->getWidth();
+    break;
+  }
+
+  default:
+    valid = false;
+    return 0;
+  }
+
+  if (!valid)
+    return 0;
+  return registers[e.get()] = emit(instruction);
+}
+
+bool CompiledExpr::evaluate(const Assignment &a, uint64_t &result) const {
+  if (!valid)
+    return false;
+
+  // The bindings of the arrays, looked up once per evaluation
+  std::vector<const std::vector<unsigned char> *> bound(arrays.size());
+  for (unsigned i = 0, n = arrays.size(); i < n; ++i) {
+    Assignment::bindings_ty::const_iterator it = a.bindings.find(arrays[i]);
+    bound[i] = it == a.bindings.end() ? 0 : &it->second;
+  }
+
+  // The registers, and whether each is not a constant in the assignment.
+  // Unknown values propagate, and are only an error when they reach the
+  // result, as a read may not select an update with an unknown value.
+  std::vector<uint64_t> r(program.size());
+  std::vector<char> unknown(program.size(), 0);
+
+  for (unsigned i = 0, n = program.size(); i < n; ++i) {
+    const Instruction &in = program[i];
+    uint64_t x = r[in.ops[0]], y = r[in.ops[1]];
+    char u = unknown[in.ops[0]];
+    if (in.kind != Expr::Constant && in.kind != Expr::Read &&
+        in.kind != Expr::Select)
+      u |= unknown[in.ops[1]];
+    uint64_t v = 0;
+
+    switch (in.kind) {
+    case Expr::Constant:
+      v = in.value;
+      u = 0;
+      break;
+
+    case Expr::Read: {
+      if (u)
+        break;
+      unsigned index = (unsigned)x;
+      bool found = false;
+      for (unsigned j = in.updatesBegin; j < in.updatesEnd; ++j) {
+        const std::pair<unsigned, unsigned> &update = updates[j];
+        if (unknown[update.first]) {
+          u = 1;
+          found = true;
+          break;
+        }
+        if (r[update.first] == index) {
+          v = r[update.second];
+          u = unknown[update.second];
+          found = true;
+          break;
+        }
+      }
+      if (found)
+        break;
+      const Array *array = arrays[in.array];
+      const std::vector<unsigned char> *bytes = bound[in.array];
+      if (array->isConstantArray() && index < array->size)
+        v = array->constantValues[index]->getZExtValue();
+      else if (bytes && index < bytes->size())
+        v = (*bytes)[index];
+      else if (a.allowFreeValues)
+        u = 1;
+      break;
+    }
+
+    case Expr::Select:
+      if (u)
+        break;
+      v = x ? y : r[in.ops[2]];
+      u = x ? unknown[in.ops[1]] : unknown[in.ops[2]];
+      break;
+
+    case Expr::Concat:
+      v = (x << in.value) | y;
+      break;
+    case Expr::Extract:
+      v = x >> in.value;
+      break;
+    case Expr::ZExt:
+      v = x;
+      break;
+    case Expr::SExt:
+      v = (uint64_t)toSigned(x, in.value);
+      break;
+    case Expr::Not:
+      v = ~x;
+      break;
+
+    case Expr::Add:
+      v = x + y;
+      break;
+    case Expr::Sub:
+      v = x - y;
+      break;
+    case Expr::Mul:
+      v = x * y;
+      break;
+
+    // Division by zero is left unevaluated by ExprEvaluator
+    case Expr::UDiv:
+      if (!y)
+        u = 1;
+      else
+        v = x / y;
+      break;
+    case Expr::URem:
+      if (!y)
+        u = 1;
+      else
+        v = x % y;
+      break;
+    case Expr::SDiv:
+    case Expr::SRem: {
+      if (!y) {
+        u = 1;
+        break;
+      }
+      int64_t sx = toSigned(x, in.width), sy = toSigned(y, in.width);
+      // The overflowing division wraps, as in APInt
+      if (sy == -1)
+        v = in.kind == Expr::SDiv ? (uint64_t)0 - (uint64_t)sx : 0;
+      else
+        v = in.kind == Expr::SDiv ? (uint64_t)(sx / sy) : (uint64_t)(sx % sy);
+      break;
+    }
+
+    case Expr::And:
+      v = x & y;
+      break;
+    case Expr::Or:
+      v = x | y;
+      break;
+    case Expr::Xor:
+      v = x ^ y;
+      break;
+
+    // Shifts by the width or more give zero, or the sign, as in APInt
+    case Expr::Shl:
+      v = y >= in.width ? 0 : x << y;
+      break;
+    case Expr::LShr:
+      v = y >= in.width ? 0 : x >> y;
+      break;
+    case Expr::AShr: {
+      int64_t sx = toSigned(x, in.width);
+      v = (uint64_t)(y >= in.width ? (sx < 0 ? -1 : 0) : sx >> y);
+      break;
+    }
+
+    case Expr::Eq:
+      v = x == y;
+      break;
+    case Expr::Ne:
+      v = x != y;
+      break;
+    case Expr::Ult:
+      v = x < y;
+      break;
+    case Expr::Ule:
+      v = x <= y;
+      break;
+    case Expr::Ugt:
+      v = x > y;
+      break;
+    case Expr::Uge:
+      v = x >= y;
+      break;
+    case Expr::Slt:
+      v = toSigned(x, in.value) < toSigned(y, in.value);
+      break;
+    case Expr::Sle:
+      v = toSigned(x, in.value) <= toSigned(y, in.value);
+      break;
+    case Expr::Sgt:
+      v = toSigned(x, in.value) > toSigned(y, in.value);
+      break;
+    case Expr::Sge:
+      v = toSigned(x, in.value) >= toSigned(y, in.value);
+      break;
+
+    default:
+      assert(0 && "unexpected instruction");
+    }
+
+    r[i] = mask(v, in.width);
+    unknown[i] = u;
+  }
+
+  if (unknown[resultRegister])
+    return false;
+  result = r[resultRegister];
+  return true;
+}
+
+const CompiledExpr *CompiledExpr::get(const ref<Expr> &e) {
+  // The threads sharing expressions each have their own cache, as the
+  // compiled expressions are freed when it is full
+#ifdef KLEE_THREADSAFE_REFS
+  static __thread ExprHashMap<CompiledExpr *> *threadCache = 0;
+  if (!threadCache)
+    threadCache = new ExprHashMap<CompiledExpr *>();
+  ExprHashMap<CompiledExpr *> &cache = *threadCache;
+#else
+  static ExprHashMap<CompiledExpr *> cache;
+#endif
+
+  ExprHashMap<CompiledExpr *>::iterator it = cache.find(e);
+  if (it == cache.end()) {
+    if (cache.size() >= CacheSize) {
+      for (it = cache.begin(); it != cache.end(); ++it)
+        delete it->second;
+      cache.clear();
+    }
+    it = cache.insert(std::make_pair(e, new CompiledExpr(e))).first;
+  }
+  return it->second->isValid() ? it->second : 0;
+}
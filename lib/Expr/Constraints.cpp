@@ -11,6 +11,7 @@
 #include "klee/CommandLine.h"
 
 #include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
@@ -58,13 +59,12 @@ public:
 
 class ExprReplaceVisitor2 : public ExprVisitor {
 private:
-  const std::map<ref<Expr>, std::pair<ref<Expr>, ref<Expr> > > &replacements;
+  const ConstraintManager::equalities_ty &replacements;
 
   std::set<ref<Expr> > usedEqualities;
 
 public:
-  ExprReplaceVisitor2(const std::map<
-      ref<Expr>, std::pair<ref<Expr>, ref<Expr> > > &_replacements)
+  ExprReplaceVisitor2(const ConstraintManager::equalities_ty &_replacements)
       : ExprVisitor(true), replacements(_replacements) {}
 
   void getCore(std::vector<ref<Expr> > &core) {
@@ -72,9 +72,9 @@ public:
   }
 
   Action visitExprPost(const Expr &e) {
-    std::map<ref<Expr>, std::pair<ref<Expr>, ref<Expr> > >::const_iterator it =
-        replacements.find(ref<Expr>(const_cast<Expr *>(&e)));
-    if (it!=replacements.end()) {
+    const ConstraintManager::equalities_ty::value_type *it =
+        replacements.lookup(ref<Expr>(const_cast<Expr *>(&e)));
+    if (it) {
       usedEqualities.insert(it->second.second);
       return Action::changeTo(it->second.first);
     } else {
@@ -83,25 +83,204 @@ public:
   }
 };
 
-bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintManager::constraints_ty old;
-  bool changed = false;
+void ConstraintPartition::getKeys(ref<Expr> e, std::vector<key_ty> &keys) {
+  std::vector<ref<ReadExpr> > reads;
+  findReads(e, /* visitUpdates= */ true, reads);
+  for (std::vector<ref<ReadExpr> >::iterator it = reads.begin(),
+                                             ie = reads.end();
+       it != ie; ++it) {
+    const ReadExpr *re = it->get();
+    // Reads of a constant array don't alias.
+    if (re->updates.root->isConstantArray() && !re->updates.head)
+      continue;
+    if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(re->index))
+      keys.push_back(key_ty(re->updates.root, ce->getZExtValue(32)));
+    else
+      keys.push_back(key_ty(re->updates.root, ~0u));
+  }
+}
 
-  constraints.swap(old);
-  for (ConstraintManager::constraints_ty::iterator 
-         it = old.begin(), ie = old.end(); it != ie; ++it) {
-    ref<Expr> &ce = *it;
-    ref<Expr> e = visitor.visit(ce);
+unsigned ConstraintPartition::find(unsigned id) const {
+  // No path compression, so that lookups do not write and the partition of a
+  // shared constraint set can be read concurrently; union by rank keeps the
+  // paths logarithmic.
+  while (parent[id] != id)
+    id = parent[id];
+  return id;
+}
 
-    if (e!=ce) {
-      addConstraintInternal(e); // enable further reductions
-      changed = true;
+unsigned ConstraintPartition::unite(unsigned a, unsigned b) {
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return a;
+  if (rank[a] < rank[b])
+    std::swap(a, b);
+  parent[b] = a;
+  if (rank[a] == rank[b])
+    ++rank[a];
+  return a;
+}
+
+unsigned ConstraintPartition::getKeyId(const key_ty &key) {
+  std::map<key_ty, unsigned>::iterator it = keyIds.lower_bound(key);
+  if (it != keyIds.end() && it->first == key)
+    return it->second;
+
+  unsigned id = parent.size();
+  parent.push_back(id);
+  rank.push_back(0);
+  keyIds.insert(it, std::make_pair(key, id));
+
+  if (key.second == ~0u) {
+    // The whole array joins every element of it read so far.
+    for (std::map<key_ty, unsigned>::iterator
+             it2 = keyIds.lower_bound(key_ty(key.first, 0)),
+             ie2 = keyIds.end();
+         it2 != ie2 && it2->first.first == key.first; ++it2)
+      unite(id, it2->second);
+  } else {
+    std::map<key_ty, unsigned>::iterator whole =
+        keyIds.find(key_ty(key.first, ~0u));
+    if (whole != keyIds.end())
+      unite(id, whole->second);
+  }
+  return id;
+}
+
+void ConstraintPartition::add(ref<Expr> e) {
+  std::vector<key_ty> keys;
+  getKeys(e, keys);
+
+  unsigned id = ~0u;
+  for (std::vector<key_ty>::iterator it = keys.begin(), ie = keys.end();
+       it != ie; ++it) {
+    unsigned keyId = getKeyId(*it);
+    id = (id == ~0u) ? keyId : unite(id, keyId);
+  }
+  constraintKeys.push_back(id);
+}
+
+void ConstraintPartition::clear() {
+  keyIds.clear();
+  parent.clear();
+  rank.clear();
+  constraintKeys.clear();
+}
+
+bool ConstraintPartition::getDependent(ref<Expr> e,
+                                       std::vector<bool> &dependent) const {
+  std::vector<key_ty> keys;
+  getKeys(e, keys);
+
+  std::set<unsigned> roots;
+  for (std::vector<key_ty>::iterator it = keys.begin(), ie = keys.end();
+       it != ie; ++it) {
+    if (it->second == ~0u) {
+      for (std::map<key_ty, unsigned>::const_iterator
+               it2 = keyIds.lower_bound(key_ty(it->first, 0)),
+               ie2 = keyIds.end();
+           it2 != ie2 && it2->first.first == it->first; ++it2)
+        roots.insert(find(it2->second));
     } else {
-      constraints.push_back(ce);
+      std::map<key_ty, unsigned>::const_iterator it2 = keyIds.find(*it);
+      if (it2 == keyIds.end())
+        it2 = keyIds.find(key_ty(it->first, ~0u));
+      if (it2 != keyIds.end())
+        roots.insert(find(it2->second));
+    }
+  }
+
+  dependent.assign(constraintKeys.size(), false);
+  if (keys.empty())
+    return false;
+  if (roots.empty())
+    return true;
+  for (unsigned i = 0, n = constraintKeys.size(); i != n; ++i)
+    if (constraintKeys[i] != ~0u && roots.count(find(constraintKeys[i])))
+      dependent[i] = true;
+  return true;
+}
+
+bool ConstraintManager::getIndependentConstraints(
+    ref<Expr> e, std::vector<ref<Expr> > &result) const {
+  if (partition.size() != constraints.size())
+    return false;
+
+  std::vector<bool> dependent;
+  partition.getDependent(e, dependent);
+  for (unsigned i = 0, n = constraints.size(); i != n; ++i)
+    if (dependent[i])
+      result.push_back(constraints[i]);
+  return true;
+}
+
+void ConstraintManager::addEquality(ref<Expr> e) const {
+  // A later constraint replaces the entry of an earlier one with the same
+  // key, as when the map was built by a pass over the constraints.
+  if (const EqExpr *ee = dyn_cast<EqExpr>(e)) {
+    if (isa<ConstantExpr>(ee->left)) {
+      equalities = equalities.replace(
+          std::make_pair(ee->right, std::make_pair(ee->left, e)));
+      ++equalitiesSize;
+      return;
     }
   }
+  equalities = equalities.replace(std::make_pair(
+      e, std::make_pair(ConstantExpr::alloc(1, Expr::Bool), e)));
+  ++equalitiesSize;
+}
+
+void ConstraintManager::pushConstraint(ref<Expr> e) {
+  // Keep the partition only while it covers all the constraints.
+  if (partition.size() == constraints.size())
+    partition.add(e);
+  if (equalitiesSize == constraints.size())
+    addEquality(e);
+  if (rangesSize == constraints.size())
+    addRange(e);
+  constraints.push_back(e);
+}
+
+bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor,
+                                           ref<Expr> replaced) {
+  // A constraint containing the replaced expression reads the array
+  // elements it reads, so it is in the same independent set. An expression
+  // reading no tracked array can be anywhere.
+  std::vector<bool> affected;
+  if (partition.size() != constraints.size() ||
+      !partition.getDependent(replaced, affected))
+    affected.assign(constraints.size(), true);
+
+  std::vector<ref<Expr> > rewritten(constraints.size());
+  bool changed = false;
+  for (unsigned i = 0, n = constraints.size(); i != n; ++i) {
+    if (!affected[i])
+      continue;
+    ref<Expr> e = visitor.visit(constraints[i]);
+    if (e != constraints[i]) {
+      rewritten[i] = e;
+      changed = true;
+    }
+  }
+  if (!changed)
+    return false;
+
+  ConstraintManager::constraints_ty old;
+  constraints.swap(old);
+  partition.clear();
+  equalities = equalities_ty();
+  equalitiesSize = 0;
+  ranges = ranges_ty();
+  rangesSize = 0;
+  for (unsigned i = 0, n = old.size(); i != n; ++i) {
+    if (!rewritten[i].isNull())
+      addConstraintInternal(rewritten[i]); // enable further reductions
+    else
+      pushConstraint(old[i]);
+  }
 
-  return changed;
+  return true;
 }
 
 void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
@@ -118,21 +297,10 @@ ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e,
   if (isa<ConstantExpr>(e))
     return e;
 
-  std::map<ref<Expr>, std::pair<ref<Expr>, ref<Expr> > > equalities;
-
-  for (ConstraintManager::constraints_ty::const_iterator 
-         it = constraints.begin(), ie = constraints.end(); it != ie; ++it) {
-    if (const EqExpr *ee = dyn_cast<EqExpr>(*it)) {
-      if (isa<ConstantExpr>(ee->left)) {
-        equalities[ee->right] = std::make_pair(ee->left, *it);
-      } else {
-        equalities[*it] =
-            std::make_pair(ConstantExpr::alloc(1, Expr::Bool), *it);
-      }
-    } else {
-      equalities[*it] = std::make_pair(ConstantExpr::alloc(1, Expr::Bool), *it);
-    }
-  }
+  for (size_t i = equalitiesSize, n = constraints.size(); i != n; ++i)
+    addEquality(constraints[i]);
+  if (equalities.empty())
+    return e;
 
   ExprReplaceVisitor2 visitor(equalities);
   ref<Expr> ret = visitor.visit(e);
@@ -141,6 +309,234 @@ ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e,
   return ret;
 }
 
+namespace {
+/// The comparison of a term with a constant
+enum Relation { LT, LE, GT, GE, EQ, NE };
+
+/// The maximum number of constraints a bound of a range is known from
+const unsigned MaxRangeCore = 8;
+
+uint64_t getMaxValue(Expr::Width width) {
+  return width >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << width) - 1;
+}
+
+/// Get the term, the unsigned relation and the constant of an expression
+/// comparing a term of at most 64 bits with a constant, or return false
+bool getRelation(ref<Expr> e, ref<Expr> &term, Relation &relation,
+                 uint64_t &constant) {
+  // An equality of a boolean with false is its negation
+  bool negated = false;
+  while (const EqExpr *ee = dyn_cast<EqExpr>(e)) {
+    const ConstantExpr *ce = dyn_cast<ConstantExpr>(ee->left);
+    if (!ce || ce->getWidth() != Expr::Bool || !ce->isFalse())
+      break;
+    e = ee->right;
+    negated = !negated;
+  }
+
+  Expr::Kind kind = e->getKind();
+  if (kind != Expr::Eq && kind != Expr::Ult && kind != Expr::Ule)
+    return false;
+  const BinaryExpr *be = cast<BinaryExpr>(e);
+  if (be->left->getWidth() > 64)
+    return false;
+
+  bool constantOnLeft;
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(be->left)) {
+    if (isa<ConstantExpr>(be->right))
+      return false;
+    term = be->right;
+    constant = ce->getZExtValue();
+    constantOnLeft = true;
+  } else if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(be->right)) {
+    term = be->left;
+    constant = ce->getZExtValue();
+    constantOnLeft = false;
+  } else {
+    return false;
+  }
+
+  switch (kind) {
+  case Expr::Eq:
+    relation = negated ? NE : EQ;
+    break;
+  case Expr::Ult:
+    if (constantOnLeft)
+      relation = negated ? LE : GT;
+    else
+      relation = negated ? GE : LT;
+    break;
+  default:
+    if (constantOnLeft)
+      relation = negated ? LT : GE;
+    else
+      relation = negated ? GT : LE;
+    break;
+  }
+  return true;
+}
+}
+
+ConstraintManager::Range ConstraintManager::getRange(ref<Expr> term) const {
+  Range range;
+  if (const ranges_ty::value_type *r = ranges.lookup(term)) {
+    range = r->second;
+  } else {
+    range.min = 0;
+    range.max = getMaxValue(term->getWidth());
+  }
+
+  // A zero extension is in the range of its operand
+  if (const ZExtExpr *ze = dyn_cast<ZExtExpr>(term)) {
+    Range kidRange = getRange(ze->src);
+    if (kidRange.min > range.min) {
+      range.min = kidRange.min;
+      range.minCore = kidRange.minCore;
+    }
+    if (kidRange.max < range.max) {
+      range.max = kidRange.max;
+      range.maxCore = kidRange.maxCore;
+    }
+  }
+  return range;
+}
+
+void ConstraintManager::narrowRange(ref<Expr> term, bool isMin,
+                                    uint64_t bound,
+                                    const std::vector<ref<Expr> > &core) const {
+  Range range;
+  if (const ranges_ty::value_type *r = ranges.lookup(term)) {
+    range = r->second;
+  } else {
+    range.min = 0;
+    range.max = getMaxValue(term->getWidth());
+  }
+
+  if (isMin) {
+    if (bound <= range.min)
+      return;
+    range.min = bound;
+    range.minCore = core;
+  } else {
+    if (bound >= range.max)
+      return;
+    range.max = bound;
+    range.maxCore = core;
+  }
+  ranges = ranges.replace(std::make_pair(term, range));
+}
+
+void ConstraintManager::addRange(ref<Expr> e) const {
+  ++rangesSize;
+
+  ref<Expr> term;
+  Relation relation;
+  uint64_t constant;
+  if (!getRelation(e, term, relation, constant))
+    return;
+
+  std::vector<ref<Expr> > core(1, e);
+  switch (relation) {
+  case EQ:
+    narrowRange(term, true, constant, core);
+    narrowRange(term, false, constant, core);
+    break;
+  case LT:
+    if (constant)
+      narrowRange(term, false, constant - 1, core);
+    break;
+  case LE:
+    narrowRange(term, false, constant, core);
+    break;
+  case GT:
+    if (constant != getMaxValue(term->getWidth()))
+      narrowRange(term, true, constant + 1, core);
+    break;
+  case GE:
+    narrowRange(term, true, constant, core);
+    break;
+  case NE: {
+    // A disequality only narrows a range at one of its bounds
+    Range range = getRange(term);
+    if (range.min == range.max)
+      break;
+    if (range.min == constant && range.minCore.size() < MaxRangeCore) {
+      core.insert(core.end(), range.minCore.begin(), range.minCore.end());
+      narrowRange(term, true, constant + 1, core);
+    } else if (range.max == constant &&
+               range.maxCore.size() < MaxRangeCore) {
+      core.insert(core.end(), range.maxCore.begin(), range.maxCore.end());
+      narrowRange(term, false, constant - 1, core);
+    }
+    break;
+  }
+  }
+}
+
+bool ConstraintManager::evaluateRange(ref<Expr> e, bool &value,
+                                      std::vector<ref<Expr> > &core) const {
+  for (size_t i = rangesSize, n = constraints.size(); i != n; ++i)
+    addRange(constraints[i]);
+
+  ref<Expr> term;
+  Relation relation;
+  uint64_t constant;
+  if (!getRelation(e, term, relation, constant))
+    return false;
+
+  Range range = getRange(term);
+  bool useMin = false, useMax = false;
+  switch (relation) {
+  case LT:
+  case GE:
+    if (range.max < constant) {
+      value = true;
+      useMax = true;
+    } else if (range.min >= constant) {
+      value = false;
+      useMin = true;
+    }
+    if (relation == GE)
+      value = !value;
+    break;
+  case LE:
+  case GT:
+    if (range.max <= constant) {
+      value = true;
+      useMax = true;
+    } else if (range.min > constant) {
+      value = false;
+      useMin = true;
+    }
+    if (relation == GT)
+      value = !value;
+    break;
+  case EQ:
+  case NE:
+    if (range.min == constant && range.max == constant) {
+      value = true;
+      useMin = useMax = true;
+    } else if (constant < range.min) {
+      value = false;
+      useMin = true;
+    } else if (constant > range.max) {
+      value = false;
+      useMax = true;
+    }
+    if (relation == NE)
+      value = !value;
+    break;
+  }
+  if (!useMin && !useMax)
+    return false;
+
+  if (useMin)
+    core.insert(core.end(), range.minCore.begin(), range.minCore.end());
+  if (useMax && !(useMin && range.maxCore == range.minCore))
+    core.insert(core.end(), range.maxCore.begin(), range.maxCore.end());
+  return true;
+}
+
 void ConstraintManager::addConstraintInternal(ref<Expr> e) {
   // rewrite any known equalities and split Ands into different conjuncts
 
@@ -160,23 +556,18 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
 
   case Expr::Eq: {
     if (RewriteEqualities) {
-      // XXX: should profile the effects of this and the overhead.
-      // traversing the constraints looking for equalities is hardly the
-      // slowest thing we do, but it is probably nicer to have a
-      // ConstraintSet ADT which efficiently remembers obvious patterns
-      // (byte-constant comparison).
       BinaryExpr *be = cast<BinaryExpr>(e);
       if (isa<ConstantExpr>(be->left)) {
 	ExprReplaceVisitor visitor(be->right, be->left);
-	rewriteConstraints(visitor);
+	rewriteConstraints(visitor, be->right);
       }
     }
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
     
   default:
-    constraints.push_back(e);
+    pushConstraint(e);
     break;
   }
 }
@@ -37,6 +37,12 @@ namespace {
 
 unsigned Expr::count = 0;
 
+uint64_t Expr::equalHashCompares = 0;
+
+uint64_t Expr::hashCollisions = 0;
+
+size_t Expr::allocatedBytes = 0;
+
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
 
@@ -83,36 +89,191 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   }
 }
 
-// returns 0 if b is structurally equal to *this
-int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
-  if (this == &b) return 0;
+const std::vector<const Array *> Expr::noReadArrays;
+
+const std::vector<const Array *> &Expr::getReadArrays() const {
+  if (readArrays)
+    return *readArrays;
+
+  // Walk the distinct subexpressions, stopping at those whose arrays are
+  // already known.
+  std::set<const Array *> arrays;
+  std::set<const Expr *> visited;
+  std::vector<const Expr *> worklist;
+  worklist.push_back(this);
+  visited.insert(this);
+  while (!worklist.empty()) {
+    const Expr *e = worklist.back();
+    worklist.pop_back();
+
+    if (e != this && e->readArrays) {
+      arrays.insert(e->readArrays->begin(), e->readArrays->end());
+      continue;
+    }
+
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      arrays.insert(re->updates.root);
+      for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+        if (visited.insert(un->index.get()).second)
+          worklist.push_back(un->index.get());
+        if (visited.insert(un->value.get()).second)
+          worklist.push_back(un->value.get());
+      }
+    }
+    for (unsigned i = 0, n = e->getNumKids(); i < n; ++i) {
+      const Expr *kid = e->getKid(i).get();
+      if (visited.insert(kid).second)
+        worklist.push_back(kid);
+    }
+  }
+
+  const std::vector<const Array *> *computed =
+      arrays.empty()
+          ? &noReadArrays
+          : new std::vector<const Array *>(arrays.begin(), arrays.end());
+#ifdef KLEE_THREADSAFE_REFS
+  // Another thread sharing the expression may have set the arrays meanwhile
+  if (!__sync_bool_compare_and_swap(&readArrays,
+                                    (const std::vector<const Array *> *)0,
+                                    computed) &&
+      computed != &noReadArrays)
+    delete computed;
+#else
+  readArrays = computed;
+#endif
+  return *readArrays;
+}
+
+bool Expr::readsArrayIn(const std::set<const Array *> &arrays) const {
+  const std::vector<const Array *> &reads = getReadArrays();
+  for (std::vector<const Array *>::const_iterator it = reads.begin(),
+                                                  ie = reads.end();
+       it != ie; ++it) {
+    if (arrays.count(*it))
+      return true;
+  }
+  return false;
+}
+
+bool Expr::readsArrayNotIn(const std::set<const Array *> &arrays) const {
+  const std::vector<const Array *> &reads = getReadArrays();
+  for (std::vector<const Array *>::const_iterator it = reads.begin(),
+                                                  ie = reads.end();
+       it != ie; ++it) {
+    if (!arrays.count(*it))
+      return true;
+  }
+  return false;
+}
+
+void klee::deleteExprRef(Expr *e) {
+  // Never destroyed, as expressions may be freed by static destructors. The
+  // threads sharing expressions each have their own queue.
+#ifdef KLEE_THREADSAFE_REFS
+  static __thread std::vector<Expr *> *pending = 0;
+  static __thread bool draining = false;
+  if (!pending)
+    pending = new std::vector<Expr *>();
+#else
+  static std::vector<Expr *> *pending = new std::vector<Expr *>();
+  static bool draining = false;
+#endif
+
+  pending->push_back(e);
+  if (draining)
+    return;
+
+  draining = true;
+  while (!pending->empty()) {
+    Expr *next = pending->back();
+    pending->pop_back();
+    delete next;
+  }
+  draining = false;
+}
+
+/// Compare the nodes of two expressions, without their kids. Returns the
+/// result of the comparison, and sets descend if the kids decide it.
+static int compareNode(const Expr *a, const Expr *b,
+                       Expr::ExprEquivSet &equivs, bool &descend) {
+  descend = false;
+  if (a == b) return 0;
 
   const Expr *ap, *bp;
-  if (this < &b) {
-    ap = this; bp = &b;
+  if (a < b) {
+    ap = a; bp = b;
   } else {
-    ap = &b; bp = this;
+    ap = b; bp = a;
   }
 
   if (equivs.count(std::make_pair(ap, bp)))
     return 0;
 
-  Kind ak = getKind(), bk = b.getKind();
+  Expr::Kind ak = a->getKind(), bk = b->getKind();
   if (ak!=bk)
     return (ak < bk) ? -1 : 1;
 
-  if (hashValue != b.hashValue) 
-    return (hashValue < b.hashValue) ? -1 : 1;
+  if (a->hash() != b->hash())
+    return (a->hash() < b->hash()) ? -1 : 1;
 
-  if (int res = compareContents(b)) 
+  if (int res = a->compareContents(*b))
     return res;
 
-  unsigned aN = getNumKids();
-  for (unsigned i=0; i<aN; i++)
-    if (int res = getKid(i)->compare(*b.getKid(i), equivs))
-      return res;
+  if (a->getNumKids() == 0)
+    equivs.insert(std::make_pair(ap, bp));
+  else
+    descend = true;
+  return 0;
+}
+
+// returns 0 if b is structurally equal to *this
+int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
+  // The kids are compared in order from an explicit stack, so that comparing
+  // deep expressions does not recurse.
+  struct Frame {
+    const Expr *a, *b;
+    unsigned kid;
+  };
+
+  bool equalHashes = this != &b && hashValue == b.hashValue;
+  if (equalHashes)
+    incrementSharedCount(equalHashCompares);
+
+  bool descend;
+  if (int res = compareNode(this, &b, equivs, descend)) {
+    if (equalHashes)
+      incrementSharedCount(hashCollisions);
+    return res;
+  }
+  if (!descend)
+    return 0;
 
-  equivs.insert(std::make_pair(ap, bp));
+  SmallVector<Frame, 16> stack;
+  Frame root = { this, &b, 0 };
+  stack.push_back(root);
+  while (!stack.empty()) {
+    Frame &f = stack.back();
+    if (f.kid == f.a->getNumKids()) {
+      if (f.a < f.b)
+        equivs.insert(std::make_pair(f.a, f.b));
+      else
+        equivs.insert(std::make_pair(f.b, f.a));
+      stack.pop_back();
+      continue;
+    }
+
+    const Expr *ak = f.a->getKid(f.kid).get(), *bk = f.b->getKid(f.kid).get();
+    ++f.kid;
+    // The hashes of the roots are equal, and their kids differ
+    if (int res = compareNode(ak, bk, equivs, descend)) {
+      incrementSharedCount(hashCollisions);
+      return res;
+    }
+    if (descend) {
+      Frame kid = { ak, bk, 0 };
+      stack.push_back(kid);
+    }
+  }
   return 0;
 }
 
@@ -167,82 +328,114 @@ void Expr::printKind(llvm::raw_ostream &os, Kind k) {
 //
 ///////
 
-unsigned Expr::computeHash() {
-  unsigned res = getKind() * Expr::MAGIC_HASH_CONSTANT;
-
-  int n = getNumKids();
-  for (int i = 0; i < n; i++) {
-    res <<= 1;
-    res ^= getKid(i)->hash() * Expr::MAGIC_HASH_CONSTANT;
-  }
-  
+uint64_t Expr::computeHash() {
+  uint64_t res = getKind();
+  for (unsigned i = 0, n = getNumKids(); i != n; ++i)
+    res = combineHash(res, getKid(i)->hash());
   hashValue = res;
   return hashValue;
 }
 
-unsigned ConstantExpr::computeHash() {
+namespace {
+/// The number of constants of the table of ConstantExpr::allocSmall, a power
+/// of two
+const unsigned SmallConstantTableBits = 12;
+}
+
+ref<ConstantExpr> ConstantExpr::allocSmall(uint64_t v, Width w) {
+  ref<ConstantExpr> r;
+#ifdef KLEE_THREADSAFE_REFS
+  // The table is not shared with the threads building expressions
+  r = new ConstantExpr(llvm::APInt(w, v));
+  r->computeHash();
+  return r;
+#else
+  // The table is never freed, so that its constants are not destroyed
+  // before the static expressions which may share them
+  static ref<ConstantExpr> *table =
+      new ref<ConstantExpr>[1U << SmallConstantTableBits];
+
+  uint64_t h = (v ^ ((uint64_t)w << 57)) * UINT64_C(0x9E3779B97F4A7C15);
+  ref<ConstantExpr> &entry = table[h >> (64 - SmallConstantTableBits)];
+  if (!entry.isNull() && entry->getWidth() == w &&
+      entry->value.getZExtValue() == v)
+    return entry;
+
+  r = new ConstantExpr(llvm::APInt(w, v));
+  r->computeHash();
+  entry = r;
+  return r;
+#endif
+}
+
+namespace {
+uint64_t hashString(const std::string &s) {
+  uint64_t res = 0;
+  for (unsigned i = 0, e = s.size(); i != e; ++i)
+    res = Expr::combineHash(res, (unsigned char)s[i]);
+  return res;
+}
+}
+
+uint64_t ConstantExpr::computeHash() {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
-  hashValue = hash_value(value) ^ (getWidth() * MAGIC_HASH_CONSTANT);
+  hashValue = combineHash(hash_value(value), getWidth());
 #else
-  hashValue = value.getHashValue() ^ (getWidth() * MAGIC_HASH_CONSTANT);
+  hashValue = combineHash(value.getHashValue(), getWidth());
 #endif
   return hashValue;
 }
 
-unsigned ExistsExpr::computeHash() {
-  unsigned res = body->hash() * Expr::MAGIC_HASH_CONSTANT;
+uint64_t ExistsExpr::computeHash() {
+  // The variables are ordered by address, so that they are combined in an
+  // order independent way
+  uint64_t variablesHash = 0;
   for (std::set<const Array *>::iterator it = variables.begin(),
                                          itEnd = variables.end();
-       it != itEnd; ++it) {
-    res <<= 1;
-    res ^= (*it)->hash() * Expr::MAGIC_HASH_CONSTANT;
-  }
-  return res;
+       it != itEnd; ++it)
+    variablesHash ^= (*it)->hash();
+  hashValue = combineHash(combineHash(Exists, body->hash()), variablesHash);
+  return hashValue;
 }
 
-unsigned CastExpr::computeHash() {
-  unsigned res = getWidth() * Expr::MAGIC_HASH_CONSTANT;
-  hashValue = res ^ src->hash() * Expr::MAGIC_HASH_CONSTANT;
+uint64_t CastExpr::computeHash() {
+  uint64_t res = combineHash(getKind(), getWidth());
+  hashValue = combineHash(res, src->hash());
   return hashValue;
 }
 
-unsigned ExtractExpr::computeHash() {
-  unsigned res = offset * Expr::MAGIC_HASH_CONSTANT;
-  res ^= getWidth() * Expr::MAGIC_HASH_CONSTANT;
-  hashValue = res ^ expr->hash() * Expr::MAGIC_HASH_CONSTANT;
+uint64_t ExtractExpr::computeHash() {
+  uint64_t res = combineHash(combineHash(Extract, offset), getWidth());
+  hashValue = combineHash(res, expr->hash());
   return hashValue;
 }
 
-unsigned ReadExpr::computeHash() {
-  unsigned res = index->hash() * Expr::MAGIC_HASH_CONSTANT;
-  res ^= updates.hash();
-  hashValue = res;
+uint64_t ReadExpr::computeHash() {
+  uint64_t res = combineHash(Read, index->hash());
+  hashValue = combineHash(res, updates.hash());
   return hashValue;
 }
 
-unsigned WPVarExpr::computeHash() {
-  unsigned hash = 0;
-  for (unsigned i = 0; i < name.size(); i++) {
-    hash = (hash * Expr::MAGIC_HASH_CONSTANT) + name[i];
-  }
-  unsigned res = index->hash() * Expr::MAGIC_HASH_CONSTANT * hash;
-  hashValue = res;
+uint64_t WPVarExpr::computeHash() {
+  uint64_t res = combineHash(WPVar, hashString(name));
+  hashValue = combineHash(res, index->hash());
   return hashValue;
 }
 
-unsigned SelExpr::computeHash() {
-  hashValue = array->hash() * index->hash() * Expr::MAGIC_HASH_CONSTANT;
+uint64_t SelExpr::computeHash() {
+  uint64_t res = combineHash(Sel, array->hash());
+  hashValue = combineHash(res, index->hash());
   return hashValue;
 }
 
-unsigned UpdExpr::computeHash() {
-  hashValue =
-      array->hash() * index->hash() * value->hash() * Expr::MAGIC_HASH_CONSTANT;
+uint64_t UpdExpr::computeHash() {
+  uint64_t res = combineHash(combineHash(Upd, array->hash()), index->hash());
+  hashValue = combineHash(res, value->hash());
   return hashValue;
 }
 
-unsigned NotExpr::computeHash() {
-  hashValue = expr->hash() * Expr::MAGIC_HASH_CONSTANT * Expr::Not;
+uint64_t NotExpr::computeHash() {
+  hashValue = combineHash(Not, expr->hash());
   return hashValue;
 }
 
@@ -528,7 +721,7 @@ Array::Array(const std::string &_name, uint64_t _size,
              const ref<ConstantExpr> *constantValuesEnd, Expr::Width _domain,
              Expr::Width _range)
     : name(_name), size(_size), domain(_domain), range(_range),
-      constantValues(constantValuesBegin, constantValuesEnd) {
+      constantValues(constantValuesBegin, constantValuesEnd), shadow(0) {
 
   assert((isSymbolicArray() || constantValues.size() == size) &&
          "Invalid size for constant array!");
@@ -544,13 +737,9 @@ Array::Array(const std::string &_name, uint64_t _size,
 Array::~Array() {
 }
 
-unsigned Array::computeHash() {
-  unsigned res = 0;
-  for (unsigned i = 0, e = name.size(); i != e; ++i)
-    res = (res * Expr::MAGIC_HASH_CONSTANT) + name[i];
-  res = (res * Expr::MAGIC_HASH_CONSTANT) + size;
-  hashValue = res;
-  return hashValue; 
+uint64_t Array::computeHash() {
+  hashValue = Expr::combineHash(hashString(name), size);
+  return hashValue;
 }
 /***/
 
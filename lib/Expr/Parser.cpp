@@ -24,6 +24,7 @@
 
 #include <cassert>
 #include <map>
+#include <set>
 #include <cstring>
 
 using namespace llvm;
@@ -110,7 +111,10 @@ namespace {
     const std::string Filename;
     const MemoryBuffer *TheMemoryBuffer;
     ExprBuilder *Builder;
-    ArrayCache TheArrayCache;
+    ArrayCache OwnArrayCache;
+    /// TheArrayCache - The cache owning the arrays, which is OwnArrayCache
+    /// unless the client gives one outliving the parser.
+    ArrayCache &TheArrayCache;
     bool ClearArrayAfterQuery;
 
     Lexer TheLexer;
@@ -303,6 +307,7 @@ namespace {
     ExprResult ParseSelectParenExpr(const Token &Name, Expr::Width ResTy);
     ExprResult ParseConcatParenExpr(const Token &Name, Expr::Width ResTy);
     ExprResult ParseExtractParenExpr(const Token &Name, Expr::Width ResTy);
+    ExprResult ParseExistsParenExpr(const Token &Name, Expr::Width ResTy);
     ExprResult ParseAnyReadParenExpr(const Token &Name,
                                      unsigned Kind,
                                      Expr::Width ResTy);
@@ -324,8 +329,10 @@ namespace {
 
   public:
     ParserImpl(const std::string _Filename, const MemoryBuffer *MB,
-               ExprBuilder *_Builder, bool _ClearArrayAfterQuery)
+               ExprBuilder *_Builder, bool _ClearArrayAfterQuery,
+               ArrayCache *_ArrayCache)
         : Filename(_Filename), TheMemoryBuffer(MB), Builder(_Builder),
+          TheArrayCache(_ArrayCache ? *_ArrayCache : OwnArrayCache),
           ClearArrayAfterQuery(_ClearArrayAfterQuery), TheLexer(MB),
           MaxErrors(~0u), NumErrors(0) {}
 
@@ -883,6 +890,8 @@ static bool LookupExprInfo(const Token &Tok, unsigned &Kind,
       return SetOK(eMacroKind_Concat, false, -1); 
     if (memcmp(Tok.start, "Select", 6) == 0)
       return SetOK(Expr::Select, false, 3);
+    if (memcmp(Tok.start, "Exists", 6) == 0)
+      return SetOK(Expr::Exists, false, -1);
     break;
     
   case 7:
@@ -980,6 +989,9 @@ ExprResult ParserImpl::ParseParenExpr(TypeResult FIXME_UNUSED) {
     case Expr::Extract:
       return ParseExtractParenExpr(Name, ResTy);
 
+    case Expr::Exists:
+      return ParseExistsParenExpr(Name, ResTy);
+
     case eMacroKind_ReadLSB:
     case eMacroKind_ReadMSB:
     case Expr::Read:
@@ -1221,6 +1233,63 @@ ExprResult ParserImpl::ParseExtractParenExpr(const Token &Name,
   return Builder->Extract(Child.get(), Offset, ResTy);
 }
 
+/// paren-expr = '(' 'Exists' '(' variable* ')' expr ')'
+/// variable = '(' type 'x' number identifier ')'
+///
+/// The variables are the arrays of the given range and size, which are the
+/// declared arrays of the same name if any.
+ExprResult ParserImpl::ParseExistsParenExpr(const Token &Name,
+                                            Expr::Width ResTy) {
+  if (Tok.kind != Token::LParen) {
+    Error("expected variable list.", Name);
+    SkipUntilRParen();
+    return Builder->Constant(0, ResTy);
+  }
+  ConsumeLParen();
+
+  std::set<const Array *> Variables;
+  while (Tok.kind == Token::LParen) {
+    ConsumeLParen();
+    TypeResult Range = ParseTypeSpecifier();
+    if (Tok.kind != Token::Identifier || Tok.length != 1 || *Tok.start != 'x') {
+      Error("expected 'x' in variable.");
+      SkipUntilRParen();
+      continue;
+    }
+    ConsumeToken();
+    IntegerResult Size = ParseIntegerConstant(64);
+    if (Tok.kind != Token::Identifier) {
+      Error("expected variable name.");
+      SkipUntilRParen();
+      continue;
+    }
+    const Identifier *Label = GetOrCreateIdentifier(Tok);
+    ConsumeToken();
+    ExpectRParen("unexpected argument in variable.");
+    if (!Range.isValid() || !Size.isValid())
+      continue;
+
+    std::map<const Identifier*, const ArrayDecl*>::iterator
+      it = ArraySymTab.find(Label);
+    if (it != ArraySymTab.end())
+      Variables.insert(it->second->Root);
+    else
+      Variables.insert(TheArrayCache.CreateArray(Label->Name, Size.get(),
+                                                 0, 0, Expr::Int32,
+                                                 Range.get()));
+  }
+  ExpectRParen("unexpected argument in variable list.");
+
+  ExprResult Body = ParseExpr(TypeResult(Expr::Bool));
+  ExpectRParen("unexpected argument to expression.");
+
+  if (!Body.isValid())
+    return Builder->Constant(0, ResTy);
+
+  // FIXME: Use builder!
+  return ExistsExpr::create(Variables, Body.get());
+}
+
 ExprResult ParserImpl::ParseAnyReadParenExpr(const Token &Name,
                                              unsigned Kind,
                                              Expr::Width ResTy) {
@@ -1646,8 +1715,10 @@ Parser::~Parser() {
 }
 
 Parser *Parser::Create(const std::string Filename, const MemoryBuffer *MB,
-                       ExprBuilder *Builder, bool ClearArrayAfterQuery) {
-  ParserImpl *P = new ParserImpl(Filename, MB, Builder, ClearArrayAfterQuery);
+                       ExprBuilder *Builder, bool ClearArrayAfterQuery,
+                       ArrayCache *TheArrayCache) {
+  ParserImpl *P = new ParserImpl(Filename, MB, Builder, ClearArrayAfterQuery,
+                                 TheArrayCache);
   P->Initialize();
   return P;
 }
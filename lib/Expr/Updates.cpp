@@ -30,7 +30,7 @@ UpdateNode::UpdateNode(const UpdateNode *_next,
   */
   computeHash();
   if (next) {
-    ++next->refCount;
+    incrementSharedCount(next->refCount);
     size = 1 + next->size;
   }
   else size = 1;
@@ -52,10 +52,9 @@ int UpdateNode::compare(const UpdateNode &b) const {
   return value.compare(b.value);
 }
 
-unsigned UpdateNode::computeHash() {
-  hashValue = index->hash() ^ value->hash();
-  if (next)
-    hashValue ^= next->hash();
+uint64_t UpdateNode::computeHash() {
+  hashValue = Expr::combineHash(next ? next->hash() : 0, index->hash());
+  hashValue = Expr::combineHash(hashValue, value->hash());
   return hashValue;
 }
 
@@ -64,13 +63,13 @@ unsigned UpdateNode::computeHash() {
 UpdateList::UpdateList(const Array *_root, const UpdateNode *_head)
   : root(_root),
     head(_head) {
-  if (head) ++head->refCount;
+  if (head) incrementSharedCount(head->refCount);
 }
 
 UpdateList::UpdateList(const UpdateList &b)
   : root(b.root),
     head(b.head) {
-  if (head) ++head->refCount;
+  if (head) incrementSharedCount(head->refCount);
 }
 
 UpdateList::~UpdateList() {
@@ -127,7 +126,7 @@ void UpdateList::tryFreeNodes() {
   //  nullptr
   //  ^Head0
   //
-  while (head && --head->refCount==0) {
+  while (head && decrementSharedCount(head->refCount) == 0) {
     const UpdateNode *n = head->next;
     delete head;
     head = n;
@@ -135,7 +134,7 @@ void UpdateList::tryFreeNodes() {
 }
 
 UpdateList &UpdateList::operator=(const UpdateList &b) {
-  if (b.head) ++b.head->refCount;
+  if (b.head) incrementSharedCount(b.head->refCount);
   // Drop reference to the current head and free a chain of nodes
   // if we are the only UpdateList referencing them
   tryFreeNodes();
@@ -151,9 +150,9 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
     assert(root->getRange() == value->getWidth());
   }
 
-  if (head) --head->refCount;
+  if (head) decrementSharedCount(head->refCount);
   head = new UpdateNode(head, index, value);
-  ++head->refCount;
+  incrementSharedCount(head->refCount);
 }
 
 int UpdateList::compare(const UpdateList &b) const {
@@ -182,11 +181,6 @@ int UpdateList::compare(const UpdateList &b) const {
   return 0;
 }
 
-unsigned UpdateList::hash() const {
-  unsigned res = 0;
-  for (unsigned i = 0, e = root->name.size(); i != e; ++i)
-    res = (res * Expr::MAGIC_HASH_CONSTANT) + root->name[i];
-  if (head)
-    res ^= head->hash();
-  return res;
+uint64_t UpdateList::hash() const {
+  return Expr::combineHash(root->hash(), head ? head->hash() : 0);
 }
@@ -46,45 +46,61 @@
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <algorithm>
 #include <map>
 #include <string>
 
 using namespace llvm;
 using namespace klee;
 
+namespace {
+/// Discards the text written to it, counting its lines.
+class LineCountingStream : public llvm::raw_ostream {
+  unsigned newlines;
+  uint64_t pos;
+
+  void write_impl(const char *ptr, size_t size) {
+    newlines += std::count(ptr, ptr + size, '\n');
+    pos += size;
+  }
+
+  uint64_t current_pos() const { return pos; }
+
+public:
+  LineCountingStream() : raw_ostream(/* unbuffered= */ true), newlines(0),
+                         pos(0) {}
+
+  /// The number of the line being written, from 1
+  unsigned getLine() const { return newlines + 1; }
+};
+
+/// Record the line of each instruction as the module is printed.
 class InstructionToLineAnnotator : public llvm::AssemblyAnnotationWriter {
+  const LineCountingStream &counter;
+  std::map<const Instruction*, unsigned> &out;
+
 public:
+  InstructionToLineAnnotator(const LineCountingStream &_counter,
+                             std::map<const Instruction*, unsigned> &_out)
+    : counter(_counter), out(_out) {}
+
   void emitInstructionAnnot(const Instruction *i,
                             llvm::formatted_raw_ostream &os) {
-    os << "%%%";
-    os << (uintptr_t) i;
+    // Push what the printer buffered so far to the counter.
+    os.flush();
+    out.insert(std::make_pair(i, counter.getLine()));
   }
 };
-        
+}
+
+// Print the module to a stream that only counts lines, rather than to a
+// string scanned afterwards, so that large modules are not held in memory
+// as text.
 static void buildInstructionToLineMap(Module *m,
                                       std::map<const Instruction*, unsigned> &out) {  
-  InstructionToLineAnnotator a;
-  std::string str;
-  llvm::raw_string_ostream os(str);
+  LineCountingStream os;
+  InstructionToLineAnnotator a(os, out);
   m->print(os, &a);
-  os.flush();
-  const char *s;
-
-  unsigned line = 1;
-  for (s=str.c_str(); *s; s++) {
-    if (*s=='\n') {
-      line++;
-      if (s[1]=='%' && s[2]=='%' && s[3]=='%') {
-        s += 4;
-        char *end;
-        unsigned long long value = strtoull(s, &end, 10);
-        if (end!=s) {
-          out.insert(std::make_pair((const Instruction*) value, line));
-        }
-        s = end;
-      }
-    }
-  }
 }
 
 static std::string getDSPIPath(DILocation Loc) {
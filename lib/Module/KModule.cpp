@@ -54,8 +54,21 @@
 #include "llvm/Support/Path.h"
 #include "llvm/Transforms/Scalar.h"
 
+#include "llvm/Support/MemoryBuffer.h"
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/system_error.h"
+#endif
+
 #include <llvm/Transforms/Utils/Cloning.h>
 
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+
 #include <sstream>
 
 using namespace llvm;
@@ -99,6 +112,50 @@ namespace {
   cl::opt<bool>
   DebugPrintEscapingFunctions("debug-print-escaping-functions", 
                               cl::desc("Print functions whose address is taken."));
+
+  cl::opt<std::string>
+  PreparedModuleCache("prepared-module-cache",
+                      cl::desc("Directory in which to cache the prepared "
+                               "module, keyed by the contents of the input "
+                               "module and the preparation options, to skip "
+                               "the linking and the passes in later runs "
+                               "(default=off)"),
+                      cl::init(""));
+
+  cl::opt<bool>
+  PruneUnreachableFunctions("prune-unreachable-functions",
+                            cl::desc("Drop the bodies of the functions that "
+                                     "the entry point does not reach through "
+                                     "calls or address references, before "
+                                     "building the interpreter structures "
+                                     "(default=off)"),
+                            cl::init(false));
+
+  cl::opt<unsigned>
+  PrepareThreads("prepare-threads",
+                 cl::desc("Number of threads building the interpreter "
+                          "structures of the functions, 0 for one per "
+                          "online processor (default=1)"),
+                 cl::init(1));
+
+  /// The operand number of a constant operand before the function is
+  /// resolved
+  const int UnresolvedConstant = INT_MIN;
+
+  /// The functions built by a thread, every stride-th from first
+  struct FunctionBuilder {
+    const std::vector<Function *> *functions;
+    std::vector<KFunction *> *built;
+    unsigned first, stride;
+    pthread_t thread;
+
+    static void *run(void *self) {
+      FunctionBuilder &b = *static_cast<FunctionBuilder *>(self);
+      for (unsigned i = b.first; i < b.functions->size(); i += b.stride)
+        (*b.built)[i] = new KFunction((*b.functions)[i]);
+      return 0;
+    }
+  };
 }
 
 KModule::KModule(Module *_module) 
@@ -110,7 +167,9 @@ KModule::KModule(Module *_module)
 #endif
     kleeMergeFn(0),
     infos(0),
-    constantTable(0) {
+    constantTable(0),
+    numBasicBlocks(0),
+    originalModule(0) {
 }
 
 KModule::~KModule() {
@@ -127,12 +186,185 @@ KModule::~KModule() {
 
   delete targetData;
   delete module;
+  delete originalModule;
 }
 
 /***/
 
 namespace llvm {
 extern void Optimize(Module *, const std::string &EntryPoint);
+extern std::string getOptimizeOptions();
+}
+
+/// Hash a byte string with 64-bit FNV-1a.
+static uint64_t hashBytes(const char *data, size_t size, uint64_t hash) {
+  for (size_t i = 0; i != size; ++i) {
+    hash ^= (unsigned char) data[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+static uint64_t hashString(const std::string &s, uint64_t hash) {
+  // Include the terminator so that consecutive strings cannot run together.
+  return hashBytes(s.c_str(), s.size() + 1, hash);
+}
+
+/// Return the path of the cached preparation of the module, a name made of
+/// the hash of its bitcode, of the runtime library linked in by prepare,
+/// and of every option that changes what prepare does to it.
+static std::string
+getPreparedModuleCachePath(Module *module,
+                           const Interpreter::ModuleOptions &opts) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  std::string bitcode;
+  {
+    llvm::raw_string_ostream os(bitcode);
+    WriteBitcodeToFile(module, os);
+  }
+  hash = hashString(bitcode, hash);
+  bitcode.clear();
+
+  std::string options;
+  {
+    llvm::raw_string_ostream os(options);
+    os << opts.LibraryDir << '\n' << opts.EntryPoint << '\n' << opts.Optimize
+       << opts.CheckDivZero << opts.CheckOvershift << '\n' << SwitchType
+       << PruneUnreachableFunctions << '\n';
+    for (cl::list<std::string>::iterator it = MergeAtExit.begin(),
+                                         ie = MergeAtExit.end();
+         it != ie; ++it)
+      os << *it << '\n';
+    os << llvm::getOptimizeOptions();
+  }
+  hash = hashString(options, hash);
+
+  // The runtime library is looked up in the library directory on each run,
+  // so its contents are part of the key.
+  SmallString<128> LibPath(opts.LibraryDir);
+  llvm::sys::path::append(LibPath,
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3,3)
+      "kleeRuntimeIntrinsic.bc"
+#else
+      "libkleeRuntimeIntrinsic.bca"
+#endif
+    );
+  std::ifstream library(LibPath.c_str(), std::ios::binary);
+  std::string contents((std::istreambuf_iterator<char>(library)),
+                       std::istreambuf_iterator<char>());
+  hash = hashString(contents, hash);
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bc", (unsigned long long) hash);
+  SmallString<128> path(PreparedModuleCache);
+  llvm::sys::path::append(path, name);
+  return path.str();
+}
+
+/// Load the cached prepared module, or return null if there is none.
+static Module *loadPreparedModule(const std::string &path) {
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> buffer;
+  if (MemoryBuffer::getFile(path, buffer))
+    return 0;
+  std::string error;
+  Module *m = ParseBitcodeFile(buffer.get(), getGlobalContext(), &error);
+  if (!m)
+    klee_warning("ignoring the prepared module cached in %s: %s",
+                 path.c_str(), error.c_str());
+  return m;
+#else
+  ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return 0;
+  ErrorOr<Module *> m = parseBitcodeFile(buffer->get(), getGlobalContext());
+  if (!m) {
+    klee_warning("ignoring the prepared module cached in %s: %s",
+                 path.c_str(), m.getError().message().c_str());
+    return 0;
+  }
+  return *m;
+#endif
+}
+
+/// Write the prepared module to the cache. It is written to a temporary
+/// file first, so that concurrent runs only ever see complete modules.
+static void savePreparedModule(Module *module, const std::string &path) {
+  std::string tmpPath = path + ".tmp";
+  std::string error;
+  {
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3,5)
+    llvm::raw_fd_ostream os(tmpPath.c_str(), error, llvm::sys::fs::F_None);
+#elif LLVM_VERSION_CODE >= LLVM_VERSION(3,4)
+    llvm::raw_fd_ostream os(tmpPath.c_str(), error, llvm::sys::fs::F_Binary);
+#else
+    llvm::raw_fd_ostream os(tmpPath.c_str(), error,
+                            llvm::raw_fd_ostream::F_Binary);
+#endif
+    if (error.empty())
+      WriteBitcodeToFile(module, os);
+  }
+  if (!error.empty() || ::rename(tmpPath.c_str(), path.c_str()) != 0) {
+    klee_warning("unable to cache the prepared module in %s%s%s",
+                 path.c_str(), error.empty() ? "" : ": ", error.c_str());
+    ::unlink(tmpPath.c_str());
+  }
+}
+
+/// Turn the functions that cannot be executed from the entry point into
+/// declarations. A function can be executed if it is referenced, as a
+/// callee or as an address, by a function that can be executed or by the
+/// initializer of a global it references. The functions are only emptied
+/// and not erased, so the remaining references stay valid.
+static unsigned pruneUnreachableFunctions(Module *m, Function *entry) {
+  std::set<Value *> reached;
+  std::vector<Value *> worklist;
+  reached.insert(entry);
+  worklist.push_back(entry);
+
+  while (!worklist.empty()) {
+    Value *v = worklist.back();
+    worklist.pop_back();
+
+    std::vector<Value *> references;
+    if (Function *f = dyn_cast<Function>(v)) {
+      for (Function::iterator bbIt = f->begin(), bbIe = f->end();
+           bbIt != bbIe; ++bbIt)
+        for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+             it != ie; ++it)
+          for (User::op_iterator op = it->op_begin(), opIe = it->op_end();
+               op != opIe; ++op)
+            references.push_back(*op);
+    } else if (GlobalVariable *gv = dyn_cast<GlobalVariable>(v)) {
+      if (gv->hasInitializer())
+        references.push_back(gv->getInitializer());
+    } else if (GlobalAlias *ga = dyn_cast<GlobalAlias>(v)) {
+      references.push_back(ga->getAliasee());
+    } else if (Constant *c = dyn_cast<Constant>(v)) {
+      for (User::op_iterator op = c->op_begin(), opIe = c->op_end();
+           op != opIe; ++op)
+        references.push_back(*op);
+    }
+
+    for (std::vector<Value *>::iterator it = references.begin(),
+                                        ie = references.end();
+         it != ie; ++it) {
+      // Only constants (which include the functions and the globals) can
+      // refer outside of the function.
+      if (isa<Constant>(*it) && reached.insert(*it).second)
+        worklist.push_back(*it);
+    }
+  }
+
+  unsigned pruned = 0;
+  for (Module::iterator it = m->begin(), ie = m->end(); it != ie; ++it) {
+    if (!it->isDeclaration() && !reached.count(&*it)) {
+      it->deleteBody();
+      ++pruned;
+    }
+  }
+  return pruned;
 }
 
 // what a hack
@@ -239,8 +471,7 @@ void KModule::addInternalFunction(const char* functionName){
   internalFunctions.insert(internalFunction);
 }
 
-void KModule::prepare(const Interpreter::ModuleOptions &opts,
-                      InterpreterHandler *ih) {
+void KModule::transform(const Interpreter::ModuleOptions &opts) {
   if (!MergeAtExit.empty()) {
     Function *mergeFn = module->getFunction("klee_merge");
     if (!mergeFn) {
@@ -347,14 +578,6 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
     );
   module = linkWithLibrary(module, LibPath.str());
 
-  // Add internal functions which are not used to check if instructions
-  // have been already visited
-  if (opts.CheckDivZero)
-    addInternalFunction("klee_div_zero_check");
-  if (opts.CheckOvershift)
-    addInternalFunction("klee_overshift_check");
-
-
   // Needs to happen after linking (since ctors/dtors can be modified)
   // and optimization (since global optimization can rewrite lists).
   injectStaticConstructorsAndDestructors(module);
@@ -387,6 +610,46 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
   if (f && f->use_empty()) f->eraseFromParent();
 #endif
 
+  if (PruneUnreachableFunctions) {
+    if (Function *entry = module->getFunction(opts.EntryPoint)) {
+      unsigned pruned = pruneUnreachableFunctions(module, entry);
+      klee_message("pruned %u functions unreachable from %s", pruned,
+                   opts.EntryPoint.c_str());
+    }
+  }
+}
+
+void KModule::prepare(const Interpreter::ModuleOptions &opts,
+                      InterpreterHandler *ih) {
+  std::string cachePath;
+  Module *cached = 0;
+  if (!PreparedModuleCache.empty()) {
+    cachePath = getPreparedModuleCachePath(module, opts);
+    cached = loadPreparedModule(cachePath);
+  }
+
+  if (cached) {
+    klee_message("using the prepared module cached in %s", cachePath.c_str());
+    // The caller may still hold pointers to the functions of the given
+    // module, so only their bodies are released until destruction.
+    for (Module::iterator it = module->begin(), ie = module->end(); it != ie;
+         ++it)
+      it->deleteBody();
+    originalModule = module;
+    module = cached;
+  } else {
+    transform(opts);
+    if (!cachePath.empty())
+      savePreparedModule(module, cachePath);
+  }
+
+  // Add internal functions which are not used to check if instructions
+  // have been already visited
+  if (opts.CheckDivZero)
+    addInternalFunction("klee_div_zero_check");
+  if (opts.CheckOvershift)
+    addInternalFunction("klee_overshift_check");
+
   // Write out the .ll assembly file. We truncate long lines to work
   // around a kcachegrind parsing bug (it puts them on new lines), so
   // that source browsing works.
@@ -435,22 +698,64 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
 
   /* Build shadow structures */
 
-  infos = new InstructionInfoTable(module);  
-  
+  // The functions are built by worker threads while this thread builds the
+  // instruction info table, and then resolved in the order of the module,
+  // so that the numbering of the basic blocks and of the constants does not
+  // depend on the threads. The arguments of the functions are created
+  // lazily, and are created here before the threads read the functions.
+  std::vector<Function *> bodies;
   for (Module::iterator it = module->begin(), ie = module->end();
        it != ie; ++it) {
     if (it->isDeclaration())
       continue;
+    it->arg_size();
+    bodies.push_back(it);
+  }
+
+  unsigned numThreads = PrepareThreads;
+  if (!numThreads) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    numThreads = online > 0 ? online : 1;
+  }
+  if (numThreads > bodies.size())
+    numThreads = bodies.size();
+
+  std::vector<KFunction *> built(bodies.size(), 0);
+  std::vector<FunctionBuilder> builders(numThreads);
+  for (unsigned t = 0; t < numThreads; ++t) {
+    builders[t].functions = &bodies;
+    builders[t].built = &built;
+    builders[t].first = t;
+    builders[t].stride = numThreads;
+  }
+  unsigned started = 0;
+  if (numThreads > 1)
+    while (started < numThreads &&
+           pthread_create(&builders[started].thread, 0, FunctionBuilder::run,
+                          &builders[started]) == 0)
+      ++started;
+
+  infos = new InstructionInfoTable(module);
+
+  for (unsigned t = 0; t < started; ++t)
+    pthread_join(builders[t].thread, 0);
+  // Build the functions of the threads that could not be started
+  for (unsigned t = started; t < numThreads; ++t)
+    FunctionBuilder::run(&builders[t]);
+
+  for (std::vector<KFunction *>::iterator it = built.begin(),
+                                          ie = built.end();
+       it != ie; ++it) {
+    KFunction *kf = *it;
+    kf->resolve(this);
 
-    KFunction *kf = new KFunction(it, this);
-    
     for (unsigned i=0; i<kf->numInstructions; ++i) {
       KInstruction *ki = kf->instructions[i];
       ki->info = &infos->getInfo(ki->inst);
     }
 
     functions.push_back(kf);
-    functionMap.insert(std::make_pair(it, kf));
+    functionMap.insert(std::make_pair(kf->function, kf));
   }
 
   /* Compute various interesting properties */
@@ -502,9 +807,7 @@ KConstant::KConstant(llvm::Constant* _ct, unsigned _id, KInstruction* _ki) {
 /***/
 
 static int getOperandNum(Value *v,
-                         std::map<Instruction*, unsigned> &registerMap,
-                         KModule *km,
-                         KInstruction *ki) {
+                         std::map<Instruction*, unsigned> &registerMap) {
   if (Instruction *inst = dyn_cast<Instruction>(v)) {
     return registerMap[inst];
   } else if (Argument *a = dyn_cast<Argument>(v)) {
@@ -514,13 +817,69 @@ static int getOperandNum(Value *v,
     return -1;
   } else {
     assert(isa<Constant>(v));
-    Constant *c = cast<Constant>(v);
-    return -(km->getConstantID(c, ki) + 2);
+    return UnresolvedConstant;
+  }
+}
+
+/// The value of the operand of the instruction numbered j in its operands
+static Value *getOperandValue(Instruction *inst, unsigned j) {
+  if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
+    CallSite cs(inst);
+    return j ? cs.getArgument(j - 1) : cs.getCalledValue();
+  }
+  return inst->getOperand(j);
+}
+
+/// Mark the control point kinds of the basic blocks of the function, whose
+/// ids follow firstId in the order of the function. A loop header is the
+/// target of a back edge of a depth-first search from the entry, and a join
+/// point has several incoming edges.
+static void markControlPoints(Function *f, unsigned firstId,
+                              std::vector<unsigned char> &kinds) {
+  std::vector<BasicBlock *> blocks;
+  std::map<BasicBlock *, unsigned> index;
+  for (Function::iterator bbit = f->begin(), bbie = f->end(); bbit != bbie;
+       ++bbit) {
+    index[bbit] = blocks.size();
+    blocks.push_back(bbit);
+  }
+  kinds.resize(firstId + blocks.size(), 0);
+  if (blocks.empty())
+    return;
+  kinds[firstId] |= KModule::FunctionEntry;
+
+  std::vector<unsigned> incoming(blocks.size(), 0);
+  for (unsigned i = 0; i < blocks.size(); ++i) {
+    TerminatorInst *term = blocks[i]->getTerminator();
+    for (unsigned j = 0, n = term ? term->getNumSuccessors() : 0; j < n; ++j)
+      if (++incoming[index[term->getSuccessor(j)]] == 2)
+        kinds[firstId + index[term->getSuccessor(j)]] |= KModule::JoinPoint;
+  }
+
+  // 0 is not visited, 1 is on the search stack, and 2 is finished
+  std::vector<char> visited(blocks.size(), 0);
+  std::vector<std::pair<unsigned, unsigned> > stack;
+  stack.push_back(std::make_pair(0U, 0U));
+  visited[0] = 1;
+  while (!stack.empty()) {
+    std::pair<unsigned, unsigned> &top = stack.back();
+    TerminatorInst *term = blocks[top.first]->getTerminator();
+    if (!term || top.second == term->getNumSuccessors()) {
+      visited[top.first] = 2;
+      stack.pop_back();
+      continue;
+    }
+    unsigned succ = index[term->getSuccessor(top.second++)];
+    if (visited[succ] == 1) {
+      kinds[firstId + succ] |= KModule::LoopHeader;
+    } else if (!visited[succ]) {
+      visited[succ] = 1;
+      stack.push_back(std::make_pair(succ, 0U));
+    }
   }
 }
 
-KFunction::KFunction(llvm::Function *_function,
-                     KModule *km) 
+KFunction::KFunction(llvm::Function *_function)
   : function(_function),
     numArgs(function->arg_size()),
     numInstructions(0),
@@ -545,10 +904,10 @@ KFunction::KFunction(llvm::Function *_function,
       registerMap[it] = rnum++;
   }
   numRegisters = rnum;
-  
-  unsigned i = 0;
+
+  unsigned i = 0, basicBlockId = 0;
   for (llvm::Function::iterator bbit = function->begin(), 
-         bbie = function->end(); bbit != bbie; ++bbit) {
+         bbie = function->end(); bbit != bbie; ++bbit, ++basicBlockId) {
     for (llvm::BasicBlock::iterator it = bbit->begin(), ie = bbit->end();
          it != ie; ++it) {
       KInstruction *ki;
@@ -564,23 +923,34 @@ KFunction::KFunction(llvm::Function *_function,
 
       ki->inst = it;      
       ki->dest = registerMap[it];
+      ki->basicBlockId = basicBlockId;
+
+      ki->fusedWithNext = false;
+      llvm::BasicBlock::iterator next = it;
+      if (++next != ie && it->hasOneUse()) {
+        if (BranchInst *bi = dyn_cast<BranchInst>(next))
+          ki->fusedWithNext = isa<ICmpInst>(it) && bi->isConditional() &&
+                              bi->getCondition() == ki->inst;
+        else if (LoadInst *li = dyn_cast<LoadInst>(next))
+          ki->fusedWithNext = isa<GetElementPtrInst>(it) &&
+                              li->getPointerOperand() == ki->inst;
+      }
 
       if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
         CallSite cs(it);
         unsigned numArgs = cs.arg_size();
         ki->operands = new int[numArgs+1];
-        ki->operands[0] = getOperandNum(cs.getCalledValue(), registerMap, km,
-                                        ki);
+        ki->operands[0] = getOperandNum(cs.getCalledValue(), registerMap);
         for (unsigned j=0; j<numArgs; j++) {
           Value *v = cs.getArgument(j);
-          ki->operands[j+1] = getOperandNum(v, registerMap, km, ki);
+          ki->operands[j+1] = getOperandNum(v, registerMap);
         }
       } else {
         unsigned numOperands = it->getNumOperands();
         ki->operands = new int[numOperands];
         for (unsigned j=0; j<numOperands; j++) {
           Value *v = it->getOperand(j);
-          ki->operands[j] = getOperandNum(v, registerMap, km, ki);
+          ki->operands[j] = getOperandNum(v, registerMap);
         }
       }
 
@@ -589,6 +959,26 @@ KFunction::KFunction(llvm::Function *_function,
   }
 }
 
+void KFunction::resolve(KModule *km) {
+  unsigned firstId = km->numBasicBlocks;
+  markControlPoints(function, firstId, km->basicBlockKinds);
+  km->numBasicBlocks += function->size();
+
+  for (unsigned i = 0; i < numInstructions; ++i) {
+    KInstruction *ki = instructions[i];
+    ki->basicBlockId += firstId;
+
+    unsigned numOperands = ki->inst->getNumOperands();
+    if (isa<CallInst>(ki->inst) || isa<InvokeInst>(ki->inst))
+      numOperands = CallSite(ki->inst).arg_size() + 1;
+    for (unsigned j = 0; j < numOperands; ++j)
+      if (ki->operands[j] == UnresolvedConstant)
+        ki->operands[j] = -(km->getConstantID(
+                                cast<Constant>(getOperandValue(ki->inst, j)),
+                                ki) + 2);
+  }
+}
+
 KFunction::~KFunction() {
   for (unsigned i=0; i<numInstructions; ++i)
     delete instructions[i];
@@ -160,6 +160,16 @@ static void AddStandardCompilePasses(PassManager &PM) {
   addPass(PM, createConstantMergePass());        // Merge dup global constants
 }
 
+/// getOptimizeOptions - Return the values of the options of Optimize, for
+/// caching its results.
+std::string getOptimizeOptions() {
+  std::string options;
+  llvm::raw_string_ostream os(options);
+  os << DontVerify << DisableInline << DisableOptimizations
+     << DisableInternalize << VerifyEach << Strip << StripDebug;
+  return os.str();
+}
+
 /// Optimize - Perform link time optimizations. This will run the scalar
 /// optimizations, any loaded plugin-optimization modules, and then the
 /// inter-procedural optimizations if applicable.
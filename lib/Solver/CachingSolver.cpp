@@ -57,8 +57,8 @@ private:
   };
   
   struct CacheEntryHash {
-    unsigned operator()(const CacheEntry &ce) const {
-      unsigned result = ce.query->hash();
+    std::size_t operator()(const CacheEntry &ce) const {
+      uint64_t result = ce.query->hash();
       
       for (ConstraintManager::constraint_iterator it = ce.constraints.begin();
            it != ce.constraints.end(); ++it)
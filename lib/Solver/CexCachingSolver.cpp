@@ -24,6 +24,10 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <deque>
+#include <list>
+
 using namespace klee;
 using namespace llvm;
 
@@ -44,6 +48,16 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexCacheMaxEntries("cex-cache-max-entries",
+                     cl::desc("Maximum number of results in the counterexample cache, evicting the least recently used (0=unlimited, default=65536)"),
+                     cl::init(65536));
+
+  cl::opt<unsigned>
+  CexCacheTryRecent("cex-cache-try-recent",
+                    cl::desc("Number of most recently used assignments to try on a query before searching the cache (default=0)"),
+                    cl::init(0));
+
 }
 
 ///
@@ -51,20 +65,52 @@ namespace {
 typedef std::set< ref<Expr> > KeyType;
 
 struct AssignmentLessThan {
-  bool operator()(const Assignment *a, const Assignment *b) {
+  bool operator()(const Assignment *a, const Assignment *b) const {
     return a->bindings < b->bindings;
   }
 };
 
+/// A cached result, kept in a list ordered from the most to the least
+/// recently used
+struct CacheEntry {
+  KeyType key;
+  AssignmentCacheWrapper *wrapper;
+
+  CacheEntry(const KeyType &_key, AssignmentCacheWrapper *_wrapper)
+      : key(_key), wrapper(_wrapper) {}
+};
+
+typedef std::list<CacheEntry> lru_ty;
 
 class CexCachingSolver : public SolverImpl {
-  typedef std::set<Assignment*, AssignmentLessThan> assignmentsTable_ty;
+  // The assignments with the number of cached results and recent list
+  // elements referring to them
+  typedef std::map<Assignment*, unsigned, AssignmentLessThan>
+    assignmentsTable_ty;
 
   Solver *solver;
   
-  MapOfSets<ref<Expr>, AssignmentCacheWrapper*> cache;
+  MapOfSets<ref<Expr>, lru_ty::iterator> cache;
+  lru_ty lru;
+  // std::list::size() is linear in C++03
+  unsigned cacheSize;
   // memo table
   assignmentsTable_ty assignmentsTable;
+  // the most recently used assignments, most recent first
+  std::deque<Assignment*> recent;
+
+  Assignment *retainAssignment(Assignment *a);
+
+  void releaseAssignment(Assignment *a);
+
+  void touchRecent(Assignment *a);
+
+  void insertEntry(const KeyType &key, AssignmentCacheWrapper *wrapper);
+
+  void eraseEntry(lru_ty::iterator it);
+
+  bool useEntry(lru_ty::iterator it, Assignment *&result,
+                std::vector<ref<Expr> > &unsatCore);
 
   bool searchForAssignment(KeyType &key, Assignment *&result,
                            std::vector<ref<Expr> > &unsatCore);
@@ -82,7 +128,7 @@ class CexCachingSolver : public SolverImpl {
                      std::vector<ref<Expr> > &unsatCore);
 
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver) : solver(_solver), cacheSize(0) {}
   ~CexCachingSolver();
 
   bool computeTruth(const Query &, bool &isValid,
@@ -102,15 +148,21 @@ public:
 
 ///
 
+namespace {
+/// The assignment last found or computed by getAssignment(), cleared when
+/// the assignment is deleted.
+Assignment *lastModel = 0;
+}
+
 struct NullAssignment {
-  bool operator()(AssignmentCacheWrapper *a) const {
-    return !(a->getAssignment());
+  bool operator()(lru_ty::iterator a) const {
+    return !(a->wrapper->getAssignment());
   }
 };
 
 struct NonNullAssignment {
-  bool operator()(AssignmentCacheWrapper *a) const {
-    return (a->getAssignment())!=0;
+  bool operator()(lru_ty::iterator a) const {
+    return (a->wrapper->getAssignment())!=0;
   }
 };
 
@@ -119,12 +171,92 @@ struct NullOrSatisfyingAssignment {
   
   NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
 
-  bool operator()(AssignmentCacheWrapper *a) const {
-    return !(a->getAssignment()) ||
-	a->getAssignment()->satisfies(key.begin(), key.end());
+  bool operator()(lru_ty::iterator a) const {
+    return !(a->wrapper->getAssignment()) ||
+	a->wrapper->getAssignment()->satisfies(key.begin(), key.end());
   }
 };
 
+/// retainAssignment - Add a reference to an assignment, merging it with an
+/// equal one already in the table.
+///
+/// \return - The assignment in the table.
+Assignment *CexCachingSolver::retainAssignment(Assignment *a) {
+  std::pair<assignmentsTable_ty::iterator, bool>
+    res = assignmentsTable.insert(std::make_pair(a, 0u));
+  if (!res.second && res.first->first != a)
+    delete a;
+  ++res.first->second;
+  return res.first->first;
+}
+
+void CexCachingSolver::releaseAssignment(Assignment *a) {
+  assignmentsTable_ty::iterator it = assignmentsTable.find(a);
+  assert(it != assignmentsTable.end() && it->first == a &&
+         "releasing an assignment not in the table");
+  if (--it->second == 0) {
+    assignmentsTable.erase(it);
+    if (a == lastModel)
+      lastModel = 0;
+    delete a;
+  }
+}
+
+/// touchRecent - Move an assignment to the front of the recent list.
+void CexCachingSolver::touchRecent(Assignment *a) {
+  if (!CexCacheTryRecent)
+    return;
+
+  std::deque<Assignment*>::iterator it =
+    std::find(recent.begin(), recent.end(), a);
+  if (it != recent.end()) {
+    recent.erase(it);
+  } else {
+    retainAssignment(a);
+    if (recent.size() == CexCacheTryRecent) {
+      releaseAssignment(recent.back());
+      recent.pop_back();
+    }
+  }
+  recent.push_front(a);
+}
+
+void CexCachingSolver::insertEntry(const KeyType &key,
+                                   AssignmentCacheWrapper *wrapper) {
+  if (lru_ty::iterator *existing = cache.lookup(key))
+    eraseEntry(*existing);
+
+  lru.push_front(CacheEntry(key, wrapper));
+  cache.insert(key, lru.begin());
+  ++cacheSize;
+
+  while (CexCacheMaxEntries && cacheSize > CexCacheMaxEntries)
+    eraseEntry(--lru.end());
+}
+
+void CexCachingSolver::eraseEntry(lru_ty::iterator it) {
+  cache.erase(it->key);
+  if (Assignment *a = it->wrapper->getAssignment())
+    releaseAssignment(a);
+  delete it->wrapper;
+  lru.erase(it);
+  --cacheSize;
+}
+
+/// useEntry - Return the result of a cache entry found by a lookup, marking
+/// it as the most recently used.
+bool CexCachingSolver::useEntry(lru_ty::iterator it, Assignment *&result,
+                                std::vector<ref<Expr> > &unsatCore) {
+  lru.splice(lru.begin(), lru, it);
+  result = it->wrapper->getAssignment();
+  const std::vector<ref<Expr> > &cachedCore = it->wrapper->getCore();
+  unsatCore.clear();
+  unsatCore.insert(unsatCore.end(), cachedCore.begin(), cachedCore.end());
+  if (result)
+    touchRecent(result);
+  return true;
+}
+
 /// searchForAssignment - Look for a cached solution for a query.
 ///
 /// \param key - The query to look up.
@@ -134,20 +266,28 @@ struct NullOrSatisfyingAssignment {
 /// \return - True if a cached result was found.
 bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result,
                                            std::vector<ref<Expr> > &unsatCore) {
-  AssignmentCacheWrapper * const *lookup = cache.lookup(key);
-
-  if (lookup) {
-    result = (*lookup)->getAssignment();
-    const std::vector<ref<Expr> > &cachedCore = (*lookup)->getCore();
-    unsatCore.clear();
-    unsatCore.insert(unsatCore.end(), cachedCore.begin(), cachedCore.end());
-    return true;
+  lru_ty::iterator *lookup = cache.lookup(key);
+
+  if (lookup)
+    return useEntry(*lookup, result, unsatCore);
+
+  // The assignments used last were mostly found for the parent or a sibling
+  // of the current path, and tend to satisfy its queries as well.
+  for (std::deque<Assignment*>::iterator it = recent.begin(),
+         ie = recent.end(); it != ie; ++it) {
+    Assignment *a = *it;
+    if (a->satisfies(key.begin(), key.end())) {
+      result = a;
+      unsatCore.clear();
+      touchRecent(a);
+      return true;
+    }
   }
 
   if (CexCacheTryAll) {
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
-    AssignmentCacheWrapper **lookup = 0;
+    lru_ty::iterator *lookup = 0;
     if (CexCacheSuperSet)
       lookup = cache.findSuperset(key, NonNullAssignment());
 
@@ -156,22 +296,18 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result,
       lookup = cache.findSubset(key, NullAssignment());
 
     // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = (*lookup)->getAssignment();
-      const std::vector<ref<Expr> > &cachedCore = (*lookup)->getCore();
-      unsatCore.clear();
-      unsatCore.insert(unsatCore.begin(), cachedCore.begin(), cachedCore.end());
-      return true;
-    }
+    if (lookup)
+      return useEntry(*lookup, result, unsatCore);
 
     // Otherwise, iterate through the set of current assignments to see if one
     // of them satisfies the query.
     for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
            ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
+      Assignment *a = it->first;
       if (a->satisfies(key.begin(), key.end())) {
         result = a;
         unsatCore.clear();
+        touchRecent(a);
         return true;
       }
     }
@@ -180,7 +316,7 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result,
 
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
-    AssignmentCacheWrapper **lookup = 0;
+    lru_ty::iterator *lookup = 0;
     if (CexCacheSuperSet)
       lookup = cache.findSuperset(key, NonNullAssignment());
 
@@ -193,13 +329,8 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result,
       lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
 
     // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = (*lookup)->getAssignment();
-      const std::vector<ref<Expr> > &cachedCore = (*lookup)->getCore();
-      unsatCore.clear();
-      unsatCore.insert(unsatCore.begin(), cachedCore.begin(), cachedCore.end());
-      return true;
-    }
+    if (lookup)
+      return useEntry(*lookup, result, unsatCore);
   }
   
   return false;
@@ -249,8 +380,11 @@ bool CexCachingSolver::getAssignment(const Query &query, Assignment *&result,
                                      std::vector<ref<Expr> > &unsatCore) {
   KeyType key;
 
-  if (lookupAssignment(query, key, result, unsatCore))
+  if (lookupAssignment(query, key, result, unsatCore)) {
+    if (result)
+      lastModel = result;
     return true;
+  }
 
   std::vector<const Array*> objects;
   findSymbolicObjects(key.begin(), key.end(), objects);
@@ -264,15 +398,9 @@ bool CexCachingSolver::getAssignment(const Query &query, Assignment *&result,
   AssignmentCacheWrapper *bindingWrapper;
   Assignment *binding;
   if (hasSolution) {
-    binding = new Assignment(objects, values);
-
     // Memoize the result.
-    std::pair<assignmentsTable_ty::iterator, bool>
-      res = assignmentsTable.insert(binding);
-    if (!res.second) {
-      delete binding;
-      binding = *res.first;
-    }
+    binding = retainAssignment(new Assignment(objects, values));
+    touchRecent(binding);
     
     if (DebugCexCacheCheckBinding)
       if (!binding->satisfies(key.begin(), key.end())) {
@@ -288,7 +416,9 @@ bool CexCachingSolver::getAssignment(const Query &query, Assignment *&result,
   }
   
   result = binding;
-  cache.insert(key, bindingWrapper);
+  if (binding)
+    lastModel = binding;
+  insertEntry(key, bindingWrapper);
 
   return true;
 }
@@ -298,9 +428,14 @@ bool CexCachingSolver::getAssignment(const Query &query, Assignment *&result,
 CexCachingSolver::~CexCachingSolver() {
   cache.clear();
   delete solver;
+  for (lru_ty::iterator it = lru.begin(), ie = lru.end(); it != ie; ++it)
+    delete it->wrapper;
   for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-         ie = assignmentsTable.end(); it != ie; ++it)
-    delete *it;
+         ie = assignmentsTable.end(); it != ie; ++it) {
+    if (it->first == lastModel)
+      lastModel = 0;
+    delete it->first;
+  }
 }
 
 bool CexCachingSolver::computeValidity(const Query &query,
@@ -441,6 +576,8 @@ void CexCachingSolver::setCoreSolverTimeout(double timeout) {
 
 ///
 
+Assignment *klee::getLastCexCacheModel() { return lastModel; }
+
 Solver *klee::createCexCachingSolver(Solver *_solver) {
   return new Solver(new CexCachingSolver(_solver));
 }
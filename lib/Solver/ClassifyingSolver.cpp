@@ -0,0 +1,105 @@
+//===-- ClassifyingSolver.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+/// A solver sending the subsumption checks of Tracer-X to a solver chain of
+/// their own, and the other queries, mostly branch feasibility checks, to the
+/// default one. The two kinds of queries differ in size and structure, and
+/// sharing caches between them only lowers the hit rate of both.
+class ClassifyingSolver : public SolverImpl {
+  Solver *branchSolver;
+  Solver *subsumptionSolver;
+
+  /// The solver of the last query, whose status is reported
+  Solver *lastSolver;
+
+  static bool hasQuantifier(ref<Expr> e);
+
+  Solver *classify(const Query &query);
+
+public:
+  ClassifyingSolver(Solver *_branchSolver, Solver *_subsumptionSolver)
+      : branchSolver(_branchSolver), subsumptionSolver(_subsumptionSolver),
+        lastSolver(_branchSolver) {}
+  ~ClassifyingSolver() {
+    delete branchSolver;
+    delete subsumptionSolver;
+  }
+
+  bool computeValidity(const Query &query, Solver::Validity &result,
+                       std::vector<ref<Expr> > &unsatCore) {
+    return classify(query)->impl->computeValidity(query, result, unsatCore);
+  }
+  bool computeTruth(const Query &query, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore) {
+    return classify(query)->impl->computeTruth(query, isValid, unsatCore);
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return classify(query)->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore) {
+    return classify(query)->impl->computeInitialValues(
+        query, objects, values, hasSolution, unsatCore);
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return lastSolver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return classify(query)->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double timeout) {
+    branchSolver->impl->setCoreSolverTimeout(timeout);
+    subsumptionSolver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+bool ClassifyingSolver::hasQuantifier(ref<Expr> e) {
+  std::vector<Expr *> stack(1, e.get());
+  std::set<Expr *> visited;
+  while (!stack.empty()) {
+    Expr *ep = stack.back();
+    stack.pop_back();
+    if (isa<ExistsExpr>(ep))
+      return true;
+    if (!visited.insert(ep).second)
+      continue;
+    for (unsigned i = 0, n = ep->getNumKids(); i != n; ++i)
+      stack.push_back(ep->getKid(i).get());
+  }
+  return false;
+}
+
+Solver *ClassifyingSolver::classify(const Query &query) {
+  lastSolver = branchSolver;
+#ifdef ENABLE_Z3
+  if (Z3Solver::subsumptionCheck)
+    lastSolver = subsumptionSolver;
+#endif
+  if (lastSolver == branchSolver && hasQuantifier(query.expr))
+    lastSolver = subsumptionSolver;
+  return lastSolver;
+}
+
+Solver *klee::createClassifyingSolver(Solver *branchSolver,
+                                      Solver *subsumptionSolver) {
+  return new Solver(new ClassifyingSolver(branchSolver, subsumptionSolver));
+}
@@ -13,7 +13,9 @@
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/IncompleteSolver.h"
+#include "klee/SolverStats.h"
 #include "klee/util/ExprEvaluator.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprRangeEvaluator.h"
 #include "klee/util/ExprVisitor.h"
 // FIXME: Use APInt.
@@ -291,45 +293,55 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
   return os;
 }
 
-// XXX waste of space, rather have ByteValueRange
 typedef ValueRange CexValueData;
 
+/// The range of the values of a byte of an object
+struct CexByteRange {
+  unsigned char min, max;
+
+  CexByteRange() : min(0), max(255) {}
+  CexByteRange(const CexValueData &values)
+      : min(values.min()), max(values.max()) {}
+
+  CexValueData get() const { return CexValueData(min, max); }
+};
+
 class CexObjectData {
   /// possibleContents - An array of "possible" values for the object.
   ///
   /// The possible values is an inexact approximation for the set of values for
   /// each array location.
-  std::vector<CexValueData> possibleContents;
+  std::vector<CexByteRange> possibleContents;
 
   /// exactContents - An array of exact values for the object.
   ///
   /// The exact values are a conservative approximation for the set of values
   /// for each array location.
-  std::vector<CexValueData> exactContents;
+  std::vector<CexByteRange> exactContents;
 
   CexObjectData(const CexObjectData&); // DO NOT IMPLEMENT
   void operator=(const CexObjectData&); // DO NOT IMPLEMENT
 
 public:
-  CexObjectData(uint64_t size) : possibleContents(size), exactContents(size) {
-    for (uint64_t i = 0; i != size; ++i) {
-      possibleContents[i] = ValueRange(0, 255);
-      exactContents[i] = ValueRange(0, 255);
-    }
-  }
+  CexObjectData(uint64_t size) : possibleContents(size), exactContents(size) {}
+
+  uint64_t size() const { return possibleContents.size(); }
 
   const CexValueData getPossibleValues(size_t index) const { 
-    return possibleContents[index];
+    return possibleContents[index].get();
   }
   void setPossibleValues(size_t index, CexValueData values) {
-    possibleContents[index] = values;
+    // The ranges propagated to a byte may be wider than a byte
+    values = values.set_intersection(CexValueData(0, 255));
+    if (!values.isEmpty())
+      possibleContents[index] = values;
   }
   void setPossibleValue(size_t index, unsigned char value) {
     possibleContents[index] = CexValueData(value);
   }
 
   const CexValueData getExactValues(size_t index) const { 
-    return exactContents[index];
+    return exactContents[index].get();
   }
   void setExactValues(size_t index, CexValueData values) {
     exactContents[index] = values;
@@ -337,16 +349,70 @@ public:
 
   /// getPossibleValue - Return some possible value.
   unsigned char getPossibleValue(size_t index) const {
-    const CexValueData &cvd = possibleContents[index];
-    return cvd.min() + (cvd.max() - cvd.min()) / 2;
+    const CexByteRange &r = possibleContents[index];
+    return r.min + (r.max - r.min) / 2;
+  }
+
+  /// Write some possible value of each byte
+  void getPossibleValues(std::vector<unsigned char> &values) const {
+    values.resize(possibleContents.size());
+    for (size_t i = 0, n = possibleContents.size(); i != n; ++i)
+      values[i] = possibleContents[i].min +
+                  (possibleContents[i].max - possibleContents[i].min) / 2;
+  }
+};
+
+/// The data of the objects of a propagation. The occurrences of a read are
+/// mostly of the object of the previous read, which is looked up first.
+class CexObjectMap {
+  std::map<const Array *, CexObjectData *> objects;
+  const Array *lastArray;
+  CexObjectData *lastData;
+
+  CexObjectMap(const CexObjectMap &); // DO NOT IMPLEMENT
+  void operator=(const CexObjectMap &); // DO NOT IMPLEMENT
+
+public:
+  typedef std::map<const Array *, CexObjectData *>::const_iterator
+  const_iterator;
+
+  CexObjectMap() : lastArray(0), lastData(0) {}
+  ~CexObjectMap() {
+    for (const_iterator it = objects.begin(), ie = objects.end(); it != ie;
+         ++it)
+      delete it->second;
+  }
+
+  const_iterator begin() const { return objects.begin(); }
+  const_iterator end() const { return objects.end(); }
+
+  /// Return the data of the object, or null if nothing was propagated to it
+  CexObjectData *find(const Array *array) {
+    if (array == lastArray)
+      return lastData;
+    const_iterator it = objects.find(array);
+    if (it == objects.end())
+      return 0;
+    lastArray = array;
+    lastData = it->second;
+    return lastData;
+  }
+
+  CexObjectData &get(const Array *array) {
+    if (CexObjectData *data = find(array))
+      return *data;
+    CexObjectData *data = new CexObjectData(array->size);
+    objects[array] = data;
+    lastArray = array;
+    lastData = data;
+    return *data;
   }
 };
 
 class CexRangeEvaluator : public ExprRangeEvaluator<ValueRange> {
 public:
-  std::map<const Array*, CexObjectData*> &objects;
-  CexRangeEvaluator(std::map<const Array*, CexObjectData*> &_objects) 
-    : objects(_objects) {}
+  CexObjectMap &objects;
+  CexRangeEvaluator(CexObjectMap &_objects) : objects(_objects) {}
 
   ValueRange getInitialReadRange(const Array &array, ValueRange index) {
     // Check for a concrete read of a constant array.
@@ -368,16 +434,14 @@ protected:
       return ReadExpr::create(UpdateList(&array, 0), 
                               ConstantExpr::alloc(index, array.getDomain()));
       
-    std::map<const Array*, CexObjectData*>::iterator it = objects.find(&array);
-    return ConstantExpr::alloc((it == objects.end() ? 127 : 
-                                it->second->getPossibleValue(index)),
+    CexObjectData *cod = objects.find(&array);
+    return ConstantExpr::alloc((!cod ? 127 : cod->getPossibleValue(index)),
                                array.getRange());
   }
 
 public:
-  std::map<const Array*, CexObjectData*> &objects;
-  CexPossibleEvaluator(std::map<const Array*, CexObjectData*> &_objects) 
-    : objects(_objects) {}
+  CexObjectMap &objects;
+  CexPossibleEvaluator(CexObjectMap &_objects) : objects(_objects) {}
 };
 
 class CexExactEvaluator : public ExprEvaluator {
@@ -389,12 +453,12 @@ protected:
       return ReadExpr::create(UpdateList(&array, 0), 
                               ConstantExpr::alloc(index, array.getDomain()));
       
-    std::map<const Array*, CexObjectData*>::iterator it = objects.find(&array);
-    if (it == objects.end())
+    CexObjectData *cod = objects.find(&array);
+    if (!cod)
       return ReadExpr::create(UpdateList(&array, 0), 
                               ConstantExpr::alloc(index, array.getDomain()));
 
-    CexValueData cvd = it->second->getExactValues(index);
+    CexValueData cvd = cod->getExactValues(index);
     if (!cvd.isFixed())
       return ReadExpr::create(UpdateList(&array, 0), 
                               ConstantExpr::alloc(index, array.getDomain()));
@@ -403,34 +467,29 @@ protected:
   }
 
 public:
-  std::map<const Array*, CexObjectData*> &objects;
-  CexExactEvaluator(std::map<const Array*, CexObjectData*> &_objects) 
-    : objects(_objects) {}
+  CexObjectMap &objects;
+  CexExactEvaluator(CexObjectMap &_objects) : objects(_objects) {}
 };
 
 class CexData {
 public:
-  std::map<const Array*, CexObjectData*> objects;
+  CexObjectMap objects;
+
+  /// Whether the exact values of a byte were found to be empty, that is,
+  /// the propagated constraints to be unsatisfiable
+  bool inconsistent;
+
+  /// The ranges of the expressions, which do not depend on the propagated
+  /// values, as the initial reads are of all the values of a byte
+  ExprHashMap<ValueRange> ranges;
 
   CexData(const CexData&); // DO NOT IMPLEMENT
   void operator=(const CexData&); // DO NOT IMPLEMENT
 
 public:
-  CexData() {}
-  ~CexData() {
-    for (std::map<const Array*, CexObjectData*>::iterator it = objects.begin(),
-           ie = objects.end(); it != ie; ++it)
-      delete it->second;
-  }
+  CexData() : inconsistent(false) {}
 
-  CexObjectData &getObjectData(const Array *A) {
-    CexObjectData *&Entry = objects[A];
-
-    if (!Entry)
-      Entry = new CexObjectData(A->size);
-
-    return *Entry;
-  }
+  CexObjectData &getObjectData(const Array *A) { return objects.get(A); }
 
   void propogatePossibleValue(ref<Expr> e, uint64_t value) {
     propogatePossibleValues(e, CexValueData(value,value));
@@ -817,16 +876,12 @@ public:
           propogateExactValues(array->constantValues[index.min()],
                                range);
         } else {
-          CexValueData cvd = cod.getExactValues(index.min());
-          if (range.min() > cvd.min()) {
-            assert(range.min() <= cvd.max());
-            cvd = CexValueData(range.min(), cvd.max());
-          }
-          if (range.max() < cvd.max()) {
-            assert(range.max() >= cvd.min());
-            cvd = CexValueData(cvd.min(), range.max());
-          }
-          cod.setExactValues(index.min(), cvd);
+          CexValueData cvd =
+              cod.getExactValues(index.min()).set_intersection(range);
+          if (cvd.isEmpty())
+            inconsistent = true;
+          else
+            cod.setExactValues(index.min(), cvd);
         }
       }
       break;
@@ -921,8 +976,13 @@ public:
   }
 
   ValueRange evalRangeForExpr(const ref<Expr> &e) {
+    ExprHashMap<ValueRange>::iterator it = ranges.find(e);
+    if (it != ranges.end())
+      return it->second;
     CexRangeEvaluator ce(objects);
-    return ce.evaluate(e);
+    ValueRange range = ce.evaluate(e);
+    ranges.insert(std::make_pair(e, range));
+    return range;
   }
 
   /// evaluate - Try to evaluate the given expression using a consistent fixed
@@ -937,9 +997,8 @@ public:
 
   void dump() {
     llvm::errs() << "-- propogated values --\n";
-    for (std::map<const Array *, CexObjectData *>::iterator
-             it = objects.begin(),
-             ie = objects.end();
+    for (CexObjectMap::const_iterator it = objects.begin(),
+                                      ie = objects.end();
          it != ie; ++it) {
       const Array *A = it->first;
       CexObjectData *COD = it->second;
@@ -999,6 +1058,10 @@ FastCexSolver::~FastCexSolver() { }
 /// constraints were proven valid or invalid.
 ///
 /// \return - True if the propogation was able to prove validity or invalidity.
+///
+/// The unsatisfiability core of a proof of validity is all the constraints,
+/// which are those of the independent factor of the query when the
+/// independent solver is used.
 static bool propogateValues(const Query &query, CexData &cd, bool checkExpr,
                             bool &isValid, std::vector<ref<Expr> > &unsatCore) {
   for (ConstraintManager::const_iterator it = query.constraints.begin(), 
@@ -1012,6 +1075,14 @@ static bool propogateValues(const Query &query, CexData &cd, bool checkExpr,
   }
 
   KLEE_DEBUG(cd.dump());
+
+  // The exact values are conservative, so that no byte having any is a
+  // proof that the constraints, with the negated query, are unsatisfiable
+  if (cd.inconsistent) {
+    isValid = true;
+    unsatCore.assign(query.constraints.begin(), query.constraints.end());
+    return true;
+  }
   
   // Check the result.
   bool hasSatisfyingAssignment = true;
@@ -1022,6 +1093,7 @@ static bool propogateValues(const Query &query, CexData &cd, bool checkExpr,
     // If the query is known to be true, then we have proved validity.
     if (cd.evaluateExact(query.expr)->isTrue()) {
       isValid = true;
+      unsatCore.assign(query.constraints.begin(), query.constraints.end());
       return true;
     }
   }
@@ -1035,6 +1107,7 @@ static bool propogateValues(const Query &query, CexData &cd, bool checkExpr,
     // the query is valid.
     if (cd.evaluateExact(*it)->isFalse()) {
       isValid = true;
+      unsatCore.assign(query.constraints.begin(), query.constraints.end());
       return true;
     }
   }
@@ -1057,6 +1130,7 @@ FastCexSolver::computeTruth(const Query &query,
 
   if (!success)
     return IncompleteSolver::None;
+  ++stats::queryFastCexHits;
 
   return isValid ? IncompleteSolver::MustBeTrue : IncompleteSolver::MayBeFalse;
 }
@@ -1081,6 +1155,7 @@ bool FastCexSolver::computeValue(const Query& query, ref<Expr> &result) {
   
   if (isa<ConstantExpr>(value)) {
     // FIXME: We should be able to make sure this never fails?
+    ++stats::queryFastCexHits;
     result = value;
     return true;
   } else {
@@ -1102,33 +1177,33 @@ bool FastCexSolver::computeInitialValues(
     return false;
 
   hasSolution = !isValid;
-  if (!hasSolution)
+  if (!hasSolution) {
+    ++stats::queryFastCexHits;
     return true;
+  }
 
-  // Propogation found a satisfying assignment, compute the initial values.
+  // Propogation found a satisfying assignment, compute the initial values,
+  // which are the possible values of the initial reads of the bytes, or the
+  // contents of the constant arrays.
+  size_t first = values.size();
+  values.resize(first + objects.size());
   for (unsigned i = 0; i != objects.size(); ++i) {
     const Array *array = objects[i];
     assert(array);
-    std::vector<unsigned char> data;
-    data.reserve(array->size);
-
-    for (unsigned i=0; i < array->size; i++) {
-      ref<Expr> read = 
-        ReadExpr::create(UpdateList(array, 0),
-                         ConstantExpr::create(i, array->getDomain()));
-      ref<Expr> value = cd.evaluatePossible(read);
-      
-      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
-        data.push_back((unsigned char) CE->getZExtValue(8));
-      } else {
-        // FIXME: When does this happen?
-        return false;
-      }
+    std::vector<unsigned char> &data = values[first + i];
+
+    if (array->isConstantArray()) {
+      data.resize(array->size);
+      for (unsigned j = 0; j < array->size; j++)
+        data[j] = array->constantValues[j]->getZExtValue(8);
+    } else if (CexObjectData *cod = cd.objects.find(array)) {
+      cod->getPossibleValues(data);
+    } else {
+      data.assign(array->size, 127);
     }
-
-    values.push_back(data);
   }
 
+  ++stats::queryFastCexHits;
   return true;
 }
 
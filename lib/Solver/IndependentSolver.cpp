@@ -13,6 +13,7 @@
 #include "klee/Expr.h"
 #include "klee/Constraints.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
 #include "klee/Internal/Support/Debug.h"
 
 #include "klee/util/ExprUtil.h"
@@ -321,8 +322,14 @@ getAllIndependentConstraintsSets(const Query &query) {
 }
 
 static 
-IndependentElementSet getIndependentConstraints(const Query& query,
-                                                std::vector< ref<Expr> > &result) {
+void computeIndependentConstraints(const Query& query,
+                                   std::vector< ref<Expr> > &result) {
+  // The constraint manager of a path keeps the partition as the constraints
+  // are added, so the closure only has to be computed for constraint sets
+  // built directly from a vector.
+  if (query.constraints.getIndependentConstraints(query.expr, result))
+    return;
+
   IndependentElementSet eltsClosure(query.expr);
   std::vector< std::pair<ref<Expr>, IndependentElementSet> > worklist;
 
@@ -364,9 +371,14 @@ IndependentElementSet getIndependentConstraints(const Query& query,
     }
     errs() << "elts closure: " << eltsClosure << "\n";
  );
+}
 
-
-  return eltsClosure;
+static
+void getIndependentConstraints(const Query& query,
+                               std::vector< ref<Expr> > &result) {
+  computeIndependentConstraints(query, result);
+  if (result.size() < query.constraints.size())
+    ++stats::queryIndependentReductions;
 }
 
 
@@ -419,8 +431,7 @@ bool IndependentSolver::computeValidity(const Query &query,
                                         Solver::Validity &result,
                                         std::vector<ref<Expr> > &unsatCore) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure =
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValidity(Query(tmp, query.expr), result,
                                        unsatCore);
@@ -429,16 +440,14 @@ bool IndependentSolver::computeValidity(const Query &query,
 bool IndependentSolver::computeTruth(const Query &query, bool &isValid,
                                      std::vector<ref<Expr> > &unsatCore) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeTruth(Query(tmp, query.expr), isValid, unsatCore);
 }
 
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
-  IndependentElementSet eltsClosure = 
-    getIndependentConstraints(query, required);
+  getIndependentConstraints(query, required);
   ConstraintManager tmp(required);
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
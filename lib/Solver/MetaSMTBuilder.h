@@ -71,6 +71,9 @@ public:
       : _solver(solver), _optimizeDivides(optimizeDivides) {};
   virtual ~MetaSMTBuilder() {};
 
+  /// Forget the update lists, cached by the address of their nodes
+  void clearUpdateNodeCache() { _arr_hash._update_node_hash.clear(); }
+
   typename SolverContext::result_type construct(ref<Expr> e);
 
   typename SolverContext::result_type getInitialRead(const Array *root,
@@ -67,14 +67,17 @@ public:
 
   char *getConstraintLog(const Query &);
   void setCoreSolverTimeout(double timeout) { _timeout = timeout; }
+  void clearUpdateNodeCache() { _builder->clearUpdateNodeCache(); }
 
-  bool computeTruth(const Query &, bool &isValid);
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
   bool computeValue(const Query &, ref<Expr> &result);
 
   bool computeInitialValues(const Query &query,
                             const std::vector<const Array *> &objects,
                             std::vector<std::vector<unsigned char> > &values,
-                            bool &hasSolution);
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore);
 
   SolverImpl::SolverRunStatus
   runAndGetCex(ref<Expr> query_expr, const std::vector<const Array *> &objects,
@@ -125,15 +128,15 @@ char *MetaSMTSolverImpl<SolverContext>::getConstraintLog(const Query &) {
 }
 
 template <typename SolverContext>
-bool MetaSMTSolverImpl<SolverContext>::computeTruth(const Query &query,
-                                                    bool &isValid) {
+bool MetaSMTSolverImpl<SolverContext>::computeTruth(
+    const Query &query, bool &isValid, std::vector<ref<Expr> > &unsatCore) {
 
   bool success = false;
   std::vector<const Array *> objects;
   std::vector<std::vector<unsigned char> > values;
   bool hasSolution;
 
-  if (computeInitialValues(query, objects, values, hasSolution)) {
+  if (computeInitialValues(query, objects, values, hasSolution, unsatCore)) {
     // query.expr is valid iff !query.expr is not satisfiable
     isValid = !hasSolution;
     success = true;
@@ -153,7 +156,9 @@ bool MetaSMTSolverImpl<SolverContext>::computeValue(const Query &query,
 
   // Find the object used in the expression, and compute an assignment for them.
   findSymbolicObjects(query.expr, objects);
-  if (computeInitialValues(query.withFalse(), objects, values, hasSolution)) {
+  std::vector<ref<Expr> > unsatCore;
+  if (computeInitialValues(query.withFalse(), objects, values, hasSolution,
+                           unsatCore)) {
     assert(hasSolution && "state has invalid constraint set");
     // Evaluate the expression with the computed assignment.
     Assignment a(objects, values);
@@ -167,7 +172,8 @@ bool MetaSMTSolverImpl<SolverContext>::computeValue(const Query &query,
 template <typename SolverContext>
 bool MetaSMTSolverImpl<SolverContext>::computeInitialValues(
     const Query &query, const std::vector<const Array *> &objects,
-    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
 
   _runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
@@ -214,6 +220,14 @@ bool MetaSMTSolverImpl<SolverContext>::computeInitialValues(
 
   // pop(_meta_solver);
 
+  // The metaSMT backends report no core, which is then computed by solving
+  // again
+  if (success && !hasSolution) {
+    SolverRunStatus status = _runStatusCode;
+    computeUnsatCoreBySolving(query, unsatCore);
+    _runStatusCode = status;
+  }
+
   return (success);
 }
 
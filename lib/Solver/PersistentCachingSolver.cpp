@@ -0,0 +1,588 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+/// The header of a cache file, with the version of its format at the end.
+/// A file of another version is discarded.
+const char CacheMagic[8] = { 'K', 'Q', 'C', 'A', 'C', 'H', 'E', 0 };
+const uint32_t CacheVersion = 1;
+const size_t HeaderSize = sizeof(CacheMagic) + sizeof(uint32_t);
+
+/// The size of the header of an entry: its key, its kind and the length of
+/// its payload
+const size_t EntryHeaderSize = 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t);
+
+enum EntryKind {
+  ValidityEntry = 1,
+  TruthEntry,
+  ValueEntry,
+  InitialValuesEntry
+};
+
+/// A structural hash of a query, as two independent 64-bit hashes
+struct CacheKey {
+  uint64_t a, b;
+
+  CacheKey()
+      : a(UINT64_C(0xcbf29ce484222325)), b(UINT64_C(0x84222325cbf29ce4)) {}
+
+  void mix(uint64_t v) {
+    a = (a ^ v) * UINT64_C(0x100000001b3);
+    a ^= a >> 29;
+    b = (b + v) * UINT64_C(0x9E3779B97F4A7C15);
+    b ^= b >> 31;
+  }
+
+  void mix(const CacheKey &k) {
+    mix(k.a);
+    mix(k.b);
+  }
+
+  bool operator<(const CacheKey &k) const {
+    return a < k.a || (a == k.a && b < k.b);
+  }
+};
+
+/// The computation of the key of a query. The arrays are numbered in the
+/// order they are met, so that the key does not depend on their names, and
+/// the hashes of the expressions and of the updates are memoized, as they are
+/// shared within a query.
+class QueryHasher {
+  std::map<const Array *, unsigned> arrayIds;
+  std::map<const Expr *, CacheKey> exprKeys;
+  std::map<const UpdateNode *, CacheKey> updateKeys;
+
+  /// Whether the query has an expression of interpolation, whose variables
+  /// cannot be named apart from the run
+  bool unsupported;
+
+  CacheKey hashUpdates(const UpdateNode *un);
+
+public:
+  QueryHasher() : unsupported(false) {}
+
+  bool isSupported() const { return !unsupported; }
+
+  /// The number of the array in the query, with its shape and constant values
+  /// at its first occurrence
+  void hashArray(CacheKey &k, const Array *array);
+
+  CacheKey hash(const ref<Expr> &e);
+};
+
+void QueryHasher::hashArray(CacheKey &k, const Array *array) {
+  std::map<const Array *, unsigned>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end()) {
+    k.mix(it->second);
+    return;
+  }
+  unsigned id = arrayIds.size();
+  arrayIds[array] = id;
+  k.mix(id);
+  k.mix(array->size);
+  k.mix(array->domain);
+  k.mix(array->range);
+  k.mix(array->constantValues.size());
+  for (std::vector<ref<ConstantExpr> >::const_iterator
+           ci = array->constantValues.begin(),
+           ce = array->constantValues.end();
+       ci != ce; ++ci)
+    k.mix(hash(*ci));
+}
+
+CacheKey QueryHasher::hashUpdates(const UpdateNode *un) {
+  CacheKey k;
+  if (!un)
+    return k;
+  std::map<const UpdateNode *, CacheKey>::iterator it = updateKeys.find(un);
+  if (it != updateKeys.end())
+    return it->second;
+  // The older updates are hashed first, as the arrays are numbered in order
+  k.mix(hashUpdates(un->next));
+  k.mix(hash(un->index));
+  k.mix(hash(un->value));
+  updateKeys[un] = k;
+  return k;
+}
+
+CacheKey QueryHasher::hash(const ref<Expr> &e) {
+  std::map<const Expr *, CacheKey>::iterator it = exprKeys.find(e.get());
+  if (it != exprKeys.end())
+    return it->second;
+
+  CacheKey k;
+  k.mix(e->getKind());
+  k.mix(e->getWidth());
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    const APInt &value = cast<ConstantExpr>(e)->getAPValue();
+    for (unsigned i = 0; i < value.getNumWords(); ++i)
+      k.mix(value.getRawData()[i]);
+    break;
+  }
+  case Expr::Read: {
+    const UpdateList &ul = cast<ReadExpr>(e)->updates;
+    hashArray(k, ul.root);
+    k.mix(hashUpdates(ul.head));
+    break;
+  }
+  case Expr::Extract:
+    k.mix(cast<ExtractExpr>(e)->offset);
+    break;
+  case Expr::Exists:
+  case Expr::WPVar:
+  case Expr::Upd:
+  case Expr::Sel:
+    unsupported = true;
+    return k;
+  default:
+    break;
+  }
+  for (unsigned i = 0, n = e->getNumKids(); i < n; ++i)
+    k.mix(hash(e->getKid(i)));
+
+  exprKeys[e.get()] = k;
+  return k;
+}
+
+/// A solver stage answering the queries from a file of the answers of the
+/// queries of earlier runs, which is mapped in memory at the start of the
+/// run, and to which the answers of the run are appended at its end. The
+/// answers are looked up by the structural hash of their query, so that a
+/// query is answered across runs whatever the names of its arrays, and the
+/// cores are kept as the positions of their constraints in the query.
+/// Without a file, the answers are only kept for the run, which answers the
+/// queries that differ from earlier ones by the names of their arrays, such
+/// as those over the shadow arrays of the subsumption checks.
+class PersistentCachingSolver : public SolverImpl {
+  Solver *solver;
+  std::string path;
+  uint64_t maxSize;
+
+  /// The mapping of the file, whose entries the cache points into
+  const char *mapped;
+  size_t mappedSize;
+
+  /// Whether the file has to be rewritten, as it is missing or has another
+  /// version
+  bool rewrite;
+
+  /// The payloads of the entries of the file, and of the new entries
+  std::map<CacheKey, std::pair<const char *, uint32_t> > cache;
+
+  /// The entries added by the run, written at its end
+  std::string added;
+
+  /// The size of the entries added by the run, which are only kept in
+  /// memory without a file
+  size_t addedSize;
+
+  /// The payloads of the new entries, which the cache points into
+  std::vector<std::string *> payloads;
+
+  void load();
+  void save();
+
+  bool computeKey(const Query &query, EntryKind kind,
+                  const std::vector<const Array *> *objects, CacheKey &key);
+  bool lookup(const CacheKey &key, const char *&data, uint32_t &length);
+  void insert(const CacheKey &key, EntryKind kind, const std::string &payload);
+
+  /// Append the positions of the constraints of the core, or return false if
+  /// the core is not a subset of the constraints of the query
+  bool encodeCore(const Query &query, const std::vector<ref<Expr> > &unsatCore,
+                  std::string &payload);
+  bool decodeCore(const Query &query, const char *data, uint32_t length,
+                  std::vector<ref<Expr> > &unsatCore);
+
+public:
+  PersistentCachingSolver(Solver *_solver, const std::string &_path,
+                          uint64_t _maxSize)
+      : solver(_solver), path(_path), maxSize(_maxSize), mapped(0),
+        mappedSize(0), rewrite(true), addedSize(0) {
+    load();
+  }
+  ~PersistentCachingSolver();
+
+  bool computeValidity(const Query &, Solver::Validity &result,
+                       std::vector<ref<Expr> > &unsatCore);
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
+  bool computeValue(const Query &query, ref<Expr> &result);
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore);
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+
+template <typename T> void append(std::string &s, T v) {
+  s.append(reinterpret_cast<const char *>(&v), sizeof(v));
+}
+
+template <typename T> T extract(const char *data) {
+  T v;
+  memcpy(&v, data, sizeof(v));
+  return v;
+}
+}
+
+void PersistentCachingSolver::load() {
+  if (path.empty())
+    return;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < HeaderSize) {
+    close(fd);
+    return;
+  }
+  void *p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    klee_warning("unable to map the query cache %s: %s", path.c_str(),
+                 strerror(errno));
+    return;
+  }
+  mapped = static_cast<const char *>(p);
+  mappedSize = st.st_size;
+
+  if (memcmp(mapped, CacheMagic, sizeof(CacheMagic)) ||
+      extract<uint32_t>(mapped + sizeof(CacheMagic)) != CacheVersion) {
+    klee_warning("discarding the query cache %s of another version",
+                 path.c_str());
+    return;
+  }
+  rewrite = false;
+
+  // An entry cut short by a run that did not finish its write is ignored
+  size_t offset = HeaderSize;
+  while (offset + EntryHeaderSize <= mappedSize) {
+    CacheKey key;
+    key.a = extract<uint64_t>(mapped + offset);
+    key.b = extract<uint64_t>(mapped + offset + sizeof(uint64_t));
+    uint32_t length =
+        extract<uint32_t>(mapped + offset + 2 * sizeof(uint64_t) + 1);
+    const char *data = mapped + offset + EntryHeaderSize;
+    if (offset + EntryHeaderSize + length > mappedSize)
+      break;
+    cache[key] = std::make_pair(data, length);
+    offset += EntryHeaderSize + length;
+  }
+  klee_message("Loaded %lu queries from the query cache %s\n",
+               (unsigned long)cache.size(), path.c_str());
+}
+
+void PersistentCachingSolver::save() {
+  if (path.empty() || (added.empty() && !rewrite))
+    return;
+
+  int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+  flags |= rewrite ? O_TRUNC : O_APPEND;
+  int fd = open(path.c_str(), flags, 0644);
+  if (fd < 0) {
+    klee_warning("unable to write the query cache %s: %s", path.c_str(),
+                 strerror(errno));
+    return;
+  }
+  std::string data;
+  if (rewrite) {
+    data.append(CacheMagic, sizeof(CacheMagic));
+    append(data, CacheVersion);
+  }
+  data += added;
+  // A single write, so that runs sharing the file append whole entries
+  const char *p = data.data();
+  size_t remaining = data.size();
+  while (remaining) {
+    ssize_t n = write(fd, p, remaining);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      klee_warning("unable to write the query cache %s: %s", path.c_str(),
+                   strerror(errno));
+      break;
+    }
+    p += n;
+    remaining -= n;
+  }
+  close(fd);
+}
+
+PersistentCachingSolver::~PersistentCachingSolver() {
+  save();
+  if (mapped)
+    munmap(const_cast<char *>(mapped), mappedSize);
+  for (std::vector<std::string *>::iterator it = payloads.begin(),
+                                            ie = payloads.end();
+       it != ie; ++it)
+    delete *it;
+  delete solver;
+}
+
+bool PersistentCachingSolver::computeKey(
+    const Query &query, EntryKind kind,
+    const std::vector<const Array *> *objects, CacheKey &key) {
+  QueryHasher hasher;
+  key.mix(kind);
+  key.mix(query.constraints.size());
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    key.mix(hasher.hash(*it));
+  key.mix(hasher.hash(query.expr));
+  if (objects) {
+    key.mix(objects->size());
+    for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                    ie = objects->end();
+         it != ie; ++it)
+      hasher.hashArray(key, *it);
+  }
+  return hasher.isSupported();
+}
+
+bool PersistentCachingSolver::lookup(const CacheKey &key, const char *&data,
+                                     uint32_t &length) {
+  std::map<CacheKey, std::pair<const char *, uint32_t> >::iterator it =
+      cache.find(key);
+  if (it == cache.end())
+    return false;
+  data = it->second.first;
+  length = it->second.second;
+  return true;
+}
+
+void PersistentCachingSolver::insert(const CacheKey &key, EntryKind kind,
+                                     const std::string &payload) {
+  // The file stops growing at its maximum size
+  size_t size = rewrite ? HeaderSize : mappedSize;
+  if (size + addedSize + EntryHeaderSize + payload.size() > maxSize)
+    return;
+  addedSize += EntryHeaderSize + payload.size();
+  if (!path.empty()) {
+    append(added, key.a);
+    append(added, key.b);
+    append(added, (uint8_t)kind);
+    append(added, (uint32_t)payload.size());
+    added += payload;
+  }
+
+  std::string *p = new std::string(payload);
+  payloads.push_back(p);
+  cache[key] = std::make_pair(p->data(), (uint32_t)p->size());
+}
+
+bool PersistentCachingSolver::encodeCore(
+    const Query &query, const std::vector<ref<Expr> > &unsatCore,
+    std::string &payload) {
+  // An empty core is also what solvers without cores give, and it would make
+  // the interpolants of a later run unsound
+  if (unsatCore.empty() && !query.constraints.empty())
+    return false;
+  ExprHashMap<uint32_t> positions;
+  uint32_t i = 0;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    positions.insert(std::make_pair(*it, i++));
+  append(payload, (uint32_t)unsatCore.size());
+  for (std::vector<ref<Expr> >::const_iterator it = unsatCore.begin(),
+                                               ie = unsatCore.end();
+       it != ie; ++it) {
+    ExprHashMap<uint32_t>::iterator pi = positions.find(*it);
+    if (pi == positions.end())
+      return false;
+    append(payload, pi->second);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::decodeCore(const Query &query, const char *data,
+                                         uint32_t length,
+                                         std::vector<ref<Expr> > &unsatCore) {
+  if (length < sizeof(uint32_t))
+    return false;
+  uint32_t n = extract<uint32_t>(data);
+  if (length != sizeof(uint32_t) * (n + 1))
+    return false;
+  std::vector<ref<Expr> > core;
+  for (uint32_t i = 0; i < n; ++i) {
+    uint32_t position = extract<uint32_t>(data + sizeof(uint32_t) * (i + 1));
+    if (position >= query.constraints.size())
+      return false;
+    core.push_back(*(query.constraints.begin() + position));
+  }
+  unsatCore.swap(core);
+  return true;
+}
+
+bool PersistentCachingSolver::computeValidity(
+    const Query &query, Solver::Validity &result,
+    std::vector<ref<Expr> > &unsatCore) {
+  CacheKey key;
+  if (!computeKey(query, ValidityEntry, 0, key))
+    return solver->impl->computeValidity(query, result, unsatCore);
+
+  const char *data;
+  uint32_t length;
+  if (lookup(key, data, length) && length >= 1 &&
+      decodeCore(query, data + 1, length - 1, unsatCore)) {
+    result = (Solver::Validity)((int)(unsigned char)data[0] - 1);
+    ++stats::queryPersistentCacheHits;
+    return true;
+  }
+
+  if (!solver->impl->computeValidity(query, result, unsatCore))
+    return false;
+  std::string payload(1, (char)(result + 1));
+  if (result == Solver::Unknown)
+    append(payload, (uint32_t)0);
+  else if (!encodeCore(query, unsatCore, payload))
+    return true;
+  insert(key, ValidityEntry, payload);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query, bool &isValid,
+                                           std::vector<ref<Expr> > &unsatCore) {
+  CacheKey key;
+  if (!computeKey(query, TruthEntry, 0, key))
+    return solver->impl->computeTruth(query, isValid, unsatCore);
+
+  const char *data;
+  uint32_t length;
+  if (lookup(key, data, length) && length >= 1 &&
+      decodeCore(query, data + 1, length - 1, unsatCore)) {
+    isValid = data[0];
+    ++stats::queryPersistentCacheHits;
+    return true;
+  }
+
+  if (!solver->impl->computeTruth(query, isValid, unsatCore))
+    return false;
+  std::string payload(1, (char)isValid);
+  if (isValid) {
+    if (!encodeCore(query, unsatCore, payload))
+      return true;
+  } else {
+    append(payload, (uint32_t)0);
+  }
+  insert(key, TruthEntry, payload);
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  CacheKey key;
+  if (query.expr->getWidth() > 64 ||
+      !computeKey(query, ValueEntry, 0, key))
+    return solver->impl->computeValue(query, result);
+
+  const char *data;
+  uint32_t length;
+  if (lookup(key, data, length) && length == sizeof(uint64_t)) {
+    result =
+        ConstantExpr::create(extract<uint64_t>(data), query.expr->getWidth());
+    ++stats::queryPersistentCacheHits;
+    return true;
+  }
+
+  if (!solver->impl->computeValue(query, result))
+    return false;
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(result)) {
+    std::string payload;
+    append(payload, ce->getZExtValue());
+    insert(key, ValueEntry, payload);
+  }
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
+  CacheKey key;
+  if (!computeKey(query, InitialValuesEntry, &objects, key))
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution, unsatCore);
+
+  const char *data;
+  uint32_t length;
+  if (lookup(key, data, length) && length >= 1) {
+    if (data[0]) {
+      size_t total = 0;
+      for (unsigned i = 0; i < objects.size(); ++i)
+        total += objects[i]->size;
+      if (length == 1 + total) {
+        const char *p = data + 1;
+        values.clear();
+        for (unsigned i = 0; i < objects.size(); ++i) {
+          values.push_back(std::vector<unsigned char>(p, p + objects[i]->size));
+          p += objects[i]->size;
+        }
+        hasSolution = true;
+        ++stats::queryPersistentCacheHits;
+        return true;
+      }
+    } else if (decodeCore(query, data + 1, length - 1, unsatCore)) {
+      hasSolution = false;
+      ++stats::queryPersistentCacheHits;
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution,
+                                          unsatCore))
+    return false;
+  std::string payload(1, (char)hasSolution);
+  if (hasSolution) {
+    for (unsigned i = 0; i < values.size(); ++i)
+      payload.append(values[i].begin(), values[i].end());
+  } else if (!encodeCore(query, unsatCore, payload)) {
+    return true;
+  }
+  insert(key, InitialValuesEntry, payload);
+  return true;
+}
+
+Solver *klee::createPersistentCachingSolver(Solver *s, const std::string &path,
+                                            uint64_t maxSize) {
+  return new Solver(new PersistentCachingSolver(s, path, maxSize));
+}
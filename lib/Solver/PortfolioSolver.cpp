@@ -0,0 +1,433 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <map>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+cl::opt<bool> PortfolioAdaptive(
+    "portfolio-adaptive",
+    cl::desc("Run a query only on the backend that won most of the earlier "
+             "races on queries of the same shape (default=off)"),
+    cl::init(false));
+
+cl::opt<unsigned> PortfolioLearnQueries(
+    "portfolio-learn-queries",
+    cl::desc("Number of races on queries of a shape before routing them to a "
+             "single backend with -portfolio-adaptive (default=32)"),
+    cl::init(32));
+
+cl::opt<unsigned> PortfolioRaceInterval(
+    "portfolio-race-interval",
+    cl::desc("With -portfolio-adaptive, still race one in this many routed "
+             "queries to follow changes in the winning backend (default=16)"),
+    cl::init(16));
+}
+
+// The result area of each backend. It holds the run status, whether there is
+// a solution, the values of the solution and the indices of the constraints
+// in the unsatisfiability core.
+static const unsigned slotSize = 1 << 20;
+
+namespace {
+struct SlotHeader {
+  int32_t status;
+  uint8_t hasSolution;
+  // Set when an element of the core is not a constraint of the query
+  uint8_t coreIncomplete;
+  uint32_t coreSize;
+};
+}
+
+class PortfolioSolverImpl : public SolverImpl {
+  std::vector<Solver *> solvers;
+  std::vector<std::string> names;
+  SolverRunStatus runStatusCode;
+  unsigned char *sharedMemory;
+
+  // The races won by each backend, in total and by query shape
+  std::vector<uint64_t> wins;
+  std::map<unsigned, std::vector<uint64_t> > shapeWins;
+  std::map<unsigned, uint64_t> shapeRouted;
+
+  static unsigned getShape(const Query &query, bool wantsValues);
+
+  int chooseBackend(unsigned shape);
+
+  bool solveWith(unsigned index, const Query &query,
+                 const std::vector<const Array *> &objects,
+                 std::vector<std::vector<unsigned char> > &values,
+                 bool &hasSolution, std::vector<ref<Expr> > &unsatCore);
+
+  void runChild(unsigned index, const Query &query,
+                const std::vector<const Array *> &objects, int fd);
+
+  bool race(const Query &query, const std::vector<const Array *> &objects,
+            std::vector<std::vector<unsigned char> > &values,
+            bool &hasSolution, std::vector<ref<Expr> > &unsatCore);
+
+public:
+  PortfolioSolverImpl(const std::vector<Solver *> &_solvers,
+                      const std::vector<std::string> &_names);
+  ~PortfolioSolverImpl();
+
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore);
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  char *getConstraintLog(const Query &query) {
+    return solvers[0]->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double timeout);
+  void clearUpdateNodeCache() {
+    for (unsigned i = 0; i < solvers.size(); ++i)
+      solvers[i]->impl->clearUpdateNodeCache();
+  }
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(
+    const std::vector<Solver *> &_solvers,
+    const std::vector<std::string> &_names)
+    : solvers(_solvers), names(_names),
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE), wins(_solvers.size(), 0) {
+  assert(!solvers.empty() && solvers.size() == names.size() &&
+         "invalid portfolio");
+  sharedMemory = (unsigned char *)mmap(0, solvers.size() * slotSize,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (sharedMemory == MAP_FAILED)
+    llvm::report_fatal_error("unable to allocate portfolio shared memory");
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  for (unsigned i = 0; i < solvers.size(); ++i) {
+    klee_message("Portfolio backend %s won %lu queries", names[i].c_str(),
+                 (unsigned long)wins[i]);
+    delete solvers[i];
+  }
+  munmap(sharedMemory, solvers.size() * slotSize);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(double timeout) {
+  for (unsigned i = 0; i < solvers.size(); ++i)
+    solvers[i]->impl->setCoreSolverTimeout(timeout);
+}
+
+/// getShape - Classify a query by the logarithm of its number of constraints,
+/// and by whether values are requested.
+unsigned PortfolioSolverImpl::getShape(const Query &query, bool wantsValues) {
+  unsigned bucket = 0;
+  for (size_t n = query.constraints.size(); n && bucket < 15; n >>= 1)
+    ++bucket;
+  return bucket * 2 + (wantsValues ? 1 : 0);
+}
+
+/// chooseBackend - Return the backend to run a query of the shape on alone,
+/// or -1 to race all of them.
+int PortfolioSolverImpl::chooseBackend(unsigned shape) {
+  if (!PortfolioAdaptive)
+    return -1;
+
+  std::map<unsigned, std::vector<uint64_t> >::iterator it =
+      shapeWins.find(shape);
+  if (it == shapeWins.end())
+    return -1;
+
+  uint64_t total = 0, best = 0;
+  unsigned bestIndex = 0;
+  for (unsigned i = 0; i < it->second.size(); ++i) {
+    total += it->second[i];
+    if (it->second[i] > best) {
+      best = it->second[i];
+      bestIndex = i;
+    }
+  }
+  // Route only when one backend wins almost all the races.
+  if (total < PortfolioLearnQueries || best * 10 < total * 9)
+    return -1;
+  if (PortfolioRaceInterval &&
+      ++shapeRouted[shape] % PortfolioRaceInterval == 0)
+    return -1;
+  return bestIndex;
+}
+
+bool PortfolioSolverImpl::solveWith(
+    unsigned index, const Query &query,
+    const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
+  bool success = solvers[index]->impl->computeInitialValues(
+      query, objects, values, hasSolution, unsatCore);
+  runStatusCode = solvers[index]->impl->getOperationStatusCode();
+  // As in race, a backend that computes no core gets the whole constraint
+  // set as its core
+  if (success && !hasSolution && unsatCore.empty())
+    unsatCore.insert(unsatCore.end(), query.constraints.begin(),
+                     query.constraints.end());
+  return success;
+}
+
+/// runChild - Solve the query with a backend in a child process, and write
+/// the result to the backend's slot. The index of the backend is written to
+/// the pipe when the result is complete.
+void PortfolioSolverImpl::runChild(unsigned index, const Query &query,
+                                   const std::vector<const Array *> &objects,
+                                   int fd) {
+  unsigned char *slot = sharedMemory + index * slotSize;
+  SlotHeader *header = (SlotHeader *)slot;
+  unsigned char *pos = slot + sizeof(SlotHeader);
+  unsigned char *end = slot + slotSize;
+
+  std::vector<std::vector<unsigned char> > values;
+  std::vector<ref<Expr> > unsatCore;
+  bool hasSolution = false;
+  bool success = solvers[index]->impl->computeInitialValues(
+      query, objects, values, hasSolution, unsatCore);
+
+  header->status = success ? solvers[index]->impl->getOperationStatusCode()
+                           : SOLVER_RUN_STATUS_FAILURE;
+  header->hasSolution = success && hasSolution;
+  header->coreIncomplete = 0;
+  header->coreSize = 0;
+
+  if (success && hasSolution) {
+    for (unsigned i = 0; i < values.size(); ++i) {
+      if (pos + values[i].size() > end)
+        _exit(1);
+      memcpy(pos, &values[i][0], values[i].size());
+      pos += values[i].size();
+    }
+  } else if (success) {
+    std::map<ref<Expr>, uint32_t> constraintIds;
+    uint32_t id = 0;
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it)
+      constraintIds.insert(std::make_pair(*it, id++));
+    for (std::vector<ref<Expr> >::iterator it = unsatCore.begin(),
+                                           ie = unsatCore.end();
+         it != ie; ++it) {
+      std::map<ref<Expr>, uint32_t>::iterator found = constraintIds.find(*it);
+      if (found == constraintIds.end() || pos + sizeof(uint32_t) > end) {
+        header->coreIncomplete = 1;
+        continue;
+      }
+      memcpy(pos, &found->second, sizeof(uint32_t));
+      pos += sizeof(uint32_t);
+      ++header->coreSize;
+    }
+  }
+
+  unsigned char done = index;
+  while (write(fd, &done, 1) < 0 && errno == EINTR)
+    ;
+  _exit(0);
+}
+
+/// race - Solve the query with all the backends in child processes, and take
+/// the result of the first one to succeed.
+bool PortfolioSolverImpl::race(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
+  unsigned sum = 0;
+  for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                  ie = objects.end();
+       it != ie; ++it)
+    sum += (*it)->size;
+  if (sum + sizeof(SlotHeader) >= slotSize)
+    llvm::report_fatal_error("not enough shared memory for counterexample");
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    klee_warning("pipe failed (for portfolio solver)");
+    runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  std::vector<pid_t> pids(solvers.size(), -1);
+  for (unsigned i = 0; i < solvers.size(); ++i) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      // Own process group, so that the processes a backend forks itself are
+      // killed with it.
+      setpgid(0, 0);
+      close(fds[0]);
+      runChild(i, query, objects, fds[1]);
+    }
+    if (pid == -1)
+      klee_warning("fork failed (for portfolio solver)");
+    pids[i] = pid;
+  }
+  close(fds[1]);
+
+  int winner = -1;
+  unsigned char done;
+  for (;;) {
+    ssize_t n = read(fds[0], &done, 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    // All the children have exited without a result.
+    if (n <= 0)
+      break;
+    SlotHeader *header = (SlotHeader *)(sharedMemory + done * slotSize);
+    if (header->status == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+        header->status == SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+      winner = done;
+      break;
+    }
+  }
+  close(fds[0]);
+
+  for (unsigned i = 0; i < pids.size(); ++i) {
+    if (pids[i] <= 0)
+      continue;
+    if ((int)i != winner) {
+      kill(-pids[i], SIGKILL);
+      kill(pids[i], SIGKILL);
+    }
+    int status;
+    while (waitpid(pids[i], &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+
+  if (winner < 0) {
+    runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+    return false;
+  }
+
+  unsigned char *slot = sharedMemory + winner * slotSize;
+  SlotHeader *header = (SlotHeader *)slot;
+  unsigned char *pos = slot + sizeof(SlotHeader);
+  runStatusCode = (SolverRunStatus)header->status;
+  hasSolution = header->hasSolution;
+
+  ++stats::queries;
+  if (hasSolution)
+    ++stats::queriesInvalid;
+  else
+    ++stats::queriesValid;
+  if (!objects.empty())
+    ++stats::queryCounterexamples;
+
+  ++wins[winner];
+  std::vector<uint64_t> &shape =
+      shapeWins[getShape(query, !objects.empty())];
+  shape.resize(solvers.size(), 0);
+  ++shape[winner];
+
+  if (hasSolution) {
+    values = std::vector<std::vector<unsigned char> >(objects.size());
+    for (unsigned i = 0; i < objects.size(); ++i) {
+      values[i].insert(values[i].begin(), pos, pos + objects[i]->size);
+      pos += objects[i]->size;
+    }
+    unsatCore.clear();
+    return true;
+  }
+
+  unsatCore.clear();
+  if (header->coreIncomplete) {
+    // The whole constraint set is a sound, if coarse, core.
+    unsatCore.insert(unsatCore.end(), query.constraints.begin(),
+                     query.constraints.end());
+    return true;
+  }
+  std::vector<ref<Expr> > constraints(query.constraints.begin(),
+                                      query.constraints.end());
+  for (unsigned i = 0; i < header->coreSize; ++i) {
+    uint32_t id;
+    memcpy(&id, pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    unsatCore.push_back(constraints[id]);
+  }
+  // A backend that computes no core leaves it empty, which would claim that
+  // no constraint is needed.
+  if (unsatCore.empty() && !query.constraints.empty())
+    unsatCore = constraints;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
+  if (solvers.size() == 1)
+    return solveWith(0, query, objects, values, hasSolution, unsatCore);
+
+  int backend = chooseBackend(getShape(query, !objects.empty()));
+  if (backend >= 0)
+    return solveWith(backend, query, objects, values, hasSolution, unsatCore);
+
+  return race(query, objects, values, hasSolution, unsatCore);
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid,
+                                       std::vector<ref<Expr> > &unsatCore) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+  if (!computeInitialValues(query, objects, values, hasSolution, unsatCore))
+    return false;
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  findSymbolicObjects(query.expr, objects);
+
+  std::vector<std::vector<unsigned char> > values;
+  std::vector<ref<Expr> > unsatCore;
+  bool hasSolution;
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution,
+                            unsatCore))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+  return true;
+}
+
+Solver *klee::createPortfolioSolver(const std::vector<Solver *> &solvers,
+                                    const std::vector<std::string> &names) {
+  return new Solver(new PortfolioSolverImpl(solvers, names));
+}
@@ -19,6 +19,10 @@
 #include "llvm/Support/FileSystem.h"
 #endif
 
+#include <deque>
+#include <pthread.h>
+#include <signal.h>
+
 using namespace klee::util;
 
 namespace {
@@ -31,6 +35,119 @@ llvm::cl::opt<bool> CreateCompressedQueryLog(
     "compress-query-log", llvm::cl::init(false),
     llvm::cl::desc("Compress query log files (default=off)"));
 #endif
+
+llvm::cl::opt<unsigned> QueryLogSample(
+    "query-log-sample", llvm::cl::init(1),
+    llvm::cl::desc("Log only one in every this many queries, the others "
+                   "being passed to the solver unformatted (default=1)"));
+
+/// The maximum number of formatted queries waiting to be written, beyond
+/// which the executor waits for the writer
+const unsigned MaxPendingQueries = 64;
+}
+
+/// Writes the formatted queries of a QueryLoggingSolver to its stream on a
+/// background thread, so that the solver does not wait for the writes and
+/// the compression of the log. The queries are written in order,
+/// synchronously if the thread cannot be started. The expressions are
+/// formatted by the solver's thread, as they are not safe to share among
+/// threads.
+class QueryLogWriter {
+  llvm::raw_ostream &os;
+  std::deque<std::string *> pending;
+  bool stopping, threaded;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  static void *run(void *self);
+
+public:
+  explicit QueryLogWriter(llvm::raw_ostream &_os);
+  ~QueryLogWriter();
+
+  /// Queue a formatted query for writing, taking its ownership.
+  void submit(std::string *text);
+
+  /// Wait until the queued queries are written and flushed.
+  void wait();
+};
+
+QueryLogWriter::QueryLogWriter(llvm::raw_ostream &_os)
+    : os(_os), stopping(false), threaded(false) {
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&changed, 0);
+  threaded = pthread_create(&thread, 0, run, this) == 0;
+}
+
+QueryLogWriter::~QueryLogWriter() {
+  if (threaded) {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, 0);
+  }
+  os.flush();
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+}
+
+void *QueryLogWriter::run(void *self) {
+  // The signals of the executor are left to the thread of the executor
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, 0);
+
+  QueryLogWriter &w = *static_cast<QueryLogWriter *>(self);
+  pthread_mutex_lock(&w.lock);
+  for (;;) {
+    while (w.pending.empty() && !w.stopping)
+      pthread_cond_wait(&w.changed, &w.lock);
+    if (w.pending.empty())
+      break;
+    std::string *text = w.pending.front();
+    bool last = w.pending.size() == 1;
+    pthread_mutex_unlock(&w.lock);
+    w.os << *text;
+    delete text;
+    // The log is flushed when the writer catches up, as the queries were
+    // flushed one by one when written synchronously
+    if (last)
+      w.os.flush();
+    // The query is only removed once written, so that an empty queue means
+    // that the stream is no longer being used.
+    pthread_mutex_lock(&w.lock);
+    w.pending.pop_front();
+    pthread_cond_broadcast(&w.changed);
+  }
+  pthread_mutex_unlock(&w.lock);
+  return 0;
+}
+
+void QueryLogWriter::submit(std::string *text) {
+  if (!threaded) {
+    os << *text;
+    os.flush();
+    delete text;
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  while (pending.size() >= MaxPendingQueries)
+    pthread_cond_wait(&changed, &lock);
+  pending.push_back(text);
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+void QueryLogWriter::wait() {
+  if (threaded) {
+    pthread_mutex_lock(&lock);
+    while (!pending.empty())
+      pthread_cond_wait(&changed, &lock);
+    pthread_mutex_unlock(&lock);
+  }
+  os.flush();
 }
 
 QueryLoggingSolver::QueryLoggingSolver(Solver *_solver, std::string path,
@@ -38,7 +155,8 @@ QueryLoggingSolver::QueryLoggingSolver(Solver *_solver, std::string path,
                                        int queryTimeToLog)
     : solver(_solver), os(0), BufferString(""), logBuffer(BufferString),
       queryCount(0), minQueryTimeToLog(queryTimeToLog), startTime(0.0f),
-      lastQueryTime(0.0f), queryCommentSign(commentSign) {
+      lastQueryTime(0.0f), queryCommentSign(commentSign), writer(0),
+      deferredQuery(0), deferredFalseQuery(0), deferredObjects(0) {
 #ifdef HAVE_ZLIB_H
   if (!CreateCompressedQueryLog) {
 #endif
@@ -57,18 +175,48 @@ QueryLoggingSolver::QueryLoggingSolver(Solver *_solver, std::string path,
   }
 #endif
   assert(0 != solver);
+  writer = new QueryLogWriter(*os);
 }
 
 QueryLoggingSolver::~QueryLoggingSolver() {
   delete solver;
+  delete writer;
   delete os;
 }
 
+bool QueryLoggingSolver::isSampled() {
+  if (QueryLogSample > 1 && queryCount % QueryLogSample) {
+    ++queryCount;
+    return false;
+  }
+  return true;
+}
+
+bool QueryLoggingSolver::isWritten() {
+  if ((0 == minQueryTimeToLog) ||
+      (static_cast<int>(lastQueryTime * 1000) > minQueryTimeToLog)) {
+    // we either do not limit logging queries or the query time
+    // is larger than threshold (in ms)
+
+    if ((minQueryTimeToLog >= 0) ||
+        (SOLVER_RUN_STATUS_TIMEOUT ==
+         (solver->impl->getOperationStatusCode()))) {
+      // we do additional check here to log only timeouts in case
+      // user specified negative value for minQueryTimeToLog param
+      return true;
+    }
+  }
+  return false;
+}
+
 void QueryLoggingSolver::flushBufferConditionally(bool writeToFile) {
   logBuffer.flush();
-  if (writeToFile) {
-    *os << logBuffer.str();
-    os->flush();
+  if (writeToFile && !BufferString.empty()) {
+    writer->submit(new std::string(BufferString));
+    // The partial queries are written before the solver is called, which
+    // may crash
+    if (DumpPartialQueryiesEarly)
+      writer->wait();
   }
   // prepare the buffer for reuse
   BufferString = "";
@@ -80,10 +228,25 @@ void QueryLoggingSolver::startQuery(const Query &query, const char *typeName,
   Statistic *S = theStatisticManager->getStatisticByName("Instructions");
   uint64_t instructions = S ? S->getValue() : 0;
 
-  logBuffer << queryCommentSign << " Query " << queryCount++ << " -- "
-            << "Type: " << typeName << ", "
-            << "Instructions: " << instructions << "\n";
+  std::string header;
+  llvm::raw_string_ostream headerStream(header);
+  headerStream << queryCommentSign << " Query " << queryCount++ << " -- "
+               << "Type: " << typeName << ", "
+               << "Instructions: " << instructions << "\n";
+  headerStream.flush();
+
+  // Only the queries slower than the threshold are written, so that the
+  // others need not be formatted
+  if (minQueryTimeToLog != 0 && !DumpPartialQueryiesEarly) {
+    deferredQuery = &query;
+    deferredFalseQuery = falseQuery;
+    deferredObjects = objects;
+    deferredHeader = header;
+    startTime = getWallTime();
+    return;
+  }
 
+  logBuffer << header;
   printQuery(query, falseQuery, objects);
 
   if (DumpPartialQueryiesEarly) {
@@ -94,6 +257,13 @@ void QueryLoggingSolver::startQuery(const Query &query, const char *typeName,
 
 void QueryLoggingSolver::finishQuery(bool success) {
   lastQueryTime = getWallTime() - startTime;
+  if (deferredQuery) {
+    if (isWritten()) {
+      logBuffer << deferredHeader;
+      printQuery(*deferredQuery, deferredFalseQuery, deferredObjects);
+    }
+    deferredQuery = 0;
+  }
   logBuffer << queryCommentSign << "   " << (success ? "OK" : "FAIL") << " -- "
             << "Elapsed: " << lastQueryTime << "\n";
 
@@ -105,27 +275,13 @@ void QueryLoggingSolver::finishQuery(bool success) {
 }
 
 void QueryLoggingSolver::flushBuffer() {
-  bool writeToFile = false;
-
-  if ((0 == minQueryTimeToLog) ||
-      (static_cast<int>(lastQueryTime * 1000) > minQueryTimeToLog)) {
-    // we either do not limit logging queries or the query time
-    // is larger than threshold (in ms)
-
-    if ((minQueryTimeToLog >= 0) ||
-        (SOLVER_RUN_STATUS_TIMEOUT ==
-         (solver->impl->getOperationStatusCode()))) {
-      // we do additional check here to log only timeouts in case
-      // user specified negative value for minQueryTimeToLog param
-      writeToFile = true;
-    }
-  }
-
-  flushBufferConditionally(writeToFile);
+  flushBufferConditionally(isWritten());
 }
 
 bool QueryLoggingSolver::computeTruth(const Query &query, bool &isValid,
                                       std::vector<ref<Expr> > &unsatCore) {
+  if (!isSampled())
+    return solver->impl->computeTruth(query, isValid, unsatCore);
   startQuery(query, "Truth");
 
   bool success = solver->impl->computeTruth(query, isValid, unsatCore);
@@ -146,6 +302,8 @@ bool QueryLoggingSolver::computeTruth(const Query &query, bool &isValid,
 bool QueryLoggingSolver::computeValidity(const Query &query,
                                          Solver::Validity &result,
                                          std::vector<ref<Expr> > &unsatCore) {
+  if (!isSampled())
+    return solver->impl->computeValidity(query, result, unsatCore);
   startQuery(query, "Validity");
 
   bool success = solver->impl->computeValidity(query, result, unsatCore);
@@ -163,6 +321,8 @@ bool QueryLoggingSolver::computeValidity(const Query &query,
 }
 
 bool QueryLoggingSolver::computeValue(const Query &query, ref<Expr> &result) {
+  if (!isSampled())
+    return solver->impl->computeValue(query, result);
   Query withFalse = query.withFalse();
   startQuery(query, "Value", &withFalse);
 
@@ -184,6 +344,9 @@ bool QueryLoggingSolver::computeInitialValues(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
     std::vector<ref<Expr> > &unsatCore) {
+  if (!isSampled())
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution, unsatCore);
   startQuery(query, "InitialValues", 0, &objects);
 
   bool success = solver->impl->computeInitialValues(query, objects, values,
@@ -17,6 +17,8 @@
 
 using namespace klee;
 
+class QueryLogWriter;
+
 /// This abstract class represents a solver that is capable of logging
 /// queries to a file.
 /// Derived classes might specialize this one by providing different formats
@@ -42,6 +44,23 @@ protected:
   const std::string queryCommentSign; // sign representing commented lines
                                       // in given a query format
 
+  /// The writer of the logged queries to the file, on a background thread
+  QueryLogWriter *writer;
+
+  /// The query whose printing is deferred until its time tells whether it
+  /// is written, when only the slow queries are, with its header
+  const Query *deferredQuery;
+  const Query *deferredFalseQuery;
+  const std::vector<const Array *> *deferredObjects;
+  std::string deferredHeader;
+
+  /// Whether the query is logged, one in every -query-log-sample queries,
+  /// counting the query
+  bool isSampled();
+
+  /// Whether the last query is to be written to the file, by its time
+  bool isWritten();
+
   virtual void startQuery(const Query &query, const char *typeName,
                           const Query *falseQuery = 0,
                           const std::vector<const Array *> *objects = 0);
@@ -0,0 +1,222 @@
+//===-- RangeSolver.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/util/Bits.h"
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+/// The values of an expression for which a comparison of it with a constant
+/// holds, as an unsigned interval.
+struct Bound {
+  ref<Expr> expr;
+  uint64_t min, max;
+};
+
+/// Return whether e, or its negation if negated is set, is an unsigned
+/// comparison of an expression of at most 64 bits with a constant, and set
+/// the values of the expression for which it holds.
+bool getBound(ref<Expr> e, bool negated, Bound &b) {
+  if (EqExpr *ee = dyn_cast<EqExpr>(e)) {
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(ee->left);
+    if (!ce || isa<ConstantExpr>(ee->right))
+      return false;
+    if (ce->getWidth() == Expr::Bool && ce->isFalse())
+      return getBound(ee->right, !negated, b);
+    if (negated || ce->getWidth() > 64)
+      return false;
+    b.expr = ee->right;
+    b.min = b.max = ce->getZExtValue();
+    return true;
+  }
+
+  bool strict;
+  if (isa<UltExpr>(e))
+    strict = true;
+  else if (isa<UleExpr>(e))
+    strict = false;
+  else
+    return false;
+
+  ref<Expr> left = e->getKid(0), right = e->getKid(1);
+  // !(l < r) is r <= l, and !(l <= r) is r < l.
+  if (negated) {
+    std::swap(left, right);
+    strict = !strict;
+  }
+
+  Expr::Width width = left->getWidth();
+  if (width > 64)
+    return false;
+  uint64_t maxValue = bits64::maxValueOfNBits(width);
+
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(left)) {
+    uint64_t k = ce->getZExtValue();
+    if (isa<ConstantExpr>(right) || (strict && k == maxValue))
+      return false;
+    b.expr = right;
+    b.min = strict ? k + 1 : k;
+    b.max = maxValue;
+    return true;
+  }
+
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(right)) {
+    uint64_t k = ce->getZExtValue();
+    if (strict && k == 0)
+      return false;
+    b.expr = left;
+    b.min = 0;
+    b.max = strict ? k - 1 : k;
+    return true;
+  }
+
+  return false;
+}
+
+/// A solver stage deciding the comparisons of an expression with a constant
+/// from the comparisons of the same expression with constants in the
+/// constraints, without hashing the query or calling the solver. The
+/// unsatisfiability core of a decided query is the constraints giving the
+/// bounds it depends on.
+class RangeSolver : public SolverImpl {
+  Solver *solver;
+
+  enum Result {
+    Unknown,
+    /// The query holds in all the values the constraints allow
+    Valid,
+    /// The query holds in none of the values the constraints allow
+    Unsatisfiable
+  };
+
+  Result decide(const Query &query, std::vector<ref<Expr> > &unsatCore);
+
+public:
+  RangeSolver(Solver *_solver) : solver(_solver) {}
+  ~RangeSolver() { delete solver; }
+
+  bool computeValidity(const Query &, Solver::Validity &result,
+                       std::vector<ref<Expr> > &unsatCore);
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore) {
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution, unsatCore);
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+}
+
+RangeSolver::Result RangeSolver::decide(const Query &query,
+                                        std::vector<ref<Expr> > &unsatCore) {
+  Bound q;
+  if (!getBound(query.expr, false, q))
+    return Unknown;
+
+  // Intersect the bounds of the expression in the constraints, remembering
+  // the constraints giving the tightest ones.
+  uint64_t min = 0, max = bits64::maxValueOfNBits(q.expr->getWidth());
+  ref<Expr> minReason, maxReason;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it) {
+    Bound b;
+    if (!getBound(*it, false, b) || b.expr != q.expr)
+      continue;
+    if (b.min > min) {
+      min = b.min;
+      minReason = *it;
+    }
+    if (b.max < max) {
+      max = b.max;
+      maxReason = *it;
+    }
+  }
+  if (minReason.isNull() && maxReason.isNull())
+    return Unknown;
+
+  unsatCore.clear();
+  if (q.min <= min && max <= q.max) {
+    if (q.min > 0)
+      unsatCore.push_back(minReason);
+    if (q.max < bits64::maxValueOfNBits(q.expr->getWidth()))
+      unsatCore.push_back(maxReason);
+    return Valid;
+  }
+  if (max < q.min) {
+    unsatCore.push_back(maxReason);
+    return Unsatisfiable;
+  }
+  if (min > q.max) {
+    unsatCore.push_back(minReason);
+    return Unsatisfiable;
+  }
+  return Unknown;
+}
+
+bool RangeSolver::computeValidity(const Query &query, Solver::Validity &result,
+                                  std::vector<ref<Expr> > &unsatCore) {
+  switch (decide(query, unsatCore)) {
+  case Valid:
+    ++stats::queryRangeHits;
+    result = Solver::True;
+    return true;
+  case Unsatisfiable:
+    ++stats::queryRangeHits;
+    result = Solver::False;
+    return true;
+  default:
+    return solver->impl->computeValidity(query, result, unsatCore);
+  }
+}
+
+bool RangeSolver::computeTruth(const Query &query, bool &isValid,
+                               std::vector<ref<Expr> > &unsatCore) {
+  switch (decide(query, unsatCore)) {
+  case Valid:
+    ++stats::queryRangeHits;
+    isValid = true;
+    return true;
+  case Unsatisfiable:
+    // The constraints are satisfiable, so the query does not hold in all
+    // their solutions, and there is no unsatisfiability core.
+    ++stats::queryRangeHits;
+    unsatCore.clear();
+    isValid = false;
+    return true;
+  default:
+    return solver->impl->computeTruth(query, isValid, unsatCore);
+  }
+}
+
+Solver *klee::createRangeSolver(Solver *s) {
+  return new Solver(new RangeSolver(s));
+}
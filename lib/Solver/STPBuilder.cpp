@@ -10,6 +10,7 @@
 #ifdef ENABLE_STP
 #include "STPBuilder.h"
 
+#include "klee/CommandLine.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
 #include "klee/util/Bits.h"
@@ -62,14 +63,17 @@ STPArrayExprHash::~STPArrayExprHash() {
   }
 
 
+  clearUpdateNodes();
+}
+
+void STPArrayExprHash::clearUpdateNodes() {
   for (UpdateNodeHashConstIter it = _update_node_hash.begin();
       it != _update_node_hash.end(); ++it) {
     ::VCExpr un_expr = it->second;
-    if (un_expr) {
+    if (un_expr)
       ::vc_DeleteExpr(un_expr);
-      un_expr = 0;
-    }
   }
+  _update_node_hash.clear();
 }
 
 /***/
@@ -466,30 +470,106 @@ ExprHandle STPBuilder::constructSDivByConstant(ExprHandle expr_n, unsigned width
 }
 
 ExprHandle STPBuilder::getInitialRead(const Array *root, unsigned index) {
+  if (isSmallArray(root))
+    return getSmallArrayByte(root, index);
   return vc_readExpr(vc, getInitialArray(root), bvConst32(32, index));
 }
 
+bool STPBuilder::isSmallArray(const Array *root) {
+  std::map<const Array *, unsigned>::iterator it = smallArrays.find(root);
+  if (it != smallArrays.end())
+    return it->second;
+  bool small = root->size && root->size <= SmallArraySize;
+  unsigned id = 0;
+  if (small)
+    id = smallArrays.size() + 1;
+  smallArrays[root] = id;
+  return small;
+}
+
+ExprHandle STPBuilder::getSmallArrayByte(const Array *root, unsigned index) {
+  if (root->isConstantArray() && index < root->size)
+    return construct(root->constantValues[index], 0);
+
+  std::pair<const Array *, unsigned> key(root, index);
+  std::map<std::pair<const Array *, unsigned>, ExprHandle>::iterator it =
+      smallArrayBytes.find(key);
+  if (it != smallArrayBytes.end())
+    return it->second;
+
+  // The byte past the end stands for the unconstrained reads out of bounds
+  // of the array theory
+  std::string unique_name = root->name.substr(0, 24) + "!" +
+                            llvm::utostr(smallArrays[root]) + "!" +
+                            llvm::utostr(index);
+  ExprHandle byte = buildVar(unique_name.c_str(), root->getRange());
+  smallArrayBytes.insert(std::make_pair(key, byte));
+  return byte;
+}
+
+ExprHandle STPBuilder::readSmallArray(const Array *root, const UpdateNode *un,
+                                      ref<Expr> index) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(index)) {
+    uint64_t offset = CE->getZExtValue();
+    ExprHandle offsetExpr = bvConst64(root->getDomain(), offset);
+    // Walk the updates newest first, until one at the offset
+    std::vector<const UpdateNode *> guarded;
+    ExprHandle res;
+    for (; un; un = un->next) {
+      if (ConstantExpr *UCE = dyn_cast<ConstantExpr>(un->index)) {
+        if (UCE->getZExtValue() == offset) {
+          res = construct(un->value, 0);
+          break;
+        }
+        continue;
+      }
+      guarded.push_back(un);
+    }
+    if (!un)
+      res = getSmallArrayByte(root, offset < root->size ? offset : root->size);
+    for (std::vector<const UpdateNode *>::reverse_iterator
+             it = guarded.rbegin(),
+             ie = guarded.rend();
+         it != ie; ++it)
+      res = vc_iteExpr(vc, eqExpr(construct((*it)->index, 0), offsetExpr),
+                       construct((*it)->value, 0), res);
+    return res;
+  }
+
+  ExprHandle indexExpr = construct(index, 0);
+  ExprHandle res = readSmallArray(
+      root, un, ConstantExpr::alloc(root->size, root->getDomain()));
+  for (unsigned i = root->size; i-- > 0;)
+    res = vc_iteExpr(vc, eqExpr(indexExpr, bvConst32(root->getDomain(), i)),
+                     readSmallArray(root, un,
+                                    ConstantExpr::alloc(i, root->getDomain())),
+                     res);
+  return res;
+}
+
 ::VCExpr STPBuilder::getArrayForUpdate(const Array *root, 
                                        const UpdateNode *un) {
-  if (!un) {
-      return(getInitialArray(root));
+  // Walk down to the newest update already translated, then translate the
+  // updates above it oldest first, so that deep update lists do not recurse.
+  std::vector<const UpdateNode *> pending;
+  ::VCExpr un_expr;
+  for (; un; un = un->next) {
+    if (_arr_hash.lookupUpdateNodeExpr(un, un_expr))
+      break;
+    pending.push_back(un);
   }
-  else {
-      // FIXME: This really needs to be non-recursive.
-      ::VCExpr un_expr;
-      bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
-      
-      if (!hashed) {
-	un_expr = vc_writeExpr(vc,
-                               getArrayForUpdate(root, un->next),
-                               construct(un->index, 0),
-                               construct(un->value, 0));
-	
-	_arr_hash.hashUpdateNodeExpr(un, un_expr);
-      }
-      
-      return(un_expr);
+  if (!un)
+    un_expr = getInitialArray(root);
+
+  for (std::vector<const UpdateNode *>::reverse_iterator it = pending.rbegin(),
+         ie = pending.rend(); it != ie; ++it) {
+    un_expr = vc_writeExpr(vc, un_expr,
+                           construct((*it)->index, 0),
+                           construct((*it)->value, 0));
+    _arr_hash.hashUpdateNodeExpr(*it, un_expr);
   }
+
+  return(un_expr);
 }
 
 /** if *width_out!=1 then result is a bitvector,
@@ -560,6 +640,8 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out) {
     ReadExpr *re = cast<ReadExpr>(e);
     assert(re && re->updates.root);
     *width_out = re->updates.root->getRange();
+    if (isSmallArray(re->updates.root))
+      return readSmallArray(re->updates.root, re->updates.head, re->index);
     return vc_readExpr(vc,
                        getArrayForUpdate(re->updates.root, re->updates.head),
                        construct(re->index, 0));
@@ -14,6 +14,7 @@
 #include "klee/util/ArrayExprHash.h"
 #include "klee/Config/config.h"
 
+#include <map>
 #include <vector>
 
 #define Expr VCExpr
@@ -60,6 +61,8 @@ namespace klee {
   public:
     STPArrayExprHash() {};
     virtual ~STPArrayExprHash();
+
+    void clearUpdateNodes();
   };
 
 class STPBuilder {
@@ -105,6 +108,16 @@ private:
   ::VCExpr getInitialArray(const Array *os);
   ::VCExpr getArrayForUpdate(const Array *root, const UpdateNode *un);
 
+  /// The arrays of at most -small-array-size bytes are encoded as a
+  /// bitvector variable per byte, numbered from 1 for the names of their
+  /// bytes, 0 when not small
+  std::map<const Array *, unsigned> smallArrays;
+  std::map<std::pair<const Array *, unsigned>, ExprHandle> smallArrayBytes;
+  bool isSmallArray(const Array *root);
+  ExprHandle getSmallArrayByte(const Array *root, unsigned index);
+  ExprHandle readSmallArray(const Array *root, const UpdateNode *un,
+                            ref<Expr> index);
+
   ExprHandle constructActual(ref<Expr> e, int *width_out);
   ExprHandle construct(ref<Expr> e, int *width_out);
   
@@ -115,6 +128,9 @@ public:
   STPBuilder(::VC _vc, bool _optimizeDivides=true);
   ~STPBuilder();
 
+  /// Forget the update lists, cached by the address of their nodes
+  void clearUpdateNodeCache() { _arr_hash.clearUpdateNodes(); }
+
   ExprHandle getTrue();
   ExprHandle getFalse();
   ExprHandle getInitialRead(const Array *os, unsigned index);
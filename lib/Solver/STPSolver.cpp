@@ -74,6 +74,7 @@ public:
 
   char *getConstraintLog(const Query &);
   void setCoreSolverTimeout(double _timeout) { timeout = _timeout; }
+  void clearUpdateNodeCache() { builder->clearUpdateNodeCache(); }
 
   bool computeTruth(const Query &, bool &isValid,
                     std::vector<ref<Expr> > &unsatCore);
@@ -374,6 +375,13 @@ bool STPSolverImpl::computeInitialValues(
 
   vc_pop(vc);
 
+  // STP reports no core, which is then computed by solving again
+  if (success && !hasSolution) {
+    SolverRunStatus status = runStatusCode;
+    computeUnsatCoreBySolving(query, unsatCore);
+    runStatusCode = status;
+  }
+
   return success;
 }
 
@@ -0,0 +1,411 @@
+//===-- SampledValidatingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Config/config.h"
+#include "klee/Solver.h"
+
+#include "expr/Parser.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Constraints.h"
+#include "klee/ExprBuilder.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/ExprPPrinter.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <map>
+
+using namespace klee;
+using namespace klee::expr;
+using namespace llvm;
+
+namespace {
+enum SampleKind { TruthSample, ValiditySample };
+
+struct SampleHeader {
+  uint32_t id;
+  uint8_t kind;
+  // Set when the query is a subsumption check
+  uint8_t subsumptionCheck;
+  double timeout;
+  uint32_t length;
+};
+
+struct VerdictHeader {
+  uint32_t id;
+  // Clear when the reference solver could not parse or decide the query
+  uint8_t decided;
+  int8_t answer;
+};
+
+bool writeAll(int fd, const void *buffer, size_t n) {
+  const char *pos = (const char *)buffer;
+  while (n) {
+    ssize_t r = send(fd, pos, n, MSG_NOSIGNAL);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    pos += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool readAll(int fd, void *buffer, size_t n) {
+  char *pos = (char *)buffer;
+  while (n) {
+    ssize_t r = read(fd, pos, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    pos += r;
+    n -= r;
+  }
+  return true;
+}
+
+const char *answerName(uint8_t kind, int answer) {
+  if (kind == TruthSample)
+    return answer ? "valid" : "invalid";
+  switch (answer) {
+  case Solver::True:
+    return "true";
+  case Solver::False:
+    return "false";
+  default:
+    return "unknown";
+  }
+}
+}
+
+/// A solver checking a fraction of the answers of another one against a
+/// reference solver, in a validator process forked when the solver is
+/// created. A sampled query is sent to the validator in the KQuery format
+/// with its answer, and the verdicts are read back when available, so that
+/// the exploration never waits for the reference solver. A sample is skipped
+/// when the unanswered samples would fill the socket buffer, as sending it
+/// could then block.
+class SampledValidatingSolver : public SolverImpl {
+  Solver *solver, *oracle;
+  double fraction;
+  double timeout;
+
+  /// The accumulated fraction, a query being sampled each time it reaches one
+  double credit;
+
+  /// The socket to the validator, or -1 if it is gone, and its process
+  int validator;
+  pid_t validatorPid;
+
+  /// The number of bytes the unanswered samples may take in the socket
+  size_t capacity;
+
+  /// The unanswered samples, by id, with their answers
+  struct Sample {
+    uint8_t kind;
+    int8_t answer;
+    std::string text;
+  };
+  std::map<uint32_t, Sample> pending;
+  size_t pendingBytes;
+  uint32_t nextId;
+
+  uint64_t checkedCount;
+  uint64_t mismatchCount;
+  uint64_t undecidedCount;
+  uint64_t skippedCount;
+
+  void runValidator(int fd);
+
+  /// Read the verdicts available, waiting for them if wait is set
+  void readVerdicts(bool wait);
+
+  void sample(const Query &query, SampleKind kind, int answer);
+
+  void stopValidator();
+
+public:
+  SampledValidatingSolver(Solver *_solver, Solver *_oracle, double _fraction);
+  ~SampledValidatingSolver();
+
+  bool computeValidity(const Query &, Solver::Validity &result,
+                       std::vector<ref<Expr> > &unsatCore);
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore);
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double _timeout) {
+    timeout = _timeout;
+    solver->impl->setCoreSolverTimeout(_timeout);
+  }
+};
+
+SampledValidatingSolver::SampledValidatingSolver(Solver *_solver,
+                                                 Solver *_oracle,
+                                                 double _fraction)
+    : solver(_solver), oracle(_oracle), fraction(_fraction), timeout(0.0),
+      credit(0.0), validator(-1), validatorPid(-1), capacity(0),
+      pendingBytes(0), nextId(0), checkedCount(0), mismatchCount(0),
+      undecidedCount(0), skippedCount(0) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    llvm::report_fatal_error("unable to create the solver validator socket");
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1)
+    llvm::report_fatal_error("unable to fork the solver validator");
+  if (pid == 0) {
+    close(fds[0]);
+    runValidator(fds[1]);
+  }
+  close(fds[1]);
+  validator = fds[0];
+  validatorPid = pid;
+
+  // Half of the send buffer, leaving room for the headers
+  int size = 4 << 20;
+  socklen_t length = sizeof(size);
+  setsockopt(validator, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  if (getsockopt(validator, SOL_SOCKET, SO_SNDBUF, &size, &length) < 0)
+    size = 64 << 10;
+  capacity = size / 2;
+}
+
+SampledValidatingSolver::~SampledValidatingSolver() {
+  readVerdicts(true);
+  stopValidator();
+  if (checkedCount || skippedCount)
+    klee_message("sampled solver validation: %lu queries checked, %lu "
+                 "mismatches, %lu undecided, %lu skipped",
+                 checkedCount, mismatchCount, undecidedCount, skippedCount);
+  delete solver;
+  delete oracle;
+}
+
+/// runValidator - Decide the samples read from the socket with the reference
+/// solver until it is closed.
+void SampledValidatingSolver::runValidator(int fd) {
+#ifdef __linux__
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+  ExprBuilder *builder = createDefaultExprBuilder();
+
+  SampleHeader request;
+  std::string text;
+  while (readAll(fd, &request, sizeof(request))) {
+    text.resize(request.length);
+    if (request.length && !readAll(fd, &text[0], request.length))
+      break;
+
+    oracle->impl->setCoreSolverTimeout(request.timeout);
+#ifdef ENABLE_Z3
+    Z3Solver::subsumptionCheck = request.subsumptionCheck;
+#endif
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    MemoryBuffer *MB = MemoryBuffer::getMemBuffer(text, "query", false);
+    Parser *P = Parser::Create("query", MB, builder, false);
+#else
+    std::unique_ptr<MemoryBuffer> MB =
+        MemoryBuffer::getMemBuffer(text, "query", false);
+    Parser *P = Parser::Create("query", MB.get(), builder, false);
+#endif
+    Decl *D = P->ParseTopLevelDecl();
+    QueryCommand *QC = D ? dyn_cast<QueryCommand>(D) : 0;
+
+    VerdictHeader reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.id = request.id;
+    if (QC && !P->GetNumErrors()) {
+      ConstraintManager constraints(QC->Constraints);
+      Query query(constraints, QC->Query);
+      std::vector<ref<Expr> > unsatCore;
+      if (request.kind == TruthSample) {
+        bool isValid;
+        reply.decided = oracle->impl->computeTruth(query, isValid, unsatCore);
+        reply.answer = isValid;
+      } else {
+        Solver::Validity validity;
+        reply.decided =
+            oracle->impl->computeValidity(query, validity, unsatCore);
+        reply.answer = validity;
+      }
+    }
+    delete D;
+    delete P;
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    delete MB;
+#endif
+
+    if (!writeAll(fd, &reply, sizeof(reply)))
+      break;
+  }
+  _exit(0);
+}
+
+void SampledValidatingSolver::stopValidator() {
+  if (validator < 0)
+    return;
+  kill(validatorPid, SIGKILL);
+  close(validator);
+  while (waitpid(validatorPid, 0, 0) < 0 && errno == EINTR)
+    ;
+  validator = -1;
+  pending.clear();
+  pendingBytes = 0;
+}
+
+void SampledValidatingSolver::readVerdicts(bool wait) {
+  while (validator >= 0 && !pending.empty()) {
+    // At the end of the run, the reference solver is given the time of a
+    // query to answer each remaining sample, or ten seconds without a
+    // timeout, so that a query it cannot decide does not hang the exit
+    struct pollfd pfd;
+    pfd.fd = validator;
+    pfd.events = POLLIN;
+    int milliseconds =
+        wait ? (timeout ? (int)(timeout * 1000) + 1000 : 10000) : 0;
+    int ready;
+    while ((ready = poll(&pfd, 1, milliseconds)) < 0 && errno == EINTR)
+      ;
+    if (ready == 0)
+      return;
+
+    VerdictHeader reply;
+    std::map<uint32_t, Sample>::iterator it;
+    if (ready < 0 || !readAll(validator, &reply, sizeof(reply)) ||
+        (it = pending.find(reply.id)) == pending.end()) {
+      klee_warning("solver validator exited unexpectedly");
+      stopValidator();
+      return;
+    }
+
+    const Sample &s = it->second;
+    if (!reply.decided) {
+      ++undecidedCount;
+    } else {
+      ++checkedCount;
+      if (reply.answer != s.answer) {
+        ++mismatchCount;
+        klee_warning("solver answered %s where the reference solver answered "
+                     "%s to the query:\n%s",
+                     answerName(s.kind, s.answer),
+                     answerName(s.kind, reply.answer), s.text.c_str());
+      }
+    }
+    pendingBytes -= s.text.size() + sizeof(SampleHeader);
+    pending.erase(it);
+  }
+}
+
+void SampledValidatingSolver::sample(const Query &query, SampleKind kind,
+                                     int answer) {
+  readVerdicts(false);
+  credit += fraction;
+  if (credit < 1.0 || validator < 0)
+    return;
+  credit -= 1.0;
+
+  Sample &s = pending[nextId];
+  s.kind = kind;
+  s.answer = answer;
+  llvm::raw_string_ostream os(s.text);
+  ExprPPrinter::printQuery(os, query.constraints, query.expr);
+  os.flush();
+
+  size_t size = s.text.size() + sizeof(SampleHeader);
+  if (pendingBytes + size > capacity) {
+    ++skippedCount;
+    pending.erase(nextId);
+    return;
+  }
+
+  SampleHeader request;
+  memset(&request, 0, sizeof(request));
+  request.id = nextId++;
+  request.kind = kind;
+#ifdef ENABLE_Z3
+  request.subsumptionCheck = Z3Solver::subsumptionCheck;
+#endif
+  request.timeout = timeout;
+  request.length = s.text.size();
+  pendingBytes += size;
+  if (!writeAll(validator, &request, sizeof(request)) ||
+      !writeAll(validator, s.text.data(), s.text.size())) {
+    klee_warning("solver validator exited unexpectedly");
+    stopValidator();
+  }
+}
+
+bool SampledValidatingSolver::computeTruth(const Query &query, bool &isValid,
+                                           std::vector<ref<Expr> > &unsatCore) {
+  if (!solver->impl->computeTruth(query, isValid, unsatCore))
+    return false;
+  sample(query, TruthSample, isValid);
+  return true;
+}
+
+bool SampledValidatingSolver::computeValidity(
+    const Query &query, Solver::Validity &result,
+    std::vector<ref<Expr> > &unsatCore) {
+  if (!solver->impl->computeValidity(query, result, unsatCore))
+    return false;
+  sample(query, ValiditySample, result);
+  return true;
+}
+
+bool SampledValidatingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution,
+                                          unsatCore))
+    return false;
+  // Only the satisfiability is checked, the values not being unique
+  sample(query, TruthSample, !hasSolution);
+  return true;
+}
+
+Solver *klee::createSampledValidatingSolver(Solver *s, Solver *oracle,
+                                            double fraction) {
+  return new Solver(new SampledValidatingSolver(s, oracle, fraction));
+}
@@ -7,11 +7,35 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "klee/CommandLine.h"
+#include "klee/Constraints.h"
+#include "klee/Internal/System/Time.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/TimerStatIncrementer.h"
+
+#include "llvm/Support/CommandLine.h"
 
 using namespace klee;
 
+namespace {
+llvm::cl::opt<bool> MinimizeSolvedUnsatCore(
+    "solver-minimize-unsat-core",
+    llvm::cl::desc("Shrink the unsatisfiability cores of the solvers other "
+                   "than Z3 by solving the query again without each of its "
+                   "constraints, within the time budget of "
+                   "-solver-minimize-unsat-core-time (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<double> MinimizeSolvedUnsatCoreTime(
+    "solver-minimize-unsat-core-time",
+    llvm::cl::desc("Time budget in seconds of the minimization of an "
+                   "unsatisfiability core by solving, after which the "
+                   "smallest core found is kept (default=0.1)."),
+    llvm::cl::init(0.1));
+}
+
 SolverImpl::~SolverImpl() {}
 
 bool SolverImpl::computeValidity(const Query &query, Solver::Validity &result,
@@ -29,6 +53,40 @@ bool SolverImpl::computeValidity(const Query &query, Solver::Validity &result,
   return true;
 }
 
+void SolverImpl::computeUnsatCoreBySolving(const Query &query,
+                                           std::vector<ref<Expr> > &unsatCore) {
+  // The cores are only used by the interpolation
+  if (!INTERPOLATION_ENABLED || computingUnsatCore)
+    return;
+
+  std::vector<ref<Expr> > core(query.constraints.begin(),
+                               query.constraints.end());
+  if (MinimizeSolvedUnsatCore && !core.empty()) {
+    TimerStatIncrementer t(stats::unsatCoreMinimizationTime);
+    ++stats::unsatCoreMinimizations;
+    stats::unsatCoreSize += core.size();
+    double deadline = util::getWallTime() + MinimizeSolvedUnsatCoreTime;
+
+    computingUnsatCore = true;
+    for (unsigned i = 0; i < core.size() && util::getWallTime() < deadline;) {
+      std::vector<ref<Expr> > candidate(core);
+      candidate.erase(candidate.begin() + i);
+      ConstraintManager constraints(candidate);
+      std::vector<ref<Expr> > ignored;
+      bool isValid;
+      // A failure keeps the constraint
+      if (computeTruth(Query(constraints, query.expr), isValid, ignored) &&
+          isValid)
+        core.swap(candidate);
+      else
+        ++i;
+    }
+    computingUnsatCore = false;
+    stats::minimalUnsatCoreSize += core.size();
+  }
+  unsatCore.insert(unsatCore.end(), core.begin(), core.end());
+}
+
 const char *SolverImpl::getOperationStatusString(SolverRunStatus statusCode) {
   switch (statusCode) {
   case SOLVER_RUN_STATUS_SUCCESS_SOLVABLE:
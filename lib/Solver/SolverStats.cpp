@@ -17,8 +17,16 @@ Statistic stats::queriesInvalid("QueriesInvalid", "Qiv");
 Statistic stats::queriesValid("QueriesValid", "Qv");
 Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
+Statistic stats::queryRangeHits("QueryRangeHits", "QRhits");
+Statistic stats::queryFastCexHits("QueryFastCexHits", "QFChits");
+Statistic stats::queryIndependentReductions("QueryIndependentReductions",
+                                            "QIreds");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::queryUnsatCoreCacheHits("QueryUnsatCoreCacheHits",
+                                         "QUChits");
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits",
+                                          "QPChits");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
@@ -27,6 +35,12 @@ Statistic stats::subsumptionQueryTime("SubsumptionQueryTime", "SQtime");
 Statistic stats::subsumptionQueryCount("SubsumptionQueryCount", "SCcount");
 Statistic stats::subsumptionQueryFailureCount("SubsumptionQueryFailureCount",
                                               "SFcount");
+Statistic stats::unsatCoreMinimizations("UnsatCoreMinimizations", "UCM");
+Statistic stats::unsatCoreMinimizationTime("UnsatCoreMinimizationTime",
+                                           "UCMtime");
+Statistic stats::unsatCoreSize("UnsatCoreSize", "UCsize");
+Statistic stats::minimalUnsatCoreSize("MinimalUnsatCoreSize", "UCMsize");
+Statistic stats::z3ContextRecycles("Z3ContextRecycles", "Z3R");
 
 #ifdef DEBUG
 Statistic stats::arrayHashTime("ArrayHashTime", "AHtime");
@@ -0,0 +1,201 @@
+//===-- UnsatCoreCachingSolver.cpp ----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/util/ExprHashMap.h"
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+/// The maximum number of cores kept for an expression, the older ones being
+/// dropped first
+const unsigned MaxCoresPerExpr = 8;
+
+/// The maximum number of cores in the cache, which is cleared when full
+const unsigned MaxCores = 65536;
+
+/// An unsatisfiability core of the negation of an expression, with the
+/// fingerprint of its constraints
+struct CachedCore {
+  uint64_t fingerprint;
+  std::vector<ref<Expr> > core;
+};
+
+/// The bit of a constraint in the fingerprint of a set of constraints. The
+/// fingerprint of a subset of the constraints of a query is included in the
+/// fingerprint of the query.
+inline uint64_t getFingerprintBit(const ref<Expr> &e) {
+  return UINT64_C(1) << (e->hash() % 64);
+}
+
+/// A solver stage answering the valid queries from the unsatisfiability
+/// cores of earlier valid queries of the same expression. A core is a subset
+/// of the constraints of its query that makes the negation of the expression
+/// unsatisfiable, so any query of the expression with all the constraints of
+/// the core is valid, with the same core. Sibling paths reaching the same
+/// infeasibility then get the core of the first without calling the solver,
+/// unlike the exact constraint sets of CachingSolver.
+class UnsatCoreCachingSolver : public SolverImpl {
+  Solver *solver;
+
+  /// The cores of the valid queries, by their expression, from the oldest
+  ExprHashMap<std::vector<CachedCore> > cores;
+
+  unsigned coreCount;
+
+  bool lookup(const ConstraintManager &constraints, ref<Expr> expr,
+              std::vector<ref<Expr> > &unsatCore);
+
+  void insert(ref<Expr> expr, const std::vector<ref<Expr> > &unsatCore);
+
+public:
+  UnsatCoreCachingSolver(Solver *_solver) : solver(_solver), coreCount(0) {}
+  ~UnsatCoreCachingSolver() { delete solver; }
+
+  bool computeValidity(const Query &, Solver::Validity &result,
+                       std::vector<ref<Expr> > &unsatCore);
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore) {
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution, unsatCore);
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double timeout) {
+    solver->impl->setCoreSolverTimeout(timeout);
+  }
+};
+}
+
+bool UnsatCoreCachingSolver::lookup(const ConstraintManager &constraints,
+                                    ref<Expr> expr,
+                                    std::vector<ref<Expr> > &unsatCore) {
+  ExprHashMap<std::vector<CachedCore> >::iterator it = cores.find(expr);
+  if (it == cores.end())
+    return false;
+
+  uint64_t fingerprint = 0;
+  for (ConstraintManager::const_iterator ci = constraints.begin(),
+                                         ce = constraints.end();
+       ci != ce; ++ci)
+    fingerprint |= getFingerprintBit(*ci);
+
+  // The constraints are only hashed for a core the fingerprint admits
+  ExprHashSet constraintSet;
+  bool hashed = false;
+  std::vector<CachedCore> &cached = it->second;
+  for (std::vector<CachedCore>::reverse_iterator ci = cached.rbegin(),
+                                                 ce = cached.rend();
+       ci != ce; ++ci) {
+    if (ci->fingerprint & ~fingerprint)
+      continue;
+    if (!hashed) {
+      constraintSet.insert(constraints.begin(), constraints.end());
+      hashed = true;
+    }
+    bool subset = true;
+    for (std::vector<ref<Expr> >::const_iterator ei = ci->core.begin(),
+                                                 ee = ci->core.end();
+         ei != ee && subset; ++ei)
+      subset = constraintSet.count(*ei);
+    if (subset) {
+      unsatCore = ci->core;
+      ++stats::queryUnsatCoreCacheHits;
+      return true;
+    }
+  }
+  return false;
+}
+
+void UnsatCoreCachingSolver::insert(ref<Expr> expr,
+                                    const std::vector<ref<Expr> > &unsatCore) {
+  // An empty core is also what solvers without cores give, and it does not
+  // tell that the expression is valid by itself
+  if (unsatCore.empty())
+    return;
+
+  if (coreCount >= MaxCores) {
+    cores.clear();
+    coreCount = 0;
+  }
+
+  CachedCore c;
+  c.fingerprint = 0;
+  c.core = unsatCore;
+  for (std::vector<ref<Expr> >::const_iterator it = unsatCore.begin(),
+                                               ie = unsatCore.end();
+       it != ie; ++it)
+    c.fingerprint |= getFingerprintBit(*it);
+
+  std::vector<CachedCore> &cached = cores[expr];
+  if (cached.size() >= MaxCoresPerExpr) {
+    cached.erase(cached.begin());
+    --coreCount;
+  }
+  cached.push_back(c);
+  ++coreCount;
+}
+
+bool UnsatCoreCachingSolver::computeValidity(
+    const Query &query, Solver::Validity &result,
+    std::vector<ref<Expr> > &unsatCore) {
+  if (lookup(query.constraints, query.expr, unsatCore)) {
+    result = Solver::True;
+    return true;
+  }
+  ref<Expr> negatedExpr = Expr::createIsZero(query.expr);
+  if (lookup(query.constraints, negatedExpr, unsatCore)) {
+    result = Solver::False;
+    return true;
+  }
+
+  if (!solver->impl->computeValidity(query, result, unsatCore))
+    return false;
+  if (result == Solver::True)
+    insert(query.expr, unsatCore);
+  else if (result == Solver::False)
+    insert(negatedExpr, unsatCore);
+  return true;
+}
+
+bool UnsatCoreCachingSolver::computeTruth(const Query &query, bool &isValid,
+                                          std::vector<ref<Expr> > &unsatCore) {
+  if (lookup(query.constraints, query.expr, unsatCore)) {
+    isValid = true;
+    return true;
+  }
+
+  if (!solver->impl->computeTruth(query, isValid, unsatCore))
+    return false;
+  if (isValid)
+    insert(query.expr, unsatCore);
+  return true;
+}
+
+Solver *klee::createUnsatCoreCachingSolver(Solver *s) {
+  return new Solver(new UnsatCoreCachingSolver(s));
+}
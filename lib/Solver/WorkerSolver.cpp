@@ -0,0 +1,567 @@
+//===-- WorkerSolver.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Config/config.h"
+#include "klee/Solver.h"
+
+#include "expr/Parser.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Constraints.h"
+#include "klee/ExprBuilder.h"
+#include "klee/SolverImpl.h"
+#include "klee/Statistics.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <map>
+
+using namespace klee;
+using namespace klee::expr;
+using namespace llvm;
+
+namespace {
+struct RequestHeader {
+  // Set when the query is a subsumption check
+  uint32_t subsumptionCheck;
+  double timeout;
+  uint32_t length;
+};
+
+struct ReplyHeader {
+  // Clear when the worker could not parse the query
+  uint8_t parsed;
+  uint8_t hasSolution;
+  // Set when an element of the core is not a constraint of the query
+  uint8_t coreIncomplete;
+  int32_t status;
+  uint32_t valuesSize;
+  uint32_t coreSize;
+  uint32_t statsSize;
+};
+
+struct StatDelta {
+  uint32_t id;
+  uint64_t delta;
+};
+
+/// Write a whole buffer to a socket, without a SIGPIPE if the peer is gone.
+bool writeAll(int fd, const void *buffer, size_t n) {
+  const char *pos = (const char *)buffer;
+  while (n) {
+    ssize_t r = send(fd, pos, n, MSG_NOSIGNAL);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    pos += r;
+    n -= r;
+  }
+  return true;
+}
+
+bool readAll(int fd, void *buffer, size_t n) {
+  char *pos = (char *)buffer;
+  while (n) {
+    ssize_t r = read(fd, pos, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    pos += r;
+    n -= r;
+  }
+  return true;
+}
+
+template <class T> void append(std::string &buffer, const T &value) {
+  buffer.append((const char *)&value, sizeof(T));
+}
+
+/// Send a process id, and a descriptor unless it is negative.
+bool sendDescriptor(int socket, int fd, int32_t pid) {
+  struct iovec iov;
+  iov.iov_base = &pid;
+  iov.iov_len = sizeof(pid);
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (fd >= 0) {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  }
+  ssize_t r;
+  while ((r = sendmsg(socket, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+    ;
+  return r == sizeof(pid);
+}
+
+/// Receive a process id and a descriptor, which is -1 if none was sent.
+bool receiveDescriptor(int socket, int &fd, int32_t &pid) {
+  struct iovec iov;
+  iov.iov_base = &pid;
+  iov.iov_len = sizeof(pid);
+  char control[CMSG_SPACE(sizeof(int))];
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t r;
+  while ((r = recvmsg(socket, &msg, 0)) < 0 && errno == EINTR)
+    ;
+  if (r != sizeof(pid))
+    return false;
+  fd = -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return true;
+}
+
+/// Have the process killed when its parent exits, so that a spawner or a
+/// worker does not outlive KLEE when the solver is not destroyed.
+void dieWithParent() {
+#ifdef __linux__
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+}
+}
+
+/// A solver running the queries of another one in a long-lived worker
+/// process, so that a crash or a timeout of the solver kills the worker and
+/// not KLEE, without forking KLEE for each query. The queries are sent to the
+/// worker in the KQuery format, and the values, the unsatisfiability core,
+/// as indices of the constraints, and the statistics the worker incremented
+/// are sent back. The workers are forked by a spawner process forked when
+/// the solver is created, while KLEE is still small, so that replacing a
+/// worker does not copy the address space of KLEE either.
+class WorkerSolverImpl : public SolverImpl {
+  Solver *solver;
+  double timeout;
+  SolverRunStatus runStatusCode;
+
+  /// The socket to the spawner, and its process
+  int spawner;
+  pid_t spawnerPid;
+
+  /// The socket to the worker, and its process, or -1 if there is none
+  int worker;
+  pid_t workerPid;
+
+  void runSpawner(int control);
+  void runWorker(int fd);
+
+  bool spawnWorker();
+  void killWorker();
+
+  bool solveInWorker(const Query &query,
+                     const std::vector<const Array *> &objects,
+                     std::vector<std::vector<unsigned char> > &values,
+                     bool &hasSolution, std::vector<ref<Expr> > &unsatCore,
+                     bool &parsed);
+
+public:
+  WorkerSolverImpl(Solver *_solver);
+  ~WorkerSolverImpl();
+
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution,
+                            std::vector<ref<Expr> > &unsatCore);
+  SolverRunStatus getOperationStatusCode() { return runStatusCode; }
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+  void setCoreSolverTimeout(double _timeout) {
+    timeout = _timeout;
+    solver->impl->setCoreSolverTimeout(_timeout);
+  }
+};
+
+WorkerSolverImpl::WorkerSolverImpl(Solver *_solver)
+    : solver(_solver), timeout(0.0), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      spawner(-1), spawnerPid(-1), worker(-1), workerPid(-1) {
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+    llvm::report_fatal_error("unable to create the solver spawner socket");
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1)
+    llvm::report_fatal_error("unable to fork the solver spawner");
+  if (pid == 0) {
+    close(fds[0]);
+    runSpawner(fds[1]);
+  }
+  close(fds[1]);
+  spawner = fds[0];
+  spawnerPid = pid;
+}
+
+WorkerSolverImpl::~WorkerSolverImpl() {
+  killWorker();
+  // The spawners of other solvers may hold the other end of the socket, so
+  // the spawner is killed rather than left to see it closed.
+  kill(spawnerPid, SIGKILL);
+  close(spawner);
+  while (waitpid(spawnerPid, 0, 0) < 0 && errno == EINTR)
+    ;
+  delete solver;
+}
+
+/// runSpawner - Fork a worker for each byte read from the control socket,
+/// and send its socket and process id back.
+void WorkerSolverImpl::runSpawner(int control) {
+  dieWithParent();
+  // Let the workers be reaped without waiting for them.
+  signal(SIGCHLD, SIG_IGN);
+
+  char c;
+  while (readAll(control, &c, 1)) {
+    int fds[2];
+    int32_t pid = -1;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+      pid = fork();
+      if (pid == 0) {
+        close(control);
+        close(fds[0]);
+        signal(SIGCHLD, SIG_DFL);
+        runWorker(fds[1]);
+      }
+      sendDescriptor(control, pid > 0 ? fds[0] : -1, pid);
+      close(fds[0]);
+      close(fds[1]);
+    } else {
+      sendDescriptor(control, -1, pid);
+    }
+  }
+  _exit(0);
+}
+
+/// runWorker - Solve the queries read from the socket until it is closed.
+void WorkerSolverImpl::runWorker(int fd) {
+  dieWithParent();
+  ExprBuilder *builder = createDefaultExprBuilder();
+  // The builders of the solver cache the translations of the arrays by
+  // their address, which the arrays keep by being owned by the worker
+  ArrayCache arrayCache;
+  StatisticManager &statistics = *theStatisticManager;
+  std::vector<uint64_t> before(statistics.getNumStatistics());
+
+  RequestHeader request;
+  std::string text;
+  while (readAll(fd, &request, sizeof(request))) {
+    text.resize(request.length);
+    if (request.length && !readAll(fd, &text[0], request.length))
+      break;
+
+    solver->impl->setCoreSolverTimeout(request.timeout);
+#ifdef ENABLE_Z3
+    Z3Solver::subsumptionCheck = request.subsumptionCheck;
+#endif
+    for (unsigned i = 0; i < before.size(); ++i)
+      before[i] = statistics.getValue(statistics.getStatistic(i));
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    MemoryBuffer *MB = MemoryBuffer::getMemBuffer(text, "query", false);
+#else
+    std::unique_ptr<MemoryBuffer> MB =
+        MemoryBuffer::getMemBuffer(text, "query", false);
+#endif
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    Parser *P = Parser::Create("query", MB, builder, false, &arrayCache);
+#else
+    Parser *P =
+        Parser::Create("query", MB.get(), builder, false, &arrayCache);
+#endif
+    Decl *D = P->ParseTopLevelDecl();
+    QueryCommand *QC = D ? dyn_cast<QueryCommand>(D) : 0;
+
+    ReplyHeader reply;
+    memset(&reply, 0, sizeof(reply));
+    std::string body;
+    if (QC && !P->GetNumErrors()) {
+      reply.parsed = 1;
+      ConstraintManager constraints(QC->Constraints);
+      std::vector<std::vector<unsigned char> > values;
+      std::vector<ref<Expr> > unsatCore;
+      bool hasSolution = false;
+      bool success = solver->impl->computeInitialValues(
+          Query(constraints, QC->Query), QC->Objects, values, hasSolution,
+          unsatCore);
+      reply.status = success ? solver->impl->getOperationStatusCode()
+                             : SOLVER_RUN_STATUS_FAILURE;
+      reply.hasSolution = success && hasSolution;
+
+      if (success && hasSolution) {
+        for (unsigned i = 0; i < values.size(); ++i)
+          body.append(values[i].begin(), values[i].end());
+        reply.valuesSize = body.size();
+      } else if (success) {
+        std::map<ref<Expr>, uint32_t> constraintIds;
+        for (uint32_t id = 0; id < QC->Constraints.size(); ++id)
+          constraintIds.insert(std::make_pair(QC->Constraints[id], id));
+        for (std::vector<ref<Expr> >::iterator it = unsatCore.begin(),
+                                               ie = unsatCore.end();
+             it != ie; ++it) {
+          std::map<ref<Expr>, uint32_t>::iterator found =
+              constraintIds.find(*it);
+          if (found == constraintIds.end()) {
+            reply.coreIncomplete = 1;
+            continue;
+          }
+          append(body, found->second);
+          ++reply.coreSize;
+        }
+      }
+    }
+    // The update nodes of the query are freed with it
+    solver->impl->clearUpdateNodeCache();
+    delete D;
+    delete P;
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    delete MB;
+#endif
+
+    for (unsigned i = 0; i < before.size(); ++i) {
+      StatDelta delta;
+      delta.id = i;
+      delta.delta = statistics.getValue(statistics.getStatistic(i)) - before[i];
+      if (delta.delta) {
+        append(body, delta);
+        ++reply.statsSize;
+      }
+    }
+
+    if (!writeAll(fd, &reply, sizeof(reply)) ||
+        !writeAll(fd, body.data(), body.size()))
+      break;
+  }
+  _exit(0);
+}
+
+/// spawnWorker - Have the spawner fork a worker, unless there is one.
+bool WorkerSolverImpl::spawnWorker() {
+  if (worker >= 0)
+    return true;
+  char c = 0;
+  int32_t pid;
+  if (!writeAll(spawner, &c, 1) || !receiveDescriptor(spawner, worker, pid) ||
+      worker < 0) {
+    klee_warning("unable to spawn a solver worker");
+    worker = -1;
+    return false;
+  }
+  workerPid = pid;
+  return true;
+}
+
+void WorkerSolverImpl::killWorker() {
+  if (worker < 0)
+    return;
+  kill(workerPid, SIGKILL);
+  close(worker);
+  worker = -1;
+  workerPid = -1;
+}
+
+bool WorkerSolverImpl::solveInWorker(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore, bool &parsed) {
+  parsed = false;
+  runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+  if (!spawnWorker())
+    return false;
+
+  std::string text;
+  llvm::raw_string_ostream os(text);
+  if (objects.empty())
+    ExprPPrinter::printQuery(os, query.constraints, query.expr);
+  else
+    ExprPPrinter::printQuery(os, query.constraints, query.expr, 0, 0,
+                             &objects[0], &objects[0] + objects.size());
+  os.flush();
+
+  RequestHeader request;
+  memset(&request, 0, sizeof(request));
+#ifdef ENABLE_Z3
+  request.subsumptionCheck = Z3Solver::subsumptionCheck;
+#endif
+  request.timeout = timeout;
+  request.length = text.size();
+
+  ReplyHeader reply;
+  if (!writeAll(worker, &request, sizeof(request)) ||
+      !writeAll(worker, text.data(), text.size())) {
+    klee_warning("solver worker exited unexpectedly");
+    killWorker();
+    runStatusCode = SOLVER_RUN_STATUS_INTERRUPTED;
+    return false;
+  }
+
+  // Wait for the reply, leaving the backend a second to report a timeout
+  // itself.
+  struct pollfd pfd;
+  pfd.fd = worker;
+  pfd.events = POLLIN;
+  int milliseconds = timeout ? (int)(timeout * 1000) + 1000 : -1;
+  int ready;
+  while ((ready = poll(&pfd, 1, milliseconds)) < 0 && errno == EINTR)
+    ;
+  if (ready == 0) {
+    klee_warning("solver worker timed out");
+    killWorker();
+    runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+    return false;
+  }
+
+  std::string body;
+  bool received = ready > 0 && readAll(worker, &reply, sizeof(reply));
+  if (received) {
+    body.resize(reply.valuesSize + reply.coreSize * sizeof(uint32_t) +
+                reply.statsSize * sizeof(StatDelta));
+    received = body.empty() || readAll(worker, &body[0], body.size());
+  }
+  if (!received) {
+    klee_warning("solver worker exited unexpectedly");
+    killWorker();
+    runStatusCode = SOLVER_RUN_STATUS_INTERRUPTED;
+    return false;
+  }
+
+  const char *pos = body.data();
+  const char *stats =
+      pos + reply.valuesSize + reply.coreSize * sizeof(uint32_t);
+  for (unsigned i = 0; i < reply.statsSize; ++i) {
+    StatDelta delta;
+    memcpy(&delta, stats + i * sizeof(StatDelta), sizeof(StatDelta));
+    theStatisticManager->incrementStatistic(
+        theStatisticManager->getStatistic(delta.id), delta.delta);
+  }
+
+  parsed = reply.parsed;
+  if (!parsed)
+    return false;
+  runStatusCode = (SolverRunStatus)reply.status;
+  if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+      runStatusCode != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+    return false;
+
+  hasSolution = reply.hasSolution;
+  unsatCore.clear();
+  if (hasSolution) {
+    values = std::vector<std::vector<unsigned char> >(objects.size());
+    for (unsigned i = 0; i < objects.size(); ++i) {
+      values[i].insert(values[i].begin(), pos, pos + objects[i]->size);
+      pos += objects[i]->size;
+    }
+    return true;
+  }
+
+  std::vector<ref<Expr> > constraints(query.constraints.begin(),
+                                      query.constraints.end());
+  if (reply.coreIncomplete) {
+    // The whole constraint set is a sound, if coarse, core.
+    unsatCore = constraints;
+    return true;
+  }
+  for (unsigned i = 0; i < reply.coreSize; ++i) {
+    uint32_t id;
+    memcpy(&id, pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    unsatCore.push_back(constraints[id]);
+  }
+  return true;
+}
+
+bool WorkerSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
+    std::vector<ref<Expr> > &unsatCore) {
+  bool parsed;
+  bool success = solveInWorker(query, objects, values, hasSolution,
+                               unsatCore, parsed);
+  if (success || parsed || runStatusCode != SOLVER_RUN_STATUS_FORK_FAILED)
+    return success;
+
+  // There is no worker, or it could not parse the query, which happens when
+  // the names of its arrays clash, so solve it here.
+  success = solver->impl->computeInitialValues(query, objects, values,
+                                               hasSolution, unsatCore);
+  runStatusCode = solver->impl->getOperationStatusCode();
+  return success;
+}
+
+bool WorkerSolverImpl::computeTruth(const Query &query, bool &isValid,
+                                    std::vector<ref<Expr> > &unsatCore) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+  if (!computeInitialValues(query, objects, values, hasSolution, unsatCore))
+    return false;
+  isValid = !hasSolution;
+  return true;
+}
+
+bool WorkerSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  findSymbolicObjects(query.expr, objects);
+
+  std::vector<std::vector<unsigned char> > values;
+  std::vector<ref<Expr> > unsatCore;
+  bool hasSolution;
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution,
+                            unsatCore))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+  return true;
+}
+
+Solver *klee::createWorkerSolver(Solver *s) {
+  return new Solver(new WorkerSolverImpl(s));
+}
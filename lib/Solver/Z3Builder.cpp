@@ -26,6 +26,13 @@ llvm::cl::opt<bool> UseConstructHashZ3(
     "use-construct-hash-z3",
     llvm::cl::desc("Use hash-consing during Z3 query construction."),
     llvm::cl::init(true));
+
+llvm::cl::opt<unsigned> Z3ConstructCacheSize(
+    "z3-construct-cache-size",
+    llvm::cl::desc("Number of constructed Z3 expressions kept across queries "
+                   "in each of the two cache generations (0=clear after each "
+                   "query, default=65536)."),
+    llvm::cl::init(65536));
 }
 
 void custom_z3_error_handler(Z3_context ctx, Z3_error_code ec) {
@@ -59,7 +66,8 @@ void Z3ArrayExprHash::clear() {
 }
 
 Z3Builder::Z3Builder(bool autoClearConstructCache)
-    : autoClearConstructCache(autoClearConstructCache) {
+    : autoClearConstructCache(autoClearConstructCache),
+      quantificationContext(0) {
   // FIXME: Should probably let the client pass in a Z3_config instead
   Z3_config cfg = Z3_mk_config();
   // It is very important that we ask Z3 to let us manage memory so that
@@ -76,7 +84,9 @@ Z3Builder::~Z3Builder() {
   // Clear caches so exprs/sorts gets freed before the destroying context
   // they aren associated with.
   clearConstructCache();
+  quantifiedConstructed.clear();
   _arr_hash.clear();
+  smallArrayBytes.clear();
   Z3_del_context(ctx);
 }
 
@@ -411,27 +421,117 @@ Z3ASTHandle Z3Builder::getInitialArray(const Array *root) {
 }
 
 Z3ASTHandle Z3Builder::getInitialRead(const Array *root, unsigned index) {
+  if (isSmallArray(root))
+    return getSmallArrayByte(root, index);
   return readExpr(getInitialArray(root), bvConst32(32, index));
 }
 
-Z3ASTHandle Z3Builder::getArrayForUpdate(const Array *root,
-                                         const UpdateNode *un) {
-  if (!un) {
-    return (getInitialArray(root));
-  } else {
-    // FIXME: This really needs to be non-recursive.
-    Z3ASTHandle un_expr;
-    bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
+bool Z3Builder::isSmallArray(const Array *root) {
+  std::map<const Array *, unsigned>::iterator it = smallArrays.find(root);
+  if (it != smallArrays.end())
+    return it->second;
 
-    if (!hashed) {
-      un_expr = writeExpr(getArrayForUpdate(root, un->next),
-                          construct(un->index, 0), construct(un->value, 0));
-
-      _arr_hash.hashUpdateNodeExpr(un, un_expr);
+  unsigned threshold = SmallArraySize;
+#ifdef ENABLE_Z3
+  if (Z3Solver::subsumptionCheck &&
+      SubsumptionSmallArraySize.getNumOccurrences())
+    threshold = SubsumptionSmallArraySize;
+#endif
+  // The shadow arrays may be bound by a quantifier as a whole
+  bool small = root->size <= threshold && root->size &&
+               root->name.find("__shadow__") != 0;
+  unsigned id = 0;
+  if (small)
+    id = smallArrays.size() + 1;
+  smallArrays[root] = id;
+  return small;
+}
+
+Z3ASTHandle Z3Builder::getSmallArrayByte(const Array *root, unsigned index) {
+  if (root->isConstantArray() && index < root->size)
+    return construct(root->constantValues[index], 0);
+
+  std::pair<const Array *, unsigned> key(root, index);
+  std::map<std::pair<const Array *, unsigned>, Z3ASTHandle>::iterator it =
+      smallArrayBytes.find(key);
+  if (it != smallArrayBytes.end())
+    return it->second;
+
+  // The bytes past the end stand for the unconstrained reads out of bounds
+  // of the array theory
+  std::string unique_name = root->name.substr(0, 24) + "!" +
+                            llvm::utostr(smallArrays[root]) + "!" +
+                            llvm::utostr(index);
+  Z3_symbol s =
+      Z3_mk_string_symbol(ctx, const_cast<char *>(unique_name.c_str()));
+  Z3ASTHandle byte(Z3_mk_const(ctx, s, getBvSort(root->getRange())), ctx);
+  smallArrayBytes.insert(std::make_pair(key, byte));
+  return byte;
+}
+
+Z3ASTHandle Z3Builder::readSmallArray(const Array *root, const UpdateNode *un,
+                                      ref<Expr> index) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(index)) {
+    uint64_t offset = CE->getZExtValue();
+    Z3ASTHandle offsetExpr = bvConst64(root->getDomain(), offset);
+    // Walk the updates newest first, until one at the offset
+    std::vector<const UpdateNode *> guarded;
+    Z3ASTHandle res;
+    for (; un; un = un->next) {
+      if (ConstantExpr *UCE = dyn_cast<ConstantExpr>(un->index)) {
+        if (UCE->getZExtValue() == offset) {
+          res = construct(un->value, 0);
+          break;
+        }
+        continue;
+      }
+      guarded.push_back(un);
     }
+    if (!un)
+      res = getSmallArrayByte(root, offset < root->size ? offset : root->size);
+    for (std::vector<const UpdateNode *>::reverse_iterator
+             it = guarded.rbegin(),
+             ie = guarded.rend();
+         it != ie; ++it)
+      res = iteExpr(eqExpr(construct((*it)->index, 0), offsetExpr),
+                    construct((*it)->value, 0), res);
+    return res;
+  }
+
+  Z3ASTHandle indexExpr = construct(index, 0);
+  Z3ASTHandle res = readSmallArray(
+      root, un, ConstantExpr::alloc(root->size, root->getDomain()));
+  for (unsigned i = root->size; i-- > 0;)
+    res = iteExpr(eqExpr(indexExpr, bvConst32(root->getDomain(), i)),
+                  readSmallArray(root, un,
+                                 ConstantExpr::alloc(i, root->getDomain())),
+                  res);
+  return res;
+}
 
-    return (un_expr);
+Z3ASTHandle Z3Builder::getArrayForUpdate(const Array *root,
+                                         const UpdateNode *un) {
+  // Walk down to the newest update already translated, then translate the
+  // updates above it oldest first, so that deep update lists do not recurse.
+  std::vector<const UpdateNode *> pending;
+  Z3ASTHandle un_expr;
+  for (; un; un = un->next) {
+    if (_arr_hash.lookupUpdateNodeExpr(un, un_expr))
+      break;
+    pending.push_back(un);
+  }
+  if (!un)
+    un_expr = getInitialArray(root);
+
+  for (std::vector<const UpdateNode *>::reverse_iterator it = pending.rbegin(),
+                                                         ie = pending.rend();
+       it != ie; ++it) {
+    un_expr = writeExpr(un_expr, construct((*it)->index, 0),
+                        construct((*it)->value, 0));
+    _arr_hash.hashUpdateNodeExpr(*it, un_expr);
   }
+
+  return (un_expr);
 }
 
 /** if *width_out!=1 then result is a bitvector,
@@ -442,20 +542,40 @@ Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
   if (!UseConstructHashZ3 || isa<ConstantExpr>(e)) {
     return constructActual(e, width_out);
   } else {
-    ExprHashMap<std::pair<Z3ASTHandle, unsigned> >::iterator it =
-        constructed.find(e);
-    if (it != constructed.end()) {
+    constructed_ty &cache =
+        quantificationContext ? quantifiedConstructed : constructed;
+    constructed_ty::iterator it = cache.find(e);
+    if (it != cache.end()) {
       if (width_out)
         *width_out = it->second.second;
       return it->second.first;
-    } else {
-      int width;
-      if (!width_out)
-        width_out = &width;
-      Z3ASTHandle res = constructActual(e, width_out);
-      constructed.insert(std::make_pair(e, std::make_pair(res, *width_out)));
-      return res;
     }
+
+    if (!quantificationContext) {
+      it = previousConstructed.find(e);
+      if (it != previousConstructed.end()) {
+        if (width_out)
+          *width_out = it->second.second;
+        constructed.insert(*it);
+        return it->second.first;
+      }
+    }
+
+    int width;
+    if (!width_out)
+      width_out = &width;
+    Z3ASTHandle res = constructActual(e, width_out);
+    cache.insert(std::make_pair(e, std::make_pair(res, *width_out)));
+    return res;
+  }
+}
+
+void Z3Builder::trimConstructCache() {
+  if (!Z3ConstructCacheSize) {
+    clearConstructCache();
+  } else if (constructed.size() >= Z3ConstructCacheSize) {
+    previousConstructed.swap(constructed);
+    constructed.clear();
   }
 }
 
@@ -507,6 +627,8 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
     ReadExpr *re = cast<ReadExpr>(e);
     assert(re && re->updates.root);
     *width_out = re->updates.root->getRange();
+    if (isSmallArray(re->updates.root))
+      return readSmallArray(re->updates.root, re->updates.head, re->index);
     return readExpr(getArrayForUpdate(re->updates.root, re->updates.head),
                     construct(re->index, 0));
   }
@@ -882,5 +1004,6 @@ void Z3Builder::popQuantificationContext() {
   QuantificationContext *tmp = quantificationContext;
   quantificationContext = tmp->getParent();
   delete tmp;
+  quantifiedConstructed.clear();
 }
 #endif // ENABLE_Z3
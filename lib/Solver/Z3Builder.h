@@ -14,6 +14,7 @@
 #include "klee/util/ArrayExprHash.h"
 #include "klee/Config/config.h"
 
+#include <map>
 #include <vector>
 #include <z3.h>
 
@@ -130,7 +131,18 @@ class Z3Builder {
     QuantificationContext *getParent() { return parent; }
   };
 
-  ExprHashMap<std::pair<Z3ASTHandle, unsigned> > constructed;
+  typedef ExprHashMap<std::pair<Z3ASTHandle, unsigned> > constructed_ty;
+
+  // The construction cache is kept across queries in two generations. A hit
+  // in the previous generation moves the entry to the current one, and when
+  // the current generation is full it replaces the previous one, releasing
+  // the handles of the entries not used since.
+  constructed_ty constructed;
+  constructed_ty previousConstructed;
+
+  // The expressions constructed under a quantifier refer to its bound
+  // variables, and are only cached until the quantifier is constructed.
+  constructed_ty quantifiedConstructed;
   Z3ArrayExprHash _arr_hash;
 
 private:
@@ -188,6 +200,20 @@ private:
   Z3ASTHandle getInitialArray(const Array *os);
   Z3ASTHandle getArrayForUpdate(const Array *root, const UpdateNode *un);
 
+  // The arrays of at most -small-array-size bytes are encoded as a bitvector
+  // variable per byte. Whether an array is so encoded is decided when it is
+  // first met, so that all its reads have the same encoding. The arrays are
+  // numbered from 1 for the names of their bytes, 0 when not small.
+  std::map<const Array *, unsigned> smallArrays;
+  std::map<std::pair<const Array *, unsigned>, Z3ASTHandle> smallArrayBytes;
+  bool isSmallArray(const Array *root);
+  Z3ASTHandle getSmallArrayByte(const Array *root, unsigned index);
+
+  // A read of a small array, an if-then-else over the updates with symbolic
+  // indices, and over the bytes for a symbolic index
+  Z3ASTHandle readSmallArray(const Array *root, const UpdateNode *un,
+                             ref<Expr> index);
+
   Z3ASTHandle constructActual(ref<Expr> e, int *width_out);
   Z3ASTHandle construct(ref<Expr> e, int *width_out);
 
@@ -228,7 +254,17 @@ public:
     return res;
   }
 
-  void clearConstructCache() { constructed.clear(); }
+  void clearConstructCache() {
+    constructed.clear();
+    previousConstructed.clear();
+  }
+
+  /// Forget the update lists, cached by the address of their nodes
+  void clearUpdateNodeCache() { _arr_hash._update_node_hash.clear(); }
+
+  /// Called at the end of a query: keeps the construction cache for the
+  /// following queries, bounding its size by -z3-construct-cache-size.
+  void trimConstructCache();
 };
 }
 
@@ -11,13 +11,72 @@
 #ifdef ENABLE_Z3
 #include "Z3Builder.h"
 #include "klee/Constraints.h"
+#include "klee/Internal/System/MemoryUsage.h"
+#include "klee/Internal/System/Time.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Statistics.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
 
+#include <map>
+#include <pthread.h>
+#include <set>
+
+namespace {
+llvm::cl::opt<bool> UseIncrementalZ3(
+    "z3-incremental",
+    llvm::cl::desc("Keep a single Z3 solver across queries, retracting and "
+                   "asserting only the constraints that differ from the "
+                   "previous query using push and pop (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> MinimizeUnsatCore(
+    "z3-minimize-unsat-core",
+    llvm::cl::desc("Shrink the unsatisfiability cores reported by Z3 by "
+                   "deleting the constraints not needed, within the time "
+                   "budget of -z3-minimize-unsat-core-time (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<double> MinimizeUnsatCoreTime(
+    "z3-minimize-unsat-core-time",
+    llvm::cl::desc("Time budget in seconds of the minimization of an "
+                   "unsatisfiability core, after which the smallest core "
+                   "found is kept (default=0.1)."),
+    llvm::cl::init(0.1));
+
+llvm::cl::opt<std::string> Z3QueryTactic(
+    "z3-query-tactic",
+    llvm::cl::desc("Comma-separated pipeline of Z3 tactics solving the "
+                   "queries outside subsumption checks, for example "
+                   "simplify,solve-eqs,elim-uncnstr,bit-blast,sat, ending "
+                   "with a tactic deciding the goal. The smt tactic solves "
+                   "the goals on which the pipeline fails (default=none, "
+                   "using the simple solver)."),
+    llvm::cl::init(""));
+
+llvm::cl::opt<std::string> Z3SubsumptionTactic(
+    "z3-subsumption-tactic",
+    llvm::cl::desc("Comma-separated pipeline of Z3 tactics solving the "
+                   "quantifier-free queries of subsumption checks, as "
+                   "-z3-query-tactic (default=none, using the simple "
+                   "solver)."),
+    llvm::cl::init(""));
+
+llvm::cl::opt<std::string> Z3ExistentialTactic(
+    "z3-existential-tactic",
+    llvm::cl::desc("Comma-separated pipeline of Z3 tactics solving the "
+                   "existentially-quantified queries of subsumption checks, "
+                   "for example simplify,solve-eqs,elim-uncnstr,qe-light,"
+                   "bit-blast,sat, as -z3-query-tactic (default=none, using "
+                   "the solver for the ABV logic)."),
+    llvm::cl::init(""));
+}
+
 namespace klee {
 
 class Z3SolverImpl : public SolverImpl {
@@ -29,6 +88,66 @@ private:
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
 
+  /// The solver kept across queries when -z3-incremental is set, and the
+  /// constraints currently asserted into it, one push scope each.
+  ::Z3_solver incrementalSolver;
+  std::vector<ref<Expr> > assertedConstraints;
+
+  /// The classes of queries with their own tactic pipeline
+  enum QueryClass {
+    RegularQuery,
+    SubsumptionQuery,
+    ExistentialQuery,
+    QueryClassCount
+  };
+
+  /// The tactic pipelines of the query classes, built once per context, or
+  /// null for the classes solved by the default solvers
+  ::Z3_tactic tactics[QueryClassCount];
+
+  /// Whether the query being solved is of a subsumption check
+  bool inSubsumptionCheck;
+
+  /// The memory usage of Z3 after the last recycling of the context
+  uint64_t usageAfterRecycle;
+
+  /// The solver implementations, hence the Z3 contexts, of the concurrent
+  /// checks of computeFirstValid, kept for the next batches.
+  std::vector<Z3SolverImpl *> concurrentImpls;
+
+  /// createContext - Create the builder, hence the context, and the
+  /// parameters and the tactics in the context.
+  void createContext();
+
+  /// destroyContext - Release the objects of the context, and the context.
+  void destroyContext();
+
+  /// recycleContext - Replace the context by a new one between queries when
+  /// Z3 uses too much memory under -z3-recycle-memory. The translations of
+  /// the expressions are rebuilt in the new context on demand, and the
+  /// constraints of the incremental solver reasserted.
+  void recycleContext();
+
+  /// buildTactic - Build the pipeline of the comma-separated tactic names,
+  /// referenced once, falling back to the smt tactic. Returns null for an
+  /// empty pipeline.
+  ::Z3_tactic buildTactic(const std::string &pipeline);
+
+  QueryClass getQueryClass(const Query &query) const;
+
+  /// syncIncrementalSolver - Pop the asserted constraints that are not a
+  /// prefix of the query constraints, and push the remaining ones. Returns
+  /// the incremental solver.
+  ::Z3_solver syncIncrementalSolver(const Query &query);
+
+  /// isExistentialQuery - Existentially-quantified queries of subsumption
+  /// checks are solved using a solver for the ABV logic.
+  static bool isExistentialQuery(const Query &query);
+
+  /// mkSolver - Create a solver, referenced once, with the constraints of the
+  /// query asserted and tracked for unsatisfiability core extraction.
+  ::Z3_solver mkSolver(const Query &query, QueryClass queryClass);
+
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
@@ -40,6 +159,15 @@ private:
                                  const Z3_solver solver,
                                  std::vector<ref<Expr> > &unsatCore);
 
+  /// minimizeUnsatCore - Remove from the unsatisfiability core of a valid
+  /// query the constraints that are not needed for the validity, one at a
+  /// time, within the time budget of -z3-minimize-unsat-core-time. A core
+  /// found unsatisfiable also drops the constraints outside the core Z3
+  /// reports for the check. The checks share a single solver, the
+  /// constraints being enabled by assumptions.
+  void minimizeUnsatCore(const Query &query,
+                         std::vector<ref<Expr> > &unsatCore);
+
 public:
   Z3SolverImpl();
   ~Z3SolverImpl();
@@ -56,6 +184,8 @@ public:
                        timeoutInMilliSeconds);
   }
 
+  void clearUpdateNodeCache() { builder->clearUpdateNodeCache(); }
+
   bool computeTruth(const Query &, bool &isValid,
                     std::vector<ref<Expr> > &unsatCore);
   bool computeValue(const Query &, ref<Expr> &result);
@@ -70,21 +200,60 @@ public:
                        std::vector<std::vector<unsigned char> > *values,
                        bool &hasSolution);
   SolverRunStatus getOperationStatusCode();
+
+  int computeFirstValid(const ConstraintManager &constraints,
+                        const std::vector<ref<Expr> > &exprs, double timeout,
+                        std::vector<ref<Expr> > &unsatCore);
 };
 
 Z3SolverImpl::Z3SolverImpl()
-    : builder(new Z3Builder(/*autoClearConstructCache=*/false)), timeout(0.0),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
+    : builder(0), timeout(0.0), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      incrementalSolver(NULL), inSubsumptionCheck(false),
+      usageAfterRecycle(0) {
+  createContext();
+}
+
+Z3SolverImpl::~Z3SolverImpl() {
+  for (std::vector<Z3SolverImpl *>::iterator it = concurrentImpls.begin(),
+                                             ie = concurrentImpls.end();
+       it != ie; ++it)
+    delete *it;
+  destroyContext();
+}
+
+void Z3SolverImpl::createContext() {
+  builder = new Z3Builder(/*autoClearConstructCache=*/false);
   assert(builder && "unable to create Z3Builder");
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
   timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
   setCoreSolverTimeout(timeout);
+  tactics[RegularQuery] = buildTactic(Z3QueryTactic);
+  tactics[SubsumptionQuery] = buildTactic(Z3SubsumptionTactic);
+  tactics[ExistentialQuery] = buildTactic(Z3ExistentialTactic);
 }
 
-Z3SolverImpl::~Z3SolverImpl() {
+void Z3SolverImpl::destroyContext() {
+  if (incrementalSolver)
+    Z3_solver_dec_ref(builder->ctx, incrementalSolver);
+  incrementalSolver = NULL;
+  assertedConstraints.clear();
+  for (unsigned i = 0; i < QueryClassCount; ++i) {
+    if (tactics[i])
+      Z3_tactic_dec_ref(builder->ctx, tactics[i]);
+  }
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
+  builder = 0;
+}
+
+void Z3SolverImpl::recycleContext() {
+  if (!Z3RecycleMemory || !Z3Solver::shouldRecycleContext(usageAfterRecycle))
+    return;
+  destroyContext();
+  createContext();
+  usageAfterRecycle = Z3Solver::getMemoryUsage();
+  ++stats::z3ContextRecycles;
 }
 
 /**/
@@ -107,6 +276,28 @@ bool Z3Solver::directComputeValidity(const Query &query,
   return impl->computeValidity(query, result, unsatCore);
 }
 
+uint64_t Z3Solver::getMemoryUsage() {
+#ifdef HAVE_Z3_GET_ESTIMATED_ALLOC_SIZE
+  return Z3_get_estimated_alloc_size();
+#else
+  return util::GetTotalMallocUsage();
+#endif
+}
+
+bool Z3Solver::shouldRecycleContext(uint64_t usageAfterRecycle) {
+  uint64_t limit = (uint64_t)Z3RecycleMemory << 20;
+  uint64_t usage = getMemoryUsage();
+  return usage > limit && usage > usageAfterRecycle + limit / 2;
+}
+
+int Z3Solver::computeFirstValid(const ConstraintManager &constraints,
+                                const std::vector<ref<Expr> > &exprs,
+                                double timeout,
+                                std::vector<ref<Expr> > &unsatCore) {
+  return static_cast<Z3SolverImpl *>(impl)->computeFirstValid(
+      constraints, exprs, timeout, unsatCore);
+}
+
 /***/
 
 char *Z3SolverImpl::getConstraintLog(const Query &query) {
@@ -194,51 +385,37 @@ bool Z3SolverImpl::internalRunSolver(
     TimerStatIncrementer t(stats::subsumptionQueryTime);
     ++stats::subsumptionQueryCount;
     Z3Solver::subsumptionCheck = false;
+    inSubsumptionCheck = true;
     bool result =
         internalRunSolver(query, objects, values, hasSolution, unsatCore);
+    inSubsumptionCheck = false;
     if (!result || hasSolution) {
       ++stats::subsumptionQueryFailureCount;
     }
     Z3Solver::subsumptionCheck = true;
     return result;
   }
+  // No expression of the context is held between queries
+  recycleContext();
+
   TimerStatIncrementer t(stats::queryTime);
-  // TODO: Does making a new solver for each query have a performance
-  // impact vs making one global solver and using push and pop?
-  // TODO: is the "simple_solver" the right solver to use for
-  // best performance?
-  Z3_solver theSolver = Z3_mk_simple_solver(builder->ctx);
-  if (INTERPOLATION_ENABLED) {
-    if (llvm::isa<ExistsExpr>(query.expr) ||
-        (llvm::isa<EqExpr>(query.expr) &&
-         llvm::isa<ExistsExpr>(query.expr->getKid(1)))) {
-      Z3_symbol abv = Z3_mk_string_symbol(builder->ctx, "ABV");
-      theSolver = Z3_mk_solver_for_logic(builder->ctx, abv);
-    }
+  QueryClass queryClass = getQueryClass(query);
+  bool existentialQuery = (queryClass == ExistentialQuery);
+  // Existentially-quantified queries use a solver for the ABV logic, and the
+  // queries of a tactic pipeline their own solver, hence they are never run
+  // incrementally.
+  bool incremental =
+      UseIncrementalZ3 && !existentialQuery && !tactics[queryClass];
+
+  Z3_solver theSolver;
+  if (incremental) {
+    theSolver = syncIncrementalSolver(query);
+  } else {
+    theSolver = mkSolver(query, queryClass);
   }
-  Z3_solver_inc_ref(builder->ctx, theSolver);
   Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
 
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
-
-  Z3_sort sort = Z3_mk_bool_sort(builder->ctx);
-  unsigned constraintIdCtr = 1;
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    std::ostringstream stringStream;
-    stringStream << constraintIdCtr;
-
-    Z3_symbol symbol =
-        Z3_mk_string_symbol(builder->ctx, stringStream.str().c_str());
-    Z3ASTHandle constraintId(Z3_mk_const(builder->ctx, symbol, sort),
-                             builder->ctx);
-
-    Z3_solver_assert_and_track(builder->ctx, theSolver, builder->construct(*it),
-                               constraintId);
-
-    constraintIdCtr++;
-  }
   ++stats::queries;
   if (objects)
     ++stats::queryCounterexamples;
@@ -251,6 +428,8 @@ bool Z3SolverImpl::internalRunSolver(
   // but Z3 works in terms of satisfiability so instead we ask the
   // negation of the equivalent i.e.
   // ∃ X Constraints(X) ∧ ¬ query(X)
+  if (incremental)
+    Z3_solver_push(builder->ctx, theSolver);
   Z3_solver_assert(
       builder->ctx, theSolver,
       Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
@@ -261,15 +440,23 @@ bool Z3SolverImpl::internalRunSolver(
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
     getUnsatCoreVector(query, builder, theSolver, unsatCore);
+    if (MinimizeUnsatCore && !existentialQuery)
+      minimizeUnsatCore(query, unsatCore);
   }
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
+  if (incremental) {
+    // Retract the query, keeping the constraints for the next query
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
+  // Bound the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and trimming now
   // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
+  // ``Query``, and with the following queries on the same path,
+  // rather than only sharing within a single call to
   // ``builder->construct()``.
-  builder->clearConstructCache();
+  builder->trimConstructCache();
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
       runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
@@ -283,6 +470,270 @@ bool Z3SolverImpl::internalRunSolver(
   return false; // failed
 }
 
+bool Z3SolverImpl::isExistentialQuery(const Query &query) {
+  return INTERPOLATION_ENABLED &&
+         (llvm::isa<ExistsExpr>(query.expr) ||
+          (llvm::isa<EqExpr>(query.expr) &&
+           llvm::isa<ExistsExpr>(query.expr->getKid(1))));
+}
+
+Z3SolverImpl::QueryClass
+Z3SolverImpl::getQueryClass(const Query &query) const {
+  if (isExistentialQuery(query))
+    return ExistentialQuery;
+  if (inSubsumptionCheck || Z3Solver::subsumptionCheck)
+    return SubsumptionQuery;
+  return RegularQuery;
+}
+
+::Z3_tactic Z3SolverImpl::buildTactic(const std::string &pipeline) {
+  if (pipeline.empty())
+    return NULL;
+
+  // Unknown tactic names are reported here, as Z3 would fail on them
+  std::set<std::string> known;
+  for (unsigned i = 0, n = Z3_get_num_tactics(builder->ctx); i < n; ++i)
+    known.insert(Z3_get_tactic_name(builder->ctx, i));
+
+  ::Z3_tactic result = NULL;
+  std::string::size_type begin = 0;
+  while (begin <= pipeline.size()) {
+    std::string::size_type end = pipeline.find(',', begin);
+    if (end == std::string::npos)
+      end = pipeline.size();
+    std::string name = pipeline.substr(begin, end - begin);
+    begin = end + 1;
+    if (name.empty())
+      continue;
+    if (!known.count(name))
+      klee_error("unknown Z3 tactic \"%s\" in \"%s\"", name.c_str(),
+                 pipeline.c_str());
+
+    ::Z3_tactic tactic = Z3_mk_tactic(builder->ctx, name.c_str());
+    Z3_tactic_inc_ref(builder->ctx, tactic);
+    if (result) {
+      ::Z3_tactic chain = Z3_tactic_and_then(builder->ctx, result, tactic);
+      Z3_tactic_inc_ref(builder->ctx, chain);
+      Z3_tactic_dec_ref(builder->ctx, result);
+      Z3_tactic_dec_ref(builder->ctx, tactic);
+      result = chain;
+    } else {
+      result = tactic;
+    }
+  }
+  if (!result)
+    return NULL;
+
+  // The goals on which the pipeline fails, e.g. quantified ones reaching
+  // bit-blast, are solved from the start by the smt tactic
+  ::Z3_tactic smt = Z3_mk_tactic(builder->ctx, "smt");
+  Z3_tactic_inc_ref(builder->ctx, smt);
+  ::Z3_tactic tactic = Z3_tactic_or_else(builder->ctx, result, smt);
+  Z3_tactic_inc_ref(builder->ctx, tactic);
+  Z3_tactic_dec_ref(builder->ctx, result);
+  Z3_tactic_dec_ref(builder->ctx, smt);
+  return tactic;
+}
+
+::Z3_solver Z3SolverImpl::mkSolver(const Query &query, QueryClass queryClass) {
+  Z3_solver theSolver;
+  if (tactics[queryClass]) {
+    theSolver = Z3_mk_solver_from_tactic(builder->ctx, tactics[queryClass]);
+  } else if (queryClass == ExistentialQuery) {
+    Z3_symbol abv = Z3_mk_string_symbol(builder->ctx, "ABV");
+    theSolver = Z3_mk_solver_for_logic(builder->ctx, abv);
+  } else {
+    theSolver = Z3_mk_simple_solver(builder->ctx);
+  }
+  Z3_solver_inc_ref(builder->ctx, theSolver);
+
+  Z3_sort sort = Z3_mk_bool_sort(builder->ctx);
+  unsigned constraintIdCtr = 1;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it) {
+    std::ostringstream stringStream;
+    stringStream << constraintIdCtr;
+
+    Z3_symbol symbol =
+        Z3_mk_string_symbol(builder->ctx, stringStream.str().c_str());
+    Z3ASTHandle constraintId(Z3_mk_const(builder->ctx, symbol, sort),
+                             builder->ctx);
+
+    Z3_solver_assert_and_track(builder->ctx, theSolver, builder->construct(*it),
+                               constraintId);
+
+    constraintIdCtr++;
+  }
+  return theSolver;
+}
+
+namespace {
+/// A validity check run on its own thread by Z3SolverImpl::computeFirstValid
+struct ConcurrentCheck {
+  ::Z3_context ctx;
+  ::Z3_solver solver;
+  ::Z3_lbool satisfiable;
+
+  /// Shared among the checks of the same batch
+  pthread_mutex_t *lock;
+  bool *validFound;
+  std::vector<ConcurrentCheck> *batch;
+};
+
+void *runConcurrentCheck(void *arg) {
+  ConcurrentCheck *check = static_cast<ConcurrentCheck *>(arg);
+  check->satisfiable = Z3_solver_check(check->ctx, check->solver);
+  if (check->satisfiable == Z3_L_FALSE) {
+    // The query is valid: interrupt the other checks
+    pthread_mutex_lock(check->lock);
+    if (!*check->validFound) {
+      *check->validFound = true;
+      for (std::vector<ConcurrentCheck>::iterator
+               it = check->batch->begin(),
+               ie = check->batch->end();
+           it != ie; ++it) {
+        if (&(*it) != check)
+          Z3_interrupt(it->ctx);
+      }
+    }
+    pthread_mutex_unlock(check->lock);
+  }
+  return 0;
+}
+
+void *runConcurrentCheckThread(void *arg) {
+  theStatisticManager->beginThread();
+  runConcurrentCheck(arg);
+  theStatisticManager->endThread();
+  return 0;
+}
+}
+
+int Z3SolverImpl::computeFirstValid(const ConstraintManager &constraints,
+                                    const std::vector<ref<Expr> > &exprs,
+                                    double timeout,
+                                    std::vector<ref<Expr> > &unsatCore) {
+  // One solver implementation, hence one Z3 context, per concurrent check
+  while (concurrentImpls.size() < exprs.size())
+    concurrentImpls.push_back(new Z3SolverImpl());
+
+  TimerStatIncrementer t(Z3Solver::subsumptionCheck
+                             ? stats::subsumptionQueryTime
+                             : stats::queryTime);
+
+  pthread_mutex_t lock;
+  pthread_mutex_init(&lock, 0);
+  bool validFound = false;
+
+  // Z3 expressions are constructed on this thread, as KLEE expressions are
+  // not safe to share among threads.
+  std::vector<ConcurrentCheck> batch(exprs.size());
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    Z3SolverImpl *impl = concurrentImpls[i];
+    Query query(constraints, exprs[i]);
+    impl->recycleContext();
+    impl->setCoreSolverTimeout(timeout);
+
+    ConcurrentCheck &check = batch[i];
+    check.ctx = impl->builder->ctx;
+    check.solver = impl->mkSolver(query, impl->getQueryClass(query));
+    Z3_solver_set_params(check.ctx, check.solver, impl->solverParameters);
+    Z3_solver_assert(
+        check.ctx, check.solver,
+        Z3ASTHandle(Z3_mk_not(check.ctx, impl->builder->construct(query.expr)),
+                    check.ctx));
+    check.satisfiable = Z3_L_UNDEF;
+    check.lock = &lock;
+    check.validFound = &validFound;
+    check.batch = &batch;
+    ++stats::queries;
+  }
+
+  std::vector<pthread_t> threads(batch.size());
+  std::vector<bool> started(batch.size(), false);
+  for (unsigned i = 0; i < batch.size(); ++i) {
+    started[i] = (pthread_create(&threads[i], 0, runConcurrentCheckThread,
+                                 &batch[i]) == 0);
+    // Run the check on this thread if no thread could be created
+    if (!started[i])
+      runConcurrentCheck(&batch[i]);
+  }
+  for (unsigned i = 0; i < batch.size(); ++i) {
+    if (started[i])
+      pthread_join(threads[i], 0);
+  }
+  pthread_mutex_destroy(&lock);
+
+  int valid = -1;
+  for (unsigned i = 0; i < batch.size(); ++i) {
+    Z3SolverImpl *impl = concurrentImpls[i];
+    ConcurrentCheck &check = batch[i];
+    if (Z3Solver::subsumptionCheck) {
+      ++stats::subsumptionQueryCount;
+      if (check.satisfiable != Z3_L_FALSE)
+        ++stats::subsumptionQueryFailureCount;
+    }
+    if (check.satisfiable == Z3_L_FALSE) {
+      ++stats::queriesValid;
+      if (valid < 0) {
+        valid = i;
+        Query query(constraints, exprs[i]);
+        getUnsatCoreVector(query, impl->builder, check.solver, unsatCore);
+        if (MinimizeUnsatCore && !isExistentialQuery(query))
+          impl->minimizeUnsatCore(query, unsatCore);
+      }
+    } else if (check.satisfiable == Z3_L_TRUE) {
+      ++stats::queriesInvalid;
+    }
+    Z3_solver_dec_ref(check.ctx, check.solver);
+    impl->builder->trimConstructCache();
+    impl->setCoreSolverTimeout(0);
+  }
+  return valid;
+}
+
+::Z3_solver Z3SolverImpl::syncIncrementalSolver(const Query &query) {
+  if (!incrementalSolver) {
+    incrementalSolver = Z3_mk_simple_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, incrementalSolver);
+  }
+
+  // Find the longest common prefix of the asserted and the query constraints
+  unsigned common = 0;
+  ConstraintManager::const_iterator it = query.constraints.begin(),
+                                    ie = query.constraints.end();
+  for (; it != ie && common < assertedConstraints.size(); ++it, ++common) {
+    if (assertedConstraints[common] != *it)
+      break;
+  }
+
+  if (common < assertedConstraints.size()) {
+    Z3_solver_pop(builder->ctx, incrementalSolver,
+                  assertedConstraints.size() - common);
+    assertedConstraints.resize(common);
+  }
+
+  // The tracking constant of each constraint is named after its position in
+  // the query, as expected by getUnsatCoreVector().
+  Z3_sort sort = Z3_mk_bool_sort(builder->ctx);
+  for (; it != ie; ++it) {
+    std::ostringstream stringStream;
+    stringStream << (assertedConstraints.size() + 1);
+
+    Z3_symbol symbol =
+        Z3_mk_string_symbol(builder->ctx, stringStream.str().c_str());
+    Z3ASTHandle constraintId(Z3_mk_const(builder->ctx, symbol, sort),
+                             builder->ctx);
+
+    Z3_solver_push(builder->ctx, incrementalSolver);
+    Z3_solver_assert_and_track(builder->ctx, incrementalSolver,
+                               builder->construct(*it), constraintId);
+    assertedConstraints.push_back(*it);
+  }
+  return incrementalSolver;
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
     ::Z3_solver theSolver, ::Z3_lbool satisfiable,
     const std::vector<const Array *> *objects,
@@ -386,5 +837,96 @@ void Z3SolverImpl::getUnsatCoreVector(const Query &query,
   }
 }
 
+
+void Z3SolverImpl::minimizeUnsatCore(const Query &query,
+                                     std::vector<ref<Expr> > &unsatCore) {
+  if (unsatCore.empty())
+    return;
+
+  TimerStatIncrementer t(stats::unsatCoreMinimizationTime);
+  ++stats::unsatCoreMinimizations;
+  stats::unsatCoreSize += unsatCore.size();
+  double deadline = util::getWallTime() + MinimizeUnsatCoreTime;
+
+  Z3_solver theSolver = Z3_mk_simple_solver(builder->ctx);
+  Z3_solver_inc_ref(builder->ctx, theSolver);
+  ::Z3_params params = Z3_mk_params(builder->ctx);
+  Z3_params_inc_ref(builder->ctx, params);
+
+  Z3_solver_assert(
+      builder->ctx, theSolver,
+      Z3ASTHandle(Z3_mk_not(builder->ctx, builder->construct(query.expr)),
+                  builder->ctx));
+
+  // Each constraint of the core is implied by an assumption, named after its
+  // position in the core. Z3 hash-conses the assumptions, so that those of a
+  // core of a check are found by their address.
+  Z3_sort sort = Z3_mk_bool_sort(builder->ctx);
+  std::vector<Z3ASTHandle> assumptions;
+  std::map<Z3_ast, unsigned> assumptionIndex;
+  for (unsigned i = 0; i < unsatCore.size(); ++i) {
+    std::ostringstream stringStream;
+    stringStream << "core" << i;
+    Z3_symbol symbol =
+        Z3_mk_string_symbol(builder->ctx, stringStream.str().c_str());
+    Z3ASTHandle assumption(Z3_mk_const(builder->ctx, symbol, sort),
+                           builder->ctx);
+    Z3_solver_assert(builder->ctx, theSolver,
+                     Z3ASTHandle(Z3_mk_implies(builder->ctx, assumption,
+                                               builder->construct(
+                                                   unsatCore[i])),
+                                 builder->ctx));
+    assumptions.push_back(assumption);
+    assumptionIndex[assumption] = i;
+  }
+
+  std::vector<bool> needed(unsatCore.size(), true);
+  for (unsigned i = 0; i < unsatCore.size(); ++i) {
+    if (!needed[i])
+      continue;
+    double remaining = deadline - util::getWallTime();
+    if (remaining <= 0)
+      break;
+    unsigned remainingInMilliSeconds = (unsigned)(remaining * 1000) + 1;
+    Z3_params_set_uint(builder->ctx, params, timeoutParamStrSymbol,
+                       remainingInMilliSeconds);
+    Z3_solver_set_params(builder->ctx, theSolver, params);
+
+    std::vector<Z3_ast> enabled;
+    for (unsigned j = 0; j < unsatCore.size(); ++j) {
+      if (j != i && needed[j])
+        enabled.push_back(assumptions[j]);
+    }
+    // A timeout or a model keeps the constraint
+    if (Z3_solver_check_assumptions(builder->ctx, theSolver, enabled.size(),
+                                    enabled.empty() ? 0 : &enabled[0]) !=
+        Z3_L_FALSE)
+      continue;
+
+    Z3_ast_vector r = Z3_solver_get_unsat_core(builder->ctx, theSolver);
+    Z3_ast_vector_inc_ref(builder->ctx, r);
+    std::vector<bool> inCheckCore(unsatCore.size(), false);
+    for (unsigned k = 0; k < Z3_ast_vector_size(builder->ctx, r); ++k) {
+      std::map<Z3_ast, unsigned>::iterator it =
+          assumptionIndex.find(Z3_ast_vector_get(builder->ctx, r, k));
+      if (it != assumptionIndex.end())
+        inCheckCore[it->second] = true;
+    }
+    Z3_ast_vector_dec_ref(builder->ctx, r);
+    for (unsigned j = 0; j < unsatCore.size(); ++j)
+      needed[j] = needed[j] && inCheckCore[j];
+  }
+
+  Z3_params_dec_ref(builder->ctx, params);
+  Z3_solver_dec_ref(builder->ctx, theSolver);
+
+  std::vector<ref<Expr> > minimalCore;
+  for (unsigned i = 0; i < unsatCore.size(); ++i) {
+    if (needed[i])
+      minimalCore.push_back(unsatCore[i]);
+  }
+  unsatCore.swap(minimalCore);
+  stats::minimalUnsatCoreSize += unsatCore.size();
+}
 }
 #endif // ENABLE_Z3
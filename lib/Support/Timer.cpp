@@ -9,6 +9,7 @@
 
 #include "klee/Config/Version.h"
 #include "klee/Internal/Support/Timer.h"
+#include "klee/TimerStatIncrementer.h"
 
 #include "klee/Internal/System/Time.h"
 
@@ -22,3 +23,27 @@ WallTimer::WallTimer() {
 uint64_t WallTimer::check() {
   return util::getWallTimeVal().usec() - startMicroseconds;
 }
+
+double CycleTimer::ticksPerMicrosecond = 0;
+
+std::vector<unsigned> SampledTimerStatIncrementer::calls;
+
+uint64_t CycleTimer::wallMicroseconds() {
+  return util::getWallTimeVal().usec();
+}
+
+uint64_t CycleTimer::toMicroseconds(uint64_t ticks) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (!ticksPerMicrosecond) {
+    // Count the ticks over a millisecond of the wall clock
+    uint64_t wallStart = wallMicroseconds(), start = now(), wallEnd;
+    do
+      wallEnd = wallMicroseconds();
+    while (wallEnd - wallStart < 1000);
+    ticksPerMicrosecond = (double)(now() - start) / (wallEnd - wallStart);
+  }
+  return ticks / ticksPerMicrosecond;
+#else
+  return ticks;
+#endif
+}
@@ -10,19 +10,267 @@
 #define DEBUG_TYPE "TreeStreamWriter"
 #include "klee/Internal/ADT/TreeStream.h"
 
+#include "klee/Config/config.h"
 #include "klee/Internal/Support/Debug.h"
 
 #include <cassert>
+#include <deque>
 #include <iomanip>
 #include <fstream>
 #include <iterator>
 #include <map>
 
 #include "llvm/Support/raw_ostream.h"
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
 
 using namespace klee;
 
+namespace {
+/// The kinds of the records of a block. A record is the varint of its
+/// stream, the varint of its value shifted left by two or'ed with its kind,
+/// and its payload.
+enum RecordKind {
+  /// The value is the size of the bytes that follow
+  DataRecord,
+  /// The value is the stream opened as a child of the stream
+  ForkRecord,
+  /// The value is the number of "0" and "1" characters, which follow as
+  /// bits, least significant first
+  BranchRecord
+};
+
+/// The bit of the stored size of a block marking it compressed
+const uint32_t CompressedBlock = 1u << 31;
+
+/// The blocks waiting for the background thread, beyond which the executor
+/// waits for it
+const unsigned MaxPendingBlocks = 8;
+
+void appendVarint(std::vector<char> &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back((char) (value | 0x80));
+    value >>= 7;
+  }
+  out.push_back((char) value);
+}
+
+bool isBranches(const char *s, unsigned size) {
+  for (unsigned i = 0; i != size; ++i)
+    if (s[i] != '0' && s[i] != '1')
+      return false;
+  return true;
+}
+
+/// Reads the records of a tree stream file, block by block.
+class TreeStreamReader {
+  std::ifstream is;
+  std::vector<char> block;
+  std::vector<char> stored;
+  size_t pos;
+
+  bool readBlock() {
+    uint32_t rawSize, storedSize;
+    is.read(reinterpret_cast<char*>(&rawSize), 4);
+    is.read(reinterpret_cast<char*>(&storedSize), 4);
+    if (!is.good())
+      return false;
+    block.resize(rawSize);
+    pos = 0;
+    if (!(storedSize & CompressedBlock)) {
+      assert(storedSize == rawSize && "corrupt tree stream block");
+      is.read(&block[0], rawSize);
+      return is.good();
+    }
+    storedSize &= ~CompressedBlock;
+    stored.resize(storedSize);
+    is.read(&stored[0], storedSize);
+#ifdef HAVE_ZLIB_H
+    uLongf size = rawSize;
+    int res = uncompress(reinterpret_cast<Bytef*>(&block[0]), &size,
+                         reinterpret_cast<const Bytef*>(&stored[0]),
+                         storedSize);
+    assert(res == Z_OK && size == rawSize && "corrupt tree stream block");
+    (void) res;
+    return is.good();
+#else
+    assert(0 && "compressed tree stream block without zlib");
+    return false;
+#endif
+  }
+
+  uint64_t readVarint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      assert(pos < block.size() && "truncated tree stream record");
+      unsigned char c = block[pos++];
+      value |= (uint64_t) (c & 0x7F) << shift;
+      if (!(c & 0x80))
+        return value;
+    }
+  }
+
+public:
+  struct Record {
+    unsigned id;
+    RecordKind kind;
+    unsigned value;
+    const char *data;
+
+    /// Append the characters of a data or branch record.
+    void appendTo(std::vector<unsigned char> &out) const {
+      if (kind == DataRecord) {
+        out.insert(out.end(), data, data + value);
+      } else if (kind == BranchRecord) {
+        for (unsigned i = 0; i != value; ++i)
+          out.push_back(((data[i / 8] >> (i % 8)) & 1) ? '1' : '0');
+      }
+    }
+  };
+
+  explicit TreeStreamReader(const std::string &path)
+    : is(path.c_str(), std::ios::in | std::ios::binary), pos(0) {
+    assert(is.good());
+  }
+
+  bool next(Record &r) {
+    while (pos == block.size())
+      if (!readBlock())
+        return false;
+    r.id = readVarint();
+    uint64_t tag = readVarint();
+    r.kind = (RecordKind) (tag & 3);
+    r.value = tag >> 2;
+    r.data = &block[0] + pos;
+    if (r.kind == DataRecord)
+      pos += r.value;
+    else if (r.kind == BranchRecord)
+      pos += (r.value + 7) / 8;
+    assert(pos <= block.size() && "truncated tree stream record");
+    return true;
+  }
+};
+}
+
+namespace klee {
+/// Writes the blocks of a TreeStreamWriter to its file on a background
+/// thread, so that the executor does not wait for the compression and the
+/// writes. The blocks are written in order, synchronously if the thread
+/// cannot be started.
+class TreeStreamBlockWriter {
+  std::ofstream &output;
+  std::deque<std::vector<char>*> blocks;
+  bool stopping, threaded;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  std::vector<char> compressed;
+
+  static void *run(void *self);
+  void writeBlock(const std::vector<char> &block);
+
+public:
+  explicit TreeStreamBlockWriter(std::ofstream &_output);
+  ~TreeStreamBlockWriter();
+
+  /// Queue a block for writing, taking its ownership.
+  void submit(std::vector<char> *block);
+
+  /// Wait until the queued blocks are written and flushed.
+  void wait();
+};
+}
+
+TreeStreamBlockWriter::TreeStreamBlockWriter(std::ofstream &_output)
+  : output(_output), stopping(false), threaded(false) {
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&changed, 0);
+  threaded = pthread_create(&thread, 0, run, this) == 0;
+}
+
+TreeStreamBlockWriter::~TreeStreamBlockWriter() {
+  if (threaded) {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, 0);
+  }
+  output.flush();
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+}
+
+void *TreeStreamBlockWriter::run(void *self) {
+  TreeStreamBlockWriter &w = *static_cast<TreeStreamBlockWriter*>(self);
+  pthread_mutex_lock(&w.lock);
+  for (;;) {
+    while (w.blocks.empty() && !w.stopping)
+      pthread_cond_wait(&w.changed, &w.lock);
+    if (w.blocks.empty())
+      break;
+    std::vector<char> *block = w.blocks.front();
+    pthread_mutex_unlock(&w.lock);
+    w.writeBlock(*block);
+    delete block;
+    // The block is only removed once written, so that an empty queue means
+    // that the output is no longer being used.
+    pthread_mutex_lock(&w.lock);
+    w.blocks.pop_front();
+    pthread_cond_broadcast(&w.changed);
+  }
+  pthread_mutex_unlock(&w.lock);
+  return 0;
+}
+
+void TreeStreamBlockWriter::writeBlock(const std::vector<char> &block) {
+  uint32_t rawSize = block.size();
+#ifdef HAVE_ZLIB_H
+  uLongf size = compressBound(rawSize);
+  compressed.resize(size);
+  if (compress2(reinterpret_cast<Bytef*>(&compressed[0]), &size,
+                reinterpret_cast<const Bytef*>(&block[0]), rawSize,
+                Z_BEST_SPEED) == Z_OK && size < rawSize) {
+    uint32_t storedSize = size | CompressedBlock;
+    output.write(reinterpret_cast<const char*>(&rawSize), 4);
+    output.write(reinterpret_cast<const char*>(&storedSize), 4);
+    output.write(&compressed[0], size);
+    return;
+  }
+#endif
+  output.write(reinterpret_cast<const char*>(&rawSize), 4);
+  output.write(reinterpret_cast<const char*>(&rawSize), 4);
+  output.write(&block[0], rawSize);
+}
+
+void TreeStreamBlockWriter::submit(std::vector<char> *block) {
+  if (!threaded) {
+    writeBlock(*block);
+    delete block;
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  while (blocks.size() >= MaxPendingBlocks)
+    pthread_cond_wait(&changed, &lock);
+  blocks.push_back(block);
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+void TreeStreamBlockWriter::wait() {
+  if (threaded) {
+    pthread_mutex_lock(&lock);
+    while (!blocks.empty())
+      pthread_cond_wait(&changed, &lock);
+    pthread_mutex_unlock(&lock);
+  }
+  output.flush();
+}
+
 ///
 
 TreeStreamWriter::TreeStreamWriter(const std::string &_path) 
@@ -31,17 +279,27 @@ TreeStreamWriter::TreeStreamWriter(const std::string &_path)
     path(_path),
     output(new std::ofstream(path.c_str(), 
                              std::ios::out | std::ios::binary)),
-    ids(1) {
+    ids(1),
+    block(0),
+    blockWriter(0) {
   if (!output->good()) {
     delete output;
     output = 0;
+    return;
   }
+  block = new std::vector<char>();
+  block->reserve(blockSize);
+  blockWriter = new TreeStreamBlockWriter(*output);
 }
 
 TreeStreamWriter::~TreeStreamWriter() {
-  flush();
-  if (output)
+  if (output) {
+    flushBuffer();
+    submitBlock();
+    delete blockWriter;
     delete output;
+  }
+  delete block;
 }
 
 bool TreeStreamWriter::good() {
@@ -56,14 +314,11 @@ TreeOStream TreeStreamWriter::open(const TreeOStream &os) {
   assert(output && os.writer==this);
   flushBuffer();
   unsigned id = ids++;
-  output->write(reinterpret_cast<const char*>(&os.id), 4);
-  unsigned tag = id | (1<<31);
-  output->write(reinterpret_cast<const char*>(&tag), 4);
+  writeRecord(os.id, ForkRecord, id, 0, 0);
   return TreeOStream(*this, id);
 }
 
 void TreeStreamWriter::write(TreeOStream &os, const char *s, unsigned size) {
-#if 1
   if (bufferCount && 
       (os.id!=lastID || size+bufferCount>bufferSize))
     flushBuffer();
@@ -75,29 +330,50 @@ void TreeStreamWriter::write(TreeOStream &os, const char *s, unsigned size) {
     memcpy(buffer, s, size);
     bufferCount = size;
   } else {
-    output->write(reinterpret_cast<const char*>(&os.id), 4);
-    output->write(reinterpret_cast<const char*>(&size), 4);
-    output->write(buffer, size);
+    writeRecord(os.id, DataRecord, size, s, size);
   }
-#else
-  output->write(reinterpret_cast<const char*>(&os.id), 4);
-  output->write(reinterpret_cast<const char*>(&size), 4);
-  output->write(s, size);
-#endif
+}
+
+void TreeStreamWriter::writeRecord(unsigned id, unsigned kind, unsigned value,
+                                   const char *data, unsigned size) {
+  appendVarint(*block, id);
+  appendVarint(*block, ((uint64_t) value << 2) | kind);
+  block->insert(block->end(), data, data + size);
+  if (block->size() >= blockSize)
+    submitBlock();
+}
+
+void TreeStreamWriter::submitBlock() {
+  if (block->empty())
+    return;
+  blockWriter->submit(block);
+  block = new std::vector<char>();
+  block->reserve(blockSize);
 }
 
 void TreeStreamWriter::flushBuffer() {
-  if (bufferCount) {    
-    output->write(reinterpret_cast<const char*>(&lastID), 4);
-    output->write(reinterpret_cast<const char*>(&bufferCount), 4);
-    output->write(buffer, bufferCount);
-    bufferCount = 0;
+  if (!bufferCount)
+    return;
+  if (isBranches(buffer, bufferCount)) {
+    char bits[bufferSize / 8 + 1];
+    unsigned n = (bufferCount + 7) / 8;
+    memset(bits, 0, n);
+    for (unsigned i = 0; i != bufferCount; ++i)
+      if (buffer[i] == '1')
+        bits[i / 8] |= 1 << (i % 8);
+    writeRecord(lastID, BranchRecord, bufferCount, bits, n);
+  } else {
+    writeRecord(lastID, DataRecord, bufferCount, buffer, bufferCount);
   }
+  bufferCount = 0;
 }
 
 void TreeStreamWriter::flush() {
+  if (!output)
+    return;
   flushBuffer();
-  output->flush();
+  submitBlock();
+  blockWriter->wait();
 }
 
 void TreeStreamWriter::readStream(TreeStreamID streamID,
@@ -105,37 +381,34 @@ void TreeStreamWriter::readStream(TreeStreamID streamID,
   assert(streamID>0 && streamID<ids);
   flush();
   
-  std::ifstream is(path.c_str(),
-                   std::ios::in | std::ios::binary);
-  assert(is.good());
   KLEE_DEBUG(llvm::errs() << "finding chain for: " << streamID << "\n");
 
   std::map<unsigned,unsigned> parents;
   std::vector<unsigned> roots;
-  for (;;) {
-    assert(is.good());
-    unsigned id;
-    unsigned tag;
-    is.read(reinterpret_cast<char*>(&id), 4);
-    is.read(reinterpret_cast<char*>(&tag), 4);
-    if (tag&(1<<31)) { // fork
-      unsigned child = tag ^ (1<<31);
-
-      if (child==streamID) {
-        roots.push_back(child);
-        while (id) {
-          roots.push_back(id);
-          std::map<unsigned, unsigned>::iterator it = parents.find(id);
-          assert(it!=parents.end());
-          id = it->second;
-        } 
-        break;
-      } else {
-        parents.insert(std::make_pair(child,id));
+  TreeStreamReader::Record r;
+  {
+    TreeStreamReader is(path);
+    for (;;) {
+      bool found = is.next(r);
+      assert(found && "stream missing from the tree stream file");
+      (void) found;
+      if (r.kind == ForkRecord) {
+        unsigned id = r.id;
+        unsigned child = r.value;
+
+        if (child==streamID) {
+          roots.push_back(child);
+          while (id) {
+            roots.push_back(id);
+            std::map<unsigned, unsigned>::iterator it = parents.find(id);
+            assert(it!=parents.end());
+            id = it->second;
+          } 
+          break;
+        } else {
+          parents.insert(std::make_pair(child,id));
+        }
       }
-    } else {
-      unsigned size = tag;
-      while (size--) is.get();
     }
   }
   KLEE_DEBUG({
@@ -145,24 +418,14 @@ void TreeStreamWriter::readStream(TreeStreamID streamID,
       }
       llvm::errs() << "\n";
     });
-  is.seekg(0, std::ios::beg);
-  for (;;) {
-    unsigned id;
-    unsigned tag;
-    is.read(reinterpret_cast<char*>(&id), 4);
-    is.read(reinterpret_cast<char*>(&tag), 4);
-    if (!is.good()) break;
-    if (tag&(1<<31)) { // fork
-      unsigned child = tag ^ (1<<31);
-      if (id==roots.back() && roots.size()>1 && child==roots[roots.size()-2])
+  TreeStreamReader is(path);
+  while (is.next(r)) {
+    if (r.kind == ForkRecord) {
+      if (r.id==roots.back() && roots.size()>1 &&
+          r.value==roots[roots.size()-2])
         roots.pop_back();
-    } else {
-      unsigned size = tag;
-      if (id==roots.back()) {
-        while (size--) out.push_back(is.get());
-      } else {
-        while (size--) is.get();
-      }
+    } else if (r.id==roots.back()) {
+      r.appendTo(out);
     }
   }  
 }
@@ -73,7 +73,17 @@ void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
       }
       tmp[strlen(tmp)-1] = '\0'; /* kill newline */
     }
-    testData = kTest_fromFile(name);
+    if (kTestArchive_isArchive(name)) {
+      /* The test case of an archive is given by KTEST_INDEX */
+      const char *index = getenv("KTEST_INDEX");
+      KTestArchive *archive = kTestArchive_open(name);
+      if (archive) {
+        testData = kTestArchive_get(archive, index ? atoi(index) : 0);
+        kTestArchive_close(archive);
+      }
+    } else {
+      testData = kTest_fromFile(name);
+    }
     if (!testData) {
       fprintf(stderr, "KLEE-RUNTIME: unable to open .ktest file\n");
       exit(1);
@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --no-interpolation --bulk-memory-functions --exit-on-error %t1.bc
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define N 10000
+
+char a[N], b[N];
+
+int main() {
+  char c;
+  klee_make_symbolic(&c, sizeof(c), "c");
+
+  // Concrete ranges
+  memset(a, 7, N);
+  memcpy(b, a, N);
+  assert(b[0] == 7 && b[N - 1] == 7);
+
+  // Overlapping ranges within an object
+  memset(a, 1, N / 2);
+  memmove(a + 1, a, N / 2);
+  assert(a[N / 2] == 1 && a[N / 2 + 1] == 7);
+
+  // Ranges with a symbolic byte
+  a[3] = c;
+  memcpy(b, a, 8);
+  assert(b[3] == c && b[4] == 1);
+
+  return 0;
+}
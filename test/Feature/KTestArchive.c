@@ -0,0 +1,31 @@
+// RUN: %llvmgcc -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --write-ktest-archive %t.bc
+// RUN: test -f %t.klee-out/tests.ktests
+// RUN: not test -f %t.klee-out/test000001.ktest
+// RUN: ktest-tool %t.klee-out/tests.ktests | FileCheck %s
+
+// Seeding from the archive explores the same two paths
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --only-replay-seeds --seed-out-dir=%t.klee-out %t.bc > %t.log
+// RUN: grep -q "x is small" %t.log
+// RUN: grep -q "x is large" %t.log
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+// CHECK: ktest file : '{{.*}}tests.ktests:0'
+// CHECK: object    0: name: {{b?}}'x'
+// CHECK: ktest file : '{{.*}}tests.ktests:1'
+// CHECK: object    0: name: {{b?}}'x'
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x < 10)
+    printf("x is small\n");
+  else
+    printf("x is large\n");
+  return 0;
+}
@@ -16,6 +16,7 @@
 #include "klee/ExprBuilder.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
 #include "klee/Statistics.h"
 #include "klee/CommandLine.h"
 #include "klee/Common.h"
@@ -23,6 +24,7 @@
 #include "klee/util/ExprVisitor.h"
 #include "klee/util/ExprSMTLIBPrinter.h"
 #include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/Support/Timer.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
@@ -30,6 +32,7 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -54,7 +57,8 @@ namespace {
     PrintTokens,
     PrintAST,
     PrintSMTLIBv2,
-    Evaluate
+    Evaluate,
+    Benchmark
   };
 
   static llvm::cl::opt<ToolActions> 
@@ -69,8 +73,17 @@ namespace {
                         "Print parsed AST nodes from the input file."),
              clEnumValN(Evaluate, "evaluate",
                         "Print parsed AST nodes from the input file."),
+             clEnumValN(Benchmark, "benchmark",
+                        "Time the queries of the input file through the "
+                        "solver chain and print the hits of its layers."),
              clEnumValEnd));
 
+  llvm::cl::opt<unsigned> BenchmarkRepeat(
+      "benchmark-repeat",
+      llvm::cl::desc("Number of times the queries are replayed by -benchmark "
+                     "(default=1)."),
+      llvm::cl::init(1));
+
 
   enum BuilderKinds {
     DefaultBuilder,
@@ -91,10 +104,25 @@ namespace {
                          "Fold constants and simplify expressions."),
               clEnumValEnd));
 
+  static llvm::cl::opt<bool>
+  HashConsing("hash-consing",
+              llvm::cl::desc("Share the nodes of structurally equal "
+                             "expressions (default=off)."),
+              llvm::cl::init(false));
+
 
   llvm::cl::opt<std::string> directoryToWriteQueryLogs("query-log-dir",llvm::cl::desc("The folder to write query logs to. Defaults is current working directory."),
 		                                               llvm::cl::init("."));
 
+  llvm::cl::opt<bool> StreamQueries(
+      "stream",
+      llvm::cl::desc("With -evaluate, evaluate each query as soon as it is "
+                     "parsed and release it, instead of parsing the whole "
+                     "input first, so that the memory is bounded by the "
+                     "array declarations and the largest query "
+                     "(default=off)."),
+      llvm::cl::init(false));
+
   llvm::cl::opt<bool> ClearArrayAfterQuery(
       "clear-array-decls-after-query",
       llvm::cl::desc("We discard the previous array declarations after a query "
@@ -194,10 +222,152 @@ static bool PrintInputAST(const char *Filename,
   return success;
 }
 
+static void EvaluateQuery(Solver *S, QueryCommand *QC, unsigned Index) {
+  llvm::outs() << "Query " << Index << ":\t";
+
+  assert("FIXME: Support counterexample query commands!");
+  if (QC->Values.empty() && QC->Objects.empty()) {
+    bool result;
+    if (S->mustBeTrue(Query(ConstraintManager(QC->Constraints), QC->Query),
+                      result)) {
+      llvm::outs() << (result ? "VALID" : "INVALID");
+    } else {
+      llvm::outs() << "FAIL (reason: "
+                << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
+                << ")";
+    }
+  } else if (!QC->Values.empty()) {
+    assert(QC->Objects.empty() && 
+           "FIXME: Support counterexamples for values and objects!");
+    assert(QC->Values.size() == 1 &&
+           "FIXME: Support counterexamples for multiple values!");
+    assert(QC->Query->isFalse() &&
+           "FIXME: Support counterexamples with non-trivial query!");
+    ref<ConstantExpr> result;
+    if (S->getValue(Query(ConstraintManager(QC->Constraints), 
+                          QC->Values[0]),
+                    result)) {
+      llvm::outs() << "INVALID\n";
+      llvm::outs() << "\tExpr 0:\t" << result;
+    } else {
+      llvm::outs() << "FAIL (reason: "
+                << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
+                << ")";
+    }
+  } else {
+    std::vector< std::vector<unsigned char> > result;
+    std::vector<ref<Expr> > unsatCore;
+    if (S->getInitialValues(
+            Query(ConstraintManager(QC->Constraints), QC->Query),
+            QC->Objects, result, unsatCore)) {
+      llvm::outs() << "INVALID\n";
+
+      for (unsigned i = 0, e = result.size(); i != e; ++i) {
+        llvm::outs() << "\tArray " << i << ":\t"
+                   << QC->Objects[i]->name
+                   << "[";
+        for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
+          llvm::outs() << (unsigned) result[i][j];
+          if (j + 1 != QC->Objects[i]->size)
+            llvm::outs() << ", ";
+        }
+        llvm::outs() << "]";
+        if (i + 1 != e)
+          llvm::outs() << "\n";
+      }
+    } else {
+      SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
+      if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
+        llvm::outs() << " FAIL (reason: "
+                  << SolverImpl::getOperationStatusString(retCode)
+                  << ")";
+      }           
+      else {
+        llvm::outs() << "VALID (counterexample request ignored)";
+      }
+    }
+  }
+
+  llvm::outs() << "\n";
+}
+
+static void PrintQueryStatistics() {
+  if (uint64_t queries = *theStatisticManager->getStatisticByName("Queries")) {
+    llvm::outs()
+      << "--\n"
+      << "total queries = " << queries << "\n"
+      << "total queries constructs = " 
+      << *theStatisticManager->getStatisticByName("QueriesConstructs") << "\n"
+      << "valid queries = " 
+      << *theStatisticManager->getStatisticByName("QueriesValid") << "\n"
+      << "invalid queries = " 
+      << *theStatisticManager->getStatisticByName("QueriesInvalid") << "\n"
+      << "query cex = " 
+      << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
+  }
+}
+
+static Solver *CreateEvaluationSolver() {
+  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
+
+  if (CoreSolverToUse != DUMMY_SOLVER) {
+    if (0 != MaxCoreSolverTime) {
+      coreSolver->setCoreSolverTimeout(MaxCoreSolverTime);
+    }
+  }
+
+  return constructSolverChain(coreSolver,
+                              getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
+                              getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
+                              getQueryLogPath(ALL_QUERIES_PC_FILE_NAME),
+                              getQueryLogPath(SOLVER_QUERIES_PC_FILE_NAME));
+}
+
+/// Evaluate the queries one at a time as they are parsed. A query is
+/// released once evaluated, while the array declarations are kept as the
+/// later queries may refer to them. The queries before a parse error are
+/// still evaluated.
+static bool StreamInputAST(const char *Filename, const MemoryBuffer *MB,
+                           ExprBuilder *Builder) {
+  std::vector<Decl*> ArrayDecls;
+  Parser *P = Parser::Create(Filename, MB, Builder, ClearArrayAfterQuery);
+  P->SetMaxErrors(20);
+  Solver *S = CreateEvaluationSolver();
+
+  unsigned Index = 0;
+  while (Decl *D = P->ParseTopLevelDecl()) {
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
+      if (!P->GetNumErrors())
+        EvaluateQuery(S, QC, Index++);
+      delete D;
+    } else {
+      ArrayDecls.push_back(D);
+    }
+  }
+
+  bool success = true;
+  if (unsigned N = P->GetNumErrors()) {
+    llvm::errs() << Filename << ": parse failure: " << N << " errors.\n";
+    success = false;
+  }
+
+  delete S;
+  delete P;
+  for (std::vector<Decl*>::iterator it = ArrayDecls.begin(),
+         ie = ArrayDecls.end(); it != ie; ++it)
+    delete *it;
+
+  PrintQueryStatistics();
+  return success;
+}
+
 static bool EvaluateInputAST(const char *Filename,
                              const MemoryBuffer *MB,
                              ExprBuilder *Builder) {
 	llvm::outs() << "EvaluateInputAST\n";
+  if (StreamQueries)
+    return StreamInputAST(Filename, MB, Builder);
+
   std::vector<Decl*> Decls;
   Parser *P = Parser::Create(Filename, MB, Builder, ClearArrayAfterQuery);
   P->SetMaxErrors(20);
@@ -214,6 +384,89 @@ static bool EvaluateInputAST(const char *Filename,
   if (!success)
     return false;
 
+  Solver *S = CreateEvaluationSolver();
+
+  unsigned Index = 0;
+  for (std::vector<Decl*>::iterator it = Decls.begin(),
+         ie = Decls.end(); it != ie; ++it) {
+    Decl *D = *it;
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(D))
+      EvaluateQuery(S, QC, Index++);
+  }
+
+  for (std::vector<Decl*>::iterator it = Decls.begin(),
+         ie = Decls.end(); it != ie; ++it)
+    delete *it;
+  delete P;
+
+  delete S;
+
+  PrintQueryStatistics();
+  return success;
+}
+
+/// Run a query command through the solver, returning false on failure.
+/// The existentially-quantified queries are run through the Z3 solver
+/// given, if any.
+static bool runQueryCommand(Solver *S, Solver *existentialSolver,
+                            QueryCommand *QC) {
+  ConstraintManager constraints(QC->Constraints);
+  if (existentialSolver && isa<ExistsExpr>(QC->Query)) {
+    // As in the subsumption checks, the existentially-quantified queries
+    // are decided by Z3 directly, since the solver chain does not handle
+    // quantifiers.
+    Solver::Validity result;
+    std::vector<ref<Expr> > unsatCore;
+    return existentialSolver->impl->computeValidity(
+        Query(constraints, QC->Query), result, unsatCore);
+  }
+  if (QC->Values.empty() && QC->Objects.empty()) {
+    bool result;
+    return S->mustBeTrue(Query(constraints, QC->Query), result);
+  }
+  if (!QC->Values.empty()) {
+    ref<ConstantExpr> result;
+    return S->getValue(Query(constraints, QC->Values[0]), result);
+  }
+  std::vector<std::vector<unsigned char> > result;
+  std::vector<ref<Expr> > unsatCore;
+  // A valid query has no counterexample, which is not a failure.
+  return S->getInitialValues(Query(constraints, QC->Query), QC->Objects,
+                             result, unsatCore) ||
+         S->impl->getOperationStatusCode() !=
+             SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+}
+
+static void printHitRate(const char *layer, uint64_t hits, uint64_t total) {
+  llvm::outs() << layer << " = " << hits << " / " << total;
+  if (total)
+    llvm::outs() << " (" << (100 * hits / total) << "%)";
+  llvm::outs() << "\n";
+}
+
+/// Replay the queries of a query log, such as the .pc and .kquery logs of
+/// the logging solvers and the subsumption query log, through the solver
+/// chain of the command line, and report the query latency and the hits of
+/// the layers of the chain.
+static bool BenchmarkInputAST(const char *Filename,
+                              const MemoryBuffer *MB,
+                              ExprBuilder *Builder) {
+  std::vector<Decl*> Decls;
+  Parser *P = Parser::Create(Filename, MB, Builder, ClearArrayAfterQuery);
+  P->SetMaxErrors(20);
+  while (Decl *D = P->ParseTopLevelDecl()) {
+    Decls.push_back(D);
+  }
+
+  if (unsigned N = P->GetNumErrors()) {
+    llvm::errs() << Filename << ": parse failure: " << N << " errors.\n";
+    for (std::vector<Decl*>::iterator it = Decls.begin(),
+           ie = Decls.end(); it != ie; ++it)
+      delete *it;
+    delete P;
+    return false;
+  }
+
   Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
 
   if (CoreSolverToUse != DUMMY_SOLVER) {
@@ -228,78 +481,28 @@ static bool EvaluateInputAST(const char *Filename,
                                    getQueryLogPath(ALL_QUERIES_PC_FILE_NAME),
                                    getQueryLogPath(SOLVER_QUERIES_PC_FILE_NAME));
 
-  unsigned Index = 0;
-  for (std::vector<Decl*>::iterator it = Decls.begin(),
-         ie = Decls.end(); it != ie; ++it) {
-    Decl *D = *it;
-    if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
-      llvm::outs() << "Query " << Index << ":\t";
-
-      assert("FIXME: Support counterexample query commands!");
-      if (QC->Values.empty() && QC->Objects.empty()) {
-        bool result;
-        if (S->mustBeTrue(Query(ConstraintManager(QC->Constraints), QC->Query),
-                          result)) {
-          llvm::outs() << (result ? "VALID" : "INVALID");
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else if (!QC->Values.empty()) {
-        assert(QC->Objects.empty() && 
-               "FIXME: Support counterexamples for values and objects!");
-        assert(QC->Values.size() == 1 &&
-               "FIXME: Support counterexamples for multiple values!");
-        assert(QC->Query->isFalse() &&
-               "FIXME: Support counterexamples with non-trivial query!");
-        ref<ConstantExpr> result;
-        if (S->getValue(Query(ConstraintManager(QC->Constraints), 
-                              QC->Values[0]),
-                        result)) {
-          llvm::outs() << "INVALID\n";
-          llvm::outs() << "\tExpr 0:\t" << result;
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else {
-        std::vector< std::vector<unsigned char> > result;
-        std::vector<ref<Expr> > unsatCore;
-        if (S->getInitialValues(
-                Query(ConstraintManager(QC->Constraints), QC->Query),
-                QC->Objects, result, unsatCore)) {
-          llvm::outs() << "INVALID\n";
-
-          for (unsigned i = 0, e = result.size(); i != e; ++i) {
-            llvm::outs() << "\tArray " << i << ":\t"
-                       << QC->Objects[i]->name
-                       << "[";
-            for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
-              llvm::outs() << (unsigned) result[i][j];
-              if (j + 1 != QC->Objects[i]->size)
-                llvm::outs() << ", ";
-            }
-            llvm::outs() << "]";
-            if (i + 1 != e)
-              llvm::outs() << "\n";
-          }
-        } else {
-          SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
-          if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
-            llvm::outs() << " FAIL (reason: "
-                      << SolverImpl::getOperationStatusString(retCode)
-                      << ")";
-          }           
-          else {
-            llvm::outs() << "VALID (counterexample request ignored)";
-          }
-        }
-      }
+  Solver *existentialSolver = 0;
+#ifdef ENABLE_Z3
+  existentialSolver = new Z3Solver();
+  if (0 != MaxCoreSolverTime)
+    existentialSolver->setCoreSolverTimeout(MaxCoreSolverTime);
+#endif
 
-      llvm::outs() << "\n";
-      ++Index;
+  std::vector<uint64_t> latencies;
+  unsigned failures = 0;
+  uint64_t total = 0;
+  for (unsigned round = 0; round < BenchmarkRepeat; ++round) {
+    for (std::vector<Decl*>::iterator it = Decls.begin(),
+           ie = Decls.end(); it != ie; ++it) {
+      QueryCommand *QC = dyn_cast<QueryCommand>(*it);
+      if (!QC)
+        continue;
+      WallTimer timer;
+      if (!runQueryCommand(S, existentialSolver, QC))
+        ++failures;
+      uint64_t elapsed = timer.check();
+      latencies.push_back(elapsed);
+      total += elapsed;
     }
   }
 
@@ -309,22 +512,37 @@ static bool EvaluateInputAST(const char *Filename,
   delete P;
 
   delete S;
-
-  if (uint64_t queries = *theStatisticManager->getStatisticByName("Queries")) {
-    llvm::outs()
-      << "--\n"
-      << "total queries = " << queries << "\n"
-      << "total queries constructs = " 
-      << *theStatisticManager->getStatisticByName("QueriesConstructs") << "\n"
-      << "valid queries = " 
-      << *theStatisticManager->getStatisticByName("QueriesValid") << "\n"
-      << "invalid queries = " 
-      << *theStatisticManager->getStatisticByName("QueriesInvalid") << "\n"
-      << "query cex = " 
-      << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
+  delete existentialSolver;
+
+  std::sort(latencies.begin(), latencies.end());
+  uint64_t n = latencies.size();
+  llvm::outs() << "queries = " << n << "\n"
+               << "failed queries = " << failures << "\n"
+               << "total time (us) = " << total << "\n";
+  if (n) {
+    llvm::outs() << "mean latency (us) = " << total / n << "\n"
+                 << "p50 latency (us) = " << latencies[(n - 1) / 2] << "\n"
+                 << "p90 latency (us) = " << latencies[(n - 1) * 9 / 10]
+                 << "\n"
+                 << "p99 latency (us) = " << latencies[(n - 1) * 99 / 100]
+                 << "\n"
+                 << "max latency (us) = " << latencies[n - 1] << "\n";
   }
 
-  return success;
+  // The layers only count the queries they see, so the rate of a layer is
+  // relative to the queries reaching it.
+  printHitRate("range hits", stats::queryRangeHits, n);
+  printHitRate("independent reductions", stats::queryIndependentReductions,
+               n);
+  printHitRate("cache hits", stats::queryCacheHits,
+               stats::queryCacheHits + stats::queryCacheMisses);
+  printHitRate("cex cache hits", stats::queryCexCacheHits,
+               stats::queryCexCacheHits + stats::queryCexCacheMisses);
+  printHitRate("fast cex hits", stats::queryFastCexHits,
+               stats::queryFastCexHits + stats::queries);
+  llvm::outs() << "core solver queries = " << stats::queries << "\n";
+
+  return failures == 0;
 }
 
 static bool printInputAsSMTLIBv2(const char *Filename,
@@ -436,6 +654,8 @@ int main(int argc, char **argv) {
     Builder = createSimplifyingExprBuilder(Builder);
     break;
   }
+  if (HashConsing)
+    Builder = createHashConsingExprBuilder(Builder);
 
   switch (ToolAction) {
   case PrintTokens:
@@ -450,6 +670,10 @@ int main(int argc, char **argv) {
     success = EvaluateInputAST(InputFile=="-" ? "<stdin>" : InputFile.c_str(),
                                MB.get(), Builder);
     break;
+  case Benchmark:
+    success = BenchmarkInputAST(InputFile=="-" ? "<stdin>" : InputFile.c_str(),
+                                MB.get(), Builder);
+    break;
   case PrintSMTLIBv2:
     success = printInputAsSMTLIBv2(InputFile=="-"? "<stdin>" : InputFile.c_str(), MB.get(),Builder);
     break;
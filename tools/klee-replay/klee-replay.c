@@ -19,10 +19,15 @@
 #include <stdint.h>
 #include <getopt.h>
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/signal.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 
 #ifdef HAVE_SYS_CAPABILITY_H
@@ -37,15 +42,57 @@ static unsigned obj_index;
 static const char *progname = 0;
 static unsigned monitored_pid = 0;    
 static unsigned monitored_timeout;
+static int monitored_timed_out = 0;
+
+/* The pipe to send the status of the monitored process to the batch
+   replay, or -1 */
+static int status_fd = -1;
 
 static char *rootdir = NULL;
+static unsigned jobs = 1;
+static const char *ktest_dir = NULL;
+static const char *report_file = NULL;
 static struct option long_options[] = {
   {"create-files-only", required_argument, 0, 'f'},
   {"chroot-to-dir", required_argument, 0, 'r'},
+  {"jobs", required_argument, 0, 'j'},
+  {"ktest-dir", required_argument, 0, 'd'},
+  {"report", required_argument, 0, 'o'},
   {"help", no_argument, 0, 'h'},
   {0, 0, 0, 0},
 };
 
+/* The status of a monitored process, as sent to the batch replay */
+struct replay_status {
+  int status;
+  int timed_out;
+};
+
+/* A test case being replayed by a child process */
+struct replay_slot {
+  int pid;
+  int status_fd;
+  const char *ktest;
+  struct timeval start;
+};
+
+/* A test case to replay: a .ktest file, or a test case of an archive */
+struct replay_test {
+  char *path;
+  int index;
+  char *name;
+};
+
+/* The archive of the last test case read from an archive */
+static KTestArchive *archive = NULL;
+static const char *archive_path = NULL;
+
+/* The outcomes and the times of the replayed test cases */
+struct replay_summary {
+  unsigned total, normal, abnormal, crashed, timed_out, failed;
+  double total_time, max_time;
+};
+
 static void stop_monitored(int process) {
   fprintf(stderr, "TIMEOUT: ATTEMPTING GDB EXIT\n");
   int pid = fork();
@@ -108,6 +155,7 @@ static void int_handler(int signal) {
 static void timeout_handler(int signal) {
   fprintf(stderr, "%s: EXIT STATUS: TIMED OUT (%d seconds)\n", progname, 
           monitored_timeout);
+  monitored_timed_out = 1;
   if (monitored_pid) {
     stop_monitored(monitored_pid);
     /* Kill the process group of monitored_pid.  Since we called
@@ -221,6 +269,13 @@ static void run_monitored(char *executable, int argc, char **argv) {
     /* Just in case, kill the process group of pid.  Since we called setpgrp()
        for pid, this will not kill us, or any of our ancestors */
     kill(-pid, SIGKILL);
+    if (status_fd >= 0) {
+      struct replay_status record;
+      record.status = status;
+      record.timed_out = monitored_timed_out;
+      if (write(status_fd, &record, sizeof record) != sizeof record)
+        perror("write");
+    }
     process_status(status, time(0) - start, 0);
   }
 }
@@ -244,11 +299,216 @@ void ensure_capsyschroot(const char *executable) {
 }
 #endif
 
+static double elapsed_since(const struct timeval *start) {
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return (now.tv_sec - start->tv_sec) + (now.tv_usec - start->tv_usec) / 1e6;
+}
+
+static int is_ktest_name(const struct dirent *entry) {
+  size_t n = strlen(entry->d_name);
+  return (n > 6 && strcmp(entry->d_name + n - 6, ".ktest") == 0) ||
+         (n > 7 && strcmp(entry->d_name + n - 7, ".ktests") == 0);
+}
+
+/* Append the test cases of a .ktest file or of an archive */
+static void add_test_file(char *path, struct replay_test **tests,
+                          unsigned *ntests) {
+  unsigned i, n = 1;
+  KTestArchive *a = NULL;
+  if (kTestArchive_isArchive(path)) {
+    a = kTestArchive_open(path);
+    if (!a) {
+      fprintf(stderr, "%s: error: archive %s not valid.\n", progname, path);
+      exit(1);
+    }
+    n = kTestArchive_numTests(a);
+    kTestArchive_close(a);
+  }
+
+  *tests = realloc(*tests, (*ntests + n) * sizeof(**tests));
+  for (i = 0; i != n; ++i) {
+    struct replay_test *t = &(*tests)[(*ntests)++];
+    t->path = path;
+    t->index = a ? (int) i : -1;
+    t->name = path;
+    if (a) {
+      t->name = malloc(strlen(path) + 16);
+      sprintf(t->name, "%s:%u", path, i);
+    }
+  }
+}
+
+/* Append the test case files of dir, in alphabetical order */
+static void add_ktest_dir(const char *dir, struct replay_test **tests,
+                          unsigned *ntests) {
+  struct dirent **entries;
+  int n = scandir(dir, &entries, is_ktest_name, alphasort);
+  if (n < 0) {
+    fprintf(stderr, "%s: error: cannot read directory %s.\n", progname, dir);
+    exit(1);
+  }
+  int i;
+  for (i = 0; i != n; ++i) {
+    char *path = malloc(strlen(dir) + strlen(entries[i]->d_name) + 2);
+    sprintf(path, "%s/%s", dir, entries[i]->d_name);
+    add_test_file(path, tests, ntests);
+    free(entries[i]);
+  }
+  free(entries);
+}
+
+static KTest *load_test(const struct replay_test *test) {
+  if (test->index < 0)
+    return kTest_fromFile(test->path);
+  if (!archive || archive_path != test->path) {
+    if (archive)
+      kTestArchive_close(archive);
+    archive = kTestArchive_open(test->path);
+    archive_path = test->path;
+    if (!archive)
+      return NULL;
+  }
+  return kTestArchive_get(archive, test->index);
+}
+
+/* Load a test case and start replaying it in a child process, in workdir if
+   not null. */
+static void start_test(struct replay_slot *slot, char *executable,
+                       char *argv0, const struct replay_test *test,
+                       const char *workdir, int first) {
+  int prg_argc;
+  char **prg_argv;
+  unsigned i;
+
+  input = load_test(test);
+  if (!input) {
+    fprintf(stderr, "%s: error: input file %s not valid.\n", progname,
+            test->name);
+    exit(1);
+  }
+
+  obj_index = 0;
+  prg_argc = input->numArgs;
+  prg_argv = input->args;
+  char *input_argv0 = prg_argv[0];
+  prg_argv[0] = argv0;
+  klee_init_env(&prg_argc, &prg_argv);
+
+  if (!first)
+    fprintf(stderr, "\n");
+  fprintf(stderr, "%s: TEST CASE: %s\n", progname, test->name);
+  fprintf(stderr, "%s: ARGS: ", progname);
+  for (i=0; i != (unsigned) prg_argc; ++i) {
+    char *s = prg_argv[i];
+    if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
+    fprintf(stderr, "\"%s\" ", prg_argv[i]);
+  }
+  fprintf(stderr, "\n");
+
+  /* The pipes are closed on exec, so that the program replayed gets the
+     same file descriptors as in the test case. */
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    _exit(66);
+  }
+  fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+  gettimeofday(&slot->start, 0);
+
+  /* Run the test case machinery in a subprocess, eventually this parent
+     process should be a script or something which shells out to the actual
+     execution tool. */
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    close(fds[0]);
+    status_fd = fds[1];
+    if (workdir && chdir(workdir) < 0) {
+      perror("chdir");
+      _exit(66);
+    }
+    /* Create the input files, pipes, etc., and run the process. */
+    replay_create_files(&__exe_fs);
+    run_monitored(executable, prg_argc, prg_argv);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  slot->pid = pid;
+  slot->status_fd = fds[0];
+  slot->ktest = test->name;
+  input->args[0] = input_argv0;
+  kTest_free(input);
+  input = 0;
+}
+
+/* Account for a test case whose replay has finished. */
+static void finish_test(struct replay_slot *slot,
+                        struct replay_summary *summary, FILE *report) {
+  struct replay_status record;
+  double elapsed = elapsed_since(&slot->start);
+  ssize_t n = read(slot->status_fd, &record, sizeof record);
+  close(slot->status_fd);
+
+  const char *outcome;
+  int code = 0;
+  if (n != sizeof record) {
+    /* The replay failed before running the program */
+    outcome = "FAILED";
+    ++summary->failed;
+  } else if (record.timed_out) {
+    outcome = "TIMED OUT";
+    ++summary->timed_out;
+  } else if (WIFSIGNALED(record.status)) {
+    outcome = "CRASHED";
+    code = WTERMSIG(record.status);
+    ++summary->crashed;
+  } else if (WIFEXITED(record.status) && WEXITSTATUS(record.status)) {
+    outcome = "ABNORMAL";
+    code = WEXITSTATUS(record.status);
+    ++summary->abnormal;
+  } else {
+    outcome = "NORMAL";
+    ++summary->normal;
+  }
+
+  ++summary->total;
+  summary->total_time += elapsed;
+  if (elapsed > summary->max_time)
+    summary->max_time = elapsed;
+  if (report)
+    fprintf(report, "%s,%s,%d,%.3f\n", slot->ktest, outcome, code, elapsed);
+  slot->pid = 0;
+}
+
+static void print_summary(const struct replay_summary *summary,
+                          double elapsed) {
+  fprintf(stderr, "\n%s: REPLAYED: %u test cases with %u jobs "
+          "(%.3f seconds)\n", progname, summary->total, jobs, elapsed);
+  fprintf(stderr, "%s: NORMAL: %u, ABNORMAL: %u, CRASHED: %u, "
+          "TIMED OUT: %u, FAILED: %u\n", progname, summary->normal,
+          summary->abnormal, summary->crashed, summary->timed_out,
+          summary->failed);
+  fprintf(stderr, "%s: TEST TIME: %.3f seconds total, %.3f average, "
+          "%.3f maximum\n", progname, summary->total_time,
+          summary->total ? summary->total_time / summary->total : 0.0,
+          summary->max_time);
+}
+
 static void usage(void) {
   fprintf(stderr, "Usage: %s [option]... <executable> <ktest-file>...\n", progname);
+  fprintf(stderr, "   or: %s [option]... <executable> <ktest-archive>...\n", progname);
   fprintf(stderr, "   or: %s --create-files-only <ktest-file>\n", progname);
   fprintf(stderr, "\n");
   fprintf(stderr, "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n");
+  fprintf(stderr, "-j, --jobs=N             replay N test cases at a time\n");
+  fprintf(stderr, "-d, --ktest-dir=DIR      replay the .ktest files in DIR\n");
+  fprintf(stderr, "-o, --report=FILE        write the outcome and the time of each test case\n");
+  fprintf(stderr, "                         to FILE, as comma-separated values\n");
   fprintf(stderr, "-h, --help               display this help and exit\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Use KLEE_REPLAY_TIMEOUT environment variable to set a timeout (in seconds).\n");
@@ -265,7 +525,8 @@ int main(int argc, char** argv) {
     usage();
 
   int c, opt_index;
-  while ((c = getopt_long(argc, argv, "f:r:", long_options, &opt_index)) != -1) {
+  while ((c = getopt_long(argc, argv, "f:r:j:d:o:", long_options,
+                          &opt_index)) != -1) {
     switch (c) {
       case 'f': {
         /* Special case hack for only creating files and not actually executing
@@ -294,9 +555,32 @@ int main(int argc, char** argv) {
       case 'r':
         rootdir = optarg;
         break;
+      case 'j':
+        jobs = atoi(optarg);
+        if (jobs == 0)
+          usage();
+        break;
+      case 'd':
+        ktest_dir = optarg;
+        break;
+      case 'o':
+        report_file = optarg;
+        break;
+      default:
+        usage();
     }
   }
 
+  if (optind >= argc)
+    usage();
+
+  /* The concurrent test cases each run in their own directory, which a
+     chroot jail would not contain. */
+  if (rootdir && jobs > 1) {
+    fprintf(stderr, "Error: chroot: cannot be used with more than one job.\n");
+    exit(1);
+  }
+
   /* Normal execution path ... */
 
   char* executable = argv[optind];
@@ -321,62 +605,89 @@ int main(int argc, char** argv) {
   }
   fclose(f);
 
-  int idx = 0;
-  for (idx = optind + 1; idx != argc; ++idx) {
-    char* input_fname = argv[idx];
-    unsigned i;
-    
-    input = kTest_fromFile(input_fname);
-    if (!input) {
-      fprintf(stderr, "%s: error: input file %s not valid.\n", progname, 
-              input_fname);
+  struct replay_test *tests = NULL;
+  unsigned ntests = 0;
+  int idx;
+  for (idx = optind + 1; idx != argc; ++idx)
+    add_test_file(argv[idx], &tests, &ntests);
+  if (ktest_dir)
+    add_ktest_dir(ktest_dir, &tests, &ntests);
+
+  /* The concurrent test cases run in their own directories, where the
+     relative path of the executable is not valid. */
+  char executable_path[PATH_MAX];
+  if (jobs > 1) {
+    if (!realpath(executable, executable_path)) {
+      perror("realpath");
       exit(1);
     }
-    
-    obj_index = 0;
-    prg_argc = input->numArgs;
-    prg_argv = input->args;
-    prg_argv[0] = argv[optind];
-    klee_init_env(&prg_argc, &prg_argv);
-
-    if (idx > 2)
-      fprintf(stderr, "\n");
-    fprintf(stderr, "%s: TEST CASE: %s\n", progname, input_fname);
-    fprintf(stderr, "%s: ARGS: ", progname);
-    for (i=0; i != (unsigned) prg_argc; ++i) {
-      char *s = prg_argv[i];
-      if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
-      fprintf(stderr, "\"%s\" ", prg_argv[i]); 
+    executable = executable_path;
+  }
+
+  FILE *report = NULL;
+  if (report_file) {
+    report = fopen(report_file, "w");
+    if (!report) {
+      fprintf(stderr, "Error: cannot open report file %s.\n", report_file);
+      exit(1);
     }
-    fprintf(stderr, "\n");
+    fprintf(report, "ktest,outcome,code,seconds\n");
+  }
+
+  struct replay_slot *slots = calloc(jobs, sizeof *slots);
+  struct replay_summary summary;
+  memset(&summary, 0, sizeof summary);
+  struct timeval start;
+  gettimeofday(&start, 0);
+
+  unsigned next = 0, running = 0;
+  while (next != ntests || running) {
+    /* Fill the free slots with the next test cases */
+    unsigned i;
+    for (i = 0; i != jobs && next != ntests; ++i) {
+      if (slots[i].pid)
+        continue;
+      char workdir[64];
+      if (jobs > 1) {
+        sprintf(workdir, "klee-replay-job%u", i);
+        if (mkdir(workdir, 0755) < 0 && errno != EEXIST) {
+          perror("mkdir");
+          exit(1);
+        }
+      }
+      start_test(&slots[i], executable, argv[optind], &tests[next],
+                 jobs > 1 ? workdir : NULL, next == 0);
+      ++next;
+      ++running;
+    }
+
+    /* Wait for a test case. */
+    int res, status;
+    do {
+      res = waitpid(-1, &status, 0);
+    } while (res < 0 && errno == EINTR);
 
-    /* Run the test case machinery in a subprocess, eventually this parent
-       process should be a script or something which shells out to the actual
-       execution tool. */
-    int pid = fork();
-    if (pid < 0) {
-      perror("fork");
+    if (res < 0) {
+      perror("waitpid");
       _exit(66);
-    } else if (pid == 0) {
-      /* Create the input files, pipes, etc., and run the process. */
-      replay_create_files(&__exe_fs);
-      run_monitored(executable, prg_argc, prg_argv);
-      _exit(0);
-    } else {
-      /* Wait for the test case. */
-      int res, status;
-
-      do {
-        res = waitpid(pid, &status, 0);
-      } while (res < 0 && errno == EINTR);
-      
-      if (res < 0) {
-        perror("waitpid");
-        _exit(66);
+    }
+
+    for (i = 0; i != jobs; ++i) {
+      if (slots[i].pid == res) {
+        finish_test(&slots[i], &summary, report);
+        --running;
+        break;
       }
     }
   }
 
+  /* Report the outcomes of batches of test cases */
+  if (jobs > 1 || ktest_dir || report)
+    print_summary(&summary, elapsed_since(&start));
+  if (report)
+    fclose(report);
+  free(slots);
+
   return 0;
 }
 
@@ -0,0 +1,286 @@
+//===-- CoverageReplayer.cpp ----------------------------------------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the implementation of the replayer of the test cases
+/// on a gcov-instrumented native binary enabled with -replay-coverage.
+///
+//===----------------------------------------------------------------------===//
+
+#include "CoverageReplayer.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <sstream>
+
+extern char **environ;
+
+using namespace klee;
+
+namespace {
+/// Run a command with its standard streams on /dev/null, in the directory
+/// if not empty. Returns its wait status, or -1 if it could not be run. The
+/// command is spawned rather than forked, so that the page tables of a large
+/// executor are not copied.
+int runCommand(const std::vector<std::string> &args,
+               const std::string &directory) {
+  std::vector<std::string> command;
+  if (!directory.empty()) {
+    // The directory and the arguments are given to the shell as positional
+    // parameters, so that they need no quoting
+    command.push_back("sh");
+    command.push_back("-c");
+    command.push_back("cd \"$0\" && exec \"$@\"");
+    command.push_back(directory);
+  }
+  command.insert(command.end(), args.begin(), args.end());
+
+  std::vector<char *> argv;
+  for (std::vector<std::string>::iterator it = command.begin(),
+                                          ie = command.end();
+       it != ie; ++it)
+    argv.push_back(const_cast<char *>(it->c_str()));
+  argv.push_back(0);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+  posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+  // The signals blocked in the replay threads are unblocked for the command,
+  // whose timeouts rely on SIGALRM
+  posix_spawnattr_t attributes;
+  posix_spawnattr_init(&attributes);
+  sigset_t none;
+  sigemptyset(&none);
+  posix_spawnattr_setsigmask(&attributes, &none);
+  posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+  pid_t pid;
+  int error =
+      posix_spawnp(&pid, argv[0], &actions, &attributes, &argv[0], environ);
+  posix_spawnattr_destroy(&attributes);
+  posix_spawn_file_actions_destroy(&actions);
+  if (error)
+    return -1;
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR)
+      return -1;
+  }
+  return status;
+}
+
+/// Add the count of a gcov line such as "Lines executed:85.71% of 7"
+void addGcovCount(const std::string &line, const std::string &prefix,
+                  double &covered, unsigned long &total) {
+  if (line.compare(0, prefix.size(), prefix))
+    return;
+  double percent;
+  unsigned long n;
+  if (sscanf(line.c_str() + prefix.size(), "%lf%% of %lu", &percent, &n) !=
+      2)
+    return;
+  covered += percent * n / 100;
+  total += n;
+}
+}
+
+CoverageReplayer::CoverageReplayer(const std::string &_binary,
+                                   const std::string &_replayTool,
+                                   const std::string &_gcovDirectory,
+                                   const std::string &_workDirectory,
+                                   unsigned jobs, unsigned timeout)
+    : binary(_binary), replayTool(_replayTool), gcovDirectory(_gcovDirectory),
+      workDirectory(_workDirectory), running(0), stopping(false),
+      replayedCount(0), failedCount(0) {
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&changed, 0);
+
+  // Read by klee-replay, and set before the threads start
+  std::ostringstream t;
+  t << (timeout ? timeout : 1);
+  setenv("KLEE_REPLAY_TIMEOUT", t.str().c_str(), 1);
+
+  mkdir(workDirectory.c_str(), 0775);
+  workers.resize(jobs ? jobs : 1);
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    std::ostringstream directory;
+    directory << workDirectory << "/job" << i;
+    workers[i].replayer = this;
+    workers[i].directory = directory.str();
+    mkdir(workers[i].directory.c_str(), 0775);
+  }
+  for (unsigned i = 0; i < workers.size(); ++i) {
+    pthread_t thread;
+    if (pthread_create(&thread, 0, run, &workers[i]))
+      break;
+    threads.push_back(thread);
+  }
+  if (threads.empty())
+    klee_warning("unable to start the coverage replay threads, replaying "
+                 "synchronously");
+}
+
+CoverageReplayer::~CoverageReplayer() {
+  pthread_mutex_lock(&lock);
+  stopping = true;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+  for (std::vector<pthread_t>::iterator it = threads.begin(),
+                                        ie = threads.end();
+       it != ie; ++it)
+    pthread_join(*it, 0);
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+}
+
+void *CoverageReplayer::run(void *worker) {
+  // The signals of the executor are left to the thread of the executor
+  sigset_t all;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, 0);
+
+  Worker &w = *static_cast<Worker *>(worker);
+  CoverageReplayer &r = *w.replayer;
+  pthread_mutex_lock(&r.lock);
+  for (;;) {
+    while (r.queue.empty() && !r.stopping)
+      pthread_cond_wait(&r.changed, &r.lock);
+    if (r.queue.empty())
+      break;
+    std::string ktestPath = r.queue.front();
+    r.queue.pop_front();
+    ++r.running;
+    pthread_mutex_unlock(&r.lock);
+    bool replayed = r.replay(ktestPath, w.directory);
+    pthread_mutex_lock(&r.lock);
+    --r.running;
+    if (replayed)
+      ++r.replayedCount;
+    else
+      ++r.failedCount;
+    pthread_cond_broadcast(&r.changed);
+  }
+  pthread_mutex_unlock(&r.lock);
+  return 0;
+}
+
+bool CoverageReplayer::replay(const std::string &ktestPath,
+                              const std::string &directory) {
+  std::vector<std::string> args;
+  args.push_back(replayTool);
+  args.push_back(binary);
+  args.push_back(ktestPath);
+  int status = runCommand(args, directory);
+  // klee-replay exits with 66 on its own failures, and the shell with 127
+  // when the tool is not found
+  return status >= 0 &&
+         !(WIFEXITED(status) &&
+           (WEXITSTATUS(status) == 66 || WEXITSTATUS(status) == 127));
+}
+
+bool CoverageReplayer::build(const std::string &compiler,
+                             const std::string &bitcode,
+                             const std::string &libraryDirectory,
+                             const std::string &output) {
+  // The object is compiled apart, so that the .gcno file is named after it,
+  // next to the binary
+  std::vector<std::string> compile;
+  compile.push_back(compiler);
+  compile.push_back("--coverage");
+  compile.push_back("-O0");
+  compile.push_back("-c");
+  compile.push_back(bitcode);
+  compile.push_back("-o");
+  compile.push_back(output + ".o");
+  int status = runCommand(compile, "");
+  if (status < 0 || !WIFEXITED(status) || WEXITSTATUS(status))
+    return false;
+
+  std::vector<std::string> link;
+  link.push_back(compiler);
+  link.push_back("--coverage");
+  link.push_back(output + ".o");
+  link.push_back("-L" + libraryDirectory);
+  link.push_back("-lkleeRuntest");
+  link.push_back("-Wl,-rpath," + libraryDirectory);
+  link.push_back("-o");
+  link.push_back(output);
+  status = runCommand(link, "");
+  return status >= 0 && WIFEXITED(status) && !WEXITSTATUS(status);
+}
+
+void CoverageReplayer::submit(const std::string &ktestPath) {
+  if (threads.empty()) {
+    if (replay(ktestPath, workers[0].directory))
+      ++replayedCount;
+    else
+      ++failedCount;
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  queue.push_back(ktestPath);
+  // The threads waiting for the queue to drain share the condition
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+void CoverageReplayer::wait() {
+  pthread_mutex_lock(&lock);
+  while (!queue.empty() || running)
+    pthread_cond_wait(&changed, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+std::string
+CoverageReplayer::getCoverageSummary(const std::string &gcovCommand) {
+  wait();
+
+  std::ostringstream summary;
+  summary << "KLEE: done: replayed test cases (failed) = " << replayedCount
+          << " (" << failedCount << ")\n";
+
+  // The counters of all the source files of the binary are summed. With -n
+  // gcov writes no .gcov files.
+  std::string command = "cd '" + gcovDirectory + "' && " + gcovCommand +
+                        " -n -b *.gcda 2>/dev/null";
+  FILE *f = popen(command.c_str(), "r");
+  if (!f) {
+    klee_warning("unable to run %s: %s", gcovCommand.c_str(),
+                 strerror(errno));
+    return summary.str();
+  }
+  double lines = 0, branches = 0;
+  unsigned long lineTotal = 0, branchTotal = 0;
+  char buffer[4096];
+  while (fgets(buffer, sizeof(buffer), f)) {
+    std::string line(buffer);
+    addGcovCount(line, "Lines executed:", lines, lineTotal);
+    addGcovCount(line, "Taken at least once:", branches, branchTotal);
+  }
+  pclose(f);
+
+  summary << "KLEE: done: gcov covered lines = "
+          << (unsigned long)(lines + 0.5) << " of " << lineTotal << "\n";
+  summary << "KLEE: done: gcov taken branches = "
+          << (unsigned long)(branches + 0.5) << " of " << branchTotal << "\n";
+  return summary.str();
+}
@@ -0,0 +1,96 @@
+//===-- CoverageReplayer.h --------------------------------------*- C++ -*-===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+///
+/// \file
+/// This file contains the declarations of the replayer of the test cases on
+/// a gcov-instrumented native binary enabled with -replay-coverage.
+///
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COVERAGEREPLAYER_H
+#define KLEE_COVERAGEREPLAYER_H
+
+#include <deque>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace klee {
+
+/// \brief Replayer of the test cases of a run for their native coverage.
+///
+/// The test cases are replayed with klee-replay on a native binary built
+/// with gcov instrumentation and linked with the Runtest library, by a pool
+/// of threads while the symbolic execution continues. Each thread replays
+/// in its own directory, so that the files created for the test cases do
+/// not clash. The gcov runtime of the binary merges the counters of the
+/// replays into its .gcda files, from which gcov reads the line and branch
+/// coverage of all the replayed test cases.
+class CoverageReplayer {
+  std::string binary;
+  std::string replayTool;
+
+  /// \brief The directory of the .gcno and .gcda files of the binary
+  std::string gcovDirectory;
+
+  std::string workDirectory;
+
+  std::deque<std::string> queue;
+  std::vector<pthread_t> threads;
+  unsigned running;
+  bool stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  unsigned replayedCount;
+  unsigned failedCount;
+
+  struct Worker {
+    CoverageReplayer *replayer;
+    std::string directory;
+  };
+  std::vector<Worker> workers;
+
+  static void *run(void *worker);
+
+  /// \brief Replay a test case in the directory, returning whether
+  /// klee-replay ran it
+  bool replay(const std::string &ktestPath, const std::string &directory);
+
+public:
+  /// \brief Start the threads replaying on the binary, working in
+  /// subdirectories of the work directory
+  CoverageReplayer(const std::string &_binary, const std::string &_replayTool,
+                   const std::string &_gcovDirectory,
+                   const std::string &_workDirectory, unsigned jobs,
+                   unsigned timeout);
+
+  /// \brief Replay the queued test cases and stop the threads
+  ~CoverageReplayer();
+
+  /// \brief Build a gcov-instrumented binary of the bitcode file, linked
+  /// with the Runtest library of the library directory, or return false
+  static bool build(const std::string &compiler, const std::string &bitcode,
+                    const std::string &libraryDirectory,
+                    const std::string &output);
+
+  /// \brief Queue a written .ktest file for replay
+  void submit(const std::string &ktestPath);
+
+  /// \brief Wait until the queued test cases are replayed
+  void wait();
+
+  /// \brief Wait until the queued test cases are replayed, and return the
+  /// statistics of the replays and of the coverage reported by the gcov
+  /// command, as 'KLEE: done:' lines
+  std::string getCoverageSummary(const std::string &gcovCommand);
+};
+}
+
+#endif
@@ -24,6 +24,8 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/util/TxTreeGraph.h"
 
+#include "CoverageReplayer.h"
+
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Module.h"
@@ -68,9 +70,11 @@
 #include <sys/wait.h>
 
 #include <cerrno>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
+#include <pthread.h>
 #include <sstream>
 
 
@@ -132,6 +136,72 @@ namespace {
   WriteSymPaths("write-sym-paths",
                 cl::desc("Write .sym.path files for each test case"));
 
+  cl::opt<unsigned>
+  TestWriteQueue("test-write-queue",
+                 cl::desc("Number of test cases that may wait to be written "
+                          "by a background thread, beyond which the "
+                          "execution waits for it, or 0 to write them "
+                          "synchronously (default=64)"),
+                 cl::init(64));
+
+  cl::opt<bool>
+  WriteKTestArchive("write-ktest-archive",
+                    cl::desc("Write the test cases to a single tests.ktests "
+                             "archive instead of a .ktest file each "
+                             "(default=off)"),
+                    cl::init(false));
+
+  cl::opt<bool>
+  ReplayCoverage("replay-coverage",
+                 cl::desc("Replay the test cases on a gcov-instrumented "
+                          "native binary while the run continues, and "
+                          "report their merged line and branch coverage in "
+                          "the info file (default=off)"),
+                 cl::init(false));
+
+  cl::opt<std::string>
+  ReplayCoverageBinary("replay-coverage-binary",
+                       cl::desc("The native binary replayed by "
+                                "-replay-coverage, built with --coverage and "
+                                "linked with the Runtest library, with its "
+                                ".gcno files next to it. By default it is "
+                                "built from the input bitcode in the "
+                                "coverage directory of the output "
+                                "directory."),
+                       cl::init(""));
+
+  cl::opt<std::string>
+  ReplayCoverageCompiler("replay-coverage-compiler",
+                         cl::desc("Compiler building the binary of "
+                                  "-replay-coverage (default=clang)"),
+                         cl::init("clang"));
+
+  cl::opt<std::string>
+  ReplayCoverageTool("replay-coverage-tool",
+                     cl::desc("The klee-replay executable of "
+                              "-replay-coverage (default=klee-replay)"),
+                     cl::init("klee-replay"));
+
+  cl::opt<std::string>
+  ReplayCoverageGcov("replay-coverage-gcov",
+                     cl::desc("The gcov command reading the coverage of "
+                              "-replay-coverage, e.g. \"llvm-cov gcov\" "
+                              "(default=gcov)"),
+                     cl::init("gcov"));
+
+  cl::opt<unsigned>
+  ReplayCoverageJobs("replay-coverage-jobs",
+                     cl::desc("Number of test cases replayed at a time by "
+                              "-replay-coverage (default=1)"),
+                     cl::init(1));
+
+  cl::opt<unsigned>
+  ReplayCoverageTimeout("replay-coverage-timeout",
+                        cl::desc("Time limit in seconds of the replay of a "
+                                 "test case by -replay-coverage "
+                                 "(default=10)"),
+                        cl::init(10));
+
   cl::opt<bool>
   ExitOnError("exit-on-error",
               cl::desc("Exit if errors occur"));
@@ -229,10 +299,235 @@ extern cl::opt<double> MaxTime;
 
 /***/
 
+namespace {
+/// The files of a test case, computed from its state by processTestCase
+struct TestCase {
+  /// The path of the .ktest file, or empty if there is no solution
+  std::string ktestPath;
+  std::vector<std::pair<std::string, std::vector<unsigned char> > > objects;
+
+  /// The paths and contents of the other files
+  std::vector<std::pair<std::string, std::string> > files;
+
+  std::string &addFile(const std::string &path) {
+    files.push_back(std::make_pair(path, std::string()));
+    return files.back().second;
+  }
+};
+
+/// Writes the files of the test cases on a background thread, so that the
+/// execution does not wait for the writes. At most -test-write-queue test
+/// cases wait to be written. The warnings of the writes are reported on
+/// the execution thread. The queued test cases are also written when the
+/// process exits without deleting the writer, e.g., by klee_error.
+class TestCaseWriter {
+  int argc;
+  char **argv;
+
+  /// The archive of the test cases, or null to write .ktest files
+  KTestArchive *archive;
+
+  /// The replayer of the written .ktest files, if any
+  CoverageReplayer *replayer;
+
+  std::deque<TestCase *> queue;
+  std::vector<std::string> errors;
+  bool stopping, threaded;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+
+  /// The writer whose test cases are written at exit, if any
+  static TestCaseWriter *live;
+
+  static void *run(void *self);
+  static void writeAtExit();
+  void write(const TestCase &testCase, std::vector<std::string> &errors);
+  void reportErrors();
+
+public:
+  TestCaseWriter(int _argc, char **_argv);
+  ~TestCaseWriter();
+
+  /// Queue a test case for writing, taking its ownership.
+  void submit(TestCase *testCase);
+
+  /// Write the test cases to an archive instead of .ktest files.
+  bool openArchive(const std::string &path);
+
+  /// Replay the .ktest files once written.
+  void setCoverageReplayer(CoverageReplayer *_replayer) {
+    replayer = _replayer;
+  }
+
+  /// Wait until the queued test cases are written, and finish the archive.
+  void wait();
+};
+}
+
+TestCaseWriter *TestCaseWriter::live = 0;
+
+TestCaseWriter::TestCaseWriter(int _argc, char **_argv)
+    : argc(_argc), argv(_argv), archive(0), replayer(0), stopping(false),
+      threaded(false) {
+  pthread_mutex_init(&lock, 0);
+  pthread_cond_init(&changed, 0);
+  if (TestWriteQueue)
+    threaded = pthread_create(&thread, 0, run, this) == 0;
+
+  static bool registered = false;
+  if (!registered)
+    registered = atexit(writeAtExit) == 0;
+  live = this;
+}
+
+void TestCaseWriter::writeAtExit() {
+  if (live)
+    live->wait();
+}
+
+TestCaseWriter::~TestCaseWriter() {
+  if (live == this)
+    live = 0;
+  if (threaded) {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, 0);
+  }
+  if (archive && !kTestArchive_close(archive))
+    errors.push_back("unable to write the test case archive");
+  reportErrors();
+  pthread_cond_destroy(&changed);
+  pthread_mutex_destroy(&lock);
+}
+
+void *TestCaseWriter::run(void *self) {
+  TestCaseWriter &w = *static_cast<TestCaseWriter *>(self);
+  std::vector<std::string> errors;
+  pthread_mutex_lock(&w.lock);
+  for (;;) {
+    while (w.queue.empty() && !w.stopping)
+      pthread_cond_wait(&w.changed, &w.lock);
+    if (w.queue.empty())
+      break;
+    TestCase *testCase = w.queue.front();
+    pthread_mutex_unlock(&w.lock);
+    w.write(*testCase, errors);
+    delete testCase;
+    pthread_mutex_lock(&w.lock);
+    w.errors.insert(w.errors.end(), errors.begin(), errors.end());
+    errors.clear();
+    w.queue.pop_front();
+    pthread_cond_broadcast(&w.changed);
+  }
+  pthread_mutex_unlock(&w.lock);
+  return 0;
+}
+
+void TestCaseWriter::write(const TestCase &testCase,
+                           std::vector<std::string> &errors) {
+  if (!testCase.ktestPath.empty()) {
+    KTest b;
+    b.numArgs = argc;
+    b.args = argv;
+    b.symArgvs = 0;
+    b.symArgvLen = 0;
+    b.numObjects = testCase.objects.size();
+    b.objects = new KTestObject[b.numObjects];
+    assert(b.objects);
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &b.objects[i];
+      o->name = const_cast<char*>(testCase.objects[i].first.c_str());
+      o->numBytes = testCase.objects[i].second.size();
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(testCase.objects[i].second.begin(),
+                testCase.objects[i].second.end(), o->bytes);
+    }
+
+    if (archive ? !kTestArchive_add(archive, &b)
+                : !kTest_toFile(&b, testCase.ktestPath.c_str())) {
+      errors.push_back("unable to write output test case, losing it");
+    } else if (replayer && !archive) {
+      replayer->submit(testCase.ktestPath);
+    }
+
+    for (unsigned i=0; i<b.numObjects; i++)
+      delete[] b.objects[i].bytes;
+    delete[] b.objects;
+  }
+
+  for (std::vector<std::pair<std::string, std::string> >::const_iterator
+           it = testCase.files.begin(),
+           ie = testCase.files.end();
+       it != ie; ++it) {
+    std::ofstream f(it->first.c_str(), std::ios::out | std::ios::binary);
+    f.write(it->second.data(), it->second.size());
+    f.close();
+    if (f.fail())
+      errors.push_back("error writing file \"" + it->first +
+                       "\".  KLEE may have run out of file descriptors: try "
+                       "to increase the maximum number of open file "
+                       "descriptors by using ulimit.");
+  }
+}
+
+void TestCaseWriter::reportErrors() {
+  std::vector<std::string> reported;
+  pthread_mutex_lock(&lock);
+  reported.swap(errors);
+  pthread_mutex_unlock(&lock);
+  for (std::vector<std::string>::iterator it = reported.begin(),
+                                          ie = reported.end();
+       it != ie; ++it)
+    klee_warning("%s", it->c_str());
+}
+
+void TestCaseWriter::submit(TestCase *testCase) {
+  if (!threaded) {
+    write(*testCase, errors);
+    delete testCase;
+    reportErrors();
+    return;
+  }
+  pthread_mutex_lock(&lock);
+  while (queue.size() >= TestWriteQueue)
+    pthread_cond_wait(&changed, &lock);
+  queue.push_back(testCase);
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+  reportErrors();
+}
+
+bool TestCaseWriter::openArchive(const std::string &path) {
+  archive = kTestArchive_create(path.c_str());
+  return archive != 0;
+}
+
+void TestCaseWriter::wait() {
+  if (threaded) {
+    pthread_mutex_lock(&lock);
+    while (!queue.empty())
+      pthread_cond_wait(&changed, &lock);
+    pthread_mutex_unlock(&lock);
+  }
+  // No test case is being written once the queue is empty
+  if (archive) {
+    if (!kTestArchive_close(archive))
+      errors.push_back("unable to write the test case archive");
+    archive = 0;
+  }
+  reportErrors();
+}
+
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
   TreeStreamWriter *m_pathWriter, *m_symPathWriter;
+  TestCaseWriter *m_testCaseWriter;
+  CoverageReplayer *m_coverageReplayer;
   llvm::raw_ostream *m_infoFile;
 
   SmallString<128> m_outputDirectory;
@@ -383,6 +678,19 @@ public:
                        const char *errorMessage,
                        const char *errorSuffix);
 
+  /// Wait until the files of the test cases are written.
+  void flushTestCases() { m_testCaseWriter->wait(); }
+
+  /// Start replaying the test cases under -replay-coverage.
+  void startCoverageReplay(const std::string &libraryDirectory);
+
+  /// The statistics of -replay-coverage, once the replays are done.
+  std::string getCoverageSummary() {
+    return m_coverageReplayer
+               ? m_coverageReplayer->getCoverageSummary(ReplayCoverageGcov)
+               : std::string();
+  }
+
   std::string getOutputFilename(const std::string &filename);
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename);
   std::string getTestFilename(const std::string &suffix, unsigned id);
@@ -399,7 +707,8 @@ public:
 };
 
 KleeHandler::KleeHandler(int argc, char **argv)
-    : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0), m_infoFile(0),
+    : m_interpreter(0), m_pathWriter(0), m_symPathWriter(0),
+      m_coverageReplayer(0), m_infoFile(0),
       m_outputDirectory(), m_testIndex(0), m_pathsExplored(0),
       m_totalBranchingDepthOnExitTermination(0),
       m_totalInstructionsDepthOnExitTermination(0),
@@ -413,6 +722,7 @@ KleeHandler::KleeHandler(int argc, char **argv)
       m_earlyTerminationTest(0), m_errorTermination(0),
       m_errorTerminationTest(0), m_exitTermination(0), m_exitTerminationTest(0),
       m_otherTermination(0), m_argc(argc), m_argv(argv) {
+  m_testCaseWriter = new TestCaseWriter(m_argc, m_argv);
 
   // create output directory (OutputDir or "klee-out-<i>")
   bool dir_given = OutputDir != "";
@@ -480,9 +790,19 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
   // open info
   m_infoFile = openOutputFile("info");
+
+  if (WriteKTestArchive) {
+    file_path = getOutputFilename("tests.ktests");
+    if (!m_testCaseWriter->openArchive(file_path))
+      klee_error("cannot open file \"%s\": %s", file_path.c_str(),
+                 strerror(errno));
+  }
 }
 
 KleeHandler::~KleeHandler() {
+  // The test case writer submits the test cases to the replayer
+  delete m_testCaseWriter;
+  delete m_coverageReplayer;
   if (m_pathWriter) delete m_pathWriter;
   if (m_symPathWriter) delete m_symPathWriter;
   fclose(klee_warning_file);
@@ -490,6 +810,45 @@ KleeHandler::~KleeHandler() {
   delete m_infoFile;
 }
 
+void KleeHandler::startCoverageReplay(const std::string &libraryDirectory) {
+  if (WriteKTestArchive) {
+    klee_warning("-replay-coverage does not replay the test cases of "
+                 "-write-ktest-archive");
+    return;
+  }
+
+  std::string directory = getOutputFilename("coverage");
+  if (mkdir(directory.c_str(), 0775) < 0)
+    klee_error("cannot create \"%s\": %s", directory.c_str(),
+               strerror(errno));
+
+  // The replays run in other directories, so the binary path is absolute
+  SmallString<128> binary(ReplayCoverageBinary);
+  if (ReplayCoverageBinary.empty()) {
+    binary = directory;
+    sys::path::append(binary, "program");
+    SmallString<128> bitcode(InputFile);
+    sys::fs::make_absolute(bitcode);
+    klee_message("building the coverage binary \"%s\"", binary.c_str());
+    if (!CoverageReplayer::build(ReplayCoverageCompiler, bitcode.c_str(),
+                                 libraryDirectory, binary.c_str())) {
+      klee_warning("unable to build the coverage binary with %s, not "
+                   "replaying the test cases",
+                   ReplayCoverageCompiler.c_str());
+      return;
+    }
+  } else {
+    sys::fs::make_absolute(binary);
+  }
+
+  SmallString<128> gcovDirectory(binary);
+  sys::path::remove_filename(gcovDirectory);
+  m_coverageReplayer = new CoverageReplayer(
+      binary.c_str(), ReplayCoverageTool, gcovDirectory.c_str(), directory,
+      ReplayCoverageJobs, ReplayCoverageTimeout);
+  m_testCaseWriter->setCoverageReplayer(m_coverageReplayer);
+}
+
 void KleeHandler::setInterpreter(Interpreter *i) {
   m_interpreter = i;
 
@@ -555,9 +914,10 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     llvm::errs() << "EXITING ON ERROR:\n" << errorMessage << "\n";
     if (INTERPOLATION_ENABLED) {
       TxTreeGraph::setError(state, TxTreeGraph::GENERIC);
-      TxTreeGraph::save(getOutputFilename("tree.dot"));
+      TxTreeGraph::save();
       TxTreeGraph::deallocate();
     }
+    flushTestCases();
     exit(1);
   }
 
@@ -572,102 +932,82 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     unsigned id = ++m_testIndex;
 
-    if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
-
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-        klee_warning("unable to write output test case, losing it");
-      }
+    // The contents of the files are computed here, from the state, and
+    // written by the test case writer.
+    TestCase *testCase = new TestCase();
 
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
+    if (success) {
+      testCase->ktestPath = getOutputFilename(getTestFilename("ktest", id));
+      testCase->objects.swap(out);
     }
 
     if (errorMessage) {
-      llvm::raw_ostream *f = openTestFile(errorSuffix, id);
-      *f << errorMessage;
-      delete f;
+      testCase->addFile(getOutputFilename(getTestFilename(errorSuffix, id))) =
+          errorMessage;
     }
 
     if (m_pathWriter) {
       std::vector<unsigned char> concreteBranches;
       m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
                                concreteBranches);
-      llvm::raw_fd_ostream *f = openTestFile("path", id);
+      std::string &f =
+          testCase->addFile(getOutputFilename(getTestFilename("path", id)));
       for (std::vector<unsigned char>::iterator I = concreteBranches.begin(),
                                                 E = concreteBranches.end();
            I != E; ++I) {
-        *f << *I << "\n";
+        f += *I;
+        f += '\n';
       }
-      delete f;
     }
 
     if (errorMessage || WritePCs) {
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      llvm::raw_ostream *f = openTestFile("pc", id);
-      *f << constraints;
-      delete f;
+      m_interpreter->getConstraintLog(
+          state,
+          testCase->addFile(getOutputFilename(getTestFilename("pc", id))),
+          Interpreter::KQUERY);
     }
 
     if (WriteCVCs) {
       // FIXME: If using Z3 as the core solver the emitted file is actually
       // SMT-LIBv2 not CVC which is a bit confusing
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      llvm::raw_ostream *f = openTestFile("cvc", id);
-      *f << constraints;
-      delete f;
+      m_interpreter->getConstraintLog(
+          state,
+          testCase->addFile(getOutputFilename(getTestFilename("cvc", id))),
+          Interpreter::STP);
     }
 
     if(WriteSMT2s) {
-      std::string constraints;
-        m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        llvm::raw_ostream *f = openTestFile("smt2", id);
-        *f << constraints;
-        delete f;
+      m_interpreter->getConstraintLog(
+          state,
+          testCase->addFile(getOutputFilename(getTestFilename("smt2", id))),
+          Interpreter::SMTLIB2);
     }
 
     if (m_symPathWriter) {
       std::vector<unsigned char> symbolicBranches;
       m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
                                   symbolicBranches);
-      llvm::raw_fd_ostream *f = openTestFile("sym.path", id);
+      std::string &f =
+          testCase->addFile(getOutputFilename(getTestFilename("sym.path", id)));
       for (std::vector<unsigned char>::iterator I = symbolicBranches.begin(), E = symbolicBranches.end(); I!=E; ++I) {
-        *f << *I << "\n";
+        f += *I;
+        f += '\n';
       }
-      delete f;
     }
 
     if (WriteCov) {
       std::map<const std::string*, std::set<unsigned> > cov;
       m_interpreter->getCoveredLines(state, cov);
-      llvm::raw_ostream *f = openTestFile("cov", id);
+      llvm::raw_string_ostream f(
+          testCase->addFile(getOutputFilename(getTestFilename("cov", id))));
       for (std::map<const std::string*, std::set<unsigned> >::iterator
              it = cov.begin(), ie = cov.end();
            it != ie; ++it) {
         for (std::set<unsigned>::iterator
                it2 = it->second.begin(), ie = it->second.end();
              it2 != ie; ++it2)
-          *f << *it->first << ":" << *it2 << "\n";
+          f << *it->first << ":" << *it2 << "\n";
       }
-      delete f;
     }
 
     if (m_testIndex == StopAfterNTests)
@@ -675,11 +1015,13 @@ void KleeHandler::processTestCase(const ExecutionState &state,
 
     if (WriteTestInfo) {
       double elapsed_time = util::getWallTime() - start_time;
-      llvm::raw_ostream *f = openTestFile("info", id);
-      *f << "Time to generate test case: "
+      llvm::raw_string_ostream f(
+          testCase->addFile(getOutputFilename(getTestFilename("info", id))));
+      f << "Time to generate test case: "
          << elapsed_time << "s\n";
-      delete f;
     }
+
+    m_testCaseWriter->submit(testCase);
   }
 }
 
@@ -709,7 +1051,8 @@ void KleeHandler::getKTestFilesInDir(std::string directoryPath,
   for (llvm::sys::fs::directory_iterator i(directoryPath, ec), e; i != e && !ec;
        i.increment(ec)) {
     std::string f = (*i).path();
-    if (f.substr(f.size()-6,f.size()) == ".ktest") {
+    if (f.substr(f.size()-6,f.size()) == ".ktest" ||
+        (f.size() > 7 && f.substr(f.size()-7) == ".ktests")) {
           results.push_back(f);
     }
   }
@@ -1150,6 +1493,32 @@ static char *format_tdiff(char *buf, long seconds)
   return buf;
 }
 
+/// Append the test case of a .ktest file, or the test cases of an archive,
+/// returning false if the file cannot be read
+static bool readKTests(const std::string &path, std::vector<KTest *> &kTests) {
+  if (!kTestArchive_isArchive(path.c_str())) {
+    KTest *out = kTest_fromFile(path.c_str());
+    if (out)
+      kTests.push_back(out);
+    return out != 0;
+  }
+
+  KTestArchive *archive = kTestArchive_open(path.c_str());
+  if (!archive)
+    return false;
+  bool success = true;
+  for (unsigned i = 0, n = kTestArchive_numTests(archive); i < n; ++i) {
+    KTest *out = kTestArchive_get(archive, i);
+    if (!out) {
+      success = false;
+      break;
+    }
+    kTests.push_back(out);
+  }
+  kTestArchive_close(archive);
+  return success;
+}
+
 #ifndef SUPPORT_KLEE_UCLIBC
 static llvm::Module *linkWithUclibc(llvm::Module *mainModule, StringRef libDir) {
   klee_error("invalid libc, no uclibc support!\n");
@@ -1526,6 +1895,8 @@ int main(int argc, char **argv, char **envp) {
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
   KleeHandler *handler = new KleeHandler(pArgc, pArgv);
+  if (ReplayCoverage)
+    handler->startCoverageReplay(LibraryDir);
   Interpreter *interpreter =
     theInterpreter = Interpreter::create(IOpts, handler);
   handler->setInterpreter(interpreter);
@@ -1563,12 +1934,8 @@ int main(int argc, char **argv, char **envp) {
     for (std::vector<std::string>::iterator it = kTestFiles.begin(),
                                             ie = kTestFiles.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (out) {
-        kTests.push_back(out);
-      } else {
+      if (!readKTests(*it, kTests))
         klee_warning("unable to open: %s\n", (*it).c_str());
-      }
     }
 
     if (RunInDir != "") {
@@ -1587,7 +1954,7 @@ int main(int argc, char **argv, char **envp) {
       interpreter->setReplayKTest(out);
       llvm::errs() << "KLEE: replaying: " << *it << " (" << kTest_numBytes(out)
                    << " bytes)"
-                   << " (" << ++i << "/" << kTestFiles.size() << ")\n";
+                   << " (" << ++i << "/" << kTests.size() << ")\n";
       // XXX should put envp in .ktest ?
       interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
       if (interrupted) break;
@@ -1602,11 +1969,9 @@ int main(int argc, char **argv, char **envp) {
     for (std::vector<std::string>::iterator
            it = SeedOutFile.begin(), ie = SeedOutFile.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (!out) {
+      if (!readKTests(*it, seeds)) {
         klee_error("unable to open: %s\n", (*it).c_str());
       }
-      seeds.push_back(out);
     }
     for (std::vector<std::string>::iterator
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
@@ -1616,11 +1981,9 @@ int main(int argc, char **argv, char **envp) {
       for (std::vector<std::string>::iterator it2 = kTestFiles.begin(),
                                               ie = kTestFiles.end();
            it2 != ie; ++it2) {
-        KTest *out = kTest_fromFile(it2->c_str());
-        if (!out) {
+        if (!readKTests(*it2, seeds)) {
           klee_error("unable to open: %s\n", (*it2).c_str());
         }
-        seeds.push_back(out);
       }
       if (kTestFiles.empty()) {
         klee_error("seeds directory is empty: %s\n", (*it).c_str());
@@ -1656,6 +2019,9 @@ int main(int argc, char **argv, char **envp) {
   strcpy(format_tdiff(buf, t[1] - t[0]), "\n");
   handler->getInfoStream() << buf;
 
+  // The test cases being written refer to the args.
+  handler->flushTestCases();
+
   // Free all the args.
   for (unsigned i=0; i<InputArgv.size()+1; i++)
     delete[] pArgv[i];
@@ -1677,6 +2043,14 @@ int main(int argc, char **argv, char **envp) {
     *theStatisticManager->getStatisticByName("Instructions");
   uint64_t forks =
     *theStatisticManager->getStatisticByName("Forks");
+  uint64_t resolutions =
+    *theStatisticManager->getStatisticByName("Resolutions");
+  uint64_t resolveQueries =
+    *theStatisticManager->getStatisticByName("ResolveQueries");
+  uint64_t functionSummaryHits =
+    *theStatisticManager->getStatisticByName("FunctionSummaryHits");
+  uint64_t rangeDecidedBranches =
+    *theStatisticManager->getStatisticByName("RangeDecidedBranches");
 
   handler->getInfoStream()
     << "KLEE: done: explored paths = " << 1 + forks << "\n";
@@ -1692,6 +2066,22 @@ int main(int argc, char **argv, char **envp) {
     << "KLEE: done: valid queries = " << queriesValid << "\n"
     << "KLEE: done: invalid queries = " << queriesInvalid << "\n"
     << "KLEE: done: query cex = " << queryCounterexamples << "\n";
+  if (resolutions)
+    handler->getInfoStream()
+      << "KLEE: done: symbolic pointer resolutions = " << resolutions << "\n"
+      << "KLEE: done: avg. queries per resolution = "
+      << (double) resolveQueries / resolutions << "\n";
+  if (functionSummaryHits)
+    handler->getInfoStream()
+      << "KLEE: done: function summary hits = " << functionSummaryHits << "\n";
+  if (rangeDecidedBranches)
+    handler->getInfoStream() << "KLEE: done: branches decided by ranges = "
+                             << rangeDecidedBranches << "\n";
+  if (Expr::equalHashCompares)
+    handler->getInfoStream()
+        << "KLEE: done: expression comparisons of equal hashes (collisions) = "
+        << Expr::equalHashCompares << " (" << Expr::hashCollisions << ")\n";
+  handler->getInfoStream() << handler->getCoverageSummary();
 
   std::stringstream stats;
   if (INTERPOLATION_ENABLED) {
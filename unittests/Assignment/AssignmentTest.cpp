@@ -33,3 +33,50 @@ TEST(AssignmentTest, FoldNotOptimized)
   ASSERT_TRUE(asConstant != NULL);
   ASSERT_EQ(asConstant->getZExtValue(), (unsigned) 128);
 }
+
+TEST(AssignmentTest, CompiledEvaluation)
+{
+  ArrayCache ac;
+  const Array* array = ac.CreateArray("compiled_array", /*size=*/ 4);
+  std::vector<const Array*> objects;
+  std::vector<unsigned char> value;
+  std::vector< std::vector<unsigned char> > values;
+  objects.push_back(array);
+  value.push_back(0x80);
+  value.push_back(3);
+  value.push_back(0);
+  value.push_back(0xff);
+  values.push_back(value);
+  Assignment assignment(objects, values);
+
+  // Signed arithmetic, an update at a symbolic index and a division by
+  // zero, compared with the evaluation of ExprEvaluator
+  ref<Expr> b0 = Expr::createTempRead(array, Expr::Int8);
+  ref<Expr> b1 = ReadExpr::create(UpdateList(array, 0),
+                                  ConstantExpr::create(1, Expr::Int32));
+  ref<Expr> b2 = ReadExpr::create(UpdateList(array, 0),
+                                  ConstantExpr::create(2, Expr::Int32));
+  UpdateList ul(array, 0);
+  ul.extend(ZExtExpr::create(b1, Expr::Int32),
+            ConstantExpr::create(42, Expr::Int8));
+  std::vector<ref<Expr> > exprs;
+  exprs.push_back(SDivExpr::create(SExtExpr::create(b0, Expr::Int32),
+                                   ZExtExpr::create(b1, Expr::Int32)));
+  exprs.push_back(AShrExpr::create(b0, b1));
+  exprs.push_back(SltExpr::create(b0, b1));
+  exprs.push_back(ReadExpr::create(ul, ConstantExpr::create(3, Expr::Int32)));
+  exprs.push_back(ReadExpr::create(ul, ConstantExpr::create(2, Expr::Int32)));
+  exprs.push_back(ConcatExpr::create(b1, b0));
+  for (unsigned i = 0; i < exprs.size(); ++i) {
+    CompiledExpr compiled(exprs[i]);
+    uint64_t result;
+    ASSERT_TRUE(compiled.evaluate(assignment, result));
+    ref<Expr> evaluated = assignment.evaluate(exprs[i]);
+    ASSERT_TRUE(isa<ConstantExpr>(evaluated));
+    ASSERT_EQ(cast<ConstantExpr>(evaluated)->getZExtValue(), result);
+  }
+
+  CompiledExpr division(UDivExpr::create(b1, b2));
+  uint64_t result;
+  ASSERT_FALSE(division.evaluate(assignment, result));
+}
@@ -10,7 +10,9 @@
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
 #include "klee/util/ArrayCache.h"
 
 using namespace klee;
@@ -113,4 +115,112 @@ TEST(ExprTest, ExtractConcat) {
   EXPECT_EQ(Expr::Extract, concat2->getKid(1)->getKind());
 }
 
+TEST(ExprTest, HashConsing) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr4", 256);
+  UpdateList ul(array, 0);
+  ExprBuilder *builder =
+      createHashConsingExprBuilder(createDefaultExprBuilder());
+
+  ref<Expr> read1 = builder->Read(ul, builder->Constant(0, 32));
+  ref<Expr> read2 = builder->Read(ul, builder->Constant(0, 32));
+  EXPECT_EQ(read1.get(), read2.get());
+
+  ref<Expr> add1 = builder->Add(read1, builder->Constant(1, 8));
+  ref<Expr> add2 = builder->Add(read2, builder->Constant(1, 8));
+  EXPECT_EQ(add1.get(), add2.get());
+
+  ref<Expr> add3 = builder->Add(read1, builder->Constant(2, 8));
+  EXPECT_NE(add1.get(), add3.get());
+
+  delete builder;
+}
+
+TEST(ExprTest, SmallConstants) {
+  // The folded constants are shared with the equal constants
+  ref<ConstantExpr> sum =
+      ConstantExpr::alloc(40, Expr::Int32)->Add(ConstantExpr::alloc(2, 32));
+  EXPECT_EQ(ConstantExpr::alloc(42, Expr::Int32).get(), sum.get());
+  EXPECT_EQ(ConstantExpr::alloc(llvm::APInt(32, 42)).get(), sum.get());
+
+  // but not with those of another width
+  EXPECT_NE(ConstantExpr::alloc(42, Expr::Int64).get(), sum.get());
+  EXPECT_EQ(64U, ConstantExpr::alloc(42, Expr::Int64)->getWidth());
+
+  // The values are truncated to the width
+  EXPECT_EQ(0xFFU, ConstantExpr::alloc(~0ULL, Expr::Int8)->getZExtValue());
+
+  ref<ConstantExpr> wide = ConstantExpr::alloc(llvm::APInt(128, 42));
+  EXPECT_EQ(128U, wide->getWidth());
+  EXPECT_EQ(42U, wide->getZExtValue(128));
+}
+
+TEST(ExprTest, ReadArrays) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr5", 256);
+  const Array *array2 = ac.CreateArray("arr6", 256);
+  const Array *array3 = ac.CreateArray("arr7", 256);
+  ref<Expr> read8 = Expr::createTempRead(array, 8);
+
+  // The index of a read and the updates of its array are read too
+  UpdateList ul(array2, 0);
+  ul.extend(getConstant(0, 32), Expr::createTempRead(array3, 8));
+  ref<Expr> read8_2 = ReadExpr::create(ul, ZExtExpr::create(read8, 32));
+
+  ref<Expr> add = AddExpr::create(read8, read8_2);
+  EXPECT_EQ(3U, add->getReadArrays().size());
+  EXPECT_EQ(0U, getConstant(1, 8)->getReadArrays().size());
+
+  std::set<const Array *> arrays;
+  arrays.insert(array);
+  EXPECT_TRUE(add->readsArrayIn(arrays));
+  EXPECT_TRUE(add->readsArrayNotIn(arrays));
+  EXPECT_TRUE(read8->readsArrayIn(arrays));
+  EXPECT_FALSE(read8->readsArrayNotIn(arrays));
+}
+
+TEST(ExprTest, ConstraintRanges) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr8", 256);
+  ref<Expr> read8 = Expr::createTempRead(array, 8);
+  ref<Expr> lower = UleExpr::create(getConstant(10, 8), read8);
+  ref<Expr> upper = UltExpr::create(read8, getConstant(20, 8));
+  ConstraintManager constraints;
+  constraints.addConstraint(lower);
+  constraints.addConstraint(upper);
+
+  // 10 <= x < 20 implies x < 30 by its upper bound
+  bool value;
+  std::vector<ref<Expr> > core;
+  EXPECT_TRUE(constraints.evaluateRange(
+      UltExpr::create(read8, getConstant(30, 8)), value, core));
+  EXPECT_TRUE(value);
+  ASSERT_EQ(1U, core.size());
+  EXPECT_EQ(upper, core[0]);
+
+  // and x != 5, also when x is extended, by its lower bound
+  core.clear();
+  EXPECT_TRUE(constraints.evaluateRange(
+      EqExpr::create(getConstant(5, 32), ZExtExpr::create(read8, 32)), value,
+      core));
+  EXPECT_FALSE(value);
+  ASSERT_EQ(1U, core.size());
+  EXPECT_EQ(lower, core[0]);
+
+  // x != 10 narrows the lower bound
+  ref<Expr> disequality = Expr::createIsZero(
+      EqExpr::create(getConstant(10, 8), read8));
+  constraints.addConstraint(disequality);
+  core.clear();
+  EXPECT_TRUE(constraints.evaluateRange(
+      UltExpr::create(getConstant(10, 8), read8), value, core));
+  EXPECT_TRUE(value);
+  EXPECT_EQ(2U, core.size());
+
+  core.clear();
+  EXPECT_FALSE(constraints.evaluateRange(
+      UltExpr::create(read8, getConstant(15, 8)), value, core));
+  EXPECT_TRUE(core.empty());
+}
+
 }
@@ -14,9 +14,12 @@
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
+#include "klee/SolverImpl.h"
 #include "klee/util/ArrayCache.h"
 #include "llvm/ADT/StringExtras.h"
 
+#include <unistd.h>
+
 using namespace klee;
 
 namespace {
@@ -166,4 +169,156 @@ TEST(SolverTest, Evaluation) {
   delete solver;
 }
 
+TEST(SolverTest, RangeSolver) {
+  // The dummy solver fails every query, so the queries answered are the
+  // ones decided from the bounds.
+  Solver *solver = createRangeSolver(createDummySolver());
+
+  const Array *array = ac.CreateArray("range", 4);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  ConstraintManager constraints;
+  ref<Expr> lower = UltExpr::create(getConstant(10, Expr::Int32), x);
+  ref<Expr> upper = UleExpr::create(x, getConstant(20, Expr::Int32));
+  constraints.addConstraint(lower);
+  constraints.addConstraint(upper);
+
+  bool res;
+  std::vector<ref<Expr> > core;
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints, UltExpr::create(x, getConstant(21, Expr::Int32))),
+      res, core));
+  EXPECT_TRUE(res);
+  ASSERT_EQ(1u, core.size());
+  EXPECT_EQ(upper, core[0]);
+
+  ASSERT_TRUE(solver->mustBeTrue(
+      Query(constraints, UleExpr::create(getConstant(11, Expr::Int32), x)),
+      res, core));
+  EXPECT_TRUE(res);
+  ASSERT_EQ(1u, core.size());
+  EXPECT_EQ(lower, core[0]);
+
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(
+      Query(constraints, EqExpr::create(getConstant(5, Expr::Int32), x)),
+      validity, core));
+  EXPECT_EQ(Solver::False, validity);
+  ASSERT_EQ(1u, core.size());
+  EXPECT_EQ(lower, core[0]);
+
+  // The bounds do not decide this one.
+  EXPECT_FALSE(solver->mustBeTrue(
+      Query(constraints, UltExpr::create(x, getConstant(15, Expr::Int32))),
+      res, core));
+
+  delete solver;
+}
+
+/// A solver answering only its first query, as valid with the given core
+class OnceSolverImpl : public SolverImpl {
+  std::vector<ref<Expr> > core;
+  bool answered;
+
+public:
+  OnceSolverImpl(const std::vector<ref<Expr> > &_core)
+      : core(_core), answered(false) {}
+
+  bool computeTruth(const Query &, bool &isValid,
+                    std::vector<ref<Expr> > &unsatCore) {
+    if (answered)
+      return false;
+    answered = true;
+    isValid = true;
+    unsatCore = core;
+    return true;
+  }
+  bool computeValue(const Query &, ref<Expr> &) { return false; }
+  bool computeInitialValues(const Query &, const std::vector<const Array *> &,
+                            std::vector<std::vector<unsigned char> > &,
+                            bool &, std::vector<ref<Expr> > &) {
+    return false;
+  }
+  SolverRunStatus getOperationStatusCode() { return SOLVER_RUN_STATUS_FAILURE; }
+};
+
+TEST(SolverTest, UnsatCoreCachingSolver) {
+  ref<Expr> x = Expr::createTempRead(ac.CreateArray("coreX", 4), Expr::Int32);
+  ref<Expr> y = Expr::createTempRead(ac.CreateArray("coreY", 4), Expr::Int32);
+  ref<Expr> lower = UltExpr::create(getConstant(10, Expr::Int32), x);
+  ref<Expr> other = UltExpr::create(y, getConstant(3, Expr::Int32));
+  ref<Expr> expr = UltExpr::create(getConstant(5, Expr::Int32), x);
+
+  Solver *solver = createUnsatCoreCachingSolver(
+      new Solver(new OnceSolverImpl(std::vector<ref<Expr> >(1, lower))));
+
+  ConstraintManager first;
+  first.addConstraint(lower);
+  bool res;
+  std::vector<ref<Expr> > core;
+  ASSERT_TRUE(solver->mustBeTrue(Query(first, expr), res, core));
+  EXPECT_TRUE(res);
+
+  // A query with more constraints has the core, so the cache answers it
+  ConstraintManager second;
+  second.addConstraint(other);
+  second.addConstraint(lower);
+  core.clear();
+  ASSERT_TRUE(solver->mustBeTrue(Query(second, expr), res, core));
+  EXPECT_TRUE(res);
+  ASSERT_EQ(1u, core.size());
+  EXPECT_EQ(lower, core[0]);
+
+  // The negation of the query is known to be false
+  Solver::Validity validity;
+  ASSERT_TRUE(solver->evaluate(Query(second, Expr::createIsZero(expr)),
+                               validity, core));
+  EXPECT_EQ(Solver::False, validity);
+
+  // Without the core, the query goes to the solver, which fails
+  ConstraintManager third;
+  third.addConstraint(other);
+  EXPECT_FALSE(solver->mustBeTrue(Query(third, expr), res, core));
+
+  delete solver;
+}
+
+TEST(SolverTest, PersistentCachingSolver) {
+  const char *path = "SolverTest.querycache";
+  unlink(path);
+
+  ref<Expr> x = Expr::createTempRead(ac.CreateArray("runX", 4), Expr::Int32);
+  ref<Expr> lower = UltExpr::create(getConstant(10, Expr::Int32), x);
+  ref<Expr> expr = UltExpr::create(getConstant(5, Expr::Int32), x);
+
+  Solver *solver = createPersistentCachingSolver(
+      new Solver(new OnceSolverImpl(std::vector<ref<Expr> >(1, lower))), path,
+      1 << 20);
+  ConstraintManager first;
+  first.addConstraint(lower);
+  bool res;
+  std::vector<ref<Expr> > core;
+  ASSERT_TRUE(solver->mustBeTrue(Query(first, expr), res, core));
+  EXPECT_TRUE(res);
+  delete solver;
+
+  // The next run names its array apart, and gets the answer of the file
+  // with the core of its own constraints, without calling its solver
+  ref<Expr> y = Expr::createTempRead(ac.CreateArray("runY", 4), Expr::Int32);
+  ref<Expr> lowerY = UltExpr::create(getConstant(10, Expr::Int32), y);
+  ref<Expr> exprY = UltExpr::create(getConstant(5, Expr::Int32), y);
+  solver = createPersistentCachingSolver(
+      new Solver(new OnceSolverImpl(std::vector<ref<Expr> >())), path,
+      1 << 20);
+  ConstraintManager second;
+  second.addConstraint(lowerY);
+  core.clear();
+  ASSERT_TRUE(solver->mustBeTrue(Query(second, exprY), res, core));
+  EXPECT_TRUE(res);
+  ASSERT_EQ(1u, core.size());
+  EXPECT_EQ(lowerY, core[0]);
+  delete solver;
+
+  unlink(path);
+}
+
 }
@@ -0,0 +1,204 @@
+//===-- TxBenchmarkTest.cpp -----------------------------------------------===//
+//
+//               The Tracer-X KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Microbenchmarks of the Tracer-X data structures on synthetic stores, path
+// conditions and tables. The size of the synthetic data is given by the
+// TX_BENCHMARK_SIZE environment variable, and is small by default so that
+// the benchmarks also run as quick tests. The times are printed to the
+// error stream.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "TxPathCondition.h"
+#include "TxShadowArray.h"
+#include "TxStore.h"
+#include "TxTree.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Expr.h"
+#include "klee/Internal/Module/TxValues.h"
+#include "klee/Internal/Support/Timer.h"
+#include "klee/util/ArrayCache.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/BasicBlock.h"
+#include "llvm/DerivedTypes.h"
+#include "llvm/Function.h"
+#include "llvm/Instructions.h"
+#include "llvm/LLVMContext.h"
+#include "llvm/Module.h"
+#endif
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+using namespace klee;
+
+namespace {
+
+unsigned getSize() {
+  const char *size = getenv("TX_BENCHMARK_SIZE");
+  return size ? atoi(size) : 100;
+}
+
+void report(const char *name, unsigned count, uint64_t microseconds) {
+  llvm::errs() << name << ": " << count << " in " << microseconds << " us";
+  if (count)
+    llvm::errs() << " (" << (double)microseconds / count << " us each)";
+  llvm::errs() << "\n";
+}
+
+/// A function of the given number of allocas, standing for the program
+/// values and the call sites of the synthetic data
+class SyntheticModule {
+  llvm::LLVMContext context;
+  llvm::Module *module;
+
+public:
+  std::vector<llvm::Instruction *> values;
+
+  SyntheticModule(unsigned size) : module(new llvm::Module("bench", context)) {
+    llvm::Type *int32 = llvm::Type::getInt32Ty(context);
+    llvm::FunctionType *type =
+        llvm::FunctionType::get(int32, std::vector<llvm::Type *>(), false);
+    llvm::Function *f = llvm::Function::Create(
+        type, llvm::GlobalValue::ExternalLinkage, "bench", module);
+    llvm::BasicBlock *bb = llvm::BasicBlock::Create(context, "entry", f);
+    for (unsigned i = 0; i < size; ++i)
+      values.push_back(new llvm::AllocaInst(int32, "", bb));
+  }
+
+  ~SyntheticModule() { delete module; }
+};
+
+TEST(TxBenchmarkTest, StoreUpdateAndRetrieval) {
+  unsigned size = getSize();
+  SyntheticModule m(size);
+  std::vector<llvm::Instruction *> callHistory;
+
+  TxStore *root = TxStore::create(0);
+  TxStore *store = TxStore::create(root);
+  root->setLeftChild(store);
+  TxVersionedValues valuesMap(0);
+
+  WallTimer updateTimer;
+  for (unsigned i = 0; i < size; ++i) {
+    ref<Expr> address = Expr::createPointer(0x1000 + 8 * i);
+    ref<TxStateAddress> location =
+        TxStateAddress::create(m.values[i], callHistory, address, 4);
+    ref<TxStateValue> addressValue =
+        TxStateValue::create(1, m.values[i], callHistory, address);
+    ref<TxStateValue> value = TxStateValue::create(
+        1, m.values[i], callHistory, ConstantExpr::create(i, Expr::Int32));
+    store->updateStore(valuesMap, location, addressValue, value);
+  }
+  report("TxStore::updateStore", size, updateTimer.check());
+
+  std::map<ref<Expr>, ref<Expr> > substitution;
+  std::set<const Array *> replacements;
+  TxStore::TopStateStore internalStore;
+  TxStore::LowerStateStore concretelyAddressedHistoricalStore;
+  TxStore::LowerStateStore symbolicallyAddressedHistoricalStore;
+  WallTimer retrievalTimer;
+  store->getStoredExpressions(
+      store, callHistory, substitution, replacements, false, true,
+      internalStore, concretelyAddressedHistoricalStore,
+      symbolicallyAddressedHistoricalStore);
+  report("TxStore::getStoredExpressions", size, retrievalTimer.check());
+  EXPECT_EQ(size, internalStore.size());
+
+  delete store;
+  delete root;
+}
+
+TEST(TxBenchmarkTest, PathConditionPacking) {
+  unsigned size = getSize();
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", size);
+  TxShadowArray::createShadowArray(ac, array);
+
+  // A path condition of one constraint per node, all in the final core
+  std::vector<TxPathCondition *> nodes;
+  std::vector<ref<Expr> > core;
+  nodes.push_back(TxPathCondition::create(0));
+  WallTimer addTimer;
+  for (unsigned i = 0; i < size; ++i) {
+    TxPathCondition *child = TxPathCondition::create(nodes.back());
+    nodes.back()->setLeftChild(child);
+    ref<Expr> constraint = UltExpr::create(
+        ReadExpr::create(UpdateList(array, 0), ConstantExpr::create(i, 32)),
+        ConstantExpr::create(i % 256, Expr::Int8));
+    child->addConstraint(constraint, ref<TxStateValue>());
+    core.push_back(constraint);
+    nodes.push_back(child);
+  }
+  report("TxPathCondition::addConstraint", size, addTimer.check());
+
+  WallTimer markTimer;
+  nodes.back()->unsatCoreInterpolation(core);
+  report("TxPathCondition::unsatCoreInterpolation", size, markTimer.check());
+
+  std::set<const Array *> replacements;
+  std::map<ref<Expr>, ref<Expr> > substitution;
+  WallTimer packTimer;
+  for (unsigned i = 1; i < nodes.size(); ++i)
+    nodes[i]->packInterpolant(replacements, substitution);
+  report("TxPathCondition::packInterpolant", size, packTimer.check());
+
+  for (std::vector<TxPathCondition *>::reverse_iterator it = nodes.rbegin(),
+                                                        ie = nodes.rend();
+       it != ie; ++it)
+    delete *it;
+}
+
+TEST(TxBenchmarkTest, TableInsertion) {
+  unsigned size = getSize();
+  SyntheticModule m(size);
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  std::set<const Array *> existentials;
+
+  // The entries are spread over a few program points, each with call
+  // histories of up to four call sites.
+  WallTimer insertTimer;
+  for (unsigned i = 0; i < size; ++i) {
+    std::vector<llvm::Instruction *> callHistory;
+    for (unsigned j = 0; j < i % 4; ++j)
+      callHistory.push_back(m.values[(i + j) % size]);
+    ref<Expr> interpolant = UltExpr::create(
+        ReadExpr::create(UpdateList(array, 0), ConstantExpr::create(0, 32)),
+        ConstantExpr::create(i % 256, Expr::Int8));
+    uintptr_t programPoint = i % 16 + 1;
+    TxSubsumptionTable::insert(
+        programPoint, callHistory,
+        new TxSubsumptionTableEntry(programPoint, 0, interpolant,
+                                    existentials));
+  }
+  report("TxSubsumptionTable::insert", size, insertTimer.check());
+
+  WallTimer lookupTimer;
+  unsigned found = 0;
+  for (unsigned i = 0; i < size; ++i)
+    found += TxSubsumptionTable::hasEntries(i % 32 + 1);
+  report("TxSubsumptionTable::hasEntries", size, lookupTimer.check());
+  EXPECT_EQ((size / 32) * 16 + std::min(size % 32, 16u), found);
+
+  TxSubsumptionTable::clear();
+}
+}
@@ -0,0 +1,23 @@
+/*
+ * Benchmark: a loop over a symbolic array with a branch per element, where
+ * the paths join after each iteration, so that most of them are subsumed.
+ */
+
+#include <klee/klee.h>
+
+#define N 12
+
+int main() {
+  int a[N];
+  int i, sum = 0;
+
+  klee_make_symbolic(a, sizeof(a), "a");
+  for (i = 0; i < N; i++) {
+    if (a[i] > 0)
+      sum += 2;
+    else
+      sum += 1;
+  }
+  klee_assert(sum >= N);
+  return 0;
+}
@@ -0,0 +1,34 @@
+/*
+ * Benchmark: a small parser of signed decimal numbers over a symbolic
+ * string, where the paths depend on the characters read.
+ */
+
+#include <klee/klee.h>
+
+#define N 8
+
+static int parse(const char *s) {
+  int sign = 1, value = 0;
+
+  if (*s == '-') {
+    sign = -1;
+    s++;
+  } else if (*s == '+') {
+    s++;
+  }
+  while (*s >= '0' && *s <= '9') {
+    value = value * 10 + (*s - '0');
+    s++;
+  }
+  if (*s != '\0')
+    return 0;
+  return sign * value;
+}
+
+int main() {
+  char s[N];
+
+  klee_make_symbolic(s, sizeof(s), "s");
+  s[N - 1] = '\0';
+  return parse(s) == 42;
+}
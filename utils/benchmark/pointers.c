@@ -0,0 +1,35 @@
+/*
+ * Benchmark: stores through pointers chosen by symbolic conditions into a
+ * linked list, exercising the interpolation of memory.
+ */
+
+#include <klee/klee.h>
+
+#define N 8
+
+struct node {
+  int value;
+  struct node *next;
+};
+
+int main() {
+  struct node nodes[N];
+  int choice[N];
+  struct node *p;
+  int i;
+
+  klee_make_symbolic(choice, sizeof(choice), "choice");
+  for (i = 0; i < N; i++) {
+    nodes[i].value = 0;
+    nodes[i].next = i + 1 < N ? &nodes[i + 1] : 0;
+  }
+
+  for (i = 0; i < N; i++) {
+    p = choice[i] ? &nodes[i] : &nodes[N - 1 - i];
+    p->value += i;
+  }
+
+  for (p = &nodes[0]; p; p = p->next)
+    klee_assert(p->value < N * N);
+  return 0;
+}